@@ -0,0 +1,156 @@
+/*
+ * OpenCrank C++ - Benchmark Harness Implementation
+ */
+#include "bench.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+namespace opencrank {
+namespace bench {
+
+namespace {
+
+volatile size_t g_sink = 0;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t time_batch(const BenchRunner::Op& op, uint64_t iterations) {
+    size_t sink = 0;
+    int64_t start = now_ns();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        sink += op();
+    }
+    int64_t elapsed = now_ns() - start;
+    g_sink = g_sink + sink;
+    return elapsed;
+}
+
+std::string format_ns(double ns) {
+    char buf[32];
+    if (ns >= 1e9) snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+    else if (ns >= 1e6) snprintf(buf, sizeof(buf), "%.2f ms", ns / 1e6);
+    else if (ns >= 1e3) snprintf(buf, sizeof(buf), "%.2f us", ns / 1e3);
+    else snprintf(buf, sizeof(buf), "%.0f ns", ns);
+    return buf;
+}
+
+} // anonymous namespace
+
+BenchRunner::BenchRunner(int min_time_ms, size_t samples, const std::string& filter)
+    : min_time_ns_(static_cast<int64_t>(min_time_ms > 0 ? min_time_ms : 1) * 1000000)
+    , samples_(samples > 0 ? samples : 1)
+    , filter_(filter) {}
+
+bool BenchRunner::selected(const std::string& name) const {
+    return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+void BenchRunner::run(const std::string& name, size_t bytes_per_op, const Op& op) {
+    if (!selected(name)) return;
+
+    // Warm caches and lazy state, then grow the batch to the sample length
+    time_batch(op, 1);
+    int64_t target = min_time_ns_ / static_cast<int64_t>(samples_);
+    uint64_t iterations = 1;
+    while (true) {
+        int64_t elapsed = time_batch(op, iterations);
+        if (elapsed >= target || iterations >= (1ull << 30)) break;
+        uint64_t next = elapsed > 0
+            ? static_cast<uint64_t>(static_cast<double>(iterations) * 1.2 * static_cast<double>(target) / static_cast<double>(elapsed))
+            : iterations * 10;
+        iterations = std::max(iterations + 1, std::min(next, iterations * 10));
+    }
+
+    std::vector<double> per_op;
+    per_op.reserve(samples_);
+    for (size_t s = 0; s < samples_; ++s) {
+        per_op.push_back(static_cast<double>(time_batch(op, iterations)) / static_cast<double>(iterations));
+    }
+    add(name, iterations, bytes_per_op, per_op);
+}
+
+void BenchRunner::add(const std::string& name, uint64_t iterations, size_t bytes_per_op,
+                      std::vector<double> per_op) {
+    if (per_op.empty()) return;
+    std::sort(per_op.begin(), per_op.end());
+
+    BenchResult r;
+    r.name = name;
+    r.iterations = iterations;
+    r.samples = per_op.size();
+    r.ns_median = per_op[per_op.size() / 2];
+    r.ns_min = per_op.front();
+    r.ns_max = per_op.back();
+    r.bytes_per_op = bytes_per_op;
+    results_.push_back(r);
+
+    printf("%-44s %12s  (min %s, max %s", name.c_str(), format_ns(r.ns_median).c_str(),
+           format_ns(r.ns_min).c_str(), format_ns(r.ns_max).c_str());
+    if (r.mb_per_s() > 0) printf(", %.1f MB/s", r.mb_per_s());
+    printf(")\n");
+    fflush(stdout);
+}
+
+Json BenchRunner::to_json(const Json& meta) const {
+    Json out;
+    out["meta"] = meta;
+    Json list = Json::array();
+    for (size_t i = 0; i < results_.size(); ++i) {
+        const BenchResult& r = results_[i];
+        Json j;
+        j["name"] = r.name;
+        j["iterations"] = r.iterations;
+        j["samples"] = r.samples;
+        j["ns_median"] = r.ns_median;
+        j["ns_min"] = r.ns_min;
+        j["ns_max"] = r.ns_max;
+        if (r.bytes_per_op) {
+            j["bytes_per_op"] = r.bytes_per_op;
+            j["mb_per_s"] = r.mb_per_s();
+        }
+        list.push_back(j);
+    }
+    out["results"] = list;
+    return out;
+}
+
+size_t compare_results(const Json& baseline, const std::vector<BenchResult>& current, double threshold_pct) {
+    std::map<std::string, double> before;
+    if (baseline.contains("results") && baseline["results"].is_array()) {
+        for (Json::const_iterator it = baseline["results"].begin(); it != baseline["results"].end(); ++it) {
+            if (it->contains("name") && it->contains("ns_median")) {
+                before[(*it)["name"].get<std::string>()] = (*it)["ns_median"].get<double>();
+            }
+        }
+    }
+
+    size_t regressions = 0;
+    printf("\n%-44s %12s %12s %9s\n", "case", "baseline", "current", "change");
+    for (size_t i = 0; i < current.size(); ++i) {
+        const BenchResult& r = current[i];
+        std::map<std::string, double>::const_iterator it = before.find(r.name);
+        if (it == before.end() || it->second <= 0) {
+            printf("%-44s %12s %12s %9s\n", r.name.c_str(), "-", format_ns(r.ns_median).c_str(), "new");
+            continue;
+        }
+        double change = (r.ns_median - it->second) * 100.0 / it->second;
+        const char* flag = "";
+        if (change > threshold_pct) {
+            flag = "  SLOWER";
+            ++regressions;
+        } else if (change < -threshold_pct) {
+            flag = "  faster";
+        }
+        printf("%-44s %12s %12s %+8.1f%%%s\n", r.name.c_str(), format_ns(it->second).c_str(),
+               format_ns(r.ns_median).c_str(), change, flag);
+    }
+    return regressions;
+}
+
+} // namespace bench
+} // namespace opencrank
@@ -0,0 +1,79 @@
+/*
+ * opencrank C++ - Benchmark Harness
+ *
+ * Each case is a callable timed in batches: the batch size is grown until a
+ * batch takes at least min_time / samples, then `samples` batches are run
+ * and the per-operation time of each is recorded. The median is the figure
+ * to compare between builds; min and max show how noisy the machine was.
+ *
+ * Callables return a value derived from their result (a size, a count),
+ * which is folded into a sink so the optimizer cannot drop the work.
+ */
+#ifndef opencrank_BENCH_BENCH_HPP
+#define opencrank_BENCH_BENCH_HPP
+
+#include <opencrank/core/json.hpp>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace opencrank {
+namespace bench {
+
+struct BenchResult {
+    std::string name;           // group/case
+    uint64_t iterations;        // Operations per sample
+    size_t samples;
+    double ns_median;           // Per operation
+    double ns_min;
+    double ns_max;
+    size_t bytes_per_op;        // Input size, for throughput (0 = n/a)
+
+    BenchResult() : iterations(0), samples(0), ns_median(0), ns_min(0), ns_max(0), bytes_per_op(0) {}
+
+    double mb_per_s() const {
+        return bytes_per_op && ns_median > 0 ? static_cast<double>(bytes_per_op) * 1e3 / ns_median : 0.0;
+    }
+};
+
+class BenchRunner {
+public:
+    typedef std::function<size_t()> Op;
+
+    // filter: run only cases whose name contains it ("" = all)
+    BenchRunner(int min_time_ms, size_t samples, const std::string& filter);
+
+    // Time op unless filtered out; prints one line per case
+    void run(const std::string& name, size_t bytes_per_op, const Op& op);
+
+    // Whether the filter lets name through
+    bool selected(const std::string& name) const;
+
+    // Record a case timed by the caller: per_op holds one figure per
+    // sample, in ns per operation
+    void add(const std::string& name, uint64_t iterations, size_t bytes_per_op, std::vector<double> per_op);
+
+    size_t samples() const { return samples_; }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+    // {"meta": {...}, "results": [...]}
+    Json to_json(const Json& meta) const;
+
+private:
+    int64_t min_time_ns_;
+    size_t samples_;
+    std::string filter_;
+    std::vector<BenchResult> results_;
+};
+
+// Print per-case change of the median against a previous to_json() file.
+// Returns the number of cases slower by more than threshold_pct.
+size_t compare_results(const Json& baseline, const std::vector<BenchResult>& current, double threshold_pct);
+
+} // namespace bench
+} // namespace opencrank
+
+#endif // opencrank_BENCH_BENCH_HPP
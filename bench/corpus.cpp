@@ -0,0 +1,130 @@
+/*
+ * OpenCrank C++ - Benchmark Corpus Implementation
+ */
+#include "corpus.hpp"
+#include <opencrank/core/html_tokenizer.hpp>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace opencrank {
+namespace bench {
+
+namespace {
+
+bool read_file(const std::string& path, std::string& out) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in.is_open()) return false;
+    std::ostringstream buf;
+    buf << in.rdbuf();
+    out = buf.str();
+    return true;
+}
+
+std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+} // anonymous namespace
+
+uint64_t Rng::next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 0x2545f4914f6cdd1dull;
+}
+
+bool Corpus::load(const std::string& dir, std::string& error) {
+    std::string outputs;
+    if (!read_file(dir + "/model_outputs.txt", outputs)) {
+        error = "cannot read " + dir + "/model_outputs.txt";
+        return false;
+    }
+    if (!read_file(dir + "/page.html", page_)) {
+        error = "cannot read " + dir + "/page.html";
+        return false;
+    }
+
+    model_outputs_.clear();
+    ModelOutput current;
+    current.label = "prose";
+    std::istringstream lines(outputs);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.compare(0, 5, "=====") == 0) {
+            current.text = trim(current.text);
+            if (!current.text.empty()) model_outputs_.push_back(current);
+            current = ModelOutput();
+            current.label = trim(line.substr(5));
+            std::replace(current.label.begin(), current.label.end(), ' ', '_');
+            continue;
+        }
+        current.text += line;
+        current.text += '\n';
+    }
+    current.text = trim(current.text);
+    if (!current.text.empty()) model_outputs_.push_back(current);
+
+    // Vocabulary from the visible text, in first-seen order
+    HtmlTokenizer tokenizer(HtmlTokenizer::TEXT);
+    tokenizer.feed(page_);
+    tokenizer.finish();
+    std::set<std::string> seen;
+    std::string word;
+    const std::string& text = tokenizer.text();
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (std::isalpha(c)) {
+            word += static_cast<char>(std::tolower(c));
+        } else {
+            if (word.size() >= 3 && seen.insert(word).second) words_.push_back(word);
+            word.clear();
+        }
+    }
+    if (words_.empty()) {
+        error = "page.html has no text";
+        return false;
+    }
+    return true;
+}
+
+std::string Corpus::large_page(size_t bytes) const {
+    size_t start = page_.find("<article>");
+    size_t end = page_.find("</article>");
+    if (start == std::string::npos || end == std::string::npos) return page_;
+    end += 10;
+
+    std::string article = page_.substr(start, end - start);
+    std::string out = page_.substr(0, end);
+    while (out.size() + (page_.size() - end) < bytes) out += article;
+    out += page_.substr(end);
+    return out;
+}
+
+std::string Corpus::prose(size_t bytes, uint64_t seed, bool paragraphs) const {
+    Rng rng(seed);
+    std::string out;
+    out.reserve(bytes + 64);
+    while (out.size() < bytes) {
+        size_t sentence = 6 + rng.below(14);
+        for (size_t w = 0; w < sentence; ++w) {
+            std::string word = words_[rng.below(words_.size())];
+            if (w == 0) word[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(word[0])));
+            out += word;
+            out += (w + 1 < sentence) ? " " : ". ";
+        }
+        if (paragraphs && rng.below(5) == 0) {
+            out.erase(out.size() - 1);
+            out += "\n\n";
+        }
+    }
+    return out;
+}
+
+} // namespace bench
+} // namespace opencrank
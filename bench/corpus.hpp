@@ -0,0 +1,66 @@
+/*
+ * opencrank C++ - Benchmark Corpus
+ *
+ * Inputs for the benchmarks: recorded model outputs and a captured web page
+ * from bench/corpus, plus larger inputs derived from them with a fixed seed
+ * (a long page, prose documents, memory entries), so every run and every
+ * machine measures exactly the same bytes.
+ *
+ * model_outputs.txt holds one response per section; a line starting with
+ * "=====" begins a new section and names it.
+ */
+#ifndef opencrank_BENCH_CORPUS_HPP
+#define opencrank_BENCH_CORPUS_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace opencrank {
+namespace bench {
+
+// xorshift64*: same sequence everywhere for a given seed
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : state_(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+    uint64_t next();
+    size_t below(size_t n) { return n ? static_cast<size_t>(next() % n) : 0; }
+
+private:
+    uint64_t state_;
+};
+
+struct ModelOutput {
+    std::string label;
+    std::string text;
+};
+
+class Corpus {
+public:
+    // Read the files in dir; false with error when one is missing
+    bool load(const std::string& dir, std::string& error);
+
+    const std::vector<ModelOutput>& model_outputs() const { return model_outputs_; }
+    const std::string& page() const { return page_; }
+
+    // The page with its <article> repeated until it is about bytes long
+    std::string large_page(size_t bytes) const;
+
+    // Sentences of words taken from the page's text; paragraphs end in a
+    // blank line when paragraphs is set
+    std::string prose(size_t bytes, uint64_t seed, bool paragraphs) const;
+
+    // Vocabulary of the page (lowercase, at least 3 letters)
+    const std::vector<std::string>& words() const { return words_; }
+
+private:
+    std::vector<ModelOutput> model_outputs_;
+    std::string page_;
+    std::vector<std::string> words_;
+};
+
+} // namespace bench
+} // namespace opencrank
+
+#endif // opencrank_BENCH_CORPUS_HPP
@@ -0,0 +1,321 @@
+/*
+ * OpenCrank C++ - Hot-path Benchmarks
+ *
+ * Usage: opencrank-bench [--corpus DIR] [--filter TEXT] [--min-time MS]
+ *                        [--samples N] [--json FILE] [--compare FILE]
+ *                        [--threshold PCT] [--replay PATH]...
+ *
+ * `make bench` builds this against the core objects and writes
+ * build/bench.json. Keep that file from one build and pass it as --compare
+ * to the next: cases slower by more than the threshold are flagged and
+ * make the exit status 1.
+ *
+ * --replay adds the agent runs recorded under agent.record_dir (a file or
+ * a directory of them) as replay/<run>/<stage> cases, in CPU time; a run
+ * that no longer replays the way it was recorded also fails the exit
+ * status.
+ */
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "replay.hpp"
+#include <opencrank/core/agent.hpp>
+#include <opencrank/core/application.hpp>
+#include <opencrank/core/content_chunker.hpp>
+#include <opencrank/core/html_tokenizer.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/memory/store.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#ifndef BENCH_REV
+#define BENCH_REV "unknown"
+#endif
+#ifndef BENCH_CXXFLAGS
+#define BENCH_CXXFLAGS ""
+#endif
+
+using namespace opencrank;
+using namespace opencrank::bench;
+
+namespace {
+
+struct Options {
+    std::string corpus_dir;
+    std::string filter;
+    int min_time_ms;
+    size_t samples;
+    std::string json_path;
+    std::string compare_path;
+    double threshold_pct;
+    std::vector<std::string> replay_paths;
+
+    Options() : corpus_dir("bench/corpus"), min_time_ms(400), samples(9), threshold_pct(10.0) {}
+};
+
+void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --corpus DIR      Corpus directory (default bench/corpus)\n"
+            "  --filter TEXT     Only cases whose name contains TEXT\n"
+            "  --min-time MS     Time spent measuring each case (default 400)\n"
+            "  --samples N       Timed batches per case (default 9)\n"
+            "  --json FILE       Write results as JSON\n"
+            "  --compare FILE    Compare against an earlier --json file\n"
+            "  --threshold PCT   Slowdown flagged by --compare (default 10)\n"
+            "  --replay PATH     Replay recorded agent runs (file or directory; repeatable)\n", prog);
+}
+
+bool parse_args(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--corpus" && has_value) opts.corpus_dir = argv[++i];
+        else if (arg == "--filter" && has_value) opts.filter = argv[++i];
+        else if (arg == "--min-time" && has_value) opts.min_time_ms = atoi(argv[++i]);
+        else if (arg == "--samples" && has_value) opts.samples = static_cast<size_t>(atoi(argv[++i]));
+        else if (arg == "--json" && has_value) opts.json_path = argv[++i];
+        else if (arg == "--compare" && has_value) opts.compare_path = argv[++i];
+        else if (arg == "--threshold" && has_value) opts.threshold_pct = atof(argv[++i]);
+        else if (arg == "--replay" && has_value) opts.replay_paths.push_back(argv[++i]);
+        else return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Suites
+// ============================================================================
+
+void bench_tool_calls(BenchRunner& runner, const Corpus& corpus) {
+    Agent agent;
+    const std::vector<ModelOutput>& outputs = corpus.model_outputs();
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        const std::string& text = outputs[i].text;
+        runner.run("parse_tool_calls/" + outputs[i].label, text.size(), [&agent, &text]() {
+            std::vector<ParsedToolCall> calls = agent.parse_tool_calls(text);
+            return calls.size() + (calls.empty() ? 0 : calls[0].params.size());
+        });
+    }
+
+    // A long answer with one call at the end: the scan over prose dominates
+    std::string long_answer = corpus.prose(32 * 1024, 7, true) +
+        "\n{\"tool\": \"memory_save\", \"arguments\": {\"content\": \"done\"}}";
+    runner.run("parse_tool_calls/long_answer", long_answer.size(), [&agent, &long_answer]() {
+        return agent.parse_tool_calls(long_answer).size();
+    });
+}
+
+void bench_html(BenchRunner& runner, const Corpus& corpus) {
+    const std::string& page = corpus.page();
+    std::string large = corpus.large_page(256 * 1024);
+
+    struct Input { const char* name; const std::string* html; };
+    Input inputs[] = { { "page", &page }, { "large_page", &large } };
+    for (size_t i = 0; i < 2; ++i) {
+        const std::string& html = *inputs[i].html;
+        std::string suffix = inputs[i].name;
+        runner.run("html_text/" + suffix, html.size(), [&html]() {
+            HtmlTokenizer tokenizer(HtmlTokenizer::TEXT);
+            tokenizer.feed(html);
+            tokenizer.finish();
+            return tokenizer.text().size();
+        });
+        runner.run("html_text_links_forms/" + suffix, html.size(), [&html]() {
+            HtmlTokenizer tokenizer(HtmlTokenizer::TEXT | HtmlTokenizer::LINKS | HtmlTokenizer::FORMS);
+            tokenizer.feed(html);
+            tokenizer.finish();
+            return tokenizer.text().size() + tokenizer.links().size() + tokenizer.forms().size();
+        });
+        runner.run("strip_html_for_ai/" + suffix, html.size(), [&html]() {
+            return strip_html_for_ai(html).size();
+        });
+    }
+}
+
+void bench_chunker(BenchRunner& runner, const Corpus& corpus) {
+    ContentChunker chunker;
+    size_t total = 0;
+    for (uint64_t doc = 0; doc < 16; ++doc) {
+        std::string content = corpus.prose(128 * 1024, 100 + doc, true);
+        if (doc == 11) content.insert(content.size() / 2, " quarterly zanzibar report ");
+        total += content.size();
+        chunker.store(content, "bench://doc/" + std::to_string(doc));
+    }
+
+    const std::vector<std::string>& words = corpus.words();
+    std::string common = words[words.size() / 3];
+    runner.run("search_all_chunks/common_word", total, [&chunker, &common]() {
+        return chunker.search_all_chunks(common).size();
+    });
+    runner.run("search_all_chunks/rare_phrase", total, [&chunker]() {
+        return chunker.search_all_chunks("Zanzibar Report").size();
+    });
+    runner.run("search_all_chunks/no_match", total, [&chunker]() {
+        return chunker.search_all_chunks("xylophone").size();
+    });
+    runner.run("search_all_chunks/regex", total, [&chunker]() {
+        return chunker.search_all_chunks("zanzibar\\s+rep[a-z]+", 300, true).size();
+    });
+}
+
+// Seeded memory DB in a temporary directory, removed afterwards
+void bench_memory(BenchRunner& runner, const Corpus& corpus) {
+    char dir_template[] = "/tmp/opencrank-bench-XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        fprintf(stderr, "memory: cannot create a temporary directory\n");
+        return;
+    }
+    std::string dir = dir_template;
+    std::string db_path = dir + "/memory.db";
+
+    {
+        MemoryStore store;
+        if (!store.open(db_path)) {
+            fprintf(stderr, "memory: cannot open %s\n", db_path.c_str());
+            rmdir(dir.c_str());
+            return;
+        }
+
+        // Several writers so the store group-commits the seed data
+        const size_t entries = 4000;
+        const size_t writers = 8;
+        static const char* categories[] = { "general", "note", "resume", "preference" };
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < writers; ++w) {
+            threads.push_back(std::thread([&corpus, &store, w, entries, writers]() {
+                for (size_t i = w; i < entries; i += writers) {
+                    MemoryEntry entry;
+                    entry.id = "bench-" + std::to_string(i);
+                    entry.content = corpus.prose(200 + (i % 7) * 120, 1000 + i, false);
+                    entry.category = categories[i % 4];
+                    entry.importance = static_cast<int>(1 + i % 10);
+                    entry.created_at = entry.updated_at = 1700000000000LL + static_cast<int64_t>(i) * 60000;
+                    store.save_memory(entry);
+                }
+            }));
+        }
+        for (size_t w = 0; w < threads.size(); ++w) threads[w].join();
+
+        const std::vector<std::string>& words = corpus.words();
+        std::string one = words[words.size() / 2];
+        std::string three = words[5] + " " + words[17] + " " + words[29];
+        runner.run("search_memories/one_word", 0, [&store, &one]() {
+            return store.search_memories(one, 10).size();
+        });
+        runner.run("search_memories/three_words", 0, [&store, &three]() {
+            return store.search_memories(three, 10).size();
+        });
+        runner.run("search_memories/category", 0, [&store, &one]() {
+            return store.search_memories(one, 10, "note").size();
+        });
+        runner.run("search_memories/no_match", 0, [&store]() {
+            return store.search_memories("xylophone", 10).size();
+        });
+        store.close();
+    }
+
+    const char* suffixes[] = { "", "-wal", "-shm", NULL };
+    for (int i = 0; suffixes[i]; ++i) unlink((db_path + suffixes[i]).c_str());
+    rmdir(dir.c_str());
+}
+
+void bench_split(BenchRunner& runner, const Corpus& corpus) {
+    std::string with_newlines = corpus.prose(64 * 1024, 42, true);
+    runner.run("split_message_chunks/paragraphs", with_newlines.size(), [&with_newlines]() {
+        return split_message_chunks(with_newlines, 4096).size();
+    });
+
+    // No newline to split at: every cut goes through truncate_safe
+    std::string one_line;
+    while (one_line.size() < 64 * 1024) one_line += "Ação rápida — naïve café. ";
+    runner.run("split_message_chunks/one_line_utf8", one_line.size(), [&one_line]() {
+        return split_message_chunks(one_line, 4096).size();
+    });
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+    Logger::instance().set_level(LogLevel::WARN);
+
+    Corpus corpus;
+    std::string error;
+    if (!corpus.load(opts.corpus_dir, error)) {
+        fprintf(stderr, "Corpus: %s\n", error.c_str());
+        return 2;
+    }
+
+    printf("opencrank-bench %s (%s)\n\n", BENCH_REV, BENCH_CXXFLAGS);
+    BenchRunner runner(opts.min_time_ms, opts.samples, opts.filter);
+    bench_tool_calls(runner, corpus);
+    bench_html(runner, corpus);
+    bench_chunker(runner, corpus);
+    bench_memory(runner, corpus);
+    bench_split(runner, corpus);
+
+    size_t replay_failures = 0;
+    if (!opts.replay_paths.empty()) {
+        std::vector<std::string> recordings;
+        for (size_t i = 0; i < opts.replay_paths.size(); ++i) {
+            std::vector<std::string> found = find_recordings(opts.replay_paths[i]);
+            if (found.empty()) fprintf(stderr, "Replay: no recordings at %s\n", opts.replay_paths[i].c_str());
+            recordings.insert(recordings.end(), found.begin(), found.end());
+        }
+        printf("\n");
+        replay_failures = bench_replay(runner, recordings);
+    }
+
+    if (!opts.json_path.empty()) {
+        Json meta;
+        meta["rev"] = BENCH_REV;
+        meta["cxxflags"] = BENCH_CXXFLAGS;
+        meta["compiler"] = __VERSION__;
+        meta["threads"] = std::thread::hardware_concurrency();
+        meta["timestamp"] = current_timestamp();
+        meta["min_time_ms"] = opts.min_time_ms;
+        meta["samples"] = opts.samples;
+        std::ofstream out(opts.json_path.c_str());
+        if (!out.is_open()) {
+            fprintf(stderr, "Cannot write %s\n", opts.json_path.c_str());
+            return 2;
+        }
+        out << runner.to_json(meta).dump(2) << "\n";
+        printf("\nWrote %s\n", opts.json_path.c_str());
+    }
+
+    if (!opts.compare_path.empty()) {
+        std::ifstream in(opts.compare_path.c_str());
+        Json baseline;
+        try {
+            in >> baseline;
+        } catch (const std::exception& e) {
+            fprintf(stderr, "Cannot read %s: %s\n", opts.compare_path.c_str(), e.what());
+            return 2;
+        }
+        if (baseline.contains("meta") && baseline["meta"].value("cxxflags", std::string()) != BENCH_CXXFLAGS) {
+            printf("\nNote: baseline was built with different flags (%s)\n",
+                   baseline["meta"].value("cxxflags", std::string()).c_str());
+        }
+        size_t slower = compare_results(baseline, runner.results(), opts.threshold_pct);
+        if (slower > 0) {
+            printf("\n%zu case(s) slower than the baseline by more than %.0f%%\n", slower, opts.threshold_pct);
+            return 1;
+        }
+    }
+    if (replay_failures > 0) {
+        printf("\n%zu recorded run(s) could not be read or diverged from the recording\n", replay_failures);
+        return 1;
+    }
+    return 0;
+}
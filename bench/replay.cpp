@@ -0,0 +1,285 @@
+/*
+ * OpenCrank C++ - Recorded Run Replay Implementation
+ */
+#include "replay.hpp"
+#include <opencrank/ai/ai.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/trace.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+namespace opencrank {
+namespace bench {
+
+namespace {
+
+int64_t thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void diverged(std::vector<std::string>& divergences, const std::string& what) {
+    // Retries repeat the same miss
+    if (divergences.empty() || divergences.back() != what) divergences.push_back(what);
+}
+
+std::string clip(const std::string& s, size_t max) {
+    return s.size() <= max ? s : s.substr(0, max) + "...";
+}
+
+// Answers with the recorded replies, in order
+class ReplayProvider : public AIPlugin {
+public:
+    ReplayProvider(const RunRecording& rec, std::vector<std::string>& divergences)
+        : rec_(rec), divergences_(divergences), next_(0) {}
+
+    const char* name() const override { return "replay"; }
+    const char* version() const override { return "1.0"; }
+    bool init(const Config&) override { return true; }
+    void shutdown() override {}
+
+    std::string provider_id() const override { return rec_.provider; }
+    std::vector<std::string> available_models() const override { return std::vector<std::string>(1, rec_.model); }
+    std::string default_model() const override { return rec_.model; }
+    bool is_configured() const override { return true; }
+    bool supports_native_tools() const override { return rec_.native_tools; }
+
+    CompletionResult complete(const std::string&, const CompletionOptions&) override {
+        diverged(divergences_, "complete() called; only chat() replies are recorded");
+        return CompletionResult::fail("replay: no recorded completion");
+    }
+
+    CompletionResult chat(const std::vector<ConversationMessage>&, const CompletionOptions& opts) override {
+        if (next_ >= rec_.replies.size()) {
+            diverged(divergences_, "asked for reply " + std::to_string(next_ + 1) + " of " +
+                     std::to_string(rec_.replies.size()));
+            ++next_;
+            return CompletionResult::fail("replay: no more recorded replies");
+        }
+        const RecordedReply& reply = rec_.replies[next_++];
+        advance_manual_clock(reply.ms);
+        if (opts.on_chunk && !reply.result.content.empty()) {
+            stream(reply.result.content, reply.chunks, opts.on_chunk);
+        }
+        return reply.result;
+    }
+
+    size_t used() const { return next_; }
+
+private:
+    // Hand the text over in as many pieces as it arrived in, cut at
+    // UTF-8 character boundaries
+    static void stream(const std::string& text, size_t chunks, const StreamCallback& on_chunk) {
+        size_t piece = (text.size() + std::max<size_t>(chunks, 1) - 1) / std::max<size_t>(chunks, 1);
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = std::min(text.size(), pos + std::max<size_t>(piece, 1));
+            while (end < text.size() && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80) ++end;
+            on_chunk(text.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+
+    const RunRecording& rec_;
+    std::vector<std::string>& divergences_;
+    size_t next_;
+};
+
+// Recorded outputs by "tool:params", each key's in execution order
+struct ToolOutputs {
+    std::map<std::string, std::deque<const RecordedToolCall*> > by_call;
+    std::vector<std::string>* divergences;
+
+    AgentToolResult take(const std::string& tool, const Json& params) {
+        std::string key = tool + ":" + params.dump();
+        std::map<std::string, std::deque<const RecordedToolCall*> >::iterator it = by_call.find(key);
+        if (it == by_call.end() || it->second.empty()) {
+            diverged(*divergences, "no recorded output for " + clip(key, 120));
+            return AgentToolResult::fail("replay: no recorded output for this call");
+        }
+        const RecordedToolCall* call = it->second.front();
+        it->second.pop_front();
+        advance_manual_clock(call->ms);
+        return call->result;
+    }
+};
+
+// Self time (span minus its children) per category
+void stage_times(const Trace& trace, std::map<std::string, int64_t>& stages) {
+    std::vector<TraceSpan> spans = trace.spans();
+    std::map<uint32_t, int64_t> children;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        if (spans[i].parent) children[spans[i].parent] += spans[i].duration_us;
+    }
+    for (size_t i = 0; i < spans.size(); ++i) {
+        std::map<uint32_t, int64_t>::const_iterator c = children.find(spans[i].id);
+        int64_t self = spans[i].duration_us - (c == children.end() ? 0 : c->second);
+        stages[spans[i].category] += std::max<int64_t>(self, 0) * 1000;
+    }
+}
+
+// run-<32 hex id>.json -> first 8 of the id; other names as they are
+std::string label_for(const std::string& path) {
+    std::string name = path.substr(path.find_last_of('/') == std::string::npos ? 0 : path.find_last_of('/') + 1);
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) name.erase(name.size() - 5);
+    if (name.compare(0, 4, "run-") == 0) {
+        name.erase(0, 4);
+        if (name.size() == 32) name.erase(8);
+    }
+    return name;
+}
+
+} // anonymous namespace
+
+ReplayOutcome replay_run(const RunRecording& rec) {
+    ReplayOutcome out;
+    set_manual_clock(rec.started_ms);
+
+    ReplayProvider provider(rec, out.divergences);
+    ToolOutputs outputs;
+    outputs.divergences = &out.divergences;
+    for (size_t i = 0; i < rec.tool_calls.size(); ++i) {
+        const RecordedToolCall& call = rec.tool_calls[i];
+        outputs.by_call[call.tool + ":" + call.params].push_back(&call);
+    }
+
+    Agent agent;
+    for (size_t i = 0; i < rec.tools.size(); ++i) {
+        AgentTool tool = rec.tools[i];
+        std::string name = tool.name;
+        ToolOutputs* shared = &outputs;
+        tool.execute = [shared, name](const Json& params) { return shared->take(name, params); };
+        agent.register_tool(tool);
+    }
+
+    // One thread, no memo or response cache: every reply and tool output
+    // is taken from the recording in order
+    AgentConfig config = rec.config;
+    config.async_model_calls = false;
+    if (rec.streamed) {
+        config.on_partial = [](const std::string&) {};
+    }
+    if (!rec.prompt_context.empty()) {
+        const std::string* context = &rec.prompt_context;
+        config.prompt_context = [context]() { return *context; };
+    }
+    std::vector<ConversationMessage> history = rec.history;
+
+    Tracer::instance().set_cpu_clock(true);
+    int64_t start = thread_cpu_ns();
+    out.result = agent.run(&provider, rec.user_message, history, rec.system_prompt, config);
+    out.cpu_ns = thread_cpu_ns() - start;
+    Tracer::instance().set_cpu_clock(false);
+    clear_manual_clock();
+
+    std::shared_ptr<Trace> trace = Tracer::instance().last("");
+    if (trace && trace->id() == out.result.trace_id) {
+        stage_times(*trace, out.stage_ns);
+    }
+
+    if (provider.used() < rec.replies.size()) {
+        diverged(out.divergences, std::to_string(rec.replies.size() - provider.used()) +
+                 " recorded repl(ies) not asked for");
+    }
+    const AgentResult& was = rec.result;
+    const AgentResult& now = out.result;
+    if (now.iterations != was.iterations || now.tool_calls_made != was.tool_calls_made) {
+        diverged(out.divergences, "iterations/tool calls " + std::to_string(now.iterations) + "/" +
+                 std::to_string(now.tool_calls_made) + ", recorded " + std::to_string(was.iterations) +
+                 "/" + std::to_string(was.tool_calls_made));
+    }
+    if (now.success != was.success || now.paused != was.paused) {
+        diverged(out.divergences, std::string("ended ") + (now.success ? "ok" : now.paused ? "paused" : "failed") +
+                 ", recorded " + (was.success ? "ok" : was.paused ? "paused" : "failed"));
+    }
+    if (now.final_response != was.final_response) {
+        diverged(out.divergences, "final response differs: " + clip(now.final_response, 80));
+    }
+    return out;
+}
+
+std::vector<std::string> find_recordings(const std::string& path) {
+    std::vector<std::string> found;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return found;
+    if (!S_ISDIR(st.st_mode)) {
+        found.push_back(path);
+        return found;
+    }
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return found;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) {
+            found.push_back(path + "/" + name);
+        }
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+size_t bench_replay(BenchRunner& runner, const std::vector<std::string>& paths) {
+    // Replays retry tools and hit recorded errors: keep the output to results
+    LogLevel saved_level = Logger::instance().level();
+    Logger::instance().set_level(LogLevel::ERROR);
+
+    size_t bad = 0;
+    for (size_t p = 0; p < paths.size(); ++p) {
+        std::string prefix = "replay/" + label_for(paths[p]) + "/";
+        RunRecording rec;
+        std::string error;
+        if (!rec.load(paths[p], error)) {
+            printf("%s: %s\n", prefix.c_str(), error.c_str());
+            ++bad;
+            continue;
+        }
+
+        // The first run warms up and tells which stages there are
+        ReplayOutcome first = replay_run(rec);
+        std::vector<std::string> stages(1, "total");
+        for (std::map<std::string, int64_t>::const_iterator it = first.stage_ns.begin();
+             it != first.stage_ns.end(); ++it) {
+            stages.push_back(it->first);
+        }
+        bool any = false;
+        for (size_t s = 0; s < stages.size() && !any; ++s) any = runner.selected(prefix + stages[s]);
+        if (!any) continue;
+
+        printf("%s: %zu repl(ies), %zu tool output(s) -> %d iteration(s), %d tool call(s)\n",
+               prefix.substr(0, prefix.size() - 1).c_str(), rec.replies.size(), rec.tool_calls.size(),
+               first.result.iterations, first.result.tool_calls_made);
+        if (!first.divergences.empty()) {
+            ++bad;
+            for (size_t d = 0; d < first.divergences.size(); ++d) {
+                printf("  diverged: %s\n", first.divergences[d].c_str());
+            }
+        }
+
+        std::map<std::string, std::vector<double> > samples;
+        for (size_t n = 0; n < runner.samples(); ++n) {
+            ReplayOutcome run = replay_run(rec);
+            samples["total"].push_back(static_cast<double>(run.cpu_ns));
+            for (size_t s = 1; s < stages.size(); ++s) {
+                samples[stages[s]].push_back(static_cast<double>(run.stage_ns[stages[s]]));
+            }
+        }
+        for (size_t s = 0; s < stages.size(); ++s) {
+            if (runner.selected(prefix + stages[s])) {
+                runner.add(prefix + stages[s], 1, 0, samples[stages[s]]);
+            }
+        }
+    }
+
+    Logger::instance().set_level(saved_level);
+    return bad;
+}
+
+} // namespace bench
+} // namespace opencrank
@@ -0,0 +1,60 @@
+/*
+ * opencrank C++ - Recorded Run Replay
+ *
+ * Runs a recording made with agent.record_dir (see
+ * core/run_record.hpp) through the agent loop again, with nothing outside
+ * the process: a provider that answers with the recorded replies (streamed
+ * in as many chunks as they arrived in), tools registered under the
+ * recorded schemas that return the recorded output for the same params,
+ * and a manual clock that moves by the recorded latencies. The run stays
+ * on the calling thread, so its spans, timed in thread CPU time, add up
+ * to the CPU the loop itself spent.
+ *
+ * Stages are span categories, counted in self time (a span minus its
+ * children): agent (loop bookkeeping, prompt assembly, history), llm
+ * (taking in the streamed reply), parse (tool-call parsing and JSON
+ * recovery), tool (the tool wrapper and param checks), format (result
+ * formatting, chunking of large results, compaction), context.
+ *
+ * The provider's own work (HTTP, SSE parsing, context fitting) and the
+ * tools' real execution are not part of a replay; bench cases of their
+ * own cover those. Neither is early tool start, which needs a pool: the
+ * tool calls of a reply are parsed once it is complete.
+ */
+#ifndef opencrank_BENCH_REPLAY_HPP
+#define opencrank_BENCH_REPLAY_HPP
+
+#include "bench.hpp"
+#include <opencrank/core/run_record.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+namespace opencrank {
+namespace bench {
+
+struct ReplayOutcome {
+    int64_t cpu_ns;                             // Whole run
+    std::map<std::string, int64_t> stage_ns;    // Self time per span category
+    AgentResult result;
+    std::vector<std::string> divergences;       // Where the loop left the recording
+
+    ReplayOutcome() : cpu_ns(0) {}
+};
+
+// Replay rec once with a fresh agent
+ReplayOutcome replay_run(const RunRecording& rec);
+
+// path itself, or the *.json files in it when it is a directory (sorted)
+std::vector<std::string> find_recordings(const std::string& path);
+
+// Replay each recording runner.samples() times and add its CPU time per
+// stage as replay/<name>/<stage> (plus replay/<name>/total). Returns the
+// number of recordings that could not be read or diverged.
+size_t bench_replay(BenchRunner& runner, const std::vector<std::string>& paths);
+
+} // namespace bench
+} // namespace opencrank
+
+#endif // opencrank_BENCH_REPLAY_HPP
@@ -3,6 +3,15 @@
  * 
  * Abstract interface for AI/LLM providers.
  * Supports conversation history, system prompts, and streaming.
+ *
+ * Providers with a function-calling API (supports_native_tools()) receive
+ * the tools as schemas in CompletionOptions::tools and return the calls the
+ * model made in CompletionResult::tool_calls. The calls are also written
+ * into content as {"tool": ..., "arguments": ...} text, so history reads
+ * the same in both modes and the agent can fall back to the text protocol.
+ *
+ * Providers that implement chat_async() (supports_async()) let the agent
+ * wait for the model without holding a worker thread.
  */
 #ifndef opencrank_AI_AI_HPP
 #define opencrank_AI_AI_HPP
@@ -12,9 +21,14 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <utility>
+#include <atomic>
 
 namespace opencrank {
 
+class ThreadPool;
+class CancelToken;
+
 // Message role in a conversation
 enum class MessageRole {
     SYSTEM,
@@ -29,8 +43,19 @@ struct ConversationMessage {
     MessageRole role;
     std::string content;
     
-    ConversationMessage() : role(MessageRole::USER) {}
-    ConversationMessage(MessageRole r, const std::string& c) : role(r), content(c) {}
+    // Token count memoized by ContextManager. Only trusted while the counter
+    // and content size still match, so edits to content invalidate it.
+    mutable size_t token_count;
+    mutable size_t token_count_bytes;
+    mutable int token_counter_id;
+    
+    ConversationMessage()
+        : role(MessageRole::USER), token_count(0), token_count_bytes(0), token_counter_id(0) {}
+    ConversationMessage(MessageRole r, const std::string& c)
+        : role(r), content(c), token_count(0), token_count_bytes(0), token_counter_id(0) {}
+    // Takes over the buffer: tool results and responses can be megabytes
+    ConversationMessage(MessageRole r, std::string&& c)
+        : role(r), content(std::move(c)), token_count(0), token_count_bytes(0), token_counter_id(0) {}
     
     static ConversationMessage system(const std::string& content) {
         return ConversationMessage(MessageRole::SYSTEM, content);
@@ -38,18 +63,58 @@ struct ConversationMessage {
     static ConversationMessage user(const std::string& content) {
         return ConversationMessage(MessageRole::USER, content);
     }
+    static ConversationMessage user(std::string&& content) {
+        return ConversationMessage(MessageRole::USER, std::move(content));
+    }
     static ConversationMessage assistant(const std::string& content) {
         return ConversationMessage(MessageRole::ASSISTANT, content);
     }
+    static ConversationMessage assistant(std::string&& content) {
+        return ConversationMessage(MessageRole::ASSISTANT, std::move(content));
+    }
 };
 
 // Usage stats from API response
 struct UsageStats {
-    int input_tokens;
+    int input_tokens;       // Prompt tokens, including any served from cache
     int output_tokens;
     int total_tokens;
+    int cached_tokens;      // Prompt tokens reused from the provider's prefix/KV cache
     
-    UsageStats() : input_tokens(0), output_tokens(0), total_tokens(0) {}
+    UsageStats() : input_tokens(0), output_tokens(0), total_tokens(0), cached_tokens(0) {}
+};
+
+// A tool offered through the provider's function-calling API
+struct ToolSpec {
+    std::string name;
+    std::string description;
+    Json parameters;            // JSON Schema of the arguments object
+};
+
+// A tool call the provider returned as structured data
+struct ToolCallRequest {
+    std::string id;             // Provider's call id (tool_use / tool_call id)
+    std::string name;
+    Json arguments;             // Object; null when raw_arguments did not parse
+    std::string raw_arguments;  // Arguments as received
+
+    // Fill arguments from a JSON text (OpenAI sends them as a string)
+    void set_arguments(const std::string& text) {
+        raw_arguments = text;
+        arguments = Json::parse(text.empty() ? std::string("{}") : text, nullptr, false);
+        if (arguments.is_discarded() || !arguments.is_object()) {
+            arguments = Json();
+        }
+    }
+
+    // {"tool": name, "arguments": {...}}, the text protocol's form of the
+    // call. Unparsed arguments are kept as received, for the text parser's
+    // repairs to work on.
+    std::string to_text() const {
+        std::string args = arguments.is_object() ? arguments.dump()
+                         : (raw_arguments.empty() ? std::string("{}") : raw_arguments);
+        return "{\"tool\": " + Json(name).dump() + ", \"arguments\": " + args + "}";
+    }
 };
 
 // Result of an AI completion request
@@ -60,6 +125,7 @@ struct CompletionResult {
     std::string stop_reason;  // Why the model stopped (end_turn, max_tokens, etc.)
     std::string model;        // Model that was used
     UsageStats usage;
+    std::vector<ToolCallRequest> tool_calls;  // Native tool calls (when opts.tools was set)
     
     static CompletionResult ok(const std::string& text) {
         CompletionResult r;
@@ -79,6 +145,9 @@ struct CompletionResult {
 // Callback for streaming responses
 typedef std::function<void(const std::string& chunk)> StreamCallback;
 
+// Receives the result of AIPlugin::chat_async()
+typedef std::function<void(CompletionResult& result)> CompletionCallback;
+
 // AI completion options
 struct CompletionOptions {
     std::string model;           // Model to use (empty = provider default)
@@ -87,10 +156,16 @@ struct CompletionOptions {
     double temperature;          // Sampling temperature (0-1)
     bool stream;                 // Enable streaming
     bool skip_context_management; // Skip context window management (for internal operations)
+    bool stable_system_prompt;   // system_prompt is a reusable prefix; providers may cache it
+    std::string session_key;     // Conversation this request belongs to (cache affinity)
     StreamCallback on_chunk;     // Called for each chunk when streaming
+    std::vector<ToolSpec> tools; // Offered through function calling (needs supports_native_tools())
+    const std::atomic<bool>* cancel; // Abandon the request once this turns true (NULL = never)
+    CancelToken* cancel_token;   // Owner of cancel, for requests that fan out under flags of their own
     
     CompletionOptions() 
-        : max_tokens(4096), temperature(0.7), stream(false), skip_context_management(false) {}
+        : max_tokens(4096), temperature(0.7), stream(false), skip_context_management(false)
+        , stable_system_prompt(false), cancel(NULL), cancel_token(NULL) {}
 };
 
 // Abstract AI provider plugin interface
@@ -122,6 +197,31 @@ public:
     // Check if the provider is properly configured
     virtual bool is_configured() const = 0;
     
+    // Start a chat and return without waiting for the model. done runs
+    // exactly once, on whichever thread finishes the request (for HTTP
+    // providers the AsyncHttp loop, where opts.on_chunk runs too), so it
+    // must return quickly. messages and opts are only read before
+    // chat_async() returns; opts.cancel must outlive the request.
+    // The default runs chat() on the calling thread: done has run by the
+    // time it returns.
+    virtual void chat_async(const std::vector<ConversationMessage>& messages,
+                            const CompletionOptions& opts,
+                            const CompletionCallback& done) {
+        CompletionResult result = chat(messages, opts);
+        done(result);
+    }
+    
+    // True if chat_async() returns before the model has answered
+    virtual bool supports_async() const { return false; }
+    
+    // True if chat() honours CompletionOptions::tools and fills
+    // CompletionResult::tool_calls
+    virtual bool supports_native_tools() const { return false; }
+    
+    // Pool for the provider's own background work, such as pre-building
+    // context resumes on its BACKGROUND lane (not owned)
+    virtual void set_thread_pool(ThreadPool* pool) { (void)pool; }
+    
     // Handle an incoming chat message (adds to session, calls AI, returns response)
     // Returns the AI response text, or error message prefixed with error emoji
     virtual std::string handle_message(const std::string& user_text,
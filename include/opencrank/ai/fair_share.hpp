@@ -0,0 +1,145 @@
+/*
+ * opencrank C++ - Fair-Share Scheduler for Model Calls
+ *
+ * Every chat completion of an agent run asks this scheduler for a slot
+ * first. Calls are grouped by account: the sender (channel:from) or the
+ * session, per llm_scheduler.key. When llm_scheduler.max_concurrent calls
+ * are in flight, further calls queue. A slot that frees up goes to the
+ * account that has used the least, by weighted fair queueing on tokens:
+ * each account has a virtual time that advances by the tokens a call used
+ * (UsageStats) divided by the account's weight, and the lowest virtual
+ * time goes first. An account that was idle starts at the current virtual
+ * time, so it cannot bank credit by staying away.
+ *
+ * First turns (iteration 1 of a run: someone is waiting for the reply) go
+ * ahead of tool-loop iterations. A per-account concurrency cap keeps one
+ * user from holding every slot even before its tokens are counted.
+ *
+ * Queued calls give back their worker: they start from the thread that
+ * frees a slot, through the executor (the thread pool). Cancelled runs
+ * leave the queue at /stop (wake_cancelled) or at shutdown (stop).
+ *
+ * Config (section "llm_scheduler"; off while no limit is set):
+ *   llm_scheduler.max_concurrent - Model calls in flight at once (0 = unlimited)
+ *   llm_scheduler.max_per_user   - Calls in flight per account (0 = unlimited)
+ *   llm_scheduler.key            - "user" (channel:sender) or "session"
+ *   llm_scheduler.default_weight - Share of accounts without an entry (default: 1)
+ *   llm_scheduler.users          - {"telegram:123": {"weight": 4, "max_concurrent": 2}, ...}
+ */
+#ifndef opencrank_AI_FAIR_SHARE_HPP
+#define opencrank_AI_FAIR_SHARE_HPP
+
+#include "../core/config.hpp"
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class Gauge;
+class Histogram;
+
+class FairShareScheduler {
+public:
+    // Called once per call: admitted = false when the run was cancelled
+    // (or the scheduler stopped) while it waited
+    typedef std::function<void(bool admitted)> Grant;
+    typedef std::function<void(const std::function<void()>& task)> Executor;
+
+    static FairShareScheduler& instance();
+
+    void configure(const Config& cfg);
+    void set_executor(const Executor& executor);
+    bool enabled() const;
+
+    // Account a run is charged to
+    std::string account_for(const std::string& session_key, const std::string& user_key) const;
+
+    // Ask for a slot. grant runs on this thread when one is free now, else
+    // later through the executor.
+    void submit(const std::string& account, bool first_turn,
+                const std::atomic<bool>* cancel, const Grant& grant);
+
+    // Ask for a slot and wait for it on this thread. False if *cancel
+    // turned true (or the scheduler stopped) first.
+    bool acquire(const std::string& account, bool first_turn, const std::atomic<bool>* cancel);
+
+    // The call is done: charge its tokens and hand the slot on. Only after
+    // an admitted submit() or a true acquire().
+    void release(const std::string& account, int64_t tokens);
+
+    // Refuse the queued calls of cancelled runs
+    void wake_cancelled();
+
+    // Refuse every queued call and admit new ones at once from now on
+    void stop();
+
+    // Stats
+    size_t queued() const;
+    size_t in_flight() const;
+
+private:
+    FairShareScheduler();
+    FairShareScheduler(const FairShareScheduler&);
+    FairShareScheduler& operator=(const FairShareScheduler&);
+
+    struct Waiter {
+        uint64_t id;
+        const std::atomic<bool>* cancel;
+        Grant grant;
+        int64_t queued_ms;
+        bool first_turn;
+        bool blocking;              // acquire(): the grant only wakes a thread
+    };
+
+    struct Account {
+        double weight;
+        int cap;                    // 0 = unlimited
+        int in_flight;
+        double vtime;               // Tokens used / weight
+        std::deque<Waiter> first_turns;
+        std::deque<Waiter> tool_loop;
+
+        Account() : weight(1.0), cap(0), in_flight(0), vtime(0.0) {}
+    };
+
+    uint64_t enqueue(const std::string& account, bool first_turn, const std::atomic<bool>* cancel,
+                     const Grant& grant, bool blocking, std::vector<Waiter>& admitted);
+
+    // mutex_ held
+    Account& account_locked(const std::string& key);
+    // Admit queued calls while slots are free, best account first
+    void dispatch_locked(std::vector<Waiter>& admitted);
+    void forget_idle_locked();
+
+    // Outside the lock. The grant of call own runs on this thread.
+    void run_grants(std::vector<Waiter>& waiters, bool admitted, uint64_t own);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Account> accounts_;
+    int max_concurrent_;
+    int max_per_user_;
+    bool by_user_;
+    double default_weight_;
+    std::map<std::string, std::pair<double, int> > overrides_;     // Account -> (weight, cap)
+    Executor executor_;
+    uint64_t next_id_;
+    int in_flight_;
+    size_t queued_;
+    double vclock_;                 // Virtual time of the last admitted account
+    bool stopped_;
+
+    Gauge* queued_gauge_;
+    Gauge* in_flight_gauge_;
+    Histogram* wait_first_;
+    Histogram* wait_loop_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_AI_FAIR_SHARE_HPP
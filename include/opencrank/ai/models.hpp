@@ -0,0 +1,75 @@
+/*
+ * opencrank C++ - Per-purpose models
+ *
+ * Internal completions do not need the model that answers the user. The
+ * "models" config section maps a purpose to a provider and model:
+ *
+ *   "models": {
+ *     "resume":   {"provider": "llamacpp"},
+ *     "classify": {"provider": "openrouter", "model": "openai/gpt-4o-mini"}
+ *   }
+ *
+ * Purposes:
+ *   resume   - Context resumes and background rolling summaries. Resumes
+ *              send the whole history, so the model needs a context window
+ *              as large as the chat model's
+ *   classify - Second opinion on the agent's tool-intent heuristic before
+ *              it spends a full-model iteration on a continuation prompt
+ *              (only asked when configured)
+ *
+ * A purpose without an entry, or whose provider is not loaded and
+ * configured, uses the AI that would have served it anyway. A failed call
+ * on a purpose model is retried once on that AI.
+ *
+ * Model calls are counted by purpose ("chat" for user turns) in
+ * opencrank_llm_request_seconds, _requests_total and _tokens_total.
+ */
+#ifndef opencrank_AI_MODELS_HPP
+#define opencrank_AI_MODELS_HPP
+
+#include "ai.hpp"
+#include "../core/config.hpp"
+#include <string>
+#include <map>
+
+namespace opencrank {
+
+extern const char* const PURPOSE_CHAT;
+extern const char* const PURPOSE_RESUME;
+extern const char* const PURPOSE_CLASSIFY;
+
+class PurposeModels {
+public:
+    static PurposeModels& instance();
+
+    // Read the "models" section. Call once the AI plugins are initialized
+    // and before requests start: lookups take no lock.
+    void configure(const Config& cfg);
+
+    // True if purpose has its own model
+    bool has(const char* purpose) const;
+
+    // The AI for purpose, setting opts.model when the entry names one.
+    // fallback (opts untouched) when the purpose has no usable entry.
+    AIPlugin* resolve(const char* purpose, AIPlugin* fallback, CompletionOptions& opts) const;
+
+    // chat() on the purpose's model, retried on fallback when that fails.
+    // Records the call in the LLM metrics under purpose.
+    CompletionResult chat(const char* purpose, AIPlugin* fallback,
+                          const std::vector<ConversationMessage>& messages,
+                          const CompletionOptions& opts) const;
+
+private:
+    struct Entry {
+        AIPlugin* ai;
+        std::string model;      // "" = provider default
+    };
+
+    PurposeModels() {}
+
+    std::map<std::string, Entry> entries_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_AI_MODELS_HPP
@@ -0,0 +1,111 @@
+/*
+ * opencrank C++ - Provider Rate Pacing
+ *
+ * Hosted providers reject requests over their limits with 429 (rate
+ * limited) or 529/503 (overloaded) and say when to come back: Retry-After,
+ * and rate-limit headers with what is left of the current window
+ * (anthropic-ratelimit-*, x-ratelimit-*).
+ *
+ * One RatePacer is shared by every request made with one API key of one
+ * provider. It learns the request limit from those headers into a
+ * TokenBucketLimiter and spaces requests to it, and it holds requests back
+ * until a Retry-After or the reset of an exhausted window has passed, so
+ * the provider is asked again when it will say yes.
+ *
+ * Plugins retry rejected requests themselves with jittered exponential
+ * backoff (never shorter than what the provider asked for), so a burst of
+ * 429s costs latency instead of failed turns. Waits, rejections and
+ * retries are counted in the opencrank_provider_* metrics.
+ *
+ * Config (in the provider's section, e.g. claude.max_retries):
+ *   max_retries    - Retries of a rejected request (default: 3)
+ *   retry_base_ms  - First backoff, doubled per retry (default: 1000)
+ *   retry_max_ms   - Longest wait before a request; a longer Retry-After
+ *                    fails the request at once (default: 60000)
+ *   rate_limit_rpm - Request limit until headers report one (default: 0 =
+ *                    learn from headers)
+ *
+ * Plugins compile this header as C++11.
+ */
+#ifndef opencrank_AI_RATE_PACER_HPP
+#define opencrank_AI_RATE_PACER_HPP
+
+#include "../core/config.hpp"
+#include "../core/http_client.hpp"
+#include "../core/rate_limiter.hpp"
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class Counter;
+class Gauge;
+class Histogram;
+
+struct RetryPolicy {
+    int max_retries;
+    int64_t base_delay_ms;
+    int64_t max_delay_ms;
+    int rate_limit_rpm;
+
+    RetryPolicy() : max_retries(3), base_delay_ms(1000), max_delay_ms(60000), rate_limit_rpm(0) {}
+
+    // From <section>.max_retries etc.
+    static RetryPolicy from_config(const Config& cfg, const std::string& section);
+};
+
+class RatePacer {
+public:
+    // The pacer of provider's api_key, created on first use and kept for the
+    // life of the process. policy replaces the one it had.
+    static RatePacer& get(const std::string& provider, const std::string& api_key,
+                          const RetryPolicy& policy);
+
+    // Claim the next request: ms to wait before sending it (0 = now).
+    // backoff_ms is this request's own retry backoff.
+    int64_t reserve(int64_t backoff_ms = 0);
+
+    // reserve() and wait on this thread. False with error set when the wait
+    // would exceed retry_max_ms or *cancel turned true.
+    bool pace(const std::atomic<bool>* cancel, int64_t backoff_ms, std::string& error);
+
+    // Learn from response's headers. True when it was rejected for load and
+    // attempt (0 = first request) may be retried; backoff_ms is then the
+    // jittered delay to pass to reserve()/pace().
+    bool should_retry(const HttpResponse& response, int attempt, int64_t& backoff_ms);
+
+    // Error for a wait beyond retry_max_ms (reserve() returned wait_ms)
+    std::string too_long(int64_t wait_ms) const;
+
+    const std::string& provider() const { return provider_; }
+    int64_t max_delay_ms() const;
+
+private:
+    explicit RatePacer(const std::string& provider);
+    RatePacer(const RatePacer&);
+    RatePacer& operator=(const RatePacer&);
+
+    void set_policy(const RetryPolicy& policy);
+    // Request limit per minute from the headers (locked)
+    void learn_limit_locked(int per_minute);
+
+    std::string provider_;
+
+    mutable std::mutex mutex_;
+    RetryPolicy policy_;
+    TokenBucketLimiter bucket_;     // Paces only once limit_ is known
+    int limit_;                     // Requests per minute (0 = unknown)
+    int64_t blocked_until_ms_;      // Retry-After / exhausted window reset
+
+    Counter* rejected_;
+    Counter* retries_;
+    Counter* gave_up_;
+    Gauge* remaining_;
+    Histogram* wait_seconds_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_AI_RATE_PACER_HPP
@@ -0,0 +1,148 @@
+/*
+ * opencrank C++ - AI Router
+ *
+ * A virtual AI provider over the loaded ones. Each backend is a provider
+ * (and optionally a model) with a weight. Per backend the router keeps an
+ * EWMA of the latency - to the first streamed chunk, or to the whole reply
+ * when nothing streams - and of the error rate, plus the recent latencies
+ * for a p95.
+ *
+ * The primary is drawn by weight scaled by health (1 - error rate). When a
+ * request fails before anything has streamed to the caller, it moves on to
+ * the next backend, fastest first. A backend that fails max_failures times
+ * in a row is skipped for cooldown_ms.
+ *
+ * Hedging (router.hedge): for requests up to hedge_max_prompt_chars, if the
+ * primary has neither streamed nor answered after its p95 latency, the same
+ * request goes to the next backend on the thread pool. The first backend to
+ * stream or answer wins and the other is cancelled through
+ * CompletionOptions::cancel; the caller's cancel_token stops both. Hedging
+ * costs a second request now and then, so it is off by default.
+ *
+ * Config (section "router"; the router is the default AI when backends is set):
+ *   router.backends               - [{"provider": "claude", "model": "", "weight": 1}, ...]
+ *   router.failover               - Retry failed requests on the next backend (default: true)
+ *   router.max_failures           - Consecutive failures before a cooldown (default: 3)
+ *   router.cooldown_ms            - How long a failing backend is skipped (default: 30000)
+ *   router.hedge                  - Send hedged requests (default: false)
+ *   router.hedge_delay_ms         - Hedge delay before a backend has 8 samples (default: 2000)
+ *   router.hedge_min_ms           - Lower bound on the p95 hedge delay (default: 300)
+ *   router.hedge_max_prompt_chars - Larger prompts are never hedged (default: 24000)
+ */
+#ifndef opencrank_AI_ROUTER_HPP
+#define opencrank_AI_ROUTER_HPP
+
+#include "ai.hpp"
+#include "../core/config.hpp"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+namespace opencrank {
+
+class Counter;
+
+class AIRouter : public AIPlugin {
+public:
+    AIRouter();
+
+    // Plugin interface
+    const char* name() const;
+    const char* version() const;
+    const char* description() const;
+
+    bool init(const Config& cfg);
+    std::vector<std::string> init_after(const Config& cfg) const;   // The backends
+    void shutdown();
+
+    // AIPlugin interface
+    std::string provider_id() const;
+    std::vector<std::string> available_models() const;
+    std::string default_model() const;
+    bool is_configured() const;
+    // Only when every backend has native tools: the agent builds its prompt
+    // once per run, and a failover may land on any of them
+    bool supports_native_tools() const;
+    void set_thread_pool(ThreadPool* pool);
+
+    CompletionResult complete(
+        const std::string& prompt,
+        const CompletionOptions& opts = CompletionOptions()
+    );
+
+    CompletionResult chat(
+        const std::vector<ConversationMessage>& messages,
+        const CompletionOptions& opts = CompletionOptions()
+    );
+
+    // True if cfg names any router backends
+    static bool configured_in(const Config& cfg);
+
+private:
+    struct Backend {
+        std::string provider;
+        std::string model;             // "" = provider default
+        double weight;
+        AIPlugin* ai;                  // Resolved from the registry
+
+        // Health, guarded by mutex_
+        double latency_ewma_ms;        // 0 = no sample yet
+        double error_ewma;
+        int consecutive_failures;
+        int64_t cooldown_until_ms;
+        std::vector<double> recent_ms; // Ring of recent latencies, for the p95
+        size_t recent_next;
+
+        Counter* ok;
+        Counter* errors;
+        Counter* cancelled;
+        Counter* hedges_won;
+    };
+
+    struct HedgeState;
+
+    std::vector<Backend> backends_;
+    mutable std::mutex mutex_;
+    ThreadPool* pool_;
+
+    // Config
+    bool failover_;
+    int max_failures_;
+    int64_t cooldown_ms_;
+    bool hedge_;
+    int64_t hedge_delay_ms_;
+    int64_t hedge_min_ms_;
+    size_t hedge_max_prompt_chars_;
+
+    Counter* failovers_;
+    Counter* hedges_sent_;
+
+    // Backends to try, primary first
+    std::vector<size_t> plan();
+
+    // One request to one backend; records its outcome. streamed is set once
+    // a chunk has gone to on_chunk.
+    CompletionResult call_backend(size_t index,
+                                  const std::vector<ConversationMessage>& messages,
+                                  const CompletionOptions& opts,
+                                  const StreamCallback& on_chunk,
+                                  const std::atomic<bool>* cancel,
+                                  bool& streamed);
+
+    // Primary on this thread, hedge on the pool after the primary's p95.
+    // hedged is set when the second backend was actually called.
+    CompletionResult hedged_chat(size_t primary, size_t secondary,
+                                 const std::vector<ConversationMessage>& messages,
+                                 const CompletionOptions& opts,
+                                 bool& streamed, bool& hedged);
+
+    void record(size_t index, bool success, double latency_ms, bool cancelled);
+    int64_t hedge_delay_ms(size_t index) const;
+
+    std::string label(size_t index) const;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_AI_ROUTER_HPP
@@ -0,0 +1,331 @@
+/*
+ * opencrank C++ - Server-Sent Events parsing for streaming AI providers
+ *
+ * SseParser splits an incremental byte stream (as delivered by the HTTP
+ * write callback) into SSE events. OpenAIStreamAccumulator consumes
+ * OpenAI-compatible chat.completion.chunk events, forwards content deltas
+ * to a StreamCallback and rebuilds a non-streaming response object so the
+ * provider's existing response parsing can be reused unchanged.
+ *
+ * write_openai_tools() and read_openai_tool_calls() map native function
+ * calling (CompletionOptions::tools, CompletionResult::tool_calls) onto the
+ * same OpenAI-compatible API, for the providers that speak it.
+ *
+ * Header-only like cron.hpp: plugins use it without extra link objects.
+ */
+#ifndef opencrank_AI_SSE_HPP
+#define opencrank_AI_SSE_HPP
+
+#include "ai.hpp"
+#include "../core/json.hpp"
+#include "../core/json_stream.hpp"
+#include "../core/logger.hpp"
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace opencrank {
+
+// ============================================================================
+// SseParser
+// ============================================================================
+
+class SseParser {
+public:
+    // Return false from the callback to abort the stream
+    typedef std::function<bool(const std::string& event, const std::string& data)> EventCallback;
+
+    explicit SseParser(EventCallback on_event) : on_event_(on_event) {}
+
+    // Feed raw bytes; returns false if the callback asked to abort
+    bool feed(const char* data, size_t len) {
+        buffer_.append(data, len);
+
+        size_t start = 0;
+        size_t nl;
+        while ((nl = buffer_.find('\n', start)) != std::string::npos) {
+            size_t end = nl;
+            if (end > start && buffer_[end - 1] == '\r') end--;
+
+            if (!handle_line(buffer_, start, end - start)) {
+                buffer_.erase(0, nl + 1);
+                return false;
+            }
+            start = nl + 1;
+        }
+        buffer_.erase(0, start);
+        return true;
+    }
+
+private:
+    bool handle_line(const std::string& buf, size_t pos, size_t len) {
+        // Blank line terminates an event
+        if (len == 0) {
+            if (data_.empty() && event_.empty()) return true;
+            bool keep_going = on_event_(event_.empty() ? std::string("message") : event_, data_);
+            event_.clear();
+            data_.clear();
+            return keep_going;
+        }
+
+        // Comment / keep-alive
+        if (buf[pos] == ':') return true;
+
+        size_t colon = buf.find(':', pos);
+        if (colon == std::string::npos || colon >= pos + len) colon = pos + len;
+
+        std::string field = buf.substr(pos, colon - pos);
+        size_t value_start = colon < pos + len ? colon + 1 : colon;
+        if (value_start < pos + len && buf[value_start] == ' ') value_start++;
+        std::string value = buf.substr(value_start, pos + len - value_start);
+
+        if (field == "data") {
+            if (!data_.empty()) data_ += '\n';
+            data_ += value;
+        } else if (field == "event") {
+            event_ = value;
+        }
+        // id / retry are not used by AI providers
+        return true;
+    }
+
+    EventCallback on_event_;
+    std::string buffer_;
+    std::string event_;
+    std::string data_;
+};
+
+// ============================================================================
+// OpenAIStreamAccumulator
+// ============================================================================
+
+class OpenAIStreamAccumulator {
+public:
+    explicit OpenAIStreamAccumulator(const StreamCallback& on_chunk)
+        : on_chunk_(on_chunk)
+        , parser_([this](const std::string& event, const std::string& data) {
+              return on_event(event, data);
+          })
+        , done_(false)
+        , usage_(Json::object()) {}
+
+    // Plug into HttpClient::post_json_stream
+    bool feed(const char* data, size_t len) { return parser_.feed(data, len); }
+
+    bool done() const { return done_; }
+    bool has_error() const { return !error_.is_null(); }
+    const std::string& content() const { return content_; }
+
+    // Response shaped like a non-streaming chat.completion
+    Json to_response() const {
+        Json resp = Json::object();
+        if (has_error()) {
+            resp["error"] = error_;
+            return resp;
+        }
+
+        Json message = Json::object();
+        message["role"] = "assistant";
+        message["content"] = content_;
+        if (!reasoning_.empty()) {
+            message["reasoning_content"] = reasoning_;
+        }
+        if (!tool_calls_.empty()) {
+            Json calls = Json::array();
+            for (size_t i = 0; i < tool_calls_.size(); ++i) {
+                Json call = Json::object();
+                call["id"] = tool_calls_[i].id;
+                call["type"] = "function";
+                call["function"]["name"] = tool_calls_[i].name;
+                call["function"]["arguments"] = tool_calls_[i].arguments;
+                calls.push_back(call);
+            }
+            message["tool_calls"] = calls;
+        }
+
+        Json choice = Json::object();
+        choice["index"] = 0;
+        choice["message"] = message;
+        choice["finish_reason"] = finish_reason_;
+
+        resp["model"] = model_;
+        resp["choices"] = Json::array();
+        resp["choices"].push_back(choice);
+        if (!usage_.empty()) {
+            resp["usage"] = usage_;
+        }
+        if (!timings_.is_null()) {
+            resp["timings"] = timings_;  // llama.cpp prompt/cache counters
+        }
+        return resp;
+    }
+
+private:
+    // The parser callback captures this
+    OpenAIStreamAccumulator(const OpenAIStreamAccumulator&);
+    OpenAIStreamAccumulator& operator=(const OpenAIStreamAccumulator&);
+
+    struct ToolCallDelta {
+        std::string id;
+        std::string name;
+        std::string arguments;
+    };
+
+    bool on_event(const std::string& event, const std::string& data) {
+        (void)event;
+        if (data == "[DONE]") {
+            done_ = true;
+            return true;
+        }
+
+        // One chunk per token: read the few members used straight from the
+        // text instead of building a DOM for each
+        JsonView chunk(data);
+        if (!chunk.is_object()) {
+            return true;  // Tolerate partial/garbage keep-alives
+        }
+
+        JsonView error = chunk["error"];
+        if (error.exists()) {
+            error_ = error.parse();
+            if (error_.is_discarded()) error_ = error.raw();
+            return false;
+        }
+
+        if (model_.empty()) {
+            model_ = chunk["model"].get_string();
+        }
+        JsonView usage = chunk["usage"];
+        if (usage.is_object()) {
+            usage_ = usage.parse();
+        }
+        JsonView timings = chunk["timings"];
+        if (timings.is_object()) {
+            timings_ = timings.parse();
+        }
+
+        JsonView choice = chunk["choices"].at(0);
+        if (!choice.is_object()) {
+            return true;
+        }
+
+        JsonView finish_reason = choice["finish_reason"];
+        if (finish_reason.is_string()) {
+            finish_reason_ = finish_reason.get_string();
+        }
+
+        JsonView delta = choice["delta"];
+        if (!delta.is_object()) {
+            return true;
+        }
+
+        JsonView content = delta["content"];
+        if (content.is_string()) {
+            std::string text = content.get_string();
+            if (!text.empty()) {
+                content_ += text;
+                if (on_chunk_) on_chunk_(text);
+            }
+        }
+        JsonView reasoning = delta["reasoning_content"];
+        if (reasoning.is_string()) {
+            reasoning_ += reasoning.get_string();
+        }
+
+        JsonView calls = delta["tool_calls"];
+        for (JsonView::Iterator it = calls.begin(); it != calls.end(); ++it) {
+            JsonView tc = *it;
+            int64_t given = tc["index"].get_int(-1);
+            size_t index = given < 0 ? tool_calls_.size() : static_cast<size_t>(given);
+            if (index >= tool_calls_.size()) {
+                tool_calls_.resize(index + 1);
+            }
+            ToolCallDelta& acc = tool_calls_[index];
+            JsonView id = tc["id"];
+            if (id.is_string()) {
+                acc.id = id.get_string();
+            }
+            JsonView fn = tc["function"];
+            if (fn.is_object()) {
+                acc.name += fn["name"].get_string();
+                acc.arguments += fn["arguments"].get_string();
+            }
+        }
+        return true;
+    }
+
+    StreamCallback on_chunk_;
+    SseParser parser_;
+    bool done_;
+
+    std::string model_;
+    std::string content_;
+    std::string reasoning_;
+    std::string finish_reason_;
+    std::vector<ToolCallDelta> tool_calls_;
+    Json usage_;
+    Json timings_;
+    Json error_;
+};
+
+// ============================================================================
+// OpenAI function calling
+// ============================================================================
+
+// The request's "tools" member: [{type: function, function: {name, description, parameters}}]
+inline void write_openai_tools(JsonWriter& request, const std::vector<ToolSpec>& tools) {
+    if (tools.empty()) return;
+    request.key("tools").begin_array();
+    for (size_t i = 0; i < tools.size(); ++i) {
+        request.begin_object();
+        request.field("type", "function");
+        request.key("function").begin_object();
+        request.field("name", tools[i].name);
+        request.field("description", tools[i].description);
+        request.key("parameters").json(tools[i].parameters);
+        request.end_object();
+        request.end_object();
+    }
+    request.end_array();
+}
+
+// Read message.tool_calls into result.tool_calls, and append the calls to
+// result.content in the text protocol's form. Returns the calls read.
+inline size_t read_openai_tool_calls(const Json& message, CompletionResult& result) {
+    if (!message.contains("tool_calls") || !message["tool_calls"].is_array()) return 0;
+    const Json& calls = message["tool_calls"];
+
+    std::string text = result.content;
+    for (size_t i = 0; i < calls.size(); ++i) {
+        const Json& call = calls[i];
+        if (!call.is_object() || !call.contains("function") || !call["function"].is_object()) {
+            LOG_WARN("[AI] tool_call[%zu] has no 'function' object, skipping", i);
+            continue;
+        }
+        const Json& fn = call["function"];
+        ToolCallRequest req;
+        req.id = call.value("id", std::string(""));
+        req.name = fn.value("name", std::string(""));
+        if (req.name.empty()) {
+            LOG_WARN("[AI] tool_call[%zu] has an empty function name, skipping", i);
+            continue;
+        }
+        // Arguments are a JSON string per the spec; some servers send the object
+        if (fn.contains("arguments") && fn["arguments"].is_object()) {
+            req.set_arguments(fn["arguments"].dump());
+        } else {
+            req.set_arguments(fn.value("arguments", std::string("{}")));
+        }
+        LOG_DEBUG("[AI] Native tool_call[%zu]: %s %s", i, req.name.c_str(), req.raw_arguments.c_str());
+
+        if (!text.empty()) text += "\n\n";
+        text += req.to_text();
+        result.tool_calls.push_back(req);
+    }
+    result.content = text;
+    return result.tool_calls.size();
+}
+
+} // namespace opencrank
+
+#endif // opencrank_AI_SSE_HPP
@@ -18,17 +18,30 @@
 #include "json.hpp"
 #include "logger.hpp"
 #include "content_chunker.hpp"
+#include "response_cache.hpp"
+#include "tool_memo.hpp"
+#include "trace.hpp"
+#include "tool_call_scanner.hpp"
+#include "cancel_token.hpp"
 #include <string>
 #include <vector>
 #include <map>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 
 namespace opencrank {
 
 // Forward declarations
 class AIPlugin;
+class ThreadPool;
 struct CompletionOptions;
+struct ToolSpec;
+struct ToolCallRequest;
 struct ConversationMessage;
+class RunRecording;
 
 // ============================================================================
 // Tool Definition
@@ -88,26 +101,43 @@ struct AgentTool {
     std::string description;
     std::vector<ToolParamSchema> params;
     ToolExecutor execute;
+    bool parallel_safe;     // Read-only, may run concurrently with other parallel-safe calls
     
-    AgentTool() {}
+    // ToolMemo: a tool with memo_store set returns the same output for the
+    // same params until something writes to that store; one with
+    // writes_store set changes it (any other non-parallel-safe tool may
+    // change anything). path_param names the param holding the path read
+    // or written ("" = the whole store).
+    std::string memo_store;
+    std::string writes_store;
+    std::string path_param;
+    
+    AgentTool() : parallel_safe(false) {}
     AgentTool(const std::string& n, const std::string& d, ToolExecutor e)
-        : name(n), description(d), execute(e) {}
+        : name(n), description(d), execute(e), parallel_safe(false) {}
 };
 
 // ============================================================================
-// Parsed Tool Call
+// Tool Call Context
 // ============================================================================
 
-struct ParsedToolCall {
-    std::string tool_name;
-    Json params;
-    std::string raw_content;  // Raw JSON content of the tool call
-    size_t start_pos;       // Position in original text
-    size_t end_pos;         // End position in original text
-    bool valid;
-    std::string parse_error;
+// The run a tool call belongs to. The agent installs it on the executing
+// thread for the duration of each call; executors reach it through
+// current(), which is NULL outside an agent run.
+struct ToolCallContext {
+    std::string session_key;            // Owner of chunked results
+    std::string user_key;               // AgentConfig::user_key of the run
+    std::string cancel_key;             // Processes started under it die with ProcessRunner::cancel()
+    const std::atomic<bool>* cancel;    // The run was stopped: give up (NULL = never)
+    std::function<void()> on_progress;  // The tool is still working (e.g. a command printed output)
+    TraceContext trace;                 // Tool spans nest under the current iteration
+    RunRecording* recording;            // Executions are recorded there (NULL = not recording)
+    
+    ToolCallContext() : cancel(NULL), recording(NULL) {}
     
-    ParsedToolCall() : start_pos(0), end_pos(0), valid(false) {}
+    bool cancelled() const { return cancel && cancel->load(); }
+    
+    static const ToolCallContext* current();
 };
 
 // ============================================================================
@@ -123,6 +153,33 @@ struct AgentConfig {
     bool auto_chunk_large_results;  // Automatically chunk large tool results (default: true)
     size_t chunk_size;              // Chunk size in chars for large content (0 = auto from context_size)
     size_t context_size;            // Context size in tokens from the AI model (0 = use defaults)
+    bool stream_replies;            // Stream replies into channels that can edit messages (default: true)
+    int stream_interval_ms;         // Min delay between streamed message edits (default: 1000)
+    int max_parallel_tools;         // Max parallel-safe tool calls run at once per iteration (default: 4)
+    bool early_tool_start;          // Start parallel-safe calls while the reply still streams (default: true)
+    bool native_tools;              // Use the provider's function calling when it has one (default: true)
+    int compact_after;              // Compact tool results older than this many iterations (default: 3, 0 = off)
+    size_t compact_min_chars;       // Tool results shorter than this are never compacted (default: 1500)
+    bool async_model_calls;         // run_async() frees its worker while the model answers (default: true)
+    double temperature;             // Sampling temperature of chat turns; only 0 is cached (default: 0.7)
+    std::string session_key;        // Forwarded to the provider for cache affinity (set by the caller)
+    std::string user_key;           // Sender the model calls are charged to by FairShareScheduler (set by the caller)
+    std::string cancel_key;         // Key under which tool processes can be cancelled (set by the caller)
+    CancelTokenPtr cancel;          // Stops the run: model call, tools, loop (set by the caller; NULL = never)
+    
+    // Per-run sink for streamed reply text. Receives the visible text of the
+    // current iteration so far (tool-call JSON is held back). Set by the caller.
+    std::function<void(const std::string& text)> on_partial;
+    
+    // Per-run liveness signal: a model reply arrived or a running tool made
+    // progress (a command printed output). May be called from pool threads.
+    // Set by the caller.
+    std::function<void()> on_progress;
+    
+    // Per-run extra system prompt text (e.g. MemoryRecall hits), fetched
+    // once right before the first model call and kept for the whole run.
+    // May block until it is ready. Set by the caller.
+    std::function<std::string()> prompt_context;
     
     AgentConfig() 
         : max_iterations(30)
@@ -132,7 +189,16 @@ struct AgentConfig {
         , max_tool_result_size(15000)
         , auto_chunk_large_results(true)
         , chunk_size(0)
-        , context_size(0) {}
+        , context_size(0)
+        , stream_replies(true)
+        , stream_interval_ms(1000)
+        , max_parallel_tools(4)
+        , early_tool_start(true)
+        , native_tools(true)
+        , compact_after(3)
+        , compact_min_chars(1500)
+        , async_model_calls(true)
+        , temperature(0.7) {}
     
     // Get effective chunk size: if chunk_size is set use it,
     // otherwise derive from context_size (10% of context in chars),
@@ -160,15 +226,30 @@ struct AgentResult {
     int tool_calls_made;            // Total tool calls made
     std::vector<std::string> tools_used;  // Names of tools that were called
     bool paused;                    // True if paused at max iterations (awaiting /continue)
+    bool cancelled;                 // Stopped through AgentConfig::cancel
     std::string pause_message;      // Message to show user when paused
+    int prompt_tokens;              // Prompt tokens summed over all iterations
+    int cached_prompt_tokens;       // ...of which the provider served from cache
+    int completion_tokens;          // Completion tokens summed over all iterations
+    int64_t model_ms;               // Time spent in ai->chat()
+    int64_t tool_ms;                // Time spent running tool calls (wall clock per batch)
+    std::string trace_id;           // Trace of this run ("" when tracing is off), see /trace
     
-    AgentResult() : success(false), iterations(0), tool_calls_made(0), paused(false) {}
+    AgentResult()
+        : success(false), iterations(0), tool_calls_made(0), paused(false), cancelled(false)
+        , prompt_tokens(0), cached_prompt_tokens(0), completion_tokens(0), model_ms(0), tool_ms(0) {}
 };
 
 // ============================================================================
 // Agent Class
 // ============================================================================
 
+struct EarlyToolCall;   // Defined in agent.cpp
+struct AgentRun;        // Defined in agent.cpp
+
+// Receives the result of Agent::run_async()
+typedef std::function<void(AgentResult& result)> AgentCallback;
+
 class Agent {
 public:
     Agent();
@@ -181,18 +262,35 @@ public:
     // Get registered tools
     const std::map<std::string, AgentTool>& tools() const { return tools_; }
     
-    // Build tools section for system prompt
-    std::string build_tools_prompt() const;
+    // Build tools section for system prompt. native: the tools travel as
+    // schemas (tool_specs()), so only usage guidance is written
+    std::string build_tools_prompt(bool native = false) const;
+    
+    // Caller prompt + tools section, rebuilt only when either changes
+    std::string build_system_prompt(const std::string& base_prompt, bool native = false);
+    
+    // Registered tools as JSON Schema for native function calling (cached)
+    std::vector<ToolSpec> tool_specs();
+    
+    // Bumped on every register_tool(); invalidates the cached prompt
+    uint64_t tools_version() const { return tools_version_.load(); }
     
     // Parse tool calls from AI response
     std::vector<ParsedToolCall> parse_tool_calls(const std::string& response) const;
     
-    // Execute a single tool call
-    AgentToolResult execute_tool(const ParsedToolCall& call);
+    // Execute a single tool call (ctx: made current while the tool runs)
+    AgentToolResult execute_tool(const ParsedToolCall& call, const ToolCallContext* ctx = NULL);
     
     // Format tool result for injection into conversation
-    // If the result is too large, it will be chunked and a summary returned
-    std::string format_tool_result(const std::string& tool_name, const AgentToolResult& result);
+    // If the result is too large, it will be chunked (owned by owner, the
+    // session key) and a summary returned
+    std::string format_tool_result(const std::string& tool_name, const AgentToolResult& result,
+                                   const std::string& owner = "");
+    
+    // Replace the large tool results in a tool-result message with a pointer
+    // into the chunker and a short extractive summary. Returns the characters
+    // saved (0 = nothing compacted)
+    size_t compact_tool_results(ConversationMessage& msg, size_t min_chars, const std::string& owner);
     
     // Extract text response (content outside tool calls)
     std::string extract_response_text(const std::string& response, 
@@ -207,18 +305,83 @@ public:
         const AgentConfig& config = AgentConfig()
     );
     
+    // Same loop without holding a thread while the model answers: with a
+    // provider that supports_async() and a thread pool, the run continues
+    // on the pool when each reply arrives and done runs there. Otherwise
+    // this is run() followed by done on the calling thread.
+    void run_async(
+        AIPlugin* ai,
+        const std::string& user_message,
+        std::vector<ConversationMessage>& history,
+        const std::string& system_prompt,
+        const AgentConfig& config,
+        const AgentCallback& done
+    );
+    
     // Configuration
     void set_config(const AgentConfig& config) { config_ = config; }
     const AgentConfig& config() const { return config_; }
     
+    // Pool used to run parallel-safe tool calls concurrently (not owned)
+    void set_thread_pool(ThreadPool* pool) { pool_ = pool; }
+    
     // Access the content chunker (for tools to access stored content)
     ContentChunker& chunker() { return chunker_; }
     const ContentChunker& chunker() const { return chunker_; }
+    
+    // Model replies of side-effect-free runs (off until opened)
+    ResponseCache& response_cache() { return response_cache_; }
+    
+    // Outputs of idempotent tool calls, reused until a write invalidates them
+    ToolMemo& tool_memo() { return tool_memo_; }
 
 private:
+    friend struct AgentRun;
+    
     std::map<std::string, AgentTool> tools_;
     AgentConfig config_;
     ContentChunker chunker_;
+    ResponseCache response_cache_;
+    ToolMemo tool_memo_;
+    ThreadPool* pool_;
+    
+    // Assembled system prompt cache
+    std::atomic<uint64_t> tools_version_;
+    std::mutex prompt_mutex_;
+    std::string cached_base_prompt_;
+    uint64_t cached_tools_version_;
+    std::string cached_system_prompt_;
+    std::string cached_native_prompt_;
+    uint64_t cached_specs_version_;
+    std::vector<ToolSpec> cached_specs_;
+    
+    // Native calls as ParsedToolCall, positioned at their text form in response
+    std::vector<ParsedToolCall> native_tool_calls(const std::vector<ToolCallRequest>& requests,
+                                                  const std::string& response) const;
+    
+    // Execute a call, retrying failures up to 3 times
+    AgentToolResult execute_with_retry(const ParsedToolCall& call, const ToolCallContext* ctx);
+    
+    // True if the call targets a tool marked parallel_safe
+    bool is_parallel_safe(const ParsedToolCall& call) const;
+    
+    // What a call does to the ToolMemo: reads a memoizable store (true), or
+    // false and, for a call with side effects, the store it writes (else "")
+    bool memo_target(const ParsedToolCall& call, std::string& store,
+                     std::string& path, std::string& writes) const;
+    
+    // Run calls concurrently (at most max_parallel at once); results[i] matches calls[i]
+    void execute_parallel(const std::vector<const ParsedToolCall*>& calls,
+                          std::vector<AgentToolResult>& results,
+                          size_t max_parallel,
+                          const ToolCallContext* ctx);
+    
+    // Queue a call that streamed in before the reply finished
+    std::shared_ptr<EarlyToolCall> start_early(const ParsedToolCall& call, const ToolCallContext* ctx);
+    
+    // Result of an early call: run it here if no worker has picked it up
+    // yet, otherwise wait for the worker
+    AgentToolResult finish_early(EarlyToolCall& early, const ToolCallContext* ctx);
     
     // Helper to check if response contains tool calls
     bool has_tool_calls(const std::string& response) const;
@@ -2,13 +2,17 @@
  * opencrank C++ - AI Process Monitor
  * 
  * Monitors AI processing activity with heartbeat tracking and hang detection.
- * Automatically sends typing indicators to channels while AI is working.
+ * Keeps typing indicators refreshed while AI is working.
  * 
  * Features:
  * - Thread-safe heartbeat tracking for active AI sessions
  * - Hang detection with configurable timeout
- * - Automatic typing indicator dispatch to channels
- * - Periodic health check in dedicated monitoring thread
+ * - Typing refreshes, handed to the TypingIndicator (which batches and
+ *   deduplicates them)
+ * - One reactor timer per session, armed for its next deadline (hang or
+ *   typing refresh); nothing runs while no deadline is due. Heartbeats only
+ *   record the time: a hang timer that finds a newer heartbeat re-arms.
+ * - A cancellation token per session, for /stop and hung runs
  */
 #ifndef opencrank_CORE_AI_MONITOR_HPP
 #define opencrank_CORE_AI_MONITOR_HPP
@@ -16,10 +20,12 @@
 #include <string>
 #include <map>
 #include <mutex>
-#include <thread>
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <cstdint>
+#include "cancel_token.hpp"
+#include "reactor.hpp"
 
 namespace opencrank {
 
@@ -37,12 +43,19 @@ struct AISessionState {
     std::chrono::steady_clock::time_point last_heartbeat;
     int heartbeat_count;
     bool is_hung;
+    CancelTokenPtr cancel;      // Carried by the session's agent run
+    std::chrono::steady_clock::time_point next_typing;
+    uint64_t serial;            // Tells a restarted session from its stale timer
+    Reactor::TimerId timer;     // Armed deadline (0 = none)
     
     AISessionState()
         : started_at(std::chrono::steady_clock::now())
         , last_heartbeat(std::chrono::steady_clock::now())
         , heartbeat_count(0)
         , is_hung(false)
+        , next_typing(std::chrono::steady_clock::now())
+        , serial(0)
+        , timer(0)
     {}
 };
 
@@ -55,21 +68,21 @@ public:
     // Configuration
     struct Config {
         int hang_timeout_seconds;      // Seconds without heartbeat = hung
-        int typing_interval_seconds;   // How often to send typing indicator
-        int check_interval_ms;         // Monitor thread check interval
+        int typing_interval_seconds;   // How often to refresh typing (0 = never)
+        bool cancel_on_hang;           // Cancel a hung session's token
         
         Config()
             : hang_timeout_seconds(60)
             , typing_interval_seconds(5)
-            , check_interval_ms(5000)
+            , cancel_on_hang(true)
         {}
     };
     
     AIProcessMonitor();
     ~AIProcessMonitor();
     
-    // Lifecycle
-    void start();
+    // Lifecycle: deadlines run as timers on reactor
+    void start(Reactor& reactor);
     void stop();
     bool is_running() const { return running_.load(); }
     
@@ -77,14 +90,18 @@ public:
     void set_config(const Config& config) { config_ = config; }
     const Config& get_config() const { return config_; }
     
-    // Session tracking
-    void start_session(const std::string& session_id, 
-                      const std::string& channel_id,
-                      const std::string& chat_id);
+    // Session tracking. start_session returns the token for the run to
+    // carry; runs overlapping under one session id share it.
+    CancelTokenPtr start_session(const std::string& session_id, 
+                                 const std::string& channel_id,
+                                 const std::string& chat_id);
     void heartbeat(const std::string& session_id);
     void end_session(const std::string& session_id);
     
-    // Hung session callback
+    // Cancel the session's token; false if no run is active under it
+    bool cancel(const std::string& session_id);
+    
+    // Hung session callback (runs on the thread pool)
     using HungSessionCallback = std::function<void(const std::string& session_id, 
                                                     int elapsed_seconds)>;
     void set_hung_callback(HungSessionCallback cb) { hung_callback_ = cb; }
@@ -94,7 +111,7 @@ public:
         int active_sessions;
         int total_sessions_started;
         int total_hung_detected;
-        int total_typing_indicators_sent;
+        int total_typing_indicators_sent;   // By the TypingIndicator, all callers
     };
     Stats get_stats() const;
     
@@ -104,29 +121,30 @@ private:
     
     // State
     std::atomic<bool> running_;
-    std::thread monitor_thread_;
+    Reactor* reactor_;
     
     // Session tracking
     mutable std::mutex sessions_mutex_;
     std::map<std::string, AISessionState> active_sessions_;
+    uint64_t next_serial_;
     
     // Statistics
     std::atomic<int> total_sessions_started_;
     std::atomic<int> total_hung_detected_;
-    std::atomic<int> total_typing_indicators_sent_;
     
     // Callbacks
     HungSessionCallback hung_callback_;
     
-    // Monitoring thread
-    void monitor_loop();
+    // Reactor thread: arm the session's timer for its next deadline
+    void schedule(const std::string& session_id, uint64_t serial);
+    void arm_locked(const std::string& session_id, AISessionState& state);
     
-    // Check a single session
-    void check_session(const std::string& session_id, AISessionState& state);
+    // Reactor thread: a session's timer fired
+    void on_deadline(const std::string& session_id, uint64_t serial);
     
-    // Send typing indicator to channel
-    void send_typing_indicator(const std::string& channel_id, 
-                               const std::string& chat_id);
+    // Off the reactor thread: notify and run the hung callback
+    void report_hung(const std::string& session_id, int elapsed_seconds);
+
 };
 
 } // namespace opencrank
@@ -0,0 +1,40 @@
+/*
+ * opencrank C++ - Memory Allocator
+ *
+ * The process allocator is picked at build time: make ALLOCATOR=mimalloc
+ * or ALLOCATOR=jemalloc links that library in place of the C library's
+ * malloc, so core and plugins (std::string, JSON values, ...) all use it.
+ * These hooks give each ThreadPool worker its own arena, report what the
+ * allocator holds for /metrics and /stats memory, and hand freed pages
+ * back to the system after session histories were unloaded.
+ */
+#ifndef opencrank_CORE_ALLOCATOR_HPP
+#define opencrank_CORE_ALLOCATOR_HPP
+
+#include <cstddef>
+
+namespace opencrank {
+namespace allocator {
+
+struct Stats {
+    size_t allocated;       // Bytes handed out to the program (0 = unknown)
+    size_t resident;        // Bytes the allocator keeps mapped (0 = unknown)
+};
+
+// "mimalloc", "jemalloc" or "libc"
+const char* name();
+
+// Called by each ThreadPool worker before its first task. jemalloc gets a
+// dedicated arena per worker; mimalloc and glibc already keep per-thread
+// heaps, so there it only sets those up early.
+void init_thread();
+
+Stats stats();
+
+// Return free pages to the system. Walks the heap: not for hot paths.
+void release_free();
+
+} // namespace allocator
+} // namespace opencrank
+
+#endif // opencrank_CORE_ALLOCATOR_HPP
@@ -12,17 +12,27 @@
 #include "registry.hpp"
 #include "sandbox.hpp"
 #include "session.hpp"
+#include "session_store.hpp"
 #include "thread_pool.hpp"
+#include "session_executor.hpp"
 #include "rate_limiter.hpp"
 #include "agent.hpp"
 #include "ai_monitor.hpp"
+#include "reactor.hpp"
+#include "cron.hpp"
+#include "startup_profile.hpp"
+#include "command_table.hpp"
+#include "batch_runner.hpp"
 #include "../skills/manager.hpp"
 #include "../skills/types.hpp"
+#include "../skills/watcher.hpp"
 
 #include <string>
 #include <vector>
 #include <atomic>
 #include <thread>
+#include <memory>
+#include <mutex>
 
 namespace opencrank {
 
@@ -60,10 +70,18 @@ public:
     PluginRegistry& registry() { return PluginRegistry::instance(); }
     SessionManager& sessions() { return SessionManager::instance(); }
     ThreadPool* thread_pool() { return thread_pool_; }
+    SessionExecutor& session_executor() { return session_executor_; }
     
     SkillManager& skills() { return skill_manager_; }
-    const std::vector<SkillEntry>& skill_entries() const { return skill_entries_; }
-    const std::vector<SkillCommandSpec>& skill_commands() const { return skill_command_specs_; }
+    
+    // Current skill set; hold the pointer for as long as entries are used
+    std::shared_ptr<const SkillCatalog> skill_catalog() const;
+    
+    // Slash command dispatch (registry, built-in and skill commands)
+    CommandTablePtr command_table() const;
+    
+    // Rescan skill directories and swap in the new catalog and system prompt
+    void reload_skills();
     
     Agent& agent() { return agent_; }
     
@@ -75,14 +93,20 @@ public:
     MessageDebouncer& debouncer() { return debouncer_; }
     TypingIndicator& typing() { return typing_; }
     
-    // System prompt (can be customized via config)
-    const std::string& system_prompt() const { return system_prompt_; }
+    // System prompt (can be customized via config; changes on skill reload)
+    std::string system_prompt() const;
     
     // ==================== Lifecycle ====================
     
     // State
     bool is_running() const { return running_.load(); }
-    void stop() { running_.store(false); }
+    void stop() { running_.store(false); reactor_.stop(); }
+    
+    // Started with --batch: no channels, run() works through the input file
+    bool batch_mode() const { return !batch_options_.input.empty(); }
+    
+    // Main event loop (plugins register fds/timers in attach_reactor)
+    Reactor& reactor() { return reactor_; }
     
     // Initialize the application
     bool init(int argc, char* argv[]);
@@ -92,6 +116,20 @@ public:
     
     // Cleanup
     void shutdown();
+    
+    // Re-read the config file on the main loop (async-signal-safe, SIGHUP)
+    void request_config_reload();
+    
+    // Hand over to a new image of the binary (async-signal-safe, SIGUSR2):
+    // run() drains and returns, shutdown() saves the handoff, and
+    // exec_restart() starts the new process
+    void request_hot_restart();
+    bool restarting() const { return restarting_; }
+    bool exec_restart(char* argv[]);
+    
+    // Stop the agent run of an AI monitor session (/stop): its token is
+    // cancelled and its tool processes are killed. False if none is running.
+    bool cancel_session(const std::string& session_id);
 
 private:
     // Private constructor for singleton
@@ -102,20 +140,70 @@ private:
     void setup_sandbox();      // Phase 1: create dirs, override paths
     void activate_sandbox();   // Phase 2: activate Landlock (after plugins loaded)
     void setup_logging();
-    void setup_system_prompt();
+    void apply_log_level();
+    void reload_config();
+    void setup_thread_pool();
+    void setup_http();
+    void setup_tool_workers();  // Fork the shell worker zygote (before any thread starts)
     void setup_skills();
+    std::string compose_system_prompt(const std::vector<SkillEntry>& entries);
+    void schedule_skill_reload();
     void setup_agent();
     void setup_plugins();
     void setup_channels();
+    void setup_reactor();
+    void setup_sessions();
+    void setup_metrics();       // Scrape-time gauges for /metrics
     void warmup_ai();
+    void send_typing_batch(const std::string& channel_id,
+                           const std::vector<std::string>& chat_ids, bool typing);   // TypingIndicator sender
+    void run_phase(const char* name, void (Application::*setup)());   // Timed setup step
+    bool drain_for_restart();   // True once running turns are done (or out of time)
+    void save_restart_state();
+    
+    // Hot plugin reload, on SIGHUP after the config: a .so rebuilt on disk
+    // is replaced, one dropped from "plugins" unloaded and a newly listed
+    // one loaded. Leaving plugins are unregistered first; the libraries
+    // close once PluginRegistry::quiescent() says no call is still in them.
+    void reload_plugins();
+    void finish_plugin_reload(bool drained);
+    Plugin* bring_up_plugin(const std::string& entry, size_t position);
+    bool hot_swappable(Plugin* plugin, std::string& why) const;
+    
+    struct PluginReload {
+        struct Leaving {
+            std::string name;
+            std::string reload_path;            // "" = unload only
+            Plugin* plugin;
+            size_t position;                    // In the registry
+            bool attached;                      // Was detached from reactor_
+        };
+        std::vector<Leaving> leaving;           // In unregister order
+        std::vector<std::string> arriving;      // Newly listed names/paths
+        uint64_t generation;                    // Registry after unregistering
+        int64_t deadline_ms;
+        Reactor::TimerId timer;                 // Drain check (0 = no reload running)
+        
+        PluginReload() : generation(0), deadline_ms(0), timer(0) {}
+    };
+    PluginReload plugin_reload_;
     
     // State
     std::atomic<bool> running_;
+    std::atomic<bool> reload_requested_;
+    std::atomic<bool> restart_requested_;
+    int64_t restart_deadline_ms_;           // Drain ends (0 = not draining)
+    bool restarting_;                       // Drain done, hand over at exit
+    Reactor reactor_;
+    std::vector<Plugin*> legacy_pollers_;   // Plugins still driven by poll()
+    uint64_t released_evictions_;           // Session evictions seen by the last heap trim
     
     // Core components
     Config config_;
     PluginLoader loader_;
     ThreadPool* thread_pool_;
+    SessionExecutor session_executor_;
+    SessionStore session_store_;
     Agent agent_;
     AIProcessMonitor ai_monitor_;
     
@@ -126,19 +214,32 @@ private:
     
     // Skills system
     SkillManager skill_manager_;
-    std::vector<SkillEntry> skill_entries_;
-    std::vector<SkillCommandSpec> skill_command_specs_;
+    SkillWatcher skill_watcher_;
+    Reactor::TimerId skill_reload_timer_;     // Pending debounce timer (0 = none)
+    std::atomic<bool> skill_reload_running_;
     
-    // System prompt
+    // Skill catalog, command table and system prompt, swapped together on reload
+    mutable std::mutex skills_mutex_;
+    std::shared_ptr<const SkillCatalog> skill_catalog_;
+    CommandTablePtr command_table_;
     std::string system_prompt_;
     std::string config_file_;
     
-    // CRON task thread
+    // Startup timings; printed with --profile-startup
+    StartupProfile startup_profile_;
+    bool profile_startup_;
+    
+    // Offline batch mode (--batch); opened in init() before the sandbox
+    std::string launch_dir_;                // Working directory at start, for relative paths
+    BatchRunner::Options batch_options_;
+    std::unique_ptr<BatchRunner> batch_;
+    int run_batch();
+    
+    // CRON tasks: fired into the agent on the background lane
     void start_cron_thread();
     void stop_cron_thread();
-    void cron_thread_func();
-    std::thread* cron_thread_ = nullptr;
-    std::atomic<bool> cron_thread_stop_{false};
+    void fire_cron_task(const std::string& task_id, time_t when);
+    CronScheduler cron_;
 };
 
 // ============================================================================
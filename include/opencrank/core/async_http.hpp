@@ -0,0 +1,110 @@
+/*
+ * opencrank C++ - Asynchronous HTTP
+ *
+ * One event-loop thread drives every transfer started with submit() through
+ * a curl multi handle, so a request in flight costs a socket and a few
+ * kilobytes instead of a thread blocked in curl_easy_perform(). AI providers
+ * build their chat_async() on it.
+ *
+ * Streamed data and completion callbacks run on the loop thread and hold
+ * up every other transfer while they run: parse or copy what is needed,
+ * then hand real work to the ThreadPool.
+ *
+ * Transfers share DNS results, TLS sessions and connections with the
+ * HttpClientPool and are multiplexed over HTTP/2 where the server allows.
+ */
+#ifndef opencrank_CORE_ASYNC_HTTP_HPP
+#define opencrank_CORE_ASYNC_HTTP_HPP
+
+#include "http_client.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace opencrank {
+
+struct AsyncHttpRequest {
+    std::string method;         // GET or POST (default: POST)
+    std::string url;
+    std::string body;
+    std::map<std::string, std::string> headers;
+    long timeout_ms;            // Whole transfer (default: 60000)
+    int64_t delay_ms;           // Start this much later (pacing, retry backoff)
+    HttpDataCallback on_data;   // Body bytes as they arrive, like HttpClient::post_json_stream
+    const std::atomic<bool>* cancel;    // Abandon once true (NULL = never)
+
+    AsyncHttpRequest() : method("POST"), timeout_ms(60000), delay_ms(0), cancel(NULL) {}
+};
+
+// Receives the finished transfer; status_code 0 with error set on failure
+typedef std::function<void(HttpResponse& response)> AsyncHttpCallback;
+
+class AsyncHttp {
+public:
+    static AsyncHttp& instance();
+
+    // Start the loop thread; false if curl multi is unavailable
+    bool start();
+
+    // Fail transfers still in flight and join the loop thread (call before
+    // HttpClientPool::shutdown)
+    void stop();
+
+    bool running() const { return running_.load(); }
+
+    // Start request; done runs exactly once on the loop thread. False (and
+    // done never runs) when the loop is not running.
+    bool submit(AsyncHttpRequest request, const AsyncHttpCallback& done);
+
+    // A cancel flag was set: fail those transfers now rather than at their
+    // next progress callback (up to a second away on an idle connection)
+    void wake_cancelled();
+
+    // Stats
+    size_t in_flight() const { return in_flight_.load(); }
+    uint64_t completed() const { return completed_.load(); }
+
+private:
+    AsyncHttp();
+    ~AsyncHttp();
+    AsyncHttp(const AsyncHttp&);
+    AsyncHttp& operator=(const AsyncHttp&);
+
+    struct Transfer;
+
+    void loop();
+    void add(Transfer* transfer);
+    // Start delayed transfers that are due, fail cancelled ones; returns
+    // the ms until the next is due (-1 = none waiting)
+    int64_t start_delayed();
+    void fail_cancelled();
+    void finish(Transfer* transfer, CURLcode code);
+
+    static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
+    static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata);
+    static int progress_callback(void* userdata, curl_off_t dltotal, curl_off_t dlnow,
+                                 curl_off_t ultotal, curl_off_t ulnow);
+
+    CURLM* multi_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::set<Transfer*> active_;        // Loop thread only
+    std::multimap<int64_t, Transfer*> delayed_;     // By start time; loop thread only
+
+    std::mutex mutex_;
+    std::vector<Transfer*> incoming_;   // Submitted, not yet added to multi_
+    std::atomic<bool> cancel_pending_;  // Set by wake_cancelled()
+
+    std::atomic<size_t> in_flight_;
+    std::atomic<uint64_t> completed_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_ASYNC_HTTP_HPP
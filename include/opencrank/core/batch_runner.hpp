@@ -0,0 +1,108 @@
+/*
+ * opencrank C++ - Offline Batch Mode
+ *
+ * `opencrank --batch input.jsonl [--out results.jsonl] [--concurrency N]`
+ * pushes prompts through the same agent loop, tools and providers as chat
+ * traffic, with no channel started. Each input line is one conversation:
+ *
+ *   {"id": "q1", "prompt": "..."}
+ *   {"id": "q2", "turns": ["first message", "follow-up"], "system": "..."}
+ *
+ * ("id" defaults to the line number; "system" replaces the configured
+ * system prompt for that item.) Up to N conversations run at once through
+ * Agent::run_async, so the provider sees N concurrent requests and batches
+ * them the way it batches chat sessions (llama.cpp slots, fair share).
+ *
+ * Every finished conversation is appended to the output file as one JSON
+ * line, flushed at once: status, response, per-turn timings (duration,
+ * model and tool time) and token usage. The output doubles as the
+ * checkpoint: a rerun skips ids already in it, so an interrupted batch
+ * resumes where it stopped. SIGINT stops starting new items and cancels
+ * the running ones, which are not written and run again on resume.
+ *
+ * Config (section "batch"):
+ *   batch.concurrency - Conversations in flight when --concurrency is not
+ *                       given (default: 4)
+ */
+#ifndef opencrank_CORE_BATCH_RUNNER_HPP
+#define opencrank_CORE_BATCH_RUNNER_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+
+namespace opencrank {
+
+class Agent;
+class AIPlugin;
+class ThreadPool;
+
+class BatchRunner {
+public:
+    struct Options {
+        std::string input;
+        std::string output;         // "" = <input>.results.jsonl
+        int concurrency;
+
+        Options() : concurrency(4) {}
+    };
+
+    explicit BatchRunner(const Options& options);
+    ~BatchRunner();
+
+    // Read the input and the ids already in the output, and open the
+    // output for appending. Call before the sandbox locks the filesystem.
+    bool open(std::string& error);
+
+    // Run every item not in the output yet, up to concurrency at once on
+    // pool; returns once each is written or stop() was called.
+    // Exit status: 0 when every item finished with status "ok".
+    int run(Agent& agent, AIPlugin* ai, ThreadPool* pool, const std::string& system_prompt);
+
+    // Start no more items and cancel the running ones
+    void stop();
+
+    const Options& options() const { return options_; }
+
+private:
+    BatchRunner(const BatchRunner&);
+    BatchRunner& operator=(const BatchRunner&);
+
+    struct Item {
+        std::string id;
+        std::vector<std::string> turns;
+        std::string system;         // "" = the configured prompt
+    };
+
+    struct Conversation;            // Defined in batch_runner.cpp
+
+    void next_turn(Conversation* conv);
+    void finish(Conversation* conv);
+
+    Options options_;
+    std::vector<Item> items_;
+    std::set<std::string> done_;    // Ids found in the output at open()
+    FILE* out_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::set<Conversation*> running_;
+    std::atomic<bool> stopping_;
+
+    // Totals for the summary (under mutex_)
+    size_t ok_;
+    size_t failed_;
+    int64_t prompt_tokens_;
+    int64_t cached_tokens_;
+    int64_t completion_tokens_;
+    std::vector<int64_t> durations_ms_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_BATCH_RUNNER_HPP
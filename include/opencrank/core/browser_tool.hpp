@@ -4,15 +4,18 @@
 #include <opencrank/core/tool.hpp>
 #include <opencrank/core/agent.hpp>
 #include <opencrank/core/http_client.hpp>
+#include <opencrank/core/http_cache.hpp>
+#include <opencrank/core/html_tokenizer.hpp>
 #include <opencrank/core/logger.hpp>
 #include <string>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <mutex>
 
 namespace opencrank {
 
+class ContentChunker;
+
 // Browser tool - HTTP fetching and web content extraction
 class BrowserTool : public ToolProvider {
 public:
@@ -35,44 +38,47 @@ public:
 
     ToolResult execute(const std::string& action, const Json& params);
 
+    // Where fetch_many stores page contents (called by Application after agent is set up)
+    void set_chunker(ContentChunker* chunker) { chunker_ = chunker; }
+
 private:
-    HttpClient http_;
     size_t max_content_length_;
+    size_t max_download_bytes_;     // Raw body cap per fetch (0 = unlimited)
     int timeout_secs_;
-    std::mutex http_mutex_;
+    size_t fetch_many_max_urls_;
+    size_t fetch_many_workers_;
+    ContentChunker* chunker_;
 
     ToolResult do_fetch(const Json& params);
+    ToolResult do_fetch_many(const Json& params);
     ToolResult do_request(const Json& params);
     ToolResult do_extract_text(const Json& params);
     ToolResult do_get_links(const Json& params);
     ToolResult do_extract_forms(const Json& params);
     ToolResult do_status();
 
+    // Validate params["url"] and GET it through the shared response cache
+    // (on_data as for HttpCache::get; params["timeout"] overrides the
+    // configured timeout, in seconds). Returns false with result filled in
+    // when the parameters are invalid.
+    bool fetch_page(const Json& params, std::string& url, HttpCacheEntryPtr& page,
+                    HttpCache::Outcome& outcome, ToolResult& result,
+                    const HttpDataCallback* on_data = nullptr);
+    static ToolResult fetch_failure(const std::string& url, const HttpCacheEntry& page);
+
     // Internal: perform an HTTP request with a given method, return structured result
+    // (select: as the tools' select parameter, empty = whole body)
     ToolResult perform_browser_request(const std::string& method, const std::string& url,
                                        const std::string& body, const std::string& content_type,
                                        const std::map<std::string, std::string>& extra_headers,
-                                       const std::string& proxy, size_t max_len, bool extract_text);
+                                       const std::string& proxy, size_t max_len, bool extract_text,
+                                       const std::string& select);
 
-    static std::string strip_html(const std::string& html);
+    static std::string page_text(const std::string& html);     // Cached per page
     static std::vector<std::pair<std::string, std::string> > extract_links(
             const std::string& html, const std::string& base_url);
 
-    // Extract HTML forms from the page (action, method, fields)
-    struct FormField {
-        std::string name;
-        std::string type;       // text, hidden, password, submit, checkbox, radio, etc.
-        std::string value;      // default/preset value
-        bool required;
-        FormField() : required(false) {}
-    };
-    struct HtmlForm {
-        std::string action;     // form action URL
-        std::string method;     // GET or POST
-        std::string id;
-        std::string name;
-        std::vector<FormField> fields;
-    };
+    // Extract HTML forms from the page (action resolved against base_url)
     static std::vector<HtmlForm> extract_html_forms(const std::string& html, const std::string& base_url);
 };
 
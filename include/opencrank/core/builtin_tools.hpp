@@ -6,6 +6,7 @@
  * - write: Write content to files
  * - shell: Execute shell commands
  * - list_dir: List directory contents
+ * - search_files: Grep/find across the workspace (the jail when sandboxed)
  * - content_chunk: Retrieve chunks of large content
  * - content_search: Search within large content
  */
@@ -61,7 +62,10 @@ public:
     
 private:
     std::string workspace_dir_;
-    int shell_timeout_;
+    int shell_timeout_;             // Wall clock per command, seconds (0 = none)
+    int shell_cpu_limit_;           // RLIMIT_CPU per command, seconds (0 = none)
+    size_t shell_memory_bytes_;     // RLIMIT_AS per command (0 = none)
+    size_t shell_max_output_;       // Output kept per command; the agent chunks large results
     ContentChunker* chunker_;
     
     // Internal tool implementations
@@ -69,6 +73,7 @@ private:
     AgentToolResult do_write(const Json& params) const;
     AgentToolResult do_shell(const Json& params) const;
     AgentToolResult do_list_dir(const Json& params) const;
+    AgentToolResult do_search_files(const Json& params) const;
     AgentToolResult do_content_chunk(const Json& params) const;
     AgentToolResult do_content_search(const Json& params) const;
     AgentToolResult do_notify_user(const Json& params) const;
@@ -0,0 +1,50 @@
+/*
+ * opencrank C++ - Cancellation Token
+ *
+ * One per agent run, owned by the AI monitor's session entry. cancel()
+ * (from /stop, or hang detection) flips an atomic flag that everything the
+ * run is blocked in polls: curl's progress callback in HttpClient, the
+ * provider rate pacers and queues, the agent loop between steps. Code that
+ * runs work under flags of its own (the router's hedged requests) links
+ * them, so they are set too.
+ */
+#ifndef opencrank_CORE_CANCEL_TOKEN_HPP
+#define opencrank_CORE_CANCEL_TOKEN_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace opencrank {
+
+class CancelToken {
+public:
+    CancelToken();
+
+    // Set the flag and every linked flag; false if already cancelled
+    bool cancel();
+
+    bool cancelled() const { return flag_.load(); }
+
+    // For APIs that poll a plain flag (CompletionOptions::cancel, HttpClient)
+    const std::atomic<bool>* flag() const { return &flag_; }
+
+    // Set *other on cancel until unlinked (at once if already cancelled)
+    void link(std::atomic<bool>* other);
+    void unlink(std::atomic<bool>* other);
+
+private:
+    CancelToken(const CancelToken&);
+    CancelToken& operator=(const CancelToken&);
+
+    std::atomic<bool> flag_;
+    std::mutex mutex_;
+    std::vector<std::atomic<bool>*> linked_;
+};
+
+typedef std::shared_ptr<CancelToken> CancelTokenPtr;
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_CANCEL_TOKEN_HPP
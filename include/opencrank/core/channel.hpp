@@ -11,6 +11,9 @@ namespace opencrank {
 // Channel plugin interface - for messaging integrations
 class ChannelPlugin : public Plugin {
 public:
+    // Completion for queued sends; may run on a channel-owned thread
+    typedef std::function<void(const SendResult&)> SendCallback;
+    
     virtual ~ChannelPlugin() {}
     
     // Channel metadata
@@ -30,6 +33,26 @@ public:
         return send_message(to, text);
     }
     
+    // Queue a send and return without waiting for the network. Channels with
+    // an outbound queue override this (and set capabilities().async_sends);
+    // the default sends synchronously.
+    virtual void send_message_async(const std::string& to, const std::string& text,
+                                    const std::string& reply_to, SendCallback done) {
+        SendResult result = reply_to.empty() ? send_message(to, text)
+                                             : send_message(to, text, reply_to);
+        if (done) done(result);
+    }
+    
+    // Replace the text of a message sent earlier (optional - channels that
+    // override this should report supports_edit in capabilities())
+    virtual SendResult edit_message(const std::string& to, const std::string& message_id,
+                                    const std::string& text) {
+        (void)to;
+        (void)message_id;
+        (void)text;
+        return SendResult::fail("Message editing not supported by this channel");
+    }
+    
     // Typing indicator (optional - override if channel supports it)
     virtual SendResult send_typing_action(const std::string& to) {
         (void)to;
@@ -0,0 +1,168 @@
+/*
+ * opencrank C++ - Cluster Mode
+ *
+ * Lets several opencrank processes share the traffic of one set of
+ * channels. Every session key hashes onto a ring of virtual nodes
+ * (cluster.vnodes points per node); the node owning the first point
+ * clockwise owns the session. on_message() routes each incoming message:
+ * one for a session owned elsewhere is POSTed to the owner's internal
+ * endpoint, so the owner alone holds the session's history, its runs
+ * (/stop cancels them in process) and its rate-limit state. A forwarded
+ * message is always handled where it lands, never routed again.
+ *
+ * Nodes ping each other every heartbeat_ms. A peer silent for
+ * dead_after_ms, or one that refuses a forward, leaves the ring until it
+ * answers again; only its sessions move (to their next node on the ring),
+ * every other session keeps its owner.
+ *
+ * Forwards to one node leave in arrival order from a queue drained by one
+ * pool worker at a time, so a chat's messages reach their owner in the
+ * order they came in, and a dead peer holds at most one worker until it
+ * leaves the ring. A forward that never reached its owner (connect
+ * failure) is routed again, to the session's next owner or this node. One
+ * the owner may have taken before failing to answer is sent once more, which the
+ * owner's dedup (by message id) absorbs; it is never also handled here.
+ *
+ * The leader is the live node with the smallest id. With cluster.cron set
+ * to "leader", only the leader fires scheduled tasks, routing each to the
+ * node owning its conversation: meant for a memory database all nodes
+ * share. "local" fires the tasks of each node's own database.
+ *
+ * Every node needs the same channel credentials (the owner sends the
+ * replies) and must receive ingress: webhooks or bridges behind a load
+ * balancer, gateway clients on any node. A session that changes owner
+ * continues from the new owner's session store, so point
+ * session.store_path at shared storage to keep histories across failover.
+ * Rate limits are enforced by the owner: exact per chat, while a user
+ * active in chats owned by N nodes is limited by each of them.
+ *
+ * Config (section "cluster"; single node unless enabled):
+ *   cluster.enabled       - Join a cluster (default: false)
+ *   cluster.node_id       - This node's id in cluster.nodes
+ *   cluster.nodes         - [{"id": "a", "url": "http://10.0.0.1:18790"}, ...]
+ *   cluster.bind          - Address of the internal endpoint (default: 0.0.0.0)
+ *   cluster.port          - Its port (default: 18790)
+ *   cluster.secret        - Shared secret required on internal requests
+ *   cluster.vnodes        - Ring points per node (default: 64)
+ *   cluster.heartbeat_ms  - Ping interval (default: 2000)
+ *   cluster.dead_after_ms - Silence before a peer leaves the ring (default: 6000)
+ *   cluster.cron          - "leader" (default) or "local"
+ */
+#ifndef opencrank_CORE_CLUSTER_HPP
+#define opencrank_CORE_CLUSTER_HPP
+
+#include "config.hpp"
+#include "types.hpp"
+#include "http_listener.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+namespace opencrank {
+
+class Reactor;
+class ThreadPool;
+class Counter;
+
+class Cluster {
+public:
+    // Hands a message to this node's normal processing
+    typedef std::function<void(const Message& msg)> Deliver;
+
+    static Cluster& instance();
+
+    // Read the cluster section; false when enabled but misconfigured
+    // (the node then runs alone)
+    bool configure(const Config& cfg);
+
+    // Open the internal endpoint and start the heartbeat. Forwards and
+    // pings run on pool; deliver receives forwarded messages.
+    bool start(Reactor& reactor, ThreadPool* pool, const Deliver& deliver);
+    void stop();
+
+    bool enabled() const;
+    std::string node_id() const;
+
+    // Id of the node owning session_key (this node when not clustered)
+    std::string owner_of(const std::string& session_key) const;
+
+    // Send msg to the owner of session_key. False when this node owns it
+    // and should process msg itself.
+    bool route(const std::string& session_key, const Message& msg);
+
+    bool is_leader() const;
+
+    // This node fires scheduled tasks (always, unless cron = "leader"
+    // and another node leads)
+    bool runs_cron() const;
+
+    size_t live_nodes() const;
+
+private:
+    Cluster();
+    Cluster(const Cluster&);
+    Cluster& operator=(const Cluster&);
+
+    struct Node {
+        std::string id;
+        std::string url;            // Base URL of its internal endpoint
+        bool alive;
+        int64_t last_seen_ms;
+    };
+
+    struct Forward {
+        std::string session_key;
+        Message msg;
+    };
+
+    // Forwards waiting for one owner; one worker drains them in order
+    struct Outbox {
+        std::deque<Forward> queue;
+        bool draining;
+
+        Outbox() : draining(false) {}
+    };
+
+    void rebuild_ring_locked();
+    void mark(const std::string& id, bool alive);
+    void heartbeat();
+    void drain_outbox(const std::string& owner);
+    void forward(const std::string& owner, const Forward& fwd);
+
+    // Internal endpoint, on the reactor thread
+    void handle_request(const HttpRequest& request, HttpReply& reply);
+
+    mutable std::mutex mutex_;
+    bool enabled_;
+    bool leader_cron_;
+    std::string node_id_;
+    std::string secret_;
+    std::string bind_;
+    int port_;
+    int vnodes_;
+    int heartbeat_ms_;
+    int64_t dead_after_ms_;
+    std::vector<Node> nodes_;                   // Peers and this node
+    std::map<uint64_t, std::string> ring_;      // Point -> node id, live nodes only
+
+    Reactor* reactor_;
+    ThreadPool* pool_;
+    Deliver deliver_;
+    HttpListener listener_;
+    uint64_t heartbeat_timer_;
+    std::map<std::string, Outbox> outbox_;      // Owner id -> its pending forwards
+    std::atomic<bool> pinging_;
+
+    Counter* forwarded_;
+    Counter* forward_failed_;
+    Counter* received_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_CLUSTER_HPP
@@ -0,0 +1,96 @@
+/*
+ * opencrank C++ - Command Dispatch Table
+ *
+ * One compiled lookup for every slash command: registry commands (core and
+ * plugin), the built-in /skills and /skill forms, skill commands and
+ * aliases. Names are matched case-insensitively by walking a byte trie, so
+ * resolving a command costs O(length of the name) no matter how many
+ * skills are installed.
+ *
+ * The table is immutable once built. The application rebuilds it whenever
+ * the skill set changes and swaps it in; callers hold the shared_ptr while
+ * they use a match (the table keeps the skill catalog it points into
+ * alive).
+ *
+ * Precedence when names collide: registry commands and built-ins, then
+ * skill command names, then aliases. Later claims on a taken name are
+ * ignored (and logged).
+ */
+#ifndef opencrank_CORE_COMMAND_TABLE_HPP
+#define opencrank_CORE_COMMAND_TABLE_HPP
+
+#include "types.hpp"
+#include "../skills/types.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+namespace opencrank {
+
+class CommandTable {
+public:
+    enum Kind {
+        NONE,           // Not a known command
+        REGISTRY,       // CommandDef registered with the PluginRegistry
+        SKILL,          // Skill command (/name or /skill name)
+        LIST_SKILLS     // Built-in /skills
+    };
+
+    struct Match {
+        Kind kind;
+        const CommandDef* command;       // REGISTRY
+        const SkillCommandSpec* skill;   // SKILL
+        const SkillEntry* entry;         // SKILL (NULL if the entry is not eligible)
+        std::string args;                // Text after the command name
+
+        Match() : kind(NONE), command(NULL), skill(NULL), entry(NULL) {}
+    };
+
+    CommandTable();
+
+    // Compile registry commands, built-ins and the catalog's skill commands.
+    // aliases maps extra names to existing commands ("/h" -> "/help");
+    // skills also answer to their original name and any names listed in
+    // their "aliases" frontmatter key.
+    static std::shared_ptr<const CommandTable> build(
+        const std::map<std::string, CommandDef>& registry_commands,
+        const std::shared_ptr<const SkillCatalog>& catalog,
+        const std::map<std::string, std::string>& aliases);
+
+    // Resolve "/name args" (also "/skill name args"). Leading whitespace is
+    // ignored; the command must start with '/'.
+    Match resolve(const std::string& text) const;
+
+    // Names known to the table (for diagnostics)
+    size_t size() const { return names_; }
+
+private:
+    struct Target {
+        Kind kind;
+        int32_t index;      // Into commands_ (REGISTRY) or the catalog (SKILL)
+    };
+
+    struct Node {
+        std::vector<std::pair<unsigned char, int32_t> > edges;  // Sorted by byte
+        int32_t target;     // Index into targets_, -1 if no name ends here
+    };
+
+    // Add name -> target; false if the name is already taken
+    bool insert(const std::string& name, const Target& target);
+    const Target* find(const char* name, size_t len) const;
+
+    std::vector<Node> nodes_;
+    std::vector<Target> targets_;
+    std::vector<const CommandDef*> commands_;
+    std::vector<const SkillEntry*> skill_entries_;   // Parallel to catalog_->commands
+    std::shared_ptr<const SkillCatalog> catalog_;
+    size_t names_;
+};
+
+typedef std::shared_ptr<const CommandTable> CommandTablePtr;
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_COMMAND_TABLE_HPP
@@ -20,6 +20,9 @@ namespace commands {
     std::string cmd_monitor(const Message& msg, Session& session, const std::string& args);
     std::string cmd_continue(const Message& msg, Session& session, const std::string& args);
     std::string cmd_cancel(const Message& msg, Session& session, const std::string& args);
+    std::string cmd_stop(const Message& msg, Session& session, const std::string& args);
+    std::string cmd_trace(const Message& msg, Session& session, const std::string& args);
+    std::string cmd_stats(const Message& msg, Session& session, const std::string& args);
 }
 
 // Register built-in core commands (/ping, /help, /info, /start, /new, /status, /tools)
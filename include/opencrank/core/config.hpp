@@ -4,42 +4,84 @@
 #include "json.hpp"
 #include <string>
 #include <fstream>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <cstdint>
 
 namespace opencrank {
 
+// Configuration loaded from config.json.
+//
+// Every load publishes an immutable snapshot: the parsed tree plus a flat
+// hash map from each dotted path ("gateway.auth.token") to its node, built
+// once. Lookups are one hash probe on the snapshot current at the call, read
+// through an atomic pointer without locking. reload() re-reads the file and
+// swaps in a new snapshot; values read at call time pick it up, values a
+// component copied at startup do not. Snapshots are kept until the Config
+// is destroyed, so references from data() and get_section() stay valid.
 class Config {
 public:
     Config();
-    
-    // Load from JSON file
+
+    // Load from JSON file (remembered for reload)
     bool load_file(const std::string& path);
-    
+
     // Load from JSON string
     bool load_string(const std::string& json_str);
-    
+
+    // Re-read the file given to load_file; set_string overrides are kept.
+    // On a parse error the current snapshot stays.
+    bool reload();
+
     // Get string value
     std::string get_string(const std::string& key, const std::string& def = "") const;
-    
+
     // Set a string value (dot-notation supported for top-level section.key)
     void set_string(const std::string& key, const std::string& value);
-    
+
     int64_t get_int(const std::string& key, int64_t def = 0) const;
-    
+
     bool get_bool(const std::string& key, bool def = false) const;
-    
+
     // Get nested object
     const Json& get_section(const std::string& key) const;
-    
+
     // Channel-specific config helper
-    std::string get_channel_string(const std::string& channel, 
+    std::string get_channel_string(const std::string& channel,
                                     const std::string& key,
                                     const std::string& def = "") const;
-    
+
     // Raw data access
     const Json& data() const;
 
+    // Bumped by every load, reload and set_string
+    uint64_t generation() const;
+
+    const std::string& path() const { return path_; }
+
 private:
-    Json data_;
+    Config(const Config&);
+    Config& operator=(const Config&);
+
+    struct Snapshot {
+        Json data;
+        std::unordered_map<std::string, const Json*> index;   // dotted path -> node
+        uint64_t generation;
+    };
+
+    // Index data and make it current (caller holds write_mutex_)
+    void publish(Json data);
+    const Json* find(const std::string& key) const;
+
+    std::atomic<const Snapshot*> current_;
+    std::vector<std::unique_ptr<Snapshot> > snapshots_;   // Every published snapshot
+    std::vector<std::pair<std::string, std::string> > overrides_;
+    std::string path_;
+    std::mutex write_mutex_;
 };
 
 } // namespace opencrank
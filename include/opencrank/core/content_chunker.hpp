@@ -3,6 +3,33 @@
  * 
  * Handles large content that exceeds token limits by splitting into
  * manageable chunks with search and navigation support.
+ *
+ * Chunk boundaries are chosen once, at store time: each chunk is at most
+ * chunk_size bytes and ends, where the text allows, before a heading or
+ * code fence, after a blank line or a closing HTML block tag, at a line
+ * end, or after a space, in that order of preference. Cuts never land
+ * inside a UTF-8 sequence and, when avoidable, never inside an HTML tag.
+ * Each chunk's token count (approximate counter) is kept with it, so the
+ * model can ask for as many chunks as fit its budget, and the HTML-cleaned
+ * text of a chunk is cached once it was asked for.
+ *
+ * store() indexes content once: a lowercased copy for case-insensitive
+ * scans, line offsets, and a trigram signature per chunk. A substring
+ * search only scans chunks whose signature holds every trigram of the
+ * query; regex searches skip contents that lack the pattern's required
+ * literal.
+ *
+ * Memory is bounded by set_limits(): past the byte budget, the least
+ * recently used content of the owner (session) holding the most memory is
+ * spilled to a file in the spill directory, so one session's scrapes push
+ * out its own old results before anyone else's. Spilled chunks are read
+ * back through mmap; a targeted search loads the content again. Spill files
+ * beyond the disk budget are deleted oldest first. Thread-safe.
+ *
+ * store_file() registers a file from the workspace without copying it: the
+ * entry starts out "spilled" to the file itself, so paging reads only the
+ * requested chunk through mmap. Such entries are never loaded, unlinked or
+ * counted against the disk budget, and are dropped if the file changes.
  */
 #ifndef opencrank_CORE_CONTENT_CHUNKER_HPP
 #define opencrank_CORE_CONTENT_CHUNKER_HPP
@@ -10,6 +37,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <mutex>
+#include <cstdint>
 
 namespace opencrank {
 
@@ -21,32 +51,78 @@ struct ChunkedContent {
     std::string id;              // Unique identifier for this content
     std::string full_content;    // The complete content
     std::string source;          // Where this content came from (tool name, url, etc.)
-    size_t chunk_size;           // Size of each chunk in characters
+    size_t chunk_size;           // Maximum size of a chunk in bytes
     size_t total_chunks;         // Total number of chunks
     
-    ChunkedContent() : chunk_size(8000), total_chunks(0) {}
+    // Layout, built once by store() and kept while spilled
+    std::vector<uint32_t> chunk_starts; // total_chunks + 1 offsets (last = content_size)
+    std::vector<uint32_t> chunk_tokens; // Approximate tokens per chunk
+    std::vector<std::string> cleaned;   // HTML-cleaned chunks asked for so far (resident only)
+    
+    // Search index, built once by store()
+    std::string lower;                  // ASCII-lowercased full_content
+    std::vector<uint32_t> line_starts;  // Offset of each line (for match line numbers)
+    std::vector<uint64_t> signatures;   // Per-chunk trigram bitmaps, words_per_chunk each
+    size_t words_per_chunk;
+    int signature_shift;                // 32 - log2(bits per chunk signature)
+    
+    // Residency
+    std::string owner;                  // Session key of the storing run ("" = shared)
+    size_t content_size;                // full_content.size(), also while spilled
+    std::string spill_path;             // Non-empty while the content lives on disk
+    size_t resident_bytes;              // Accounted memory while resident
+    std::list<std::string>::iterator lru_pos;
+    
+    // store_file(): spill_path is the caller's file, as of file_mtime_ns
+    bool external;
+    int64_t file_mtime_ns;
+    
+    ChunkedContent()
+        : chunk_size(8000), total_chunks(0), words_per_chunk(0), signature_shift(0)
+        , content_size(0), resident_bytes(0), external(false), file_mtime_ns(0) {}
+    
+    bool spilled() const { return !spill_path.empty(); }
+    size_t chunk_begin(size_t c) const { return chunk_starts[c]; }
+    size_t chunk_length(size_t c) const { return chunk_starts[c + 1] - chunk_starts[c]; }
+    size_t chunk_of(size_t position) const;
 };
 
 class ContentChunker {
 public:
     ContentChunker();
+    ~ContentChunker();
+    
+    // Memory budget in bytes (0 = unbounded). With an empty spill_dir, or a
+    // disk budget of 0, evicted content is dropped instead of spilled.
+    // Stale spill files in spill_dir are removed.
+    void set_limits(size_t memory_budget, const std::string& spill_dir, size_t disk_budget);
     
     // Store content and return a unique ID
     // chunk_size: 0 means use default (8000)
-    std::string store(const std::string& content, const std::string& source, size_t chunk_size = 0);
+    // owner: session the content belongs to, for fair eviction
+    std::string store(const std::string& content, const std::string& source, size_t chunk_size = 0,
+                      const std::string& owner = "");
     
-    // Get a specific chunk (0-indexed)
-    std::string get_chunk(const std::string& id, size_t chunk_index, bool clean_html = false) const;
+    // Register an existing file by reference and return its ID ("" if it
+    // cannot be read). The file is not copied.
+    std::string store_file(const std::string& path, const std::string& source, size_t chunk_size = 0,
+                           const std::string& owner = "");
+    
+    // Get a specific chunk (0-indexed). With max_tokens, the following
+    // chunks are appended too while their token counts still fit (the
+    // first one is always returned).
+    std::string get_chunk(const std::string& id, size_t chunk_index, bool clean_html = false,
+                          size_t max_tokens = 0);
     
     // Get summary info about stored content
     std::string get_info(const std::string& id) const;
     
     // Search within stored content and return chunk IDs where matches are found
     // use_regex: if true, query is treated as a regex pattern
-    std::string search_with_chunks(const std::string& id, const std::string& query, size_t context_chars = 300, bool use_regex = false) const;
+    std::string search_with_chunks(const std::string& id, const std::string& query, size_t context_chars = 300, bool use_regex = false);
     
     // Search across all stored chunks and return results grouped by content ID
-    std::string search_all_chunks(const std::string& query, size_t context_chars = 300, bool use_regex = false) const;
+    std::string search_all_chunks(const std::string& query, size_t context_chars = 300, bool use_regex = false);
     
     // Check if content exists
     bool has(const std::string& id) const;
@@ -58,8 +134,35 @@ public:
     // Get total chunks for an ID
     size_t get_total_chunks(const std::string& id) const;
     
+    // Stats
+    size_t memory_used() const;
+    size_t disk_used() const;
+    
+    // Resident bytes per owner (session key, "" = shared)
+    std::map<std::string, size_t> owner_usage() const;
+    
 private:
+    ContentChunker(const ContentChunker&);
+    ContentChunker& operator=(const ContentChunker&);
+    
+    // All below require mutex_
+    void touch(ChunkedContent& cc);
+    void enforce_limits(const std::string& keep_id);
+    bool spill(ChunkedContent& cc);
+    bool load(ChunkedContent& cc);              // Bring spilled content back
+    void erase(std::map<std::string, ChunkedContent>::iterator it);
+    void account(ChunkedContent& cc, bool resident);
+    bool file_changed(const ChunkedContent& cc) const;   // External file modified since store_file()
+    
+    mutable std::mutex mutex_;
     std::map<std::string, ChunkedContent> storage_;
+    std::list<std::string> lru_;                    // Front = most recently used
+    std::map<std::string, size_t> owner_bytes_;     // Resident bytes per owner
+    size_t memory_used_;
+    size_t disk_used_;
+    size_t memory_budget_;
+    size_t disk_budget_;
+    std::string spill_dir_;
     int next_id_;
 };
 
@@ -6,6 +6,11 @@
  * - Generates conversation resumes to preserve continuity
  * - Saves resumes to persistent memory
  * - Wipes context and reloads memory for fresh continuation
+ * - Counts tokens with a pluggable TokenCounter, memoized per message
+ * - Pre-builds the resume on the background lane: once usage passes
+ *   summary_start, each summary_window new messages are folded into a
+ *   rolling per-session summary, so the resume cycle at usage_threshold
+ *   swaps it in without a model call on the request path
  * 
  * This replaces the old "chop messages" approach with a smart
  * resume-based context management strategy.
@@ -15,13 +20,19 @@
 
 #include <opencrank/core/json.hpp>
 #include <opencrank/ai/ai.hpp>
+#include <opencrank/core/token_counter.hpp>
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
 
 namespace opencrank {
 
 // Forward declarations
 class MemoryTool;
+class ThreadPool;
 
 // ============================================================================
 // Context Manager Configuration
@@ -29,17 +40,23 @@ class MemoryTool;
 
 struct ContextManagerConfig {
     double usage_threshold;          // Trigger resume at this % (default: 0.75)
-    size_t max_context_chars;        // Total context budget in characters
-    size_t reserve_for_response;     // Characters reserved for AI response
+    size_t max_context_tokens;       // Total context window in tokens
+    size_t reserve_for_response;     // Tokens reserved for AI response
     size_t max_resume_chars;         // Maximum resume size in characters
     bool auto_save_memory;           // Auto-save resume to memory (default: true)
+    bool background_summary;         // Pre-build the resume on the background lane (default: true)
+    double summary_start;            // Start rolling summaries at this % (default: 0.5)
+    size_t summary_window;           // New messages per background fold (default: 8)
     
     ContextManagerConfig()
         : usage_threshold(0.75)
-        , max_context_chars(16000)
-        , reserve_for_response(4000)
+        , max_context_tokens(4096)
+        , reserve_for_response(1024)
         , max_resume_chars(3000)
-        , auto_save_memory(true) {}
+        , auto_save_memory(true)
+        , background_summary(true)
+        , summary_start(0.5)
+        , summary_window(8) {}
 };
 
 // ============================================================================
@@ -47,18 +64,18 @@ struct ContextManagerConfig {
 // ============================================================================
 
 struct ContextUsage {
-    size_t system_prompt_chars;      // System prompt size
-    size_t history_chars;            // All messages size
-    size_t total_chars;              // Total estimated characters
-    size_t budget_chars;             // Available budget
+    size_t system_prompt_tokens;     // System prompt size
+    size_t history_tokens;           // All messages size
+    size_t total_tokens;             // Total tokens
+    size_t budget_tokens;            // Available budget
     double usage_ratio;              // 0.0 to 1.0+
     bool needs_resume;               // True if usage >= threshold
     
     ContextUsage()
-        : system_prompt_chars(0)
-        , history_chars(0)
-        , total_chars(0)
-        , budget_chars(0)
+        : system_prompt_tokens(0)
+        , history_tokens(0)
+        , total_tokens(0)
+        , budget_tokens(0)
         , usage_ratio(0.0)
         , needs_resume(false) {}
 };
@@ -79,6 +96,24 @@ public:
     // Set memory tool for persistence (optional)
     void set_memory_tool(MemoryTool* tool) { memory_tool_ = tool; }
     
+    // Lane for rolling summaries (not owned; without one, resumes are
+    // only generated inside the resume cycle)
+    void set_thread_pool(ThreadPool* pool) { pool_ = pool; }
+    
+    // Replace the token counter (default: ApproxTokenCounter)
+    void set_token_counter(std::shared_ptr<TokenCounter> counter);
+    const TokenCounter& token_counter() const { return *counter_; }
+    
+    // Tokens for one message, including role/template overhead (memoized)
+    size_t count_tokens(const ConversationMessage& message) const;
+    
+    // Tokens for a full request: system prompt plus all messages
+    size_t count_tokens(const std::vector<ConversationMessage>& messages,
+                        const std::string& system_prompt) const;
+    
+    // Token budget available for prompt (window minus response reserve)
+    size_t budget_tokens() const;
+    
     // Estimate current context usage
     ContextUsage estimate_usage(
         const std::vector<ConversationMessage>& history,
@@ -89,7 +124,16 @@ public:
         const std::vector<ConversationMessage>& history,
         const std::string& system_prompt) const;
     
+    // Called before each request with its usage: past summary_start, queue
+    // a fold of the messages added since the session's last summary
+    void prepare_summary(
+        AIPlugin* ai,
+        const std::vector<ConversationMessage>& history,
+        const ContextUsage& usage,
+        const std::string& session_key = "");
+    
     // Perform the full resume cycle:
+    // 0. Use the session's pre-built summary if it still matches history
     // 1. Ask AI to generate a resume of the conversation
     // 2. Save the resume to persistent memory
     // 3. Wipe the conversation history
@@ -126,14 +170,56 @@ public:
         const std::string& system_prompt) const;
 
 private:
+    // Resume of a session's history[0, covered), kept current in the background
+    struct RollingSummary {
+        std::string text;
+        size_t covered;
+        uint64_t prefix_hash;       // Of history[0, covered): spots rewritten history
+        bool pending;               // A fold is queued or running
+        int64_t last_used_ms;
+        
+        RollingSummary() : covered(0), prefix_hash(0), pending(false), last_used_ms(0) {}
+    };
+    
     ContextManagerConfig config_;
     MemoryTool* memory_tool_;
+    std::shared_ptr<TokenCounter> counter_;
+    ThreadPool* pool_;
+    
+    std::mutex summary_mutex_;
+    std::map<std::string, RollingSummary> summaries_;
+    
+    // Last system prompt counted (it is resent unchanged every iteration)
+    mutable std::mutex prompt_mutex_;
+    mutable std::string counted_prompt_;
+    mutable size_t counted_prompt_tokens_;
+    mutable int counted_prompt_counter_;
     
-    // Estimate character count for a set of messages
-    size_t estimate_chars(const std::vector<ConversationMessage>& messages) const;
+    // Tokens for the system prompt (cached)
+    size_t count_system_prompt(const std::string& system_prompt) const;
     
     // Build the resume generation prompt
     std::string build_resume_prompt() const;
+    
+    // Update previous with messages (the background fold); empty on failure
+    std::string fold_summary(
+        AIPlugin* ai,
+        const std::string& previous,
+        const std::vector<ConversationMessage>& messages) const;
+    
+    // Replace history with the session's summary plus the messages after
+    // it. False if there is none, it no longer matches, or it does not fit.
+    bool swap_in_summary(
+        std::vector<ConversationMessage>& history,
+        const std::string& system_prompt,
+        const std::string& session_key);
+    
+    // Remember a resume of history[0, covered) for the session
+    void store_summary(
+        const std::string& session_key,
+        const std::string& text,
+        size_t covered,
+        uint64_t prefix_hash);
 };
 
 } // namespace opencrank
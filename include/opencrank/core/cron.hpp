@@ -1,43 +1,111 @@
-// Minimal CRON parser for OpenCrank (supports minute, hour, day, month, weekday)
-// Only supports '*' and single values for each field (no ranges, steps, or lists)
-#pragma once
+/*
+ * opencrank C++ - CRON Schedules and Scheduler
+ *
+ * CronSchedule parses a standard five-field expression (minute hour
+ * day-of-month month day-of-week) once into bitmasks: '*', single values,
+ * ranges (1-5), steps ('/15' after '*' or a range), lists (1,15,30), month
+ * and weekday names (jan, mon) and the @hourly/@daily/@weekly/@monthly/
+ * @yearly macros.
+ * As in cron, when both day fields are restricted a day matching either
+ * one fires. next_after() computes the next firing minute in local time.
+ *
+ * CronScheduler keeps every job's next fire time in a min-heap and sleeps
+ * until the earliest one; invalidate() wakes it to reload the job list.
+ */
+#ifndef opencrank_CORE_CRON_HPP
+#define opencrank_CORE_CRON_HPP
+
 #include <string>
-#include <ctime>
 #include <vector>
-#include <sstream>
+#include <map>
+#include <queue>
+#include <ctime>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 namespace opencrank {
 
 struct CronSchedule {
-    int minute = -1;   // 0-59 or -1 for *
-    int hour = -1;     // 0-23 or -1 for *
-    int day = -1;      // 1-31 or -1 for *
-    int month = -1;    // 1-12 or -1 for *
-    int weekday = -1;  // 0-6 (Sun=0) or -1 for *
-
-    static CronSchedule parse(const std::string& expr) {
-        CronSchedule sched;
-        std::istringstream iss(expr);
-        std::string field;
-        std::vector<std::string> fields;
-        while (iss >> field) fields.push_back(field);
-        if (fields.size() != 5) return sched;
-        sched.minute = (fields[0] == "*") ? -1 : std::stoi(fields[0]);
-        sched.hour = (fields[1] == "*") ? -1 : std::stoi(fields[1]);
-        sched.day = (fields[2] == "*") ? -1 : std::stoi(fields[2]);
-        sched.month = (fields[3] == "*") ? -1 : std::stoi(fields[3]);
-        sched.weekday = (fields[4] == "*") ? -1 : std::stoi(fields[4]);
-        return sched;
-    }
-
-    bool matches(const std::tm& tm) const {
-        if (minute != -1 && minute != tm.tm_min) return false;
-        if (hour != -1 && hour != tm.tm_hour) return false;
-        if (day != -1 && day != tm.tm_mday) return false;
-        if (month != -1 && month != (tm.tm_mon + 1)) return false;
-        if (weekday != -1 && weekday != tm.tm_wday) return false;
-        return true;
-    }
+    uint64_t minutes;       // Bit n = minute n (0-59)
+    uint32_t hours;         // Bit n = hour n (0-23)
+    uint32_t days;          // Bit n = day of month n (1-31)
+    uint16_t months;        // Bit n = month n (1-12)
+    uint8_t weekdays;       // Bit n = weekday n (0-6, Sun=0)
+    bool days_any;          // Day-of-month field was '*'
+    bool weekdays_any;      // Day-of-week field was '*'
+    bool valid;
+    std::string error;      // Why parsing failed
+
+    CronSchedule();
+
+    static CronSchedule parse(const std::string& expr);
+
+    bool matches(const std::tm& tm) const;
+
+    // First matching minute strictly after t, or 0 if none within 5 years
+    // (e.g. "0 0 31 2 *")
+    time_t next_after(time_t t) const;
+
+private:
+    bool day_matches(const std::tm& tm) const;
+};
+
+class CronScheduler {
+public:
+    struct Job {
+        std::string id;
+        std::string expr;
+    };
+
+    // Current jobs; called at start and after each invalidate()
+    typedef std::function<std::vector<Job>()> JobSource;
+    // Runs on the scheduler thread: keep it short (hand work off)
+    typedef std::function<void(const std::string& id, time_t when)> FireHandler;
+
+    CronScheduler();
+    ~CronScheduler();
+
+    void start(JobSource source, FireHandler fire);
+    void stop();
+    bool running() const { return thread_.joinable(); }
+
+    // The job list changed: reload it and recompute the next deadline
+    void invalidate();
+
+    // Stats
+    size_t jobs() const;
+    time_t next_fire() const;      // 0 when nothing is scheduled
+
+private:
+    CronScheduler(const CronScheduler&);
+    CronScheduler& operator=(const CronScheduler&);
+
+    struct Entry {
+        std::string expr;
+        CronSchedule schedule;
+        time_t next;
+    };
+    typedef std::pair<time_t, std::string> Deadline;
+    typedef std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> > Heap;
+
+    void run();
+    void reload_locked(const std::vector<Job>& jobs, time_t now);
+
+    JobSource source_;
+    FireHandler fire_;
+    std::thread thread_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    bool dirty_;
+    std::map<std::string, Entry> entries_;
+    Heap heap_;                 // May hold stale deadlines; checked against entries_
 };
 
 } // namespace opencrank
+
+#endif // opencrank_CORE_CRON_HPP
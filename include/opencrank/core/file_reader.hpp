@@ -0,0 +1,75 @@
+/*
+ * opencrank C++ - File Reader
+ *
+ * Range reads for the read tools. Files are mapped read-only instead of
+ * being streamed into a string, so a request for lines 500-600 of a large
+ * log touches only the pages up to line 600, and a byte range touches only
+ * its own pages. Files that cannot be mapped (pipes, /proc entries) are
+ * read with read(2), up to 16 MB.
+ *
+ * Range parameters shared by the tools:
+ *   start_line / end_line  1-based, inclusive (end_line alone reads from line 1)
+ *   offset / length        byte range
+ * Lines win when both are given. Results longer than the caller's limit are
+ * cut at a line boundary where possible and say where to continue.
+ */
+#ifndef opencrank_CORE_FILE_READER_HPP
+#define opencrank_CORE_FILE_READER_HPP
+
+#include "json.hpp"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace opencrank {
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // False (with errno set) if the file cannot be opened or mapped.
+    // Empty files open successfully with size() == 0.
+    bool open(const std::string& path);
+    void close();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    int64_t mtime_ns() const { return mtime_ns_; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    char* data_;
+    size_t size_;
+    int64_t mtime_ns_;
+};
+
+struct FileSlice {
+    std::string text;
+    size_t file_size;
+    size_t begin;           // Byte range of text within the file
+    size_t end;
+    size_t first_line;      // 1-based line of begin
+    size_t last_line;       // Line containing the last byte of text
+    bool ranged;            // A range parameter was given
+    bool more;              // The file continues past end
+
+    FileSlice() : file_size(0), begin(0), end(0), first_line(1), last_line(0), ranged(false), more(false) {}
+};
+
+// Read the part of path selected by the range parameters in params, at most
+// max_bytes of it. On failure returns false with a message in error.
+bool read_file_slice(const std::string& path, const Json& params, size_t max_bytes,
+                     FileSlice& out, std::string& error);
+
+// Tool output for a slice: the text, preceded by a "[lines 10-42, bytes
+// 120-980 of 5000]" header and followed by where to continue when the read
+// was ranged or cut short. A whole small file comes back unchanged.
+std::string format_slice(const FileSlice& slice);
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_FILE_READER_HPP
@@ -0,0 +1,75 @@
+/*
+ * opencrank C++ - File Search
+ *
+ * Recursive grep/find over the workspace for the search_files tool. A few
+ * threads share one queue of directories and files: a directory entry is
+ * listed and its children queued, a file is mapped (MappedFile) and
+ * scanned. Literal patterns are found with memmem / memchr over the whole
+ * mapping, regexes are only run on the lines holding their required
+ * literal (or on every line when they have none).
+ *
+ * Hidden entries, node_modules and files with a NUL byte in their first
+ * 8 KB are skipped. Symlinks are not followed, so the walk never leaves
+ * the directory it was started in.
+ */
+#ifndef opencrank_CORE_FILE_SEARCH_HPP
+#define opencrank_CORE_FILE_SEARCH_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace opencrank {
+
+struct FileSearchOptions {
+    std::string pattern;        // Text to find ("" = list files matching glob)
+    bool regex;                 // pattern is an ECMAScript regex
+    bool ignore_case;
+    std::string glob;           // fnmatch filter on the file name, or on the
+                                // relative path when it contains '/'
+    size_t max_results;         // Lines returned
+    size_t context_lines;       // Lines shown around each hit
+    size_t max_file_size;       // Larger files are skipped
+    size_t max_files;           // Stop after scanning this many files
+    int timeout_ms;             // Stop scanning after this long (0 = none)
+    int threads;                // 0 = hardware concurrency, at most 8
+
+    FileSearchOptions()
+        : regex(false), ignore_case(false), max_results(50), context_lines(0)
+        , max_file_size(4 * 1024 * 1024), max_files(20000), timeout_ms(15000), threads(0) {}
+};
+
+struct FileSearchHit {
+    std::string path;                   // Relative to the search root
+    size_t line;                        // 1-based (0 in file-list mode)
+    std::string text;                   // The line, shortened around the match
+    std::vector<std::string> before;    // Context lines
+    std::vector<std::string> after;
+};
+
+struct FileSearchResult {
+    std::vector<FileSearchHit> hits;    // Ranked, at most max_results
+    size_t total_matches;               // Matching lines found (before the cut)
+    size_t files_matched;
+    size_t files_scanned;
+    size_t skipped_binary;
+    size_t skipped_large;
+    bool incomplete;                    // File limit or timeout reached
+    std::string error;
+
+    FileSearchResult()
+        : total_matches(0), files_matched(0), files_scanned(0)
+        , skipped_binary(0), skipped_large(0), incomplete(false) {}
+};
+
+// Search the tree under root. False (with result.error) on a bad pattern
+// or an unreadable root.
+bool search_files(const std::string& root, const FileSearchOptions& options, FileSearchResult& result);
+
+// Tool output: hits grouped by file, best files first, as "path" headers
+// followed by "  line: text" rows, plus a summary line
+std::string format_search(const FileSearchResult& result, const FileSearchOptions& options);
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_FILE_SEARCH_HPP
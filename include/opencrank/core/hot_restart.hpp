@@ -0,0 +1,88 @@
+/*
+ * opencrank C++ - Hot Restart
+ *
+ * Upgrades the running process in place: SIGUSR2 makes the old process
+ * hand its work to a fresh image of the binary at the same path (the new
+ * build) started with execv(), under the same pid.
+ *
+ * The old process holds new messages and waits for the turns already
+ * running (at most restart.drain_ms), stops its channels, then writes a
+ * state file with the messages that never started and each plugin's
+ * Plugin::save_state() (the Telegram update offset, ...). Listening
+ * sockets registered with offer_listener() stay open across execv(), so
+ * connections and webhook deliveries queue in the kernel instead of
+ * being refused while the new process starts. The new process adopts the
+ * sockets, restores the plugin state before its channels start, and runs
+ * the handed-over messages first.
+ *
+ * Sessions need no handoff: they are in the session store (session.persist)
+ * and load on first use. Open gateway WebSocket connections do not
+ * survive execv(); clients reconnect to the inherited listener.
+ *
+ * Config (section "restart"):
+ *   restart.drain_ms   - Longest wait for running turns (default: 30000);
+ *                        turns still running then fail as on shutdown
+ *   restart.state_file - State file (default: restart_state.json next to
+ *                        the databases)
+ */
+#ifndef opencrank_CORE_HOT_RESTART_HPP
+#define opencrank_CORE_HOT_RESTART_HPP
+
+#include "json.hpp"
+#include "session_executor.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace opencrank {
+
+class HotRestart {
+public:
+    static HotRestart& instance();
+
+    // Record the executable and pick up what a previous process handed
+    // over (call once, early in startup)
+    void init();
+
+    // This process was started by a hot restart
+    bool resumed() const;
+
+    // An inherited listening socket registered as name, or -1 (bind one)
+    int adopt_listener(const std::string& name);
+
+    // Keep a listening socket open for the next process (dup'ed; the
+    // caller still closes its own fd)
+    void offer_listener(const std::string& name, int fd);
+
+    // State the previous process saved for a plugin (null when none)
+    Json plugin_state(const std::string& plugin) const;
+
+    // Messages the previous process did not start (once)
+    std::vector<SessionExecutor::Queued> take_messages();
+
+    // Old process: collect the handoff, write it to path, then replace
+    // this process with the executable. exec() returns only on failure.
+    void set_plugin_state(const std::string& plugin, const Json& state);
+    void add_messages(const std::vector<SessionExecutor::Queued>& messages);
+    bool save(const std::string& path);
+    bool exec(char* argv[]);
+
+private:
+    HotRestart();
+    HotRestart(const HotRestart&);
+    HotRestart& operator=(const HotRestart&);
+
+    mutable std::mutex mutex_;
+    std::string executable_;
+    std::string state_path_;                    // Written by save()
+    bool resumed_;
+    std::map<std::string, int> inherited_;      // Listener name -> fd
+    std::map<std::string, int> offered_;
+    Json plugin_states_;
+    std::vector<SessionExecutor::Queued> messages_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_HOT_RESTART_HPP
@@ -0,0 +1,148 @@
+/*
+ * opencrank C++ - Streaming HTML Tokenizer
+ *
+ * One forward pass over an HTML document that produces, as requested, its
+ * visible text (tags, scripts, styles and comments removed, common entities
+ * decoded, whitespace collapsed), its links and its forms. Input can arrive
+ * in arbitrary pieces - feed() it straight from a curl write callback - and
+ * no piece is ever copied or lowercased as a whole: text runs are located
+ * with a vectorised search for '<' / '&', and only tag bodies are buffered.
+ *
+ * With only TEXT requested and a text limit set, done() turns true once the
+ * limit is exceeded so the caller can stop the download there.
+ *
+ * Attribute values are returned as written (entities decoded); resolving
+ * hrefs and form actions against a base URL is left to the caller.
+ */
+#ifndef opencrank_CORE_HTML_TOKENIZER_HPP
+#define opencrank_CORE_HTML_TOKENIZER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace opencrank {
+
+struct HtmlLink {
+    std::string href;
+    std::string text;       // Visible text of the anchor, whitespace collapsed
+};
+
+struct HtmlFormField {
+    std::string name;
+    std::string type;       // text, hidden, password, submit, checkbox, radio, textarea, select, ...
+    std::string value;      // default/preset value
+    bool required;
+    HtmlFormField() : required(false) {}
+};
+
+struct HtmlForm {
+    std::string action;     // As written in the tag (may be relative or empty)
+    std::string method;     // Uppercased, GET when absent
+    std::string id;
+    std::string name;
+    std::vector<HtmlFormField> fields;
+};
+
+class HtmlTokenizer {
+public:
+    enum Output {
+        TEXT  = 1,
+        LINKS = 2,
+        FORMS = 4
+    };
+
+    // outputs is a mask of Output; text_limit == 0 means unlimited
+    explicit HtmlTokenizer(int outputs, size_t text_limit = 0);
+
+    // Consume the next piece of the document. Returns !done().
+    bool feed(const char* data, size_t len);
+    bool feed(const std::string& data) { return feed(data.data(), data.size()); }
+
+    // End of input: closes open links and forms
+    void finish();
+
+    // Nothing requested remains to be produced (text limit reached)
+    bool done() const { return done_; }
+
+    // Text was cut at text_limit (the document had more)
+    bool truncated() const { return truncated_; }
+    size_t bytes_fed() const { return bytes_fed_; }
+
+    const std::string& text() const { return text_; }
+    std::string& text() { return text_; }
+    std::vector<HtmlLink>& links() { return links_; }
+    std::vector<HtmlForm>& forms() { return forms_; }
+
+    typedef std::vector<std::pair<std::string, std::string> > Attributes;
+
+    // The decoding the tokenizer applies, for other readers of HTML:
+    // character references (named and numeric) in s, and the attributes
+    // of a tag body (no '<' / '>') from pos on, as lowercase names with
+    // decoded values
+    static std::string decode_entities(const std::string& s);
+    static void parse_attributes(const std::string& tag, size_t pos, Attributes& attrs);
+
+    // Append code point cp to out as UTF-8
+    static void append_utf8(std::string& out, uint32_t cp);
+
+private:
+    HtmlTokenizer(const HtmlTokenizer&);
+    HtmlTokenizer& operator=(const HtmlTokenizer&);
+
+    enum State {
+        DATA,           // Text content
+        TAG_OPEN,       // Just after '<'
+        TAG,            // Inside a tag, buffering it
+        COMMENT,        // Inside <!-- -->
+        ENTITY,         // After '&' in text
+        RAW,            // <script>/<style> content, looking for '<'
+        RAW_END         // Matching the raw element's end tag
+    };
+
+    void emit(const char* s, size_t n);
+    void emit_separator();
+    void finish_entity(bool terminated);
+    void handle_tag();
+    void open_link(const Attributes& attrs);
+    void close_link();
+    void close_form();
+    void close_textarea();
+    void close_select();
+
+    int outputs_;
+    size_t text_limit_;
+    bool done_;
+    bool truncated_;
+    size_t bytes_fed_;
+
+    State state_;
+    std::string tag_;           // Current tag, without the '<' and '>'
+    char quote_;                // Open quote inside tag_, or 0
+    int comment_dashes_;        // Trailing '-' seen inside a comment
+    std::string entity_;
+    const char* raw_end_;       // "/script" or "/style" while in RAW
+    size_t raw_matched_;
+    bool space_pending_;        // Collapsed whitespace waiting for the next text
+
+    std::string text_;
+    std::vector<HtmlLink> links_;
+    std::vector<HtmlForm> forms_;
+
+    bool in_link_;
+    HtmlLink link_;
+    bool in_form_;
+    HtmlForm form_;
+    bool in_textarea_;
+    HtmlFormField textarea_;
+    bool in_select_;
+    bool select_has_selected_;
+    bool select_has_option_;
+    HtmlFormField select_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_HTML_TOKENIZER_HPP
@@ -0,0 +1,143 @@
+/*
+ * opencrank C++ - HTTP Response Cache
+ *
+ * Process-wide cache of GET responses in front of HttpClientPool, so tools
+ * that look at the same page several times (fetch, then extract text, then
+ * list links) download it once.
+ *
+ * Freshness follows the response: Cache-Control max-age/no-cache/no-store,
+ * Expires, or 10% of the Last-Modified age; responses with none of these
+ * stay fresh for the configured default TTL. Stale entries with an ETag or
+ * Last-Modified are revalidated with If-None-Match / If-Modified-Since, and
+ * a 304 refreshes them in place. Entries are keyed by URL (and proxy) plus
+ * the request headers named in Vary, and evicted LRU past the byte budget.
+ *
+ * Entries are immutable and shared: callers hold an HttpCacheEntryPtr while
+ * they read the body. Derived text (e.g. HTML stripped to plain text) is
+ * computed once per entry and cached next to the body.
+ */
+#ifndef opencrank_CORE_HTTP_CACHE_HPP
+#define opencrank_CORE_HTTP_CACHE_HPP
+
+#include "http_client.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+struct HttpCacheEntry {
+    std::string key;                // Method, URL and proxy
+    long status_code;
+    std::map<std::string, std::string> headers;
+    std::shared_ptr<const std::string> body;
+    std::string error;              // Transport error (uncached responses only)
+    bool truncated;                 // Body cut off at max_body (never cached)
+
+    // Request header values this response varies on (lowercase names)
+    std::vector<std::pair<std::string, std::string> > vary;
+    std::string etag;
+    std::string last_modified;
+    int64_t stored_ms;
+    int64_t expires_ms;
+
+    // Filled by HttpCache::derived_text()
+    mutable std::mutex text_mutex;
+    mutable std::shared_ptr<const std::string> text;
+
+    HttpCacheEntry() : status_code(0), truncated(false), stored_ms(0), expires_ms(0) {}
+
+    bool ok() const { return status_code >= 200 && status_code < 300; }
+
+    // Case-insensitive response header lookup ("" if absent)
+    std::string header(const std::string& name) const;
+};
+
+typedef std::shared_ptr<const HttpCacheEntry> HttpCacheEntryPtr;
+
+class HttpCache {
+public:
+    enum Outcome {
+        MISS,           // Fetched and stored
+        HIT,            // Served fresh from the cache
+        REVALIDATED,    // Stale, server answered 304
+        BYPASS          // Not cacheable; fetched without storing
+    };
+
+    static HttpCache& instance();
+
+    // max_bytes == 0 disables caching; default_ttl_ms applies to responses
+    // without freshness information
+    void configure(size_t max_bytes, int64_t default_ttl_ms);
+
+    // GET url through the cache. Never returns null: uncacheable or failed
+    // requests come back as a standalone entry.
+    //
+    // on_data, if given, sees a downloaded body as it arrives (MISS and
+    // BYPASS only: HIT and REVALIDATED serve the stored body without calling
+    // it). When it stops the transfer the partial response is returned as a
+    // BYPASS and nothing is stored. So is a download abandoned because
+    // *cancel turned true (see HttpClient::set_cancel), and one whose body
+    // outgrew max_body bytes (0 = unlimited; see HttpClient::set_max_body).
+    HttpCacheEntryPtr get(const std::string& url,
+                          const std::map<std::string, std::string>& headers,
+                          const std::string& proxy, long timeout_ms,
+                          Outcome* outcome = nullptr,
+                          const HttpDataCallback* on_data = nullptr,
+                          const std::atomic<bool>* cancel = nullptr,
+                          size_t max_body = 0);
+
+    // Drop every variant cached for url (after an unsafe request to it)
+    void invalidate(const std::string& url);
+
+    // derive(body), computed on first use and kept with the entry
+    typedef std::string (*TextDeriver)(const std::string& body);
+    std::shared_ptr<const std::string> derived_text(const HttpCacheEntryPtr& entry, TextDeriver derive);
+
+    void clear();
+
+    // Stats
+    size_t entries() const;
+    size_t bytes() const;
+    uint64_t hits() const { return hits_.load(); }
+    uint64_t misses() const { return misses_.load(); }
+    uint64_t revalidations() const { return revalidations_.load(); }
+
+    static const char* outcome_name(Outcome outcome);
+
+private:
+    HttpCache();
+    HttpCache(const HttpCache&);
+    HttpCache& operator=(const HttpCache&);
+
+    struct Slot {
+        HttpCacheEntryPtr entry;
+        size_t bytes;           // As accounted in bytes_
+    };
+    typedef std::list<Slot> Lru;
+
+    HttpCacheEntryPtr lookup(const std::string& key, const std::map<std::string, std::string>& headers);
+    void store(const HttpCacheEntryPtr& entry);
+    void remove_locked(Lru::iterator it);
+    static size_t entry_bytes(const HttpCacheEntry& entry);
+
+    mutable std::mutex mutex_;
+    Lru lru_;                                        // Front = most recent
+    std::multimap<std::string, Lru::iterator> index_;   // key -> variants
+    size_t bytes_;
+    size_t max_bytes_;
+    int64_t default_ttl_ms_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> revalidations_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_HTTP_CACHE_HPP
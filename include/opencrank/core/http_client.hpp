@@ -5,18 +5,29 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 #include <curl/curl.h>
 
 namespace opencrank {
 
+// Receives response body bytes as they arrive (2xx responses only).
+// Return false to stop the transfer early.
+typedef std::function<bool(const char* data, size_t len)> HttpDataCallback;
+
 // HTTP response structure
 struct HttpResponse {
     long status_code;
     std::string body;
     std::map<std::string, std::string> headers;
     std::string error;
+    bool truncated;         // Body cut off at the client's max_body limit
+    bool sent;              // The request reached the server (false: DNS,
+                            // connect or TLS failure; it was never seen)
     
-    HttpResponse() : status_code(0) {}
+    HttpResponse() : status_code(0), truncated(false), sent(false) {}
     
     bool ok() const { return status_code >= 200 && status_code < 300; }
     
@@ -41,11 +52,47 @@ public:
     void set_proxy(const std::string& proxy_url);
     void clear_proxy();
     
+    // Share DNS cache, TLS sessions and connections with other handles
+    void set_share(CURLSH* share) { share_ = share; }
+    
+    // Negotiate HTTP/2 over TLS when the server supports it
+    void set_http2(bool enabled) { http2_ = enabled; }
+    
+    // Abandon requests once *flag turns true (checked while waiting and
+    // while data arrives). NULL = never; cleared when a lease ends.
+    void set_cancel(const std::atomic<bool>* flag) { cancel_ = flag; }
+    
+    // Stop downloading once a body reaches max bytes (after decoding); the
+    // response keeps the first max bytes and has truncated set, and
+    // on_data / sinks see no more than that. 0 = unlimited; reset when a
+    // lease ends.
+    void set_max_body(size_t max) { max_body_ = max; }
+    size_t max_body() const { return max_body_; }
+    
+    // Advertise every encoding libcurl can decode (gzip, deflate, br, zstd)
+    // and hand callers the decoded body (default: on)
+    void set_decompress(bool enabled) { decompress_ = enabled; }
+    
     // GET request
     HttpResponse get(const std::string& url, 
                      const std::map<std::string, std::string>& headers = std::map<std::string, std::string>(),
                      const std::string& proxy = "");
     
+    // GET request, streaming the body through on_data as it arrives.
+    // The body received so far is still collected in HttpResponse::body.
+    HttpResponse get_stream(const std::string& url,
+                            const std::map<std::string, std::string>& headers,
+                            const std::string& proxy,
+                            const HttpDataCallback& on_data);
+    
+    // GET request handing a 2xx body only to sink, without collecting it:
+    // HttpResponse::body stays empty (error bodies are still collected).
+    // For long-lived streams and consumers that keep their own copy.
+    HttpResponse get_sink(const std::string& url,
+                          const std::map<std::string, std::string>& headers,
+                          const std::string& proxy,
+                          const HttpDataCallback& sink);
+    
     // POST request with JSON body
     HttpResponse post_json(const std::string& url, 
                            const Json& body,
@@ -56,6 +103,13 @@ public:
                            const std::string& body,
                            const std::map<std::string, std::string>& extra_headers = std::map<std::string, std::string>());
     
+    // POST request with string body, streaming the response through on_data.
+    // The full body is still collected in HttpResponse::body.
+    HttpResponse post_json_stream(const std::string& url,
+                                  const std::string& body,
+                                  const std::map<std::string, std::string>& extra_headers,
+                                  const HttpDataCallback& on_data);
+    
     // POST request with form data
     HttpResponse post_form(const std::string& url,
                            const std::map<std::string, std::string>& form_data,
@@ -70,20 +124,149 @@ public:
 
 private:
     CURL* curl_;
+    CURLSH* share_;
+    bool http2_;
     long timeout_ms_;
     std::string proxy_url_;
+    const std::atomic<bool>* cancel_;
+    size_t max_body_;
+    bool decompress_;
     
     HttpResponse perform_request(const std::string& method,
                                  const std::string& url,
                                  const std::string& body,
                                  const std::map<std::string, std::string>& headers,
-                                 const std::string& proxy = "");
+                                 const std::string& proxy = "",
+                                 const HttpDataCallback* on_data = nullptr,
+                                 bool collect = true);
+    
+    // State handed to write_callback
+    struct WriteContext {
+        std::string* body;
+        const HttpDataCallback* on_data;
+        CURL* curl;
+        bool collect;           // Keep 2xx bodies (error bodies are always kept)
+        size_t max_body;        // 0 = unlimited
+        size_t received;        // Decoded body bytes seen so far
+        bool aborted;           // Consumer stopped the transfer
+        bool truncated;         // max_body reached
+    };
     
     static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
     static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata);
+    static int progress_callback(void* userdata, curl_off_t dltotal, curl_off_t dlnow,
+                                 curl_off_t ultotal, curl_off_t ulnow);
     static std::string url_encode(CURL* curl, const std::string& s);
 };
 
+// Process-wide pool of HttpClients sharing one curl share handle.
+// Borrowing a client instead of constructing one per request keeps the
+// easy handle's connection cache warm, and the share handle lets all
+// clients reuse DNS results, TLS sessions and open connections.
+class HttpClientPool {
+public:
+    // RAII borrow; returns the client to the pool when destroyed
+    class Lease {
+    public:
+        Lease(HttpClientPool* pool, HttpClient* client) : pool_(pool), client_(client), limited_(false) {}
+        Lease(HttpClientPool* pool, HttpClient* client, const std::string& host)
+            : pool_(pool), client_(client), host_(host), limited_(true) {}
+        Lease(Lease&& other) : pool_(other.pool_), client_(other.client_),
+                               host_(std::move(other.host_)), limited_(other.limited_) {
+            other.client_ = nullptr;
+            other.limited_ = false;
+        }
+        ~Lease() {
+            if (client_) pool_->release(client_);
+            if (limited_) pool_->release_slot(host_);
+        }
+        
+        HttpClient* operator->() const { return client_; }
+        HttpClient& operator*() const { return *client_; }
+        
+    private:
+        Lease(const Lease&);
+        Lease& operator=(const Lease&);
+        
+        HttpClientPool* pool_;
+        HttpClient* client_;
+        std::string host_;      // Request slot held for this host
+        bool limited_;
+    };
+    
+    static HttpClientPool& instance();
+    
+    // Borrow a client (timeout reset to 60s, no proxy)
+    Lease acquire();
+    
+    // Borrow a client for a request to url, first waiting while the requests
+    // made this way have reached the in-flight limit overall or for url's
+    // host. The slot is held until the lease is destroyed.
+    Lease acquire(const std::string& url);
+    
+    // Limits for acquire(url); 0 means unlimited (the default)
+    void set_request_limits(size_t max_in_flight, size_t max_per_host);
+    
+    // Max idle clients kept around for reuse (default: 8)
+    void set_max_idle(size_t max_idle);
+    
+    // Enable HTTP/2 negotiation for pooled clients (default: on)
+    void set_http2(bool enabled) { http2_ = enabled; }
+    bool http2() const { return http2_; }
+    
+    // Accept compressed responses on pooled clients (default: on)
+    void set_decompress(bool enabled) { decompress_ = enabled; }
+    bool decompress() const { return decompress_; }
+    
+    // The share handle, for transfers made outside the pool (NULL once shut down)
+    CURLSH* share() const;
+    
+    // Free idle clients and the share handle (call before curl_global_cleanup)
+    void shutdown();
+    
+    // Stats
+    size_t idle() const;
+    size_t created() const { return created_.load(); }
+    size_t reused() const { return reused_.load(); }
+    size_t in_flight() const;
+    size_t waiting() const;
+    
+private:
+    HttpClientPool();
+    ~HttpClientPool();
+    HttpClientPool(const HttpClientPool&);
+    HttpClientPool& operator=(const HttpClientPool&);
+    
+    void release(HttpClient* client);
+    HttpClient* borrow();             // Configured client, not yet leased
+    void release_slot(const std::string& host);
+    
+    static void share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void share_unlock(CURL* handle, curl_lock_data data, void* userptr);
+    
+    CURLSH* share_;
+    std::mutex share_locks_[CURL_LOCK_DATA_LAST];
+    
+    mutable std::mutex mutex_;
+    std::vector<HttpClient*> idle_;
+    size_t max_idle_;
+    bool http2_;
+    bool decompress_;
+    bool stopped_;
+    
+    std::atomic<size_t> created_;
+    std::atomic<size_t> reused_;
+    
+    // Request slots for acquire(url)
+    mutable std::mutex slots_mutex_;
+    std::condition_variable slots_cv_;
+    std::map<std::string, size_t> host_in_flight_;
+    size_t in_flight_;
+    size_t waiting_;
+    size_t max_in_flight_;
+    size_t max_per_host_;
+};
+
 } // namespace opencrank
 
 #endif // opencrank_CORE_HTTP_CLIENT_HPP
@@ -0,0 +1,103 @@
+/*
+ * opencrank C++ - Minimal HTTP/1.1 Listener
+ *
+ * The server side of the endpoints that take requests from outside: the
+ * Telegram and WhatsApp webhooks and the cluster's internal endpoint.
+ * Driven by the main Reactor (no extra thread) and plain HTTP; public
+ * URLs go through a TLS-terminating reverse proxy.
+ *
+ * One request per connection: once the headers and the Content-Length
+ * body are in, the handler runs on the reactor thread, its reply is sent
+ * and the connection closed. Requests over 1 MB get 413, malformed
+ * request lines 400, and connections idle for 10 s are dropped.
+ *
+ * A listener opened under a name stays bound across a hot restart (see
+ * hot_restart.hpp): requests arriving meanwhile wait in the kernel
+ * backlog for the new process.
+ */
+#ifndef opencrank_CORE_HTTP_LISTENER_HPP
+#define opencrank_CORE_HTTP_LISTENER_HPP
+
+#include <string>
+#include <map>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace opencrank {
+
+class Reactor;
+
+struct HttpRequest {
+    std::string method;
+    std::string path;                           // Without the query
+    std::string query;                          // After '?', still encoded
+    std::map<std::string, std::string> headers; // Names lowercased
+    const char* body;                           // In the connection's buffer,
+    size_t body_size;                           // valid while the handler runs
+
+    HttpRequest() : body(NULL), body_size(0) {}
+
+    // Header value by lowercase name ("" when missing)
+    std::string header(const std::string& name) const;
+
+    // Decoded value of key in the query string ("" when missing)
+    std::string query_param(const std::string& key) const;
+};
+
+struct HttpReply {
+    int status;
+    std::string content_type;                   // Sent with a non-empty body
+    std::string body;
+
+    HttpReply() : status(200), content_type("text/plain") {}
+};
+
+class HttpListener {
+public:
+    typedef std::function<void(const HttpRequest& request, HttpReply& reply)> Handler;
+
+    HttpListener();
+    ~HttpListener();
+
+    // Bind the listening socket (call before attach). tag prefixes log
+    // lines; a non-empty restart_name adopts the socket a hot restart
+    // handed over and offers it to the next one.
+    bool open(const std::string& tag, const std::string& restart_name,
+              const std::string& bind_address, int port);
+
+    // Register the listener and idle sweep with the reactor
+    bool attach(Reactor& reactor, const Handler& handler);
+
+    void close();
+    bool is_open() const { return listen_fd_ >= 0; }
+
+private:
+    HttpListener(const HttpListener&);
+    HttpListener& operator=(const HttpListener&);
+
+    struct Connection {
+        std::string buffer;
+        int64_t last_active_ms;
+    };
+
+    void on_accept();
+    void on_readable(int fd);
+    void close_connection(int fd);
+    void sweep_idle();
+
+    // Parse a complete request in buffer and answer it into reply;
+    // false = need more bytes
+    bool handle_request(const std::string& buffer, HttpReply& reply);
+
+    std::string tag_;
+    int listen_fd_;
+    Reactor* reactor_;
+    uint64_t sweep_timer_;
+    Handler handler_;
+    std::map<int, Connection> connections_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_HTTP_LISTENER_HPP
@@ -0,0 +1,175 @@
+/*
+ * opencrank C++ - Streaming JSON
+ *
+ * JsonWriter appends JSON text straight into a caller-owned buffer, so a
+ * provider request never exists as a DOM: message content is escaped from
+ * the history bytes into the body that curl sends. Strings pass through the
+ * same cleanup as sanitize_utf8() (invalid UTF-8 -> U+FFFD, control
+ * characters other than tab/newline -> space) while they are escaped.
+ *
+ * parse_json_fields() is the matching reader: a SAX pass that materialises
+ * only the requested top-level members and skips everything else (echoed
+ * prompts, timings, logprobs) without allocating it.
+ *
+ * JsonView goes one step further for payloads read a few fields at a time
+ * (stream deltas, getUpdates batches, bridge polls): nothing is built at
+ * all. A view is a position in the text; members and elements are found by
+ * skipping over what lies in between, and only the values read are
+ * converted. Skipping is not validation: malformed or truncated parts read
+ * as missing, and the getters fall back to their defaults.
+ */
+#ifndef opencrank_CORE_JSON_STREAM_HPP
+#define opencrank_CORE_JSON_STREAM_HPP
+
+#include "json.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace opencrank {
+
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out), after_key_(false) {}
+
+    // Per-thread scratch buffer for request bodies, cleared on each call.
+    // Capacity is kept between requests (dropped once it exceeds 16 MB).
+    static std::string& thread_buffer();
+
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+
+    // Keys are escaped like values
+    JsonWriter& key(const char* name);
+    JsonWriter& key(const std::string& name);
+
+    JsonWriter& value(const std::string& s);
+    JsonWriter& value(const char* s);
+    JsonWriter& value(int64_t n);
+    JsonWriter& value(int n) { return value(static_cast<int64_t>(n)); }
+    JsonWriter& value(double d);
+    JsonWriter& value(bool b);
+    JsonWriter& null_value();
+
+    // Embed an existing DOM value (small fragments such as tool schemas)
+    JsonWriter& json(const Json& j);
+
+    // Shorthand for key(name).value(v)
+    template <typename T>
+    JsonWriter& field(const char* name, const T& v) { key(name); return value(v); }
+
+private:
+    JsonWriter(const JsonWriter&);
+    JsonWriter& operator=(const JsonWriter&);
+
+    void separator();
+    void write_string(const char* data, size_t len);
+
+    std::string& out_;
+    std::vector<bool> first_;   // One entry per open container
+    bool after_key_;
+};
+
+// Parse text, keeping only the named top-level members of the root object.
+// Returns an object holding the members that were present, or a discarded
+// value (is_discarded()) when text is not valid JSON or not an object.
+Json parse_json_fields(const std::string& text, const std::vector<std::string>& keys);
+
+// On-demand view of one JSON value inside a caller-owned buffer, which must
+// outlive the view. Lookups rescan from the value's start, so read each
+// field once rather than in a loop over a large object.
+class JsonView {
+public:
+    enum Type { MISSING, OBJECT, ARRAY, STRING, NUMBER, BOOLEAN, NULL_VALUE };
+
+    JsonView() : p_(nullptr), end_(nullptr) {}
+    JsonView(const char* data, size_t len);
+    explicit JsonView(const std::string& text);
+
+    Type type() const;
+    bool exists() const { return type() != MISSING; }
+    bool is_object() const { return type() == OBJECT; }
+    bool is_array() const { return type() == ARRAY; }
+    bool is_string() const { return type() == STRING; }
+    bool is_number() const { return type() == NUMBER; }
+    bool is_bool() const { return type() == BOOLEAN; }
+    bool is_null() const { return type() == NULL_VALUE; }
+
+    // Member of an object / element of an array (MISSING when absent)
+    JsonView operator[](const char* key) const;
+    JsonView operator[](const std::string& key) const { return find(key.data(), key.size()); }
+    JsonView at(size_t index) const;
+
+    // Scalars; def when the value is missing or of another type
+    std::string get_string(const std::string& def = "") const;
+    int64_t get_int(int64_t def = 0) const;
+    double get_double(double def = 0.0) const;
+    bool get_bool(bool def = false) const;
+
+    // The value's text, and the value parsed into a DOM (for the parts that
+    // are kept whole, e.g. an error object or usage counters)
+    std::string raw() const;
+    Json parse() const;
+
+    // Forward iteration over array elements or object members:
+    //   for (JsonView::Iterator it = v.begin(); it != v.end(); ++it) use(*it, it.key());
+    class Iterator {
+    public:
+        JsonView operator*() const { return JsonView(p_, end_, true); }
+        std::string key() const;        // Objects only
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const { return p_ == other.p_; }
+        bool operator!=(const Iterator& other) const { return p_ != other.p_; }
+
+    private:
+        friend class JsonView;
+        Iterator() : p_(nullptr), end_(nullptr), object_(false), key_(nullptr) {}
+        Iterator(const char* p, const char* end, bool object);
+        void enter(const char* p);      // Land on the entry at p, or end
+
+        const char* p_;                 // Current value; nullptr at the end
+        const char* end_;
+        bool object_;
+        const char* key_;               // Current member's key string
+    };
+
+    Iterator begin() const;
+    Iterator end() const { return Iterator(); }
+
+private:
+    JsonView(const char* p, const char* end, bool) : p_(p), end_(end) {}
+    JsonView find(const char* key, size_t len) const;
+    const char* value_end() const;
+
+    const char* p_;                     // First byte of the value
+    const char* end_;                   // End of the buffer
+};
+
+// json_utils getters over a view, so call sites read like their DOM versions
+namespace json_utils {
+
+inline bool has(const JsonView& j, const char* key) { return j[key].exists(); }
+
+inline std::string get_string(const JsonView& j, const char* key, const std::string& def = "") {
+    return j[key].get_string(def);
+}
+
+inline int64_t get_int(const JsonView& j, const char* key, int64_t def = 0) {
+    return j[key].get_int(def);
+}
+
+inline double get_double(const JsonView& j, const char* key, double def = 0.0) {
+    return j[key].get_double(def);
+}
+
+inline bool get_bool(const JsonView& j, const char* key, bool def = false) {
+    return j[key].get_bool(def);
+}
+
+} // namespace json_utils
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_JSON_STREAM_HPP
@@ -3,6 +3,9 @@
  * 
  * Loads plugins from shared libraries (.so files) at runtime.
  * Plugins must export a create_plugin() function.
+ *
+ * Plugins compiled into the binary (make static) register themselves
+ * instead, and load() takes them from that table before searching for a .so.
  */
 #ifndef opencrank_PLUGIN_LOADER_HPP
 #define opencrank_PLUGIN_LOADER_HPP
@@ -12,9 +15,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <cstdint>
 
 namespace opencrank {
 
+class StartupProfile;
+
 // Plugin metadata returned by shared library
 struct PluginInfo {
     const char* name;
@@ -28,17 +34,28 @@ typedef PluginInfo (*GetPluginInfoFunc)();
 typedef Plugin* (*CreatePluginFunc)();
 typedef void (*DestroyPluginFunc)(Plugin*);
 
+// Add a plugin compiled into the binary; called from static initializers
+// generated by OPENCRANK_DECLARE_PLUGIN when OPENCRANK_STATIC_PLUGIN is set
+bool register_static_plugin(GetPluginInfoFunc get_info, CreatePluginFunc create,
+                            DestroyPluginFunc destroy);
+
+// Names of the plugins compiled into the binary
+std::vector<std::string> static_plugin_names();
+
 // Loaded plugin handle
 struct LoadedPlugin {
-    void* handle;                   // dlopen handle
+    void* handle;                   // dlopen handle (NULL for static plugins)
     std::string path;               // Path to .so file
     PluginInfo info;                // Plugin metadata
     Plugin* instance;               // Plugin instance
     CreatePluginFunc create_func;
     DestroyPluginFunc destroy_func;
+    int64_t file_mtime_ns;          // .so as loaded, to notice a rebuild
+    int64_t file_size;
     
     LoadedPlugin() : handle(nullptr), instance(nullptr), 
-                     create_func(nullptr), destroy_func(nullptr) {}
+                     create_func(nullptr), destroy_func(nullptr),
+                     file_mtime_ns(0), file_size(0) {}
 };
 
 // Dynamic plugin loader
@@ -56,7 +73,9 @@ public:
     // Load plugins specified in config
     int load_from_config(const Config& config);
     
-    // Unload a specific plugin
+    // Unload a specific plugin (shutdown, destroy, dlclose). Whoever can
+    // still call into it must be gone: unregister it from PluginRegistry
+    // and wait for quiescent() first.
     void unload(const std::string& name);
     
     // Unload all plugins
@@ -71,6 +90,15 @@ public:
     // Check if a plugin is loaded
     bool is_loaded(const std::string& name) const;
     
+    // Loaded plugin by name (NULL if not loaded)
+    const LoadedPlugin* loaded(const std::string& name) const;
+    
+    // True if the .so of a loaded plugin was replaced since it was loaded
+    bool changed_on_disk(const std::string& name) const;
+    
+    // Names or paths listed (and enabled) in the "plugins" config section
+    static std::vector<std::string> configured(const Config& config);
+    
     // Get last error message
     std::string last_error() const;
     
@@ -79,14 +107,26 @@ public:
     
     // Add plugin search path
     void add_search_path(const std::string& path);
+    
+    // Bind function symbols on first call (RTLD_LAZY) instead of all at
+    // dlopen. Data relocations and missing libraries still fail the load;
+    // a missing function would abort on its first call instead.
+    // LD_BIND_NOW in the environment overrides this.
+    void set_lazy_binding(bool lazy) { lazy_binding_ = lazy; }
+    
+    // Record per-plugin load times (NULL = off)
+    void set_profile(StartupProfile* profile) { profile_ = profile; }
 
 private:
     std::vector<LoadedPlugin> plugins_;
     std::map<std::string, size_t> name_index_;
     std::vector<std::string> search_paths_;
     std::string last_error_;
+    bool lazy_binding_;
+    StartupProfile* profile_;
     
     bool load_impl(const std::string& path, LoadedPlugin& plugin);
+    bool find_static(const std::string& name, LoadedPlugin& plugin);
     std::string find_plugin(const std::string& name);
     void set_error(const std::string& error);
 };
@@ -96,6 +136,31 @@ private:
 // Macros for plugin authors to export required functions
 #define OPENCRANK_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
 
+#ifdef OPENCRANK_STATIC_PLUGIN
+// Linked into the main binary: internal-linkage entry points (several plugins
+// share one link) registered with the loader during static initialization
+#define OPENCRANK_DECLARE_PLUGIN(PluginClass, plugin_name, plugin_version, plugin_desc, plugin_type) \
+    namespace { \
+    opencrank::PluginInfo opencrank_static_plugin_info() { \
+        opencrank::PluginInfo info; \
+        info.name = plugin_name; \
+        info.version = plugin_version; \
+        info.description = plugin_desc; \
+        info.type = plugin_type; \
+        return info; \
+    } \
+    opencrank::Plugin* opencrank_static_create_plugin() { \
+        return new PluginClass(); \
+    } \
+    void opencrank_static_destroy_plugin(opencrank::Plugin* plugin) { \
+        delete plugin; \
+    } \
+    __attribute__((used)) const bool opencrank_static_plugin_registered = \
+        opencrank::register_static_plugin(opencrank_static_plugin_info, \
+                                          opencrank_static_create_plugin, \
+                                          opencrank_static_destroy_plugin); \
+    }
+#else
 #define OPENCRANK_DECLARE_PLUGIN(PluginClass, plugin_name, plugin_version, plugin_desc, plugin_type) \
     OPENCRANK_PLUGIN_EXPORT opencrank::PluginInfo opencrank_get_plugin_info() { \
         opencrank::PluginInfo info; \
@@ -111,5 +176,6 @@ private:
     OPENCRANK_PLUGIN_EXPORT void opencrank_destroy_plugin(opencrank::Plugin* plugin) { \
         delete plugin; \
     }
+#endif
 
 #endif // opencrank_PLUGIN_LOADER_HPP
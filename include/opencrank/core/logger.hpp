@@ -1,11 +1,34 @@
+/*
+ * opencrank C++ - Logger
+ *
+ * Synchronous by default: each call formats and writes one line to stderr.
+ * Async mode moves all I/O to a writer thread: callers format the message
+ * into a fixed-size, per-thread, single-producer ring buffer and return.
+ * The writer merges the rings in order, formats timestamps (cached per
+ * second) and writes to stderr and/or a log file as text, JSON lines or
+ * binary records. A full ring either drops the record (counted) or blocks.
+ *
+ * Binary record layout (little-endian):
+ *   u32 length of the rest | i64 unix ms | u8 level | u32 thread | u32 line
+ *   | file\0 | function\0 | message\0
+ *
+ * LOG_* macros test the level before evaluating their arguments, and calls
+ * below OPENCRANK_LOG_MIN_LEVEL (0=debug .. 3=error) compile to nothing.
+ */
 #ifndef opencrank_CORE_LOGGER_HPP
 #define opencrank_CORE_LOGGER_HPP
 
 #include <string>
 #include <utility>
+#include <atomic>
 #include <cstdio>
 #include <ctime>
 #include <cstdarg>
+#include <cstdint>
+
+#ifndef OPENCRANK_LOG_MIN_LEVEL
+#define OPENCRANK_LOG_MIN_LEVEL 0
+#endif
 
 namespace opencrank {
 
@@ -23,33 +46,98 @@ enum class LogLevel {
     ERROR = 3
 };
 
+enum class LogFormat {
+    TEXT = 0,       // Same line format as stderr, without colors
+    JSON = 1,       // One JSON object per line
+    BINARY = 2      // Length-prefixed records (see layout above)
+};
+
+struct LoggerOptions {
+    bool async;                 // Writer thread + per-thread rings (default: false)
+    size_t ring_entries;        // Records per thread ring, ~1KB each (default: 256)
+    bool block_when_full;       // Block producers instead of dropping (default: false)
+    std::string file;           // Optional log file (appended)
+    LogFormat file_format;      // Format for the log file
+    bool to_stderr;             // Keep writing to stderr (default: true)
+
+    LoggerOptions()
+        : async(false)
+        , ring_entries(256)
+        , block_when_full(false)
+        , file_format(LogFormat::TEXT)
+        , to_stderr(true) {}
+};
+
 class LOGGER_API Logger {
 public:
     static Logger& instance();
-    
+
     void set_level(LogLevel level);
     LogLevel level() const;
-    
+
+    // Cheap check used by the LOG_* macros before formatting anything
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Apply output options; starts/stops the writer thread as needed
+    bool configure(const LoggerOptions& options);
+
+    // Drain pending async records and flush outputs
+    void flush();
+
+    // Stop the writer thread (drains first); logging continues synchronously
+    void shutdown();
+
+    // Records discarded because a ring was full
+    uint64_t dropped() const { return dropped_.load(); }
+
     void debug(const char* file, int line, const char* func, const char* fmt, ...);
     void info(const char* file, int line, const char* func, const char* fmt, ...);
     void warn(const char* file, int line, const char* func, const char* fmt, ...);
     void error(const char* file, int line, const char* func, const char* fmt, ...);
 
 private:
+    struct Record;
+    struct Ring;
+    struct AsyncState;
+
     Logger();
+    ~Logger();
     Logger(const Logger&);
     Logger& operator=(const Logger&);
-    
+
     void log_impl(LogLevel level, const char* file, int line, const char* func, const char* fmt, va_list args);
-    
-    LogLevel level_;
+
+    // Async path: copy into this thread's ring. False = fall back to sync.
+    bool enqueue(LogLevel level, const char* file, int line, const char* func, const char* fmt, va_list args);
+
+    // Writer thread body and one merge/drain pass
+    void writer_loop();
+    size_t drain_rings();
+    bool has_pending();
+
+    // Format and write one record to every configured output
+    void write_record(const Record& rec);
+
+    std::atomic<int> level_;
+    std::atomic<uint64_t> dropped_;
+    AsyncState* state_;
 };
 
 // Convenience macros
-#define LOG_DEBUG(...) opencrank::Logger::instance().debug(__FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__)
-#define LOG_INFO(...)  opencrank::Logger::instance().info(__FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__)
-#define LOG_WARN(...)  opencrank::Logger::instance().warn(__FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__)
-#define LOG_ERROR(...) opencrank::Logger::instance().error(__FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__)
+#define OPENCRANK_LOG_AT(lvl, method, ...) \
+    do { \
+        if (static_cast<int>(opencrank::LogLevel::lvl) >= OPENCRANK_LOG_MIN_LEVEL && \
+            opencrank::Logger::instance().enabled(opencrank::LogLevel::lvl)) { \
+            opencrank::Logger::instance().method(__FILE__, __LINE__, __PRETTY_FUNCTION__, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) OPENCRANK_LOG_AT(DEBUG, debug, __VA_ARGS__)
+#define LOG_INFO(...)  OPENCRANK_LOG_AT(INFO, info, __VA_ARGS__)
+#define LOG_WARN(...)  OPENCRANK_LOG_AT(WARN, warn, __VA_ARGS__)
+#define LOG_ERROR(...) OPENCRANK_LOG_AT(ERROR, error, __VA_ARGS__)
 
 } // namespace opencrank
 
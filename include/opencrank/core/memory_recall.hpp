@@ -0,0 +1,93 @@
+/*
+ * opencrank C++ - Proactive Memory Recall
+ *
+ * Searches memory for the incoming message before the model sees it, so
+ * the first reply already knows what was saved about the user instead of
+ * spending an iteration on memory_search. handle_ai_message() starts the
+ * lookup on the thread pool, where it runs while the agent assembles the
+ * prompt; the run waits for it (at most wait_ms) right before its first
+ * model call and appends the top hits to the system prompt, within a
+ * token budget.
+ *
+ * The query is the message's significant words (stop words and words
+ * under three letters dropped), searched with MemoryManager::search
+ * (BM25, hybrid with embeddings). The block is cached per session: later
+ * turns reuse it until ttl_s passes or a memory is saved or deleted.
+ *
+ * Config (section "memory.recall"):
+ *   memory.recall.enabled     - Look up memories for each message (default: true)
+ *   memory.recall.max_results - Hits injected (default: 3)
+ *   memory.recall.max_tokens  - Budget of the block, ~4 chars a token (default: 300)
+ *   memory.recall.wait_ms     - Longest the first model call waits (default: 1500)
+ *   memory.recall.ttl_s       - Reuse of a session's hits (default: 900)
+ */
+#ifndef opencrank_CORE_MEMORY_RECALL_HPP
+#define opencrank_CORE_MEMORY_RECALL_HPP
+
+#include "config.hpp"
+#include <string>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+namespace opencrank {
+
+class ThreadPool;
+class Counter;
+
+class MemoryRecall {
+public:
+    // Waits for the lookup and returns the system prompt block ("" = none)
+    typedef std::function<std::string()> Result;
+
+    static MemoryRecall& instance();
+
+    void configure(const Config& cfg);
+    void set_thread_pool(ThreadPool* pool);
+    bool enabled() const;
+
+    // Start the lookup for a message; NULL when recall is off or the
+    // message has nothing to search for. user_key ("channel:sender")
+    // picks the memory shard.
+    Result start(const std::string& session_key, const std::string& user_key,
+                 const std::string& text);
+
+    // Drop a session's cached hits (its conversation was cleared)
+    void forget(const std::string& session_key);
+
+    // Significant words of text, lowercased and deduplicated
+    static std::string query_for(const std::string& text);
+
+private:
+    MemoryRecall();
+    MemoryRecall(const MemoryRecall&);
+    MemoryRecall& operator=(const MemoryRecall&);
+
+    struct Lookup;
+
+    struct Cached {
+        std::string block;
+        uint64_t revision;          // MemoryManager::revision() it was found at
+        int64_t stored_ms;
+    };
+
+    void remember(const std::string& session_key, const std::string& block, uint64_t revision);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Cached> sessions_;
+    ThreadPool* pool_;
+    bool enabled_;
+    int max_results_;
+    size_t max_chars_;
+    int wait_ms_;
+    int64_t ttl_ms_;
+
+    Counter* cached_;
+    Counter* searched_;
+    Counter* late_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_MEMORY_RECALL_HPP
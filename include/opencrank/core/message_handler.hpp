@@ -8,12 +8,18 @@
 #define opencrank_CORE_MESSAGE_HANDLER_HPP
 
 #include "types.hpp"
+#include "json.hpp"
+#include "thread_pool.hpp"
+#include "command_table.hpp"
+#include "session_executor.hpp"
 #include <string>
+#include <functional>
 
 namespace opencrank {
 
 // Forward declarations
 class Session;
+class ChannelPlugin;
 
 // ============================================================================
 // Message Handler Functions
@@ -27,17 +33,28 @@ class Session;
  * - Skill commands (matched skill names)
  * - AI for natural conversation
  * 
- * This is called from the thread pool after rate limiting.
+ * This is called from the thread pool after rate limiting. done runs
+ * once the reply is out, possibly on another pool thread: a chat turn
+ * holds no worker while the model answers.
  */
-void process_message(const Message& msg);
+void process_message(const MessagePtr& msg, const SessionExecutor::Done& done);
 
 /**
  * Main message callback for channels.
  * 
+ * Forwards the message to the cluster node owning its session, or
+ * handles it here through on_owned_message().
+ */
+void on_message(const Message& msg);
+
+/**
+ * Handle a message for a session this node owns (also messages
+ * forwarded by cluster peers).
+ * 
  * Performs deduplication, rate limiting, and enqueues
  * the message for processing in the thread pool.
  */
-void on_message(const Message& msg);
+void on_owned_message(const Message& msg);
 
 /**
  * Error callback for channels.
@@ -69,12 +86,74 @@ void broadcast_notification(
     const std::string& emoji
 );
 
+/**
+ * Message as JSON and back (cluster forwards, hot restart state).
+ */
+Json message_to_json(const Message& msg);
+Message message_from_json(const Json& json);
+
 // ============================================================================
 // Internal Message Processing
 // ============================================================================
 
 namespace detail {
 
+/**
+ * Pick the thread pool lane for a message.
+ * Registered slash commands are interactive; plain text, skill
+ * commands and /continue run the agentic loop.
+ */
+TaskPriority classify_message(const Message& msg);
+
+/**
+ * True for /stop, which on_message handles ahead of the session queue.
+ */
+bool is_stop_command(const Message& msg);
+
+/**
+ * Live-updating reply on the originating channel.
+ * The first update sends a draft message; later updates edit it, at most
+ * once per min_interval_ms. send_response() replaces the draft with the
+ * final text.
+ */
+class StreamingReply {
+public:
+    StreamingReply(ChannelPlugin* channel, const Message& msg, int min_interval_ms);
+    
+    // Show text so far (throttled)
+    void update(const std::string& text);
+    
+    bool active() const { return !message_id_.empty(); }
+    ChannelPlugin* channel() const { return channel_; }
+    const std::string& message_id() const { return message_id_; }
+    
+private:
+    ChannelPlugin* channel_;
+    std::string to_;
+    std::string reply_to_;
+    std::string message_id_;
+    std::string last_text_;
+    int64_t last_edit_ms_;
+    int min_interval_ms_;
+    bool failed_;
+};
+
+/**
+ * Releases a session taken with SessionManager::get_session* when the
+ * turn ends, whichever way it ends: saves changes and unpins it.
+ */
+class SessionRelease {
+public:
+    explicit SessionRelease(Session& session) : session_(session) {}
+    ~SessionRelease();
+    
+private:
+    SessionRelease(const SessionRelease&);
+    SessionRelease& operator=(const SessionRelease&);
+    
+    Session& session_;
+};
+
 /**
  * Handle a slash command (built-in or skill).
  * Returns the response to send, or empty string if command not found.
@@ -86,30 +165,39 @@ std::string handle_command(
 );
 
 /**
- * Handle a skill command invocation.
- * Returns true if a skill was matched and handled.
+ * Handle a skill command resolved by the CommandTable.
+ * Returns true if match was a skill command and it was handled.
  */
 bool handle_skill_command(
     const Message& msg,
     Session& session,
-    const std::string& cmd_text,
+    const CommandTable::Match& match,
     std::string& response_out
 );
 
+// Receives the reply text of handle_ai_message()
+typedef std::function<void(const std::string& response)> ReplyCallback;
+
 /**
  * Handle a regular (non-command) message via AI.
+ * done receives the reply, on this thread or on the pool thread that
+ * finishes the agent run; session (and stream) must stay valid until then.
  */
-std::string handle_ai_message(
+void handle_ai_message(
     const Message& msg,
-    Session& session
+    Session& session,
+    StreamingReply* stream,
+    const ReplyCallback& done
 );
 
 /**
- * Send a response, optionally splitting into chunks.
+ * Queue a response on the OutboundScheduler, split into chunks, and return.
+ * If stream holds a draft, its first chunk is edited in place.
  */
 void send_response(
     const Message& original_msg,
-    const std::string& response
+    const std::string& response,
+    StreamingReply* stream = nullptr
 );
 
 } // namespace detail
@@ -0,0 +1,177 @@
+/*
+ * opencrank C++ - Metrics
+ *
+ * Process-wide counters, gauges and histograms, rendered in the Prometheus
+ * text format (served by the gateway plugin at /metrics).
+ *
+ * A series is looked up once by name and labels (under the registry lock)
+ * and then updated with relaxed atomics only, so hot paths keep the
+ * reference: either in a function-local static when the labels are fixed,
+ * or by looking it up per event where that is cheap next to the work being
+ * measured (a model call, a tool run). Values that already live elsewhere
+ * (queue depths, session counts, debouncer stats) are read at scrape time
+ * by collectors instead of being mirrored.
+ *
+ * Plugins compile this header as C++11.
+ */
+#ifndef opencrank_CORE_METRICS_HPP
+#define opencrank_CORE_METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <sstream>
+#include <cstdint>
+
+namespace opencrank {
+
+class Counter {
+public:
+    Counter() : value_(0) {}
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_;
+};
+
+class Gauge {
+public:
+    Gauge() : value_(0) {}
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_;
+};
+
+// Cumulative buckets as Prometheus expects; the sum is kept in millionths
+// so it can be a plain atomic integer
+class Histogram {
+public:
+    explicit Histogram(const std::vector<double>& bounds);
+
+    void observe(double value);
+
+    const std::vector<double>& bounds() const { return bounds_; }
+    uint64_t bucket(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }  // Not cumulative
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    double sum() const { return static_cast<double>(sum_micro_.load(std::memory_order_relaxed)) / 1e6; }
+
+private:
+    Histogram(const Histogram&);
+    Histogram& operator=(const Histogram&);
+
+    std::vector<double> bounds_;                        // Upper bounds, ascending; +Inf implied
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;  // bounds_.size() + 1
+    std::atomic<uint64_t> count_;
+    std::atomic<int64_t> sum_micro_;
+};
+
+// Observes the seconds spent in the enclosing scope
+class HistogramTimer {
+public:
+    explicit HistogramTimer(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~HistogramTimer() {
+        histogram_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+    }
+
+private:
+    HistogramTimer(const HistogramTimer&);
+    HistogramTimer& operator=(const HistogramTimer&);
+
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Builds the rendered label set, e.g. {provider="claude",kind="prompt"}.
+// Series of one metric are told apart by this string, so build it the same
+// way every time.
+std::string metric_labels(const std::string& k1, const std::string& v1);
+std::string metric_labels(const std::string& k1, const std::string& v1,
+                          const std::string& k2, const std::string& v2);
+std::string metric_labels(const std::string& k1, const std::string& v1,
+                          const std::string& k2, const std::string& v2,
+                          const std::string& k3, const std::string& v3);
+
+// Scrape-time output for collectors. Consecutive samples of the same metric
+// share one HELP/TYPE header.
+class MetricsWriter {
+public:
+    explicit MetricsWriter(std::ostringstream& out) : out_(out) {}
+
+    void gauge(const std::string& name, const std::string& help, double value,
+               const std::string& labels = "");
+    void counter(const std::string& name, const std::string& help, double value,
+                 const std::string& labels = "");
+
+private:
+    void sample(const std::string& name, const std::string& help, const char* type,
+                double value, const std::string& labels);
+
+    std::ostringstream& out_;
+    std::string last_name_;
+};
+
+class Metrics {
+public:
+    typedef std::function<void(MetricsWriter&)> Collector;
+
+    static Metrics& instance();
+
+    // Find or create a series. The reference stays valid for the life of
+    // the process; help and buckets are taken from the first registration.
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                         const std::vector<double>& bounds = latency_buckets());
+
+    // Called on every scrape; id replaces an earlier collector of that id
+    void add_collector(const std::string& id, const Collector& collector);
+    void remove_collector(const std::string& id);
+
+    // Everything in the Prometheus text exposition format (version 0.0.4)
+    std::string render() const;
+
+    // Seconds, 5 ms to 5 minutes
+    static std::vector<double> latency_buckets();
+
+private:
+    Metrics() {}
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+
+    enum Kind { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Family {
+        Kind kind;
+        std::string help;
+        std::vector<double> bounds;                                     // Histograms
+        std::map<std::string, std::shared_ptr<Counter> > counters;     // By labels
+        std::map<std::string, std::shared_ptr<Gauge> > gauges;
+        std::map<std::string, std::shared_ptr<Histogram> > histograms;
+    };
+
+    Family& family(const std::string& name, const std::string& help, Kind kind);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+    std::vector<std::pair<std::string, Collector> > collectors_;
+};
+
+// Model call outcome: opencrank_llm_request_seconds, _requests_total and
+// _tokens_total, labelled by provider and purpose (chat, resume, ...)
+void record_llm_request(const std::string& provider, const std::string& purpose,
+                        double seconds, bool success,
+                        int64_t prompt_tokens, int64_t completion_tokens, int64_t cached_tokens);
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_METRICS_HPP
@@ -0,0 +1,149 @@
+/*
+ * opencrank C++ - Outbound Reply Scheduler
+ *
+ * Replies leave the agent worker as soon as they are queued here. Each
+ * (channel, chat) has a FIFO queue: chunks of a reply, and of later replies
+ * to the same chat, go out in order. Chats are independent of each other.
+ *
+ * Channels whose send_message_async() queues and returns at once
+ * (ChannelCapabilities::async_sends: Telegram, WhatsApp) shape their own
+ * traffic with what their API reports. Their chunks are pipelined: chunk
+ * n+1 is handed over as soon as chunk n is, without waiting for its
+ * result. Other channels send synchronously, so this scheduler shapes
+ * them: a token bucket per channel (max_sends_per_second) and a minimum
+ * gap per chat (min_chat_send_interval_ms). It runs one send at a time
+ * per chat, on its own small pool of sender threads.
+ *
+ * Editing a streamed draft into the final text is blocking on every
+ * channel, and runs on the sender pool ahead of the remaining chunks.
+ */
+#ifndef opencrank_CORE_OUTBOUND_HPP
+#define opencrank_CORE_OUTBOUND_HPP
+
+#include "channel.hpp"
+#include "rate_limiter.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class ThreadPool;
+
+class OutboundScheduler {
+public:
+    // How one queued reply went, reported once all its chunks are answered
+    struct Delivery {
+        std::string channel_id;
+        std::string to;
+        size_t chunks;
+        size_t delivered;
+        std::string error;      // Last failure ("" = every chunk delivered)
+
+        Delivery() : chunks(0), delivered(0) {}
+    };
+    typedef std::function<void(const Delivery&)> DeliveryCallback;
+
+    // Per chunk, once the channel has answered for it
+    typedef std::function<void(size_t index, const SendResult& result)> ChunkCallback;
+
+    struct Reply {
+        std::string to;
+        std::vector<std::string> chunks;
+        std::string reply_to;           // First chunk replies to this message
+        std::string edit_message_id;    // First chunk replaces this draft instead
+        ChunkCallback on_chunk;
+        DeliveryCallback on_delivered;
+    };
+
+    static OutboundScheduler& instance();
+
+    // threads: sender threads for channels that send synchronously
+    void start(size_t threads);
+
+    // Waits up to drain_ms for queued chunks to go out, then fails the rest
+    // (call before channels stop)
+    void stop(int drain_ms);
+
+    // Queue a reply to one chat; returns without waiting for the network.
+    // Before start() (or after stop()) the reply is sent on this thread.
+    void send(ChannelPlugin* channel, const Reply& reply);
+
+    // Stats
+    size_t pending() const;
+    uint64_t delivered() const { return delivered_.load(); }
+    uint64_t failed() const { return failed_.load(); }
+
+private:
+    OutboundScheduler();
+    ~OutboundScheduler();
+    OutboundScheduler(const OutboundScheduler&);
+    OutboundScheduler& operator=(const OutboundScheduler&);
+
+    struct ReplyState;
+
+    struct Job {
+        ChannelPlugin* channel;
+        std::string chat_key;
+        std::string to;
+        std::string text;
+        std::string reply_to;
+        std::string edit_message_id;
+        size_t index;
+        std::shared_ptr<ReplyState> reply;
+        bool pipelined;         // Handed to send_message_async, not awaited
+        int chat_interval_ms;
+    };
+
+    struct ChatQueue {
+        std::deque<Job> jobs;
+        bool busy;              // A blocking send for this chat is running
+        int64_t next_ms;        // Earliest time for its next send
+
+        ChatQueue() : busy(false), next_ms(0) {}
+    };
+
+    struct ChannelShape {
+        bool async_sends;
+        bool shaped;            // Bucket applies
+        int chat_interval_ms;
+        TokenBucketLimiter bucket;
+
+        ChannelShape() : async_sends(false), shaped(false), chat_interval_ms(0), bucket(1, 1) {}
+    };
+
+    // mutex_ held
+    ChannelShape& shape_for(ChannelPlugin* channel);
+    void take_ready(int64_t now, std::vector<Job>& ready, int64_t& wait_ms);
+
+    void dispatcher_loop();
+    void dispatch(Job& job);
+    SendResult run_blocking(const Job& job);
+    void chat_done(const std::string& chat_key, int chat_interval_ms);
+    void report(const Job& job, const SendResult& result);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, ChatQueue> chats_;        // channel '\n' chat -> queue
+    std::map<std::string, ChannelShape> shapes_;    // By channel id
+    size_t queued_;
+    bool running_;
+    bool stopping_;
+    std::thread thread_;
+    std::unique_ptr<ThreadPool> senders_;
+
+    std::atomic<uint64_t> delivered_;
+    std::atomic<uint64_t> failed_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_OUTBOUND_HPP
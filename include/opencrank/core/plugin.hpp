@@ -4,9 +4,12 @@
 #include "../core/config.hpp"
 #include "../core/types.hpp"
 #include <string>
+#include <vector>
 
 namespace opencrank {
 
+class Reactor;
+
 // Base plugin interface
 class Plugin {
 public:
@@ -21,12 +24,28 @@ public:
     virtual bool init(const Config& cfg) = 0;
     virtual void shutdown() = 0;
     
+    // Optional: plugins (by name, or AI provider / channel / tool id) whose
+    // init() must finish before this one's. Plugins without an ordering
+    // between them are initialized in parallel.
+    virtual std::vector<std::string> init_after(const Config& /* cfg */) const {
+        return std::vector<std::string>();
+    }
+    
     // Plugin state
     virtual bool is_initialized() const { return initialized_; }
     
     // Optional: plugins can override this for periodic updates
     virtual void poll() {}
     
+    // Optional: hook into the main event loop (fds, timers, posted work).
+    // Return true if the plugin no longer needs periodic poll() calls.
+    virtual bool attach_reactor(Reactor& /* reactor */) { return false; }
+
+    // Optional: undo attach_reactor() before the plugin is unloaded at
+    // runtime (removing its fds and timers). false, the default, means an
+    // attached plugin can only be replaced by a restart.
+    virtual bool detach_reactor(Reactor& /* reactor */) { return false; }
+
     // Optional: plugins can override this to receive all incoming messages
     // (useful for gateway/logging plugins that need to see all traffic)
     virtual void on_incoming_message(const Message& /* msg */) {}
@@ -37,6 +56,12 @@ public:
                                      const std::string& /* chat_id */,
                                      bool /* typing */) {}
     
+    // Optional: state carried over a hot restart (SIGUSR2). save_state()
+    // is called after the channel stopped; the new process passes it to
+    // restore_state() after init(), before the channel starts.
+    virtual Json save_state() const { return Json(); }
+    virtual void restore_state(const Json& /* state */) {}
+    
 protected:
     bool initialized_;
     
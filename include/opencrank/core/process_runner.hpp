@@ -0,0 +1,90 @@
+/*
+ * opencrank C++ - Process Runner
+ *
+ * Runs a child process without blocking on it: posix_spawn into its own
+ * process group, stdout and stderr merged into one nonblocking pipe, and a
+ * poll loop over the pipe and a pidfd (waitpid polling on kernels without
+ * pidfd_open). Output is handed to a callback as it arrives.
+ *
+ * Limits are applied to the child instead of wrapping it in timeout(1):
+ * RLIMIT_CPU and RLIMIT_AS through prlimit() right after the spawn, plus a
+ * wall-clock deadline after which the whole process group gets SIGTERM and,
+ * after a grace period, SIGKILL.
+ *
+ * Simple command lines ("ls -la src", "cat notes.txt") skip /bin/sh and are
+ * spawned directly, which saves the shell's startup on the commands the
+ * agent runs most.
+ *
+ * Every run can carry a cancel key (the AI monitor's session id). cancel()
+ * kills all process groups running under that key, from any thread.
+ */
+#ifndef opencrank_CORE_PROCESS_RUNNER_HPP
+#define opencrank_CORE_PROCESS_RUNNER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace opencrank {
+
+struct ProcessLimits {
+    int timeout_s;          // Wall clock (0 = none)
+    int cpu_s;              // RLIMIT_CPU (0 = none)
+    size_t memory_bytes;    // RLIMIT_AS (0 = none)
+    size_t max_output;      // Output kept in ProcessResult (the rest is read and dropped)
+    const std::atomic<bool>* cancel;    // Set by the run's owner: kill, as cancel() does
+
+    ProcessLimits() : timeout_s(0), cpu_s(0), memory_bytes(0), max_output(1024 * 1024), cancel(NULL) {}
+};
+
+struct ProcessResult {
+    bool started;
+    int exit_code;          // -1 if killed by a signal
+    int term_signal;        // Signal that ended the process (0 = exited)
+    bool timed_out;
+    bool cancelled;
+    bool truncated;         // Output exceeded max_output
+    std::string output;     // stdout and stderr, interleaved
+    std::string error;      // Why the process could not be started
+    int error_code;         // errno behind error
+    int64_t duration_ms;
+
+    ProcessResult()
+        : started(false), exit_code(-1), term_signal(0), timed_out(false)
+        , cancelled(false), truncated(false), error_code(0), duration_ms(0) {}
+};
+
+class ProcessRunner {
+public:
+    // Called from the running thread with each block of output as it is read
+    using OutputCallback = std::function<void(const char* data, size_t len)>;
+
+    // Run argv[0] (searched in PATH) in workdir ("" = current directory)
+    static ProcessResult run(const std::vector<std::string>& argv,
+                             const std::string& workdir,
+                             const ProcessLimits& limits,
+                             const std::string& cancel_key = "",
+                             OutputCallback on_output = OutputCallback());
+
+    // Run a command line. Simple commands (plain words, no quoting,
+    // expansion, redirection or operators) are spawned directly; anything
+    // else, or a first word that is not a program, goes through /bin/sh -c.
+    static ProcessResult run_shell(const std::string& command,
+                                   const std::string& workdir,
+                                   const ProcessLimits& limits,
+                                   const std::string& cancel_key = "",
+                                   OutputCallback on_output = OutputCallback());
+
+    // Kill every process running under cancel_key; returns how many
+    static size_t cancel(const std::string& cancel_key);
+
+    // Processes currently running
+    static size_t running();
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_PROCESS_RUNNER_HPP
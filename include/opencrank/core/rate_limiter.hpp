@@ -5,6 +5,12 @@
 #include <vector>
 #include <map>
 #include <deque>
+#include <unordered_map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <utility>
 #include <cstdint>
 
 namespace opencrank {
@@ -48,6 +54,16 @@ public:
     // Try to consume a token
     RateLimitResult try_acquire();
     
+    // Consume a token even before it has refilled; retry_after_ms is how
+    // long the caller must wait for it (pacing rather than rejecting)
+    RateLimitResult reserve();
+    
+    // Change capacity and rate, keeping the tokens already there
+    void set_rate(int max_tokens, double refill_rate_per_second);
+    
+    // Drop to at most tokens (e.g. what a server says is left)
+    void limit_to(int tokens);
+    
     // Check if a token would be available (without consuming)
     bool would_allow() const;
     
@@ -61,7 +77,7 @@ private:
     void refill();
     
     int max_tokens_;
-    int refill_rate_;
+    double refill_rate_;
     double tokens_;
     int64_t last_refill_ms_;
 };
@@ -89,6 +105,15 @@ private:
 };
 
 // Per-key rate limiter (e.g., per user, per channel)
+//
+// Thread-safe. Keys hash into lock-striped shards; each key keeps one
+// compact state record (fits a cache line) instead of a limiter object:
+//   TOKEN_BUCKET   - limit tokens, refilled at window_or_rate per second
+//   SLIDING_WINDOW - limit requests per window_or_rate seconds, using the
+//                    weighted two-window estimate (previous window's count
+//                    scaled by its remaining overlap plus the current count)
+// Idle keys are expired through a per-shard timer wheel, so cleanup() only
+// visits keys that have actually gone quiet.
 class KeyedRateLimiter {
 public:
     enum LimiterType {
@@ -101,6 +126,9 @@ public:
     // Check rate limit for a key
     RateLimitResult check(const std::string& key);
     
+    // Check several keys, taking each shard lock once (results in key order)
+    std::vector<RateLimitResult> check_many(const std::vector<std::string>& keys);
+    
     // Reset a specific key
     void reset(const std::string& key);
     
@@ -114,45 +142,112 @@ public:
     size_t key_count() const;
 
 private:
-    LimiterType type_;
-    int limit_;
-    int window_or_rate_;
+    KeyedRateLimiter(const KeyedRateLimiter&);
+    KeyedRateLimiter& operator=(const KeyedRateLimiter&);
+    
+    static const size_t SHARDS = 16;
+    static const size_t WHEEL_SLOTS = 64;
+    static const int64_t WHEEL_TICK_MS = 60000;   // Expiry resolution
+    
+    struct KeyState {
+        double tokens;              // Token bucket: available tokens
+        int64_t refill_ms;          // Token bucket: last refill
+        int64_t window_start_ms;    // Sliding window: current window start
+        int32_t prev_count;         // Sliding window: previous window total
+        int32_t curr_count;         // Sliding window: current window so far
+        int64_t last_active_ms;
+        int64_t tick;               // Wheel tick the key is filed under
+    };
     
-    // For token bucket
-    std::map<std::string, TokenBucketLimiter> token_limiters_;
+    struct WheelSlot {
+        int64_t tick;
+        std::vector<std::string> keys;
+        WheelSlot() : tick(-1) {}
+    };
     
-    // For sliding window
-    std::map<std::string, SlidingWindowLimiter> window_limiters_;
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, KeyState> keys;
+        WheelSlot wheel[WHEEL_SLOTS];
+    };
+    
+    Shard& shard_for(const std::string& key);
     
-    // Track last activity for cleanup
-    std::map<std::string, int64_t> last_activity_;
+    // Shard lock held
+    RateLimitResult check_locked(Shard& shard, const std::string& key, int64_t now);
+    void touch_locked(Shard& shard, const std::string& key, KeyState& state, int64_t now);
+    size_t expire_locked(Shard& shard, int64_t cutoff_ms);
+    
+    LimiterType type_;
+    int limit_;
+    int window_or_rate_;
+    Shard shards_[SHARDS];
 };
 
-// Typing indicator manager
+// Typing indicator manager: the one place typing actions are sent from.
+//
+// A chat shows "typing" while at least one run holds it (start/stop nest).
+// Requests are deduplicated (a chat is sent at most once per interval,
+// however many callers ask) and batched per channel: they collect until
+// the pending flush runs on the executor, off the caller's thread.
 class TypingIndicator {
 public:
+    // Delivers one channel's batch: chats to show typing in, or to clear
+    typedef std::function<void(const std::string& channel_id,
+                               const std::vector<std::string>& chat_ids,
+                               bool typing)> Sender;
+    // Runs a flush asynchronously (inline if unset)
+    typedef std::function<void(std::function<void()>)> Executor;
+    
     TypingIndicator();
     
-    // Start typing indicator for a chat
-    void start_typing(const std::string& chat_id);
+    void set_sender(const Sender& sender, const Executor& executor);
     
-    // Stop typing indicator for a chat
-    void stop_typing(const std::string& chat_id);
+    // Start typing indicator for a chat (sent now unless sent within interval)
+    void start_typing(const std::string& channel_id, const std::string& chat_id);
     
-    // Check if we should send typing indicator (with throttling)
-    bool should_send_typing(const std::string& chat_id);
+    // Stop typing indicator for a chat; cleared once the last holder stops
+    void stop_typing(const std::string& channel_id, const std::string& chat_id);
     
-    // Get chats with active typing
-    std::vector<std::string> active_chats() const;
+    // Re-send for a chat still typing, if the interval has passed
+    void refresh(const std::string& channel_id, const std::string& chat_id);
     
     // Typing indicator interval in milliseconds (default 5000)
     void set_interval(int ms) { interval_ms_ = ms; }
     int interval() const { return interval_ms_; }
+    
+    // Typing actions handed to the sender
+    uint64_t sent() const { return sent_.load(); }
 
 private:
+    typedef std::pair<std::string, std::string> ChatKey;   // channel, chat
+    
+    struct ChatState {
+        int holders;
+        int64_t last_sent_ms;
+        
+        ChatState() : holders(0), last_sent_ms(0) {}
+    };
+    
+    struct Batch {
+        std::set<std::string> start;
+        std::set<std::string> stop;
+    };
+    
+    // mutex_ held; true if the caller must dispatch() a flush
+    bool queue_locked(const ChatKey& key, bool typing);
+    void dispatch();
+    void flush();
+    
     int interval_ms_;
-    std::map<std::string, int64_t> last_typing_;  // chat_id -> last send time
-    std::map<std::string, bool> is_typing_;       // chat_id -> is typing
+    Sender sender_;
+    Executor executor_;
+    std::atomic<uint64_t> sent_;
+    
+    std::mutex mutex_;
+    std::map<ChatKey, ChatState> chats_;
+    std::map<std::string, Batch> pending_;   // channel -> queued actions
+    bool flush_scheduled_;
 };
 
 // Heartbeat/keep-alive manager
@@ -192,22 +287,74 @@ private:
 };
 
 // Message debouncer (prevents duplicate message handling)
+//
+// Thread-safe, fixed memory. Seen IDs are kept as 64-bit fingerprints in a
+// ring ordered by arrival, indexed by an open-addressing hash table. Entries
+// fall off the ring when they leave the window - or early, when the ring is
+// full (counted as evictions). An optional pair of rotating Bloom filters
+// answers "never seen" without touching the table.
 class MessageDebouncer {
 public:
-    MessageDebouncer(int window_seconds = 5);
+    MessageDebouncer(int window_seconds = 5, size_t max_entries = 65536);
     
     // Check if message should be processed (returns false if duplicate)
     bool should_process(const std::string& message_id);
     
-    // Clean up old entries
+    // Drop entries older than the window (also done on every check)
     void cleanup();
     
     // Set dedup window
-    void set_window(int seconds) { window_seconds_ = seconds; }
+    void set_window(int seconds);
+    
+    // Resize the ring (clears remembered IDs)
+    void set_capacity(size_t max_entries);
+    
+    // Enable the Bloom-filter front (bits per generation, 0 = off)
+    void set_bloom_bits(size_t bits);
+    
+    // Remembered IDs as (fingerprint, seen_ms), oldest first, and their
+    // reload (entries already out of the window are skipped), to carry
+    // the set over a hot restart
+    std::vector<std::pair<uint64_t, int64_t> > snapshot() const;
+    void restore(const std::vector<std::pair<uint64_t, int64_t> >& entries);
+    
+    // Stats
+    uint64_t duplicates() const;    // Duplicates caught
+    uint64_t evictions() const;     // IDs forgotten before the window ended
+    size_t size() const;            // IDs currently remembered
 
 private:
-    int window_seconds_;
-    std::map<std::string, int64_t> seen_messages_;
+    struct Entry {
+        uint64_t fingerprint;
+        int64_t seen_ms;
+    };
+    
+    static const uint32_t EMPTY = 0xffffffffu;
+    
+    // mutex_ held
+    void expire_locked(int64_t now);
+    void pop_oldest_locked();
+    void insert_locked(uint64_t fingerprint, int64_t seen_ms);
+    size_t find_slot_locked(uint64_t fingerprint) const;   // index slot or EMPTY slot
+    void erase_index_locked(uint64_t fingerprint);
+    bool bloom_maybe_locked(uint64_t fingerprint) const;
+    void bloom_add_locked(uint64_t fingerprint, int64_t now);
+    
+    mutable std::mutex mutex_;
+    int64_t window_ms_;
+    
+    std::vector<Entry> ring_;          // Circular, oldest at tail_
+    size_t head_;
+    size_t tail_;
+    size_t count_;
+    std::vector<uint32_t> index_;     // Ring position per slot, power-of-two size
+    
+    std::vector<uint64_t> bloom_[2];  // Current / previous generation
+    size_t bloom_current_;
+    int64_t bloom_rotated_ms_;
+    
+    uint64_t duplicates_;
+    uint64_t evictions_;
 };
 
 // Throttler for general-purpose rate limiting
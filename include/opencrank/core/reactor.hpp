@@ -0,0 +1,103 @@
+/*
+ * opencrank C++ - Event Reactor
+ *
+ * epoll-based main loop. The main thread blocks in epoll_wait until a
+ * registered file descriptor is ready, a timer is due, or another thread
+ * wakes it (eventfd). Plugins register from attach_reactor():
+ *   - file descriptors (sockets, pipes, eventfds) with a readiness callback
+ *   - timers (one-shot or repeating)
+ *   - posted closures, run on the reactor thread ("wake handles")
+ *
+ * All callbacks run on the reactor thread and must not block for long;
+ * hand slow work to the ThreadPool. fd and timer registration is for the
+ * reactor thread (or before run()); other threads use post(). post(),
+ * wake() and stop() are thread-safe; stop() is also async-signal-safe.
+ */
+#ifndef opencrank_CORE_REACTOR_HPP
+#define opencrank_CORE_REACTOR_HPP
+
+#include <functional>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace opencrank {
+
+class Reactor {
+public:
+    typedef std::function<void(uint32_t events)> FdCallback;   // EPOLLIN/EPOLLOUT/... bits
+    typedef std::function<void()> Task;
+    typedef uint64_t TimerId;
+
+    Reactor();
+    ~Reactor();
+
+    // Create the epoll/eventfd pair; false if the kernel refuses
+    bool init();
+
+    // Watch fd for events (EPOLLIN etc.). Replaces an existing registration.
+    bool add_fd(int fd, uint32_t events, FdCallback callback);
+    bool modify_fd(int fd, uint32_t events);
+    void remove_fd(int fd);
+
+    // Run callback after delay_ms, then every delay_ms if repeat
+    TimerId add_timer(int delay_ms, Task callback, bool repeat = false);
+    void cancel_timer(TimerId id);
+
+    // Run task on the reactor thread (thread-safe)
+    void post(Task task);
+
+    // Interrupt a blocking wait (thread-safe, async-signal-safe)
+    void wake();
+
+    // Dispatch ready events once, blocking at most max_wait_ms (-1 = until
+    // the next timer or event). Returns the number of callbacks run.
+    int run_once(int max_wait_ms = -1);
+
+    // Loop until stop()
+    void run();
+    void stop();
+    bool stopped() const { return stop_.load(); }
+
+    // Stats
+    uint64_t wakeups() const { return wakeups_.load(); }
+
+private:
+    Reactor(const Reactor&);
+    Reactor& operator=(const Reactor&);
+
+    struct Timer {
+        TimerId id;
+        int interval_ms;
+        bool repeat;
+        Task callback;
+    };
+
+    // Milliseconds until the earliest timer (-1 if none)
+    int next_timer_wait(int64_t now) const;
+    int run_due_timers(int64_t now);
+    int run_posted();
+    void drain_wake_fd();
+
+    int epoll_fd_;
+    int wake_fd_;
+    std::atomic<bool> stop_;
+    std::atomic<uint64_t> wakeups_;
+
+    // Reactor thread only
+    std::map<int, std::shared_ptr<FdCallback> > fds_;
+    std::multimap<int64_t, Timer> timers_;   // due time (ms) -> timer
+    std::map<TimerId, int64_t> timer_due_;   // id -> due time, for cancel
+    TimerId next_timer_id_;
+
+    // Cross-thread
+    std::mutex posted_mutex_;
+    std::vector<Task> posted_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_REACTOR_HPP
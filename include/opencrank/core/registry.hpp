@@ -8,10 +8,17 @@
 #include "../core/session.hpp"
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
 
 namespace opencrank {
 
+class StartupProfile;
+
 // Visibility attribute for plugin-visible symbols
 #ifdef __GNUC__
 #  define PLUGIN_API __attribute__((visibility("default")))
@@ -20,86 +27,96 @@ namespace opencrank {
 #endif
 
 // Plugin registry - manages all plugins
+//
+// The plugin lists and lookup tables form an immutable snapshot, published
+// through an atomic pointer like Config's: get_ai(), get_tool(),
+// find_command() and the list accessors are a hash probe or a read on the
+// current snapshot and never lock. Registering or unregistering builds a
+// new snapshot under write_mutex_. Snapshots are kept until exit, so the
+// vectors and CommandDefs handed out stay valid; the registry only changes
+// at startup and when a plugin is reloaded, so there are few of them.
+//
+// A Pin marks code that is using plugin pointers from the registry (an AI
+// turn, a tool or command call). Once a plugin is unregistered, quiescent()
+// reports when no pin on an older snapshot is left: from then on nothing
+// can still be calling into it, and its library may be closed.
 class PLUGIN_API PluginRegistry {
+    struct Snapshot;
+    
 public:
     // Singleton instance - must be visible to plugins
     static PluginRegistry& instance();
     
-    // Register a plugin
-    void register_plugin(Plugin* plugin) {
-        if (!plugin) return;
-        plugins_.push_back(plugin);
-        plugin_map_[plugin->name()] = plugin;
-        
-        // Also track channel plugins separately
-        ChannelPlugin* channel = dynamic_cast<ChannelPlugin*>(plugin);
-        if (channel) {
-            channels_.push_back(channel);
-            channel_map_[channel->channel_id()] = channel;
-        }
-        
-        // Also track tools
-        ToolProvider* tool = dynamic_cast<ToolProvider*>(plugin);
-        if (tool) {
-            tools_.push_back(tool);
-            tool_map_[tool->tool_id()] = tool;
-        }
-        
-        // Also track AI plugins
-        AIPlugin* ai = dynamic_cast<AIPlugin*>(plugin);
-        if (ai) {
-            ai_providers_.push_back(ai);
-            ai_map_[ai->provider_id()] = ai;
-        }
-    }
+    class PLUGIN_API Pin {
+    public:
+        Pin();
+        ~Pin();
+    private:
+        Pin(const Pin&);
+        Pin& operator=(const Pin&);
+        const Snapshot* snapshot_;
+    };
+    
+    // Register a plugin, last or at position (order decides get_default_ai)
+    void register_plugin(Plugin* plugin, size_t position = static_cast<size_t>(-1));
+    
+    // Remove a plugin from new lookups; calls already holding it go on
+    // until their pins are released (see quiescent()). Returns the position
+    // it had, or size_t(-1) if it was not registered.
+    size_t unregister_plugin(Plugin* plugin);
+    
+    // Bumped by every change
+    uint64_t generation() const { return current()->generation; }
+    
+    // True once no Pin taken before generation is held any more
+    bool quiescent(uint64_t generation) const;
     
     // Get plugin by name
-    Plugin* get_plugin(const std::string& name) {
-        std::map<std::string, Plugin*>::iterator it = plugin_map_.find(name);
-        return it != plugin_map_.end() ? it->second : NULL;
+    Plugin* get_plugin(const std::string& name) const {
+        return lookup(current()->plugin_map, name);
     }
     
     // Get channel by ID
-    ChannelPlugin* get_channel(const std::string& channel_id) {
-        std::map<std::string, ChannelPlugin*>::iterator it = channel_map_.find(channel_id);
-        return it != channel_map_.end() ? it->second : NULL;
+    ChannelPlugin* get_channel(const std::string& channel_id) const {
+        return lookup(current()->channel_map, channel_id);
     }
     
     // Get tool by ID
-    ToolProvider* get_tool(const std::string& tool_id) {
-        std::map<std::string, ToolProvider*>::iterator it = tool_map_.find(tool_id);
-        return it != tool_map_.end() ? it->second : NULL;
+    ToolProvider* get_tool(const std::string& tool_id) const {
+        return lookup(current()->tool_map, tool_id);
     }
     
     // Get AI provider by ID
-    AIPlugin* get_ai(const std::string& provider_id) {
-        std::map<std::string, AIPlugin*>::iterator it = ai_map_.find(provider_id);
-        return it != ai_map_.end() ? it->second : NULL;
+    AIPlugin* get_ai(const std::string& provider_id) const {
+        return lookup(current()->ai_map, provider_id);
     }
     
     // Get first available AI provider
     AIPlugin* get_default_ai();
     
     // Get all plugins
-    const std::vector<Plugin*>& plugins() const { return plugins_; }
+    const std::vector<Plugin*>& plugins() const { return current()->plugins; }
     
     // Get all channels
-    const std::vector<ChannelPlugin*>& channels() const { return channels_; }
+    const std::vector<ChannelPlugin*>& channels() const { return current()->channels; }
     
     // Get all tools
-    const std::vector<ToolProvider*>& tools() const { return tools_; }
+    const std::vector<ToolProvider*>& tools() const { return current()->tools; }
     
     // Get all AI providers
-    const std::vector<AIPlugin*>& ai_providers() const { return ai_providers_; }
+    const std::vector<AIPlugin*>& ai_providers() const { return current()->ai_providers; }
     
-    // Initialize all plugins
-    bool init_all(const Config& cfg);
+    // Initialize all plugins, in waves that respect init_after(): each wave
+    // runs its plugins on parallel threads unless parallel is false.
+    // profile (optional) receives per-plugin timings.
+    bool init_all(const Config& cfg, bool parallel = true, StartupProfile* profile = NULL);
     
     // Shutdown all plugins
     void shutdown_all();
     
-    // Start all channels
-    bool start_all_channels();
+    // Start all initialized channels (concurrently unless parallel is false);
+    // returns how many started
+    int start_all_channels(bool parallel = true, StartupProfile* profile = NULL);
     
     // Stop all channels
     void stop_all_channels();
@@ -131,22 +148,50 @@ public:
                                 Session& session, const std::string& args);
     
     // Get all registered commands (for /help)
-    const std::map<std::string, CommandDef>& commands() const { return commands_; }
+    const std::map<std::string, CommandDef>& commands() const { return current()->commands; }
 
 private:
-    PluginRegistry() {}
+    PluginRegistry();
+    ~PluginRegistry();
     PluginRegistry(const PluginRegistry&);
     PluginRegistry& operator=(const PluginRegistry&);
     
-    std::vector<Plugin*> plugins_;
-    std::vector<ChannelPlugin*> channels_;
-    std::vector<ToolProvider*> tools_;
-    std::vector<AIPlugin*> ai_providers_;
-    std::map<std::string, Plugin*> plugin_map_;
-    std::map<std::string, ChannelPlugin*> channel_map_;
-    std::map<std::string, ToolProvider*> tool_map_;
-    std::map<std::string, AIPlugin*> ai_map_;
-    std::map<std::string, CommandDef> commands_;
+    struct Snapshot {
+        std::vector<Plugin*> plugins;
+        std::vector<ChannelPlugin*> channels;
+        std::vector<ToolProvider*> tools;
+        std::vector<AIPlugin*> ai_providers;
+        std::unordered_map<std::string, Plugin*> plugin_map;
+        std::unordered_map<std::string, ChannelPlugin*> channel_map;
+        std::unordered_map<std::string, ToolProvider*> tool_map;
+        std::unordered_map<std::string, AIPlugin*> ai_map;
+        std::map<std::string, CommandDef> commands;     // Sorted for /help
+        std::unordered_map<std::string, const CommandDef*> command_index;
+        uint64_t generation;
+        mutable std::atomic<int> pins;
+        
+        Snapshot() : generation(0), pins(0) {}
+    };
+    
+    const Snapshot* current() const { return current_.load(std::memory_order_acquire); }
+    
+    template <typename T>
+    static T* lookup(const std::unordered_map<std::string, T*>& map, const std::string& key) {
+        typename std::unordered_map<std::string, T*>::const_iterator it = map.find(key);
+        return it != map.end() ? it->second : NULL;
+    }
+    
+    // Index plugins and commands into a new snapshot and make it current
+    // (write_mutex_ held)
+    void publish_locked(const std::vector<Plugin*>& plugins,
+                        const std::map<std::string, CommandDef>& commands);
+    
+    // Plugin named by an init_after() entry (name or provider/channel/tool id)
+    Plugin* find_dependency(const std::string& name);
+    
+    std::atomic<const Snapshot*> current_;
+    std::vector<std::unique_ptr<Snapshot> > snapshots_;    // Every published snapshot
+    mutable std::mutex write_mutex_;
 };
 
 } // namespace opencrank
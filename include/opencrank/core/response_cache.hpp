@@ -0,0 +1,117 @@
+/*
+ * opencrank C++ - Model Response Cache
+ *
+ * Opt-in cache of model replies in front of the agent's chat() calls, for
+ * users asking the same question again and skill commands that send the
+ * same prompt.
+ *
+ * A request's key is a SHA-256 over the model scope (provider, model,
+ * temperature, tools), the system prompt and the trailing config.messages
+ * messages, with whitespace runs collapsed (case is kept). An optional
+ * semantic tier (config.semantic, needs an embedding endpoint) also serves
+ * a reply when everything but the last user message matches exactly and
+ * that message embeds within config.similarity of a cached one.
+ *
+ * The agent only looks up and stores replies for requests at temperature
+ * 0 (agent.temperature) while the run has executed no side-effecting tool
+ * (any tool not marked parallel_safe), and stores them
+ * only when the run finishes. Entries expire after ttl_s, are evicted LRU
+ * past max_entries, and persist in a SQLite database:
+ *   response_cache(key, context, content, embedding, expires_ms)
+ */
+#ifndef opencrank_CORE_RESPONSE_CACHE_HPP
+#define opencrank_CORE_RESPONSE_CACHE_HPP
+
+#include "../ai/ai.hpp"
+#include "../memory/embeddings.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+struct sqlite3;
+
+namespace opencrank {
+
+class Counter;
+
+struct ResponseCacheConfig {
+    size_t messages;        // Trailing messages in the key (default: 4)
+    int64_t ttl_s;          // Entry lifetime (default: 86400)
+    size_t max_entries;     // LRU bound (default: 2000)
+    bool semantic;          // Embedding-similarity tier (default: false)
+    double similarity;      // Cosine cutoff for semantic hits (default: 0.95)
+    EmbeddingConfig embeddings;
+
+    ResponseCacheConfig()
+        : messages(4), ttl_s(86400), max_entries(2000), semantic(false), similarity(0.95) {}
+};
+
+class ResponseCache {
+public:
+    struct Key {
+        std::string exact;          // Hash of the whole request
+        std::string context;        // Hash of all but the last user message
+        std::string query;          // That message, normalized ("" = no semantic tier)
+        std::vector<float> vector;  // Its embedding, once computed
+    };
+
+    ResponseCache();
+    ~ResponseCache();
+
+    // Open (or create) the database and load the unexpired entries
+    bool open(const std::string& db_path, const ResponseCacheConfig& config);
+    void close();
+    bool enabled() const { return db_ != nullptr; }
+
+    // scope: what else decides the reply (provider, model, tools)
+    Key make_key(const std::string& scope, const std::string& system_prompt,
+                 const std::vector<ConversationMessage>& history) const;
+
+    // Cached reply for key; may embed key.query for the semantic tier
+    bool lookup(Key& key, std::string& content);
+
+    void store(Key& key, const std::string& content);
+
+    size_t entries() const;
+
+private:
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+
+    struct Entry {
+        std::string key;
+        std::string context;
+        std::string content;
+        std::vector<float> vector;  // Unit length; empty without the semantic tier
+        int64_t expires_ms;
+    };
+    typedef std::list<Entry> Lru;
+
+    void insert_locked(const Entry& entry);
+    void remove_locked(Lru::iterator it);
+    bool semantic_lookup(Key& key, std::string& content);
+
+    ResponseCacheConfig config_;
+    EmbeddingClient embedder_;
+
+    mutable std::mutex mutex_;
+    Lru lru_;                                           // Front = most recent
+    std::map<std::string, Lru::iterator> index_;
+    std::multimap<std::string, Lru::iterator> by_context_;
+
+    std::mutex db_mutex_;
+    sqlite3* db_;
+
+    Counter* hits_;
+    Counter* semantic_hits_;
+    Counter* misses_;
+    Counter* stores_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_RESPONSE_CACHE_HPP
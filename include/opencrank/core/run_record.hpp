@@ -0,0 +1,132 @@
+/*
+ * opencrank C++ - Agent Run Recording
+ *
+ * With agent.record_dir set, every Agent::run is written there as one
+ * single-line JSON file, run-<id>.json:
+ *
+ *   - what the run started from: user message, history, system prompt,
+ *     prompt context, the agent settings and the registered tools
+ *   - every provider reply in order (text, native tool calls, usage,
+ *     errors) with its latency and the number of streamed chunks
+ *   - every tool execution (retries and memo hits included) with its
+ *     params, output and duration
+ *   - the outcome: iterations, tool calls, final response, timings
+ *
+ * `opencrank-bench --replay DIR` runs recordings again offline: replies
+ * come from the file, tools return their recorded output, the clock
+ * advances by the recorded latencies instead of waiting, and spans are
+ * timed in thread CPU time. What it reports is the CPU the build under
+ * test spends per stage (loop, reply streaming, tool-call parsing,
+ * tool-result formatting, ...) on conversations users actually had: the
+ * giant scraped pages, the 25-iteration tool loops, the malformed JSON
+ * that synthetic inputs miss. A replay whose loop takes another path than
+ * the recording (different tool calls, iterations or final response) is
+ * flagged as diverged.
+ *
+ * Recordings hold whole conversations and tool outputs; keep record_dir
+ * as private as the session store. Recording copies the history at the
+ * start of each run, so leave it off when not collecting traces.
+ */
+#ifndef opencrank_CORE_RUN_RECORD_HPP
+#define opencrank_CORE_RUN_RECORD_HPP
+
+#include "agent.hpp"
+#include "../ai/ai.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+namespace opencrank {
+
+// One provider reply as the agent received it
+struct RecordedReply {
+    CompletionResult result;
+    int64_t ms;             // Latency (0 for a response cache hit)
+    size_t chunks;          // Streamed chunks it arrived in (0 = not streamed)
+    bool cached;            // Served by the response cache
+
+    RecordedReply() : ms(0), chunks(0), cached(false) {}
+};
+
+// One tool execution
+struct RecordedToolCall {
+    std::string tool;
+    std::string params;     // Params as executed, dumped
+    AgentToolResult result;
+    int64_t ms;
+
+    RecordedToolCall() : ms(0) {}
+};
+
+class RunRecording {
+public:
+    RunRecording();
+
+    // Inputs
+    std::string id;
+    int64_t started_ms;
+    std::string session_key;
+    std::string provider;
+    std::string model;
+    bool native_tools;              // The provider offered function calling
+    bool streamed;                  // The run had a partial-reply sink
+    AgentConfig config;             // Settings only; callbacks are not kept
+    std::string user_message;
+    std::vector<ConversationMessage> history;   // Before the user message
+    std::string system_prompt;
+    std::string prompt_context;
+    std::vector<AgentTool> tools;   // Without executors
+
+    // What happened, in order
+    std::vector<RecordedReply> replies;
+    std::vector<RecordedToolCall> tool_calls;
+
+    // Outcome
+    AgentResult result;
+
+    // Tool calls may finish on several pool threads at once
+    void add_tool_call(const std::string& tool, const std::string& params,
+                       const AgentToolResult& result, int64_t ms);
+
+    Json to_json() const;
+    bool from_json(const Json& json, std::string& error);
+
+    bool load(const std::string& path, std::string& error);
+
+private:
+    RunRecording(const RunRecording&);
+    RunRecording& operator=(const RunRecording&);
+
+    std::mutex mutex_;
+};
+
+class RunRecorder {
+public:
+    static RunRecorder& instance();
+
+    // dir: where recordings go ("" = off)
+    void configure(const std::string& dir);
+
+    bool enabled() const { return !dir_.empty(); }
+    const std::string& dir() const { return dir_; }
+
+    // New recording, or null when recording is off
+    std::shared_ptr<RunRecording> begin(const std::string& id);
+
+    // Write a finished recording to dir/run-<id>.json; returns the path
+    // ("" on failure)
+    std::string finish(const std::shared_ptr<RunRecording>& recording);
+
+private:
+    RunRecorder() {}
+    RunRecorder(const RunRecorder&);
+    RunRecorder& operator=(const RunRecorder&);
+
+    std::string dir_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_RUN_RECORD_HPP
@@ -7,12 +7,24 @@
  * After activation, the process can only access paths explicitly allowed.
  * This prevents the AI from reading/writing outside its jail, even through
  * shell commands.
+ *
+ * Path checks resolve through a bounded cache: a hit costs one stat() of
+ * the path (its device and inode must still match the resolution) instead
+ * of realpath()'s walk over every component. invalidate_path_cache()
+ * drops all entries (e.g. after a shell command rearranged directories).
+ * open_beneath() opens a file with openat2(RESOLVE_BENEATH) under the
+ * allowed root, so the check and the open are one race-free syscall.
  */
 #ifndef opencrank_CORE_SANDBOX_HPP
 #define opencrank_CORE_SANDBOX_HPP
 
 #include <string>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
 
 namespace opencrank {
 
@@ -61,6 +73,14 @@ public:
     // Resolve a relative path within the jail
     std::string resolve_in_jail(const std::string& relative_path) const;
 
+    // open(2) that can't leave the allowed roots: symlinks and ".." are
+    // resolved beneath the root the path names. Plain open() when the
+    // sandbox is inactive. Returns -1 with errno set (EACCES outside).
+    int open_beneath(const std::string& path, int flags, mode_t mode = 0) const;
+
+    // Forget every cached path resolution
+    void invalidate_path_cache();
+
 private:
     Sandbox();
     Sandbox(const Sandbox&);
@@ -69,12 +89,30 @@ private:
     bool ensure_directory(const std::string& path);
     std::string resolve_home_dir() const;
 
+    // realpath() through the cache; false when path doesn't resolve
+    bool resolve_cached(const std::string& path, std::string& resolved) const;
+
+    // O_PATH descriptor of an allowed root (opened once)
+    int root_fd(const std::string& root) const;
+
+    struct CachedPath {
+        std::string resolved;
+        dev_t dev;
+        ino_t ino;
+        uint64_t generation;
+    };
+
     bool active_;
     bool supported_;
     std::string base_dir_;    // ~/.opencrank
     std::string db_dir_;      // ~/.opencrank/db
     std::string jail_dir_;    // ~/.opencrank/jail
     std::vector<std::string> extra_allowed_paths_;
+
+    mutable std::mutex cache_mutex_;
+    mutable std::map<std::string, CachedPath> path_cache_;
+    mutable std::map<std::string, int> root_fds_;
+    std::atomic<uint64_t> cache_generation_;
 };
 
 } // namespace opencrank
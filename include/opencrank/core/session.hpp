@@ -2,15 +2,22 @@
 #define opencrank_CORE_SESSION_HPP
 
 #include <opencrank/core/types.hpp>
+#include <opencrank/core/symbol.hpp>
 #include <opencrank/ai/ai.hpp>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <list>
 #include <vector>
+#include <utility>
 #include <cstdint>
 #include <mutex>
+#include <atomic>
 
 namespace opencrank {
 
+class SessionStore;
+
 // Session scope for DM handling
 enum class DMScope {
     MAIN,              // All DMs share one session (default)
@@ -67,6 +74,9 @@ public:
     
     static Parsed parse(const std::string& session_key);
     
+    // Key of an isolated sub-agent session: agent:<id>:subagent:<n>
+    static std::string build_subagent(const std::string& agent_id, uint64_t n);
+    
     // Check if session key is for a subagent
     static bool is_subagent_key(const std::string& session_key);
     
@@ -123,6 +133,8 @@ public:
     void remove_data(const std::string& key);
     
 private:
+    friend class SessionManager;
+    
     std::string key_;
     std::string agent_id_;
     std::string channel_;
@@ -130,16 +142,74 @@ private:
     std::vector<ConversationMessage> history_;
     int64_t last_activity_;
     std::map<std::string, std::string> data_;
+    
+    // Persistence bookkeeping, owned by SessionManager. stored_ mirrors the
+    // rows saved for history_ as (seq, fingerprint) so a save only writes
+    // what changed, however the agent edited the vector. store_mutex_
+    // guards it and the load/unload of history_; pins_, removed_ and
+    // lru_pos_ belong to the session's shard lock.
+    std::mutex store_mutex_;
+    std::vector<std::pair<int64_t, uint64_t> > stored_;
+    int64_t next_seq_;
+    uint64_t stored_meta_;              // Fingerprint of the saved metadata
+    bool history_loaded_;               // False while evicted to the store
+    bool meta_loaded_;                  // False until the store was read once
+    bool removed_;                      // Removed while pinned; erased on release
+    int pins_;                          // Callers between get_session and release
+    std::atomic<size_t> bytes_;         // Approximate history footprint
+    size_t inflight_bytes_;             // Added by the running turn (shard lock)
+    std::list<Session*>::iterator lru_pos_;
+};
+
+// Approximate memory held for one session
+struct SessionMemory {
+    std::string key;
+    size_t history_bytes;               // As of the last release
+    size_t inflight_bytes;              // Tool results of the turn running now
+    bool loaded;                        // false while unloaded to the store
 };
 
 // Session manager - manages all active sessions
+//
+// Sessions live in SHARDS maps picked by key hash, each with its own lock
+// and LRU list, so chats on different shards never contend. A shard lock
+// only covers lookup, pinning and the LRU splice; reading a cold history
+// from the store and diffing it on save happen under the session's own
+// lock. Between get_session and release a session belongs to its caller,
+// which for chat traffic is the SessionExecutor strand of that key.
 class SessionManager {
 public:
     static SessionManager& instance();
     
-    // Get or create a session by key
+    // Get or create a session by key. The session is pinned (never evicted
+    // or cleaned up) until release(); a cold session's history is loaded
+    // from the store first, outside the shard lock.
     Session& get_session(const std::string& key);
     
+    // Save what changed since the last save (write-behind) and unpin
+    void release(Session& session);
+    
+    // Persist sessions through store (nullptr = memory only). Histories of
+    // unpinned sessions are unloaded, least recently used first, while the
+    // total exceeds memory_budget_bytes (0 = unlimited; needs a store).
+    void set_store(SessionStore* store, size_t memory_budget_bytes);
+    
+    // Approximate bytes of history held in memory, in-flight turns included
+    size_t memory_used() const;
+    
+    // Per-session breakdown of memory_used() (a snapshot taken one shard
+    // at a time)
+    std::vector<SessionMemory> memory_usage() const;
+    
+    // Count bytes a running turn added to a pinned session's history
+    // (model replies, tool results) before release() measures it. Goes
+    // toward the memory budget right away, so a turn piling up tool output
+    // unloads cold sessions instead of waiting for its release.
+    void note_inflight(const std::string& key, size_t bytes);
+    
+    // Histories unloaded to the store to stay under the budget, in total
+    uint64_t evictions() const { return evictions_.load(); }
+    
     // Check if session exists
     bool has_session(const std::string& key) const;
     
@@ -149,17 +219,23 @@ public:
     // Get session for a message
     Session& get_session_for_message(const Message& msg, const std::string& agent_id = "");
     
+    // Resolve the session key a message routes to (does not create the
+    // session). Keys are built once per chat and interned: later messages
+    // from the same chat find theirs by symbol, without building a string.
+    const std::string& session_key_for_message(const Message& msg, const std::string& agent_id = "") const;
+    
     // Clear all sessions
     void clear_all();
     
-    // Clean up inactive sessions (older than max_age_seconds)
+    // Clean up inactive sessions (older than max_age_seconds). Walks each
+    // shard's LRU list from the cold end and stops at the first recent one.
     size_t cleanup_inactive(int64_t max_age_seconds);
     
-    // Get all session keys
+    // Get all session keys (a snapshot taken one shard at a time)
     std::vector<std::string> session_keys() const;
     
     // Session count
-    size_t session_count() const { return sessions_.size(); }
+    size_t session_count() const;
     
     // DM scope setting
     DMScope dm_scope() const { return dm_scope_; }
@@ -174,10 +250,62 @@ private:
     SessionManager(const SessionManager&);
     SessionManager& operator=(const SessionManager&);
     
-    std::map<std::string, Session> sessions_;
-    mutable std::mutex mutex_;
+    static const size_t SHARDS = 16;
+    
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Session> sessions;
+        std::list<Session*> lru;            // Most recently used first
+    };
+    typedef std::unordered_map<std::string, Session>::iterator SessionIter;
+    
+    static size_t shard_index(const std::string& key);
+    
+    // shard.mutex held
+    Session& create_locked(Shard& shard, const std::string& key);
+    SessionIter erase_locked(Shard& shard, SessionIter it);
+    
+    // session.store_mutex_ held
+    void load_history(Session& session, SessionStore* store);
+    void save(Session& session, SessionStore* store);
+    
+    // Unload unpinned histories, coldest first, from shard first_shard on
+    // until memory is back under budget
+    void evict(size_t first_shard);
+    
+    // What a session key is built from, as symbols
+    struct RouteId {
+        Symbol agent;
+        Symbol channel;
+        Symbol account;
+        Symbol peer;
+        int kind;           // PeerKind
+        int scope;          // DMScope
+        
+        bool operator==(const RouteId& o) const {
+            return agent == o.agent && channel == o.channel && account == o.account && peer == o.peer &&
+                   kind == o.kind && scope == o.scope;
+        }
+    };
+    struct RouteIdHash {
+        size_t operator()(const RouteId& r) const {
+            uint64_t h = (static_cast<uint64_t>(r.agent) << 40) ^ (static_cast<uint64_t>(r.channel) << 20) ^
+                         (static_cast<uint64_t>(r.account) << 30) ^ r.peer ^ (static_cast<uint64_t>(r.kind) << 60) ^ (static_cast<uint64_t>(r.scope) << 62);
+            return static_cast<size_t>(h * 0x9e3779b97f4a7c15ULL);
+        }
+    };
+    
+    Shard shards_[SHARDS];
+    std::atomic<size_t> count_;
     DMScope dm_scope_;
     size_t max_history_;
+    std::atomic<SessionStore*> store_;
+    std::atomic<size_t> memory_budget_;
+    std::atomic<size_t> memory_used_;
+    std::atomic<uint64_t> evictions_;
+    
+    mutable std::mutex routes_mutex_;
+    mutable std::unordered_map<RouteId, Symbol, RouteIdHash> routes_;  // -> session key
 };
 
 // Route resolution result
@@ -0,0 +1,119 @@
+/*
+ * opencrank C++ - Per-Session Serialized Executor
+ *
+ * Strand layer on top of the shared ThreadPool. Messages that route to
+ * the same session key run one after another; different sessions still
+ * run in parallel. At most one drain task per session is ever queued on
+ * the pool, so a user firing five messages occupies one worker instead
+ * of five racing on the same history.
+ *
+ * Plain chat messages that pile up behind a running turn can be
+ * coalesced into a single turn (joined with blank lines).
+ *
+ * An AsyncHandler may finish its turn after it returns (waiting for a
+ * model reply without a worker): the session stays busy until it calls
+ * done.
+ *
+ * For a hot restart, hand_off() takes the messages that have not started
+ * and holds every later one, so only the turns already running remain.
+ *
+ * Messages travel as MessagePtr (queued, handed to the handler and kept
+ * for the reply without copying), and strands are keyed by the interned
+ * session key.
+ */
+#ifndef opencrank_CORE_SESSION_EXECUTOR_HPP
+#define opencrank_CORE_SESSION_EXECUTOR_HPP
+
+#include "types.hpp"
+#include "symbol.hpp"
+#include "thread_pool.hpp"
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+namespace opencrank {
+
+class SessionExecutor {
+public:
+    typedef std::function<void(const MessagePtr&)> Handler;
+    typedef std::function<void()> Done;
+    typedef std::function<void(const MessagePtr&, const Done& done)> AsyncHandler;
+
+    // A message that has not started, as handed to the next process
+    struct Queued {
+        std::string session_key;
+        Message msg;
+        TaskPriority priority;
+    };
+
+    SessionExecutor();
+
+    // Must be called before submit(); pool is not owned
+    void init(ThreadPool* pool, Handler handler);
+    // Same, for a handler that calls done (once, from any thread) when
+    // the turn is over
+    void init(ThreadPool* pool, AsyncHandler handler);
+
+    // Merge queued plain-text messages from the same sender (default: on)
+    void set_coalesce(bool enabled) { coalesce_ = enabled; }
+
+    // Queue a message behind any work already running for session_key
+    void submit(const std::string& session_key, const MessagePtr& msg, TaskPriority priority);
+    void submit(const std::string& session_key, const Message& msg, TaskPriority priority) {
+        submit(session_key, std::make_shared<const Message>(msg), priority);
+    }
+
+    // Sessions with running or queued work
+    size_t active_sessions() const;
+
+    // Messages waiting (not yet running) for one session
+    size_t queued(const std::string& session_key) const;
+
+    // Total messages merged into an earlier queued message
+    uint64_t coalesced_count() const { return coalesced_.load(); }
+
+    // Remove the messages not yet started and hold all later submissions
+    // (returned by the next call) instead of running them
+    std::vector<Queued> hand_off();
+
+private:
+    struct PendingMessage {
+        MessagePtr msg;
+        TaskPriority priority;
+    };
+
+    struct Strand {
+        std::deque<PendingMessage> queue;
+    };
+
+    // Post a drain task for session_key at the given lane
+    void schedule(Symbol session_key, TaskPriority priority);
+
+    // Run the head message; finish() follows when its turn is over
+    void drain(Symbol session_key);
+
+    // Reschedule if more are waiting, else release the session
+    void finish(Symbol session_key);
+
+    // True if incoming can be folded into the queued message
+    static bool can_coalesce(const Message& queued, const Message& incoming);
+
+    ThreadPool* pool_;
+    AsyncHandler handler_;
+    bool coalesce_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<Symbol, Strand> strands_;  // present = running or scheduled
+    bool handing_off_;
+    std::vector<Queued> held_;               // Submitted during hand-off
+    std::atomic<uint64_t> coalesced_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_SESSION_EXECUTOR_HPP
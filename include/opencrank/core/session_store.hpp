@@ -0,0 +1,119 @@
+/*
+ * opencrank C++ - Session Store
+ *
+ * SQLite persistence for sessions so conversations survive restarts and
+ * cold sessions can drop their history from memory.
+ *
+ * Writes are write-behind: SessionManager hands over a SessionDelta (the
+ * messages appended or replaced since the last save, plus metadata) and
+ * returns immediately. A writer thread coalesces everything queued within
+ * flush_interval_ms into one transaction. load() waits for queued deltas of
+ * the same key, so a reload never sees stale rows.
+ *
+ * Tables:
+ *   sessions(key, agent_id, channel, peer_id, data, last_activity)
+ *   session_messages(session_key, seq, role, content)   -- seq ascends per key
+ */
+#ifndef opencrank_CORE_SESSION_STORE_HPP
+#define opencrank_CORE_SESSION_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+struct sqlite3;
+
+namespace opencrank {
+
+struct StoredMessage {
+    int64_t seq;
+    int role;               // MessageRole value
+    std::string content;
+
+    StoredMessage() : seq(0), role(0) {}
+};
+
+// Persisted session state
+struct SessionRecord {
+    std::string key;
+    std::string agent_id;
+    std::string channel;
+    std::string peer_id;
+    std::map<std::string, std::string> data;
+    int64_t last_activity;
+    std::vector<StoredMessage> messages;    // Ascending seq
+
+    SessionRecord() : last_activity(0) {}
+};
+
+// One queued change to a session
+struct SessionDelta {
+    std::string key;
+    bool remove;                    // Delete the session and its messages
+    bool has_meta;
+    SessionRecord meta;             // messages unused
+    int64_t keep_from_seq;          // Delete rows with seq < this (trimmed front)
+    int64_t replace_from_seq;       // Delete rows with seq >= this before inserting
+    std::vector<StoredMessage> inserts;
+
+    SessionDelta() : remove(false), has_meta(false), keep_from_seq(0), replace_from_seq(INT64_MAX) {}
+};
+
+class SessionStore {
+public:
+    SessionStore();
+    ~SessionStore();
+
+    bool open(const std::string& db_path, int flush_interval_ms = 200);
+    void close();           // Flushes pending writes
+    bool is_open() const { return db_ != nullptr; }
+
+    // Queue a change (write-behind)
+    void enqueue(const SessionDelta& delta);
+
+    // Read a session; false if the store has no such key
+    bool load(const std::string& key, SessionRecord& out);
+
+    // Block until everything queued so far is committed
+    void flush();
+
+    // Delete sessions idle for longer than max_age_seconds
+    size_t prune(int64_t max_age_seconds);
+
+    // Stats
+    uint64_t batches_committed() const;
+    uint64_t deltas_committed() const;
+
+private:
+    SessionStore(const SessionStore&);
+    SessionStore& operator=(const SessionStore&);
+
+    void writer_loop();
+    bool apply(const SessionDelta& delta);
+    bool exec(const char* sql);
+
+    sqlite3* db_;
+    std::mutex db_mutex_;               // Writer batch vs. load/prune
+    int flush_interval_ms_;
+
+    mutable std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;      // Writer wakeup
+    std::condition_variable done_cv_;       // Commit notifications
+    std::deque<SessionDelta> queue_;
+    std::map<std::string, int> pending_;    // key -> queued + in-flight deltas
+    bool flush_requested_;
+    bool stop_;
+    uint64_t enqueued_;
+    uint64_t committed_;
+    uint64_t batches_;
+    std::thread writer_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_SESSION_STORE_HPP
@@ -0,0 +1,63 @@
+/*
+ * opencrank C++ - SQLite Prepared Statement
+ *
+ * A prepared statement that finalizes itself, for the stores that talk to
+ * SQLite directly (session store, response cache, polls). A failed
+ * prepare is logged with its query and leaves ok() false; steps on such a
+ * statement fail, so callers check ok() once and then bind and step.
+ */
+#ifndef opencrank_CORE_SQLITE_STMT_HPP
+#define opencrank_CORE_SQLITE_STMT_HPP
+
+#include "logger.hpp"
+#include <sqlite3.h>
+#include <string>
+#include <cstdint>
+
+namespace opencrank {
+
+class SqliteStatement {
+public:
+    SqliteStatement(sqlite3* db, const char* sql) : stmt_(NULL) {
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt_, NULL) != SQLITE_OK) {
+            LOG_ERROR("[SQLite] Prepare failed: %s\n  Query: %s", sqlite3_errmsg(db), sql);
+            stmt_ = NULL;
+        }
+    }
+    ~SqliteStatement() { if (stmt_) sqlite3_finalize(stmt_); }
+
+    bool ok() const { return stmt_ != NULL; }
+    sqlite3_stmt* get() { return stmt_; }
+
+    // Parameters are 1-based; values are copied
+    void bind(int i, const std::string& s) {
+        sqlite3_bind_text(stmt_, i, s.data(), static_cast<int>(s.size()), SQLITE_TRANSIENT);
+    }
+    void bind_blob(int i, const std::string& s) {
+        sqlite3_bind_blob(stmt_, i, s.data(), static_cast<int>(s.size()), SQLITE_TRANSIENT);
+    }
+    void bind(int i, int64_t v) { sqlite3_bind_int64(stmt_, i, v); }
+
+    // Step once: the statement finished / produced a row
+    bool done() { return sqlite3_step(stmt_) == SQLITE_DONE; }
+    bool row() { return sqlite3_step(stmt_) == SQLITE_ROW; }
+
+    // Columns of the current row, 0-based
+    std::string text(int col) {
+        const unsigned char* p = sqlite3_column_text(stmt_, col);
+        return p ? std::string(reinterpret_cast<const char*>(p),
+                               static_cast<size_t>(sqlite3_column_bytes(stmt_, col)))
+                 : std::string();
+    }
+    int64_t integer(int col) { return sqlite3_column_int64(stmt_, col); }
+
+private:
+    SqliteStatement(const SqliteStatement&);
+    SqliteStatement& operator=(const SqliteStatement&);
+
+    sqlite3_stmt* stmt_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_SQLITE_STMT_HPP
@@ -0,0 +1,67 @@
+/*
+ * opencrank C++ - Startup Profile
+ *
+ * Wall-clock timings of the startup phases (config load, plugin dlopen and
+ * init, channel start, ...) and of each plugin within them. Recording is
+ * cheap and always on; --profile-startup prints the table once the main
+ * loop is about to run. Phases that overlap (parallel plugin init, the
+ * background AI warmup) are listed with their own duration and start
+ * offset, so the table shows what the critical path was.
+ */
+#ifndef opencrank_CORE_STARTUP_PROFILE_HPP
+#define opencrank_CORE_STARTUP_PROFILE_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+namespace opencrank {
+
+class StartupProfile {
+public:
+    StartupProfile();
+
+    // Milliseconds since the profile was created
+    double elapsed_ms() const;
+
+    // Record a finished step (item empty for a whole phase)
+    void record(const std::string& phase, const std::string& item,
+                double start_ms, double duration_ms, bool ok = true);
+
+    // Times a step from construction to destruction
+    class Scope {
+    public:
+        Scope(StartupProfile* profile, const std::string& phase, const std::string& item = "");
+        ~Scope();
+        void set_ok(bool ok) { ok_ = ok; }
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+        StartupProfile* profile_;
+        std::string phase_;
+        std::string item_;
+        double start_ms_;
+        bool ok_;
+    };
+
+    // Table of every step in start order, with the total
+    std::string report() const;
+
+private:
+    struct Step {
+        std::string phase;
+        std::string item;
+        double start_ms;
+        double duration_ms;
+        bool ok;
+    };
+
+    std::chrono::steady_clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Step> steps_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_STARTUP_PROFILE_HPP
@@ -0,0 +1,70 @@
+/*
+ * opencrank C++ - Sub-agent Fan-out Tool
+ *
+ * spawn_subagents splits a task into independent prompts and runs each as
+ * its own agent run, concurrently on the thread pool. Every sub-agent has
+ * an isolated history under its own session key (agent:<id>:subagent:<n>)
+ * and the same tools, except that it cannot spawn sub-agents itself. The
+ * results come back to the calling run as one merged tool result, so ten
+ * independent lookups take about as long as the slowest one.
+ *
+ * The call waits on an AGENT worker, so it also runs sub-agents itself:
+ * whatever the pool has not started yet, it takes. A burst of fan-outs
+ * holding every AGENT slot still finishes, each on its own thread.
+ *
+ * Sub-agents share the caller's cancellation (/stop, hang detection), its
+ * shell process group key and its fair-share account. Their histories are
+ * not kept once the tool returns.
+ *
+ * Config (section "subagents"):
+ *   subagents.max_tasks      - Prompts per call (default: 8)
+ *   subagents.max_concurrent - Sub-agents running at once per call (default: 4)
+ *   subagents.max_iterations - Iterations per sub-agent (default: 8)
+ *   subagents.timeout        - Seconds before unfinished sub-agents are stopped (default: 300)
+ */
+#ifndef opencrank_CORE_SUBAGENT_TOOL_HPP
+#define opencrank_CORE_SUBAGENT_TOOL_HPP
+
+#include "tool.hpp"
+#include "agent.hpp"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class SubagentTool : public ToolProvider {
+public:
+    SubagentTool();
+
+    // Plugin interface
+    const char* name() const override { return "subagents"; }
+    const char* description() const override {
+        return "Run independent parts of a task as parallel sub-agents";
+    }
+    const char* version() const override { return "1.0.0"; }
+
+    bool init(const Config& cfg) override;
+    void shutdown() override;
+
+    // ToolProvider interface
+    const char* tool_id() const override { return "subagents"; }
+    std::vector<std::string> actions() const override;
+    ToolResult execute(const std::string& action, const Json& params) override;
+
+    std::vector<AgentTool> get_agent_tools() const override;
+
+private:
+    size_t max_tasks_;
+    size_t max_concurrent_;
+    int max_iterations_;
+    int timeout_secs_;
+    std::atomic<uint64_t> next_id_;     // Numbers sub-agent sessions
+
+    AgentToolResult do_spawn(const Json& params);
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_SUBAGENT_TOOL_HPP
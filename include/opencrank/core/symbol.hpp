@@ -0,0 +1,57 @@
+/*
+ * opencrank C++ - Interned Identifiers
+ *
+ * Process-wide table of the small strings every message is routed by:
+ * channel ids, chat ids, agent ids and the session keys built from them.
+ * Interning one gives a Symbol, a dense integer that compares, hashes and
+ * copies like one, so the per-message routing path (session key lookup,
+ * per-session executor queues) works on integers instead of building and
+ * comparing strings.
+ *
+ * Interned strings are never freed: the table grows with the number of
+ * distinct chats and sessions seen, which the session store keeps anyway.
+ * name() references stay valid for the life of the process.
+ */
+#ifndef opencrank_CORE_SYMBOL_HPP
+#define opencrank_CORE_SYMBOL_HPP
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+namespace opencrank {
+
+typedef uint32_t Symbol;    // 0 = the empty string
+
+class SymbolTable {
+public:
+    static SymbolTable& instance();
+
+    // The symbol for s, added on first use
+    Symbol intern(const std::string& s);
+
+    // The symbol for s, or 0 if s was never interned
+    Symbol find(const std::string& s) const;
+
+    const std::string& name(Symbol symbol) const;
+
+    size_t size() const;
+
+private:
+    SymbolTable();
+    SymbolTable(const SymbolTable&);
+    SymbolTable& operator=(const SymbolTable&);
+
+    mutable std::mutex mutex_;
+    std::deque<std::string> names_;                 // Indexed by Symbol; never moves
+    std::unordered_map<std::string, Symbol> ids_;
+};
+
+inline Symbol intern(const std::string& s) { return SymbolTable::instance().intern(s); }
+inline const std::string& symbol_name(Symbol symbol) { return SymbolTable::instance().name(symbol); }
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_SYMBOL_HPP
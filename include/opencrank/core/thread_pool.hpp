@@ -1,44 +1,151 @@
 /*
  * opencrank C++ - Thread Pool for Message Processing
+ *
+ * Work-stealing pool with per-worker deques and priority lanes:
+ *   INTERACTIVE - quick slash commands (/ping, /status, ...)
+ *   AGENT       - agentic loop runs (long, model-bound)
+ *   BACKGROUND  - cron firing and maintenance
+ *
+ * Workers always drain higher-priority lanes first (their own deque,
+ * then stealing from siblings). AGENT tasks can be capped below the
+ * worker count so interactive commands never queue behind a wall of
+ * 90-second agent runs.
  */
 #ifndef opencrank_CORE_THREAD_POOL_HPP
 #define opencrank_CORE_THREAD_POOL_HPP
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
+#include <memory>
+#include <utility>
 #include <atomic>
+#include <type_traits>
+#include <cstdint>
 
 namespace opencrank {
 
-// Simple thread pool for processing messages asynchronously
+class Histogram;
+
+// Scheduling lane for a task (lower value = higher priority)
+enum class TaskPriority {
+    INTERACTIVE = 0,
+    AGENT = 1,
+    BACKGROUND = 2
+};
+
+const char* task_priority_name(TaskPriority priority);
+
+// Move-only type-erased callable. Unlike std::function it never copies
+// the captured state, so lambdas holding a Message are moved exactly once.
+class Task {
+public:
+    Task() {}
+
+    template<typename F,
+             typename = typename std::enable_if<
+                 !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) : impl_(new Model<typename std::decay<F>::type>(std::forward<F>(f))) {}
+
+    Task(Task&&) = default;
+    Task& operator=(Task&&) = default;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    void operator()() { impl_->call(); }
+    explicit operator bool() const { return impl_ != nullptr; }
+
+private:
+    struct Concept {
+        virtual ~Concept() {}
+        virtual void call() = 0;
+    };
+
+    template<typename F>
+    struct Model : Concept {
+        explicit Model(F&& f) : fn(std::move(f)) {}
+        explicit Model(const F& f) : fn(f) {}
+        void call() { fn(); }
+        F fn;
+    };
+
+    std::unique_ptr<Concept> impl_;
+};
+
+// Pool sizing and lane limits
+struct ThreadPoolConfig {
+    size_t num_threads;        // Worker count (0 = hardware concurrency)
+    size_t max_agent_workers;  // Max workers running AGENT tasks at once (0 = num_threads - 1)
+
+    ThreadPoolConfig() : num_threads(8), max_agent_workers(0) {}
+};
+
+// Work-stealing thread pool for processing messages asynchronously
 class ThreadPool {
 public:
-    ThreadPool(size_t num_threads = 4);
+    explicit ThreadPool(size_t num_threads = 4);
+    explicit ThreadPool(const ThreadPoolConfig& config);
     ~ThreadPool();
-    
-    // Add a task to the queue
-    void enqueue(std::function<void()> task);
-    
+
+    // Add a task to the given lane. Tasks enqueued from a worker thread
+    // land on that worker's own deque; others are spread round-robin.
+    void enqueue(Task task, TaskPriority priority = TaskPriority::AGENT);
+
     // Get number of threads
     size_t size() const { return threads_.size(); }
-    
-    // Get number of pending tasks
+
+    // Get number of pending tasks (all lanes, or a single lane)
     size_t pending() const;
-    
-    // Shutdown the pool
+    size_t pending(TaskPriority priority) const;
+
+    // Number of tasks currently executing
+    size_t active() const { return active_.load(); }
+
+    // Effective cap on concurrent AGENT tasks
+    size_t max_agent_workers() const { return max_agent_workers_; }
+
+    // Shutdown the pool (drains queued tasks before joining)
     void shutdown();
 
 private:
-    void worker();
-    
+    static const size_t NUM_LANES = 3;
+
+    struct QueuedTask {
+        Task task;
+        int64_t enqueued_us;    // steady clock, for the queue wait metric
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<QueuedTask> lanes[NUM_LANES];
+    };
+
+    void start(size_t num_threads);
+    void worker(size_t index);
+
+    // Take a runnable task: own deque first, then steal from siblings
+    bool try_take(size_t index, Task& out, size_t& lane_out);
+    bool take_from(WorkerQueue& queue, size_t lane, bool steal, Task& out, int64_t& enqueued_us);
+
+    // True if some queued task may run now (called with idle_mutex_ held)
+    bool has_runnable() const;
+
+    void wake_one();
+    void wake_all();
+
     std::vector<std::thread> threads_;
-    std::queue<std::function<void()>> tasks_;
-    
-    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+
+    std::atomic<size_t> lane_pending_[NUM_LANES];
+    std::atomic<size_t> active_;
+    std::atomic<size_t> active_agent_;
+    std::atomic<size_t> next_queue_;
+    size_t max_agent_workers_;
+    Histogram* wait_seconds_[NUM_LANES];   // opencrank_pool_wait_seconds per lane
+
+    mutable std::mutex idle_mutex_;
     std::condition_variable condition_;
     std::atomic<bool> stop_;
 };
@@ -0,0 +1,128 @@
+/*
+ * opencrank C++ - Token Counters
+ *
+ * Pluggable token counting for context window accounting:
+ *   ApproxTokenCounter - single-pass heuristic that tokenizes words, digit
+ *                        groups, punctuation and multi-byte UTF-8 separately
+ *                        (much closer than chars / 4 for code and non-Latin text)
+ *   BpeTokenCounter    - byte-level BPE using a tiktoken-format rank file
+ *                        (e.g. cl100k_base.tiktoken), for OpenAI/Claude-family models
+ *   LlamaTokenCounter  - asks a llama.cpp server's /tokenize endpoint, so the
+ *                        count matches the loaded model exactly
+ *
+ * The BPE and llama.cpp counters fall back to the approximation when their
+ * vocabulary or server is unavailable. ContextManager memoizes per-message
+ * counts on ConversationMessage, so counters only see new text.
+ */
+#ifndef opencrank_CORE_TOKEN_COUNTER_HPP
+#define opencrank_CORE_TOKEN_COUNTER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <cstddef>
+
+namespace opencrank {
+
+class Config;
+
+// ============================================================================
+// TokenCounter interface
+// ============================================================================
+
+class TokenCounter {
+public:
+    TokenCounter();
+    virtual ~TokenCounter() {}
+
+    virtual const char* name() const = 0;
+
+    // Number of tokens the model would see for text
+    virtual size_t count(const std::string& text) const = 0;
+
+    // Unique per instance; tags memoized counts so a counter swap recounts
+    int id() const { return id_; }
+
+private:
+    int id_;
+};
+
+// ============================================================================
+// ApproxTokenCounter
+// ============================================================================
+
+class ApproxTokenCounter : public TokenCounter {
+public:
+    const char* name() const { return "approx"; }
+    size_t count(const std::string& text) const;
+};
+
+// ============================================================================
+// BpeTokenCounter
+// ============================================================================
+
+class BpeTokenCounter : public TokenCounter {
+public:
+    BpeTokenCounter() : loaded_(false) {}
+
+    // Load "<base64 token> <rank>" lines. Returns false if unreadable/empty.
+    bool load(const std::string& path);
+    bool loaded() const { return loaded_; }
+
+    const char* name() const { return loaded_ ? "bpe" : "approx"; }
+    size_t count(const std::string& text) const;
+
+private:
+    // Tokens for one pre-tokenized piece
+    size_t count_piece(const std::string& piece) const;
+
+    bool loaded_;
+    std::unordered_map<std::string, int> ranks_;
+    ApproxTokenCounter fallback_;
+
+    // Piece -> token count (words repeat a lot across a conversation)
+    mutable std::mutex cache_mutex_;
+    mutable std::unordered_map<std::string, size_t> piece_cache_;
+};
+
+// ============================================================================
+// LlamaTokenCounter
+// ============================================================================
+
+class LlamaTokenCounter : public TokenCounter {
+public:
+    LlamaTokenCounter(const std::string& server_url, const std::string& api_key);
+
+    const char* name() const { return "llamacpp"; }
+    size_t count(const std::string& text) const;
+
+private:
+    std::string url_;
+    std::string api_key_;
+    ApproxTokenCounter fallback_;
+
+    // Back off to the approximation for a while after a failed request
+    mutable std::mutex mutex_;
+    mutable long long retry_after_ms_;
+};
+
+// ============================================================================
+// Factory
+// ============================================================================
+
+// Build the counter named by "<section>.tokenizer":
+//   "approx" (default), "bpe" (needs "<section>.tokenizer_vocab"),
+//   "server" (llama.cpp /tokenize at server_url)
+std::shared_ptr<TokenCounter> create_token_counter(
+    const Config& cfg,
+    const std::string& section,
+    const std::string& default_kind,
+    const std::string& server_url = "",
+    const std::string& api_key = "");
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_TOKEN_COUNTER_HPP
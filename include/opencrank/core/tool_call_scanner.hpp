@@ -0,0 +1,162 @@
+/*
+ * opencrank C++ - Tool Call Scanner
+ *
+ * Finds {"tool": ..., "arguments": {...}} objects in model output in one
+ * forward pass. Text can be fed in pieces as it streams from the provider;
+ * each call is reported as soon as its closing brace arrives, so the agent
+ * can start a tool before generation finishes.
+ *
+ * A '{' opens a candidate when its first member is a key and a "tool" key
+ * follows within 200 bytes (the heuristic ReplyStreamFilter also uses).
+ * A candidate is checked in the same pass, and copied into a repaired buffer
+ * from the first spot that needs fixing (Json::parse reads well-formed
+ * calls straight from the text):
+ *   - whitespace outside strings is dropped
+ *   - trailing commas before '}' or ']' are dropped
+ *   - raw newlines, tabs and other control characters in strings are escaped
+ *   - unknown escapes ("C:\path") keep their backslash as a literal
+ *   - a quote inside a value that is not followed by , } or ] is taken as
+ *     part of the text ({"command": "echo "hi""})
+ * Code fences and prose around the objects are never copied.
+ *
+ * repair_json() runs the same repairs over a complete text, and also closes
+ * containers left open at the end (truncated output).
+ */
+#ifndef opencrank_CORE_TOOL_CALL_SCANNER_HPP
+#define opencrank_CORE_TOOL_CALL_SCANNER_HPP
+
+#include "json.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace opencrank {
+
+// ============================================================================
+// Parsed Tool Call
+// ============================================================================
+
+struct ParsedToolCall {
+    std::string tool_name;
+    Json params;
+    std::string raw_content;  // Raw JSON content of the tool call
+    size_t start_pos;       // Position in original text
+    size_t end_pos;         // End position in original text
+    bool valid;
+    std::string parse_error;
+
+    ParsedToolCall() : start_pos(0), end_pos(0), valid(false) {}
+};
+
+// Repair the first JSON object or array in text into out. False when text
+// holds no '{' or '['.
+bool repair_json(const std::string& text, std::string& out);
+
+// repair_json() + Json::parse; error holds the parser message on failure
+bool parse_json_tolerant(const std::string& text, Json& out, std::string& error);
+
+// Incremental repair of one JSON object or array, the state machine behind
+// both of the above. Also notes the value of a top-level "tool" key.
+class JsonRepairer {
+public:
+    enum Status {
+        NEED_MORE,      // Input used up (or a quote needs to see what follows)
+        DONE,           // The value closed; pos is just past it
+        NOT_JSON,       // An object whose first token is not a key
+        NO_TOOL         // tool_within bytes passed without a top-level "tool" key
+    };
+
+    JsonRepairer();
+
+    // Start on the '{' or '[' at text[at]. text must outlive the repairer
+    // (it may grow between calls to run)
+    void begin(const std::string& text, size_t at);
+
+    // Continue from pos. at_end: no more text will come. tool_within > 0
+    // gives up on objects that do not name a tool early enough.
+    Status run(const std::string& text, size_t& pos, bool at_end, size_t tool_within = 0);
+
+    // Append closers for containers still open (truncated input)
+    void close_open();
+
+    // The repaired text so far
+    void output(std::string& out) const;
+
+    // Json::parse over output(); error holds the parser message on failure
+    bool parse(Json& out, std::string& error) const;
+
+    size_t start() const { return start_; }
+    bool has_tool() const { return has_tool_; }
+    const std::string& tool_name() const { return tool_name_; }
+
+private:
+    enum Container { OBJECT, ARRAY };
+
+    // Until the first repair, out_ stays empty and the repaired text is
+    // src_[start_, end_): well-formed JSON is never copied
+    const std::string* src_;
+    size_t start_;
+    size_t end_;                // Scanned up to here
+    size_t comma_at_;           // Position of the pending comma in src_
+    bool clean_;
+    std::string out_;
+    std::vector<Container> stack_;
+    bool in_string_;
+    bool escape_;
+    bool string_is_key_;
+    bool expect_key_;
+    bool pending_comma_;
+    bool seen_token_;           // The top-level object has its first token
+    bool has_tool_;
+    bool tool_value_next_;      // The next top-level value names the tool
+    int capture_;               // 0 none, 1 top-level key, 2 value of "tool"
+    std::string key_;
+    std::string tool_name_;
+
+    Status scan(const std::string& text, size_t& pos, bool at_end, size_t tool_within);
+
+    // Start the repaired copy: src_[start_, at) as it was, then repairs
+    void dirty(size_t at);
+    void put(char c) { if (!clean_) out_ += c; }
+
+    // Whether the quote at text[i] ends the current string: 1 yes, 0 no,
+    // -1 cannot tell before more text arrives
+    int closes_string(const std::string& text, size_t i, bool at_end) const;
+};
+
+class ToolCallScanner {
+public:
+    ToolCallScanner();
+
+    // Append text and scan as far as it allows. Returns the number of calls
+    // completed by this piece.
+    size_t feed(const char* data, size_t len);
+    size_t feed(const std::string& text) { return feed(text.data(), text.size()); }
+
+    // End of input: settle what was waiting for more text, and rescan after
+    // a '{' that never closed (prose braces). Returns calls added.
+    size_t finish();
+
+    // Calls in order of appearance; positions index text()
+    const std::vector<ParsedToolCall>& calls() const { return calls_; }
+    std::vector<ParsedToolCall>& calls() { return calls_; }
+
+    // Everything fed so far
+    const std::string& text() const { return text_; }
+
+private:
+    std::string text_;
+    std::vector<ParsedToolCall> calls_;
+    size_t pos_;                // Next byte of text_ to scan
+    bool in_candidate_;
+    JsonRepairer candidate_;
+
+    // Scan from pos_ as far as the text allows; returns calls added
+    size_t scan(bool at_end);
+    // Turn the finished candidate into a call; false if it names no tool
+    bool add_call(size_t end);
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_TOOL_CALL_SCANNER_HPP
@@ -0,0 +1,111 @@
+/*
+ * opencrank C++ - Tool Result Memo
+ *
+ * Reuses the output of idempotent tool calls (tools with
+ * AgentTool::memo_store set: read, list_dir, memory_search, browser_fetch,
+ * ...) when the model repeats the exact call later on, as long as nothing
+ * the call reads was written since. A repeated call answers at once with
+ * the earlier output and a note that it came from the memo.
+ *
+ * Every entry belongs to a store ("files", "memory", "web", ...) and, for
+ * tools that name one, a path. A call to a tool that writes
+ * (AgentTool::writes_store) drops the entries of its store whose path
+ * overlaps the written one: equal, or one inside the other. A write
+ * without a path drops the whole store; tools with side effects that
+ * declare no store (shell, browser_request, ...) drop everything. Writes
+ * invalidate across all runs, so one session sees another one's writes.
+ *
+ * Entries belong to one run (scope "run") or are kept for later runs of
+ * the same session (scope "session"). Either way they expire after ttl_s,
+ * which also bounds changes made outside the agent, and are evicted LRU
+ * past max_bytes.
+ *
+ * Config (section "agent"):
+ *   agent.tool_memo        - "run" (default), "session" or "off"
+ *   agent.tool_memo_ttl_s  - Entry lifetime in seconds (default: 300)
+ *   agent.tool_memo_max_mb - Memory for memoized outputs (default: 32)
+ */
+#ifndef opencrank_CORE_TOOL_MEMO_HPP
+#define opencrank_CORE_TOOL_MEMO_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+namespace opencrank {
+
+class Counter;
+
+struct ToolMemoConfig {
+    enum Scope { OFF, RUN, SESSION };
+    Scope scope;
+    int64_t ttl_s;
+    size_t max_bytes;
+
+    ToolMemoConfig() : scope(RUN), ttl_s(300), max_bytes(32 * 1024 * 1024) {}
+};
+
+class ToolMemo {
+public:
+    // Store name of tools whose writes may touch anything
+    static const char* const ANY_STORE;
+
+    ToolMemo();
+
+    void configure(const ToolMemoConfig& config);
+    bool enabled() const;
+    bool per_session() const;
+
+    // scope: a run id or a session key; key: "tool:params"
+    bool lookup(const std::string& scope, const std::string& key,
+                std::string& output, int64_t& age_ms);
+
+    // Like lookup(), without taking the output or counting it
+    bool contains(const std::string& scope, const std::string& key) const;
+
+    void store(const std::string& scope, const std::string& key, const std::string& store,
+               const std::string& path, const std::string& output);
+
+    // Something wrote to store at path ("" = anywhere in it)
+    void invalidate(const std::string& store, const std::string& path);
+
+    // The run owning scope is over
+    void drop(const std::string& scope);
+
+    size_t entries() const;
+
+    // Workspace paths refer to the same place or one contains the other
+    static bool paths_overlap(const std::string& a, const std::string& b);
+
+private:
+    ToolMemo(const ToolMemo&);
+    ToolMemo& operator=(const ToolMemo&);
+
+    struct Entry {
+        std::string id;             // scope + '\n' + key
+        std::string scope;
+        std::string store;
+        std::string path;
+        std::string output;
+        int64_t stored_ms;
+    };
+    typedef std::list<Entry> Lru;
+
+    void remove_locked(Lru::iterator it);
+
+    ToolMemoConfig config_;
+    mutable std::mutex mutex_;
+    Lru lru_;                                       // Front = most recent
+    std::map<std::string, Lru::iterator> index_;
+    size_t bytes_;
+
+    Counter* hits_;
+    Counter* misses_;
+    Counter* invalidated_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_TOOL_MEMO_HPP
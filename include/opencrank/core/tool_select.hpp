@@ -0,0 +1,61 @@
+/*
+ * opencrank C++ - Tool Output Selectors
+ *
+ * Cut a large tool result down to the part the model asked for, before it
+ * is formatted into the conversation, so a 200 KB API response or build log
+ * costs the tokens of the few lines that matter on every later iteration.
+ *
+ * select_json() takes a jq / JSONPath style path:
+ *     $.items[0].name    .items[].id    .items[2:5]    ..price
+ *     .data["odd key"]   .items[*]{id,name}    .a, .b
+ *   A leading '$' is optional. [] and [*] expand arrays and objects, [a:b]
+ *   slices (negative indices count from the end), ..key finds the key at
+ *   any depth, and {k1,k2} keeps only those keys of each object. Commas
+ *   join the results of several paths.
+ *
+ * select_html() takes a CSS selector:
+ *     table.prices td    div#main > h2    a[href^="/docs"]    meta[name=description]@content
+ *   Type, #id, .class and [attr], [attr=v], [attr^=v], [attr$=v], [attr*=v]
+ *   compound selectors, with descendant and child (>) combinators and
+ *   comma-separated groups. Each match yields its visible text, or with a
+ *   trailing @attr, that attribute. Matches inside an earlier match are
+ *   part of its text and are not repeated.
+ *
+ * filter_lines() keeps the lines matching a regex (or not, with invert),
+ * then the first head and/or last tail of them.
+ *
+ * All three return false with error set when the expression is invalid or
+ * the document cannot be read as the expected type.
+ */
+#ifndef opencrank_CORE_TOOL_SELECT_HPP
+#define opencrank_CORE_TOOL_SELECT_HPP
+
+#include <string>
+#include <cstddef>
+
+namespace opencrank {
+
+// matches: number of values / elements / lines selected
+bool select_json(const std::string& document, const std::string& expr,
+                 std::string& out, size_t& matches, std::string& error);
+
+bool select_html(const std::string& document, const std::string& expr,
+                 std::string& out, size_t& matches, std::string& error);
+
+struct LineFilter {
+    std::string grep;       // ECMAScript regex; empty = every line
+    bool invert;            // Keep the lines that do not match
+    size_t head;            // First lines to keep (0 = no limit)
+    size_t tail;            // Last lines to keep (0 = no limit)
+
+    LineFilter() : invert(false), head(0), tail(0) {}
+    bool empty() const { return grep.empty() && head == 0 && tail == 0; }
+};
+
+// With both head and tail, the lines between them are replaced by a marker
+bool filter_lines(const std::string& text, const LineFilter& filter,
+                  std::string& out, size_t& matches, std::string& error);
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_TOOL_SELECT_HPP
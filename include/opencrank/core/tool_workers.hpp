@@ -0,0 +1,99 @@
+/*
+ * opencrank C++ - Tool Worker Pool
+ *
+ * Shell commands run in small helper processes instead of the gateway.
+ * Early in startup, while the gateway is still single-threaded, it forks a
+ * zygote that applies the Landlock sandbox to itself and then forks
+ * workers on request. Every worker is therefore already sandboxed and
+ * never carries the gateway's threads, plugins or connections.
+ *
+ * The gateway talks to the zygote and to each worker over SOCK_SEQPACKET
+ * Unix sockets (one JSON message per packet). A worker runs a command with
+ * ProcessRunner and writes its output into a memfd shared with the
+ * gateway, so only a small status message crosses the socket. While the
+ * command runs, the worker sends progress ticks; a cancel message kills
+ * the command.
+ *
+ * A worker that crashes or stops answering is killed and replaced; the
+ * call fails instead of taking the gateway down. With no zygote (disabled
+ * or fork failed) commands run through ProcessRunner in-process.
+ */
+#ifndef opencrank_CORE_TOOL_WORKERS_HPP
+#define opencrank_CORE_TOOL_WORKERS_HPP
+
+#include "process_runner.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace opencrank {
+
+class ToolWorkerPool {
+public:
+    static ToolWorkerPool& instance();
+
+    // Fork the zygote. Must be called before any thread is started.
+    // workers: processes kept for commands; output_bytes: shared memory
+    // per worker (caps the output of one command); sandbox: apply Landlock
+    // in the zygote.
+    bool start(int workers, size_t output_bytes, bool sandbox);
+
+    // Close every socket; workers and the zygote exit on EOF
+    void stop();
+
+    bool available() const { return zygote_sock_ >= 0; }
+
+    // Same contract as ProcessRunner::run_shell
+    ProcessResult run_shell(const std::string& command,
+                            const std::string& workdir,
+                            const ProcessLimits& limits,
+                            const std::string& cancel_key = "",
+                            ProcessRunner::OutputCallback on_output = ProcessRunner::OutputCallback());
+
+    // Cancel the commands running under cancel_key; returns how many
+    size_t cancel(const std::string& cancel_key);
+
+    // Stats
+    uint64_t commands() const { return commands_.load(); }
+    uint64_t crashes() const { return crashes_.load(); }
+
+private:
+    ToolWorkerPool();
+    ~ToolWorkerPool();
+    ToolWorkerPool(const ToolWorkerPool&);
+    ToolWorkerPool& operator=(const ToolWorkerPool&);
+
+    struct Worker {
+        pid_t pid;
+        int sock;
+        char* shm;
+        std::string cancel_key;     // Of the command running now
+    };
+
+    Worker* acquire();                  // Blocks until a worker is free
+    void release(Worker* w, bool healthy);
+    Worker* spawn_locked();             // Ask the zygote for a worker (mutex_ held)
+    void destroy(Worker* w);
+
+    int zygote_sock_;
+    size_t output_bytes_;
+    size_t target_;                     // Workers to keep
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Worker*> idle_;
+    std::multimap<std::string, Worker*> busy_;   // By cancel key
+    size_t live_;
+
+    std::atomic<uint64_t> commands_;
+    std::atomic<uint64_t> crashes_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_TOOL_WORKERS_HPP
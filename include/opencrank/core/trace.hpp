@@ -0,0 +1,180 @@
+/*
+ * opencrank C++ - Tracing
+ *
+ * Span timings for agent runs. Agent::run opens a Trace and makes it current
+ * on its thread; whatever runs underneath (the provider's chat(), context
+ * resume cycles, HTTP requests, tools) opens a ScopedSpan, which nests under
+ * the span open on that thread and carries attributes such as token counts.
+ * Outside a trace a ScopedSpan costs one thread-local read.
+ *
+ * Work handed to another thread takes a TraceContext (trace plus parent
+ * span) along and installs it there with TraceContextScope.
+ *
+ * Finished traces are kept in memory, the last few per session, for the
+ * /trace command, and can be written as Chrome trace-event JSON (opens in
+ * Perfetto or chrome://tracing; trace and span ids follow OpenTelemetry's
+ * 16- and 8-byte hex format).
+ *
+ * Spans measure wall time. A replay (see run_record.hpp) switches new
+ * traces to the CPU time of the thread that opened them, which is only
+ * meaningful while the whole run stays on that thread.
+ *
+ * Plugins compile this header as C++11.
+ */
+#ifndef opencrank_CORE_TRACE_HPP
+#define opencrank_CORE_TRACE_HPP
+
+#include "json.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+struct TraceSpan {
+    std::string name;
+    std::string category;       // agent, llm, tool, http, context, parse, format
+    uint32_t id;
+    uint32_t parent;            // 0 = top level
+    int64_t start_us;           // Since the trace started
+    int64_t duration_us;
+    uint32_t thread;            // Small per-trace thread number
+    Json attrs;
+
+    TraceSpan() : id(0), parent(0), start_us(0), duration_us(0), thread(0) {}
+};
+
+class Trace {
+public:
+    Trace(const std::string& name, const std::string& session_key);
+
+    const std::string& id() const { return id_; }
+    const std::string& name() const { return name_; }
+    const std::string& session_key() const { return session_key_; }
+    int64_t started_ms() const { return started_ms_; }     // Wall clock
+    int64_t duration_us() const;                            // Up to now while running
+
+    uint32_t next_span_id() { return next_span_.fetch_add(1); }
+    int64_t now_us() const;
+    uint32_t thread_number();
+    void add(const TraceSpan& span);
+    void finish();
+
+    std::vector<TraceSpan> spans() const;
+
+    // Chrome trace-event JSON: one complete ("X") event per span
+    Json to_chrome_json() const;
+
+    // Plain-text breakdown: time per category, per tool, slowest spans
+    std::string summary() const;
+
+private:
+    Trace(const Trace&);
+    Trace& operator=(const Trace&);
+
+    std::string id_;
+    std::string name_;
+    std::string session_key_;
+    int64_t started_ms_;
+    int64_t start_steady_us_;
+    int64_t finished_us_;               // -1 while running
+    bool cpu_clock_;                    // Thread CPU time instead of wall time
+    std::atomic<uint32_t> next_span_;
+
+    mutable std::mutex mutex_;
+    std::vector<TraceSpan> spans_;
+    std::vector<std::pair<uint64_t, uint32_t> > threads_;
+};
+
+// The trace and span new spans on a thread attach to
+struct TraceContext {
+    std::shared_ptr<Trace> trace;
+    uint32_t parent;
+
+    TraceContext() : parent(0) {}
+    bool active() const { return trace != nullptr; }
+
+    static TraceContext current();
+};
+
+// Makes ctx current on this thread, restoring the previous one on exit
+class TraceContextScope {
+public:
+    explicit TraceContextScope(const TraceContext& ctx);
+    ~TraceContextScope();
+
+private:
+    TraceContextScope(const TraceContextScope&);
+    TraceContextScope& operator=(const TraceContextScope&);
+
+    TraceContext saved_;
+};
+
+// Times the enclosing scope as a span of the current trace (if any)
+class ScopedSpan {
+public:
+    ScopedSpan(const std::string& name, const char* category);
+    ~ScopedSpan();
+
+    bool active() const { return trace_ != nullptr; }
+
+    template<typename T>
+    void set(const char* key, const T& value) {
+        if (trace_) attrs_[key] = value;
+    }
+
+private:
+    ScopedSpan(const ScopedSpan&);
+    ScopedSpan& operator=(const ScopedSpan&);
+
+    Trace* trace_;
+    TraceSpan span_;
+    uint32_t saved_parent_;
+    Json attrs_;
+};
+
+class Tracer {
+public:
+    static Tracer& instance();
+
+    // keep: finished traces kept per session (0 disables tracing);
+    // export_dir: write every finished trace there as JSON ("" = only on request)
+    void configure(size_t keep, const std::string& export_dir);
+
+    bool enabled() const { return keep_ > 0; }
+    const std::string& export_dir() const { return export_dir_; }
+
+    // Traces begun from now on time their spans in CPU time of the thread
+    // that began them (replays, which run on one thread)
+    void set_cpu_clock(bool on);
+
+    // New trace, or null when tracing is off
+    std::shared_ptr<Trace> begin(const std::string& name, const std::string& session_key);
+
+    // Keep a finished trace (and export it when configured)
+    void finish(const std::shared_ptr<Trace>& trace);
+
+    // Most recent finished trace of a session ("" = of any session)
+    std::shared_ptr<Trace> last(const std::string& session_key) const;
+
+    // Write trace to dir/trace-<id>.json; returns the path ("" on failure)
+    static std::string write(const Trace& trace, const std::string& dir);
+
+private:
+    Tracer();
+    Tracer(const Tracer&);
+    Tracer& operator=(const Tracer&);
+
+    size_t keep_;
+    std::string export_dir_;
+    mutable std::mutex mutex_;
+    std::deque<std::shared_ptr<Trace> > finished_;     // Oldest first
+};
+
+} // namespace opencrank
+
+#endif // opencrank_CORE_TRACE_HPP
@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <memory>
 #include <cstdint>
 #include <ctime>
 
@@ -14,6 +15,7 @@ namespace opencrank {
 struct Message {
     std::string id;              // Unique message ID
     std::string channel;         // Channel name (telegram, discord, etc.)
+    std::string account_id;      // Receiving account of a multi-account channel ("" = default)
     std::string from;            // Sender identifier
     std::string from_name;       // Human-readable sender name
     std::string to;              // Recipient/chat identifier
@@ -26,6 +28,10 @@ struct Message {
     Message() : timestamp(0) {}
 };
 
+// Messages are immutable once received: the ingress path shares one copy
+// between the executor queue, the handler and the reply
+typedef std::shared_ptr<const Message> MessagePtr;
+
 // Result of sending a message
 struct SendResult {
     bool success;
@@ -58,6 +64,9 @@ struct ChannelCapabilities {
     bool supports_delete;
     bool supports_threads;
     bool supports_typing;
+    bool async_sends;                   // send_message_async() queues and returns at once
+    int max_sends_per_second;           // Outbound shaping per channel (0 = unlimited)
+    int min_chat_send_interval_ms;      // Minimum gap between sends to one chat
     
     ChannelCapabilities() 
         : supports_groups(false)
@@ -66,7 +75,10 @@ struct ChannelCapabilities {
         , supports_edit(false)
         , supports_delete(false)
         , supports_threads(false)
-        , supports_typing(false) {}
+        , supports_typing(false)
+        , async_sends(false)
+        , max_sends_per_second(0)
+        , min_chat_send_interval_ms(0) {}
 };
 
 // Channel status
@@ -29,6 +29,18 @@ int64_t current_timestamp();
 // Get current Unix timestamp in milliseconds
 int64_t current_timestamp_ms();
 
+// Monotonic clock for measuring durations (arbitrary epoch, never manual)
+int64_t steady_us();
+int64_t steady_ms();
+
+// Deterministic clock for replays: from set_manual_clock() on,
+// current_timestamp_ms() returns the manual time, which only moves
+// through advance_manual_clock(). clear_manual_clock() goes back to
+// the real clock.
+void set_manual_clock(int64_t start_ms);
+void advance_manual_clock(int64_t ms);
+void clear_manual_clock();
+
 // Format timestamp as ISO 8601 string (YYYY-MM-DDTHH:MM:SSZ)
 std::string format_timestamp(int64_t timestamp);
 
@@ -61,10 +73,23 @@ std::string join(const std::vector<std::string>& parts, const std::string& delim
 // Truncate string safely (UTF-8 aware, doesn't break multi-byte chars)
 std::string truncate_safe(const std::string& s, size_t max_len);
 
+// Largest length <= max_len that doesn't split a multi-byte char
+size_t utf8_safe_cut(const char* s, size_t len, size_t max_len);
+
 // Sanitize a string for safe JSON serialization
-// Replaces invalid UTF-8 sequences and problematic control characters
+// Replaces invalid UTF-8 sequences and problematic control characters.
+// Valid text is scanned 16 bytes at a time (SSE2/NEON) and copied whole.
 std::string sanitize_utf8(const std::string& s);
 
+// sanitize_utf8() written into out (its capacity is reused)
+void sanitize_utf8_into(const char* s, size_t n, std::string& out);
+
+// Sanitize s itself; leaves it untouched (no copy) when already clean
+void sanitize_utf8_in_place(std::string& s);
+
+// True when sanitize_utf8() would return the input unchanged
+bool utf8_is_clean(const char* s, size_t n);
+
 // ============ Phone number utilities ============
 
 // ============ Path utilities ============
@@ -98,6 +123,19 @@ std::string generate_uuid();
 
 // ============ Hashing utilities ============
 
+// 64-bit FNV-1a; cheap content fingerprint (not cryptographic)
+uint64_t fnv1a_64(const std::string& data);
+
+// SHA-256 as 64 lowercase hex digits; for keys that persist
+std::string sha256_hex(const std::string& data);
+
+// ============ Regex utilities ============
+
+// Longest literal every match of an (ECMAScript) pattern must contain;
+// empty when none of at least 3 characters can be proven. Used to reject
+// texts with memmem before running the regex.
+std::string regex_required_literal(const std::string& pattern);
+
 } // namespace opencrank
 
 #endif // opencrank_CORE_UTILS_HPP
@@ -0,0 +1,97 @@
+/*
+ * opencrank C++ - Memory Embeddings
+ *
+ * Optional semantic side of memory search:
+ *   EmbeddingClient - fetches embeddings from an OpenAI-compatible
+ *                     /v1/embeddings endpoint or llama.cpp's /embedding
+ *   VectorIndex     - in-memory, contiguous matrix of unit vectors searched
+ *                     with a brute-force SIMD dot product (memory stores are
+ *                     small enough that an exact scan beats building a graph)
+ *
+ * Vectors are persisted by MemoryStore as float16 blobs.
+ */
+#ifndef opencrank_MEMORY_EMBEDDINGS_HPP
+#define opencrank_MEMORY_EMBEDDINGS_HPP
+
+#include "types.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace opencrank {
+
+// ============================================================================
+// Vector helpers
+// ============================================================================
+
+// IEEE 754 half precision conversion
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+// Pack a vector as little-endian float16 (2 bytes per dimension)
+std::string encode_embedding(const std::vector<float>& vec);
+std::vector<float> decode_embedding(const void* data, size_t bytes);
+
+// Dot product (SSE when available)
+float dot_product(const float* a, const float* b, size_t n);
+
+// Scale to unit length so dot product == cosine similarity
+void normalize_vector(std::vector<float>& vec);
+
+// ============================================================================
+// EmbeddingClient
+// ============================================================================
+
+class EmbeddingClient {
+public:
+    EmbeddingClient() {}
+
+    void configure(const EmbeddingConfig& config) { config_ = config; }
+    bool enabled() const { return config_.enabled && !config_.url.empty(); }
+
+    // Identifies the vector space; rows embedded with another model are ignored
+    std::string model_tag() const;
+
+    // Embed one text. Returns false (and sets error) on failure.
+    bool embed(const std::string& text, std::vector<float>& out, std::string* error = nullptr) const;
+
+private:
+    EmbeddingConfig config_;
+};
+
+// ============================================================================
+// VectorIndex
+// ============================================================================
+
+class VectorIndex {
+public:
+    VectorIndex() : dim_(0) {}
+
+    void clear();
+
+    // Insert or replace (vector is normalized; wrong dimension is rejected)
+    bool upsert(const std::string& id, std::vector<float> vec);
+    void remove(const std::string& id);
+
+    size_t size() const;
+    size_t dim() const;
+
+    // Top-k ids by cosine similarity, best first, at or above min_similarity
+    std::vector<std::pair<std::string, float>> search(
+        std::vector<float> query, size_t k, float min_similarity = 0.0f) const;
+
+private:
+    mutable std::mutex mutex_;
+    size_t dim_;
+    std::vector<float> data_;               // Row-major, ids_.size() x dim_
+    std::vector<std::string> ids_;
+    std::map<std::string, size_t> slots_;   // id -> row
+};
+
+} // namespace opencrank
+
+#endif // opencrank_MEMORY_EMBEDDINGS_HPP
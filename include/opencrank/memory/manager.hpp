@@ -4,14 +4,36 @@
  * High-level memory management coordinating the storage backend.
  * Provides a clean interface for saving, searching, and managing
  * memories and tasks through the SQLite store.
+ *
+ * When embeddings are configured, search() fuses BM25 keyword hits with
+ * vector similarity hits (weighted reciprocal rank fusion), so paraphrased
+ * queries still find relevant memories.
+ *
+ * Sharding (memory.shard_by = "user" or "channel"): memories live in one
+ * SQLite file per user ("channel:sender") or per channel under
+ * memory.shard_dir, so a search scans only that owner's FTS index and
+ * each shard has its own writer. The owner is the one installed on the
+ * calling thread with ShardScope; without one, the main database is used.
+ * Shards open on first use and at most memory.shard_cache stay open
+ * (least recently used closes first). Tasks stay in the main database,
+ * where the CRON scheduler sees them all. The vector index is global and
+ * therefore off while sharding: search is BM25 per shard.
  */
 #ifndef opencrank_MEMORY_MANAGER_HPP
 #define opencrank_MEMORY_MANAGER_HPP
 
 #include "store.hpp"
 #include "types.hpp"
+#include "embeddings.hpp"
 #include <string>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <list>
 
 namespace opencrank {
 
@@ -24,6 +46,18 @@ class Config;
 
 class MemoryManager {
 public:
+    // Memory calls on this thread use the shard of user_key
+    // ("channel:sender") while the scope lives
+    class ShardScope {
+    public:
+        explicit ShardScope(const std::string& user_key);
+        ~ShardScope();
+    private:
+        ShardScope(const ShardScope&);
+        ShardScope& operator=(const ShardScope&);
+        std::string saved_;
+    };
+    
     MemoryManager();
     ~MemoryManager();
     
@@ -50,7 +84,11 @@ public:
                             const std::string& channel = "",
                             const std::string& user_id = "");
     
-    // Search memories using BM25 full-text search
+    // Save several entries in one transaction (all or none)
+    // Returns how many were saved
+    size_t save_memories(const std::vector<MemoryEntry>& entries);
+    
+    // Search memories (BM25, fused with vector similarity when enabled)
     std::vector<MemorySearchHit> search(const std::string& query,
                                          int max_results = 10,
                                          const std::string& category = "");
@@ -78,6 +116,10 @@ public:
                             const std::string& channel = "",
                             const std::string& user_id = "");
     
+    // Create several tasks in one transaction (all or none)
+    // Returns how many were created
+    size_t create_tasks(const std::vector<MemoryTask>& tasks);
+    
     // List tasks
     std::vector<MemoryTask> list_tasks(bool include_completed = false,
                                         const std::string& channel = "");
@@ -94,6 +136,18 @@ public:
     // Get overdue tasks
     std::vector<MemoryTask> get_due_tasks();
     
+    // Called after a task is created, completed or deleted (e.g. so the
+    // CRON scheduler can recompute its deadlines)
+    void set_task_listener(std::function<void()> listener) { task_listener_ = listener; }
+    
+    // ========================================================================
+    // Maintenance
+    // ========================================================================
+    
+    // Compact and checkpoint the database (config().maintenance) and log
+    // the report
+    bool run_maintenance(MaintenanceReport& report);
+    
     // ========================================================================
     // Access
     // ========================================================================
@@ -101,11 +155,63 @@ public:
     MemoryStore& store() { return store_; }
     const MemoryStore& store() const { return store_; }
     const MemoryConfig& config() const { return config_; }
+    
+    // Number of memories in the vector index
+    size_t indexed_vectors() const { return vectors_.size(); }
+    
+    bool sharded() const { return !config_.shard_by.empty(); }
+    
+    // Shard databases currently open
+    size_t open_shards() const;
+    
+    // Bumped by every save and delete: search results may have changed
+    uint64_t revision() const { return revision_.load(); }
 
 private:
     MemoryStore store_;
     MemoryConfig config_;
     bool initialized_;
+    std::atomic<uint64_t> revision_;
+    
+    // Shards: file stem -> open store, most recently used first
+    struct Shard {
+        std::shared_ptr<MemoryStore> store;
+        std::list<std::string>::iterator lru;
+    };
+    mutable std::mutex shards_mutex_;
+    std::map<std::string, Shard> shards_;
+    std::list<std::string> shard_lru_;
+    std::string shard_dir_;
+    
+    // Store holding the memories of the current ShardScope
+    std::shared_ptr<MemoryStore> memories();
+    
+    // Open (or reuse) the shard stored as <shard_dir>/<stem>.db
+    std::shared_ptr<MemoryStore> shard(const std::string& stem);
+    
+    // File stem of a user key's shard ("" = main database)
+    std::string shard_stem(const std::string& user_key) const;
+    
+    // Semantic index
+    EmbeddingClient embedder_;
+    VectorIndex vectors_;
+    std::string embed_model_;
+    std::thread backfill_thread_;
+    std::atomic<bool> stop_backfill_;
+    
+    std::function<void()> task_listener_;
+    void notify_tasks_changed() { if (task_listener_) task_listener_(); }
+    
+    // Embed content and store/index it under id (best effort)
+    bool index_memory(const std::string& id, const std::string& content);
+    
+    // Load stored vectors, then embed memories saved before embeddings were on
+    void load_vectors();
+    void backfill_vectors();
+    
+    // Weighted reciprocal rank fusion of BM25 and vector results
+    std::vector<MemorySearchHit> hybrid_search(const std::string& query, int limit,
+                                               const std::string& category);
 };
 
 } // namespace opencrank
@@ -6,6 +6,25 @@
  * BM25 full-text search via SQLite FTS5.
  * 
  * All operations are database read/write - no file I/O.
+ *
+ * Concurrency model (WAL mode):
+ *   - Each calling thread gets its own read-only connection, so concurrent
+ *     searches from parallel agent runs never serialize on one handle.
+ *   - All writes go through a single writer connection owned by a writer
+ *     thread. Queued writes are group-committed in one transaction, each
+ *     isolated by a savepoint so one failure doesn't undo its neighbours.
+ *     The writer lingers a few milliseconds (memory.write_linger_ms) after
+ *     the first queued write so concurrent saves share one commit.
+ *   - Bulk writes (save_memories, create_tasks) are one job: all rows
+ *     commit together or none do.
+ *   - Every connection keeps a prepared-statement cache keyed by SQL text.
+ *
+ * Maintenance (run_maintenance, scheduled by the application's CRON
+ * thread): merges the FTS5 segments that trigger-driven updates pile up,
+ * refreshes the planner statistics with ANALYZE, returns free pages with
+ * an incremental vacuum (databases created with auto_vacuum=INCREMENTAL)
+ * and truncates the WAL once it outgrows a threshold. It runs as a writer
+ * job of its own, outside any group commit.
  */
 #ifndef opencrank_MEMORY_STORE_HPP
 #define opencrank_MEMORY_STORE_HPP
@@ -14,6 +33,13 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <functional>
 
 // Forward declaration for sqlite3
 struct sqlite3;
@@ -45,6 +71,26 @@ struct MemorySearchHit {
     MemorySearchHit() : score(0.0) {}
 };
 
+// What a maintenance run did and what it changed
+struct MaintenanceReport {
+    int64_t db_bytes_before;
+    int64_t db_bytes_after;
+    int64_t wal_bytes_before;
+    int64_t wal_bytes_after;
+    double probe_ms_before;         // Average search latency (-1 = not probed)
+    double probe_ms_after;
+    bool fts_optimized;
+    bool analyzed;
+    bool checkpointed;
+    int64_t pages_vacuumed;
+    double elapsed_ms;
+    
+    MaintenanceReport()
+        : db_bytes_before(0), db_bytes_after(0), wal_bytes_before(0), wal_bytes_after(0)
+        , probe_ms_before(-1), probe_ms_after(-1), fts_optimized(false), analyzed(false)
+        , checkpointed(false), pages_vacuumed(0), elapsed_ms(0) {}
+};
+
 // ============================================================================
 // MemoryStore - SQLite Storage Backend
 // ============================================================================
@@ -57,14 +103,23 @@ public:
     // Open/close the database
     bool open(const std::string& db_path);
     void close();
-    bool is_open() const { return db_ != nullptr; }
+    bool is_open() const { return writer_ != nullptr; }
+    
+    // How long the writer waits for more writes before committing a batch
+    // (0 = commit as soon as one is queued)
+    void set_write_linger(int ms) { write_linger_ms_ = ms < 0 ? 0 : ms; }
     
     // ========================================================================
     // Memory Operations (database read/write)
     // ========================================================================
     
-    // Save a memory entry (insert or update by id)
-    bool save_memory(const MemoryEntry& entry);
+    // Save a memory entry (insert or update by id); id_out gets the stored id
+    bool save_memory(const MemoryEntry& entry, std::string* id_out = nullptr);
+    
+    // Save several entries in one transaction (all or none); ids_out gets
+    // the stored ids in order
+    bool save_memories(const std::vector<MemoryEntry>& entries,
+                       std::vector<std::string>* ids_out = nullptr);
     
     // Search memories using BM25 full-text search
     std::vector<MemorySearchHit> search_memories(
@@ -85,6 +140,21 @@ public:
     // Delete a memory by ID
     bool delete_memory(const std::string& id);
     
+    // ========================================================================
+    // Embedding Operations (float16 blobs keyed by memory id)
+    // ========================================================================
+    
+    // Store the embedding of a memory computed with the given model
+    bool save_embedding(const std::string& memory_id, const std::string& model,
+                        const std::string& blob, int dim);
+    
+    // Visit every stored embedding for a model
+    void for_each_embedding(const std::string& model,
+        const std::function<void(const std::string& id, const void* blob, size_t bytes)>& fn);
+    
+    // Memories that have no embedding for the given model yet
+    std::vector<MemoryEntry> get_memories_without_embedding(const std::string& model, int limit);
+    
     // ========================================================================
     // Task Operations (database read/write)
     // ========================================================================
@@ -92,6 +162,10 @@ public:
     // Create a new task
     bool create_task(const MemoryTask& task);
     
+    // Create several tasks in one transaction (all or none)
+    bool create_tasks(const std::vector<MemoryTask>& tasks,
+                      std::vector<std::string>* ids_out = nullptr);
+    
     // List tasks (optionally filter by completed status)
     std::vector<MemoryTask> list_tasks(
         bool include_completed = false,
@@ -109,24 +183,73 @@ public:
     
     // Get tasks that are due (due_at <= now and not completed)
     std::vector<MemoryTask> get_due_tasks();
+    
+    // ========================================================================
+    // Maintenance
+    // ========================================================================
+    
+    // Optimize the FTS index, ANALYZE, vacuum and checkpoint (see above);
+    // false when a step failed (the report still covers the others)
+    bool run_maintenance(const MaintenanceConfig& options, MaintenanceReport& report);
 
 private:
-    sqlite3* db_;
+    // sqlite3 handle plus its statement cache (defined in store.cpp)
+    struct Connection;
+    struct WriteJob;
+
+    typedef std::function<bool(Connection&)> DbFn;
+
+    std::string db_path_;
+    std::unique_ptr<Connection> writer_;
+
+    // Read connections, one per calling thread
+    std::mutex readers_mutex_;
+    std::map<std::thread::id, std::unique_ptr<Connection>> readers_;
+    bool readers_enabled_;
+
+    // Writer queue
+    std::mutex write_mutex_;
+    std::condition_variable write_cv_;
+    std::deque<std::shared_ptr<WriteJob>> write_queue_;
+    std::thread writer_thread_;
+    bool writer_stop_;
+    int write_linger_ms_;
     
     // Initialize database tables and FTS index
     bool init_tables();
     
+    // Run fn on this thread's read connection (falls back to the writer)
+    bool with_reader(const DbFn& fn);
+    
+    // Queue fn for the writer thread and wait for its result. An exclusive
+    // job runs alone, outside a transaction (checkpoints, VACUUM).
+    bool submit_write(const DbFn& fn, bool exclusive = false);
+    
+    // Writer thread: drain the queue in group-committed batches
+    void writer_loop();
+    void run_write_batch(std::vector<std::shared_ptr<WriteJob>>& batch);
+    
+    // Run fn inside a savepoint on the writer connection; rolled back
+    // unless fn returns true
+    static bool atomically(Connection& conn, const std::function<bool()>& fn);
+    
     // Helper: execute a simple SQL statement
-    bool exec_sql(const std::string& sql);
+    static bool exec_sql(sqlite3* db, const std::string& sql);
     
     // Helper: generate a UUID
     static std::string generate_uuid();
     
+    // Helper: bytes of the database file and its WAL
+    void file_sizes(int64_t& db_bytes, int64_t& wal_bytes) const;
+    
+    // Helper: average time of a search for query (-1 without a query)
+    double probe_search_ms(const std::string& query);
+    
     // Helper: current time in milliseconds
     static int64_t now_ms();
     
-    // Helper: bind and step a prepared statement
-    bool bind_and_step(sqlite3_stmt* stmt);
+    // Helper: step a cached statement that returns no rows
+    static bool step_done(sqlite3_stmt* stmt);
 };
 
 } // namespace opencrank
@@ -155,13 +155,31 @@ struct MemorySearchConfig {
     MemorySearchConfig() 
         : max_results(10)
         , min_score(0.1)
-        , hybrid_enabled(false)  // Vector search not implemented yet
+        , hybrid_enabled(false)  // Enabled when embeddings are configured
         , bm25_weight(1.0)
-        , vector_weight(0.0)
+        , vector_weight(1.0)
         , citation_mode(MemoryCitationMode::AUTO)
     {}
 };
 
+// Embedding endpoint for semantic memory search
+struct EmbeddingConfig {
+    bool enabled;           // Compute and index embeddings
+    std::string url;        // Server base URL (e.g. http://localhost:8080)
+    std::string api;        // "openai" (/v1/embeddings) or "llamacpp" (/embedding)
+    std::string model;      // Model name sent to the server (may be empty)
+    std::string api_key;    // Bearer token (optional)
+    double min_similarity;  // Cosine cutoff for vector hits
+    int timeout_ms;         // Per-request timeout
+    
+    EmbeddingConfig()
+        : enabled(false)
+        , api("openai")
+        , min_similarity(0.3)
+        , timeout_ms(15000)
+    {}
+};
+
 // Session sync configuration
 struct SessionSyncConfig {
     int delta_bytes;        // Trigger sync after this many new bytes
@@ -177,6 +195,23 @@ struct SessionSyncConfig {
     {}
 };
 
+// Database maintenance, run on the CRON thread's schedule
+struct MaintenanceConfig {
+    bool enabled;
+    std::string cron;               // When to run (five-field expression)
+    int64_t checkpoint_wal_bytes;   // Truncate the WAL once larger (0 = always)
+    int vacuum_pages;               // Free pages returned per run (0 = none)
+    std::string probe_query;        // Search timed before and after ("" = a
+                                    // word from the newest memory)
+    
+    MaintenanceConfig()
+        : enabled(true)
+        , cron("17 4 * * *")
+        , checkpoint_wal_bytes(4 * 1024 * 1024)
+        , vacuum_pages(1000)
+    {}
+};
+
 // Overall memory configuration
 struct MemoryConfig {
     std::string workspace_dir;      // Agent workspace directory
@@ -185,16 +220,24 @@ struct MemoryConfig {
     ChunkingConfig chunking;
     MemorySearchConfig search;
     SessionSyncConfig session_sync;
+    EmbeddingConfig embeddings;
+    MaintenanceConfig maintenance;
     std::vector<std::string> sources;  // "memory", "sessions"
     std::vector<std::string> extra_paths; // Additional memory paths
     bool watch_enabled;             // Watch files for changes
     int sync_interval_minutes;      // Auto-sync interval (0 = disabled)
     int watch_debounce_ms;          // Debounce time for file watch
+    int write_linger_ms;            // Group-commit window of the writer
+    std::string shard_by;           // "" (one database), "user" or "channel"
+    std::string shard_dir;          // Shard files ("" = memory/ next to db_path)
+    int shard_cache;                // Shard databases kept open
     
     MemoryConfig() 
         : watch_enabled(false)
         , sync_interval_minutes(0)
         , watch_debounce_ms(1500)
+        , write_linger_ms(2)
+        , shard_cache(32)
     {
         sources.push_back("memory");
     }
@@ -7,6 +7,9 @@
  * Config:
  *   ai.api_key    - Your Anthropic API key
  *   ai.model      - Default model (optional, defaults to claude-sonnet-4-20250514)
+ *   claude.native_tools - Offer tools as Messages API tools (default: true)
+ *   claude.max_retries, retry_base_ms, retry_max_ms, rate_limit_rpm -
+ *                   429/529 handling and pacing (see ai/rate_pacer.hpp)
  */
 #ifndef opencrank_PLUGINS_CLAUDE_HPP
 #define opencrank_PLUGINS_CLAUDE_HPP
@@ -20,6 +23,8 @@
 
 namespace opencrank {
 
+class RatePacer;
+
 class ClaudeAI : public AIPlugin {
 public:
     ClaudeAI();
@@ -38,6 +43,7 @@ public:
     std::vector<std::string> available_models() const;
     std::string default_model() const;
     bool is_configured() const;
+    bool supports_native_tools() const;
     
     // Single prompt completion
     CompletionResult complete(
@@ -66,7 +72,9 @@ private:
     std::string default_model_;
     std::string api_url_;
     std::string api_version_;
+    bool native_tools_;
     bool initialized_;
+    RatePacer* pacer_;          // Shared by every request with api_key_
 };
 
 } // namespace opencrank
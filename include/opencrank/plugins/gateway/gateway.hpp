@@ -9,12 +9,17 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <atomic>
+#include <mutex>
+#include <memory>
 
 namespace opencrank {
 
 // Forward declarations
 class WebSocketServer;
 class GatewayClient;
+struct GatewayOutbox;
+struct GatewayUiAsset;
 
 // Gateway Server Plugin
 // Implements a WebSocket-based gateway for remote agent control
@@ -34,6 +39,7 @@ public:
     virtual bool init(const Config& cfg);
     virtual void shutdown();
     virtual void poll();  // Poll WebSocket server
+    virtual bool attach_reactor(Reactor& reactor);  // Starts the server
     
     // ChannelPlugin interface
     virtual const char* channel_id() const { return "gateway"; }
@@ -44,6 +50,8 @@ public:
     virtual SendResult send_message(const std::string& to, const std::string& text);
     virtual SendResult send_message(const std::string& to, const std::string& text, const std::string& reply_to);
     virtual SendResult send_typing_action(const std::string& to);
+    virtual SendResult edit_message(const std::string& to, const std::string& message_id,
+                                    const std::string& text);
     
     // Receive all incoming messages for routing to gateway clients
     virtual void on_incoming_message(const Message& msg) override;
@@ -59,9 +67,23 @@ public:
     size_t client_count() const;
     const std::string& index_filename() const { return index_filename_; }
     
-    // Broadcast events to all connected clients
+    // Control UI page with its gzip copy and ETags, reloaded when the file
+    // changes (checked at most once a second). NULL if it cannot be read
+    std::shared_ptr<const GatewayUiAsset> ui_asset();
+    
+    // /metrics: enabled by gateway.metrics; with an auth token configured the
+    // scraper must send it as "Authorization: Bearer <token>"
+    bool metrics_enabled() const { return metrics_enabled_; }
+    bool metrics_authorized(const std::string& authorization) const;
+    
+    // Broadcast events to all connected (authenticated) clients
     void broadcast(const std::string& event, const Json& payload);
     
+    // Send an event to the clients subscribed to topic ("<channel>:<chat_id>").
+    // A queued event with the same non-empty coalesce_key is replaced in place.
+    void publish(const std::string& topic, const std::string& event,
+                 const Json& payload, const std::string& coalesce_key = "");
+    
     // Send typing indicator event
     void send_typing_event(const std::string& channel_id, 
                           const std::string& chat_id, 
@@ -73,7 +95,7 @@ public:
     // Protocol handlers (public for WebSocketServer callback)
     void handle_client_connect(GatewayClient* client);
     void handle_client_disconnect(GatewayClient* client);
-    void handle_client_message(GatewayClient* client, const std::string& msg);
+    void handle_client_message(GatewayClient* client, const std::string& msg, bool binary = false);
     
 private:
     bool running_;
@@ -81,15 +103,35 @@ private:
     std::string bind_host_;
     std::string auth_token_;
     std::string index_filename_;
+    std::shared_ptr<const GatewayUiAsset> ui_asset_;
+    int64_t ui_checked_ms_;
+    std::mutex ui_mutex_;
+    bool metrics_enabled_;
     
     // WebSocket server (implementation in .cpp)
     WebSocketServer* ws_server_;
     
-    // Connected clients
+    // Connected clients (Crow threads connect/disconnect, any thread publishes)
     std::set<GatewayClient*> clients_;
+    mutable std::mutex clients_mutex_;
+    
+    // Per-client outbound queue bounds
+    size_t queue_max_messages_;
+    size_t queue_max_bytes_;
     
-    // Track most recent active chat for routing outgoing messages
-    std::string recent_chat_id_;
+    // Wire formats offered in hello; frames below compress_min_bytes_ go
+    // uncompressed
+    bool allow_binary_;
+    bool allow_compression_;
+    size_t compress_min_bytes_;
+    
+    // Serialize an event once and queue it on the matching clients
+    void deliver(const std::string* topic, const std::string& event,
+                 const Json& payload, const std::string& coalesce_key);
+    
+    // Outgoing message ids (clients match edits to rendered messages)
+    std::atomic<uint64_t> next_message_id_;
+    std::string make_message_id();
     
     // Gateway protocol methods
     Json handle_hello(GatewayClient* client, const Json& params);
@@ -97,8 +139,14 @@ private:
     Json handle_config_get(GatewayClient* client, const Json& params);
     Json handle_health_get(GatewayClient* client, const Json& params);
     Json handle_models_list(GatewayClient* client, const Json& params);
+    Json handle_subscribe(GatewayClient* client, const Json& params, bool subscribe);
 };
 
+// Wire encoding negotiated in hello. JSON text frames are the default; the
+// other formats use binary frames of one flag byte (GatewayClient::FRAME_*)
+// followed by the body, raw-deflated when the flag says so.
+enum class GatewayEncoding { JSON = 0, MSGPACK = 1, CBOR = 2 };
+
 // Client connection state
 class GatewayClient {
 public:
@@ -109,10 +157,27 @@ public:
     bool is_authenticated() const { return authenticated_; }
     void set_authenticated(bool auth) { authenticated_ = auth; }
     
-    // Send message to client
+    static const unsigned char FRAME_PLAIN = 0x00;
+    static const unsigned char FRAME_DEFLATE = 0x01;
+    
+    // Send message to client (RPC replies; queued, never dropped).
+    // send() is always a JSON text frame; send_json() uses the wire format.
     bool send(const std::string& message);
     bool send_json(const Json& data);
     
+    // Queue a serialized event. Over the queue bounds the oldest queued
+    // events are dropped; replies are kept.
+    void enqueue(const std::shared_ptr<const std::string>& data, bool binary,
+                 const std::string& coalesce_key);
+    void set_queue_limits(size_t max_messages, size_t max_bytes);
+    uint64_t dropped() const;
+    
+    // Topic subscriptions: "*", "<channel>:*" or "<channel>:<chat_id>"
+    void subscribe(const std::string& topic);
+    void unsubscribe(const std::string& topic);
+    bool wants(const std::string& topic) const;
+    std::vector<std::string> subscriptions() const;
+    
     // Protocol info
     int protocol_version() const { return protocol_version_; }
     void set_protocol_version(int ver) { protocol_version_ = ver; }
@@ -120,12 +185,29 @@ public:
     const std::string& client_id() const { return client_id_; }
     void set_client_id(const std::string& id) { client_id_ = id; }
     
+    // Wire format (set once in hello, read by publishers on any thread)
+    GatewayEncoding encoding() const { return static_cast<GatewayEncoding>(encoding_.load()); }
+    bool compression() const { return compression_.load(); }
+    void set_wire_format(GatewayEncoding encoding, bool compression, size_t compress_min_bytes);
+    
+    // Index of the wire format among the 6 combinations (encoding x deflate)
+    int wire_format_index() const { return encoding_.load() * 2 + (compression_.load() ? 1 : 0); }
+    
 private:
+    void push(const std::shared_ptr<const std::string>& data, bool binary,
+              const std::string& coalesce_key, bool droppable);
+    
     void* ws_connection_;  // Opaque WebSocket connection handle
+    std::shared_ptr<GatewayOutbox> outbox_;    // Shared with pending drains
+    std::set<std::string> topics_;
+    mutable std::mutex topics_mutex_;
     std::string conn_id_;
     std::string client_id_;
     bool authenticated_;
     int protocol_version_;
+    std::atomic<int> encoding_;
+    std::atomic<bool> compression_;
+    std::atomic<size_t> compress_min_bytes_;
 };
 
 } // namespace opencrank
@@ -0,0 +1,147 @@
+/*
+ * opencrank C++ - Llama.cpp Slot Dispatcher
+ *
+ * llama-server decodes one request per slot (--parallel N) and batches the
+ * busy slots together. Requests beyond N queue inside the server, where
+ * they wait without a deadline and count against our HTTP timeout.
+ *
+ * The dispatcher keeps at most one request per slot in flight and queues
+ * the rest here: one FIFO per session, sessions served round robin, so a
+ * session running a long tool loop cannot starve the others. An admitted
+ * request goes to its session's slot when that slot is free (its KV cache
+ * still holds the conversation prefix), else to the least recently used
+ * free slot, which then becomes the session's slot.
+ *
+ * The slot count comes from llamacpp.slots or, when that is 0, from the
+ * server (GET /slots, then /props total_slots). GET /slots is polled every
+ * poll_ms while requests go out, so slots busy with other clients of the
+ * same server are left alone. Until the count is known, requests go out
+ * unmanaged as before.
+ *
+ * acquire() blocks its thread in the queue. acquire_async() queues the same
+ * way, but one dispatcher thread waits for all such requests and hands each
+ * its slot through a callback.
+ */
+#ifndef opencrank_PLUGINS_LLAMACPP_DISPATCHER_HPP
+#define opencrank_PLUGINS_LLAMACPP_DISPATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <cstdint>
+
+namespace opencrank {
+
+class Histogram;
+
+// Receives the outcome of acquire_async(): as acquire() returns it
+typedef std::function<void(int slot, const std::string& error)> SlotCallback;
+
+class LlamaSlotDispatcher {
+public:
+    LlamaSlotDispatcher();
+    ~LlamaSlotDispatcher();
+
+    // slots: server slot count (0 = ask the server). poll_ms: refresh of
+    // other clients' slot use (0 = never). queue_timeout_ms: longest wait
+    // for a slot (0 = no limit)
+    void configure(const std::string& server_url, const std::string& api_key,
+                   int slots, int64_t poll_ms, int64_t queue_timeout_ms);
+
+    // Wait for a slot for session_key. Returns the slot, -1 to send the
+    // request without one (slot count unknown), or -2 with error set
+    // (queue timeout, or *cancel turned true).
+    int acquire(const std::string& session_key, const std::atomic<bool>* cancel, std::string& error);
+
+    // acquire() without blocking: granted runs exactly once, on the calling
+    // thread when the request need not wait, else on the dispatcher thread.
+    // It must return quickly; other grants wait behind it.
+    void acquire_async(const std::string& session_key, const std::atomic<bool>* cancel,
+                       const SlotCallback& granted);
+
+    // Give back a slot from acquire() (no-op for negative slots)
+    void release(int slot);
+
+    // Stats
+    int slots() const;
+    size_t in_flight() const;
+    size_t queued() const;
+
+private:
+    struct Slot {
+        bool busy;              // One of our requests is on it
+        bool external;          // Busy with another client (last poll)
+        uint64_t last_used;
+        int64_t released_ms;    // Polls started before this are stale for it
+        std::string owner;      // Session whose prefix the slot's cache holds
+
+        Slot() : busy(false), external(false), last_used(0), released_ms(0) {}
+    };
+
+    std::string server_url_;
+    std::string api_key_;
+    int64_t poll_ms_;
+    int64_t queue_timeout_ms_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Slot> slots_;
+    std::map<std::string, int> session_slots_;
+    uint64_t clock_;
+    size_t in_flight_;
+
+    // Waiters: FIFO of tickets per session, sessions in round-robin order
+    std::map<std::string, std::deque<uint64_t> > waiting_;
+    std::deque<std::string> turn_;
+    uint64_t next_ticket_;
+    size_t queued_;
+
+    // Tickets of acquire_async(), served by thread_
+    struct AsyncWaiter {
+        std::string session_key;
+        const std::atomic<bool>* cancel;
+        int64_t start_ms;
+        SlotCallback granted;
+    };
+    std::map<uint64_t, AsyncWaiter> async_waiters_;
+    std::thread thread_;
+    bool stopping_;
+
+    bool polling_;
+    int64_t last_poll_ms_;
+    int64_t discover_after_ms_;     // Next attempt to learn the slot count
+    bool discovering_;
+    bool slots_endpoint_;           // GET /slots answers
+
+    Histogram* wait_seconds_;
+
+    // Wait out or run slot discovery; false while the count is unknown
+    bool managed();
+    // Learn the slot count from the server (called unlocked)
+    void discover();
+    // Refresh Slot::external from GET /slots (called unlocked)
+    void poll();
+    void maybe_poll();
+
+    // Free slot for session, preferring its own (-1 = none). Locked.
+    int pick_slot_locked(const std::string& session_key) const;
+
+    // Queue bookkeeping (locked): join the session's FIFO, leave it (a
+    // served session goes to the back of the rotation), take the slot
+    uint64_t enqueue_locked(const std::string& session_key);
+    void leave_locked(const std::string& session_key, uint64_t ticket, bool served);
+    void take_locked(const std::string& session_key, int slot, int64_t start_ms);
+
+    // Body of thread_
+    void serve_async();
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_LLAMACPP_DISPATCHER_HPP
@@ -8,6 +8,16 @@
  *   llamacpp.url          - Server URL (default: http://localhost:8080)
  *   llamacpp.model        - Model name (optional)
  *   llamacpp.api_key      - API key if server requires authentication (optional)
+ *   llamacpp.slots        - Server slot count (--parallel); 0 = ask the server.
+ *                           At most one request per slot is in flight, the
+ *                           rest queue per session (see dispatcher.hpp), and
+ *                           each session keeps to its slot so its KV cache
+ *                           survives between turns
+ *   llamacpp.slots_poll_ms - Refresh slot use by other clients from GET /slots
+ *                           (default: 1000, 0 = never)
+ *   llamacpp.queue_timeout_ms - Longest wait for a free slot (default: 120000)
+ *   llamacpp.native_tools - Offer tools through function calling (default: false;
+ *                           needs llama-server started with --jinja)
  */
 #ifndef opencrank_PLUGINS_LLAMACPP_HPP
 #define opencrank_PLUGINS_LLAMACPP_HPP
@@ -17,10 +27,17 @@
 #include <opencrank/core/context_manager.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/config.hpp>
+#include <opencrank/plugins/llamacpp/dispatcher.hpp>
 #include <sstream>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
 
 namespace opencrank {
 
+class OpenAIStreamAccumulator;
+
 class LlamaCppAI : public AIPlugin {
 public:
     LlamaCppAI();
@@ -39,6 +56,8 @@ public:
     std::vector<std::string> available_models() const;
     std::string default_model() const;
     bool is_configured() const;
+    bool supports_native_tools() const;
+    void set_thread_pool(ThreadPool* pool);
     
     // Single prompt completion
     CompletionResult complete(
@@ -52,6 +71,15 @@ public:
         const CompletionOptions& opts = CompletionOptions()
     );
     
+    // Conversation completion on the AsyncHttp loop (when it runs); a
+    // request queued for a slot holds no thread either
+    void chat_async(
+        const std::vector<ConversationMessage>& messages,
+        const CompletionOptions& opts,
+        const CompletionCallback& done
+    );
+    bool supports_async() const;
+    
     // Convenience method: simple question-answer
     std::string ask(const std::string& question, const std::string& system = "");
     
@@ -70,21 +98,39 @@ private:
     std::string server_url_;
     std::string api_key_;
     std::string default_model_;
-    size_t max_context_chars_;   // Approx char limit for context (chars ≈ tokens * 4)
+    size_t max_context_tokens_;  // Model context window in tokens
+    bool native_tools_;
     bool initialized_;
     ContextManager context_manager_;
     
-    // Estimate total character count of a request to proactively avoid context overflow
-    size_t estimate_request_chars(const std::vector<ConversationMessage>& messages,
-                                  const std::string& system_prompt) const;
+    // Bounded in-flight window over the server's slots, with session affinity
+    LlamaSlotDispatcher dispatcher_;
+    
+    // Chat request body for messages (context managed), without a slot.
+    // False with error set when there is nothing to send.
+    bool build_chat_request(const std::vector<ConversationMessage>& messages,
+                            const CompletionOptions& opts,
+                            std::string& request_body,
+                            std::string& error);
+    // Pin the request to slot (no-op for negative slots)
+    static void add_slot(std::string& request_body, int slot);
+    std::map<std::string, std::string> request_headers() const;
+    
+    // Result from the server's answer; stream holds the deltas when streaming
+    CompletionResult parse_chat_response(const HttpResponse& response, bool streaming,
+                                         const OpenAIStreamAccumulator& stream, int slot);
     
     // Manage context window intelligently using resume-based strategy.
-    // If context is within budget, returns messages unchanged.
-    // If context exceeds threshold, performs a resume cycle: generates a summary,
-    // saves to memory, wipes history, and returns fresh context with resume.
-    std::vector<ConversationMessage> manage_context(
+    // If context is within budget, returns messages itself (no copy).
+    // If context exceeds threshold, performs a resume cycle: swaps in the
+    // session's background summary or generates one, and returns fresh
+    // context with the resume.
+    // Any rewritten context is built in storage, which is then returned.
+    const std::vector<ConversationMessage>& manage_context(
         const std::vector<ConversationMessage>& messages,
-        const std::string& system_prompt);
+        const std::string& system_prompt,
+        const std::string& session_key,
+        std::vector<ConversationMessage>& storage);
 };
 
 } // namespace opencrank
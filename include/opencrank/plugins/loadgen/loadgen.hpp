@@ -0,0 +1,121 @@
+/*
+ * opencrank C++ - Load Generator Channel
+ *
+ * In-process channel that plays many synthetic users at once. Each
+ * conversation sends a message, waits for the reply, pauses for the think
+ * time and sends the next, so messages take the same path as real traffic:
+ * on_message -> dedup/rate limit -> session executor -> ThreadPool ->
+ * Agent::run -> tools -> send_response. Pair it with the mock AI plugin to
+ * measure the gateway itself rather than a model.
+ *
+ * Latency is measured per turn from emitting the message to the first
+ * reply delivered to the conversation's chat. When every conversation has
+ * finished (or timed out) a report is logged and written as JSON: turns,
+ * errors, timeouts, throughput, p50/p90/p99/max latency and peak RSS.
+ *
+ * Config (section "loadgen"):
+ *   loadgen.conversations  - Concurrent conversations (default: 100)
+ *   loadgen.turns          - Messages per conversation (default: 5)
+ *   loadgen.think_ms       - Pause between a reply and the next message (default: 1000)
+ *   loadgen.ramp_ms        - Conversation starts spread over this long (default: 5000)
+ *   loadgen.timeout_ms     - A turn without reply after this long fails (default: 120000)
+ *   loadgen.chat_type      - Chat type of the messages (default: group, one
+ *                            session per conversation; "direct" chats all
+ *                            share the main session)
+ *   loadgen.report         - Report file (default: loadgen_report.json)
+ *   loadgen.exit_when_done - Stop the process after the report (default: true)
+ */
+#ifndef opencrank_PLUGINS_LOADGEN_HPP
+#define opencrank_PLUGINS_LOADGEN_HPP
+
+#include <opencrank/core/channel.hpp>
+#include <opencrank/core/reactor.hpp>
+#include <opencrank/core/logger.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <mutex>
+#include <cstdint>
+
+namespace opencrank {
+
+class LoadGenChannel : public ChannelPlugin {
+public:
+    LoadGenChannel();
+
+    // Plugin interface
+    const char* name() const;
+    const char* version() const;
+    const char* description() const;
+
+    // Channel interface
+    const char* channel_id() const;
+    ChannelCapabilities capabilities() const;
+
+    bool init(const Config& cfg);
+    void shutdown();
+    bool start();
+    bool stop();
+    ChannelStatus status() const;
+
+    // Replies from the agent end the pending turn of their conversation
+    SendResult send_message(const std::string& to, const std::string& text);
+
+    void poll();
+    bool attach_reactor(Reactor& reactor);
+
+private:
+    struct Conversation {
+        std::string chat_id;
+        int turn;              // Messages sent so far
+        bool waiting;          // A message is out, no reply yet
+        int64_t sent_us;       // When the pending message was emitted
+    };
+
+    // (due time ms, conversation index), earliest first
+    typedef std::pair<int64_t, size_t> Due;
+    typedef std::priority_queue<Due, std::vector<Due>, std::greater<Due> > DueQueue;
+
+    // Config
+    int conversations_;
+    int turns_;
+    int think_ms_;
+    int ramp_ms_;
+    int timeout_ms_;
+    std::string chat_type_;
+    std::string report_path_;
+    bool exit_when_done_;
+
+    ChannelStatus status_;
+    Reactor* reactor_;
+    Reactor::TimerId tick_timer_;
+    std::string run_id_;
+
+    // Guarded by mutex_: replies arrive on agent worker threads
+    std::mutex mutex_;
+    std::vector<Conversation> convs_;
+    std::map<std::string, size_t> by_chat_;
+    DueQueue due_;
+    std::vector<double> latencies_ms_;
+    uint64_t sent_;
+    uint64_t errors_;
+    uint64_t timeouts_;
+    size_t finished_;
+    int64_t started_us_;
+    int64_t last_check_ms_;
+    bool reported_;
+
+    // Reactor thread: emit due messages, expire stuck turns
+    void tick();
+    void send_turn(size_t index);
+    // Called with mutex_ held once a turn ends (reply, error or timeout)
+    void end_turn_locked(Conversation& conv, size_t index, int64_t now_ms);
+    // Log and write the report once: when every conversation is done, or
+    // with whatever was measured so far when partial is set
+    void report(bool partial);
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_LOADGEN_HPP
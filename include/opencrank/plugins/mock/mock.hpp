@@ -0,0 +1,132 @@
+/*
+ * opencrank C++ - Mock AI Plugin
+ *
+ * Scripted AI provider for load tests and offline development. Nothing
+ * leaves the process: each chat() sleeps for a latency drawn from the
+ * configured distribution and answers from a script, so the agent loop,
+ * tools and channels run exactly as they would against a real model.
+ * chat_async() waits on reactor timers instead, like a provider whose
+ * requests are in flight on the network.
+ *
+ * A script is a list of turns; a turn is a list of steps, each either a
+ * tool call ({"tool": ..., "arguments": {...}}) or a text answer
+ * ({"text": ...}). The step is picked from the conversation itself: the
+ * number of assistant replies since the last user message. Conversations
+ * are spread over the turns by session key, so the same load produces the
+ * same mix of tool calls on every run.
+ *
+ * Config (section "mock"):
+ *   mock.script             - Script file ({"turns": [[step, ...], ...]});
+ *                             empty = built-in script
+ *   mock.model              - Model name reported back (default: mock-1)
+ *   mock.latency            - fixed | uniform | lognormal (default: lognormal)
+ *   mock.latency_ms         - Mean latency per call (default: 800)
+ *   mock.latency_stddev_ms  - Spread: stddev for lognormal, half-width for
+ *                             uniform (default: 300)
+ *   mock.stream_chunks      - Chunks per streamed reply (default: 8)
+ *   mock.error_rate         - Fraction of calls that fail (default: 0)
+ *   mock.native_tools       - Return tool-call steps as native tool calls
+ *                             when the agent offers tools (default: false)
+ */
+#ifndef opencrank_PLUGINS_MOCK_HPP
+#define opencrank_PLUGINS_MOCK_HPP
+
+#include <opencrank/ai/ai.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/config.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace opencrank {
+
+class MockAI : public AIPlugin {
+public:
+    enum Distribution {
+        LATENCY_FIXED,
+        LATENCY_UNIFORM,
+        LATENCY_LOGNORMAL
+    };
+
+    MockAI();
+
+    // Plugin interface
+    const char* name() const;
+    const char* version() const;
+    const char* description() const;
+
+    bool init(const Config& cfg);
+    void shutdown();
+    bool is_initialized() const;
+
+    // AIPlugin interface
+    std::string provider_id() const;
+    std::vector<std::string> available_models() const;
+    std::string default_model() const;
+    bool is_configured() const;
+    bool supports_native_tools() const;
+
+    CompletionResult complete(
+        const std::string& prompt,
+        const CompletionOptions& opts = CompletionOptions()
+    );
+
+    CompletionResult chat(
+        const std::vector<ConversationMessage>& messages,
+        const CompletionOptions& opts = CompletionOptions()
+    );
+
+    void chat_async(
+        const std::vector<ConversationMessage>& messages,
+        const CompletionOptions& opts,
+        const CompletionCallback& done
+    );
+    bool supports_async() const;
+
+    bool attach_reactor(Reactor& reactor);
+    bool detach_reactor(Reactor& reactor);
+
+private:
+    // One scripted turn: response text for each step, last one final
+    typedef std::vector<std::string> Turn;
+
+    std::string model_;
+    Distribution distribution_;
+    double latency_ms_;
+    double latency_stddev_ms_;
+    int stream_chunks_;
+    double error_rate_;
+    bool native_tools_;
+    std::vector<Turn> turns_;
+    Reactor* reactor_;              // Timers of chat_async() (not owned)
+
+    // A reply of chat_async() on its way: one timer per streamed chunk
+    struct AsyncReply {
+        CompletionResult result;
+        std::vector<std::string> chunks;
+        size_t next;
+        int delay_ms;                   // Per chunk
+        int waited_ms;                  // Of delay_ms, toward the next chunk
+        StreamCallback on_chunk;
+        const std::atomic<bool>* cancel;
+        CompletionCallback done;
+    };
+    static void deliver(Reactor& reactor, const std::shared_ptr<AsyncReply>& reply);
+
+    // The scripted result for messages, its latency, and the pieces it
+    // streams in (empty = not streamed)
+    CompletionResult script_reply(const std::vector<ConversationMessage>& messages,
+                                  const CompletionOptions& opts,
+                                  double& latency,
+                                  std::vector<std::string>& chunks);
+
+    bool load_script(const std::string& path);
+    void load_builtin_script();
+
+    // Latency for one call, in milliseconds
+    double draw_latency_ms() const;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_MOCK_HPP
@@ -8,6 +8,9 @@
  *   openrouter.api_key    - Your OpenRouter API key
  *   openrouter.model      - Default model (optional, defaults to openai/gpt-4o)
  *   openrouter.api_url    - API base URL (optional, defaults to https://openrouter.ai/api/v1)
+ *   openrouter.native_tools - Offer tools through function calling (default: true)
+ *   openrouter.max_retries, retry_base_ms, retry_max_ms, rate_limit_rpm -
+ *                   429 handling and pacing (see ai/rate_pacer.hpp)
  */
 #ifndef opencrank_PLUGINS_OPENROUTER_HPP
 #define opencrank_PLUGINS_OPENROUTER_HPP
@@ -18,10 +21,14 @@
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/config.hpp>
 #include <sstream>
+#include <memory>
 #include <cstdlib>
 
 namespace opencrank {
 
+class OpenAIStreamAccumulator;
+class RatePacer;
+
 class OpenRouterAI : public AIPlugin {
 public:
     OpenRouterAI();
@@ -40,6 +47,8 @@ public:
     std::vector<std::string> available_models() const;
     std::string default_model() const;
     bool is_configured() const;
+    bool supports_native_tools() const;
+    void set_thread_pool(ThreadPool* pool);
     
     // Single prompt completion
     CompletionResult complete(
@@ -53,6 +62,14 @@ public:
         const CompletionOptions& opts = CompletionOptions()
     );
     
+    // Conversation completion on the AsyncHttp loop (when it runs)
+    void chat_async(
+        const std::vector<ConversationMessage>& messages,
+        const CompletionOptions& opts,
+        const CompletionCallback& done
+    );
+    bool supports_async() const;
+    
     // Convenience method: simple question-answer
     std::string ask(const std::string& question, const std::string& system = "");
     
@@ -67,21 +84,40 @@ private:
     std::string api_key_;
     std::string default_model_;
     std::string api_url_;
-    size_t max_context_chars_;   // Approx char limit for context (chars ≈ tokens * 4)
+    size_t max_context_tokens_;  // Model context window in tokens
+    bool native_tools_;
     bool initialized_;
     ContextManager context_manager_;
+    RatePacer* pacer_;          // Shared by every request with api_key_
+    
+    // Chat request body for messages (context managed). False with error
+    // set when there is nothing to send.
+    bool build_chat_request(const std::vector<ConversationMessage>& messages,
+                            const CompletionOptions& opts,
+                            std::string& request_body,
+                            std::string& error);
+    std::map<std::string, std::string> request_headers() const;
+    
+    // Result from the API's answer; stream holds the deltas when streaming
+    CompletionResult parse_chat_response(const HttpResponse& response, bool streaming,
+                                         const OpenAIStreamAccumulator& stream);
     
-    // Estimate total character count of a request to proactively avoid context overflow
-    size_t estimate_request_chars(const std::vector<ConversationMessage>& messages,
-                                  const std::string& system_prompt) const;
+    // One chat_async() request through its retries. send_async() paces and
+    // submits the next attempt; false (done not called) if the loop stopped.
+    struct AsyncChat;
+    bool send_async(const std::shared_ptr<AsyncChat>& chat, int64_t backoff_ms);
     
     // Manage context window intelligently using resume-based strategy.
-    // If context is within budget, returns messages unchanged.
-    // If context exceeds threshold, performs a resume cycle: generates a summary,
-    // saves to memory, wipes history, and returns fresh context with resume.
-    std::vector<ConversationMessage> manage_context(
+    // If context is within budget, returns messages itself (no copy).
+    // If context exceeds threshold, performs a resume cycle: swaps in the
+    // session's background summary or generates one, and returns fresh
+    // context with the resume.
+    // Any rewritten context is built in storage, which is then returned.
+    const std::vector<ConversationMessage>& manage_context(
         const std::vector<ConversationMessage>& messages,
-        const std::string& system_prompt);
+        const std::string& system_prompt,
+        const std::string& session_key,
+        std::vector<ConversationMessage>& storage);
 };
 
 } // namespace opencrank
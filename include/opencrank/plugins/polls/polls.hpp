@@ -5,9 +5,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <cstdint>
 #include <stdexcept>
 
+struct sqlite3;
+
 namespace opencrank {
 
 // Exception for poll validation errors
@@ -69,7 +76,7 @@ struct PollResults {
     std::string poll_id;
     std::vector<int> vote_counts;  // Count per option
     int total_votes;
-    std::map<std::string, std::vector<int> > votes_by_voter;  // voter_id -> selected options
+    std::map<std::string, std::vector<int> > votes_by_voter;  // voter_id -> selected options (only when asked for)
     
     PollResults() : total_votes(0) {}
     
@@ -103,7 +110,68 @@ int normalize_poll_duration(int duration_hours, int default_hours, int max_hours
 // Returns empty string if valid, error message otherwise
 std::string validate_vote(const Poll& poll, const std::vector<int>& selected_options);
 
-// Poll manager - manages all polls in memory
+// Poll persistence: poll definitions plus an append-only vote log in SQLite.
+// Changes are queued and committed by a writer thread, one transaction per
+// flush interval. load() replays the log into the live votes and rewrites
+// it as that snapshot once it has grown to twice their number.
+//
+// Config (section "polls"):
+//   polls.db_path  - Database file (default: db/polls.db, under ~/.opencrank)
+//   polls.flush_ms - Longest a change waits before it is committed (default: 200)
+class PollStore {
+public:
+    struct Change {
+        enum Kind { SAVE_POLL, DELETE_POLL, VOTE, RETRACT };
+        Kind kind;
+        Poll poll;                      // SAVE_POLL
+        PollVote vote;                  // VOTE, RETRACT (poll_id, voter_id); DELETE_POLL (poll_id)
+        
+        Change() : kind(VOTE) {}
+    };
+    
+    PollStore();
+    ~PollStore();
+    
+    bool open(const std::string& db_path, int flush_interval_ms = 200);
+    void close();                       // Commits pending changes
+    bool is_open() const { return db_ != nullptr; }
+    
+    // Queue a change (write-behind)
+    void enqueue(const Change& change);
+    
+    // Block until everything queued so far is committed
+    void flush();
+    
+    // Every poll and its live votes (log replayed in order)
+    bool load(std::vector<Poll>& polls, std::vector<PollVote>& votes);
+    
+private:
+    PollStore(const PollStore&);
+    PollStore& operator=(const PollStore&);
+    
+    void writer_loop();
+    bool apply(const Change& change);
+    bool exec(const char* sql);
+    
+    sqlite3* db_;
+    std::mutex db_mutex_;               // Writer batch vs. load
+    int flush_interval_ms_;
+    
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Change> queue_;
+    bool flush_requested_;
+    bool stop_;
+    uint64_t enqueued_;
+    uint64_t committed_;
+    std::thread writer_;
+};
+
+// Poll manager - manages all polls in memory. Tallies are kept per option
+// and updated on every vote and retraction, so results cost O(options)
+// however many voters a poll has. With a store open, every change is also
+// written to it and the polls survive a restart.
 class PollManager {
 public:
     static PollManager& instance();
@@ -130,8 +198,16 @@ public:
                      const std::string& voter_id,
                      const std::vector<int>& selected_options);
     
-    // Get results for a poll
-    PollResults get_results(const std::string& poll_id) const;
+    // Withdraw a voter's vote (they may vote again while the poll is active)
+    // Returns empty string on success, error message on failure
+    std::string retract_vote(const std::string& poll_id, const std::string& voter_id);
+    
+    // Get results for a poll; with_voters also copies every voter's
+    // selection into votes_by_voter (O(voters))
+    PollResults get_results(const std::string& poll_id, bool with_voters = false) const;
+    
+    // Number of voters in a poll
+    size_t voter_count(const std::string& poll_id) const;
     
     // Check if voter has already voted
     bool has_voted(const std::string& poll_id, const std::string& voter_id) const;
@@ -146,15 +222,31 @@ public:
     std::vector<std::string> active_poll_ids() const;
     
     // Poll count
-    size_t poll_count() const { return polls_.size(); }
+    size_t poll_count() const;
+    
+    // Persist to db_path and load what an earlier run stored there
+    bool open_store(const std::string& db_path, int flush_interval_ms = 200);
+    void close_store();
 
 private:
     PollManager() {}
     PollManager(const PollManager&);
     PollManager& operator=(const PollManager&);
     
-    std::map<std::string, Poll> polls_;
-    std::map<std::string, std::vector<PollVote> > votes_;  // poll_id -> votes
+    struct PollState {
+        Poll poll;
+        std::vector<int> counts;        // Per option
+        std::unordered_map<std::string, PollVote> votes;   // voter_id -> vote
+    };
+    
+    PollState* find(const std::string& poll_id);
+    const PollState* find(const std::string& poll_id) const;
+    void add_vote(PollState& state, const PollVote& vote);
+    void persist(PollStore::Change::Kind kind, const Poll* poll, const PollVote* vote);
+    
+    mutable std::mutex mutex_;
+    std::map<std::string, PollState> polls_;
+    PollStore store_;
 };
 
 // Polls plugin class
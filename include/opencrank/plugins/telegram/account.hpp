@@ -0,0 +1,118 @@
+/*
+ * opencrank C++ - Telegram Bot Account
+ *
+ * One bot token served by the Telegram channel: its identity (getMe), its
+ * outbound send queue (rate limits are per bot) and its update intake.
+ * Updates arrive by long polling - as a transfer on the shared AsyncHttp
+ * loop when it runs, so N bots cost N sockets rather than N threads, else
+ * on a thread of their own - or by webhook, as a route on the channel's
+ * shared listener under the path of the account's webhook_url.
+ *
+ * The default account (telegram.bot_token) addresses chats by their bare
+ * id; a named account (telegram.accounts.<id>) as "<id>:<chat id>", so
+ * replies, edits and typing actions find their way back to the same bot.
+ */
+#ifndef opencrank_PLUGINS_TELEGRAM_ACCOUNT_HPP
+#define opencrank_PLUGINS_TELEGRAM_ACCOUNT_HPP
+
+#include <opencrank/core/config.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <opencrank/core/json_stream.hpp>
+#include <opencrank/core/rate_limiter.hpp>
+#include <opencrank/core/types.hpp>
+#include <opencrank/plugins/telegram/send_queue.hpp>
+#include <opencrank/plugins/telegram/webhook.hpp>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace opencrank {
+
+class TelegramAccount {
+public:
+    typedef std::function<void(const Message& msg)> MessageHandler;
+
+    // id "" is the default account
+    explicit TelegramAccount(const std::string& id);
+    ~TelegramAccount();
+
+    // Read the settings under section (telegram.accounts.<id>, or
+    // telegram for the default account); unset keys fall back to the
+    // channel-wide telegram.* values. False without a bot_token.
+    bool configure(const Config& cfg, const std::string& section);
+
+    // Check in with getMe, start the send queue, then receive updates:
+    // through listener when in webhook mode (NULL = no listener), else by
+    // long polling. Messages go to on_message.
+    bool start(TelegramWebhookServer* listener, MessageHandler on_message);
+    void stop();
+
+    // The listener could not be watched: receive by long polling instead
+    void fall_back_to_polling();
+
+    const std::string& id() const { return id_; }
+    const std::string& username() const { return bot_username_; }
+    bool wants_webhook() const { return webhook_mode_; }
+    TelegramSendQueue& send_queue() { return send_queue_; }
+
+    // Message::to for a chat of this account
+    std::string address(const std::string& chat_id) const;
+
+    // Highest update handled, carried over a hot restart
+    int64_t last_update_id() const { return last_update_id_.load(); }
+    void resume_after(int64_t update_id);
+
+private:
+    TelegramAccount(const TelegramAccount&);
+    TelegramAccount& operator=(const TelegramAccount&);
+
+    std::string updates_url() const;
+    void start_polling();
+    bool start_webhook(TelegramWebhookServer* listener);
+
+    // Long poll on the AsyncHttp loop: one getUpdates in flight at a time,
+    // the next submitted from the completion of the last
+    void poll_async(int64_t delay_ms);
+    void on_updates(HttpResponse& response);
+
+    // Long poll on a thread (AsyncHttp not running)
+    void polling_loop();
+
+    // Returns the seconds to back off before the next poll (0 = none)
+    int handle_updates(const HttpResponse& response);
+    void process_update(const JsonView& update);
+
+    std::string id_;
+    std::string log_name_;              // "Telegram" or "Telegram <id>"
+    std::string bot_token_;
+    std::string api_base_;
+    int64_t bot_id_;
+    std::string bot_username_;
+    HttpClient http_;                   // getMe, webhook setup, polling thread
+    TelegramSendQueue send_queue_;
+    MessageHandler on_message_;
+    std::atomic<int64_t> last_update_id_;
+    int poll_timeout_;
+    int poll_backoff_;                  // Seconds to wait after a failed poll
+
+    std::atomic<bool> stopping_;        // Also the cancel flag of async polls
+    std::thread poll_thread_;
+    std::mutex poll_mutex_;
+    std::condition_variable poll_done_;
+    bool poll_pending_;                 // An async poll is in flight
+
+    bool webhook_mode_;
+    std::string webhook_url_;
+    std::string webhook_path_;
+    std::string webhook_secret_;
+    TelegramWebhookServer* listener_;   // Routed to while in webhook mode
+    MessageDebouncer update_dedup_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_TELEGRAM_ACCOUNT_HPP
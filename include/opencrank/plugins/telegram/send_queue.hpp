@@ -0,0 +1,96 @@
+/*
+ * opencrank C++ - Telegram Outbound Send Queue
+ *
+ * All Bot API writes (sendMessage, editMessageText, sendChatAction) go
+ * through one sender thread, so worker threads never block on the network
+ * and never share a curl handle. The sender paces requests to Telegram's
+ * published limits:
+ *   - ~30 messages/second across all chats (token bucket)
+ *   - 1 message/second per private chat, 20/minute per group
+ * and honours 429 "retry_after" by parking the affected chat. Jobs for the
+ * same chat stay in order.
+ */
+#ifndef opencrank_PLUGINS_TELEGRAM_SEND_QUEUE_HPP
+#define opencrank_PLUGINS_TELEGRAM_SEND_QUEUE_HPP
+
+#include <opencrank/core/channel.hpp>
+#include <opencrank/core/rate_limiter.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <string>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class TelegramSendQueue {
+public:
+    typedef ChannelPlugin::SendCallback Callback;
+
+    TelegramSendQueue();
+    ~TelegramSendQueue();
+
+    void start(const std::string& api_base);
+    void stop();   // Fails whatever is still queued with "channel stopped"
+
+    // Queue a Bot API call. plain_text replaces params["text"] (and drops
+    // parse_mode) if Telegram rejects the HTML. done may be empty.
+    void submit(const std::string& method, const std::string& chat_id,
+                const Json& params, const std::string& plain_text, Callback done);
+
+    // Queue and wait for the result (streaming needs the message id)
+    SendResult call(const std::string& method, const std::string& chat_id,
+                    const Json& params, const std::string& plain_text);
+
+    // Fire-and-forget typing action; collapses repeats for the same chat
+    void typing(const std::string& chat_id);
+
+    size_t pending() const;
+
+private:
+    TelegramSendQueue(const TelegramSendQueue&);
+    TelegramSendQueue& operator=(const TelegramSendQueue&);
+
+    struct Job {
+        std::string method;
+        std::string chat_id;
+        Json params;
+        std::string plain_text;
+        Callback done;
+        bool counts;        // Subject to the per-chat message limit
+        int attempts;
+    };
+
+    void sender_loop();
+
+    // Index of the next job allowed to go out, or -1 with wait_ms set
+    int next_ready(int64_t now, int64_t& wait_ms);
+
+    // Perform one request; false = rate limited, job was re-queued
+    bool execute(Job& job);
+
+    std::string api_base_;
+    HttpClient http_;                       // Sender thread only
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::set<std::string> typing_pending_;
+    std::map<std::string, int64_t> blocked_until_;   // chat -> ms
+    TokenBucketLimiter global_;
+    KeyedRateLimiter private_chats_;
+    KeyedRateLimiter group_chats_;
+    int64_t last_cleanup_ms_;
+
+    std::thread thread_;
+    std::atomic<bool> stop_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_TELEGRAM_SEND_QUEUE_HPP
@@ -4,16 +4,21 @@
 #include <opencrank/core/channel.hpp>
 #include <opencrank/core/http_client.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/rate_limiter.hpp>
+#include <opencrank/plugins/telegram/account.hpp>
+#include <opencrank/plugins/telegram/webhook.hpp>
 #include <string>
-#include <sstream>
-#include <ctime>
-#include <thread>
-#include <atomic>
-#include <mutex>
+#include <vector>
+#include <memory>
 
 namespace opencrank {
 
-// Telegram Bot API channel plugin
+// Telegram Bot API channel plugin.
+// Serves one bot (telegram.bot_token) and any number of named bots
+// (telegram.accounts) in one process. Each bot receives updates by long
+// polling (mode "polling") or by webhook on a listener they share on the
+// main reactor (mode "webhook"), and sends through its own rate-limited
+// outbound queue. Chats of named bots are addressed as "<account>:<chat>".
 class TelegramChannel : public ChannelPlugin {
 public:
     TelegramChannel();
@@ -38,30 +43,40 @@ public:
     SendResult send_message(const std::string& to, const std::string& text,
                             const std::string& reply_to);
     
-    // Send typing action
+    // Queue a message without waiting for Telegram
+    void send_message_async(const std::string& to, const std::string& text,
+                            const std::string& reply_to, SendCallback done) override;
+    
+    // Edit a sent message (used for streamed replies)
+    SendResult edit_message(const std::string& to, const std::string& message_id,
+                            const std::string& text);
+    
+    // Send typing action (queued, returns immediately)
     SendResult send_typing_action(const std::string& to);
     
-    // Poll for new messages (single tick)
-    void poll() override;
+    // Updates arrive by themselves (async long polls, threads or webhook)
+    void poll() override {}
+    
+    // Registers the webhook listener; polling needs no main-loop ticks
+    bool attach_reactor(Reactor& reactor) override;
+    
+    // Update offsets kept across a hot restart, so none is handled twice
+    Json save_state() const override;
+    void restore_state(const Json& state) override;
     
 private:
-    std::string bot_token_;
-    std::string api_base_;
-    int64_t bot_id_;
-    std::string bot_username_;
-    HttpClient http_;        // For polling
-    HttpClient http_send_;   // For sending messages (separate to avoid blocking)
+    std::vector<std::unique_ptr<TelegramAccount> > accounts_;
     ChannelStatus status_;
-    int64_t last_update_id_;
-    int poll_timeout_;
-    int poll_backoff_; // Backoff in seconds for poll failures
-    // Polling thread
-    std::thread poll_thread_;
-    std::atomic<bool> should_stop_polling_;
-    void polling_loop();
-    void poll_tick();
-    SendResult send_message_impl(const std::string& to, const std::string& text, int64_t reply_to);
-    void process_update(const Json& update);
+    // Webhook listener shared by the accounts in webhook mode
+    std::string webhook_bind_;
+    int webhook_port_;
+    TelegramWebhookServer webhook_;
+    
+    // The account a Message::to belongs to; chat_id receives the chat
+    // part. NULL if no configured account matches.
+    TelegramAccount* account_for(const std::string& to, std::string& chat_id) const;
+    TelegramAccount* find_account(const std::string& id) const;
+    static Json send_params(const std::string& chat_id, const std::string& text, int64_t reply_to);
 };
 
 } // namespace opencrank
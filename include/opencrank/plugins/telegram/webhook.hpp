@@ -0,0 +1,67 @@
+/*
+ * opencrank C++ - Telegram Webhook Listener
+ *
+ * Bot API webhooks on the core HttpListener (reactor-driven, kept bound
+ * across hot restarts). Telegram only delivers to public HTTPS URLs, so
+ * this listens in plain HTTP behind a TLS-terminating reverse proxy that
+ * forwards webhook_url to webhook_bind:webhook_port.
+ *
+ * Each bot account of the channel registers the path of its webhook_url,
+ * so several bots share one listener. Each POST carries one Update;
+ * requests without that route's X-Telegram-Bot-Api-Secret-Token are
+ * rejected. The connection is answered with an empty 200 and closed.
+ */
+#ifndef opencrank_PLUGINS_TELEGRAM_WEBHOOK_HPP
+#define opencrank_PLUGINS_TELEGRAM_WEBHOOK_HPP
+
+#include <opencrank/core/json_stream.hpp>
+#include <opencrank/core/http_listener.hpp>
+#include <string>
+#include <map>
+#include <functional>
+#include <mutex>
+
+namespace opencrank {
+
+class Reactor;
+
+class TelegramWebhookServer {
+public:
+    typedef std::function<void(const JsonView& update)> UpdateHandler;
+
+    TelegramWebhookServer();
+    ~TelegramWebhookServer();
+
+    // Bind the listening socket (call before attach)
+    bool open(const std::string& bind_address, int port);
+
+    // Deliver updates POSTed to path (carrying secret, unless empty) to
+    // handler, on the reactor thread. False if another route has the path.
+    bool add_route(const std::string& path, const std::string& secret, UpdateHandler handler);
+    void remove_route(const std::string& path);
+
+    // Register the listener and idle sweep with the reactor
+    bool attach(Reactor& reactor);
+
+    void close();
+    bool is_open() const { return listener_.is_open(); }
+
+private:
+    TelegramWebhookServer(const TelegramWebhookServer&);
+    TelegramWebhookServer& operator=(const TelegramWebhookServer&);
+
+    struct Route {
+        std::string secret;
+        UpdateHandler handler;
+    };
+
+    void handle_request(const HttpRequest& request, HttpReply& reply);
+
+    HttpListener listener_;
+    std::mutex routes_mutex_;               // Accounts start in parallel
+    std::map<std::string, Route> routes_;   // By path
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_TELEGRAM_WEBHOOK_HPP
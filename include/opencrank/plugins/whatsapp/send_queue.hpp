@@ -0,0 +1,101 @@
+/*
+ * opencrank C++ - WhatsApp Outbound Send Queue
+ *
+ * All sends (text messages and bridge typing actions) go through one
+ * sender thread, so worker threads never block on the network and never
+ * share a curl handle. Each wakeup drains every job that may go out, back
+ * to back on the sender's kept-alive connection. Requests are paced by a
+ * token bucket (whatsapp.send_rate per second); when the API asks to slow
+ * down, the recipient - or, for account-wide throughput limits, every
+ * recipient - is parked and the job retried. Jobs for the same recipient
+ * stay in order.
+ */
+#ifndef opencrank_PLUGINS_WHATSAPP_SEND_QUEUE_HPP
+#define opencrank_PLUGINS_WHATSAPP_SEND_QUEUE_HPP
+
+#include <opencrank/core/channel.hpp>
+#include <opencrank/core/rate_limiter.hpp>
+#include <string>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class WhatsAppSendQueue {
+public:
+    typedef ChannelPlugin::SendCallback Callback;
+
+    struct Job {
+        std::string to;
+        std::string text;
+        std::string reply_to;
+        bool typing;            // Typing action instead of a message
+        Callback done;
+        int attempts;
+    };
+
+    // What the API answered to one request. retry_after_ms > 0 parks the
+    // recipient (every recipient with throttle_all) and retries the job.
+    struct Outcome {
+        SendResult result;
+        int64_t retry_after_ms;
+        bool throttle_all;
+
+        Outcome() : retry_after_ms(0), throttle_all(false) {}
+    };
+
+    // Performs one request on the sender thread
+    typedef std::function<Outcome(const Job& job)> Sender;
+
+    WhatsAppSendQueue();
+    ~WhatsAppSendQueue();
+
+    void start(const Sender& sender, int per_second);
+    void stop();   // Fails whatever is still queued with "channel stopped"
+
+    // Queue a message; done may be empty
+    void submit(const std::string& to, const std::string& text,
+                const std::string& reply_to, Callback done);
+
+    // Queue and wait for the result
+    SendResult call(const std::string& to, const std::string& text, const std::string& reply_to);
+
+    // Fire-and-forget typing action; collapses repeats for the same recipient
+    void typing(const std::string& to);
+
+    size_t pending() const;
+
+private:
+    WhatsAppSendQueue(const WhatsAppSendQueue&);
+    WhatsAppSendQueue& operator=(const WhatsAppSendQueue&);
+
+    void enqueue(const Job& job);
+    void sender_loop();
+
+    // Take every job allowed to go out now (in order), or set wait_ms
+    void take_ready(int64_t now, std::deque<Job>& ready, int64_t& wait_ms);
+
+    Sender sender_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::set<std::string> typing_pending_;
+    std::map<std::string, int64_t> blocked_until_;   // recipient -> ms
+    int64_t all_blocked_until_ms_;
+    TokenBucketLimiter bucket_;
+
+    std::thread thread_;
+    std::atomic<bool> stop_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_WHATSAPP_SEND_QUEUE_HPP
@@ -0,0 +1,65 @@
+/*
+ * opencrank C++ - WhatsApp Webhook Listener
+ *
+ * Runs on the core HttpListener (reactor-driven, no extra thread), like
+ * the Telegram webhook. It serves both push sources:
+ *   - Cloud API: Meta verifies the subscription with a GET carrying
+ *     hub.mode=subscribe, hub.verify_token and hub.challenge (answered with
+ *     the challenge when the token matches), then POSTs notifications
+ *     signed with X-Hub-Signature-256 (HMAC-SHA256 of the body with the
+ *     app secret).
+ *   - Bridges that can push: POST the same JSON they return from
+ *     GET /messages (one message or {"messages": [...]}), signed the same
+ *     way when an app secret is set.
+ *
+ * Meta only delivers to public HTTPS URLs, so this listens in plain HTTP
+ * behind a TLS-terminating reverse proxy. The socket is handed over across
+ * a hot restart as "whatsapp.webhook".
+ */
+#ifndef opencrank_PLUGINS_WHATSAPP_WEBHOOK_HPP
+#define opencrank_PLUGINS_WHATSAPP_WEBHOOK_HPP
+
+#include <opencrank/core/json_stream.hpp>
+#include <opencrank/core/http_listener.hpp>
+#include <string>
+#include <functional>
+
+namespace opencrank {
+
+class Reactor;
+
+class WhatsAppWebhookServer {
+public:
+    typedef std::function<void(const JsonView& body)> PayloadHandler;
+
+    WhatsAppWebhookServer();
+    ~WhatsAppWebhookServer();
+
+    // Bind the listening socket (call before attach). An empty app_secret
+    // accepts unsigned POSTs.
+    bool open(const std::string& bind_address, int port, const std::string& path,
+              const std::string& verify_token, const std::string& app_secret);
+
+    // Register the listener and idle sweep with the reactor
+    bool attach(Reactor& reactor, PayloadHandler handler);
+
+    void close();
+    bool is_open() const { return listener_.is_open(); }
+
+private:
+    WhatsAppWebhookServer(const WhatsAppWebhookServer&);
+    WhatsAppWebhookServer& operator=(const WhatsAppWebhookServer&);
+
+    void handle_request(const HttpRequest& request, HttpReply& reply);
+    bool signature_valid(const std::string& header, const std::string& payload) const;
+
+    HttpListener listener_;
+    std::string path_;
+    std::string verify_token_;
+    std::string app_secret_;
+    PayloadHandler handler_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_PLUGINS_WHATSAPP_WEBHOOK_HPP
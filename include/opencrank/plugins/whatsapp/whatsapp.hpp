@@ -4,10 +4,15 @@
 #include <opencrank/core/channel.hpp>
 #include <opencrank/core/http_client.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/rate_limiter.hpp>
+#include <opencrank/plugins/whatsapp/send_queue.hpp>
+#include <opencrank/plugins/whatsapp/webhook.hpp>
 #include <string>
 #include <sstream>
 #include <ctime>
 #include <map>
+#include <thread>
+#include <atomic>
 
 namespace opencrank {
 
@@ -26,6 +31,14 @@ namespace opencrank {
  *    - Bridge handles QR code authentication
  * 
  * The plugin auto-detects which mode based on available config.
+ *
+ * Inbound delivery (whatsapp.mode):
+ *   - "poll"    bridge only: GET /messages every poll_interval seconds
+ *   - "stream"  bridge only: one long-lived SSE subscription to
+ *               bridge_events on a dedicated thread
+ *   - "webhook" Cloud API or pushing bridge: POSTs to the webhook listener
+ *               on the main reactor
+ * Outbound sends and typing actions go through a paced send queue.
  */
 class WhatsAppChannel : public ChannelPlugin {
 public:
@@ -57,39 +70,81 @@ public:
     SendResult send_message(const std::string& to, const std::string& text,
                             const std::string& reply_to);
     
-    // Send typing action
+    // Queue a message without waiting for WhatsApp
+    void send_message_async(const std::string& to, const std::string& text,
+                            const std::string& reply_to, SendCallback done) override;
+    
+    // Send typing action (queued, returns immediately)
     SendResult send_typing_action(const std::string& to);
     
     // Poll for updates
     void poll();
     
+    // Registers the webhook listener, or the poll timer in poll mode
+    bool attach_reactor(Reactor& reactor);
+    
+    // Recently seen message ids kept across a hot restart, so a delivery
+    // Meta retries during the upgrade is not handled twice
+    Json save_state() const override;
+    void restore_state(const Json& state) override;
+    
     // Get mode for external inspection
     Mode mode() const;
 
 private:
+    enum Delivery {
+        DELIVERY_POLL,
+        DELIVERY_STREAM,
+        DELIVERY_WEBHOOK
+    };
+    
     std::string phone_number_id_;
     std::string access_token_;
     std::string bridge_url_;
     std::string api_base_;
-    HttpClient http_;
+    HttpClient http_;        // Verification and bridge polling
+    HttpClient send_http_;   // Used only on the send queue thread
+    WhatsAppSendQueue send_queue_;
+    int send_rate_;
     ChannelStatus status_;
     Mode mode_;
+    Delivery delivery_;
     int poll_interval_;
     int64_t last_poll_time_;
+    // Stream mode
+    std::string bridge_events_;
+    std::thread stream_thread_;
+    std::atomic<bool> should_stop_stream_;
+    // Webhook mode
+    std::string webhook_bind_;
+    int webhook_port_;
+    std::string webhook_path_;
+    std::string verify_token_;
+    std::string app_secret_;
+    WhatsAppWebhookServer webhook_;
+    MessageDebouncer message_dedup_;
     
     std::string normalize_phone(const std::string& phone);
     
     // Cloud API methods
     bool verify_cloud_api();
-    SendResult send_cloud_api(const std::string& to, const std::string& text,
-                              const std::string& reply_to = "");
+    WhatsAppSendQueue::Outcome send_cloud_api(const std::string& to, const std::string& text,
+                                              const std::string& reply_to);
+    void process_cloud_payload(const JsonView& payload);
     
     // Bridge mode methods
     bool verify_bridge();
-    SendResult send_bridge(const std::string& to, const std::string& text,
-                           const std::string& reply_to = "");
+    WhatsAppSendQueue::Outcome send_bridge(const std::string& to, const std::string& text,
+                                           const std::string& reply_to);
+    WhatsAppSendQueue::Outcome send_bridge_typing(const std::string& to);
     void poll_bridge();
-    void process_bridge_message(const Json& msg);
+    void stream_loop();
+    bool stream_bridge();
+    void process_bridge_payload(const JsonView& payload);
+    void process_bridge_message(const JsonView& msg);
+    
+    // Runs on the send queue thread
+    WhatsAppSendQueue::Outcome deliver(const WhatsAppSendQueue::Job& job);
 };
 
 } // namespace opencrank
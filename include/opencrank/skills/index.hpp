@@ -0,0 +1,73 @@
+/*
+ * opencrank C++ - Skill Index
+ *
+ * Persistent index of parsed SKILL.md files, keyed by path. A scan stats
+ * each SKILL.md and only reads files whose mtime or size changed; a file
+ * whose content hash is unchanged keeps its parsed entry. Entries keep
+ * frontmatter and metadata only: bodies are read when a skill is invoked.
+ *
+ * The index is saved as JSON so a restart skips parsing unchanged skills.
+ * Not thread-safe; SkillManager serializes access.
+ */
+#ifndef opencrank_SKILLS_INDEX_HPP
+#define opencrank_SKILLS_INDEX_HPP
+
+#include "types.hpp"
+#include "loader.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+namespace opencrank {
+
+class SkillIndex {
+public:
+    SkillIndex();
+
+    // Index file; empty keeps the index in memory only
+    void set_path(const std::string& path) { path_ = path; }
+    const std::string& path() const { return path_; }
+
+    // Read the index file (metadata is re-resolved from stored frontmatter)
+    bool load(SkillLoader& loader);
+
+    // Write the index file if anything changed since the last load/save
+    bool save();
+
+    // Mark the start of a full scan; end_scan() drops skills not seen since
+    void begin_scan();
+    void end_scan();
+
+    // Entries for every <dir>/<name>/SKILL.md, re-parsing only changed files
+    std::vector<SkillEntry> scan_dir(
+        SkillLoader& loader,
+        const std::string& dir,
+        const std::string& source);
+
+    size_t size() const { return records_.size(); }
+    bool dirty() const { return dirty_; }
+
+    // Counters for the last scan
+    size_t parsed() const { return parsed_; }
+    size_t reused() const { return reused_; }
+
+private:
+    struct Record {
+        SkillEntry entry;   // skill.content is always empty
+        uint64_t seen;      // Scan generation that last found this file
+
+        Record() : seen(0) {}
+    };
+
+    std::string path_;
+    std::map<std::string, Record> records_;  // SKILL.md path -> record
+    uint64_t generation_;
+    bool dirty_;
+    size_t parsed_;
+    size_t reused_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_SKILLS_INDEX_HPP
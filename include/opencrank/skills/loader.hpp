@@ -39,6 +39,9 @@ public:
     // Get the content after frontmatter (the actual skill instructions)
     std::string get_content_body(const std::string& content);
     
+    // Instructions of a skill, read from its SKILL.md when not in memory
+    std::string read_body(const Skill& skill);
+    
     // Format skill for prompt inclusion
     std::string format_skill_for_prompt(const Skill& skill);
     
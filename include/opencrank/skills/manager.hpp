@@ -9,9 +9,11 @@
 
 #include "types.hpp"
 #include "loader.hpp"
+#include "index.hpp"
 #include <string>
 #include <vector>
 #include <set>
+#include <mutex>
 
 namespace opencrank {
 
@@ -21,14 +23,22 @@ public:
     explicit SkillManager(const SkillsConfig& config);
     ~SkillManager();
     
-    // Set configuration
+    // Set configuration (also loads the skill index from config.index_path)
     void set_config(const SkillsConfig& config);
     const SkillsConfig& config() const { return config_; }
     
     // Load all skills from configured directories
     // Precedence: extra < bundled < managed < workspace
+    // Only SKILL.md files changed since the last call (or the saved index)
+    // are re-read; entries carry no body (see load_skill_body).
     std::vector<SkillEntry> load_workspace_skill_entries();
     
+    // Directories scanned by load_workspace_skill_entries, in precedence order
+    std::vector<std::string> skill_dirs() const;
+    
+    // Instructions of a skill (SKILL.md without frontmatter), read on demand
+    std::string load_skill_body(const SkillEntry& entry);
+    
     // Filter entries based on config and eligibility
     std::vector<SkillEntry> filter_skill_entries(
         const std::vector<SkillEntry>& entries,
@@ -84,7 +94,7 @@ public:
         const std::vector<SkillEntry>& entries,
         bool show_eligibility = true);
     
-    // Check if binary exists
+    // Check if binary exists (memoized, see SkillRequirementResolver)
     static bool has_binary(const std::string& bin);
     
     // Check if environment variable is set
@@ -99,6 +109,8 @@ public:
 private:
     SkillsConfig config_;
     SkillLoader loader_;
+    SkillIndex index_;
+    std::mutex mutex_;   // Guards loader_ and index_ (reloads run off the main thread)
     std::string last_error_;
     
     // Load skills from a specific directory
@@ -0,0 +1,81 @@
+/*
+ * opencrank C++ - Skill Requirement Resolver
+ *
+ * Process-wide memo of "is this binary on PATH" answers for skill
+ * eligibility checks. A lookup stats PATH once per binary; the answer is
+ * then reused until its TTL runs out, PATH itself changes, or one of the
+ * PATH directories changes (inotify: a binary installed, removed or made
+ * executable drops every cached answer).
+ *
+ * Environment variables are not memoized: getenv is a memory lookup and
+ * the value may legitimately change at runtime.
+ *
+ * Thread-safe.
+ */
+#ifndef opencrank_SKILLS_REQUIREMENTS_HPP
+#define opencrank_SKILLS_REQUIREMENTS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace opencrank {
+
+class SkillRequirementResolver {
+public:
+    static SkillRequirementResolver& instance();
+
+    // How long an answer stays valid without a PATH change (0 = until invalidated)
+    void set_ttl_ms(int64_t ttl_ms);
+
+    // Binary found as an executable file in one of the PATH directories
+    bool has_binary(const std::string& bin);
+
+    // Environment variable set and non-empty
+    bool has_env(const std::string& var);
+
+    // Forget every cached answer
+    void invalidate();
+
+    // Stats
+    uint64_t lookups() const { return lookups_.load(); }
+    uint64_t probes() const { return probes_.load(); }          // Lookups that hit the filesystem
+    uint64_t invalidations() const { return invalidations_.load(); }
+    uint64_t probe_us() const { return probe_us_.load(); }      // Time spent probing PATH
+
+private:
+    SkillRequirementResolver();
+    ~SkillRequirementResolver();
+    SkillRequirementResolver(const SkillRequirementResolver&);
+    SkillRequirementResolver& operator=(const SkillRequirementResolver&);
+
+    struct Answer {
+        bool found;
+        int64_t checked_ms;
+    };
+
+    // Callers hold mutex_
+    void sync_path_locked();
+    void drain_watch_locked();
+    bool probe_locked(const std::string& bin) const;
+
+    std::mutex mutex_;
+    bool path_synced_;
+    std::string path_env_;                  // PATH the cache was built for
+    std::vector<std::string> path_dirs_;
+    std::map<std::string, Answer> binaries_;
+    int64_t ttl_ms_;
+    int watch_fd_;                          // inotify over path_dirs_ (-1 if unavailable)
+
+    std::atomic<uint64_t> lookups_;
+    std::atomic<uint64_t> probes_;
+    std::atomic<uint64_t> invalidations_;
+    std::atomic<uint64_t> probe_us_;
+};
+
+} // namespace opencrank
+
+#endif // opencrank_SKILLS_REQUIREMENTS_HPP
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <cstdint>
 
 namespace opencrank {
 
@@ -93,7 +94,12 @@ struct Skill {
     std::string file_path;   // Path to SKILL.md
     std::string base_dir;    // Directory containing the skill
     std::string source;      // Source: "workspace", "managed", "bundled", "extra"
-    std::string content;     // Full content of SKILL.md
+    std::string content;     // Full content of SKILL.md (dropped once indexed)
+    int64_t mtime_ns;        // SKILL.md modification time
+    uint64_t size;           // SKILL.md size in bytes
+    uint64_t content_hash;   // fnv1a_64 of SKILL.md
+    
+    Skill() : mtime_ns(0), size(0), content_hash(0) {}
     
     bool empty() const { return name.empty(); }
 };
@@ -135,6 +141,12 @@ struct SkillSnapshot {
     bool empty() const { return skills.empty(); }
 };
 
+// Loaded skill set handed to message handlers; replaced wholesale on reload
+struct SkillCatalog {
+    std::vector<SkillEntry> entries;         // Eligible entries
+    std::vector<SkillCommandSpec> commands;  // Chat commands of user-invocable skills
+};
+
 // Configuration for skill loading
 struct SkillsConfig {
     std::string workspace_dir;
@@ -142,6 +154,7 @@ struct SkillsConfig {
     std::string bundled_skills_dir;  // Built-in skills
     std::vector<std::string> extra_dirs;
     std::vector<std::string> skill_filter; // If set, only include these skills
+    std::string index_path;  // Persistent skill index (empty = in memory only)
     
     // Installation preferences
     bool prefer_brew;
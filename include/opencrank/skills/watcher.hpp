@@ -0,0 +1,49 @@
+/*
+ * opencrank C++ - Skill Directory Watcher
+ *
+ * inotify watch over the skill roots and each skill directory beneath
+ * them. The application registers fd() with the reactor and reloads the
+ * skill set when drain() reports a relevant change (a SKILL.md written,
+ * moved or deleted, or a skill directory added or removed). Edits to other
+ * files next to SKILL.md are ignored.
+ *
+ * Roots that do not exist when watch() is called are not picked up until
+ * the next watch() call.
+ */
+#ifndef opencrank_SKILLS_WATCHER_HPP
+#define opencrank_SKILLS_WATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace opencrank {
+
+class SkillWatcher {
+public:
+    SkillWatcher();
+    ~SkillWatcher();
+
+    // (Re)watch roots and their subdirectories; safe to call after a reload
+    bool watch(const std::vector<std::string>& roots);
+    void stop();
+
+    // inotify descriptor (-1 when not watching)
+    int fd() const { return fd_; }
+
+    // Read pending events; true if any of them should trigger a reload
+    bool drain();
+
+private:
+    SkillWatcher(const SkillWatcher&);
+    SkillWatcher& operator=(const SkillWatcher&);
+
+    void add(const std::string& path, bool root);
+
+    int fd_;
+    std::map<int, bool> watches_;   // wd -> is a skill root
+};
+
+} // namespace opencrank
+
+#endif // opencrank_SKILLS_WATCHER_HPP
@@ -0,0 +1,303 @@
+/*
+ * OpenCrank C++ - Fair-Share Scheduler for Model Calls Implementation
+ */
+#include <opencrank/ai/fair_share.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <condition_variable>
+#include <chrono>
+
+namespace opencrank {
+
+namespace {
+const int64_t CANCEL_POLL_MS = 100;     // acquire() looks at its cancel flag this often
+} // namespace
+
+FairShareScheduler& FairShareScheduler::instance() {
+    static FairShareScheduler scheduler;
+    return scheduler;
+}
+
+FairShareScheduler::FairShareScheduler()
+    : max_concurrent_(0)
+    , max_per_user_(0)
+    , by_user_(true)
+    , default_weight_(1.0)
+    , next_id_(1)
+    , in_flight_(0)
+    , queued_(0)
+    , vclock_(0.0)
+    , stopped_(false) {
+    Metrics& metrics = Metrics::instance();
+    queued_gauge_ = &metrics.gauge("opencrank_llm_queued", "Model calls waiting for a fair-share slot");
+    in_flight_gauge_ = &metrics.gauge("opencrank_llm_in_flight", "Model calls holding a fair-share slot");
+    const char* help = "Time model calls waited for a fair-share slot";
+    wait_first_ = &metrics.histogram("opencrank_llm_queue_wait_seconds", help, metric_labels("turn", "first"));
+    wait_loop_ = &metrics.histogram("opencrank_llm_queue_wait_seconds", help, metric_labels("turn", "tool_loop"));
+}
+
+void FairShareScheduler::configure(const Config& cfg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_concurrent_ = static_cast<int>(cfg.get_int("llm_scheduler.max_concurrent", 0));
+    max_per_user_ = static_cast<int>(cfg.get_int("llm_scheduler.max_per_user", 0));
+    by_user_ = cfg.get_string("llm_scheduler.key", "user") != "session";
+    default_weight_ = 1.0;
+    overrides_.clear();
+
+    const Json& section = cfg.get_section("llm_scheduler");
+    if (section.is_object()) {
+        default_weight_ = section.value("default_weight", 1.0);
+        if (default_weight_ <= 0) default_weight_ = 1.0;
+        const Json& users = section.contains("users") ? section["users"] : Json();
+        for (Json::const_iterator it = users.begin(); users.is_object() && it != users.end(); ++it) {
+            if (!it.value().is_object()) continue;
+            double weight = it.value().value("weight", default_weight_);
+            int cap = it.value().value("max_concurrent", max_per_user_);
+            if (weight <= 0) {
+                LOG_WARN("[FairShare] %s has weight %.2f, using %.2f", it.key().c_str(), weight, default_weight_);
+                weight = default_weight_;
+            }
+            overrides_[it.key()] = std::make_pair(weight, cap);
+        }
+    }
+
+    if (max_concurrent_ > 0 || max_per_user_ > 0 || !overrides_.empty()) {
+        LOG_INFO("[FairShare] Model calls: %d at once, %d per account (0 = unlimited), keyed by %s, %zu weighted account(s)",
+                 max_concurrent_, max_per_user_, by_user_ ? "user" : "session", overrides_.size());
+    }
+}
+
+void FairShareScheduler::set_executor(const Executor& executor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    executor_ = executor;
+}
+
+bool FairShareScheduler::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !stopped_ && (max_concurrent_ > 0 || max_per_user_ > 0 || !overrides_.empty());
+}
+
+std::string FairShareScheduler::account_for(const std::string& session_key, const std::string& user_key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return by_user_ && !user_key.empty() ? user_key : session_key;
+}
+
+void FairShareScheduler::submit(const std::string& account, bool first_turn,
+                                const std::atomic<bool>* cancel, const Grant& grant) {
+    std::vector<Waiter> admitted;
+    uint64_t own = enqueue(account, first_turn, cancel, grant, false, admitted);
+    run_grants(admitted, true, own);
+}
+
+bool FairShareScheduler::acquire(const std::string& account, bool first_turn, const std::atomic<bool>* cancel) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int state = -1;     // -1 waiting, 0 refused, 1 admitted
+    Grant grant = [&mutex, &cv, &state](bool admitted) {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = admitted ? 1 : 0;
+        cv.notify_one();
+    };
+
+    std::vector<Waiter> admitted;
+    uint64_t own = enqueue(account, first_turn, cancel, grant, true, admitted);
+    run_grants(admitted, true, own);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (state < 0) {
+        cv.wait_for(lock, std::chrono::milliseconds(CANCEL_POLL_MS));
+        if (state < 0 && cancel && cancel->load()) {
+            lock.unlock();
+            wake_cancelled();   // Refuses this call too
+            lock.lock();
+        }
+    }
+    return state == 1;
+}
+
+uint64_t FairShareScheduler::enqueue(const std::string& account, bool first_turn, const std::atomic<bool>* cancel,
+                                     const Grant& grant, bool blocking, std::vector<Waiter>& admitted) {
+    Waiter waiter;
+    waiter.id = 0;
+    waiter.cancel = cancel;
+    waiter.grant = grant;
+    waiter.queued_ms = current_timestamp_ms();
+    waiter.first_turn = first_turn;
+    waiter.blocking = blocking;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_ || (max_concurrent_ <= 0 && max_per_user_ <= 0 && overrides_.empty())) {
+        admitted.push_back(waiter);     // Unscheduled: id 0 runs on this thread
+        return 0;
+    }
+
+    Account& a = account_locked(account);
+    if (a.in_flight == 0 && a.first_turns.empty() && a.tool_loop.empty() && a.vtime < vclock_) {
+        a.vtime = vclock_;      // Back from idle: no credit for the time away
+    }
+    waiter.id = next_id_++;
+    (first_turn ? a.first_turns : a.tool_loop).push_back(waiter);
+    ++queued_;
+    dispatch_locked(admitted);
+    return waiter.id;
+}
+
+void FairShareScheduler::release(const std::string& account, int64_t tokens) {
+    std::vector<Waiter> admitted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) return;
+        std::map<std::string, Account>::iterator it = accounts_.find(account);
+        if (it == accounts_.end() || it->second.in_flight <= 0) return;
+
+        Account& a = it->second;
+        a.in_flight--;
+        in_flight_--;
+        // A failed call with no usage still took a turn
+        a.vtime += static_cast<double>(tokens > 0 ? tokens : 1) / a.weight;
+        dispatch_locked(admitted);
+        forget_idle_locked();
+    }
+    run_grants(admitted, true, 0);
+}
+
+void FairShareScheduler::wake_cancelled() {
+    std::vector<Waiter> refused;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::map<std::string, Account>::iterator it = accounts_.begin(); it != accounts_.end(); ++it) {
+            std::deque<Waiter>* queues[2] = { &it->second.first_turns, &it->second.tool_loop };
+            for (int q = 0; q < 2; ++q) {
+                std::deque<Waiter>::iterator w = queues[q]->begin();
+                while (w != queues[q]->end()) {
+                    if (w->cancel && w->cancel->load()) {
+                        refused.push_back(*w);
+                        w = queues[q]->erase(w);
+                        --queued_;
+                    } else {
+                        ++w;
+                    }
+                }
+            }
+        }
+        if (refused.empty()) return;
+        queued_gauge_->set(static_cast<int64_t>(queued_));
+        forget_idle_locked();
+    }
+    LOG_DEBUG("[FairShare] %zu cancelled call(s) left the queue", refused.size());
+    run_grants(refused, false, 0);
+}
+
+void FairShareScheduler::stop() {
+    std::vector<Waiter> refused;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) return;
+        stopped_ = true;
+        for (std::map<std::string, Account>::iterator it = accounts_.begin(); it != accounts_.end(); ++it) {
+            refused.insert(refused.end(), it->second.first_turns.begin(), it->second.first_turns.end());
+            refused.insert(refused.end(), it->second.tool_loop.begin(), it->second.tool_loop.end());
+        }
+        accounts_.clear();
+        queued_ = 0;
+        in_flight_ = 0;
+        queued_gauge_->set(0);
+        in_flight_gauge_->set(0);
+    }
+    if (!refused.empty()) {
+        LOG_DEBUG("[FairShare] Refusing %zu queued call(s) at shutdown", refused.size());
+    }
+    run_grants(refused, false, 0);
+    set_executor(Executor());
+}
+
+size_t FairShareScheduler::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+size_t FairShareScheduler::in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<size_t>(in_flight_);
+}
+
+FairShareScheduler::Account& FairShareScheduler::account_locked(const std::string& key) {
+    std::map<std::string, Account>::iterator it = accounts_.find(key);
+    if (it != accounts_.end()) return it->second;
+
+    Account& a = accounts_[key];
+    std::map<std::string, std::pair<double, int> >::const_iterator o = overrides_.find(key);
+    a.weight = o != overrides_.end() ? o->second.first : default_weight_;
+    a.cap = o != overrides_.end() ? o->second.second : max_per_user_;
+    a.vtime = vclock_;
+    return a;
+}
+
+void FairShareScheduler::dispatch_locked(std::vector<Waiter>& admitted) {
+    int64_t now = current_timestamp_ms();
+    while (max_concurrent_ <= 0 || in_flight_ < max_concurrent_) {
+        // First turns before tool-loop iterations, then the least virtual time
+        std::map<std::string, Account>::iterator best = accounts_.end();
+        bool best_first = false;
+        for (std::map<std::string, Account>::iterator it = accounts_.begin(); it != accounts_.end(); ++it) {
+            Account& a = it->second;
+            if (a.first_turns.empty() && a.tool_loop.empty()) continue;
+            if (a.cap > 0 && a.in_flight >= a.cap) continue;
+            bool first = !a.first_turns.empty();
+            if (best == accounts_.end() || (first && !best_first) ||
+                (first == best_first && a.vtime < best->second.vtime)) {
+                best = it;
+                best_first = first;
+            }
+        }
+        if (best == accounts_.end()) break;
+
+        Account& a = best->second;
+        std::deque<Waiter>& queue = best_first ? a.first_turns : a.tool_loop;
+        Waiter waiter = queue.front();
+        queue.pop_front();
+        --queued_;
+        a.in_flight++;
+        in_flight_++;
+        if (a.vtime > vclock_) vclock_ = a.vtime;
+        (waiter.first_turn ? wait_first_ : wait_loop_)->observe(static_cast<double>(now - waiter.queued_ms) / 1000.0);
+        admitted.push_back(waiter);
+    }
+    queued_gauge_->set(static_cast<int64_t>(queued_));
+    in_flight_gauge_->set(in_flight_);
+}
+
+// Accounts with nothing running or queued and no debt carry no state: one
+// coming back would start at vclock_ anyway
+void FairShareScheduler::forget_idle_locked() {
+    std::map<std::string, Account>::iterator it = accounts_.begin();
+    while (it != accounts_.end()) {
+        const Account& a = it->second;
+        if (a.in_flight == 0 && a.first_turns.empty() && a.tool_loop.empty() && a.vtime <= vclock_) {
+            accounts_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FairShareScheduler::run_grants(std::vector<Waiter>& waiters, bool admitted, uint64_t own) {
+    if (waiters.empty()) return;
+    Executor executor;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        executor = executor_;
+    }
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        Waiter& w = waiters[i];
+        if (w.id == own || w.blocking || !executor) {
+            w.grant(admitted);
+        } else {
+            Grant grant = w.grant;
+            executor([grant, admitted]() { grant(admitted); });
+        }
+    }
+}
+
+} // namespace opencrank
@@ -0,0 +1,93 @@
+/*
+ * OpenCrank C++ - Per-purpose Models Implementation
+ */
+#include <opencrank/ai/models.hpp>
+#include <opencrank/core/registry.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/trace.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+
+namespace opencrank {
+
+const char* const PURPOSE_CHAT = "chat";
+const char* const PURPOSE_RESUME = "resume";
+const char* const PURPOSE_CLASSIFY = "classify";
+
+PurposeModels& PurposeModels::instance() {
+    static PurposeModels models;
+    return models;
+}
+
+void PurposeModels::configure(const Config& cfg) {
+    entries_.clear();
+    const Json& section = cfg.get_section("models");
+    if (!section.is_object()) return;
+
+    PluginRegistry& registry = PluginRegistry::instance();
+    for (Json::const_iterator it = section.begin(); it != section.end(); ++it) {
+        if (!it.key().empty() && it.key()[0] == '_') continue;  // _note etc.
+        Entry entry;
+        std::string provider;
+        if (it.value().is_string()) {
+            provider = it.value().get<std::string>();
+        } else if (it.value().is_object()) {
+            provider = it.value().value("provider", std::string());
+            entry.model = it.value().value("model", std::string());
+        }
+        entry.ai = provider.empty() ? NULL : registry.get_ai(provider);
+        if (!entry.ai || !entry.ai->is_initialized() || !entry.ai->is_configured()) {
+            LOG_WARN("[Models] %s: AI provider '%s' is not available, using the default",
+                     it.key().c_str(), provider.c_str());
+            continue;
+        }
+        entries_[it.key()] = entry;
+        LOG_INFO("[Models] %s -> %s (%s)", it.key().c_str(), provider.c_str(),
+                 entry.model.empty() ? entry.ai->default_model().c_str() : entry.model.c_str());
+    }
+}
+
+bool PurposeModels::has(const char* purpose) const {
+    return entries_.find(purpose) != entries_.end();
+}
+
+AIPlugin* PurposeModels::resolve(const char* purpose, AIPlugin* fallback, CompletionOptions& opts) const {
+    std::map<std::string, Entry>::const_iterator it = entries_.find(purpose);
+    if (it == entries_.end()) return fallback;
+    if (!it->second.model.empty()) {
+        opts.model = it->second.model;
+    }
+    return it->second.ai;
+}
+
+CompletionResult PurposeModels::chat(const char* purpose, AIPlugin* fallback,
+                                     const std::vector<ConversationMessage>& messages,
+                                     const CompletionOptions& opts) const {
+    CompletionOptions purpose_opts = opts;
+    AIPlugin* ai = resolve(purpose, fallback, purpose_opts);
+    if (!ai) return CompletionResult::fail("No AI provider for " + std::string(purpose));
+
+    for (;;) {
+        ScopedSpan span("chat " + ai->provider_id(), "llm");
+        span.set("purpose", purpose);
+        int64_t start = current_timestamp_ms();
+        CompletionResult result = ai->chat(messages, purpose_opts);
+        record_llm_request(ai->provider_id(), purpose, static_cast<double>(current_timestamp_ms() - start) / 1000.0,
+                           result.success, result.usage.input_tokens, result.usage.output_tokens,
+                           result.usage.cached_tokens);
+        span.set("model", result.model);
+        span.set("success", result.success);
+        span.set("input_tokens", result.usage.input_tokens);
+        span.set("output_tokens", result.usage.output_tokens);
+
+        if (result.success || ai == fallback || !fallback) {
+            return result;
+        }
+        LOG_WARN("[Models] %s on %s failed (%s), retrying on %s", purpose, ai->provider_id().c_str(),
+                 result.error.c_str(), fallback->provider_id().c_str());
+        ai = fallback;
+        purpose_opts = opts;
+    }
+}
+
+} // namespace opencrank
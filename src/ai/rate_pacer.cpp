@@ -0,0 +1,305 @@
+/*
+ * OpenCrank C++ - Provider Rate Pacing Implementation
+ */
+#include <opencrank/ai/rate_pacer.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <curl/curl.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <strings.h>
+
+namespace opencrank {
+
+namespace {
+
+const int64_t SLEEP_SLICE_MS = 100;     // Cancellation checks while pacing
+
+std::mt19937& thread_rng() {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+// Header value by case-insensitive name (HTTP/2 sends them lowercase,
+// HTTP/1.1 servers as they like)
+const std::string* find_header(const std::map<std::string, std::string>& headers, const char* name) {
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (strcasecmp(it->first.c_str(), name) == 0) return &it->second;
+    }
+    return nullptr;
+}
+
+bool parse_number(const std::string& value, double& out) {
+    char* end = nullptr;
+    out = std::strtod(value.c_str(), &end);
+    return end != value.c_str() && *end == '\0';
+}
+
+// "1m30.5s", "20ms", "2h0m0s" (x-ratelimit-reset-* of OpenAI-style APIs)
+bool parse_duration_ms(const std::string& value, int64_t& out) {
+    double total = 0;
+    const char* p = value.c_str();
+    bool any = false;
+    while (*p) {
+        char* end = nullptr;
+        double n = std::strtod(p, &end);
+        if (end == p) return false;
+        p = end;
+        if (p[0] == 'm' && p[1] == 's') { total += n; p += 2; }
+        else if (*p == 'h') { total += n * 3600000.0; ++p; }
+        else if (*p == 'm') { total += n * 60000.0; ++p; }
+        else if (*p == 's') { total += n * 1000.0; ++p; }
+        else return false;
+        any = true;
+    }
+    out = static_cast<int64_t>(total);
+    return any;
+}
+
+// Absolute time (ms) of a window reset: RFC 3339, a duration, epoch
+// seconds or milliseconds, or seconds from now. 0 if unreadable.
+int64_t parse_reset_ms(const std::string& value, int64_t now_ms) {
+    int year, month, day, hour, minute, second;
+    if (value.find('T') != std::string::npos &&
+        std::sscanf(value.c_str(), "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6) {
+        struct tm tm = {};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_min = minute;
+        tm.tm_sec = second;
+        return static_cast<int64_t>(timegm(&tm)) * 1000;
+    }
+    double n;
+    if (parse_number(value, n)) {
+        if (n > 1e12) return static_cast<int64_t>(n);
+        if (n > 1e9) return static_cast<int64_t>(n * 1000.0);
+        return now_ms + static_cast<int64_t>(n * 1000.0);
+    }
+    int64_t duration;
+    if (parse_duration_ms(value, duration)) return now_ms + duration;
+    return 0;
+}
+
+// Retry-After: seconds or an HTTP date. -1 if absent or unreadable.
+int64_t parse_retry_after_ms(const std::map<std::string, std::string>& headers, int64_t now_ms) {
+    const std::string* value = find_header(headers, "retry-after-ms");
+    double n;
+    if (value && parse_number(*value, n)) return static_cast<int64_t>(n);
+    value = find_header(headers, "retry-after");
+    if (!value) return -1;
+    if (parse_number(*value, n)) return static_cast<int64_t>(n * 1000.0);
+    time_t date = curl_getdate(value->c_str(), nullptr);
+    if (date < 0) return -1;
+    return std::max<int64_t>(0, static_cast<int64_t>(date) * 1000 - now_ms);
+}
+
+// Remaining/reset header pairs; requests marks the request-count windows
+struct WindowHeaders {
+    const char* remaining;
+    const char* reset;
+    bool requests;
+};
+
+const WindowHeaders WINDOW_HEADERS[] = {
+    {"anthropic-ratelimit-requests-remaining", "anthropic-ratelimit-requests-reset", true},
+    {"anthropic-ratelimit-tokens-remaining", "anthropic-ratelimit-tokens-reset", false},
+    {"anthropic-ratelimit-input-tokens-remaining", "anthropic-ratelimit-input-tokens-reset", false},
+    {"anthropic-ratelimit-output-tokens-remaining", "anthropic-ratelimit-output-tokens-reset", false},
+    {"x-ratelimit-remaining-requests", "x-ratelimit-reset-requests", true},
+    {"x-ratelimit-remaining-tokens", "x-ratelimit-reset-tokens", false},
+    {"x-ratelimit-remaining", "x-ratelimit-reset", true},
+};
+
+const char* const LIMIT_HEADERS[] = {
+    "anthropic-ratelimit-requests-limit",
+    "x-ratelimit-limit-requests",
+    "x-ratelimit-limit",
+};
+
+} // anonymous namespace
+
+RetryPolicy RetryPolicy::from_config(const Config& cfg, const std::string& section) {
+    RetryPolicy policy;
+    policy.max_retries = static_cast<int>(std::max<int64_t>(0, cfg.get_int(section + ".max_retries", 3)));
+    policy.base_delay_ms = std::max<int64_t>(1, cfg.get_int(section + ".retry_base_ms", 1000));
+    policy.max_delay_ms = std::max<int64_t>(0, cfg.get_int(section + ".retry_max_ms", 60000));
+    policy.rate_limit_rpm = static_cast<int>(std::max<int64_t>(0, cfg.get_int(section + ".rate_limit_rpm", 0)));
+    return policy;
+}
+
+RatePacer& RatePacer::get(const std::string& provider, const std::string& api_key, const RetryPolicy& policy) {
+    static std::mutex registry_mutex;
+    static std::map<std::string, RatePacer*> registry;
+
+    // Keyed by a hash so the key itself is not kept twice
+    char key[96];
+    std::snprintf(key, sizeof(key), "%.64s:%016llx", provider.c_str(),
+                  static_cast<unsigned long long>(fnv1a_64(api_key)));
+
+    RatePacer* pacer;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        std::map<std::string, RatePacer*>::iterator it = registry.find(key);
+        if (it == registry.end()) {
+            it = registry.insert(std::make_pair(std::string(key), new RatePacer(provider))).first;
+        }
+        pacer = it->second;
+    }
+    pacer->set_policy(policy);
+    return *pacer;
+}
+
+RatePacer::RatePacer(const std::string& provider)
+    : provider_(provider)
+    , bucket_(1, 1)
+    , limit_(0)
+    , blocked_until_ms_(0) {
+    Metrics& metrics = Metrics::instance();
+    std::string labels = metric_labels("provider", provider);
+    rejected_ = &metrics.counter("opencrank_provider_rate_limited_total",
+                                 "Requests the provider rejected for load (HTTP 429, 503, 529)", labels);
+    retries_ = &metrics.counter("opencrank_provider_retries_total",
+                                "Rejected requests sent again after a backoff", labels);
+    gave_up_ = &metrics.counter("opencrank_provider_rate_limit_failures_total",
+                                "Requests failed because the provider's limit did not clear in time", labels);
+    remaining_ = &metrics.gauge("opencrank_provider_rate_limit_remaining",
+                                "Requests left in the provider's window, as last reported", labels);
+    wait_seconds_ = &metrics.histogram("opencrank_provider_pacing_seconds",
+                                       "Time requests were held back for a provider's rate limit", labels);
+}
+
+void RatePacer::set_policy(const RetryPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    if (limit_ == 0 && policy.rate_limit_rpm > 0) {
+        bucket_.set_rate(policy.rate_limit_rpm, policy.rate_limit_rpm / 60.0);
+        bucket_.reset();
+    }
+}
+
+int64_t RatePacer::max_delay_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_.max_delay_ms;
+}
+
+void RatePacer::learn_limit_locked(int per_minute) {
+    if (per_minute <= 0 || per_minute == limit_) return;
+    if (limit_ == 0) {
+        LOG_DEBUG("[RatePacer] %s allows %d requests/min", provider_.c_str(), per_minute);
+    }
+    limit_ = per_minute;
+    // Bursts up to the whole window, as the provider's own bucket allows
+    bucket_.set_rate(per_minute, per_minute / 60.0);
+}
+
+int64_t RatePacer::reserve(int64_t backoff_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = current_timestamp_ms();
+    int64_t wait_ms = std::max<int64_t>(backoff_ms, blocked_until_ms_ - now);
+    if (limit_ > 0 || policy_.rate_limit_rpm > 0) {
+        RateLimitResult slot = bucket_.reserve();
+        if (!slot.allowed) {
+            wait_ms = std::max(wait_ms, slot.retry_after_ms);
+        }
+    }
+    if (wait_ms > policy_.max_delay_ms) {
+        gave_up_->inc();
+    } else if (wait_ms > 0) {
+        wait_seconds_->observe(static_cast<double>(wait_ms) / 1000.0);
+    }
+    return std::max<int64_t>(0, wait_ms);
+}
+
+bool RatePacer::pace(const std::atomic<bool>* cancel, int64_t backoff_ms, std::string& error) {
+    int64_t wait_ms = reserve(backoff_ms);
+    if (wait_ms > max_delay_ms()) {
+        error = too_long(wait_ms);
+        return false;
+    }
+    if (wait_ms > 0) {
+        LOG_DEBUG("[RatePacer] %s: holding request %lld ms", provider_.c_str(), static_cast<long long>(wait_ms));
+    }
+    int64_t until = current_timestamp_ms() + wait_ms;
+    for (;;) {
+        if (cancel && cancel->load()) {
+            error = "Request cancelled";
+            return false;
+        }
+        int64_t left = until - current_timestamp_ms();
+        if (left <= 0) return true;
+        sleep_ms(static_cast<int>(std::min(left, SLEEP_SLICE_MS)));
+    }
+}
+
+std::string RatePacer::too_long(int64_t wait_ms) const {
+    return "Rate limited by " + provider_ + " (retry in " + std::to_string((wait_ms + 999) / 1000) + "s)";
+}
+
+bool RatePacer::should_retry(const HttpResponse& response, int attempt, int64_t& backoff_ms) {
+    if (response.status_code == 0) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = current_timestamp_ms();
+    const std::map<std::string, std::string>& headers = response.headers;
+
+    for (size_t i = 0; i < sizeof(LIMIT_HEADERS) / sizeof(LIMIT_HEADERS[0]); ++i) {
+        const std::string* value = find_header(headers, LIMIT_HEADERS[i]);
+        double n;
+        if (value && parse_number(*value, n)) {
+            learn_limit_locked(static_cast<int>(n));
+            break;
+        }
+    }
+    for (size_t i = 0; i < sizeof(WINDOW_HEADERS) / sizeof(WINDOW_HEADERS[0]); ++i) {
+        const std::string* value = find_header(headers, WINDOW_HEADERS[i].remaining);
+        double remaining;
+        if (!value || !parse_number(*value, remaining)) continue;
+        if (WINDOW_HEADERS[i].requests) {
+            remaining_->set(static_cast<int64_t>(remaining));
+            if (limit_ > 0) bucket_.limit_to(static_cast<int>(remaining));
+        }
+        if (remaining < 1) {
+            // Window used up: nobody gets through before it resets. Capped,
+            // since a window header is only a hint and Retry-After is not.
+            const std::string* reset = find_header(headers, WINDOW_HEADERS[i].reset);
+            int64_t reset_ms = reset ? parse_reset_ms(*reset, now) : 0;
+            if (reset_ms > now) {
+                blocked_until_ms_ = std::max(blocked_until_ms_, std::min(reset_ms, now + policy_.max_delay_ms));
+            }
+        }
+    }
+
+    long status = response.status_code;
+    if (status != 429 && status != 503 && status != 529) return false;
+    rejected_->inc();
+
+    int64_t retry_after = parse_retry_after_ms(headers, now);
+    if (retry_after >= 0) {
+        blocked_until_ms_ = std::max(blocked_until_ms_, now + retry_after);
+    }
+    if (attempt >= policy_.max_retries) {
+        gave_up_->inc();
+        return false;
+    }
+
+    // Full exponential step with +-50% jitter, so requests rejected together
+    // do not come back together
+    double step = static_cast<double>(policy_.base_delay_ms) * static_cast<double>(1LL << std::min(attempt, 20));
+    std::uniform_real_distribution<double> jitter(0.5, 1.5);
+    backoff_ms = std::min(policy_.max_delay_ms, static_cast<int64_t>(step * jitter(thread_rng())));
+    retries_->inc();
+    LOG_WARN("[RatePacer] %s answered HTTP %ld, retry %d/%d in %lld ms%s", provider_.c_str(), status,
+             attempt + 1, policy_.max_retries,
+             static_cast<long long>(std::max(backoff_ms, blocked_until_ms_ - now)),
+             retry_after >= 0 ? " (Retry-After)" : "");
+    return true;
+}
+
+} // namespace opencrank
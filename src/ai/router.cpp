@@ -0,0 +1,476 @@
+/*
+ * OpenCrank C++ - AI Router Implementation
+ */
+#include <opencrank/ai/router.hpp>
+#include <opencrank/core/registry.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/cancel_token.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <random>
+
+namespace opencrank {
+
+namespace {
+
+const double EWMA_ALPHA = 0.2;
+const size_t RECENT_SAMPLES = 64;
+const size_t MIN_P95_SAMPLES = 8;
+
+// Keeps a hedge slot's flag linked to the caller's token while the caller waits
+class TokenLink {
+public:
+    TokenLink(CancelToken* token, std::atomic<bool>* flag) : token_(token), flag_(flag) {
+        if (token_) token_->link(flag_);
+    }
+    ~TokenLink() {
+        if (token_) token_->unlink(flag_);
+    }
+private:
+    TokenLink(const TokenLink&);
+    TokenLink& operator=(const TokenLink&);
+    CancelToken* token_;
+    std::atomic<bool>* flag_;
+};
+
+std::mt19937& thread_rng() {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+} // anonymous namespace
+
+// Shared by the caller and the hedge task. Slot 0 is the primary, slot 1
+// the hedge; owner is the slot whose reply goes to the caller.
+struct AIRouter::HedgeState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<bool> cancel[2];
+    int owner;
+    bool primary_done;
+    bool hedge_started;
+    bool hedge_done;
+    bool hedge_streamed;
+    CompletionResult hedge_result;
+
+    HedgeState() : owner(-1), primary_done(false), hedge_started(false),
+                   hedge_done(false), hedge_streamed(false) {
+        cancel[0] = false;
+        cancel[1] = false;
+    }
+
+    // First slot to stream or answer owns the request; the other is cancelled
+    bool claim(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (owner == -1) {
+            owner = slot;
+            cancel[1 - slot] = true;
+            cv.notify_all();
+        }
+        return owner == slot;
+    }
+};
+
+AIRouter::AIRouter()
+    : pool_(nullptr)
+    , failover_(true)
+    , max_failures_(3)
+    , cooldown_ms_(30000)
+    , hedge_(false)
+    , hedge_delay_ms_(2000)
+    , hedge_min_ms_(300)
+    , hedge_max_prompt_chars_(24000)
+    , failovers_(nullptr)
+    , hedges_sent_(nullptr) {}
+
+const char* AIRouter::name() const { return "AI Router"; }
+const char* AIRouter::version() const { return "1.0.0"; }
+const char* AIRouter::description() const {
+    return "Routes requests over several AI providers with failover and hedging";
+}
+
+bool AIRouter::configured_in(const Config& cfg) {
+    const Json& section = cfg.get_section("router");
+    return section.is_object() && section.contains("backends") &&
+           section["backends"].is_array() && !section["backends"].empty();
+}
+
+std::vector<std::string> AIRouter::init_after(const Config& cfg) const {
+    std::vector<std::string> providers;
+    const Json& section = cfg.get_section("router");
+    const Json& list = section.is_object() && section.contains("backends") ? section["backends"] : Json();
+    for (size_t i = 0; list.is_array() && i < list.size(); ++i) {
+        if (list[i].is_string()) {
+            providers.push_back(list[i].get<std::string>());
+        } else if (list[i].is_object()) {
+            providers.push_back(list[i].value("provider", std::string()));
+        }
+    }
+    return providers;
+}
+
+bool AIRouter::init(const Config& cfg) {
+    failover_ = cfg.get_bool("router.failover", true);
+    max_failures_ = std::max(1, static_cast<int>(cfg.get_int("router.max_failures", 3)));
+    cooldown_ms_ = std::max<int64_t>(0, cfg.get_int("router.cooldown_ms", 30000));
+    hedge_ = cfg.get_bool("router.hedge", false);
+    hedge_delay_ms_ = std::max<int64_t>(0, cfg.get_int("router.hedge_delay_ms", 2000));
+    hedge_min_ms_ = std::max<int64_t>(0, cfg.get_int("router.hedge_min_ms", 300));
+    hedge_max_prompt_chars_ = static_cast<size_t>(
+        std::max<int64_t>(0, cfg.get_int("router.hedge_max_prompt_chars", 24000)));
+
+    Metrics& metrics = Metrics::instance();
+    failovers_ = &metrics.counter("opencrank_router_failovers_total",
+                                  "Requests retried on another backend after an error");
+    hedges_sent_ = &metrics.counter("opencrank_router_hedges_total",
+                                    "Hedged requests sent to a second backend");
+
+    backends_.clear();
+    const Json& section = cfg.get_section("router");
+    const Json& list = section.is_object() && section.contains("backends") ? section["backends"] : Json();
+    PluginRegistry& registry = PluginRegistry::instance();
+    for (size_t i = 0; list.is_array() && i < list.size(); ++i) {
+        const Json& entry = list[i];
+        Backend b;
+        if (entry.is_string()) {
+            b.provider = entry.get<std::string>();
+            b.weight = 1.0;
+        } else if (entry.is_object()) {
+            b.provider = entry.value("provider", std::string());
+            b.model = entry.value("model", std::string());
+            b.weight = entry.value("weight", 1.0);
+        }
+        b.ai = b.provider.empty() || b.provider == provider_id() ? nullptr : registry.get_ai(b.provider);
+        if (!b.ai) {
+            LOG_WARN("[Router] Backend %zu: unknown AI provider '%s', skipped", i, b.provider.c_str());
+            continue;
+        }
+        if (b.weight <= 0) {
+            LOG_WARN("[Router] Backend %s has weight %.2f, skipped", b.provider.c_str(), b.weight);
+            continue;
+        }
+        b.latency_ewma_ms = 0;
+        b.error_ewma = 0;
+        b.consecutive_failures = 0;
+        b.cooldown_until_ms = 0;
+        b.recent_next = 0;
+
+        std::string name = b.model.empty() ? b.provider : b.provider + "/" + b.model;
+        const char* help = "Requests per router backend and outcome";
+        b.ok = &metrics.counter("opencrank_router_requests_total", help,
+                                metric_labels("backend", name, "result", "ok"));
+        b.errors = &metrics.counter("opencrank_router_requests_total", help,
+                                    metric_labels("backend", name, "result", "error"));
+        b.cancelled = &metrics.counter("opencrank_router_requests_total", help,
+                                       metric_labels("backend", name, "result", "cancelled"));
+        b.hedges_won = &metrics.counter("opencrank_router_hedges_won_total",
+                                        "Hedged requests a backend answered first",
+                                        metric_labels("backend", name));
+        backends_.push_back(b);
+    }
+
+    metrics.add_collector("router", [this](MetricsWriter& w) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < backends_.size(); ++i) {
+            w.gauge("opencrank_router_latency_ewma_seconds", "Smoothed latency per router backend",
+                    backends_[i].latency_ewma_ms / 1000.0, metric_labels("backend", label(i)));
+        }
+        for (size_t i = 0; i < backends_.size(); ++i) {
+            w.gauge("opencrank_router_error_ewma", "Smoothed error rate per router backend",
+                    backends_[i].error_ewma, metric_labels("backend", label(i)));
+        }
+    });
+
+    LOG_INFO("[Router] %zu backend(s), failover %s, hedging %s",
+             backends_.size(), failover_ ? "on" : "off", hedge_ ? "on" : "off");
+    initialized_ = !backends_.empty();
+    return initialized_;
+}
+
+void AIRouter::shutdown() {
+    Metrics::instance().remove_collector("router");
+    initialized_ = false;
+}
+
+std::string AIRouter::provider_id() const { return "router"; }
+
+std::string AIRouter::label(size_t index) const {
+    const Backend& b = backends_[index];
+    return b.model.empty() ? b.provider : b.provider + "/" + b.model;
+}
+
+std::vector<std::string> AIRouter::available_models() const {
+    std::vector<std::string> models;
+    for (size_t i = 0; i < backends_.size(); ++i) {
+        models.push_back(label(i));
+    }
+    return models;
+}
+
+std::string AIRouter::default_model() const {
+    if (backends_.empty()) return "";
+    const Backend& b = backends_[0];
+    return b.provider + "/" + (b.model.empty() ? b.ai->default_model() : b.model);
+}
+
+bool AIRouter::is_configured() const {
+    for (size_t i = 0; i < backends_.size(); ++i) {
+        if (backends_[i].ai->is_initialized() && backends_[i].ai->is_configured()) return true;
+    }
+    return false;
+}
+
+bool AIRouter::supports_native_tools() const {
+    for (size_t i = 0; i < backends_.size(); ++i) {
+        if (!backends_[i].ai->supports_native_tools()) return false;
+    }
+    return !backends_.empty();
+}
+
+void AIRouter::set_thread_pool(ThreadPool* pool) {
+    pool_ = pool;
+}
+
+CompletionResult AIRouter::complete(const std::string& prompt, const CompletionOptions& opts) {
+    std::vector<ConversationMessage> messages;
+    messages.push_back(ConversationMessage::user(prompt));
+    return chat(messages, opts);
+}
+
+std::vector<size_t> AIRouter::plan() {
+    std::vector<size_t> usable;
+    std::vector<double> weights;
+    std::vector<size_t> order;
+    int64_t now = current_timestamp_ms();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int pass = 0; pass < 2 && usable.empty(); ++pass) {
+        // Second pass: everything is cooling down, so try them anyway
+        for (size_t i = 0; i < backends_.size(); ++i) {
+            const Backend& b = backends_[i];
+            if (!b.ai->is_initialized() || !b.ai->is_configured()) continue;
+            if (pass == 0 && b.cooldown_until_ms > now) continue;
+            usable.push_back(i);
+            weights.push_back(b.weight * std::max(0.05, 1.0 - b.error_ewma));
+        }
+    }
+    if (usable.empty()) return order;
+
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    size_t first = pick(thread_rng());
+    order.push_back(usable[first]);
+    usable.erase(usable.begin() + first);
+
+    // Failover goes to the fastest remaining backend first
+    std::sort(usable.begin(), usable.end(), [this](size_t a, size_t b) {
+        return backends_[a].latency_ewma_ms < backends_[b].latency_ewma_ms;
+    });
+    order.insert(order.end(), usable.begin(), usable.end());
+    return order;
+}
+
+void AIRouter::record(size_t index, bool success, double latency_ms, bool cancelled) {
+    Backend& b = backends_[index];
+    if (cancelled) {
+        b.cancelled->inc();
+        return;
+    }
+    (success ? b.ok : b.errors)->inc();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    b.error_ewma += EWMA_ALPHA * ((success ? 0.0 : 1.0) - b.error_ewma);
+    if (success) {
+        b.latency_ewma_ms = b.latency_ewma_ms <= 0 ? latency_ms
+                          : b.latency_ewma_ms + EWMA_ALPHA * (latency_ms - b.latency_ewma_ms);
+        if (b.recent_ms.size() < RECENT_SAMPLES) {
+            b.recent_ms.push_back(latency_ms);
+        } else {
+            b.recent_ms[b.recent_next] = latency_ms;
+        }
+        b.recent_next = (b.recent_next + 1) % RECENT_SAMPLES;
+        b.consecutive_failures = 0;
+    } else if (++b.consecutive_failures >= max_failures_ && cooldown_ms_ > 0) {
+        b.cooldown_until_ms = current_timestamp_ms() + cooldown_ms_;
+        b.consecutive_failures = 0;
+        LOG_WARN("[Router] %s failed %d times in a row, skipping it for %llds",
+                 label(index).c_str(), max_failures_, static_cast<long long>(cooldown_ms_ / 1000));
+    }
+}
+
+int64_t AIRouter::hedge_delay_ms(size_t index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::vector<double>& recent = backends_[index].recent_ms;
+    if (recent.size() < MIN_P95_SAMPLES) return hedge_delay_ms_;
+
+    std::vector<double> sorted(recent);
+    size_t rank = (sorted.size() * 95 + 99) / 100 - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return std::max(hedge_min_ms_, static_cast<int64_t>(sorted[rank]));
+}
+
+CompletionResult AIRouter::call_backend(size_t index,
+                                        const std::vector<ConversationMessage>& messages,
+                                        const CompletionOptions& opts,
+                                        const StreamCallback& on_chunk,
+                                        const std::atomic<bool>* cancel,
+                                        bool& streamed) {
+    const Backend& b = backends_[index];
+    int64_t start = current_timestamp_ms();
+    int64_t first_chunk = 0;
+
+    CompletionOptions backend_opts = opts;
+    if (!b.model.empty()) backend_opts.model = b.model;
+    backend_opts.cancel = cancel;
+    backend_opts.cancel_token = NULL;   // cancel is the router's own flag from here
+    if (opts.on_chunk) {
+        backend_opts.on_chunk = [&](const std::string& chunk) {
+            if (first_chunk == 0) first_chunk = current_timestamp_ms();
+            if (on_chunk) {
+                streamed = true;
+                on_chunk(chunk);
+            }
+        };
+    }
+
+    CompletionResult result = b.ai->chat(messages, backend_opts);
+    int64_t end = first_chunk ? first_chunk : current_timestamp_ms();
+    record(index, result.success, static_cast<double>(end - start), cancel && cancel->load());
+    return result;
+}
+
+CompletionResult AIRouter::hedged_chat(size_t primary, size_t secondary,
+                                       const std::vector<ConversationMessage>& messages,
+                                       const CompletionOptions& opts,
+                                       bool& streamed, bool& hedged) {
+    std::shared_ptr<HedgeState> state = std::make_shared<HedgeState>();
+    // Stopping the caller's run stops both requests
+    TokenLink primary_link(opts.cancel_token, &state->cancel[0]);
+    TokenLink hedge_link(opts.cancel_token, &state->cancel[1]);
+    int64_t delay_ms = hedge_delay_ms(primary);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(delay_ms);
+
+    // The hedge task outlives this call when it loses, so it works on copies.
+    // It only forwards chunks while it owns the request, and the caller
+    // waits for the owner to finish, so on_chunk stays valid.
+    std::vector<ConversationMessage> hedge_messages(messages);
+    CompletionOptions hedge_opts = opts;
+    pool_->enqueue([this, state, primary, secondary, hedge_messages = std::move(hedge_messages),
+                    hedge_opts = std::move(hedge_opts), deadline, delay_ms]() {
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            if (state->cv.wait_until(lock, deadline, [&state] {
+                    return state->owner != -1 || state->primary_done;
+                })) {
+                return;
+            }
+            state->hedge_started = true;
+        }
+        hedges_sent_->inc();
+        LOG_INFO("[Router] No reply from %s after %lldms, hedging on %s",
+                 label(primary).c_str(), static_cast<long long>(delay_ms), label(secondary).c_str());
+
+        const StreamCallback& forward = hedge_opts.on_chunk;
+        StreamCallback on_chunk = [&state, &forward](const std::string& chunk) {
+            if (state->claim(1)) forward(chunk);
+        };
+        bool streamed = false;
+        CompletionResult result = call_backend(secondary, hedge_messages, hedge_opts,
+                                               on_chunk, &state->cancel[1], streamed);
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (result.success && state->owner == -1) {
+            state->owner = 1;
+            state->cancel[0] = true;
+        }
+        state->hedge_result = std::move(result);
+        state->hedge_streamed = streamed;
+        state->hedge_done = true;
+        state->cv.notify_all();
+    }, TaskPriority::BACKGROUND);
+
+    const StreamCallback& forward = opts.on_chunk;
+    StreamCallback on_chunk = [&state, &forward](const std::string& chunk) {
+        if (state->claim(0)) forward(chunk);
+    };
+    CompletionResult result = call_backend(primary, messages, opts, on_chunk, &state->cancel[0], streamed);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->primary_done = true;
+    hedged = state->hedge_started;
+    if (result.success && state->owner == -1) {
+        state->owner = 0;
+    }
+    if (state->owner == 0 || !state->hedge_started) {
+        // The primary answered (or streamed, then failed) first, or the
+        // hedge never went out
+        state->cancel[1] = true;
+        state->cv.notify_all();
+        return result;
+    }
+
+    // The hedge owns the reply, or both are still out after the primary failed
+    state->cv.wait(lock, [&state] { return state->hedge_done; });
+    if (state->owner == 1 || state->hedge_result.success) {
+        backends_[secondary].hedges_won->inc();
+        streamed = state->hedge_streamed;
+        LOG_DEBUG("[Router] Hedge on %s answered first", label(secondary).c_str());
+        return std::move(state->hedge_result);
+    }
+    return result;
+}
+
+CompletionResult AIRouter::chat(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts
+) {
+    std::vector<size_t> order = plan();
+    if (order.empty()) {
+        return CompletionResult::fail("No AI backend available");
+    }
+
+    // Hedge short requests only: a duplicate costs little there and their
+    // latency is what the user is waiting on. A caller's cancel flag has to
+    // come with its token, which the hedge slots' own flags can follow.
+    bool hedge = hedge_ && pool_ && order.size() > 1 && (!opts.cancel || opts.cancel_token) &&
+                 !opts.skip_context_management;
+    if (hedge) {
+        size_t prompt_chars = opts.system_prompt.size();
+        for (size_t i = 0; i < messages.size() && prompt_chars <= hedge_max_prompt_chars_; ++i) {
+            prompt_chars += messages[i].content.size();
+        }
+        hedge = prompt_chars <= hedge_max_prompt_chars_;
+    }
+
+    CompletionResult result;
+    size_t next = 0;
+    while (next < order.size()) {
+        size_t index = order[next++];
+        bool streamed = false;
+        if (hedge && next == 1) {
+            bool hedged = false;
+            result = hedged_chat(index, order[1], messages, opts, streamed, hedged);
+            if (hedged) ++next;     // The hedge backend has been tried too
+        } else {
+            result = call_backend(index, messages, opts, opts.on_chunk, opts.cancel, streamed);
+        }
+
+        // Once text has reached the caller a retry would repeat it
+        if (result.success || streamed || !failover_ || (opts.cancel && opts.cancel->load())) {
+            break;
+        }
+        if (next < order.size()) {
+            failovers_->inc();
+            LOG_WARN("[Router] %s failed (%s), failing over to %s",
+                     label(index).c_str(), result.error.c_str(), label(order[next]).c_str());
+        }
+    }
+    return result;
+}
+
+} // namespace opencrank
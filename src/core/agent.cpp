@@ -7,7 +7,12 @@
 #include <opencrank/core/agent.hpp>
 #include <opencrank/core/application.hpp>
 #include <opencrank/ai/ai.hpp>
+#include <opencrank/ai/models.hpp>
+#include <opencrank/ai/fair_share.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/run_record.hpp>
 #include <sstream>
 #include <algorithm>
 #include <set>
@@ -16,6 +21,10 @@
 #include <cstring>
 #include <cctype>
 #include <fstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 namespace opencrank {
 
@@ -25,13 +34,6 @@ namespace opencrank {
 
 namespace {
 
-struct JsonParseResult {
-    bool ok;
-    std::string used;
-    std::string error;
-    Json value;
-};
-
 static std::string trim_whitespace(const std::string& input) {
     size_t start = input.find_first_not_of(" \t\n\r");
     if (start == std::string::npos) return "";
@@ -39,222 +41,76 @@ static std::string trim_whitespace(const std::string& input) {
     return input.substr(start, end - start + 1);
 }
 
-static std::string remove_trailing_commas(const std::string& input) {
-    std::string out;
-    out.reserve(input.size());
-    for (size_t i = 0; i < input.size(); ++i) {
-        if (input[i] == ',') {
-            size_t j = i + 1;
-            while (j < input.size() && (input[j] == ' ' || input[j] == '\t' || input[j] == '\n' || input[j] == '\r')) {
-                ++j;
-            }
-            if (j < input.size() && (input[j] == '}' || input[j] == ']')) {
-                continue;  // skip trailing comma
-            }
-        }
-        out.push_back(input[i]);
-    }
-    return out;
+static bool is_key_char(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
 }
 
-static JsonParseResult try_parse_json(const std::string& raw) {
-    JsonParseResult res;
-    res.ok = false;
-    res.used = raw;
-
-    try {
-        res.value = Json::parse(raw);
-        res.ok = true;
-        return res;
-    } catch (const std::exception& e) {
-        res.error = e.what();
-    }
-
-    // Recovery: strip code fences and extract first JSON object
-    std::string cleaned = raw;
-    size_t fence_pos;
-    while ((fence_pos = cleaned.find("```")) != std::string::npos) {
-        cleaned.erase(fence_pos, 3);
-    }
-
-    cleaned = trim_whitespace(cleaned);
-
-    size_t first_brace = cleaned.find('{');
-    size_t last_brace = cleaned.rfind('}');
-    if (first_brace != std::string::npos && last_brace != std::string::npos && last_brace > first_brace) {
-        std::string candidate = cleaned.substr(first_brace, last_brace - first_brace + 1);
-        std::string sanitized = remove_trailing_commas(candidate);
-        
-        // Try parsing directly first
-        try {
-            res.value = Json::parse(sanitized);
-            res.ok = true;
-            res.used = sanitized;
-            res.error.clear();
-            return res;
-        } catch (const std::exception& e) {
-            res.error = e.what();
-        }
-        
-        // Advanced recovery: Try to fix common escaping issues
-        // This handles cases like: {"command": "curl -H "Header: value""}
-        // by escaping internal quotes within string values
-        std::string fixed = sanitized;
-        bool in_string = false;
-        bool in_key = false;
-        bool escape_next = false;
-        size_t colon_pos = std::string::npos;
-        
-        for (size_t i = 0; i < fixed.size(); ++i) {
-            if (escape_next) {
-                escape_next = false;
-                continue;
-            }
-            
-            if (fixed[i] == '\\') {
-                escape_next = true;
-                continue;
-            }
-            
-            if (fixed[i] == '"') {
-                if (!in_string) {
-                    // Starting a string
-                    in_string = true;
-                    // Check if this is a key (before colon) or value (after colon)
-                    if (colon_pos == std::string::npos || i < colon_pos) {
-                        in_key = true;
-                    } else {
-                        in_key = false;
-                    }
-                } else {
-                    // Ending a string - but is this really the end or an unescaped quote?
-                    // If we're in a value string and the next non-whitespace char is not , or },
-                    // this might be an unescaped internal quote
-                    if (!in_key) {
-                        size_t next_char = i + 1;
-                        while (next_char < fixed.size() && 
-                               (fixed[next_char] == ' ' || fixed[next_char] == '\t' || 
-                                fixed[next_char] == '\n' || fixed[next_char] == '\r')) {
-                            next_char++;
-                        }
-                        
-                        // If next significant char is not , or }, this quote should be escaped
-                        if (next_char < fixed.size() && 
-                            fixed[next_char] != ',' && 
-                            fixed[next_char] != '}' && 
-                            fixed[next_char] != ']') {
-                            // Escape this quote
-                            fixed.insert(i, "\\");
-                            i++; // Skip the inserted backslash
-                            continue; // Don't toggle in_string
-                        }
-                    }
-                    in_string = false;
-                    in_key = false;
-                }
-            } else if (fixed[i] == ':' && !in_string) {
-                colon_pos = i;
-            }
-        }
-        
-        // Try parsing the fixed version
-        try {
-            res.value = Json::parse(fixed);
-            res.ok = true;
-            res.used = fixed;
-            res.error.clear();
-            LOG_DEBUG("JSON recovery: auto-escaped internal quotes");
-            return res;
-        } catch (const std::exception& e) {
-            // Recovery failed, keep original error
-            res.error = e.what();
-            res.used = sanitized;
+// Reads a '"' or '\'' quoted string starting at content[pos]; pos ends past
+// the closing quote. False when the string never closes.
+static bool read_quoted(const std::string& content, size_t& pos, std::string& out) {
+    char quote = content[pos];
+    size_t start = ++pos;
+    bool escaped = false;
+    for (; pos < content.size(); ++pos) {
+        char c = content[pos];
+        if (escaped) {
+            escaped = false;
+        } else if (c == '\\') {
+            escaped = true;
+        } else if (c == quote) {
+            out = content.substr(start, pos - start);
+            ++pos;
+            return true;
         }
     }
-
-    return res;
+    return false;
 }
 
-static bool extract_kv_value(const std::string& content, const std::string& key, std::string& value_out) {
-    const std::string quoted_key = "\"" + key + "\"";
-    const std::string single_quoted_key = "'" + key + "'";
-
-    std::vector<size_t> candidates;
-    size_t pos = content.find(quoted_key);
-    while (pos != std::string::npos) {
-        candidates.push_back(pos + quoted_key.size());
-        pos = content.find(quoted_key, pos + 1);
-    }
-    pos = content.find(single_quoted_key);
-    while (pos != std::string::npos) {
-        candidates.push_back(pos + single_quoted_key.size());
-        pos = content.find(single_quoted_key, pos + 1);
-    }
-
-    pos = content.find(key);
-    while (pos != std::string::npos) {
-        bool left_ok = (pos == 0) || !(isalnum(content[pos - 1]) || content[pos - 1] == '_');
-        bool right_ok = (pos + key.size() >= content.size()) ||
-                        !(isalnum(content[pos + key.size()]) || content[pos + key.size()] == '_');
-        if (left_ok && right_ok) {
-            candidates.push_back(pos + key.size());
-        }
-        pos = content.find(key, pos + 1);
-    }
-
-    for (size_t i = 0; i < candidates.size(); ++i) {
-        size_t cursor = candidates[i];
-        while (cursor < content.size() && isspace(static_cast<unsigned char>(content[cursor]))) {
-            ++cursor;
-        }
-        if (cursor >= content.size() || content[cursor] != ':') {
+// Collects key: value pairs from broken JSON in one pass. Keys may be
+// double-quoted, single-quoted or bare; values are quoted strings or run to
+// the next ',', '}' or line end. The first value of a key wins.
+static void collect_key_values(const std::string& content, std::map<std::string, std::string>& out) {
+    size_t pos = 0;
+    while (pos < content.size()) {
+        char c = content[pos];
+        std::string key;
+        if (c == '"' || c == '\'') {
+            if (!read_quoted(content, pos, key)) return;
+        } else if (is_key_char(c)) {
+            size_t start = pos;
+            while (pos < content.size() && is_key_char(content[pos])) ++pos;
+            key = content.substr(start, pos - start);
+        } else {
+            ++pos;
             continue;
         }
+
+        size_t cursor = pos;
+        while (cursor < content.size() && isspace(static_cast<unsigned char>(content[cursor]))) ++cursor;
+        if (cursor >= content.size() || content[cursor] != ':') continue;
         ++cursor;
-        while (cursor < content.size() && isspace(static_cast<unsigned char>(content[cursor]))) {
-            ++cursor;
-        }
-        if (cursor >= content.size()) {
-            continue;
-        }
+        while (cursor < content.size() && isspace(static_cast<unsigned char>(content[cursor]))) ++cursor;
+        if (cursor >= content.size()) return;
 
-        char quote = content[cursor];
-        if (quote == '\"' || quote == '\'') {
-            size_t start = cursor + 1;
-            size_t end = start;
-            bool escaped = false;
-            for (; end < content.size(); ++end) {
-                char c = content[end];
-                if (escaped) {
-                    escaped = false;
-                    continue;
-                }
-                if (c == '\\') {
-                    escaped = true;
-                    continue;
-                }
-                if (c == quote) {
-                    break;
-                }
-            }
-            if (end < content.size()) {
-                value_out = content.substr(start, end - start);
-                return true;
-            }
+        std::string value;
+        if (content[cursor] == '"' || content[cursor] == '\'') {
+            if (!read_quoted(content, cursor, value)) return;
+            pos = cursor;
         } else {
-            size_t start = cursor;
-            size_t end = start;
-            while (end < content.size() && content[end] != ',' && content[end] != '}' && content[end] != '\n' && content[end] != '\r') {
+            size_t end = cursor;
+            while (end < content.size() && content[end] != ',' && content[end] != '}' &&
+                   content[end] != '\n' && content[end] != '\r') {
                 ++end;
             }
-            value_out = trim_whitespace(content.substr(start, end - start));
-            if (!value_out.empty()) {
-                return true;
-            }
+            value = trim_whitespace(content.substr(cursor, end - cursor));
+            // Rescan the value itself: it may hold nested keys
+            pos = cursor;
+            if (value.empty()) continue;
+        }
+        if (out.find(key) == out.end()) {
+            out[key] = value;
         }
     }
-
-    return false;
 }
 
 static bool recover_params_from_raw(const AgentTool& tool, const std::string& raw_content, Json& out_params, std::string& out_error) {
@@ -264,21 +120,25 @@ static bool recover_params_from_raw(const AgentTool& tool, const std::string& ra
         return true;
     }
 
-    JsonParseResult parsed = try_parse_json(content);
-    if (parsed.ok) {
-        out_params = parsed.value;
+    Json parsed;
+    std::string parse_error;
+    if (parse_json_tolerant(content, parsed, parse_error) && parsed.is_object()) {
+        out_params = parsed;
         return true;
     }
 
+    std::map<std::string, std::string> values;
+    collect_key_values(content, values);
+
     Json recovered = Json::object();
     bool found_any = false;
     bool missing_required = false;
 
     for (size_t i = 0; i < tool.params.size(); ++i) {
         const ToolParamSchema& param = tool.params[i];
-        std::string value;
-        if (extract_kv_value(content, param.name, value)) {
-            recovered[param.name] = value;
+        std::map<std::string, std::string>::const_iterator value = values.find(param.name);
+        if (value != values.end()) {
+            recovered[param.name] = value->second;
             found_any = true;
         } else if (param.required) {
             missing_required = true;
@@ -296,23 +156,76 @@ static bool recover_params_from_raw(const AgentTool& tool, const std::string& ra
         return true;
     }
 
-    out_error = parsed.error;
+    out_error = parse_error.empty() ? "arguments are not a JSON object" : parse_error;
     return false;
 }
 
+// Forwards the user-visible part of a streamed reply. Uses the same
+// heuristic as parse_tool_calls ('{' with "tool" within 200 chars) so
+// tool-call JSON is never shown; text after the first call is dropped.
+class ReplyStreamFilter {
+public:
+    typedef std::function<void(const std::string&)> Sink;
+    
+    explicit ReplyStreamFilter(const Sink& sink) : sink_(sink), visible_(0), suppressed_(false) {}
+    
+    void on_chunk(const std::string& chunk) {
+        if (suppressed_ || !sink_) return;
+        text_ += chunk;
+        
+        size_t limit = text_.size();
+        size_t brace = text_.find('{', visible_);
+        while (brace != std::string::npos) {
+            size_t window = std::min(text_.size() - brace, static_cast<size_t>(200));
+            if (text_.substr(brace, window).find("\"tool\"") != std::string::npos) {
+                limit = brace;
+                suppressed_ = true;
+                break;
+            }
+            if (window < 200) {
+                // Could still turn into a tool call; hold it back
+                limit = brace;
+                break;
+            }
+            brace = text_.find('{', brace + 1);
+        }
+        
+        // Don't leave a dangling code fence opener in front of a call
+        std::string visible = trim_whitespace(text_.substr(0, limit));
+        if (suppressed_ && visible.size() >= 3) {
+            size_t fence = visible.rfind("```");
+            if (fence != std::string::npos && visible.find('\n', fence) == std::string::npos) {
+                visible = trim_whitespace(visible.substr(0, fence));
+            }
+        }
+        
+        if (limit > visible_ && !visible.empty()) {
+            visible_ = limit;
+            sink_(visible);
+        }
+    }
+    
+private:
+    Sink sink_;
+    std::string text_;
+    size_t visible_;    // Bytes of text_ already released
+    bool suppressed_;   // A tool call started; ignore the rest of this response
+};
+
 } // namespace
 
 // ============================================================================
 // Agent Implementation
 // ============================================================================
 
-Agent::Agent() {}
+Agent::Agent() : pool_(nullptr), tools_version_(1), cached_tools_version_(0), cached_specs_version_(0) {}
 
 Agent::~Agent() {}
 
 void Agent::register_tool(const AgentTool& tool) {
     LOG_DEBUG("Registering tool: %s", tool.name.c_str());
     tools_[tool.name] = tool;
+    tools_version_.fetch_add(1);
 }
 
 void Agent::register_tool(const std::string& name, const std::string& desc, ToolExecutor executor) {
@@ -320,7 +233,7 @@ void Agent::register_tool(const std::string& name, const std::string& desc, Tool
     register_tool(tool);
 }
 
-std::string Agent::build_tools_prompt() const {
+std::string Agent::build_tools_prompt(bool native) const {
     if (tools_.empty()) {
         return "";
     }
@@ -328,20 +241,25 @@ std::string Agent::build_tools_prompt() const {
     std::ostringstream oss;
     oss << "## Available Tools\n\n";
     oss << "**ALWAYS use tools** - When you need to perform an action (schedule reminders, send messages, execute commands, etc.), you MUST call the appropriate tool. Do NOT just say you'll do it or pretend to do it\n";
-    oss << "Use this JSON format:\n";
-    oss << "```json\n";
-    oss << "{\n";
-    oss << "  \"tool\": \"TOOLNAME\",\n";
-    oss << "  \"arguments\": {\n";
-    oss << "    \"param\": \"value\"\n";
-    oss << "  }\n";
-    oss << "}\n";
-    oss << "```\n\n";
-    
-    oss << "**FORMAT Rules:**\n";
-    oss << "1. Start IMMEDIATELY with the JSON tool call - NO explanatory text before it\n";
-    oss << "2. You can call multiple tools by emitting multiple JSON objects\n";
-    oss << "3. You can explain AFTER the tool call(s), never before\n\n";
+    if (native) {
+        // Names, descriptions and parameters travel as function schemas
+        oss << "Call tools through the function-calling interface. You can call several tools in one reply.\n\n";
+    } else {
+        oss << "Use this JSON format:\n";
+        oss << "```json\n";
+        oss << "{\n";
+        oss << "  \"tool\": \"TOOLNAME\",\n";
+        oss << "  \"arguments\": {\n";
+        oss << "    \"param\": \"value\"\n";
+        oss << "  }\n";
+        oss << "}\n";
+        oss << "```\n\n";
+    
+        oss << "**FORMAT Rules:**\n";
+        oss << "1. Start IMMEDIATELY with the JSON tool call - NO explanatory text before it\n";
+        oss << "2. You can call multiple tools by emitting multiple JSON objects\n";
+        oss << "3. You can explain AFTER the tool call(s), never before\n\n";
+    }
 
     oss << "### Large Content Handling\n";
     oss << "When a tool returns content too large to fit in context, it will be automatically chunked.\n";
@@ -352,6 +270,10 @@ std::string Agent::build_tools_prompt() const {
     oss << "Use 'notify_user' to tell the user what you're about to do BEFORE doing it, ";
     oss << "but only for significant actions. Good uses: starting a complex multi-step task, or when something failed and it was not expected. ";
 
+    if (native) {
+        return oss.str();
+    }
+
     oss << "### Tools:\n\n";
     
     for (std::map<std::string, AgentTool>::const_iterator it = tools_.begin();
@@ -379,142 +301,179 @@ std::string Agent::build_tools_prompt() const {
     return oss.str();
 }
 
-bool Agent::has_tool_calls(const std::string& response) const {
-    // Look for JSON tool call pattern: {"tool": "..."
-    return response.find("\"tool\"") != std::string::npos;
+std::string Agent::build_system_prompt(const std::string& base_prompt, bool native) {
+    std::lock_guard<std::mutex> lock(prompt_mutex_);
+    
+    // The base prompt (default + config + skills) is assembled once by the
+    // application, so a string compare is all it takes to detect skill changes.
+    uint64_t version = tools_version_.load();
+    if (version == cached_tools_version_ && base_prompt == cached_base_prompt_) {
+        return native ? cached_native_prompt_ : cached_system_prompt_;
+    }
+    
+    // Both variants at once: a run falling back to the text protocol
+    // switches without a rebuild
+    std::string full = base_prompt;
+    std::string compact = base_prompt;
+    std::string tools_prompt = build_tools_prompt(false);
+    if (!tools_prompt.empty()) {
+        if (!full.empty()) full += "\n\n";
+        full += tools_prompt;
+        if (!compact.empty()) compact += "\n\n";
+        compact += build_tools_prompt(true);
+    }
+    
+    cached_base_prompt_ = base_prompt;
+    cached_tools_version_ = version;
+    cached_system_prompt_ = full;
+    cached_native_prompt_ = compact;
+    LOG_DEBUG("Rebuilt system prompt (%zu chars, %zu with native tools, tools v%llu)",
+              full.size(), compact.size(), static_cast<unsigned long long>(version));
+    LOG_DEBUG("Full system prompt content:\n%s", full.c_str());
+    return native ? compact : full;
 }
 
-std::vector<ParsedToolCall> Agent::parse_tool_calls(const std::string& response) const {
-    std::vector<ParsedToolCall> calls;
+std::vector<ToolSpec> Agent::tool_specs() {
+    std::lock_guard<std::mutex> lock(prompt_mutex_);
     
-    // Parse JSON tool calls: {"tool": "name", "arguments": {...}}
-    // We scan for '{' characters and try to parse JSON objects that have a "tool" key.
-    size_t pos = 0;
-    while (pos < response.size()) {
-        // Find next '{' that could start a tool call
-        size_t brace_start = response.find('{', pos);
-        if (brace_start == std::string::npos) break;
-        
-        // Quick check: does the area after this brace contain "tool"?
-        // Look ahead a reasonable distance to avoid parsing random JSON
-        size_t lookahead_end = std::min(brace_start + 200, response.size());
-        std::string lookahead = response.substr(brace_start, lookahead_end - brace_start);
-        if (lookahead.find("\"tool\"") == std::string::npos) {
-            pos = brace_start + 1;
-            continue;
-        }
+    uint64_t version = tools_version_.load();
+    if (version == cached_specs_version_) {
+        return cached_specs_;
+    }
+    
+    std::vector<ToolSpec> specs;
+    specs.reserve(tools_.size());
+    for (std::map<std::string, AgentTool>::const_iterator it = tools_.begin();
+         it != tools_.end(); ++it) {
+        const AgentTool& tool = it->second;
+        ToolSpec spec;
+        spec.name = tool.name;
+        spec.description = tool.description;
         
-        // Find the matching closing brace
-        int brace_count = 1;
-        size_t scan = brace_start + 1;
-        bool in_string = false;
-        bool escape_next = false;
-        while (scan < response.size() && brace_count > 0) {
-            char c = response[scan];
-            if (escape_next) {
-                escape_next = false;
-                scan++;
-                continue;
+        Json properties = Json::object();
+        Json required = Json::array();
+        for (size_t i = 0; i < tool.params.size(); ++i) {
+            const ToolParamSchema& param = tool.params[i];
+            const std::string& type = param.type;
+            Json prop = Json::object();
+            if (type == "number" || type == "boolean" || type == "array" || type == "object") {
+                prop["type"] = type;
+            } else {
+                prop["type"] = "string";
             }
-            if (c == '\\' && in_string) {
-                escape_next = true;
-                scan++;
-                continue;
+            if (type == "array") {
+                prop["items"] = Json::object();     // Element type is not declared
             }
-            if (c == '"') {
-                in_string = !in_string;
-            } else if (!in_string) {
-                if (c == '{') brace_count++;
-                else if (c == '}') brace_count--;
+            std::string description = param.description;
+            if (!param.default_value.empty()) {
+                description += " (default: " + param.default_value + ")";
+            }
+            prop["description"] = description;
+            properties[param.name] = prop;
+            if (param.required) {
+                required.push_back(param.name);
             }
-            scan++;
-        }
-        
-        if (brace_count != 0) {
-            // Unmatched braces, skip
-            pos = brace_start + 1;
-            continue;
-        }
-        
-        std::string candidate = response.substr(brace_start, scan - brace_start);
-        LOG_DEBUG("Found candidate JSON at position %zu (length=%zu)", brace_start, candidate.size());
-        
-        // Try to parse the JSON
-        JsonParseResult parsed = try_parse_json(candidate);
-        if (!parsed.ok) {
-            LOG_DEBUG("Candidate JSON parse failed: %s", parsed.error.c_str());
-            pos = brace_start + 1;
-            continue;
         }
         
-        // Check if this JSON has a "tool" key
-        if (!parsed.value.is_object() || !parsed.value.contains("tool")) {
-            pos = scan;
-            continue;
+        spec.parameters = Json::object();
+        spec.parameters["type"] = "object";
+        spec.parameters["properties"] = properties;
+        if (!required.empty()) {
+            spec.parameters["required"] = required;
         }
+        specs.push_back(spec);
+    }
+    
+    cached_specs_.swap(specs);
+    cached_specs_version_ = version;
+    LOG_DEBUG("Rebuilt %zu tool schema(s) (tools v%llu)",
+              cached_specs_.size(), static_cast<unsigned long long>(version));
+    return cached_specs_;
+}
+
+bool Agent::has_tool_calls(const std::string& response) const {
+    // Look for JSON tool call pattern: {"tool": "..."
+    return response.find("\"tool\"") != std::string::npos;
+}
+
+std::vector<ParsedToolCall> Agent::parse_tool_calls(const std::string& response) const {
+    // {"tool": "name", "arguments": {...}} objects, repaired in the same pass
+    ToolCallScanner scanner;
+    scanner.feed(response);
+    scanner.finish();
+
+    std::vector<ParsedToolCall> calls;
+    calls.swap(scanner.calls());
+    return calls;
+}
+
+std::vector<ParsedToolCall> Agent::native_tool_calls(const std::vector<ToolCallRequest>& requests,
+                                                    const std::string& response) const {
+    std::vector<ParsedToolCall> calls;
+    size_t from = 0;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const ToolCallRequest& req = requests[i];
+        ParsedToolCall call;
+        call.tool_name = req.name;
         
-        std::string tool_name = parsed.value.value("tool", std::string(""));
-        if (tool_name.empty()) {
-            LOG_DEBUG("JSON has 'tool' key but empty value, skipping");
-            pos = scan;
-            continue;
+        // The provider appended the text form to the reply; locate it so
+        // extract_response_text() leaves it out
+        std::string text = req.to_text();
+        size_t at = response.find(text, from);
+        if (at == std::string::npos) {
+            call.start_pos = call.end_pos = response.size();
+        } else {
+            call.start_pos = at;
+            call.end_pos = at + text.size();
+            from = call.end_pos;
         }
         
-        LOG_DEBUG("Found JSON tool call: '%s'", tool_name.c_str());
-        
-        ParsedToolCall call;
-        call.tool_name = tool_name;
-        call.start_pos = brace_start;
-        call.end_pos = scan;
-        call.raw_content = candidate;
-        
-        // Extract arguments
-        if (parsed.value.contains("arguments") && parsed.value["arguments"].is_object()) {
-            call.params = parsed.value["arguments"];
+        if (req.arguments.is_object()) {
+            call.params = req.arguments;
+            call.raw_content = text;
             call.valid = true;
-            LOG_DEBUG("Parsed arguments for '%s': %s", 
-                      tool_name.c_str(), call.params.dump().c_str());
-        } else if (parsed.value.contains("arguments") && parsed.value["arguments"].is_string()) {
-            // Sometimes models put a JSON string in arguments - try to parse it
-            std::string args_str = parsed.value["arguments"].get<std::string>();
-            JsonParseResult args_parsed = try_parse_json(args_str);
-            if (args_parsed.ok && args_parsed.value.is_object()) {
-                call.params = args_parsed.value;
-                call.valid = true;
-                LOG_DEBUG("Parsed stringified arguments for '%s'", tool_name.c_str());
-            } else {
-                call.valid = false;
-                call.parse_error = "Arguments field is a string but not valid JSON: " + args_str;
-                LOG_WARN(" Failed to parse stringified arguments for '%s'", tool_name.c_str());
-            }
         } else {
-            // Extract top-level parameters (excluding "tool")
-            call.params = Json::object();
-            for (auto& item : parsed.value.items()) {
-                if (item.key() != "tool") {
-                    call.params[item.key()] = item.value();
-                }
-            }
-            if (!call.params.empty()) {
-                LOG_DEBUG("Extracted top-level params for '%s': %s", 
-                          tool_name.c_str(), call.params.dump().c_str());
-            } else {
-                LOG_DEBUG("No arguments for '%s', using empty params", tool_name.c_str());
-            }
-            call.valid = true;
+            // Left to recover_params_from_raw() when the call runs
+            call.raw_content = req.raw_arguments;
+            call.parse_error = "arguments are not a JSON object";
+            LOG_WARN("Native call to '%s' has unparsable arguments (%zu bytes)",
+                     req.name.c_str(), req.raw_arguments.size());
         }
-        
         calls.push_back(call);
-        pos = scan;
-        
-        LOG_DEBUG("Parsed tool call: %s (valid=%s)", 
-                  tool_name.c_str(), call.valid ? "yes" : "no");
     }
-    
     return calls;
 }
 
-AgentToolResult Agent::execute_tool(const ParsedToolCall& call) {
+// ============================================================================
+// Tool Call Context
+// ============================================================================
+
+namespace {
+
+thread_local const ToolCallContext* t_tool_context = NULL;
+
+// Makes ctx current on this thread, restoring the previous one on exit
+class ToolContextScope {
+public:
+    explicit ToolContextScope(const ToolCallContext* ctx) : saved_(t_tool_context) {
+        t_tool_context = ctx;
+    }
+    ~ToolContextScope() { t_tool_context = saved_; }
+private:
+    const ToolCallContext* saved_;
+};
+
+} // anonymous namespace
+
+const ToolCallContext* ToolCallContext::current() {
+    return t_tool_context;
+}
+
+AgentToolResult Agent::execute_tool(const ParsedToolCall& call, const ToolCallContext* ctx) {
+    // Parallel calls run on pool threads: attach their spans to the run
+    TraceContextScope trace_scope(ctx ? ctx->trace : TraceContext::current());
+    ScopedSpan span(call.tool_name, "tool");
+    
     // Check for common mistakes
     if (call.tool_name == "tool_call") {
         std::string hint = "ERROR: Used 'tool_call' as name. Must use actual tool name.\n";
@@ -543,7 +502,12 @@ AgentToolResult Agent::execute_tool(const ParsedToolCall& call) {
     if (!effective_call.valid) {
         Json recovered;
         std::string recover_error;
-        if (recover_params_from_raw(it->second, effective_call.raw_content, recovered, recover_error)) {
+        bool recovered_ok;
+        {
+            ScopedSpan recover_span("recover_params", "parse");
+            recovered_ok = recover_params_from_raw(it->second, effective_call.raw_content, recovered, recover_error);
+        }
+        if (recovered_ok) {
             effective_call.params = recovered;
             effective_call.valid = true;
             LOG_DEBUG("Recovered tool params for '%s' from raw content", call.tool_name.c_str());
@@ -569,6 +533,10 @@ AgentToolResult Agent::execute_tool(const ParsedToolCall& call) {
         }
     }
     
+    if (ctx && ctx->cancelled()) {
+        return AgentToolResult::fail("Cancelled: the run was stopped");
+    }
+    
     LOG_INFO(" ▶ TOOL Executing: %s", call.tool_name.c_str());
     LOG_DEBUG("▶ TOOL Params: %s", effective_call.params.dump().c_str());
     LOG_DEBUG("▶ TOOL Raw content: %s", effective_call.raw_content.c_str());
@@ -577,18 +545,315 @@ AgentToolResult Agent::execute_tool(const ParsedToolCall& call) {
         // Log parameters just before execution
         LOG_DEBUG("About to execute tool with params: %s", effective_call.params.dump().c_str());
         
+        ToolContextScope scope(ctx);
+        int64_t tool_start = current_timestamp_ms();
         AgentToolResult result = it->second.execute(effective_call.params);
+        int64_t tool_ms = current_timestamp_ms() - tool_start;
+        if (ctx && ctx->recording) {
+            ctx->recording->add_tool_call(call.tool_name, effective_call.params.dump(), result, tool_ms);
+        }
+        Metrics& metrics = Metrics::instance();
+        metrics.histogram("opencrank_tool_seconds", "Tool execution latency",
+                          metric_labels("tool", call.tool_name))
+            .observe(static_cast<double>(tool_ms) / 1000.0);
+        metrics.counter("opencrank_tool_calls_total", "Tool executions by outcome",
+                        metric_labels("tool", call.tool_name, "outcome", result.success ? "ok" : "error")).inc();
         LOG_DEBUG("◀ TOOL %s result: success=%s, output_len=%zu",
                   call.tool_name.c_str(), result.success ? "yes" : "no", 
                   result.output.size());
+        span.set("success", result.success);
+        span.set("output_bytes", result.output.size());
         return result;
     } catch (const std::exception& e) {
         LOG_ERROR(" Tool %s threw exception: %s", call.tool_name.c_str(), e.what());
-        return AgentToolResult::fail(std::string("Tool exception: ") + e.what());
+        AgentToolResult failed = AgentToolResult::fail(std::string("Tool exception: ") + e.what());
+        if (ctx && ctx->recording) {
+            ctx->recording->add_tool_call(call.tool_name, effective_call.params.dump(), failed, 0);
+        }
+        return failed;
+    }
+}
+
+AgentToolResult Agent::execute_with_retry(const ParsedToolCall& call, const ToolCallContext* ctx) {
+    const int max_tool_retries = 3;
+    AgentToolResult tool_result;
+    int retry_count = 0;
+    
+    while (retry_count < max_tool_retries) {
+        tool_result = execute_tool(call, ctx);
+        if (tool_result.success || (ctx && ctx->cancelled())) {
+            break;
+        }
+        retry_count++;
+        if (retry_count < max_tool_retries) {
+            LOG_WARN(" Tool %s failed (attempt %d/%d): %s - retrying...",
+                     call.tool_name.c_str(), retry_count, max_tool_retries, 
+                     tool_result.error.c_str());
+        } else {
+            LOG_ERROR(" Tool %s failed after %d attempts: %s",
+                      call.tool_name.c_str(), max_tool_retries, 
+                      tool_result.error.c_str());
+        }
+    }
+    return tool_result;
+}
+
+bool Agent::is_parallel_safe(const ParsedToolCall& call) const {
+    std::map<std::string, AgentTool>::const_iterator it = tools_.find(call.tool_name);
+    return it != tools_.end() && it->second.parallel_safe;
+}
+
+bool Agent::memo_target(const ParsedToolCall& call, std::string& store,
+                        std::string& path, std::string& writes) const {
+    store.clear();
+    path.clear();
+    writes.clear();
+    std::map<std::string, AgentTool>::const_iterator it = tools_.find(call.tool_name);
+    if (!call.valid || it == tools_.end()) return false;
+    
+    const AgentTool& tool = it->second;
+    if (!tool.path_param.empty() && call.params.is_object() && call.params.contains(tool.path_param) &&
+        call.params[tool.path_param].is_string()) {
+        path = call.params[tool.path_param].get<std::string>();
+    }
+    if (!tool.memo_store.empty()) {
+        store = tool.memo_store;
+        return true;
+    }
+    if (!tool.writes_store.empty()) {
+        writes = tool.writes_store;
+    } else if (!tool.parallel_safe) {
+        writes = ToolMemo::ANY_STORE;   // Undeclared side effects
+    }
+    return false;
+}
+
+void Agent::execute_parallel(const std::vector<const ParsedToolCall*>& calls,
+                             std::vector<AgentToolResult>& results,
+                             size_t max_parallel,
+                             const ToolCallContext* ctx) {
+    const size_t n = calls.size();
+    results.assign(n, AgentToolResult());
+    
+    size_t helpers = std::min(max_parallel, n) - 1;
+    if (!pool_ || helpers == 0) {
+        for (size_t i = 0; i < n; ++i) {
+            results[i] = execute_with_retry(*calls[i], ctx);
+        }
+        return;
     }
+    
+    // Calls are claimed through a shared counter by this thread and by
+    // helper tasks on the pool. The caller works too, so the batch finishes
+    // even when every worker is busy; helpers that start late find nothing
+    // left to claim and return without touching the (by then gone) vectors.
+    struct BatchState {
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        std::mutex mutex;
+        std::condition_variable cv;
+        BatchState() : next(0), done(0) {}
+    };
+    std::shared_ptr<BatchState> state = std::make_shared<BatchState>();
+    const std::vector<const ParsedToolCall*>* calls_ptr = &calls;
+    std::vector<AgentToolResult>* results_ptr = &results;
+    
+    auto drain = [this, state, n, calls_ptr, results_ptr, ctx]() {
+        size_t index;
+        while ((index = state->next.fetch_add(1)) < n) {
+            AgentToolResult r;
+            try {
+                r = execute_with_retry(*(*calls_ptr)[index], ctx);
+            } catch (...) {
+                r = AgentToolResult::fail("Tool exception");
+            }
+            (*results_ptr)[index] = r;
+            
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->done.fetch_add(1) + 1 == n) {
+                state->cv.notify_all();
+            }
+        }
+    };
+    
+    for (size_t i = 0; i < helpers; ++i) {
+        pool_->enqueue(Task(drain), TaskPriority::BACKGROUND);
+    }
+    drain();
+    
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&state, n] { return state->done.load() == n; });
+}
+
+// A call started while the reply was still streaming. The pool task and
+// the agent loop race to claim it; the loser of the race waits for (or, for
+// the task, ignores) the result, so a busy pool never stalls the loop.
+struct EarlyToolCall {
+    ParsedToolCall call;
+    std::string dedup_key;
+    std::atomic<bool> claimed;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done;
+    AgentToolResult result;
+    EarlyToolCall() : claimed(false), done(false) {}
+};
+
+std::shared_ptr<EarlyToolCall> Agent::start_early(const ParsedToolCall& call, const ToolCallContext* ctx) {
+    std::shared_ptr<EarlyToolCall> early = std::make_shared<EarlyToolCall>();
+    early->call = call;
+    early->dedup_key = call.tool_name + ":" + call.params.dump();
+    
+    pool_->enqueue(Task([this, early, ctx]() {
+        if (early->claimed.exchange(true)) return;
+        AgentToolResult r;
+        try {
+            r = execute_with_retry(early->call, ctx);
+        } catch (...) {
+            r = AgentToolResult::fail("Tool exception");
+        }
+        std::lock_guard<std::mutex> lock(early->mutex);
+        early->result = r;
+        early->done = true;
+        early->cv.notify_all();
+    }), TaskPriority::BACKGROUND);
+    return early;
+}
+
+AgentToolResult Agent::finish_early(EarlyToolCall& early, const ToolCallContext* ctx) {
+    if (!early.claimed.exchange(true)) {
+        AgentToolResult r;
+        try {
+            r = execute_with_retry(early.call, ctx);
+        } catch (...) {
+            r = AgentToolResult::fail("Tool exception");
+        }
+        std::lock_guard<std::mutex> lock(early.mutex);
+        early.result = r;
+        early.done = true;
+        return r;
+    }
+    std::unique_lock<std::mutex> lock(early.mutex);
+    early.cv.wait(lock, [&early] { return early.done; });
+    return early.result;
+}
+
+namespace {
+
+// Waits out early calls still running when an iteration ends (failed chat,
+// duplicate skipped): they hold a pointer to the run's ToolCallContext.
+// Calls no worker has picked up yet are claimed so they never start.
+class EarlyCallJoin {
+public:
+    explicit EarlyCallJoin(std::vector<std::shared_ptr<EarlyToolCall> >& calls) : calls_(calls) {}
+    ~EarlyCallJoin() {
+        for (size_t i = 0; i < calls_.size(); ++i) {
+            EarlyToolCall& early = *calls_[i];
+            if (!early.claimed.exchange(true)) continue;
+            std::unique_lock<std::mutex> lock(early.mutex);
+            early.cv.wait(lock, [&early] { return early.done; });
+        }
+    }
+private:
+    std::vector<std::shared_ptr<EarlyToolCall> >& calls_;
+};
+
+// First non-blank lines of text, up to max_lines and max_chars (cut on a
+// UTF-8 boundary)
+std::string extractive_summary(const std::string& text, size_t max_lines, size_t max_chars) {
+    std::string out;
+    size_t lines = 0;
+    size_t kept = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        size_t first = text.find_first_not_of(" \t\r", pos);
+        if (first < end) {
+            ++lines;
+            if (kept < max_lines && out.size() < max_chars) {
+                size_t last = text.find_last_not_of(" \t\r", end - 1);
+                size_t take = std::min(last + 1 - first, max_chars - out.size());
+                while (first + take < end && take > 0 &&
+                       (static_cast<unsigned char>(text[first + take]) & 0xC0) == 0x80) {
+                    --take;
+                }
+                if (!out.empty()) out += '\n';
+                out.append(text, first, take);
+                if (take < last + 1 - first) out += "...";
+                ++kept;
+            }
+        }
+        pos = end + 1;
+    }
+    if (lines > kept) {
+        out += "\n... (" + std::to_string(lines - kept) + " more lines)";
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+size_t Agent::compact_tool_results(ConversationMessage& msg, size_t min_chars, const std::string& owner) {
+    static const char OPEN[] = "[TOOL_RESULT tool=";
+    static const char CLOSE[] = "\n[/TOOL_RESULT]";
+    const std::string& content = msg.content;
+    
+    std::string out;
+    size_t copied = 0;          // content[0, copied) is settled in out
+    size_t pos = 0;
+    while ((pos = content.find(OPEN, pos)) != std::string::npos) {
+        size_t name_start = pos + sizeof(OPEN) - 1;
+        size_t header_end = content.find("]\n", name_start);
+        if (header_end == std::string::npos) break;
+        size_t body = header_end + 2;
+        size_t body_end = content.find(CLOSE, body);
+        if (body_end == std::string::npos) break;
+        pos = body_end + sizeof(CLOSE) - 1;
+        
+        // Errors are short and worth keeping; compacted ones are done
+        size_t length = body_end - body;
+        if (length < min_chars || content.compare(body, 12, "[Compacted: ") == 0 ||
+            content.compare(header_end - 13, 13, "success=false") == 0) {
+            continue;
+        }
+        
+        size_t name_end = content.find(' ', name_start);
+        std::string tool_name = content.substr(name_start, std::min(name_end, header_end) - name_start);
+        
+        std::string stored = content.substr(body, length);
+        std::string pointer;
+        std::string summary;
+        if (stored.compare(0, 19, "Content too large (") == 0) {
+            // Already in the chunker: keep the line naming it, drop the preview
+            size_t line_end = std::min(stored.find('\n'), stored.size());
+            pointer = "[Compacted: " + stored.substr(0, line_end) + "]";
+            summary = extractive_summary(stored.substr(line_end), 8, 400);
+        } else {
+            std::string id = chunker_.store(stored, tool_name, config_.effective_chunk_size(), owner);
+            size_t chunks = chunker_.get_total_chunks(id);
+            pointer = "[Compacted: " + std::to_string(length) + " characters stored as '" + id + "' (" +
+                      std::to_string(chunks) + (chunks == 1 ? " chunk" : " chunks") +
+                      "). Load them with content_chunk or content_search if you need the details again.]";
+            summary = extractive_summary(stored, 8, 400);
+        }
+        
+        out.append(content, copied, body - copied);
+        out += pointer;
+        out += '\n';
+        out += summary;
+        copied = body_end;
+    }
+    
+    if (copied == 0) return 0;
+    out.append(content, copied, std::string::npos);
+    size_t saved = content.size() > out.size() ? content.size() - out.size() : 0;
+    msg.content.swap(out);
+    return saved;
 }
 
-std::string Agent::format_tool_result(const std::string& tool_name, const AgentToolResult& result) {
+std::string Agent::format_tool_result(const std::string& tool_name, const AgentToolResult& result,
+                                      const std::string& owner) {
     std::ostringstream oss;
     oss << "[TOOL_RESULT tool=" << tool_name 
         << " success=" << (result.success ? "true" : "false") << "]\n";
@@ -597,7 +862,7 @@ std::string Agent::format_tool_result(const std::string& tool_name, const AgentT
         // Check if the result is too large and should be chunked
         if (config_.auto_chunk_large_results && result.output.size() > config_.max_tool_result_size) {
             // Store the large content in the chunker using config-driven chunk size
-            std::string chunk_id = chunker_.store(result.output, tool_name, config_.effective_chunk_size());
+            std::string chunk_id = chunker_.store(result.output, tool_name, config_.effective_chunk_size(), owner);
             size_t total_chunks = chunker_.get_total_chunks(chunk_id);
             
             LOG_INFO(" Large tool result (%zu bytes) chunked as '%s' (%zu chunks)",
@@ -617,7 +882,7 @@ std::string Agent::format_tool_result(const std::string& tool_name, const AgentT
             
             oss << "\n\n=== To access full content ===\n";
             oss << "Follow the instructions for working with chunked content in the tools documentation.\n";
-            oss << "Total chunks available: " << total_chunks;
+            oss << chunker_.get_info(chunk_id);
         } else {
             oss << result.output;
         }
@@ -707,11 +972,15 @@ bool Agent::try_truncate_history(std::vector<ConversationMessage>& history) cons
                         }
                     }
                     
-                    // Create truncated version
-                    std::ostringstream truncated;
-                    truncated << "[TOOL_RESULT tool=" << tool_name << " success=true]\n";
-                    truncated << "[Content truncated to fit context window - original was " 
-                              << msg.content.size() << " characters]\n";
+                    // Create truncated version (one buffer, built in place)
+                    size_t original_size = msg.content.size();
+                    std::string truncated;
+                    truncated.reserve(tool_name.size() + 2200);
+                    truncated += "[TOOL_RESULT tool=";
+                    truncated += tool_name;
+                    truncated += " success=true]\n[Content truncated to fit context window - original was ";
+                    truncated += std::to_string(original_size);
+                    truncated += " characters]\n";
                     
                     // Keep first 2000 chars of content
                     size_t content_start = msg.content.find("]\n", result_start);
@@ -722,17 +991,17 @@ bool Agent::try_truncate_history(std::vector<ConversationMessage>& history) cons
                     }
                     size_t content_len = result_end - content_start;
                     if (content_len > 2000) {
-                        truncated << msg.content.substr(content_start, 2000);
-                        truncated << "\n... [truncated] ...";
+                        truncated.append(msg.content, content_start, 2000);
+                        truncated += "\n... [truncated] ...";
                     } else {
-                        truncated << msg.content.substr(content_start, content_len);
+                        truncated.append(msg.content, content_start, content_len);
                     }
-                    truncated << "\n[/TOOL_RESULT]";
+                    truncated += "\n[/TOOL_RESULT]";
                     
                     LOG_DEBUG("Truncated tool result for '%s' from %zu to %zu chars",
-                              tool_name.c_str(), msg.content.size(), truncated.str().size());
+                              tool_name.c_str(), original_size, truncated.size());
                     
-                    msg.content = truncated.str();
+                    msg.content.swap(truncated);
                     truncated_something = true;
                 }
             }
@@ -747,8 +1016,10 @@ bool Agent::try_truncate_history(std::vector<ConversationMessage>& history) cons
     // Strategy 2: Remove older tool call/result pairs (keep first and last few messages)
     if (history.size() > 6) {
         // Keep first message (original user message) and build a valid alternating sequence
+        // Kept messages are moved, not copied: only string handles change hands
         std::vector<ConversationMessage> new_history;
-        new_history.push_back(history[0]);
+        new_history.reserve(6);
+        new_history.push_back(std::move(history[0]));
         
         // If first message is user, add a synthetic assistant response as bridge
         if (history[0].role == MessageRole::USER) {
@@ -776,519 +1047,1180 @@ bool Agent::try_truncate_history(std::vector<ConversationMessage>& history) cons
                 // Skip to avoid consecutive same-role messages
                 continue;
             }
-            new_history.push_back(history[i]);
             last_role = history[i].role;
+            new_history.push_back(std::move(history[i]));
         }
         
         LOG_INFO(" Reduced history from %zu to %zu messages", 
                  history.size(), new_history.size());
         
-        history = new_history;
+        history.swap(new_history);
         return true;
     }
     
     return false;
 }
 
-AgentResult Agent::run(
-    AIPlugin* ai,
-    const std::string& user_message,
-    std::vector<ConversationMessage>& history,
-    const std::string& system_prompt,
-    const AgentConfig& config) {
+namespace {
+
+// action it has not taken. True (keep going) unless it answers NO.
+bool confirm_tool_intent(AIPlugin* ai, const std::string& response) {
+    // Announcements come at the end of a reply
+    size_t from = response.size() > 2000 ? response.size() - 2000 : 0;
+    while (from > 0 && from < response.size() && (static_cast<unsigned char>(response[from]) & 0xC0) == 0x80) {
+        ++from;  // Not in the middle of a UTF-8 sequence
+    }
+    std::string tail = from > 0 ? "[...]" + response.substr(from) : response;
+    std::vector<ConversationMessage> request;
+    request.push_back(ConversationMessage::user(
+        "An AI assistant that acts through tool calls sent this reply without any tool call:\n\n"
+        "---\n" + tail + "\n---\n\n"
+        "Does the reply say the assistant is about to do something it has not done yet (YES), "
+        "or is it a complete answer or question for the user (NO)? Answer YES or NO."));
     
-    AgentResult result;
-    result.iterations = 0;
-    result.tool_calls_made = 0;
+    CompletionOptions opts;
+    opts.system_prompt = "You classify messages. Answer with a single word.";
+    opts.max_tokens = 4;
+    opts.temperature = 0.0;
+    opts.skip_context_management = true;
     
-    if (!ai || !ai->is_configured()) {
+    CompletionResult result = PurposeModels::instance().chat(PURPOSE_CLASSIFY, ai, request, opts);
+    if (!result.success) {
+        LOG_DEBUG("Intent check failed (%s), trusting the heuristic", result.error.c_str());
+        return true;
+    }
+    std::string answer = trim_whitespace(result.content);
+    std::transform(answer.begin(), answer.end(), answer.begin(), ::toupper);
+    LOG_DEBUG("Intent check: %s", answer.c_str());
+    return answer.compare(0, 2, "NO") != 0;
+}
+
+} // anonymous namespace
+
+// The provider turned the request itself down (bad request, no such
+// endpoint, unprocessable): what a model or server without function
+// calling answers to a request with tools
+static bool is_request_rejected(const std::string& error) {
+    return error.find("(HTTP 400)") != std::string::npos ||
+           error.find("(HTTP 404)") != std::string::npos ||
+           error.find("(HTTP 422)") != std::string::npos;
+}
+
+// ============================================================================
+// Agent Run
+// ============================================================================
+
+// One run of the agentic loop as a resumable state machine. drive() works
+// through the loop until a model call is in flight and returns; the reply
+// resumes it, on the thread waiting in Agent::run() or on a pool worker for
+// Agent::run_async(). Providers without chat_async() answer inline, and then
+// the whole run stays on one thread as before.
+struct AgentRun : public std::enable_shared_from_this<AgentRun> {
+    // Continues the run once a reply arrived while drive() was not running
+    typedef std::function<void(const std::shared_ptr<AgentRun>& run)> Resume;
+    
+    enum Step { NEXT, WAIT, DONE };
+    
+    Agent& agent;
+    AIPlugin* ai;
+    std::string user_message;
+    std::vector<ConversationMessage>& history;
+    std::string system_prompt;
+    AgentConfig config;
+    AgentResult result;
+    Resume resume;
+    
+    // Across iterations
+    size_t initial_history_size;
+    bool native;
+    std::vector<ToolSpec> specs;
+    std::string full_system_prompt;
+    std::string prompt_context;         // From config.prompt_context, part of full_system_prompt
+    ToolCallContext tool_context;       // Seen by tools through ToolCallContext::current()
+    int consecutive_errors;
+    int token_limit_retries;
+    std::string accumulated_response;
+    // Track recent tool calls to detect duplicates across iterations
+    // Key: "tool_name:params_json", Value: iteration when last executed
+    std::map<std::string, int> recent_tool_calls;
+    // Tool-result messages added by this run: (history index, iteration)
+    std::vector<std::pair<size_t, int> > result_messages;
+    // Replies to store once the run is done, while it has no side effects
+    bool side_effects;
+    std::vector<std::pair<ResponseCache::Key, std::string> > cache_pending;
+    
+    // The current iteration
+    CompletionOptions opts;
+    bool cacheable;
+    ResponseCache::Key cache_key;
+    std::unique_ptr<ReplyStreamFilter> stream_filter;
+    size_t max_parallel;
+    bool early_start;
+    ToolCallScanner scanner;
+    std::vector<std::shared_ptr<EarlyToolCall> > early_calls;
+    size_t early_seen;
+    bool early_open;                    // Every call so far may run early
+    int64_t chat_start;
+    int64_t last_progress_ms;           // Streamed chunks count as progress, once a second
+    std::string account;                // FairShareScheduler account
+    std::string memo_scope;             // ToolMemo scope ("" = memo off)
+    size_t chunks;                      // Streamed chunks of the reply so far
+    std::shared_ptr<RunRecording> recording;    // agent.record_dir (null = off)
+    
+    // The model call in flight: whichever of the caller and the completion
+    // gets to the handoff second carries on with the reply
+    std::atomic<bool> handoff;
+    bool have_reply;
+    bool cached_reply;
+    CompletionResult reply;
+    
+    // Trace: spans stay open across the wait for the model
+    TraceContext trace_context;
+    std::unique_ptr<ScopedSpan> root_span;
+    std::unique_ptr<ScopedSpan> iteration_span;
+    std::unique_ptr<ScopedSpan> chat_span;
+    
+    // Streamed text of an async provider arrives on its I/O thread; channel
+    // edits are handed to the pool, newest text only
+    bool defer_partials;
+    std::mutex partial_mutex;
+    std::string partial_text;
+    bool partial_posted;
+    std::mutex delivery_mutex;          // Held while on_partial runs
+    bool partials_closed;
+    
+    AgentRun(Agent& owner, AIPlugin* provider, const std::string& message,
+             std::vector<ConversationMessage>& conversation, const std::string& prompt,
+             const AgentConfig& run_config)
+        : agent(owner), ai(provider), user_message(message), history(conversation)
+        , system_prompt(prompt), config(run_config), initial_history_size(conversation.size())
+        , native(false), consecutive_errors(0), token_limit_retries(0), side_effects(false)
+        , cacheable(false), max_parallel(1), early_start(false), early_seen(0), early_open(true)
+        , chat_start(0), last_progress_ms(0), chunks(0), handoff(false), have_reply(false), cached_reply(false)
+        , defer_partials(run_config.async_model_calls && provider && provider->supports_async() && owner.pool_ != nullptr)
+        , partial_posted(false), partials_closed(false) {
+        result.iterations = 0;
+        result.tool_calls_made = 0;
+        trace_context.trace = Tracer::instance().begin("agent.run", config.session_key);
+        if (trace_context.trace) result.trace_id = trace_context.trace->id();
+        recording = RunRecorder::instance().begin(result.trace_id);
+    }
+    
+    // Run until the loop ends (true) or waits for the model (false)
+    bool drive() {
+        TraceContextScope scope(trace_context);
+        Step step = root_span ? NEXT : begin();
+        while (step == NEXT) {
+            step = have_reply ? on_reply() : start_iteration();
+        }
+        if (step == WAIT) {
+            return false;   // The reply resumes the run, maybe on another thread already
+        }
+        finish();
+        return true;
+    }
+    
+    Step begin();
+    Step start_iteration();
+    Step on_reply();
+    Step handle_reply(CompletionResult& ai_result);
+    Step pause_for_iterations();
+    Step stop();
+    void end_iteration();
+    void finish();
+    void record_inputs();
+    
+    bool stopped() const { return config.cancel && config.cancel->cancelled(); }
+    
+    // Send the request; true if the reply is already here
+    bool await_reply();
+    void call_model(bool admitted);
+    void deliver_reply();
+    void on_chunk(const std::string& chunk);
+    void on_partial(const std::string& text);
+    void flush_partial();
+};
+
+AgentRun::Step AgentRun::begin() {
+    root_span.reset(new ScopedSpan("agent.run", "agent"));
+    
+    if (!ai || !ai->is_configured()) {
         result.error = "AI not configured";
-        return result;
+        return DONE;
     }
     
     LOG_INFO(" Starting agentic loop (max_iterations=%d, tools=%zu)",
-             config.max_iterations, tools_.size());
+             config.max_iterations, agent.tools_.size());
     LOG_DEBUG("▶ IN  User message (%zu chars): %.100s%s", 
               user_message.size(), user_message.c_str(), user_message.size() > 100 ? "..." : "");
     LOG_DEBUG("▶ IN  System prompt: %zu chars", system_prompt.size());
     
-    // Track initial history size so we can restore on failure
-    size_t initial_history_size = history.size();
+    if (recording) {
+        record_inputs();
+    }
     
     // Add user message to history
     history.push_back(ConversationMessage::user(user_message));
     
-    // Build full system prompt: caller-provided prompt (default + config + skills)
-    // plus the tools schema section generated by the agent.
-    std::string full_system_prompt = system_prompt;
-    std::string tools_prompt = build_tools_prompt();
-    if (!tools_prompt.empty()) {
-        if (!full_system_prompt.empty()) full_system_prompt += "\n\n";
-        full_system_prompt += tools_prompt;
+    // Native function calling: tools travel as schemas and calls come back
+    // structured, so the prompt drops the JSON format rules and tool list.
+    // The text protocol stays the fallback.
+    native = config.native_tools && !agent.tools_.empty() && ai->supports_native_tools();
+    if (native) {
+        specs = agent.tool_specs();
     }
+    
+    // Full system prompt: caller-provided prompt (default + config + skills)
+    // plus the tools schema section generated by the agent (cached).
+    full_system_prompt = agent.build_system_prompt(system_prompt, native);
 
     LOG_DEBUG("Full system prompt length: %zu chars", full_system_prompt.size());
-    LOG_DEBUG("Full system prompt content:\n%s", full_system_prompt.c_str());
 
-    int consecutive_errors = 0;
-    int token_limit_retries = 0;
+    tool_context.session_key = config.session_key;
+    tool_context.user_key = config.user_key;
+    tool_context.cancel_key = config.cancel_key;
+    tool_context.cancel = config.cancel ? config.cancel->flag() : NULL;
+    tool_context.on_progress = config.on_progress;
+    tool_context.recording = recording.get();
+    account = FairShareScheduler::instance().account_for(config.session_key, config.user_key);
+    
+    if (agent.tool_memo_.enabled()) {
+        static std::atomic<uint64_t> next_run(1);
+        memo_scope = agent.tool_memo_.per_session() && !config.session_key.empty()
+            ? config.session_key : "run:" + std::to_string(next_run.fetch_add(1));
+    }
+    return NEXT;
+}
+
+// What the run starts from, before the user message joins the history
+void AgentRun::record_inputs() {
+    RunRecording& rec = *recording;
+    rec.session_key = config.session_key;
+    rec.provider = ai->provider_id();
+    rec.model = ai->default_model();
+    rec.native_tools = ai->supports_native_tools();
+    rec.streamed = static_cast<bool>(config.on_partial);
+    rec.config = config;
+    rec.config.on_partial = nullptr;
+    rec.config.on_progress = nullptr;
+    rec.config.prompt_context = nullptr;
+    rec.config.cancel.reset();
+    rec.user_message = user_message;
+    rec.history = history;
+    rec.system_prompt = system_prompt;
+    for (std::map<std::string, AgentTool>::const_iterator it = agent.tools_.begin(); it != agent.tools_.end(); ++it) {
+        rec.tools.push_back(it->second);
+        rec.tools.back().execute = nullptr;
+    }
+}
+
+AgentRun::Step AgentRun::stop() {
+    LOG_INFO(" Agent run stopped after %d iteration(s), %d tool call(s)",
+             result.iterations, result.tool_calls_made);
+    result.success = false;
+    result.cancelled = true;
+    result.error = "Stopped";
+    return DONE;
+}
+
+AgentRun::Step AgentRun::start_iteration() {
+    if (stopped()) {
+        return stop();
+    }
+    if (result.iterations >= config.max_iterations) {
+        return pause_for_iterations();
+    }
+    result.iterations++;
+    iteration_span.reset(new ScopedSpan("iteration", "agent"));
+    iteration_span->set("n", result.iterations);
+    tool_context.trace = TraceContext::current();
+    LOG_DEBUG("=== Iteration %d/%d ===", result.iterations, config.max_iterations);
+    
+    // Tool results older than compact_after iterations give way to a
+    // pointer into the chunker and a short summary. They go in batches
+    // of compact_after, so the provider's cached prompt prefix breaks
+    // once per batch rather than every iteration.
+    if (config.compact_after > 0) {
+        size_t due = 0;
+        while (due < result_messages.size() &&
+               result_messages[due].second < result.iterations - config.compact_after) {
+            ++due;
+        }
+        if (due >= static_cast<size_t>(config.compact_after)) {
+            ScopedSpan compact_span("compact_tool_results", "format");
+            size_t saved = 0;
+            for (size_t i = 0; i < due; ++i) {
+                size_t at = result_messages[i].first;
+                if (at < history.size()) {
+                    saved += agent.compact_tool_results(history[at], config.compact_min_chars, config.session_key);
+                }
+            }
+            result_messages.erase(result_messages.begin(), result_messages.begin() + due);
+            if (saved > 0) {
+                LOG_INFO(" Compacted tool results of %zu earlier iteration(s), %zu characters saved", due, saved);
+                iteration_span->set("compacted_chars", saved);
+            }
+        }
+    }
+    LOG_DEBUG("▶ IN  Sending %zu messages to AI (history size: %zu)",
+              history.size(), history.size());
+    
+    // The caller's context was gathered while the run got ready
+    if (config.prompt_context) {
+        prompt_context = config.prompt_context();
+        config.prompt_context = nullptr;
+        if (!prompt_context.empty()) {
+            LOG_DEBUG("▶ IN  Prompt context: %zu chars", prompt_context.size());
+            full_system_prompt += prompt_context;
+            if (recording) recording->prompt_context = prompt_context;
+        }
+    }
+    
+    // Call AI
+    opts = CompletionOptions();
+    opts.system_prompt = full_system_prompt;
+    opts.stable_system_prompt = true;  // Same bytes every iteration: let providers cache it
+    opts.session_key = config.session_key;
+    opts.max_tokens = 4096;
+    opts.temperature = config.temperature;
+    if (native) {
+        opts.tools = specs;
+    }
+    if (config.cancel) {
+        opts.cancel = config.cancel->flag();
+        opts.cancel_token = config.cancel.get();
+    }
+    
+    // A cached reply stands for what the model would say again: only
+    // deterministic (temperature 0) requests use the cache
+    cacheable = agent.response_cache_.enabled() && !side_effects && opts.temperature == 0.0;
+    if (cacheable) {
+        char temperature[32];
+        snprintf(temperature, sizeof(temperature), "|t=%g", opts.temperature);
+        std::string scope = ai->provider_id() + "/" + ai->default_model() + temperature;
+        for (size_t i = 0; native && i < specs.size(); ++i) {
+            scope += (i == 0 ? "|tools:" : ",") + specs[i].name;
+        }
+        cache_key = agent.response_cache_.make_key(scope, full_system_prompt, history);
+    }
+    
+    // Stream visible text to the caller while the model is still generating
+    stream_filter.reset(new ReplyStreamFilter(
+        config.on_partial ? [this](const std::string& text) { on_partial(text); } : ReplyStreamFilter::Sink()));
+    
+    // Scan the stream for tool calls too: parallel-safe calls at the
+    // start of the reply begin while the rest is still being written
+    max_parallel = config.max_parallel_tools > 1 ?
+        static_cast<size_t>(config.max_parallel_tools) : 1;
+    early_start = config.early_tool_start && agent.pool_ && max_parallel > 1;
+    scanner = ToolCallScanner();
+    early_calls.clear();
+    early_seen = 0;
+    early_open = true;
+    chunks = 0;
+    
+    if (config.on_partial || early_start) {
+        opts.stream = true;
+        opts.on_chunk = [this](const std::string& chunk) { on_chunk(chunk); };
+    }
+    
+    std::string cached;
+    if (cacheable && agent.response_cache_.lookup(cache_key, cached)) {
+        LOG_INFO(" ◀ OUT Reply from the response cache (%zu chars)", cached.size());
+        ScopedSpan cache_span("response_cache", "llm");
+        cache_span.set("chars", cached.size());
+        reply = CompletionResult::ok(cached);
+        if (opts.on_chunk) {
+            opts.on_chunk(reply.content);
+        }
+        cached_reply = true;
+        have_reply = true;
+        return NEXT;
+    }
+    
+    chat_span.reset(new ScopedSpan("chat " + ai->provider_id(), "llm"));
+    chat_start = current_timestamp_ms();
+    return await_reply() ? NEXT : WAIT;
+}
+
+// Tokens a call is charged to its account: what the provider reported
+static int64_t charged_tokens(const UsageStats& usage) {
+    return usage.total_tokens > 0 ? usage.total_tokens : usage.input_tokens + usage.output_tokens;
+}
+
+bool AgentRun::await_reply() {
+    // The first iteration answers someone waiting: it goes ahead of tool loops
+    FairShareScheduler& fair = FairShareScheduler::instance();
+    bool first_turn = result.iterations <= 1;
+    if (!config.async_model_calls) {
+        if (!fair.acquire(account, first_turn, opts.cancel)) {
+            reply = CompletionResult::fail("Cancelled while waiting for the model");
+        } else {
+            chat_start = current_timestamp_ms();    // Model latency leaves out the queue
+            reply = ai->chat(history, opts);
+            fair.release(account, charged_tokens(reply.usage));
+        }
+        have_reply = true;
+        return true;
+    }
+    std::shared_ptr<AgentRun> self = shared_from_this();
+    trace_context = TraceContext::current();    // Parent of the spans opened on resume
+    handoff = false;
+    // A queued call starts later from the pool: the worker moves on
+    fair.submit(account, first_turn, opts.cancel, [self](bool admitted) { self->call_model(admitted); });
+    return handoff.exchange(true);
+}
+
+void AgentRun::call_model(bool admitted) {
+    if (!admitted) {
+        reply = CompletionResult::fail("Cancelled while waiting for the model");
+        deliver_reply();
+        return;
+    }
+    chat_start = current_timestamp_ms();
+    std::shared_ptr<AgentRun> self = shared_from_this();
+    ai->chat_async(history, opts, [self](CompletionResult& completed) {
+        FairShareScheduler::instance().release(self->account, charged_tokens(completed.usage));
+        self->reply = std::move(completed);
+        self->deliver_reply();
+    });
+}
+
+void AgentRun::deliver_reply() {
+    have_reply = true;
+    if (handoff.exchange(true)) {
+        resume(shared_from_this());     // The caller has moved on
+    }
+}
+
+void AgentRun::on_chunk(const std::string& chunk) {
+    ++chunks;
+    if (config.on_progress) {
+        int64_t now = current_timestamp_ms();
+        if (now - last_progress_ms >= 1000) {
+            last_progress_ms = now;
+            config.on_progress();
+        }
+    }
+    if (config.on_partial) {
+        stream_filter->on_chunk(chunk);
+    }
+    if (!early_start || scanner.feed(chunk) == 0) {
+        return;
+    }
+    const std::vector<ParsedToolCall>& found = scanner.calls();
+    for (; early_open && early_seen < found.size(); ++early_seen) {
+        const ParsedToolCall& call = found[early_seen];
+        // A call with side effects keeps its place: stop here
+        if (!call.valid || !agent.is_parallel_safe(call) || early_calls.size() >= max_parallel) {
+            early_open = false;
+            break;
+        }
+        // Skipped later as a duplicate or a repeat of the last iteration
+        std::string key = call.tool_name + ":" + call.params.dump();
+        bool skip = false;
+        for (size_t j = 0; j < early_calls.size() && !skip; ++j) {
+            skip = early_calls[j]->dedup_key == key;
+        }
+        std::map<std::string, int>::const_iterator prev = recent_tool_calls.find(key);
+        if (skip || (prev != recent_tool_calls.end() && prev->second == result.iterations - 1) ||
+            (!memo_scope.empty() && agent.tool_memo_.contains(memo_scope, key))) {
+            continue;
+        }
+        LOG_DEBUG("Starting '%s' while the reply streams", call.tool_name.c_str());
+        early_calls.push_back(agent.start_early(call, &tool_context));
+    }
+}
+
+void AgentRun::on_partial(const std::string& text) {
+    if (!defer_partials) {
+        config.on_partial(text);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(partial_mutex);
+    partial_text = text;
+    if (partial_posted) return;
+    partial_posted = true;
+    std::shared_ptr<AgentRun> self = shared_from_this();
+    agent.pool_->enqueue(Task([self]() { self->flush_partial(); }), TaskPriority::INTERACTIVE);
+}
+
+void AgentRun::flush_partial() {
+    std::lock_guard<std::mutex> delivery(delivery_mutex);
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(partial_mutex);
+        text.swap(partial_text);
+        partial_posted = false;
+    }
+    if (!partials_closed && !text.empty()) {
+        config.on_partial(text);
+    }
+}
+
+AgentRun::Step AgentRun::on_reply() {
+    have_reply = false;
+    CompletionResult ai_result = std::move(reply);
+    int64_t chat_ms = 0;
+    bool from_cache = cached_reply;
+    
+    if (cached_reply) {
+        cached_reply = false;
+    } else {
+        chat_ms = current_timestamp_ms() - chat_start;
+        result.model_ms += chat_ms;
+        record_llm_request(ai->provider_id(), PURPOSE_CHAT, static_cast<double>(chat_ms) / 1000.0,
+                           ai_result.success, ai_result.usage.input_tokens, ai_result.usage.output_tokens,
+                           ai_result.usage.cached_tokens);
+        chat_span->set("messages", history.size());
+        chat_span->set("model", ai_result.model);
+        chat_span->set("success", ai_result.success);
+        chat_span->set("input_tokens", ai_result.usage.input_tokens);
+        chat_span->set("output_tokens", ai_result.usage.output_tokens);
+        chat_span->set("cached_tokens", ai_result.usage.cached_tokens);
+        if (!ai_result.stop_reason.empty()) chat_span->set("stop_reason", ai_result.stop_reason);
+        chat_span.reset();
+        // Truncated replies are not worth keeping
+        if (cacheable && ai_result.success && ai_result.stop_reason != "max_tokens" &&
+            ai_result.stop_reason != "length") {
+            cache_pending.push_back(std::make_pair(cache_key, ai_result.content));
+        }
+    }
+    
+    if (recording) {
+        RecordedReply recorded;
+        recorded.result = ai_result;
+        recorded.ms = chat_ms;
+        recorded.chunks = chunks;
+        recorded.cached = from_cache;
+        recording->replies.push_back(recorded);
+    }
+    
+    // A reply that arrives after /stop is dropped, tool calls and all
+    Step step = stopped() ? stop() : handle_reply(ai_result);
+    end_iteration();
+    return step;
+}
+
+// Waits out early calls still running when an iteration ends (failed chat,
+// duplicate skipped): they hold a pointer to the run's ToolCallContext
+void AgentRun::end_iteration() {
+    {
+        EarlyCallJoin join(early_calls);
+    }
+    early_calls.clear();
+    iteration_span.reset();
+}
+
+AgentRun::Step AgentRun::handle_reply(CompletionResult& ai_result) {
     const int max_token_limit_retries = 2;
-    std::string accumulated_response;
     
-    // Track recent tool calls to detect duplicates across iterations
-    // Key: "tool_name:params_json", Value: iteration when last executed
-    std::map<std::string, int> recent_tool_calls;
+    if (config.on_progress) {
+        config.on_progress();
+    }
     
-    // Agentic loop
-    while (result.iterations < config.max_iterations) {
-        result.iterations++;
-        LOG_DEBUG("=== Iteration %d/%d ===", result.iterations, config.max_iterations);
-        LOG_DEBUG("▶ IN  Sending %zu messages to AI (history size: %zu)",
-                  history.size(), history.size());
-        
-        // Call AI
-        CompletionOptions opts;
-        opts.system_prompt = full_system_prompt;
-        opts.max_tokens = 4096;
+    if (!ai_result.success) {
+        LOG_ERROR(" ◀ OUT AI call failed: %s", ai_result.error.c_str());
         
-        CompletionResult ai_result = ai->chat(history, opts);
-        
-        if (!ai_result.success) {
-            LOG_ERROR(" ◀ OUT AI call failed: %s", ai_result.error.c_str());
+        // Check if this is a token limit error
+        if (agent.is_token_limit_error(ai_result.error)) {
+            token_limit_retries++;
+            LOG_WARN(" Token limit exceeded (attempt %d/%d), trying to recover...",
+                     token_limit_retries, max_token_limit_retries);
             
-            // Check if this is a token limit error
-            if (is_token_limit_error(ai_result.error)) {
-                token_limit_retries++;
-                LOG_WARN(" Token limit exceeded (attempt %d/%d), trying to recover...",
-                         token_limit_retries, max_token_limit_retries);
-                
-                if (token_limit_retries <= max_token_limit_retries) {
-                    // Try to truncate history and retry
-                    if (try_truncate_history(history)) {
-                        LOG_INFO(" History truncated, retrying...");
-                        consecutive_errors = 0;  // Reset error count for this recovery attempt
-                        continue;
-                    } else {
-                        LOG_WARN(" Could not truncate history further");
-                    }
-                }
-                
-                // If we've exhausted retries or can't truncate, fail gracefully
-                result.error = "Context window exceeded and recovery failed. Try a simpler request or use smaller data.";
-                // Restore history to state before this agent run
-                while (history.size() > initial_history_size) {
-                    history.pop_back();
+            if (token_limit_retries <= max_token_limit_retries) {
+                // Try to truncate history and retry
+                if (agent.try_truncate_history(history)) {
+                    LOG_INFO(" History truncated, retrying...");
+                    result_messages.clear();    // Indices no longer hold
+                    consecutive_errors = 0;  // Reset error count for this recovery attempt
+                    return NEXT;
+                } else {
+                    LOG_WARN(" Could not truncate history further");
                 }
-                return result;
             }
             
-            consecutive_errors++;
-            if (consecutive_errors >= config.max_consecutive_errors) {
-                LOG_WARN(" Reached max consecutive errors (%d) - pausing for user decision",
-                         config.max_consecutive_errors);
-                result.success = false;
-                result.paused = true;
-                
-                std::ostringstream err_pause_msg;
-                err_pause_msg << "⚠️ **Task paused after " << consecutive_errors 
-                              << " consecutive AI errors**\n\n";
-                err_pause_msg << "Last error: " << ai_result.error << "\n\n";
-                
-                if (!accumulated_response.empty()) {
-                    err_pause_msg << "Progress so far:\n" << accumulated_response << "\n\n";
-                }
-                
-                err_pause_msg << "The AI encountered repeated errors after "
-                              << result.iterations << " iterations and "
-                              << result.tool_calls_made << " tool calls.\n\n";
-                err_pause_msg << "**Options:**\n";
-                err_pause_msg << "• `/continue` - Retry with 15 more iterations\n";
-                err_pause_msg << "• `/continue <N>` - Retry with N more iterations\n";
-                err_pause_msg << "• `/cancel` - Stop the task\n";
-                
-                result.pause_message = err_pause_msg.str();
-                result.final_response = result.pause_message;
-                return result;
+            // If we've exhausted retries or can't truncate, fail gracefully
+            result.error = "Context window exceeded and recovery failed. Try a simpler request or use smaller data.";
+            // Restore history to state before this agent run
+            while (history.size() > initial_history_size) {
+                history.pop_back();
             }
-            continue;
+            return DONE;
         }
         
-        consecutive_errors = 0;
-        token_limit_retries = 0;  // Reset on successful call
-        std::string response = ai_result.content;
-        
-        LOG_DEBUG("◀ OUT AI response (%zu chars): %.300s%s", 
-                  response.size(), response.c_str(), 
-                  response.size() > 300 ? "..." : "");
-        
-        // Parse tool calls
-        std::vector<ParsedToolCall> calls = parse_tool_calls(response);
+        if (native && is_request_rejected(ai_result.error)) {
+            LOG_WARN(" Request with native tools rejected, using the text protocol for this run");
+            native = false;
+            full_system_prompt = agent.build_system_prompt(system_prompt, false) + prompt_context;
+            return NEXT;
+        }
         
-        if (calls.empty()) {
-            // Check if the AI indicated intent to use a tool but didn't emit the call
-            // This is common with smaller models that "think out loud"
-            bool indicates_tool_intent = false;
-            bool is_asking_question = false;
-            std::string response_lower = response;
-            std::transform(response_lower.begin(), response_lower.end(), response_lower.begin(), ::tolower);
-            
-            // Check if AI is asking a question (not intent to act)
-            if (response_lower.find("?") != std::string::npos &&
-                (response_lower.find("which") != std::string::npos ||
-                 response_lower.find("what") != std::string::npos ||
-                 response_lower.find("where") != std::string::npos ||
-                 response_lower.find("could you") != std::string::npos ||
-                 response_lower.find("would you") != std::string::npos ||
-                 response_lower.find("do you want") != std::string::npos)) {
-                is_asking_question = true;
-                LOG_DEBUG("AI is asking a question, not forcing tool call");
-            }
+        consecutive_errors++;
+        if (consecutive_errors >= config.max_consecutive_errors) {
+            LOG_WARN(" Reached max consecutive errors (%d) - pausing for user decision",
+                     config.max_consecutive_errors);
+            result.success = false;
+            result.paused = true;
             
-            // Patterns that indicate the AI wants to use a tool NOW
-            // Only trigger if it's a clear statement of intent to act immediately
-            const char* intent_patterns[] = {
-                "let me create",
-                "let me write",
-                "let me read",
-                "let me check",
-                "let me look",
-                "let me search",
-                "let me fetch",
-                "let me browse",
-                "let me run",
-                "let me execute",
-                "let me try",
-                "let me make",
-                "let me update",
-                "let me modify",
-                "let me delete",
-                "let me remove",
-                "let me add",
-                "let me open",
-                "let me download",
-                "let me get",
-                "let me see",
-                "let me find",
-                "let me use",
-                "let me install",
-                "i'll create",
-                "i'll write",
-                "i'll read",
-                "i'll check",
-                "i'll run",
-                "i'll execute",
-                "i'll fetch",
-                "i'll browse",
-                "i'll search",
-                "i'll make",
-                "i'll use",
-                "will create",
-                "will write",
-                "will run",
-                "need to create",
-                "need to write",
-                "need to read",
-                "need to check",
-                "need to run",
-                "need to fetch",
-                "need to browse",
-                "need to search",
-                "need to make",
-                "now i'll",
-                "now let me",
-                "let's do that",
-                "let's do it",
-                "let's create",
-                "let's check",
-                "let's write",
-                "let's run",
-                "let's look",
-                "let's fetch",
-                "let's search",
-                "let's make",
-                "should check",
-                "should write",
-                "should run", 
-                "should do",
-                "should use the",
-                "i'll do that",
-                "doing that now",
-                "executing now",
-                "running the command now",
-                "let's execute it",
-                "i'll emit the tool call",
-                "need to emit",
-                "emitting tool call",
-                "calling the tool",
-                "can handle using the",
-                "going to create",
-                "going to write",
-                "going to read",
-                "going to check",
-                "going to look",
-                "going to search",
-                "going to fetch",
-                "going to browse",
-                "going to run",
-                "going to execute",
-                "going to try",
-                "going to make",
-                "going to update",
-                "going to modify",
-                "going to delete",
-                "going to remove",
-                "going to add",
-                "going to open",
-                "going to download",
-                "going to get",
-                "going to see",
-                "going to find",
-                "going to use",
-                "going to install",
-                "about to create",
-                "about to write",
-                "about to read",
-                "about to check",
-                "about to look",
-                "about to search",
-                "about to fetch",
-                "about to browse",
-                "about to run",
-                "about to execute",
-                "about to try",
-                "about to make",
-                "about to update",
-                "about to modify",
-                "about to delete",
-                "about to remove",
-                "about to add",
-                "about to open",
-                "about to download",
-                "about to get",
-                "about to see",
-                "about to find",
-                "about to use",
-                "about to install",
-                "plan to create",
-                "plan to write",
-                "plan to run",
-                "want to create",
-                "want to write",
-                "want to run",
-                "ready to create",
-                "ready to write",
-                "ready to run",
-                "preparing to create",
-                "preparing to write",
-                "preparing to run",
-                "creating now",
-                "writing now",
-                "reading now",
-                "checking now",
-                "looking now",
-                "searching now",
-                "fetching now",
-                "browsing now",
-                "running now",
-                "executing now",
-                "trying now",
-                "making now",
-                "updating now",
-                "modifying now",
-                "deleting now",
-                "removing now",
-                "adding now",
-                "opening now",
-                "downloading now",
-                "getting now",
-                "seeing now",
-                "finding now",
-                "using now",
-                "installing now",
-                "time to create",
-                "time to write",
-                "time to run",
-                "let's get started with",
-                "starting to",
-                "beginning to",
-                "commencing to",
-                "initiating",
-                "launching",
-                "starting the",
-                "beginning the",
-                "commencing the",
-                "initiating the",
-                "launching the",
-                NULL
-            };
+            std::ostringstream err_pause_msg;
+            err_pause_msg << "⚠️ **Task paused after " << consecutive_errors 
+                          << " consecutive AI errors**\n\n";
+            err_pause_msg << "Last error: " << ai_result.error << "\n\n";
             
-            for (int i = 0; intent_patterns[i] != NULL && !is_asking_question; ++i) {
-                if (response_lower.find(intent_patterns[i]) != std::string::npos) {
-                    indicates_tool_intent = true;
-                    LOG_DEBUG("Detected tool intent pattern: '%s'", intent_patterns[i]);
-                    break;
-                }
-            }
-            
-            // If AI indicated intent but no tool call, prompt it to actually emit the call
-            if (indicates_tool_intent && !is_asking_question && result.iterations < config.max_iterations) {
-                LOG_INFO(" ▶ IN  AI indicated tool intent, sending continuation prompt");
-                
-                // Add the AI's response to history
-                history.push_back(ConversationMessage::assistant(response));
-
-                // stupid model won't act, lets kick it's arse
-                std::string continuation_prompt = 
-                    "You said you would take action but didn't use a tool. "
-                    "Stop planning and ACT NOW. Emit the tool call immediately:\n\n"
-                    "{\"tool\": \"TOOLNAME\", \"arguments\": {\"param\": \"value\"}}\n\n"
-                    "Do NOT explain. Do NOT plan. Just emit the tool call.";
-                
-                history.push_back(ConversationMessage::user(continuation_prompt));
-                continue;  // Continue the loop to get the actual tool call
+            if (!accumulated_response.empty()) {
+                err_pause_msg << "Progress so far:\n" << accumulated_response << "\n\n";
             }
             
-            // No tool calls and no intent - we're done
-            LOG_INFO(" ◀ OUT Final response after %d iterations (%d tool calls)", 
-                     result.iterations, result.tool_calls_made);
-            
-            // Add final response to history
-            history.push_back(ConversationMessage::assistant(response));
+            err_pause_msg << "The AI encountered repeated errors after "
+                          << result.iterations << " iterations and "
+                          << result.tool_calls_made << " tool calls.\n\n";
+            err_pause_msg << "**Options:**\n";
+            err_pause_msg << "• `/continue` - Retry with 15 more iterations\n";
+            err_pause_msg << "• `/continue <N>` - Retry with N more iterations\n";
+            err_pause_msg << "• `/cancel` - Stop the task\n";
             
-            result.success = true;
-            result.final_response = response;
-            return result;
+            result.pause_message = err_pause_msg.str();
+            result.final_response = result.pause_message;
+            return DONE;
+        }
+        return NEXT;
+    }
+    
+    consecutive_errors = 0;
+    token_limit_retries = 0;  // Reset on successful call
+    result.prompt_tokens += ai_result.usage.input_tokens;
+    result.cached_prompt_tokens += ai_result.usage.cached_tokens;
+    result.completion_tokens += ai_result.usage.output_tokens;
+    std::string response;
+    response.swap(ai_result.content);
+    std::vector<ToolCallRequest> native_requests;
+    native_requests.swap(ai_result.tool_calls);
+    
+    LOG_DEBUG("◀ OUT AI response (%zu chars): %.300s%s", 
+              response.size(), response.c_str(), 
+              response.size() > 300 ? "..." : "");
+    
+    // Parse tool calls
+    std::vector<ParsedToolCall> calls;
+    {
+        ScopedSpan parse_span("parse_tool_calls", "parse");
+        if (!native_requests.empty()) {
+            // Structured already; nothing to scan
+            calls = agent.native_tool_calls(native_requests, response);
+        } else if (early_start && scanner.text() == response) {
+            // The stream was scanned already; settle the tail
+            scanner.finish();
+            calls.swap(scanner.calls());
+        } else {
+            // Not streamed, or the provider rewrote the reply
+            calls = agent.parse_tool_calls(response);
         }
+        parse_span.set("calls", calls.size());
+        if (!early_calls.empty()) {
+            parse_span.set("early", early_calls.size());
+        }
+    }
+    
+    // A tool that changes something makes the run's replies uncacheable
+    for (size_t i = 0; i < calls.size() && !side_effects; ++i) {
+        if (calls[i].valid && !agent.is_parallel_safe(calls[i])) {
+            side_effects = true;
+            cache_pending.clear();
+        }
+    }
+    
+    if (calls.empty()) {
+        // Check if the AI indicated intent to use a tool but didn't emit the call
+        // This is common with smaller models that "think out loud"
+        bool indicates_tool_intent = false;
+        bool is_asking_question = false;
+        std::string response_lower = response;
+        std::transform(response_lower.begin(), response_lower.end(), response_lower.begin(), ::tolower);
         
-        // Execute tool calls and build results
-        LOG_INFO(" ◀ OUT AI requested %zu tool call(s)", calls.size());
+        // Check if AI is asking a question (not intent to act)
+        if (response_lower.find("?") != std::string::npos &&
+            (response_lower.find("which") != std::string::npos ||
+             response_lower.find("what") != std::string::npos ||
+             response_lower.find("where") != std::string::npos ||
+             response_lower.find("could you") != std::string::npos ||
+             response_lower.find("would you") != std::string::npos ||
+             response_lower.find("do you want") != std::string::npos)) {
+            is_asking_question = true;
+            LOG_DEBUG("AI is asking a question, not forcing tool call");
+        }
         
-        std::ostringstream results_oss;
-        bool should_continue = true;
+        // Patterns that indicate the AI wants to use a tool NOW
+        // Only trigger if it's a clear statement of intent to act immediately
+        const char* intent_patterns[] = {
+            "let me create",
+            "let me write",
+            "let me read",
+            "let me check",
+            "let me look",
+            "let me search",
+            "let me fetch",
+            "let me browse",
+            "let me run",
+            "let me execute",
+            "let me try",
+            "let me make",
+            "let me update",
+            "let me modify",
+            "let me delete",
+            "let me remove",
+            "let me add",
+            "let me open",
+            "let me download",
+            "let me get",
+            "let me see",
+            "let me find",
+            "let me use",
+            "let me install",
+            "i'll create",
+            "i'll write",
+            "i'll read",
+            "i'll check",
+            "i'll run",
+            "i'll execute",
+            "i'll fetch",
+            "i'll browse",
+            "i'll search",
+            "i'll make",
+            "i'll use",
+            "will create",
+            "will write",
+            "will run",
+            "need to create",
+            "need to write",
+            "need to read",
+            "need to check",
+            "need to run",
+            "need to fetch",
+            "need to browse",
+            "need to search",
+            "need to make",
+            "now i'll",
+            "now let me",
+            "let's do that",
+            "let's do it",
+            "let's create",
+            "let's check",
+            "let's write",
+            "let's run",
+            "let's look",
+            "let's fetch",
+            "let's search",
+            "let's make",
+            "should check",
+            "should write",
+            "should run", 
+            "should do",
+            "should use the",
+            "i'll do that",
+            "doing that now",
+            "executing now",
+            "running the command now",
+            "let's execute it",
+            "i'll emit the tool call",
+            "need to emit",
+            "emitting tool call",
+            "calling the tool",
+            "can handle using the",
+            "going to create",
+            "going to write",
+            "going to read",
+            "going to check",
+            "going to look",
+            "going to search",
+            "going to fetch",
+            "going to browse",
+            "going to run",
+            "going to execute",
+            "going to try",
+            "going to make",
+            "going to update",
+            "going to modify",
+            "going to delete",
+            "going to remove",
+            "going to add",
+            "going to open",
+            "going to download",
+            "going to get",
+            "going to see",
+            "going to find",
+            "going to use",
+            "going to install",
+            "about to create",
+            "about to write",
+            "about to read",
+            "about to check",
+            "about to look",
+            "about to search",
+            "about to fetch",
+            "about to browse",
+            "about to run",
+            "about to execute",
+            "about to try",
+            "about to make",
+            "about to update",
+            "about to modify",
+            "about to delete",
+            "about to remove",
+            "about to add",
+            "about to open",
+            "about to download",
+            "about to get",
+            "about to see",
+            "about to find",
+            "about to use",
+            "about to install",
+            "plan to create",
+            "plan to write",
+            "plan to run",
+            "want to create",
+            "want to write",
+            "want to run",
+            "ready to create",
+            "ready to write",
+            "ready to run",
+            "preparing to create",
+            "preparing to write",
+            "preparing to run",
+            "creating now",
+            "writing now",
+            "reading now",
+            "checking now",
+            "looking now",
+            "searching now",
+            "fetching now",
+            "browsing now",
+            "running now",
+            "executing now",
+            "trying now",
+            "making now",
+            "updating now",
+            "modifying now",
+            "deleting now",
+            "removing now",
+            "adding now",
+            "opening now",
+            "downloading now",
+            "getting now",
+            "seeing now",
+            "finding now",
+            "using now",
+            "installing now",
+            "time to create",
+            "time to write",
+            "time to run",
+            "let's get started with",
+            "starting to",
+            "beginning to",
+            "commencing to",
+            "initiating",
+            "launching",
+            "starting the",
+            "beginning the",
+            "commencing the",
+            "initiating the",
+            "launching the",
+            NULL
+        };
         
-        // Deduplicate tool calls within this response
-        std::set<std::string> seen_in_response;
+        for (int i = 0; intent_patterns[i] != NULL && !is_asking_question; ++i) {
+            if (response_lower.find(intent_patterns[i]) != std::string::npos) {
+                indicates_tool_intent = true;
+                LOG_DEBUG("Detected tool intent pattern: '%s'", intent_patterns[i]);
+                break;
+            }
+        }
         
-        for (size_t i = 0; i < calls.size(); ++i) {
-            const ParsedToolCall& call = calls[i];
-            
-            // Build a dedup key from tool name + params
-            std::string dedup_key = call.tool_name + ":" + 
-                (call.valid ? call.params.dump() : call.raw_content);
+        // The continuation costs a full-model iteration; with a classify
+        // model configured, a cheap call weeds out false positives first
+        if (indicates_tool_intent && !is_asking_question && result.iterations < config.max_iterations &&
+            PurposeModels::instance().has(PURPOSE_CLASSIFY) && !confirm_tool_intent(ai, response)) {
+            LOG_DEBUG("Intent check: reply is final, no continuation prompt");
+            indicates_tool_intent = false;
+        }
+        
+        // If AI indicated intent but no tool call, prompt it to actually emit the call
+        if (indicates_tool_intent && !is_asking_question && result.iterations < config.max_iterations) {
+            LOG_INFO(" ▶ IN  AI indicated tool intent, sending continuation prompt");
             
-            // Skip exact duplicates within the same response
-            if (seen_in_response.count(dedup_key)) {
-                LOG_WARN(" Skipping duplicate tool call in same response: %s",
-                         call.tool_name.c_str());
-                results_oss << "[TOOL_RESULT tool=" << call.tool_name 
-                            << " success=true]\n"
-                            << "(Duplicate call skipped - same tool with same parameters "
-                            << "was already called in this response)\n[/TOOL_RESULT]\n";
-                continue;
-            }
-            seen_in_response.insert(dedup_key);
+            // Add the AI's response to history
+            history.push_back(ConversationMessage::assistant(std::move(response)));
+
+            // stupid model won't act, lets kick it's arse
+            std::string continuation_prompt = 
+                "You said you would take action but didn't use a tool. "
+                "Stop planning and ACT NOW. Emit the tool call immediately:\n\n"
+                "{\"tool\": \"TOOLNAME\", \"arguments\": {\"param\": \"value\"}}\n\n"
+                "Do NOT explain. Do NOT plan. Just emit the tool call.";
             
-            // Warn about repeated calls across iterations (but still execute)
-            std::map<std::string, int>::iterator prev = recent_tool_calls.find(dedup_key);
-            if (prev != recent_tool_calls.end()) {
-                int prev_iter = prev->second;
-                LOG_WARN(" Tool '%s' called with same params as iteration %d (now %d)",
-                         call.tool_name.c_str(), prev_iter, result.iterations);
-                // If called in the immediately previous iteration with same params, skip
-                if (prev_iter == result.iterations - 1) {
-                    LOG_WARN(" Skipping repeated tool call from consecutive iteration: %s",
-                             call.tool_name.c_str());
-                    results_oss << "[TOOL_RESULT tool=" << call.tool_name 
-                                << " success=true]\n"
-                                << "(This exact tool call was already made in the previous iteration. "
-                                << "The result has not changed. Please use the previous result "
-                                << "or try a different approach.)\n[/TOOL_RESULT]\n";
-                    continue;
+            history.push_back(ConversationMessage::user(std::move(continuation_prompt)));
+            return NEXT;  // Continue the loop to get the actual tool call
+        }
+        
+        // No tool calls and no intent - we're done
+        LOG_INFO(" ◀ OUT Final response after %d iterations (%d tool calls)", 
+                 result.iterations, result.tool_calls_made);
+        
+        // The insert (and an embedding request for the semantic tier)
+        // happens off the reply path
+        if (!cache_pending.empty()) {
+            std::shared_ptr<std::vector<std::pair<ResponseCache::Key, std::string> > > pending =
+                std::make_shared<std::vector<std::pair<ResponseCache::Key, std::string> > >();
+            pending->swap(cache_pending);
+            ResponseCache* cache = &agent.response_cache_;
+            Task store([cache, pending]() {
+                for (size_t i = 0; i < pending->size(); ++i) {
+                    cache->store((*pending)[i].first, (*pending)[i].second);
                 }
+            });
+            if (agent.pool_) {
+                agent.pool_->enqueue(std::move(store), TaskPriority::BACKGROUND);
+            } else {
+                store();
             }
-            recent_tool_calls[dedup_key] = result.iterations;
-            
-            result.tool_calls_made++;
-            
-            // Track tool usage
-            if (std::find(result.tools_used.begin(), result.tools_used.end(), call.tool_name) 
-                == result.tools_used.end()) {
-                result.tools_used.push_back(call.tool_name);
+        }
+        
+        // Add final response to history
+        result.success = true;
+        result.final_response = response;
+        history.push_back(ConversationMessage::assistant(std::move(response)));
+        return DONE;
+    }
+    
+    // Execute tool calls and build results
+    LOG_INFO(" ◀ OUT AI requested %zu tool call(s)", calls.size());
+    
+    std::ostringstream results_oss;
+    bool should_continue = true;
+    
+    // Deduplicate tool calls within this response
+    std::set<std::string> seen_in_response;
+    
+    // Canned results for skipped calls; empty = executed below
+    std::vector<std::string> skipped_results(calls.size());
+    std::vector<size_t> to_run;
+    std::vector<AgentToolResult> call_results(calls.size());
+    std::vector<bool> memo_hit(calls.size(), false);
+    std::string memo_store, memo_path, memo_writes;
+    
+    for (size_t i = 0; i < calls.size(); ++i) {
+        const ParsedToolCall& call = calls[i];
+        
+        // Build a dedup key from tool name + params
+        std::string dedup_key = call.tool_name + ":" + 
+            (call.valid ? call.params.dump() : call.raw_content);
+        
+        // Skip exact duplicates within the same response
+        if (seen_in_response.count(dedup_key)) {
+            LOG_WARN(" Skipping duplicate tool call in same response: %s",
+                     call.tool_name.c_str());
+            std::ostringstream skipped;
+            skipped << "[TOOL_RESULT tool=" << call.tool_name 
+                    << " success=true]\n"
+                    << "(Duplicate call skipped - same tool with same parameters "
+                    << "was already called in this response)\n[/TOOL_RESULT]\n";
+            skipped_results[i] = skipped.str();
+            continue;
+        }
+        seen_in_response.insert(dedup_key);
+        
+        // A repeat of an idempotent call answers from the memo, unless an
+        // earlier call (this one's predecessors included) wrote over it
+        if (!memo_scope.empty()) {
+            bool memoizable = agent.memo_target(call, memo_store, memo_path, memo_writes);
+            if (!memo_writes.empty()) {
+                agent.tool_memo_.invalidate(memo_writes, memo_path);
             }
-            
-            // Execute tool with retry logic
-            const int max_tool_retries = 3;
-            AgentToolResult tool_result;
-            int retry_count = 0;
-            bool tool_success = false;
-            
-            while (retry_count < max_tool_retries && !tool_success) {
-                tool_result = execute_tool(call);
-                if (tool_result.success) {
-                    tool_success = true;
-                } else {
-                    retry_count++;
-                    if (retry_count < max_tool_retries) {
-                        LOG_WARN(" Tool %s failed (attempt %d/%d): %s - retrying...",
-                                 call.tool_name.c_str(), retry_count, max_tool_retries, 
-                                 tool_result.error.c_str());
-                    } else {
-                        LOG_ERROR(" Tool %s failed after %d attempts: %s",
-                                  call.tool_name.c_str(), max_tool_retries, 
-                                  tool_result.error.c_str());
-                    }
+            std::string output;
+            int64_t age_ms = 0;
+            if (memoizable && agent.tool_memo_.lookup(memo_scope, dedup_key, output, age_ms)) {
+                LOG_INFO(" Reusing memoized '%s' result (%llds old)", call.tool_name.c_str(),
+                         static_cast<long long>(age_ms / 1000));
+                call_results[i] = AgentToolResult::ok(
+                    "(Memoized: this exact call already ran " + std::to_string(age_ms / 1000) +
+                    "s ago and nothing it reads has been written since; same output as then)\n" + output);
+                memo_hit[i] = true;
+                // A replay runs without the memo: it executes the call
+                if (recording) {
+                    recording->add_tool_call(call.tool_name, call.params.dump(), AgentToolResult::ok(output), 0);
                 }
             }
-            
-            if (!tool_result.should_continue) {
-                should_continue = false;
-            }
-            
-            results_oss << format_tool_result(call.tool_name, tool_result) << "\n";
         }
         
-        // Extract text response (non-tool-call content)
-        std::string text_response = extract_response_text(response, calls);
+        // Warn about repeated calls across iterations (but still execute)
+        std::map<std::string, int>::iterator prev = recent_tool_calls.find(dedup_key);
+        if (prev != recent_tool_calls.end() && !memo_hit[i]) {
+            int prev_iter = prev->second;
+            LOG_WARN(" Tool '%s' called with same params as iteration %d (now %d)",
+                     call.tool_name.c_str(), prev_iter, result.iterations);
+            // If called in the immediately previous iteration with same params, skip
+            if (prev_iter == result.iterations - 1) {
+                LOG_WARN(" Skipping repeated tool call from consecutive iteration: %s",
+                         call.tool_name.c_str());
+                std::ostringstream skipped;
+                skipped << "[TOOL_RESULT tool=" << call.tool_name 
+                        << " success=true]\n"
+                        << "(This exact tool call was already made in the previous iteration. "
+                        << "The result has not changed. Please use the previous result "
+                        << "or try a different approach.)\n[/TOOL_RESULT]\n";
+                skipped_results[i] = skipped.str();
+                continue;
+            }
+        }
+        recent_tool_calls[dedup_key] = result.iterations;
         
-        // Add AI's response (with tool calls) to history
-        history.push_back(ConversationMessage::assistant(response));
+        result.tool_calls_made++;
         
-        // Add tool results as a user message (this continues the conversation)
-        std::string tool_results = results_oss.str();
-        LOG_DEBUG("▶ IN  Feeding tool results back to AI (%zu chars)", tool_results.size());
-        LOG_DEBUG("▶ IN  Tool results preview: %.500s%s", tool_results.c_str(),
-                  tool_results.size() > 500 ? "..." : "");
+        // Track tool usage
+        if (std::find(result.tools_used.begin(), result.tools_used.end(), call.tool_name) 
+            == result.tools_used.end()) {
+            result.tools_used.push_back(call.tool_name);
+        }
         
-        history.push_back(ConversationMessage::user(tool_results));
+        if (!memo_hit[i]) {
+            to_run.push_back(i);
+        }
+    }
+    
+    // Execute: a run of consecutive parallel-safe calls goes out
+    // concurrently; any other call runs alone so side effects keep
+    // the order the model asked for.
+    int64_t tools_start = current_timestamp_ms();
+    
+    // Calls already started while the reply streamed, by index
+    std::map<size_t, EarlyToolCall*> early_for;
+    for (size_t k = 0; k < to_run.size() && !early_calls.empty(); ++k) {
+        const ParsedToolCall& call = calls[to_run[k]];
+        if (!call.valid) continue;
+        std::string key = call.tool_name + ":" + call.params.dump();
+        for (size_t j = 0; j < early_calls.size(); ++j) {
+            if (early_calls[j]->dedup_key == key) {
+                early_for[to_run[k]] = early_calls[j].get();
+                break;
+            }
+        }
+    }
+    
+    size_t next = 0;
+    while (next < to_run.size()) {
+        std::vector<const ParsedToolCall*> batch;
+        std::vector<size_t> batch_index;
+        std::vector<size_t> early_index;
+        while (max_parallel > 1 && next < to_run.size() && agent.is_parallel_safe(calls[to_run[next]])) {
+            if (early_for.count(to_run[next])) {
+                early_index.push_back(to_run[next]);
+            } else {
+                batch.push_back(&calls[to_run[next]]);
+                batch_index.push_back(to_run[next]);
+            }
+            ++next;
+        }
         
-        if (!should_continue) {
-            LOG_INFO(" Tool requested stop, ending loop");
-            result.success = true;
-            result.final_response = text_response.empty() ? "Task completed." : text_response;
-            return result;
+        if (batch.size() > 1) {
+            LOG_INFO(" Running %zu parallel-safe tool calls concurrently (cap %zu)",
+                     batch.size(), max_parallel);
+            std::vector<AgentToolResult> batch_results;
+            agent.execute_parallel(batch, batch_results, max_parallel, &tool_context);
+            for (size_t j = 0; j < batch.size(); ++j) {
+                call_results[batch_index[j]] = batch_results[j];
+            }
+        } else if (batch.size() == 1) {
+            call_results[batch_index[0]] = agent.execute_with_retry(*batch[0], &tool_context);
+        } else if (early_index.empty()) {
+            call_results[to_run[next]] = agent.execute_with_retry(calls[to_run[next]], &tool_context);
+            ++next;
         }
         
-        // Accumulate non-tool response text
-        if (!text_response.empty()) {
-            if (!accumulated_response.empty()) {
-                accumulated_response += "\n\n";
+        for (size_t j = 0; j < early_index.size(); ++j) {
+            call_results[early_index[j]] = agent.finish_early(*early_for[early_index[j]], &tool_context);
+        }
+    }
+    
+    result.tool_ms += current_timestamp_ms() - tools_start;
+    
+    // Inject results in the original call order (keeps transcripts deterministic)
+    {
+        ScopedSpan format_span("format_tool_results", "format");
+        for (size_t i = 0; i < calls.size(); ++i) {
+            if (!skipped_results[i].empty()) {
+                results_oss << skipped_results[i];
+                continue;
+            }
+            if (!call_results[i].should_continue) {
+                should_continue = false;
             }
-            accumulated_response += text_response;
+            // Reads are memoized and writes invalidate in call order, which is
+            // also the order they ran in
+            if (!memo_scope.empty() && !memo_hit[i]) {
+                if (agent.memo_target(calls[i], memo_store, memo_path, memo_writes)) {
+                    if (call_results[i].success && call_results[i].should_continue) {
+                        agent.tool_memo_.store(memo_scope, calls[i].tool_name + ":" + calls[i].params.dump(),
+                                               memo_store, memo_path, call_results[i].output);
+                    }
+                } else if (!memo_writes.empty()) {
+                    agent.tool_memo_.invalidate(memo_writes, memo_path);
+                }
+            }
+            results_oss << agent.format_tool_result(calls[i].tool_name, call_results[i], config.session_key) << "\n";
         }
+        format_span.set("calls", calls.size());
     }
     
+    // Extract text response (non-tool-call content)
+    std::string text_response = agent.extract_response_text(response, calls);
+    
+    // Add AI's response (with tool calls) to history. calls/text_response
+    // hold their own copies, so the response buffer can be handed over.
+    history.push_back(ConversationMessage::assistant(std::move(response)));
+    
+    // Add tool results as a user message (this continues the conversation)
+    std::string tool_results = results_oss.str();
+    LOG_DEBUG("▶ IN  Feeding tool results back to AI (%zu chars)", tool_results.size());
+    LOG_DEBUG("▶ IN  Tool results preview: %.500s%s", tool_results.c_str(),
+              tool_results.size() > 500 ? "..." : "");
+    
+    size_t added = history.back().content.size() + tool_results.size();
+    history.push_back(ConversationMessage::user(std::move(tool_results)));
+    result_messages.push_back(std::make_pair(history.size() - 1, result.iterations));
+    if (!config.session_key.empty()) {
+        SessionManager::instance().note_inflight(config.session_key, added);
+    }
+    
+    if (!should_continue) {
+        LOG_INFO(" Tool requested stop, ending loop");
+        result.success = true;
+        result.final_response = text_response.empty() ? "Task completed." : text_response;
+        return DONE;
+    }
+    
+    // Accumulate non-tool response text
+    if (!text_response.empty()) {
+        if (!accumulated_response.empty()) {
+            accumulated_response += "\n\n";
+        }
+        accumulated_response += text_response;
+    }
+    return NEXT;
+}
+
+AgentRun::Step AgentRun::pause_for_iterations() {
     // Reached max iterations - pause instead of stopping
     LOG_WARN(" Reached max iterations (%d) - pausing for user confirmation", config.max_iterations);
     result.success = false;  // Not completed yet
     result.paused = true;
-    
+
     std::ostringstream pause_msg;
     pause_msg << "⏸️ **Task paused after " << config.max_iterations << " iterations**\n\n";
-    
+
     if (!accumulated_response.empty()) {
         pause_msg << "Progress so far:\n" << accumulated_response << "\n\n";
     }
-    
+
     pause_msg << "The AI has made " << result.tool_calls_made << " tool calls ";
     pause_msg << "and needs more iterations to complete the task.\n\n";
     pause_msg << "**Options:**\n";
@@ -1296,11 +2228,114 @@ AgentResult Agent::run(
     pause_msg << "• `/continue <N>` - Allow N more iterations\n";
     pause_msg << "• `/continue no-stop` - Remove iteration limit (use with caution)\n";
     pause_msg << "• `/cancel` - Stop the task\n";
-    
+
     result.pause_message = pause_msg.str();
     result.final_response = result.pause_message;
+    return DONE;
+}
+
+// Hands the finished trace to the Tracer and stops streamed updates, so
+// none lands after the caller's final reply
+void AgentRun::finish() {
+    {
+        std::lock_guard<std::mutex> delivery(delivery_mutex);
+        partials_closed = true;
+    }
+    if (!memo_scope.empty() && memo_scope != config.session_key) {
+        agent.tool_memo_.drop(memo_scope);
+    }
+    root_span->set("iterations", result.iterations);
+    root_span->set("tool_calls", result.tool_calls_made);
+    root_span->set("success", result.success);
+    root_span->set("paused", result.paused);
+    if (result.cancelled) root_span->set("cancelled", true);
+    root_span->set("prompt_tokens", result.prompt_tokens);
+    root_span.reset();
+    Tracer::instance().finish(trace_context.trace);
+    // A run that never reached the model has nothing to replay
+    if (recording && !recording->replies.empty()) {
+        recording->result = result;
+        RunRecorder::instance().finish(recording);
+    }
+    if (trace_context.trace) {
+        LOG_DEBUG("[Trace] Run %s: %lld ms (model %lld ms, tools %lld ms)",
+                  trace_context.trace->id().c_str(), static_cast<long long>(trace_context.trace->duration_us() / 1000),
+                  static_cast<long long>(result.model_ms), static_cast<long long>(result.tool_ms));
+    }
+}
+
+AgentResult Agent::run(
+    AIPlugin* ai,
+    const std::string& user_message,
+    std::vector<ConversationMessage>& history,
+    const std::string& system_prompt,
+    const AgentConfig& config) {
+    
+    std::shared_ptr<AgentRun> run = std::make_shared<AgentRun>(
+        *this, ai, user_message, history, system_prompt, config);
     
-    return result;
+    // Replies of an async provider come back on its I/O thread; the loop
+    // carries on here
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready = false;
+    run->resume = [&mutex, &cv, &ready](const std::shared_ptr<AgentRun>&) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready = true;
+        cv.notify_one();
+    };
+    while (!run->drive()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&ready] { return ready; });
+        ready = false;
+    }
+    return run->result;
+}
+
+void Agent::run_async(
+    AIPlugin* ai,
+    const std::string& user_message,
+    std::vector<ConversationMessage>& history,
+    const std::string& system_prompt,
+    const AgentConfig& config,
+    const AgentCallback& done) {
+    
+    if (!config.async_model_calls || !pool_ || !ai || !ai->supports_async()) {
+        AgentResult result = run(ai, user_message, history, system_prompt, config);
+        done(result);
+        return;
+    }
+    
+    std::shared_ptr<AgentRun> run = std::make_shared<AgentRun>(
+        *this, ai, user_message, history, system_prompt, config);
+    run->resume = [done](const std::shared_ptr<AgentRun>& self) {
+        ThreadPool* pool = self->agent.pool_;
+        if (!pool) {
+            LOG_DEBUG("[Agent] Reply after shutdown, run dropped");
+            return;
+        }
+        pool->enqueue(Task([self, done]() {
+            // Nobody up the stack would catch for this run: end it here
+            bool finished = true;
+            try {
+                finished = self->drive();
+            } catch (const std::exception& e) {
+                LOG_ERROR("[Agent] Run failed after a model reply: %s", e.what());
+                self->result.success = false;
+                self->result.paused = false;
+                self->result.error = e.what();
+                self->chat_span.reset();
+                self->end_iteration();
+                self->finish();
+            }
+            if (finished) {
+                done(self->result);
+            }
+        }), TaskPriority::AGENT);
+    };
+    if (run->drive()) {
+        done(run->result);
+    }
 }
 
 } // namespace opencrank
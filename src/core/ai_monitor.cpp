@@ -3,9 +3,10 @@
  */
 #include <opencrank/core/ai_monitor.hpp>
 #include <opencrank/core/application.hpp>
-#include <opencrank/core/channel.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/message_handler.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <algorithm>
 
 namespace opencrank {
 
@@ -15,9 +16,10 @@ namespace opencrank {
 
 AIProcessMonitor::AIProcessMonitor()
     : running_(false)
+    , reactor_(NULL)
+    , next_serial_(0)
     , total_sessions_started_(0)
     , total_hung_detected_(0)
-    , total_typing_indicators_sent_(0)
 {
 }
 
@@ -29,30 +31,35 @@ AIProcessMonitor::~AIProcessMonitor() {
 // Lifecycle
 // ============================================================================
 
-void AIProcessMonitor::start() {
+void AIProcessMonitor::start(Reactor& reactor) {
     if (running_.load()) {
         LOG_WARN("[AIProcessMonitor] already running");
         return;
     }
     
+    reactor_ = &reactor;
     running_.store(true);
-    monitor_thread_ = std::thread(&AIProcessMonitor::monitor_loop, this);
+    
+    // Sessions that started before the monitor get their timers now
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        for (auto& entry : active_sessions_) {
+            std::string session_id = entry.first;
+            uint64_t serial = entry.second.serial;
+            reactor_->post([this, session_id, serial]() { schedule(session_id, serial); });
+        }
+    }
     
     LOG_INFO("[AIProcessMonitor] started (hang_timeout=%ds, typing_interval=%ds)",
              config_.hang_timeout_seconds, config_.typing_interval_seconds);
 }
 
 void AIProcessMonitor::stop() {
-    if (!running_.load()) {
+    if (!running_.exchange(false)) {
         return;
     }
     
-    running_.store(false);
-    
-    if (monitor_thread_.joinable()) {
-        monitor_thread_.join();
-    }
-    
+    // Armed timers find running_ off and do nothing; the reactor drops them
     LOG_INFO("[AIProcessMonitor] stopped");
 }
 
@@ -60,20 +67,45 @@ void AIProcessMonitor::stop() {
 // Session Tracking
 // ============================================================================
 
-void AIProcessMonitor::start_session(const std::string& session_id,
-                                     const std::string& channel_id,
-                                     const std::string& chat_id) {
+CancelTokenPtr AIProcessMonitor::start_session(const std::string& session_id,
+                                               const std::string& channel_id,
+                                               const std::string& chat_id) {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     
     AISessionState state;
     state.channel_id = channel_id;
     state.chat_id = chat_id;
+    state.serial = ++next_serial_;
+    if (config_.typing_interval_seconds > 0) {
+        state.next_typing = state.started_at + std::chrono::seconds(config_.typing_interval_seconds);
+    }
+    
+    auto existing = active_sessions_.find(session_id);
+    if (existing != active_sessions_.end()) {
+        if (existing->second.cancel && !existing->second.cancel->cancelled()) {
+            state.cancel = existing->second.cancel;
+        }
+        Reactor::TimerId stale = existing->second.timer;
+        if (stale && running_.load()) {
+            reactor_->post([this, stale]() { reactor_->cancel_timer(stale); });
+        }
+    }
+    if (!state.cancel) {
+        state.cancel = std::make_shared<CancelToken>();
+    }
+    CancelTokenPtr token = state.cancel;
+    uint64_t serial = state.serial;
     
     active_sessions_[session_id] = state;
     total_sessions_started_.fetch_add(1);
     
+    if (running_.load()) {
+        reactor_->post([this, session_id, serial]() { schedule(session_id, serial); });
+    }
+    
     LOG_DEBUG("[AIProcessMonitor] session started [%s] -> %s:%s", 
               session_id.c_str(), channel_id.c_str(), chat_id.c_str());
+    return token;
 }
 
 void AIProcessMonitor::heartbeat(const std::string& session_id) {
@@ -83,7 +115,16 @@ void AIProcessMonitor::heartbeat(const std::string& session_id) {
     if (it != active_sessions_.end()) {
         it->second.last_heartbeat = std::chrono::steady_clock::now();
         it->second.heartbeat_count++;
-        it->second.is_hung = false;
+        
+        // A hung session that recovers needs its hang deadline back
+        if (it->second.is_hung) {
+            it->second.is_hung = false;
+            std::string id = session_id;
+            uint64_t serial = it->second.serial;
+            if (running_.load()) {
+                reactor_->post([this, id, serial]() { schedule(id, serial); });
+            }
+        }
         
         LOG_DEBUG("[AIProcessMonitor] heartbeat [%s] count=%d", 
                   session_id.c_str(), it->second.heartbeat_count);
@@ -105,18 +146,28 @@ void AIProcessMonitor::end_session(const std::string& session_id) {
                   it->second.heartbeat_count,
                   it->second.is_hung ? "yes" : "no");
         
-        // Stop typing indicator
-        auto& state = it->second;
-        auto& app = Application::instance();
-        auto& plugins = app.registry().plugins();
-        for (size_t i = 0; i < plugins.size(); ++i) {
-            plugins[i]->on_typing_indicator(state.channel_id, state.chat_id, false);
+        Reactor::TimerId timer = it->second.timer;
+        if (timer && running_.load()) {
+            reactor_->post([this, timer]() { reactor_->cancel_timer(timer); });
         }
         
         active_sessions_.erase(it);
     }
 }
 
+bool AIProcessMonitor::cancel(const std::string& session_id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    
+    auto it = active_sessions_.find(session_id);
+    if (it == active_sessions_.end() || !it->second.cancel) {
+        return false;
+    }
+    if (it->second.cancel->cancel()) {
+        LOG_INFO("[AIProcessMonitor] session cancelled [%s]", session_id.c_str());
+    }
+    return true;
+}
+
 // ============================================================================
 // Statistics
 // ============================================================================
@@ -128,121 +179,122 @@ AIProcessMonitor::Stats AIProcessMonitor::get_stats() const {
     stats.active_sessions = static_cast<int>(active_sessions_.size());
     stats.total_sessions_started = total_sessions_started_.load();
     stats.total_hung_detected = total_hung_detected_.load();
-    stats.total_typing_indicators_sent = total_typing_indicators_sent_.load();
+    stats.total_typing_indicators_sent = static_cast<int>(Application::instance().typing().sent());
     
     return stats;
 }
 
 // ============================================================================
-// Monitoring Thread
+// Deadlines (reactor thread)
 // ============================================================================
 
-void AIProcessMonitor::monitor_loop() {
-    LOG_DEBUG("[AIProcessMonitor] monitor thread started");
+void AIProcessMonitor::schedule(const std::string& session_id, uint64_t serial) {
+    if (!running_.load()) return;
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    
+    auto it = active_sessions_.find(session_id);
+    if (it == active_sessions_.end() || it->second.serial != serial) {
+        return;
+    }
+    if (it->second.timer) {
+        reactor_->cancel_timer(it->second.timer);
+        it->second.timer = 0;
+    }
+    arm_locked(session_id, it->second);
+}
+
+void AIProcessMonitor::arm_locked(const std::string& session_id, AISessionState& state) {
+    typedef std::chrono::steady_clock Clock;
     
-    auto last_typing_time = std::chrono::steady_clock::now();
+    bool armed = false;
+    Clock::time_point due;
+    if (!state.is_hung && config_.hang_timeout_seconds > 0) {
+        due = state.last_heartbeat + std::chrono::seconds(config_.hang_timeout_seconds);
+        armed = true;
+    }
+    if (config_.typing_interval_seconds > 0 && (!armed || state.next_typing < due)) {
+        due = state.next_typing;
+        armed = true;
+    }
+    if (!armed) {
+        return;
+    }
     
-    while (running_.load()) {
-        auto now = std::chrono::steady_clock::now();
+    int64_t wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+    std::string id = session_id;
+    uint64_t serial = state.serial;
+    state.timer = reactor_->add_timer(static_cast<int>(std::max<int64_t>(wait_ms, 0)),
+                                      [this, id, serial]() { on_deadline(id, serial); });
+}
+
+void AIProcessMonitor::on_deadline(const std::string& session_id, uint64_t serial) {
+    if (!running_.load()) return;
+    
+    int hung_for = -1;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
         
-        // Check all sessions
-        {
-            std::lock_guard<std::mutex> lock(sessions_mutex_);
-            
-            for (auto& entry : active_sessions_) {
-                check_session(entry.first, entry.second);
-            }
+        auto it = active_sessions_.find(session_id);
+        if (it == active_sessions_.end() || it->second.serial != serial) {
+            return;
         }
+        AISessionState& state = it->second;
+        state.timer = 0;
         
-        // Send typing indicators periodically
-        auto elapsed_typing = std::chrono::duration_cast<std::chrono::seconds>(
-            now - last_typing_time
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+            now - state.last_heartbeat
         ).count();
         
-        if (elapsed_typing >= config_.typing_interval_seconds) {
-            std::lock_guard<std::mutex> lock(sessions_mutex_);
+        // Check for hung session
+        if (!state.is_hung && config_.hang_timeout_seconds > 0 &&
+            elapsed >= config_.hang_timeout_seconds) {
+            state.is_hung = true;
+            total_hung_detected_.fetch_add(1);
+            hung_for = static_cast<int>(elapsed);
             
-            for (const auto& entry : active_sessions_) {
-                const auto& state = entry.second;
-                send_typing_indicator(state.channel_id, state.chat_id);
-            }
+            LOG_WARN("[AIProcessMonitor] HUNG SESSION DETECTED [%s] - no heartbeat for %llds",
+                     session_id.c_str(), static_cast<long long>(elapsed));
             
-            last_typing_time = now;
+            // Free the worker: the run's model call and loop give up
+            if (config_.cancel_on_hang && state.cancel) {
+                state.cancel->cancel();
+            }
+        }
+        
+        // Keep the typing indicator up; the TypingIndicator drops repeats
+        if (config_.typing_interval_seconds > 0 && now >= state.next_typing) {
+            Application::instance().typing().refresh(state.channel_id, state.chat_id);
+            state.next_typing = now + std::chrono::seconds(config_.typing_interval_seconds);
         }
         
-        // Sleep
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(config_.check_interval_ms)
-        );
+        arm_locked(session_id, state);
     }
     
-    LOG_DEBUG("[AIProcessMonitor] monitor thread exited");
+    if (hung_for >= 0) {
+        report_hung(session_id, hung_for);
+    }
 }
 
-void AIProcessMonitor::check_session(const std::string& session_id, 
-                                     AISessionState& state) {
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-        now - state.last_heartbeat
-    ).count();
-    
-    // Check for hung session
-    if (!state.is_hung && elapsed >= config_.hang_timeout_seconds) {
-        state.is_hung = true;
-        total_hung_detected_.fetch_add(1);
-        
-        LOG_WARN("[AIProcessMonitor] HUNG SESSION DETECTED [%s] - no heartbeat for %llds",
-                 session_id.c_str(), static_cast<long long>(elapsed));
-        
+void AIProcessMonitor::report_hung(const std::string& session_id, int elapsed_seconds) {
+    HungSessionCallback callback = hung_callback_;
+    auto report = [session_id, elapsed_seconds, callback]() {
         // Broadcast critical notification about hung session
         std::string message = "AI session '" + session_id + "' has been detected as hung after " + 
-                             std::to_string(static_cast<long long>(elapsed)) + " seconds of inactivity";
+                             std::to_string(elapsed_seconds) + " seconds of inactivity";
         broadcast_notification(message, "critical", "\xf0\x9f\x9a\xa8");  // 🚨
         
-        // Invoke callback if set
-        if (hung_callback_) {
-            hung_callback_(session_id, static_cast<int>(elapsed));
+        if (callback) {
+            callback(session_id, elapsed_seconds);
         }
-    }
-}
-
-void AIProcessMonitor::send_typing_indicator(const std::string& channel_id,
-                                             const std::string& chat_id) {
-    auto& app = Application::instance();
-    auto* channel = app.registry().get_channel(channel_id);
-    
-    if (!channel) {
-        LOG_DEBUG("[AIProcessMonitor] channel not found: %s", channel_id.c_str());
-        return;
-    }
-    
-    // Check if channel supports typing indicators
-    auto caps = channel->capabilities();
-    if (!caps.supports_typing) {
-        LOG_DEBUG("[AIProcessMonitor] channel %s does not support typing", channel_id.c_str());
-        return;
-    }
+    };
     
-    LOG_DEBUG("[AIProcessMonitor] requesting typing indicator for %s:%s",
-              channel_id.c_str(), chat_id.c_str());
-    
-    // Cast to get access to send_typing_action
-    // Note: This is a safe pattern since we checked capabilities
-    auto send_result = channel->send_typing_action(chat_id);
-    
-    if (send_result.success) {
-        total_typing_indicators_sent_.fetch_add(1);
-        LOG_INFO("[AIProcessMonitor] typing indicator sent to %s:%s (total: %d)",
-                  channel_id.c_str(), chat_id.c_str(), total_typing_indicators_sent_.load());
+    // Sends and process kills stay off the reactor thread
+    ThreadPool* pool = Application::instance().thread_pool();
+    if (pool) {
+        pool->enqueue(report, TaskPriority::INTERACTIVE);
     } else {
-        LOG_WARN("[AIProcessMonitor] failed to send typing indicator to %s:%s - %s",
-                  channel_id.c_str(), chat_id.c_str(), send_result.error.c_str());
-    }
-    
-    // Notify all plugins about typing indicator
-    auto& plugins = app.registry().plugins();
-    for (size_t i = 0; i < plugins.size(); ++i) {
-        plugins[i]->on_typing_indicator(channel_id, chat_id, true);
+        report();
     }
 }
 
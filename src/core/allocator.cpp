@@ -0,0 +1,103 @@
+/*
+ * OpenCrank C++ - Memory Allocator Implementation
+ */
+#include <opencrank/core/allocator.hpp>
+#include <opencrank/core/logger.hpp>
+
+#if defined(OPENCRANK_ALLOCATOR_MIMALLOC)
+#include <mimalloc.h>
+#elif defined(OPENCRANK_ALLOCATOR_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#include <cstdint>
+#include <cstdio>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace opencrank {
+namespace allocator {
+
+#if defined(OPENCRANK_ALLOCATOR_MIMALLOC)
+
+const char* name() { return "mimalloc"; }
+
+void init_thread() {
+    mi_thread_init();
+}
+
+Stats stats() {
+    size_t elapsed, user, system, rss, peak_rss, commit, peak_commit, faults;
+    mi_process_info(&elapsed, &user, &system, &rss, &peak_rss, &commit, &peak_commit, &faults);
+    Stats s;
+    s.allocated = 0;
+    s.resident = commit;
+    return s;
+}
+
+void release_free() {
+    mi_collect(true);
+}
+
+#elif defined(OPENCRANK_ALLOCATOR_JEMALLOC)
+
+const char* name() { return "jemalloc"; }
+
+void init_thread() {
+    unsigned arena = 0;
+    size_t size = sizeof(arena);
+    if (mallctl("arenas.create", &arena, &size, NULL, 0) != 0 ||
+        mallctl("thread.arena", NULL, NULL, &arena, sizeof(arena)) != 0) {
+        LOG_WARN("[Allocator] Could not give this worker its own jemalloc arena");
+    }
+}
+
+Stats stats() {
+    // Statistics are cached until the epoch advances
+    uint64_t epoch = 1;
+    size_t size = sizeof(epoch);
+    mallctl("epoch", &epoch, &size, &epoch, size);
+
+    Stats s;
+    s.allocated = 0;
+    s.resident = 0;
+    size = sizeof(size_t);
+    mallctl("stats.allocated", &s.allocated, &size, NULL, 0);
+    size = sizeof(size_t);
+    mallctl("stats.resident", &s.resident, &size, NULL, 0);
+    return s;
+}
+
+void release_free() {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "arena.%u.purge", static_cast<unsigned>(MALLCTL_ARENAS_ALL));
+    mallctl(cmd, NULL, NULL, NULL, 0);
+}
+
+#else
+
+const char* name() { return "libc"; }
+
+void init_thread() {}
+
+Stats stats() {
+    Stats s;
+    s.allocated = 0;
+    s.resident = 0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    s.allocated = info.uordblks + info.hblkhd;
+    s.resident = info.arena + info.hblkhd;
+#endif
+    return s;
+}
+
+void release_free() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+#endif
+
+} // namespace allocator
+} // namespace opencrank
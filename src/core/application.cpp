@@ -4,21 +4,41 @@
  * Central application singleton managing the lifecycle of all components.
  */
 #include <opencrank/core/application.hpp>
+#include <opencrank/ai/router.hpp>
+#include <opencrank/ai/models.hpp>
+#include <opencrank/ai/fair_share.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/allocator.hpp>
 #include <opencrank/core/commands.hpp>
 #include <opencrank/core/sandbox.hpp>
 #include <opencrank/core/builtin_tools.hpp>
 #include <opencrank/core/browser_tool.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <opencrank/core/async_http.hpp>
 #include <opencrank/core/memory_tool.hpp>
+#include <opencrank/core/memory_recall.hpp>
+#include <opencrank/core/subagent_tool.hpp>
 #include <opencrank/core/message_handler.hpp>
+#include <opencrank/core/cluster.hpp>
+#include <opencrank/core/hot_restart.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/outbound.hpp>
+#include <opencrank/core/process_runner.hpp>
+#include <opencrank/core/tool_workers.hpp>
+#include <opencrank/core/trace.hpp>
+#include <opencrank/core/run_record.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/skills/requirements.hpp>
 
 #include <iostream>
+#include <algorithm>
 #include <csignal>
 #include <cstring>
+#include <cerrno>
 #include <climits>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <curl/curl.h>
 
 namespace opencrank {
@@ -42,14 +62,27 @@ void print_usage(const char* prog) {
     std::cout << AppInfo::NAME << " - Personal AI Assistant Framework\n\n"
               << "Usage: " << prog << " [options] [config.json]\n\n"
               << "Options:\n"
-              << "  -h, --help     Show this help message\n"
-              << "  -v, --version  Show version\n\n"
+              << "  -h, --help         Show this help message\n"
+              << "  -v, --version      Show version\n"
+              << "  --config FILE      Config file (default config.json)\n"
+              << "  --profile-startup  Print per-phase startup timings\n\n"
+              << "Batch mode (no channels; one JSON result line per input line):\n"
+              << "  --batch FILE       Run the prompts in FILE (JSONL) and exit\n"
+              << "  --out FILE         Results, also the resume checkpoint (default FILE.results.jsonl)\n"
+              << "  --concurrency N    Conversations in flight (default batch.concurrency, 4)\n\n"
               << "Example:\n"
-              << "  " << prog << " config.json\n";
+              << "  " << prog << " config.json\n"
+              << "  " << prog << " --config config.json --batch prompts.jsonl --concurrency 8\n";
 }
 
 void print_version() {
-    std::cout << AppInfo::NAME << " v" << AppInfo::VERSION << " (dynamic plugins)\n";
+    std::vector<std::string> built_in = static_plugin_names();
+    std::cout << AppInfo::NAME << " v" << AppInfo::VERSION << " (dynamic plugins";
+    if (!built_in.empty()) {
+        std::cout << "; static:";
+        for (size_t i = 0; i < built_in.size(); ++i) std::cout << " " << built_in[i];
+    }
+    std::cout << ")\n";
 }
 
 std::vector<std::string> split_message_chunks(const std::string& text, size_t max_len) {
@@ -73,14 +106,13 @@ std::vector<std::string> split_message_chunks(const std::string& text, size_t ma
         // Try to split at newline for cleaner breaks
         size_t split_pos = text.rfind('\n', end);
         if (split_pos == std::string::npos || split_pos <= start) {
-            // No good newline, use truncate_safe for clean UTF-8 cut
-            std::string slice = text.substr(start, max_len);
-            slice = truncate_safe(slice, max_len);
-            if (slice.empty()) {
+            // No good newline, cut at a UTF-8 character boundary
+            size_t len = utf8_safe_cut(text.data() + start, remaining, max_len);
+            if (len == 0) {
                 break;
             }
-            chunks.push_back(slice);
-            start += slice.size();
+            chunks.push_back(text.substr(start, len));
+            start += len;
         } else {
             chunks.push_back(text.substr(start, split_pos - start));
             start = split_pos + 1;
@@ -105,6 +137,16 @@ namespace {
         Application::instance().stop();
         LOG_INFO("Received shutdown signal");
     }
+    
+    void reload_signal_handler(int sig) {
+        (void)sig;
+        Application::instance().request_config_reload();
+    }
+    
+    void restart_signal_handler(int sig) {
+        (void)sig;
+        Application::instance().request_hot_restart();
+    }
 }
 
 // ============================================================================
@@ -118,14 +160,25 @@ Application& Application::instance() {
 
 Application::Application() 
     : running_(true)
+    , reload_requested_(false)
+    , restart_requested_(false)
+    , restart_deadline_ms_(0)
+    , restarting_(false)
+    , released_evictions_(0)
     , thread_pool_(nullptr)
     , user_limiter_(KeyedRateLimiter::TOKEN_BUCKET, 10, 2)
     , debouncer_(5)
+    , skill_reload_timer_(0)
+    , skill_reload_running_(false)
+    , skill_catalog_(std::make_shared<SkillCatalog>())
+    , command_table_(std::make_shared<CommandTable>())
     , system_prompt_("")
     , config_file_("config.json")
+    , profile_startup_(false)
 {}
 
 bool Application::parse_args(int argc, char* argv[]) {
+    batch_options_.concurrency = 0;    // From batch.concurrency unless given
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
@@ -140,6 +193,26 @@ bool Application::parse_args(int argc, char* argv[]) {
             config_file_ = std::string(argv[++i]);
             continue;
         }
+        if (strcmp(argv[i], "--profile-startup") == 0) {
+            profile_startup_ = true;
+            continue;
+        }
+        if ((strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--out") == 0) && i + 1 < argc) {
+            // Relative to where we were started, not ~/.opencrank
+            std::string path = argv[i + 1];
+            if (path[0] != '/' && !launch_dir_.empty()) path = launch_dir_ + "/" + path;
+            if (strcmp(argv[i], "--batch") == 0) {
+                batch_options_.input = path;
+            } else {
+                batch_options_.output = path;
+            }
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            batch_options_.concurrency = atoi(argv[++i]);
+            continue;
+        }
     }
     return true;
 }
@@ -169,6 +242,13 @@ void Application::setup_sandbox() {
         LOG_INFO("[Sandbox] memory_db_path -> %s", sandbox.memory_db_path().c_str());
     }
     
+    // Session database lives next to it
+    auto configured_sessions = config_.get_string("session.store_path", "");
+    if (configured_sessions.empty() || configured_sessions.find("/.opencrank/") != std::string::npos) {
+        config_.set_string("session.store_path", sandbox.db_dir() + "/sessions.db");
+        LOG_INFO("[Sandbox] session.store_path -> %s", (sandbox.db_dir() + "/sessions.db").c_str());
+    }
+    
     LOG_INFO("[Sandbox] Directories ready (Landlock will activate after init)");
 }
 
@@ -197,7 +277,7 @@ void Application::activate_sandbox() {
     }
 }
 
-void Application::setup_logging() {
+void Application::apply_log_level() {
     auto log_level = config_.get_string("log_level", "info");
 
     if (log_level == "debug") {
@@ -206,7 +286,189 @@ void Application::setup_logging() {
         Logger::instance().set_level(LogLevel::WARN);
     } else if (log_level == "error") {
         Logger::instance().set_level(LogLevel::ERROR);
+    } else {
+        Logger::instance().set_level(LogLevel::INFO);
+    }
+}
+
+void Application::setup_logging() {
+    apply_log_level();
+
+    LoggerOptions options;
+    options.async = config_.get_bool("log_async", false);
+    options.ring_entries = static_cast<size_t>(config_.get_int("log_ring_entries", 256));
+    options.block_when_full = config_.get_string("log_overflow", "drop") == "block";
+    options.file = config_.get_string("log_file", "");
+    options.to_stderr = config_.get_bool("log_stderr", true);
+
+    std::string format = config_.get_string("log_format", "text");
+    if (format == "json") {
+        options.file_format = LogFormat::JSON;
+    } else if (format == "binary") {
+        options.file_format = LogFormat::BINARY;
+    }
+
+    if (options.async || !options.file.empty()) {
+        Logger::instance().configure(options);
+        LOG_DEBUG("[App] Logging: %s, file=%s (%s), overflow=%s",
+                  options.async ? "async" : "sync",
+                  options.file.empty() ? "none" : options.file.c_str(), format.c_str(),
+                  options.block_when_full ? "block" : "drop");
+    }
+}
+
+void Application::setup_thread_pool() {
+    // 0 picks the default (CPU count, workers - 1); below that is a typo
+    int64_t workers = config_.get_int("thread_pool.workers", 8);
+    int64_t max_agent_workers = config_.get_int("thread_pool.max_agent_workers", 0);
+    if (workers < 0) {
+        LOG_WARN("[App] thread_pool.workers %lld is negative, using the CPU count",
+                 static_cast<long long>(workers));
+        workers = 0;
+    }
+    if (max_agent_workers < 0) {
+        LOG_WARN("[App] thread_pool.max_agent_workers %lld is negative, using workers - 1",
+                 static_cast<long long>(max_agent_workers));
+        max_agent_workers = 0;
+    }
+    ThreadPoolConfig pool_config;
+    pool_config.num_threads = static_cast<size_t>(workers);
+    pool_config.max_agent_workers = static_cast<size_t>(max_agent_workers);
+
+    thread_pool_ = new ThreadPool(pool_config);
+
+    // Serialize work per session on top of the shared pool
+    session_executor_.init(thread_pool_, process_message);
+    session_executor_.set_coalesce(config_.get_bool("session.coalesce_messages", true));
+
+    // Ingress dedup: fixed-size ring of recent message IDs
+    debouncer_.set_window(static_cast<int>(config_.get_int("dedup.window_seconds", 5)));
+    debouncer_.set_capacity(static_cast<size_t>(config_.get_int("dedup.max_entries", 65536)));
+    debouncer_.set_bloom_bits(static_cast<size_t>(config_.get_int("dedup.bloom_bits", 0)));
+}
+
+void Application::setup_tool_workers() {
+    int workers = static_cast<int>(config_.get_int("agent.shell_workers", 2));
+    if (workers <= 0) {
+        LOG_INFO("[ToolWorkers] Disabled, shell commands run in-process");
+        return;
+    }
+    size_t output_bytes = static_cast<size_t>(config_.get_int("agent.shell_max_output_kb", 1024)) * 1024;
+    ToolWorkerPool::instance().start(workers, output_bytes, config_.get_bool("sandbox.enabled", true));
+}
+
+void Application::setup_http() {
+    HttpClientPool& pool = HttpClientPool::instance();
+    pool.set_http2(config_.get_bool("http.http2", true));
+    pool.set_decompress(config_.get_bool("http.compression", true));
+    pool.set_max_idle(static_cast<size_t>(config_.get_int("http.max_idle_clients", 8)));
+    
+    // Model calls in flight wait here instead of on a worker
+    if (config_.get_bool("agent.async_model_calls", true)) {
+        AsyncHttp::instance().start();
+    }
+}
+
+void Application::setup_sessions() {
+    sessions().set_max_history(static_cast<size_t>(
+        config_.get_int("session.max_history", 20)));
+    
+    // Which direct chats share a session; per_account_peer keeps the bots
+    // of a multi-account channel apart
+    std::string scope = config_.get_string("session.dm_scope", "main");
+    if (scope == "per_peer") {
+        sessions().set_dm_scope(DMScope::PER_PEER);
+    } else if (scope == "per_channel_peer") {
+        sessions().set_dm_scope(DMScope::PER_CHANNEL_PEER);
+    } else if (scope == "per_account_peer") {
+        sessions().set_dm_scope(DMScope::PER_ACCOUNT_PEER);
+    } else if (scope != "main") {
+        LOG_WARN("[App] Unknown session.dm_scope '%s', using main", scope.c_str());
+    }
+    
+    if (!config_.get_bool("session.persist", true)) {
+        LOG_INFO("[App] Sessions kept in memory only (session.persist=false)");
+        return;
     }
+    
+    std::string path = config_.get_string("session.store_path", ".opencrank/sessions.db");
+    int flush_ms = static_cast<int>(config_.get_int("session.flush_interval_ms", 200));
+    if (!session_store_.open(path, flush_ms)) {
+        LOG_WARN("[App] Session store unavailable, sessions kept in memory only");
+        return;
+    }
+    
+    int64_t retention_days = config_.get_int("session.retention_days", 30);
+    session_store_.prune(retention_days * 86400);
+    
+    size_t budget_mb = static_cast<size_t>(config_.get_int("session.memory_budget_mb", 64));
+    sessions().set_store(&session_store_, budget_mb * 1024 * 1024);
+}
+
+void Application::setup_metrics() {
+    Metrics::instance().add_collector("app", [this](MetricsWriter& w) {
+        if (thread_pool_) {
+            w.gauge("opencrank_pool_workers", "Thread pool workers", static_cast<double>(thread_pool_->size()));
+            w.gauge("opencrank_pool_active", "Thread pool workers running a task",
+                    static_cast<double>(thread_pool_->active()));
+            for (int lane = 0; lane <= static_cast<int>(TaskPriority::BACKGROUND); ++lane) {
+                TaskPriority priority = static_cast<TaskPriority>(lane);
+                w.gauge("opencrank_pool_queued", "Tasks waiting for a worker",
+                        static_cast<double>(thread_pool_->pending(priority)),
+                        metric_labels("lane", task_priority_name(priority)));
+            }
+        }
+
+        if (AsyncHttp::instance().running()) {
+            w.gauge("opencrank_async_http_in_flight", "Model requests in flight on the async HTTP loop",
+                    static_cast<double>(AsyncHttp::instance().in_flight()));
+            w.counter("opencrank_async_http_completed_total", "Requests completed by the async HTTP loop",
+                      static_cast<double>(AsyncHttp::instance().completed()));
+        }
+
+        w.gauge("opencrank_outbound_queued", "Reply chunks waiting in the outbound scheduler",
+                static_cast<double>(OutboundScheduler::instance().pending()));
+        w.counter("opencrank_outbound_delivered_total", "Reply chunks delivered",
+                  static_cast<double>(OutboundScheduler::instance().delivered()));
+        w.counter("opencrank_outbound_failed_total", "Reply chunks that failed to send",
+                  static_cast<double>(OutboundScheduler::instance().failed()));
+
+        w.gauge("opencrank_sessions", "Sessions held in memory", static_cast<double>(sessions().session_count()));
+        w.gauge("opencrank_session_memory_bytes", "Approximate bytes of session history in memory",
+                static_cast<double>(sessions().memory_used()));
+        w.counter("opencrank_session_evictions_total", "Session histories unloaded to stay under the memory budget",
+                  static_cast<double>(sessions().evictions()));
+        w.gauge("opencrank_chunker_memory_bytes", "Stored tool output held in memory by the content chunker",
+                static_cast<double>(agent_.chunker().memory_used()));
+        w.gauge("opencrank_chunker_disk_bytes", "Stored tool output spilled to disk by the content chunker",
+                static_cast<double>(agent_.chunker().disk_used()));
+        
+        allocator::Stats heap = allocator::stats();
+        if (heap.allocated > 0) {
+            w.gauge("opencrank_heap_allocated_bytes", "Bytes in use from the allocator",
+                    static_cast<double>(heap.allocated), metric_labels("allocator", allocator::name()));
+        }
+        if (heap.resident > 0) {
+            w.gauge("opencrank_heap_resident_bytes", "Bytes the allocator holds from the system",
+                    static_cast<double>(heap.resident), metric_labels("allocator", allocator::name()));
+        }
+
+        AIProcessMonitor::Stats ai = ai_monitor_.get_stats();
+        w.gauge("opencrank_agent_runs_active", "Agent runs in progress", ai.active_sessions);
+        w.counter("opencrank_agent_runs_hung_total", "Agent runs flagged as hung", ai.total_hung_detected);
+
+        if (Cluster::instance().enabled()) {
+            w.gauge("opencrank_cluster_live_nodes", "Cluster nodes in the session ring",
+                    static_cast<double>(Cluster::instance().live_nodes()));
+            w.gauge("opencrank_cluster_leader", "1 while this node leads the cluster",
+                    Cluster::instance().is_leader() ? 1.0 : 0.0);
+        }
+        
+        w.counter("opencrank_dedup_duplicates_total", "Duplicate messages dropped by the debouncer",
+                  static_cast<double>(debouncer_.duplicates()));
+        w.counter("opencrank_dedup_evictions_total", "Message IDs forgotten before the dedup window ended",
+                  static_cast<double>(debouncer_.evictions()));
+    });
 }
 
 void Application::setup_skills() {
@@ -217,52 +479,144 @@ void Application::setup_skills() {
     skills_config.bundled_skills_dir = config_.get_string("skills.bundled_dir", "");
     skills_config.managed_skills_dir = config_.get_string("skills.managed_dir", "");
     
+    // Parsed skills persist next to the other databases so restarts only
+    // re-read SKILL.md files that changed
+    skills_config.index_path = config_.get_string("skills.index_path", "");
+    const std::string& db_dir = Sandbox::instance().db_dir();
+    if (skills_config.index_path.empty() && !db_dir.empty()) {
+        skills_config.index_path = db_dir + "/skills_index.json";
+    }
+    
     skill_manager_.set_config(skills_config);
+    SkillRequirementResolver::instance().set_ttl_ms(
+        config_.get_int("skills.requirement_ttl_s", 300) * 1000);
+    reload_skills();
     
-    // Load and filter skills
+    if (config_.get_bool("skills.watch", true)) {
+        skill_watcher_.watch(skill_manager_.skill_dirs());
+    }
+}
+
+void Application::reload_skills() {
     auto entries = skill_manager_.load_workspace_skill_entries();
-    auto eligible = skill_manager_.filter_skill_entries(entries, nullptr);
     
-    LOG_INFO("Loaded %zu skills (%zu eligible for this environment)", 
-             entries.size(), eligible.size());
+    // Skill commands never take a registry or built-in command's name
+    std::set<std::string> reserved;
+    for (const auto& command : registry().commands()) {
+        reserved.insert(command.first.substr(command.first[0] == '/' ? 1 : 0));
+    }
+    reserved.insert("skills");
+    reserved.insert("skill");
+    
+    auto catalog = std::make_shared<SkillCatalog>();
+    catalog->entries = skill_manager_.filter_skill_entries(entries, nullptr);
+    catalog->commands = skill_manager_.build_workspace_skill_command_specs(&entries, nullptr, &reserved);
     
-    // Store for later use
-    skill_entries_ = std::move(eligible);
-    skill_command_specs_ = skill_manager_.build_workspace_skill_command_specs(&entries, nullptr, nullptr);
+    LOG_INFO("Loaded %zu skills (%zu eligible for this environment)", 
+             entries.size(), catalog->entries.size());
+    LOG_DEBUG("Built %zu skill command specs", catalog->commands.size());
     
-    LOG_DEBUG("Built %zu skill command specs", skill_command_specs_.size());
-    for (const auto& spec : skill_command_specs_) {
+    const SkillRequirementResolver& requirements = SkillRequirementResolver::instance();
+    LOG_DEBUG("[Skills] Binary checks: %llu lookups, %llu PATH probes (%llu us), %llu invalidations",
+              (unsigned long long)requirements.lookups(),
+              (unsigned long long)requirements.probes(),
+              (unsigned long long)requirements.probe_us(),
+              (unsigned long long)requirements.invalidations());
+    for (const auto& spec : catalog->commands) {
         LOG_DEBUG("  /%s -> skill '%s' (%s)", spec.name.c_str(), spec.skill_name.c_str(), spec.description.c_str());
     }
+    
+    // The skills section filters entries itself; skip it when none are eligible
+    std::string prompt = compose_system_prompt(catalog->entries.empty()
+        ? std::vector<SkillEntry>() : entries);
+    
+    std::map<std::string, std::string> aliases;
+    const Json& commands_config = config_.get_section("commands");
+    if (commands_config.is_object() && commands_config.contains("aliases") &&
+        commands_config["aliases"].is_object()) {
+        for (auto it = commands_config["aliases"].begin(); it != commands_config["aliases"].end(); ++it) {
+            if (it.value().is_string()) {
+                aliases[it.key()] = it.value().get<std::string>();
+            }
+        }
+    }
+    CommandTablePtr table = CommandTable::build(registry().commands(), catalog, aliases);
+    
+    std::lock_guard<std::mutex> lock(skills_mutex_);
+    skill_catalog_ = catalog;
+    command_table_ = table;
+    system_prompt_ = std::move(prompt);
+}
+
+CommandTablePtr Application::command_table() const {
+    std::lock_guard<std::mutex> lock(skills_mutex_);
+    return command_table_;
+}
+
+std::shared_ptr<const SkillCatalog> Application::skill_catalog() const {
+    std::lock_guard<std::mutex> lock(skills_mutex_);
+    return skill_catalog_;
+}
+
+std::string Application::system_prompt() const {
+    std::lock_guard<std::mutex> lock(skills_mutex_);
+    return system_prompt_;
+}
+
+void Application::schedule_skill_reload() {
+    // Coalesce bursts of events (editors write, rename and chmod in a row)
+    if (skill_reload_timer_ != 0) {
+        return;
+    }
+    int debounce_ms = static_cast<int>(config_.get_int("skills.reload_debounce_ms", 500));
+    skill_reload_timer_ = reactor_.add_timer(debounce_ms, [this]() {
+        skill_reload_timer_ = 0;
+        if (skill_reload_running_.exchange(true)) {
+            schedule_skill_reload();  // A reload is still running; try again later
+            return;
+        }
+        auto reload = [this]() {
+            LOG_INFO("[Skills] Skill directories changed, reloading");
+            reload_skills();
+            skill_reload_running_.store(false);
+            // New skill directories need watches of their own
+            reactor_.post([this]() {
+                skill_watcher_.watch(skill_manager_.skill_dirs());
+            });
+        };
+        if (thread_pool_) {
+            thread_pool_->enqueue(reload, TaskPriority::BACKGROUND);
+        } else {
+            reload();
+        }
+    });
 }
 
-void Application::setup_system_prompt() {
+std::string Application::compose_system_prompt(const std::vector<SkillEntry>& entries) {
     // ── 1. Default base prompt ──
-    system_prompt_ = AppInfo::default_system_prompt();
+    std::string prompt = AppInfo::default_system_prompt();
     LOG_DEBUG("Loaded default system prompt");
 
     // ── 2. Custom prompt from config.json ──
     auto custom_prompt = config_.get_string("system_prompt", "");
     if (!custom_prompt.empty()) {
-        system_prompt_ += "\n\n";
-        system_prompt_ += custom_prompt;
+        prompt += "\n\n";
+        prompt += custom_prompt;
         LOG_DEBUG("Appended custom system prompt from config");
     }
 
-    // ── 3. Skills section (from already-loaded skill entries) ──
-    if (!skill_entries_.empty()) {
-        // Reload entries to pass to build_skills_section
-        auto entries = skill_manager_.load_workspace_skill_entries();
+    // ── 3. Skills section (from the loaded skill entries) ──
+    if (!entries.empty()) {
         auto skills_section = skill_manager_.build_skills_section(&entries);
         if (!skills_section.empty()) {
-            system_prompt_ += "\n\n";
-            system_prompt_ += skills_section;
+            prompt += "\n\n";
+            prompt += skills_section;
             LOG_DEBUG("Appended skills section to system prompt");
         }
     }
 
     // ── Summary ──
-    auto prompt_size = system_prompt_.size();
+    auto prompt_size = prompt.size();
     if (prompt_size > 20000) {
         LOG_WARN("System prompt is very large (%zu chars). This may consume significant context window.",
                  prompt_size);
@@ -271,6 +625,7 @@ void Application::setup_system_prompt() {
     }
     LOG_DEBUG("Final system prompt size: %zu characters (~%zu tokens)",
               prompt_size, prompt_size / 4);
+    return prompt;
 }
 
 void Application::setup_agent() {
@@ -288,6 +643,22 @@ void Application::setup_agent() {
         config_.get_bool("agent.auto_chunk_large_results", true);
     agent_config.chunk_size = static_cast<size_t>(
         config_.get_int("agent.chunk_size", 0));
+    agent_config.stream_replies = config_.get_bool("agent.stream", true);
+    agent_config.stream_interval_ms = static_cast<int>(
+        config_.get_int("agent.stream_interval_ms", 1000));
+    agent_config.max_parallel_tools = static_cast<int>(
+        config_.get_int("agent.max_parallel_tools", 4));
+    agent_config.early_tool_start = config_.get_bool("agent.early_tool_start", true);
+    agent_config.native_tools = config_.get_bool("agent.native_tools", true);
+    agent_config.compact_after = static_cast<int>(
+        config_.get_int("agent.compact_after", 3));
+    agent_config.compact_min_chars = static_cast<size_t>(
+        config_.get_int("agent.compact_min_chars", 1500));
+    agent_config.async_model_calls = config_.get_bool("agent.async_model_calls", true);
+    const Json& agent_section = config_.get_section("agent");
+    if (agent_section.is_object()) {
+        agent_config.temperature = agent_section.value("temperature", agent_config.temperature);
+    }
     
     // Try to get context_size from AI provider configs (llamacpp or claude)
     int64_t ctx = config_.get_int("llamacpp.context_size", 0);
@@ -297,6 +668,70 @@ void Application::setup_agent() {
     agent_config.context_size = static_cast<size_t>(ctx);
     
     agent_.set_config(agent_config);
+    agent_.set_thread_pool(thread_pool_);
+    
+    // Model calls share provider capacity fairly between users; queued
+    // calls start from the pool (sending is quick, the reply is awaited)
+    FairShareScheduler& fair = FairShareScheduler::instance();
+    fair.configure(config_);
+    fair.set_executor([this](const std::function<void()>& task) {
+        thread_pool_->enqueue(task, TaskPriority::INTERACTIVE);
+    });
+    
+    // Large tool results: bounded in memory, cold ones spilled next to the databases
+    size_t chunker_memory = static_cast<size_t>(config_.get_int("agent.chunker_memory_mb", 256)) * 1024 * 1024;
+    size_t chunker_disk = static_cast<size_t>(config_.get_int("agent.chunker_disk_mb", 1024)) * 1024 * 1024;
+    const std::string& db_dir = Sandbox::instance().db_dir();
+    agent_.chunker().set_limits(chunker_memory, db_dir.empty() ? "" : db_dir + "/chunks", chunker_disk);
+    
+    // Memories for each incoming message, searched while the run gets ready
+    MemoryRecall::instance().configure(config_);
+    MemoryRecall::instance().set_thread_pool(thread_pool_);
+    
+    // Session ownership across nodes; the endpoint opens with the reactor
+    Cluster::instance().configure(config_);
+    
+    // Repeated idempotent tool calls answer from memory until a write
+    ToolMemoConfig memo_config;
+    std::string memo_scope = config_.get_string("agent.tool_memo", "run");
+    memo_config.scope = memo_scope == "session" ? ToolMemoConfig::SESSION
+                      : memo_scope == "off" ? ToolMemoConfig::OFF : ToolMemoConfig::RUN;
+    memo_config.ttl_s = config_.get_int("agent.tool_memo_ttl_s", 300);
+    memo_config.max_bytes = static_cast<size_t>(config_.get_int("agent.tool_memo_max_mb", 32)) * 1024 * 1024;
+    agent_.tool_memo().configure(memo_config);
+    
+    // Opt-in cache of model replies for repeated prompts
+    if (config_.get_bool("response_cache.enabled", false)) {
+        ResponseCacheConfig cache_config;
+        cache_config.messages = static_cast<size_t>(config_.get_int("response_cache.messages", 4));
+        cache_config.ttl_s = config_.get_int("response_cache.ttl_s", 86400);
+        cache_config.max_entries = static_cast<size_t>(config_.get_int("response_cache.max_entries", 2000));
+        cache_config.semantic = config_.get_bool("response_cache.semantic", false);
+        const Json& cache_section = config_.get_section("response_cache");
+        if (cache_section.is_object()) {
+            cache_config.similarity = cache_section.value("similarity", cache_config.similarity);
+        }
+        // Same embedding endpoint as memory search
+        cache_config.embeddings.enabled = cache_config.semantic;
+        cache_config.embeddings.url = config_.get_string("memory.embedding_url",
+                                                         config_.get_string("llamacpp.url", ""));
+        cache_config.embeddings.api = config_.get_string("memory.embedding_api", "openai");
+        cache_config.embeddings.model = config_.get_string("memory.embedding_model", "");
+        cache_config.embeddings.api_key = config_.get_string("memory.embedding_api_key", "");
+        cache_config.embeddings.timeout_ms = static_cast<int>(config_.get_int("memory.embedding_timeout_ms", 15000));
+        std::string path = config_.get_string("response_cache.path",
+                                              (db_dir.empty() ? std::string(".opencrank") : db_dir) + "/response_cache.db");
+        if (!agent_.response_cache().open(path, cache_config)) {
+            LOG_WARN("[App] Response cache unavailable, every request goes to the model");
+        }
+    }
+    
+    // Per-run span traces for /trace (and optional JSON export)
+    Tracer::instance().configure(static_cast<size_t>(config_.get_int("agent.trace_keep", 8)),
+                                 config_.get_string("agent.trace_dir", ""));
+    
+    // Provider replies and tool outputs of every run, for opencrank-bench --replay
+    RunRecorder::instance().configure(config_.get_string("agent.record_dir", ""));
     
     LOG_INFO("Agent config: max_iterations=%d, max_consecutive_errors=%d, "
              "max_tool_result_size=%zu, chunk_size=%zu (effective=%zu), context_size=%zu tokens",
@@ -328,6 +763,8 @@ void Application::setup_plugins() {
     loader_.add_search_path(plugins_dir);
     
     // Load external plugins from config
+    loader_.set_profile(&startup_profile_);
+    loader_.set_lazy_binding(config_.get_bool("startup.lazy_bind", true));
     int loaded = loader_.load_from_config(config_);
     LOG_INFO("Loaded %d external plugins", loaded);
     
@@ -335,12 +772,21 @@ void Application::setup_plugins() {
     static BuiltinToolsProvider builtin_tools_provider;
     static BrowserTool browser_tool;
     static MemoryTool memory_tool;
+    static SubagentTool subagent_tool;
     
     registry().register_plugin(&builtin_tools_provider);
     registry().register_plugin(&browser_tool);
     registry().register_plugin(&memory_tool);
+    registry().register_plugin(&subagent_tool);
     LOG_DEBUG("Registered 3 core tool providers (builtin, browser, memory)");
     
+    // The router goes ahead of the providers it wraps, so get_default_ai()
+    // picks it whenever one of them is configured
+    static AIRouter ai_router;
+    if (AIRouter::configured_in(config_)) {
+        registry().register_plugin(&ai_router);
+    }
+    
     // Register external plugins with registry
     for (const auto& plugin : loader_.plugins()) {
         if (plugin.instance) {
@@ -359,13 +805,24 @@ void Application::setup_plugins() {
     // Register core commands
     register_core_commands(config_, registry());
 
-    // Initialize all plugins
-    registry().init_all(config_);
+    // Initialize all plugins; independent ones in parallel (provider token
+    // counters and the like may fetch over the network)
+    bool parallel = config_.get_bool("startup.parallel", true);
+    registry().init_all(config_, parallel, &startup_profile_);
+    
+    // AI providers pre-build context resumes on the background lane
+    for (auto* ai : registry().ai_providers()) {
+        ai->set_thread_pool(thread_pool_);
+    }
+    
+    // Internal completions (resumes, intent checks) on their own models
+    PurposeModels::instance().configure(config_);
     
     LOG_INFO("Registered %zu commands", registry().commands().size());
 
     // Set up chunker reference for builtin tools
     builtin_tools_provider.set_chunker(&agent_.chunker());
+    browser_tool.set_chunker(&agent_.chunker());
 
     // Register tool plugins with the agent
     for (auto* tool_plugin : registry().tools()) {
@@ -386,6 +843,10 @@ void Application::setup_plugins() {
 void Application::setup_channels() {
     auto& channels = registry().channels();
     
+    // Replies are queued per chat and leave the agent worker at once
+    OutboundScheduler::instance().start(static_cast<size_t>(
+        std::max(1, static_cast<int>(config_.get_int("outbound.threads", 2)))));
+    
     // Set callbacks
     for (auto* channel : channels) {
         if (channel->is_initialized()) {
@@ -394,20 +855,29 @@ void Application::setup_channels() {
         }
     }
     
-    // Start channels
-    int started_count = 0;
-    for (auto* channel : channels) {
-        if (channel->is_initialized() && channel->start()) {
-            LOG_INFO("Started channel: %s", channel->channel_id());
-            started_count++;
+    // State a replaced process saved (hot restart), before anything polls
+    if (HotRestart::instance().resumed()) {
+        const std::vector<Plugin*>& plugins = registry().plugins();
+        for (size_t i = 0; i < plugins.size(); ++i) {
+            Json state = HotRestart::instance().plugin_state(plugins[i]->name());
+            if (!state.is_null()) plugins[i]->restore_state(state);
         }
     }
     
+    // Start channels (each usually checks in with its service)
+    int started_count = 0;
+    if (batch_mode()) {
+        LOG_INFO("[Batch] Batch mode, channels are not started");
+    } else {
+        started_count = registry().start_all_channels(config_.get_bool("startup.parallel", true),
+                                                      &startup_profile_);
+    }
+    
     // Check gateway
     auto* gateway = registry().get_plugin("gateway");
     bool has_gateway = (gateway != nullptr && gateway->is_initialized());
     
-    if (started_count == 0 && !has_gateway) {
+    if (started_count == 0 && !has_gateway && !batch_mode()) {
         LOG_ERROR("No channels or gateway started. Configure at least one:");
         LOG_ERROR("  1. Set telegram.bot_token in config.json for Telegram");
         LOG_ERROR("  2. Or enable gateway with gateway.port in config.json");
@@ -437,21 +907,35 @@ void Application::warmup_ai() {
     
     LOG_INFO("Warming up AI connection...");
     
-    // Send a minimal warmup message to establish connection
-    std::vector<ConversationMessage> warmup_history;
-    warmup_history.push_back(ConversationMessage::system("You are a helpful AI assistant."));
-    warmup_history.push_back(ConversationMessage::user("Hello"));
-    
-    CompletionOptions opts;
-    opts.max_tokens = 10;  // Very short response
-    opts.temperature = 0.1; // Low creativity for fast response
-    
-    CompletionResult result = ai->chat(warmup_history, opts);
+    auto warmup = [this, ai]() {
+        PluginRegistry::Pin pin;
+        StartupProfile::Scope scope(&startup_profile_, "warmup_call", ai->provider_id());
+        
+        // Send a minimal warmup message to establish connection
+        std::vector<ConversationMessage> warmup_history;
+        warmup_history.push_back(ConversationMessage::system("You are a helpful AI assistant."));
+        warmup_history.push_back(ConversationMessage::user("Hello"));
+        
+        CompletionOptions opts;
+        opts.max_tokens = 10;  // Very short response
+        opts.temperature = 0.1; // Low creativity for fast response
+        
+        CompletionResult result = ai->chat(warmup_history, opts);
+        scope.set_ok(result.success);
+        
+        if (result.success) {
+            LOG_INFO("AI warmup successful - connection established");
+        } else {
+            LOG_WARN("AI warmup failed: %s", result.error.c_str());
+        }
+    };
     
-    if (result.success) {
-        LOG_INFO("AI warmup successful - connection established");
+    // Nothing waits for the warmup: the first real request simply finds the
+    // connection already open (or opens it itself)
+    if (thread_pool_ && config_.get_bool("startup.background_warmup", true)) {
+        thread_pool_->enqueue(warmup, TaskPriority::BACKGROUND);
     } else {
-        LOG_WARN("AI warmup failed: %s", result.error.c_str());
+        warmup();
     }
 }
 
@@ -459,9 +943,6 @@ bool Application::init(int argc, char* argv[]) {
     // Initialize libcurl globally (before threads start)
     curl_global_init(CURL_GLOBAL_ALL);
 
-    // Create thread pool after curl init
-    thread_pool_ = new ThreadPool(8);
-
     // Change to home directory for consistent path resolution
     {
         const char* home = getenv("HOME");
@@ -475,6 +956,9 @@ bool Application::init(int argc, char* argv[]) {
         // Create the directory if it doesn't exist
         mkdir(app_dir.c_str(), 0755);
         
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd))) launch_dir_ = cwd;
+        
         // Best-effort change; ignore error here
         chdir(app_dir.c_str());
     }
@@ -487,57 +971,106 @@ bool Application::init(int argc, char* argv[]) {
     // Setup signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGHUP, reload_signal_handler);
+    signal(SIGUSR2, restart_signal_handler);
     
     LOG_INFO("%s v%s starting...", AppInfo::NAME, AppInfo::VERSION);
     
+    // Sockets and work handed over by the process this one replaces
+    HotRestart::instance().init();
+    
     // Load configuration
-    if (!config_.load_file(config_file_)) {
-        LOG_WARN("Failed to load config from %s, aborting!", config_file_.c_str());
-        return false;
-    } else {
+    {
+        StartupProfile::Scope phase(&startup_profile_, "config");
+        if (!config_.load_file(config_file_)) {
+            LOG_WARN("Failed to load config from %s, aborting!", config_file_.c_str());
+            return false;
+        }
         LOG_INFO("Loaded config from %s", config_file_.c_str());
     }
+    if (batch_mode() && batch_options_.concurrency <= 0) {
+        batch_options_.concurrency = static_cast<int>(config_.get_int("batch.concurrency", 4));
+    }
+
+    // Fork the tool worker zygote while the process is still single-threaded
+    run_phase("tool_workers", &Application::setup_tool_workers);
 
-    setup_plugins();
+    // Create thread pool after curl init and config load, before channels start
+    run_phase("thread_pool", &Application::setup_thread_pool);
+    run_phase("http", &Application::setup_http);
+
+    run_phase("plugins", &Application::setup_plugins);
 
     // Setup sandbox (must be before any AI/tool processing)
-    setup_sandbox();
+    run_phase("sandbox", &Application::setup_sandbox);
     
     // Setup components in order
-    setup_logging();
-    setup_channels();
-    setup_skills();
-    setup_system_prompt();
-    setup_agent();
+    run_phase("logging", &Application::setup_logging);
+    run_phase("channels", &Application::setup_channels);
+    run_phase("skills", &Application::setup_skills);
+    run_phase("agent", &Application::setup_agent);
     
-    // Configure session manager
-    sessions().set_max_history(static_cast<size_t>(
-        config_.get_int("session.max_history", 20)));
+    run_phase("sessions", &Application::setup_sessions);
+    run_phase("metrics", &Application::setup_metrics);
     
-    // Warm up AI connection
-    warmup_ai();
+    // Warm up AI connection (in the background unless startup.background_warmup is off)
+    run_phase("warmup", &Application::warmup_ai);
     
     // Start AI process monitor
     AIProcessMonitor::Config monitor_config;
     monitor_config.hang_timeout_seconds = config_.get_int("ai_monitor.hang_timeout", 30);
     monitor_config.typing_interval_seconds = config_.get_int("ai_monitor.typing_interval", 3);
-    monitor_config.check_interval_ms = config_.get_int("ai_monitor.check_interval_ms", 5000);
+    monitor_config.cancel_on_hang = config_.get_bool("ai_monitor.cancel_on_hang", true);
     ai_monitor_.set_config(monitor_config);
     
-    // Set hung session callback
+    // Set hung session callback: kill the session's running tool processes
+    // so its agent loop gets a result and can move on (the monitor has
+    // cancelled the run's token already, unless cancel_on_hang is off)
     ai_monitor_.set_hung_callback([](const std::string& session_id, int elapsed_seconds) {
         LOG_ERROR("AI HUNG DETECTED: session [%s] no heartbeat for %d seconds",
                   session_id.c_str(), elapsed_seconds);
-        // Future: could implement recovery actions here
+        AsyncHttp::instance().wake_cancelled();
+        ProcessRunner::cancel(session_id);
+        ToolWorkerPool::instance().cancel(session_id);
     });
     
-    ai_monitor_.start();
+    // Typing actions from every caller go out batched per channel on the
+    // pool. Requests within half an interval of a send are dropped, which
+    // absorbs timer jitter without suppressing the monitor's refreshes.
+    typing_.set_interval(std::max(0, monitor_config.typing_interval_seconds) * 500);
+    typing_.set_sender(
+        [this](const std::string& channel_id, const std::vector<std::string>& chat_ids, bool typing) {
+            send_typing_batch(channel_id, chat_ids, typing);
+        },
+        [this](std::function<void()> flush) {
+            if (thread_pool_) {
+                thread_pool_->enqueue(flush, TaskPriority::BACKGROUND);
+            } else {
+                flush();
+            }
+        });
+    
+    ai_monitor_.start(reactor_);
     LOG_INFO("AI process monitor started");
     
+    // The batch files usually live outside the sandbox: open them first
+    if (batch_mode()) {
+        batch_.reset(new BatchRunner(batch_options_));
+        std::string error;
+        if (!batch_->open(error)) {
+            LOG_ERROR("[Batch] %s", error.c_str());
+            return false;
+        }
+    }
+    
     // NOW activate Landlock sandbox - all plugins, configs, and shared
     // libraries are loaded. From here on, filesystem is locked down.
     activate_sandbox();
     
+    if (batch_mode()) {
+        return true;    // No channels and no CRON tasks; run() works through the batch
+    }
+    
     // Verify we have something to run
     auto* gateway = registry().get_plugin("gateway");
     bool has_gateway = (gateway != nullptr && gateway->is_initialized());
@@ -556,54 +1089,486 @@ bool Application::init(int argc, char* argv[]) {
     return true;
 }
 
+void Application::setup_reactor() {
+    if (!reactor_.init()) {
+        LOG_WARN("[App] Reactor unavailable, falling back to the poll loop");
+    }
+    
+    legacy_pollers_.clear();
+    const std::vector<Plugin*>& plugins = registry().plugins();
+    for (size_t i = 0; i < plugins.size(); ++i) {
+        // Batch mode leaves the channels it did not start alone
+        if (batch_mode() && dynamic_cast<ChannelPlugin*>(plugins[i])) continue;
+        if (!plugins[i]->attach_reactor(reactor_)) {
+            legacy_pollers_.push_back(plugins[i]);
+        }
+    }
+    
+    // Plugins that have not moved to the reactor keep their poll() cadence
+    if (!legacy_pollers_.empty()) {
+        int interval = static_cast<int>(config_.get_int("main_loop.poll_interval_ms", 100));
+        reactor_.add_timer(interval, [this]() {
+            for (size_t i = 0; i < legacy_pollers_.size(); ++i) {
+                legacy_pollers_[i]->poll();
+            }
+        }, true);
+        LOG_INFO("[App] %zu plugin(s) polled every %dms", legacy_pollers_.size(), interval);
+    }
+    
+    // Reload skills when SKILL.md files change
+    if (skill_watcher_.fd() >= 0) {
+        reactor_.add_fd(skill_watcher_.fd(), EPOLLIN, [this](uint32_t) {
+            if (skill_watcher_.drain()) {
+                schedule_skill_reload();
+            }
+        });
+    }
+    
+    // Peers forward the messages of sessions this node owns
+    if (Cluster::instance().enabled()) {
+        Cluster::instance().start(reactor_, thread_pool_, on_owned_message);
+    }
+    
+    // Periodic cleanup
+    reactor_.add_timer(10000, [this]() {
+        sessions().cleanup_inactive(3600);  // 1 hour timeout
+        user_limiter_.cleanup(3600);
+        
+        // Histories unloaded over budget leave free holes in the heap;
+        // hand them back off the loop thread (the trim walks the heap)
+        uint64_t evictions = sessions().evictions();
+        if (evictions != released_evictions_ && thread_pool_) {
+            released_evictions_ = evictions;
+            thread_pool_->enqueue([]() { allocator::release_free(); }, TaskPriority::BACKGROUND);
+        }
+    }, true);
+}
+
+void Application::run_phase(const char* name, void (Application::*setup)()) {
+    StartupProfile::Scope phase(&startup_profile_, name);
+    (this->*setup)();
+}
+
 int Application::run() {
-    LOG_INFO("Entering main loop (poll interval: 100ms)");
+    run_phase("reactor", &Application::setup_reactor);
+    
+    LOG_INFO("Startup complete in %.0f ms", startup_profile_.elapsed_ms());
+    if (profile_startup_) {
+        // The background warmup shows up only if it has finished by now
+        fprintf(stderr, "%s", startup_profile_.report().c_str());
+    }
+    
+    if (batch_) {
+        return run_batch();
+    }
+    
+    // Messages a replaced process never started go first
+    std::vector<SessionExecutor::Queued> handed_over = HotRestart::instance().take_messages();
+    for (size_t i = 0; i < handed_over.size(); ++i) {
+        session_executor_.submit(handed_over[i].session_key, handed_over[i].msg, handed_over[i].priority);
+    }
+    
+    LOG_INFO("Entering main loop (event-driven, %zu legacy pollers)", legacy_pollers_.size());
     LOG_DEBUG("[App] Active channels: %zu, Active plugins: %zu, Agent tools: %zu",
               registry().channels().size(), registry().plugins().size(), agent_.tools().size());
     
     while (running_.load()) {
-        // Poll all plugins
-        registry().poll_all();
-        sleep_ms(100);
-        
-        // Periodic cleanup (~10 seconds)
-        static int cleanup_counter = 0;
-        if (++cleanup_counter >= 100) {
-            cleanup_counter = 0;
-            sessions().cleanup_inactive(3600);  // 1 hour timeout
-            user_limiter_.cleanup(3600);
+        // Blocks until an fd is ready, a timer is due, or stop() wakes us
+        reactor_.run_once(restart_deadline_ms_ ? 100 : 1000);
+        if (reload_requested_.exchange(false)) {
+            reload_config();
+        }
+        if (restart_requested_.load() && drain_for_restart()) {
+            running_.store(false);
         }
     }
+    LOG_DEBUG("[App] Main loop exited after %llu wakeups",
+              static_cast<unsigned long long>(reactor_.wakeups()));
     stop_cron_thread();
     return 0;
 }
 
+int Application::run_batch() {
+    AIPlugin* ai = registry().get_default_ai();
+    if (!ai || !ai->is_configured() || !thread_pool_) {
+        LOG_ERROR("[Batch] Needs a configured AI provider and the thread pool");
+        return 1;
+    }
+    
+    // The batch feeds the agent from its own thread; this one keeps serving
+    // async model replies and timers until the last item is written, also
+    // while the items a SIGINT cancelled wind down
+    int result = 1;
+    std::atomic<bool> finished(false);
+    std::string prompt = system_prompt();
+    std::thread feeder([this, ai, prompt, &result, &finished]() {
+        result = batch_->run(agent_, ai, thread_pool_, prompt);
+        finished.store(true);
+        stop();
+    });
+    while (!finished.load()) {
+        reactor_.run_once(1000);
+        if (!running_.load()) {
+            batch_->stop();
+        }
+        if (reload_requested_.exchange(false)) {
+            reload_config();
+        }
+    }
+    feeder.join();
+    return result;
+}
+
+void Application::request_config_reload() {
+    // Signal context: only flag and wake the loop
+    reload_requested_.store(true);
+    reactor_.wake();
+}
+
+void Application::request_hot_restart() {
+    // Signal context: only flag and wake the loop
+    restart_requested_.store(true);
+    reactor_.wake();
+}
+
+bool Application::drain_for_restart() {
+    int64_t now = current_timestamp_ms();
+    if (restart_deadline_ms_ == 0) {
+        restart_deadline_ms_ = now + config_.get_int("restart.drain_ms", 30000);
+        HotRestart::instance().add_messages(session_executor_.hand_off());
+        LOG_INFO("[Restart] Hot restart: holding new messages, waiting for %zu running turn(s)",
+                 session_executor_.active_sessions());
+    }
+    size_t running = session_executor_.active_sessions();
+    if (running > 0 && now < restart_deadline_ms_) return false;
+    if (running > 0) {
+        LOG_WARN("[Restart] %zu turn(s) still running at the end of restart.drain_ms, stopping them", running);
+    }
+    restarting_ = true;
+    return true;
+}
+
+void Application::save_restart_state() {
+    HotRestart& restart = HotRestart::instance();
+    restart.add_messages(session_executor_.hand_off());
+    const std::vector<Plugin*>& plugins = registry().plugins();
+    for (size_t i = 0; i < plugins.size(); ++i) {
+        Json state = plugins[i]->save_state();
+        if (!state.is_null()) restart.set_plugin_state(plugins[i]->name(), state);
+    }
+    
+    std::string path = config_.get_string("restart.state_file", "");
+    if (path.empty()) {
+        const std::string& db_dir = Sandbox::instance().db_dir();
+        path = db_dir.empty() ? "restart_state.json" : db_dir + "/restart_state.json";
+    }
+    if (!restart.save(path)) {
+        LOG_ERROR("[Restart] Handoff not saved, exiting instead of restarting");
+        restarting_ = false;
+    }
+}
+
+bool Application::exec_restart(char* argv[]) {
+    return HotRestart::instance().exec(argv);
+}
+
+void Application::send_typing_batch(const std::string& channel_id,
+                                    const std::vector<std::string>& chat_ids, bool typing) {
+    PluginRegistry::Pin pin;
+    ChannelPlugin* channel = typing ? registry().get_channel(channel_id) : NULL;
+    if (channel && !channel->capabilities().supports_typing) {
+        channel = NULL;
+    }
+    const std::vector<Plugin*>& plugins = registry().plugins();
+    for (size_t i = 0; i < chat_ids.size(); ++i) {
+        if (channel) {
+            SendResult result = channel->send_typing_action(chat_ids[i]);
+            if (!result.success) {
+                LOG_DEBUG("[App] Typing indicator to %s:%s failed: %s",
+                          channel_id.c_str(), chat_ids[i].c_str(), result.error.c_str());
+            }
+        }
+        for (size_t j = 0; j < plugins.size(); ++j) {
+            plugins[j]->on_typing_indicator(channel_id, chat_ids[i], typing);
+        }
+    }
+}
+
+bool Application::cancel_session(const std::string& session_id) {
+    bool running = ai_monitor_.cancel(session_id);
+    if (running) {
+        AsyncHttp::instance().wake_cancelled();
+        FairShareScheduler::instance().wake_cancelled();
+    }
+    ProcessRunner::cancel(session_id);
+    ToolWorkerPool::instance().cancel(session_id);
+    return running;
+}
+
+void Application::reload_config() {
+    if (!config_.reload()) return;
+    
+    // Settings read per call follow the new snapshot on their own; these
+    // were copied at startup and are cheap to re-apply
+    apply_log_level();
+    schedule_skill_reload();   // System prompt and command aliases
+    LOG_INFO("[App] Config reloaded; thread pool, channel and plugin settings apply on restart");
+    reload_plugins();
+}
+
+namespace {
+    // AI providers the router or a models entry resolved to a pointer
+    bool provider_held_by_config(const Config& config, const std::string& provider) {
+        const Json& router = config.get_section("router");
+        if (AIRouter::configured_in(config) && router.is_object() && router.contains("backends") &&
+            router["backends"].is_array()) {
+            const Json& backends = router["backends"];
+            for (size_t i = 0; i < backends.size(); ++i) {
+                const Json& b = backends[i];
+                if ((b.is_string() && b.get<std::string>() == provider) ||
+                    (b.is_object() && b.value("provider", std::string()) == provider)) {
+                    return true;
+                }
+            }
+        }
+        const Json& models = config.get_section("models");
+        for (Json::const_iterator it = models.begin(); models.is_object() && it != models.end(); ++it) {
+            if ((it.value().is_string() && it.value().get<std::string>() == provider) ||
+                (it.value().is_object() && it.value().value("provider", std::string()) == provider)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+bool Application::hot_swappable(Plugin* plugin, std::string& why) const {
+    if (dynamic_cast<ChannelPlugin*>(plugin)) {
+        why = "channels are held by reply queues and message callbacks";
+        return false;
+    }
+    if (dynamic_cast<ToolProvider*>(plugin)) {
+        why = "its agent tools are registered at startup";
+        return false;
+    }
+    AIPlugin* ai = dynamic_cast<AIPlugin*>(plugin);
+    if (ai && provider_held_by_config(config_, ai->provider_id())) {
+        why = "the router or a models entry uses it";
+        return false;
+    }
+    return true;
+}
+
+void Application::reload_plugins() {
+    if (batch_mode()) return;   // The batch holds its provider for the whole run
+    if (plugin_reload_.timer != 0) {
+        LOG_WARN("[Plugins] A plugin reload is still draining; send SIGHUP again once it is done");
+        return;
+    }
+    
+    std::vector<std::string> listed = PluginLoader::configured(config_);
+    std::vector<bool> matched(listed.size(), false);
+    PluginReload reload;
+    
+    // Loaded plugins dropped from the list or rebuilt on disk leave
+    std::vector<LoadedPlugin> loaded = loader_.plugins();
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        const LoadedPlugin& lp = loaded[i];
+        if (!lp.instance) continue;
+        std::string name = lp.info.name;
+        bool is_listed = false;
+        for (size_t j = 0; j < listed.size(); ++j) {
+            if (listed[j] == name || listed[j] == lp.path) {
+                is_listed = true;
+                matched[j] = true;
+            }
+        }
+        bool rebuilt = is_listed && loader_.changed_on_disk(name);
+        if (is_listed && !rebuilt) continue;
+        
+        std::string why;
+        if (!lp.handle) {
+            why = "it is compiled into the binary";
+        } else if (!hot_swappable(lp.instance, why)) {
+            // why is set
+        } else if (rebuilt && access(lp.path.c_str(), R_OK) != 0) {
+            why = "the new library is not readable (" + std::string(strerror(errno)) + ")";
+        }
+        if (why.empty()) {
+            PluginReload::Leaving leaving;
+            leaving.name = name;
+            leaving.reload_path = rebuilt ? lp.path : "";
+            leaving.plugin = lp.instance;
+            leaving.position = 0;
+            leaving.attached = std::find(legacy_pollers_.begin(), legacy_pollers_.end(),
+                                         lp.instance) == legacy_pollers_.end();
+            if (leaving.attached && !lp.instance->detach_reactor(reactor_)) {
+                why = "it cannot detach from the event loop";
+            } else {
+                reload.leaving.push_back(leaving);
+            }
+        }
+        if (!why.empty()) {
+            LOG_WARN("[Plugins] %s %s needs a restart: %s",
+                     rebuilt ? "Rebuilt plugin" : "Removed plugin", name.c_str(), why.c_str());
+        }
+    }
+    for (size_t j = 0; j < listed.size(); ++j) {
+        if (!matched[j] && !loader_.is_loaded(listed[j])) {
+            reload.arriving.push_back(listed[j]);
+        }
+    }
+    if (reload.leaving.empty() && reload.arriving.empty()) return;
+    
+    // New lookups stop finding them; calls already inside finish first
+    for (size_t i = 0; i < reload.leaving.size(); ++i) {
+        PluginReload::Leaving& leaving = reload.leaving[i];
+        leaving.position = registry().unregister_plugin(leaving.plugin);
+        legacy_pollers_.erase(std::remove(legacy_pollers_.begin(), legacy_pollers_.end(), leaving.plugin),
+                              legacy_pollers_.end());
+        LOG_INFO("[Plugins] %s %s", leaving.reload_path.empty() ? "Unloading" : "Reloading",
+                 leaving.name.c_str());
+    }
+    reload.generation = registry().generation();
+    reload.deadline_ms = current_timestamp_ms() + config_.get_int("plugin_reload.drain_ms", 30000);
+    plugin_reload_ = reload;
+    
+    // Polled rather than signalled: the interval also gives a callback that
+    // released the last pin time to return out of the plugin's code
+    plugin_reload_.timer = reactor_.add_timer(50, [this]() {
+        bool drained = registry().quiescent(plugin_reload_.generation);
+        if (!drained && current_timestamp_ms() < plugin_reload_.deadline_ms) return;
+        reactor_.cancel_timer(plugin_reload_.timer);
+        finish_plugin_reload(drained);
+    }, true);
+}
+
+void Application::finish_plugin_reload(bool drained) {
+    PluginReload reload = plugin_reload_;
+    plugin_reload_ = PluginReload();
+    
+    if (!drained) {
+        // Put everything back where it was, last removed first
+        for (size_t i = reload.leaving.size(); i > 0; --i) {
+            const PluginReload::Leaving& leaving = reload.leaving[i - 1];
+            if (!leaving.attached || !leaving.plugin->attach_reactor(reactor_)) {
+                legacy_pollers_.push_back(leaving.plugin);
+            }
+            registry().register_plugin(leaving.plugin, leaving.position);
+        }
+        LOG_WARN("[Plugins] Calls into the leaving plugins outlasted plugin_reload.drain_ms; "
+                 "reload abandoned, send SIGHUP to try again");
+        return;
+    }
+    
+    size_t unloaded = 0;
+    size_t loaded = 0;
+    for (size_t i = 0; i < reload.leaving.size(); ++i) {
+        loader_.unload(reload.leaving[i].name);
+        unloaded++;
+    }
+    for (size_t i = reload.leaving.size(); i > 0; --i) {
+        const PluginReload::Leaving& leaving = reload.leaving[i - 1];
+        if (!leaving.reload_path.empty() && bring_up_plugin(leaving.reload_path, leaving.position)) {
+            loaded++;
+        }
+    }
+    for (size_t i = 0; i < reload.arriving.size(); ++i) {
+        if (bring_up_plugin(reload.arriving[i], static_cast<size_t>(-1))) {
+            loaded++;
+        }
+    }
+    LOG_INFO("[Plugins] Reload done: %zu unloaded, %zu loaded (%zu plugins registered)",
+             unloaded, loaded, registry().plugins().size());
+}
+
+Plugin* Application::bring_up_plugin(const std::string& entry, size_t position) {
+    size_t before = loader_.plugins().size();
+    if (!loader_.load(entry) || loader_.plugins().size() == before) {
+        return nullptr;   // Failed (logged), or a plugin of that name is loaded
+    }
+    const LoadedPlugin& lp = loader_.plugins().back();
+    Plugin* plugin = lp.instance;
+    std::string name = lp.info.name;
+    
+    std::string why;
+    if (!hot_swappable(plugin, why)) {
+        LOG_WARN("[Plugins] %s needs a restart to load: %s", name.c_str(), why.c_str());
+        loader_.unload(name);
+        return nullptr;
+    }
+    if (!plugin->init(config_)) {
+        LOG_ERROR("[Plugins] %s failed to initialize", name.c_str());
+        loader_.unload(name);
+        return nullptr;
+    }
+    if (AIPlugin* ai = dynamic_cast<AIPlugin*>(plugin)) {
+        ai->set_thread_pool(thread_pool_);
+    }
+    if (!plugin->attach_reactor(reactor_)) {
+        legacy_pollers_.push_back(plugin);
+    }
+    registry().register_plugin(plugin, position);
+    LOG_INFO("[Plugins] %s v%s is live", name.c_str(), plugin->version());
+    return plugin;
+}
+
 void Application::shutdown() {
     LOG_INFO("Shutting down...");
     
     stop_cron_thread();
+    Cluster::instance().stop();
     
     // Stop AI monitor first
     ai_monitor_.stop();
     LOG_DEBUG("[App] AI monitor stopped");
     
+    Metrics::instance().remove_collector("app");
+    
+    // Fail model calls still queued or in flight while the pool can finish their runs
+    FairShareScheduler::instance().stop();
+    AsyncHttp::instance().stop();
+    
     // Stop thread pool (wait for pending)
     if (thread_pool_) {
         LOG_DEBUG("[App] Stopping thread pool (pending: %zu)", thread_pool_->pending());
         thread_pool_->shutdown();
+        agent_.set_thread_pool(nullptr);
+        MemoryRecall::instance().set_thread_pool(nullptr);
         delete thread_pool_;
         thread_pool_ = nullptr;
         LOG_DEBUG("[App] Thread pool stopped");
     }
     
+    // Last replies go out while the channels can still carry them
+    OutboundScheduler::instance().stop(static_cast<int>(config_.get_int("outbound.drain_ms", 5000)));
+    
     registry().stop_all_channels();
+    if (restarting_) {
+        save_restart_state();   // Channels are stopped: their offsets are final
+    }
     registry().shutdown_all();
     loader_.unload_all();
     
-    // Cleanup libcurl
+    LOG_DEBUG("[ToolWorkers] %llu command(s), %llu worker crash(es)",
+              (unsigned long long)ToolWorkerPool::instance().commands(),
+              (unsigned long long)ToolWorkerPool::instance().crashes());
+    ToolWorkerPool::instance().stop();
+    
+    // Write out anything still queued for the session store
+    sessions().set_store(nullptr, 0);
+    session_store_.close();
+    
+    LOG_DEBUG("[App] Dedup: %llu duplicates caught, %llu IDs evicted early",
+              (unsigned long long)debouncer_.duplicates(),
+              (unsigned long long)debouncer_.evictions());
+    
+    // Cleanup libcurl (pooled handles first)
+    HttpClientPool::instance().shutdown();
     curl_global_cleanup();
     
     LOG_INFO("Goodbye!");
+    Logger::instance().shutdown();
 }
 
 } // namespace opencrank
@@ -1,54 +1,109 @@
 #include <opencrank/core/application.hpp>
 #include <opencrank/core/cron.hpp>
+#include <opencrank/core/cluster.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/memory_tool.hpp>
+#include <opencrank/core/message_handler.hpp>
 #include <opencrank/core/utils.hpp>
-#include <thread>
 #include <ctime>
 
 namespace opencrank {
 
+namespace {
+
+MemoryManager* task_manager() {
+    auto* memtool = dynamic_cast<MemoryTool*>(PluginRegistry::instance().get_tool("memory"));
+    return memtool ? &memtool->manager() : nullptr;
+}
+
+// Built-in job next to the scheduled tasks (task ids are UUIDs)
+const char* MAINTENANCE_JOB = "memory-maintenance";
+
+} // namespace
+
 void Application::start_cron_thread() {
-    if (cron_thread_) return;
-    cron_thread_stop_ = false;
-    cron_thread_ = new std::thread([this] { cron_thread_func(); });
+    if (cron_.running()) return;
+    MemoryManager* manager = task_manager();
+    if (!manager) {
+        LOG_WARN("[CRON] No memory tool, scheduled tasks disabled");
+        return;
+    }
+    
+    // Creating, completing or deleting a task reschedules immediately
+    manager->set_task_listener([this]() { cron_.invalidate(); });
+    
+    cron_.start(
+        [manager]() {
+            std::vector<CronScheduler::Job> jobs;
+            std::vector<MemoryTask> tasks = manager->list_tasks(false, "");
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                if (tasks[i].cron_expr.empty() || tasks[i].completed) continue;
+                CronScheduler::Job job;
+                job.id = tasks[i].id;
+                job.expr = tasks[i].cron_expr;
+                jobs.push_back(job);
+            }
+            const MaintenanceConfig& maintenance = manager->config().maintenance;
+            if (maintenance.enabled && !maintenance.cron.empty()) {
+                CronScheduler::Job job;
+                job.id = MAINTENANCE_JOB;
+                job.expr = maintenance.cron;
+                jobs.push_back(job);
+            }
+            return jobs;
+        },
+        [this](const std::string& id, time_t when) { fire_cron_task(id, when); });
     LOG_INFO("Started CRON task thread");
 }
 
 void Application::stop_cron_thread() {
-    if (!cron_thread_) return;
-    cron_thread_stop_ = true;
-    if (cron_thread_->joinable()) cron_thread_->join();
-    delete cron_thread_;
-    cron_thread_ = nullptr;
+    if (!cron_.running()) return;
+    MemoryManager* manager = task_manager();
+    if (manager) manager->set_task_listener(std::function<void()>());
+    cron_.stop();
     LOG_INFO("Stopped CRON task thread");
 }
 
-void Application::cron_thread_func() {
-    while (!cron_thread_stop_) {
-        // Get the memory tool provider which manages tasks
-        auto* tool_plugin = registry().get_tool("memory");
-        auto* memtool = dynamic_cast<MemoryTool*>(tool_plugin);
-        if (!memtool) {
-            sleep_ms(60 * 1000); // No memory tool, wait 1 min
-            continue;
-        }
-        auto tasks = memtool->manager().list_tasks(false, "");
-        time_t now = time(nullptr);
-        std::tm tm_now;
-        localtime_r(&now, &tm_now);
-        for (auto& task : tasks) {
-            if (task.cron_expr.empty() || task.completed) continue;
-            auto sched = CronSchedule::parse(task.cron_expr);
-            if (sched.matches(tm_now)) {
-                // Fire the task: mark as completed and log
-                memtool->manager().complete_task(task.id);
-                LOG_INFO("[CRON] Fired scheduled task: %s (id=%s)", task.content.c_str(), task.id.c_str());
-                // Optionally: trigger agent action, notification, etc.
-            }
+void Application::fire_cron_task(const std::string& task_id, time_t when) {
+    MemoryManager* manager = task_manager();
+    if (!manager || !Cluster::instance().runs_cron()) return;
+    
+    if (task_id == MAINTENANCE_JOB) {
+        // Rewrites the FTS index: keep it off the scheduler thread
+        thread_pool_->enqueue(Task([manager]() {
+            MaintenanceReport report;
+            manager->run_maintenance(report);
+        }), TaskPriority::BACKGROUND);
+        return;
+    }
+    
+    MemoryTask task = manager->get_task(task_id);
+    if (task.id.empty() || task.completed) return;
+    
+    LOG_INFO("[CRON] Fired scheduled task: %s (id=%s)", task.content.c_str(), task.id.c_str());
+    
+    // Run the task as a turn in the owner's conversation, behind live traffic
+    ChannelPlugin* channel = task.channel.empty() ? nullptr : registry().get_channel(task.channel);
+    if (channel && channel->is_initialized() && !task.user_id.empty()) {
+        Message msg;
+        msg.id = "cron-" + task.id + "-" + std::to_string(static_cast<long long>(when));
+        msg.channel = task.channel;
+        msg.from = task.user_id;
+        msg.from_name = "scheduler";
+        msg.to = task.user_id;
+        msg.chat_type = "direct";
+        msg.timestamp = when;
+        msg.text = "[Scheduled task] " + task.content;
+        if (!task.context.empty()) msg.text += "\n\n" + task.context;
+        std::string session_key = sessions().session_key_for_message(msg);
+        if (!Cluster::instance().route(session_key, msg)) {
+            session_executor().submit(session_key, msg, TaskPriority::BACKGROUND);
         }
-        sleep_ms(60 * 1000); // Check every minute
+        return;
     }
+    
+    // No conversation to run it in: surface it on every channel
+    broadcast_notification("Scheduled task: " + task.content, "info", "\xe2\x8f\xb0");  // ⏰
 }
 
 } // namespace opencrank
@@ -0,0 +1,388 @@
+/*
+ * OpenCrank C++ - Asynchronous HTTP Implementation
+ */
+#include <opencrank/core/async_http.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/trace.hpp>
+#include <sstream>
+#include <memory>
+
+namespace opencrank {
+
+struct AsyncHttp::Transfer {
+    AsyncHttpRequest request;
+    AsyncHttpCallback done;
+    CURL* curl;
+    struct curl_slist* header_list;
+    std::string body;
+    std::map<std::string, std::string> headers;
+    bool aborted;               // on_data asked to stop
+    TraceContext trace;         // Span parent, captured at submit()
+    int64_t start_us;
+    int64_t start_after_ms;     // request.delay_ms as a deadline (0 = now)
+
+    Transfer() : curl(nullptr), header_list(nullptr), aborted(false), start_us(0), start_after_ms(0) {}
+};
+
+AsyncHttp& AsyncHttp::instance() {
+    static AsyncHttp async_http;
+    return async_http;
+}
+
+AsyncHttp::AsyncHttp() : multi_(nullptr), running_(false), cancel_pending_(false), in_flight_(0), completed_(0) {}
+
+AsyncHttp::~AsyncHttp() {
+    stop();
+}
+
+bool AsyncHttp::start() {
+    if (running_.load()) return true;
+    multi_ = curl_multi_init();
+    if (!multi_) {
+        LOG_WARN("[AsyncHttp] curl_multi_init failed, model calls stay synchronous");
+        return false;
+    }
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    running_ = true;
+    thread_ = std::thread(&AsyncHttp::loop, this);
+    LOG_DEBUG("[AsyncHttp] Event loop started");
+    return true;
+}
+
+void AsyncHttp::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) return;
+        curl_multi_wakeup(multi_);
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    // Submitted while the loop was winding down
+    std::vector<Transfer*> left;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        left.swap(incoming_);
+    }
+    for (size_t i = 0; i < left.size(); ++i) {
+        finish(left[i], CURLE_ABORTED_BY_CALLBACK);
+    }
+    curl_multi_cleanup(multi_);
+    multi_ = nullptr;
+    LOG_DEBUG("[AsyncHttp] Event loop stopped (%llu transfers)", static_cast<unsigned long long>(completed_.load()));
+}
+
+bool AsyncHttp::submit(AsyncHttpRequest request, const AsyncHttpCallback& done) {
+    std::unique_ptr<Transfer> transfer(new Transfer());
+    transfer->request = std::move(request);
+    transfer->done = done;
+    transfer->trace = TraceContext::current();
+    if (transfer->trace.active()) {
+        transfer->start_us = transfer->trace.trace->now_us();
+    }
+    if (transfer->request.delay_ms > 0) {
+        transfer->start_after_ms = current_timestamp_ms() + transfer->request.delay_ms;
+    }
+    // Under the lock: stop() must not clean up multi_ under the wakeup
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.load()) return false;
+    incoming_.push_back(transfer.release());
+    in_flight_.fetch_add(1);
+    curl_multi_wakeup(multi_);
+    return true;
+}
+
+void AsyncHttp::wake_cancelled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.load()) return;
+    cancel_pending_.store(true);
+    curl_multi_wakeup(multi_);
+}
+
+size_t AsyncHttp::write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t total = size * nmemb;
+    Transfer* transfer = static_cast<Transfer*>(userdata);
+    transfer->body.append(ptr, total);
+
+    if (transfer->request.on_data) {
+        // Error bodies are left for the caller to parse as a whole
+        long status = 0;
+        curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &status);
+        if (status >= 200 && status < 300 && !transfer->request.on_data(ptr, total)) {
+            transfer->aborted = true;
+            return 0;  // Makes curl stop with CURLE_WRITE_ERROR
+        }
+    }
+    return total;
+}
+
+size_t AsyncHttp::header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
+    size_t total = size * nitems;
+    std::map<std::string, std::string>* headers = static_cast<std::map<std::string, std::string>*>(userdata);
+    std::string line(buffer, total);
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+        line.pop_back();
+    }
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        (*headers)[line.substr(0, colon)] = start == std::string::npos ? std::string() : line.substr(start);
+    }
+    return total;
+}
+
+int AsyncHttp::progress_callback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    // Non-zero makes curl stop with CURLE_ABORTED_BY_CALLBACK
+    return static_cast<const std::atomic<bool>*>(userdata)->load() ? 1 : 0;
+}
+
+void AsyncHttp::add(Transfer* transfer) {
+    const AsyncHttpRequest& request = transfer->request;
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        finish(transfer, CURLE_FAILED_INIT);
+        return;
+    }
+    transfer->curl = curl;
+    LOG_DEBUG("▶ OUT %s %s (body: %zu bytes, async)", request.method.c_str(), request.url.c_str(),
+              request.body.size());
+
+    curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, request.timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, request.timeout_ms / 2);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    HttpClientPool& pool = HttpClientPool::instance();
+    CURLSH* share = pool.share();
+    if (share) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    }
+    if (pool.http2()) {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        if (request.url.compare(0, 8, "https://") == 0) {
+            // Wait to multiplex rather than open another connection. Plain
+            // HTTP stays on 1.1, where waiting would serialize the requests.
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        }
+    }
+    if (pool.decompress()) {
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    }
+
+    if (request.method == "POST") {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.body.size()));
+    } else if (request.method != "GET") {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, request.method.c_str());
+        if (!request.body.empty()) {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.body.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.body.size()));
+        }
+    }
+
+    for (std::map<std::string, std::string>::const_iterator it = request.headers.begin();
+         it != request.headers.end(); ++it) {
+        transfer->header_list = curl_slist_append(transfer->header_list, (it->first + ": " + it->second).c_str());
+    }
+    if (transfer->header_list) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->header_list);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer->headers);
+    if (request.cancel) {
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(request.cancel));
+    }
+
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+
+    active_.insert(transfer);
+    CURLMcode code = curl_multi_add_handle(multi_, curl);
+    if (code != CURLM_OK) {
+        LOG_WARN("[AsyncHttp] curl_multi_add_handle failed: %s", curl_multi_strerror(code));
+        finish(transfer, CURLE_FAILED_INIT);
+    }
+}
+
+int64_t AsyncHttp::start_delayed() {
+    int64_t now = current_timestamp_ms();
+    std::multimap<int64_t, Transfer*>::iterator it = delayed_.begin();
+    while (it != delayed_.end()) {
+        Transfer* transfer = it->second;
+        if (it->first <= now) {
+            delayed_.erase(it++);
+            add(transfer);
+        } else if (transfer->request.cancel && transfer->request.cancel->load()) {
+            delayed_.erase(it++);
+            finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+        } else {
+            ++it;
+        }
+    }
+    return delayed_.empty() ? -1 : delayed_.begin()->first - now;
+}
+
+void AsyncHttp::fail_cancelled() {
+    std::vector<Transfer*> cancelled;
+    for (std::set<Transfer*>::iterator it = active_.begin(); it != active_.end(); ++it) {
+        if ((*it)->request.cancel && (*it)->request.cancel->load()) {
+            cancelled.push_back(*it);
+        }
+    }
+    for (size_t i = 0; i < cancelled.size(); ++i) {
+        finish(cancelled[i], CURLE_ABORTED_BY_CALLBACK);
+    }
+}
+
+void AsyncHttp::finish(Transfer* transfer, CURLcode code) {
+    const AsyncHttpRequest& request = transfer->request;
+    HttpResponse resp;
+
+    if (code == CURLE_WRITE_ERROR && transfer->aborted) {
+        // Stream consumer stopped early on purpose; keep what we have
+        code = CURLE_OK;
+    }
+    if (code != CURLE_OK) {
+        resp.error = code == CURLE_ABORTED_BY_CALLBACK ? "Request cancelled"
+                   : code == CURLE_FAILED_INIT ? "CURL not initialized" : curl_easy_strerror(code);
+        long request_bytes = 0;
+        if (transfer->curl) curl_easy_getinfo(transfer->curl, CURLINFO_REQUEST_SIZE, &request_bytes);
+        resp.sent = request_bytes > 0;
+        LOG_DEBUG("◀ IN  %s %s FAILED: %s", request.method.c_str(), request.url.c_str(), resp.error.c_str());
+    } else {
+        curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &resp.status_code);
+        resp.sent = true;
+        resp.body.swap(transfer->body);
+        sanitize_utf8_in_place(resp.body);
+        resp.headers.swap(transfer->headers);
+        LOG_DEBUG("◀ IN  %s %s -> HTTP %ld (%zu bytes, async)", request.method.c_str(), request.url.c_str(),
+                  resp.status_code, resp.body.size());
+        if (!resp.ok()) {
+            std::ostringstream oss;
+            oss << "HTTP " << resp.status_code;
+            if (!resp.body.empty()) {
+                oss << ": " << (resp.body.size() > 512 ? resp.body.substr(0, 512) + "..." : resp.body);
+            }
+            resp.error = oss.str();
+        }
+    }
+
+    // The span the synchronous client would have opened on the caller's thread
+    if (transfer->trace.active()) {
+        Trace& trace = *transfer->trace.trace;
+        TraceSpan span;
+        char* host = nullptr;
+        CURLU* url = curl_url();
+        if (url && curl_url_set(url, CURLUPART_URL, request.url.c_str(), 0) == CURLUE_OK) {
+            curl_url_get(url, CURLUPART_HOST, &host, 0);
+        }
+        span.name = request.method + " " + (host ? host : request.url.c_str());
+        curl_free(host);
+        curl_url_cleanup(url);
+        span.category = "http";
+        span.id = trace.next_span_id();
+        span.parent = transfer->trace.parent;
+        span.thread = trace.thread_number();
+        span.start_us = transfer->start_us;
+        span.duration_us = trace.now_us() - transfer->start_us;
+        span.attrs["status"] = resp.status_code;
+        span.attrs["request_bytes"] = request.body.size();
+        span.attrs["response_bytes"] = resp.body.size();
+        span.attrs["streamed"] = static_cast<bool>(request.on_data);
+        span.attrs["async"] = true;
+        if (!resp.error.empty() && resp.status_code == 0) span.attrs["error"] = resp.error;
+        trace.add(span);
+    }
+
+    active_.erase(transfer);
+    if (transfer->curl) {
+        curl_multi_remove_handle(multi_, transfer->curl);
+        curl_easy_cleanup(transfer->curl);
+    }
+    if (transfer->header_list) {
+        curl_slist_free_all(transfer->header_list);
+    }
+
+    try {
+        transfer->done(resp);
+    } catch (const std::exception& e) {
+        LOG_ERROR("[AsyncHttp] Completion callback threw: %s", e.what());
+    } catch (...) {
+        LOG_ERROR("[AsyncHttp] Completion callback threw an unknown exception");
+    }
+    delete transfer;
+    in_flight_.fetch_sub(1);
+    completed_.fetch_add(1);
+}
+
+void AsyncHttp::loop() {
+    while (running_.load()) {
+        std::vector<Transfer*> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch.swap(incoming_);
+        }
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i]->start_after_ms > 0) {
+                delayed_.insert(std::make_pair(batch[i]->start_after_ms, batch[i]));
+            } else {
+                add(batch[i]);
+            }
+        }
+        int64_t next_start_ms = start_delayed();
+        if (cancel_pending_.exchange(false)) {
+            fail_cancelled();
+        }
+
+        int still_running = 0;
+        curl_multi_perform(multi_, &still_running);
+
+        CURLMsg* msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi_, &queued)) != nullptr) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Transfer* transfer = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+            if (transfer) {
+                finish(transfer, msg->data.result);
+            }
+        }
+
+        // Sleeps until a socket is ready, a curl timeout or delayed start
+        // is due or submit() wakes it; the 1s cap lets progress callbacks
+        // (and delayed transfers) see cancellations
+        int timeout_ms = next_start_ms >= 0 && next_start_ms < 1000 ? static_cast<int>(next_start_ms) : 1000;
+        curl_multi_poll(multi_, nullptr, 0, timeout_ms, nullptr);
+    }
+
+    // Fail what is left so every callback runs exactly once
+    std::vector<Transfer*> left;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        left.swap(incoming_);
+    }
+    for (size_t i = 0; i < left.size(); ++i) {
+        finish(left[i], CURLE_ABORTED_BY_CALLBACK);
+    }
+    while (!delayed_.empty()) {
+        Transfer* transfer = delayed_.begin()->second;
+        delayed_.erase(delayed_.begin());
+        finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+    }
+    while (!active_.empty()) {
+        finish(*active_.begin(), CURLE_ABORTED_BY_CALLBACK);
+    }
+}
+
+} // namespace opencrank
@@ -0,0 +1,355 @@
+/*
+ * OpenCrank C++ - Offline Batch Mode Implementation
+ */
+#include <opencrank/core/batch_runner.hpp>
+#include <opencrank/core/agent.hpp>
+#include <opencrank/core/async_http.hpp>
+#include <opencrank/core/cancel_token.hpp>
+#include <opencrank/core/json.hpp>
+#include <opencrank/core/process_runner.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/tool_workers.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/ai/fair_share.hpp>
+#include <algorithm>
+#include <fstream>
+
+namespace opencrank {
+
+namespace {
+
+int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+} // anonymous namespace
+
+// One input item on its way through the agent, turn after turn
+struct BatchRunner::Conversation {
+    const Item* item;
+    Agent* agent;
+    AIPlugin* ai;
+    ThreadPool* pool;
+    std::string system_prompt;
+    AgentConfig config;
+    std::vector<ConversationMessage> history;
+    size_t turn;
+    int64_t started_ms;
+
+    // Summed over the turns
+    Json turns;
+    int iterations;
+    int tool_calls;
+    int64_t prompt_tokens;
+    int64_t cached_tokens;
+    int64_t completion_tokens;
+    int64_t model_ms;
+    int64_t tool_ms;
+
+    std::string status;         // "ok", "error", "paused" or "cancelled"
+    std::string response;
+    std::string error;
+
+    Conversation()
+        : item(NULL), agent(NULL), ai(NULL), pool(NULL), turn(0), started_ms(0)
+        , turns(Json::array()), iterations(0), tool_calls(0), prompt_tokens(0)
+        , cached_tokens(0), completion_tokens(0), model_ms(0), tool_ms(0) {}
+};
+
+BatchRunner::BatchRunner(const Options& options)
+    : options_(options)
+    , out_(NULL)
+    , stopping_(false)
+    , ok_(0)
+    , failed_(0)
+    , prompt_tokens_(0)
+    , cached_tokens_(0)
+    , completion_tokens_(0)
+{
+    if (options_.output.empty()) {
+        options_.output = options_.input + ".results.jsonl";
+    }
+    if (options_.concurrency < 1) {
+        options_.concurrency = 1;
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    if (out_) {
+        fclose(out_);
+    }
+}
+
+bool BatchRunner::open(std::string& error) {
+    std::ifstream in(options_.input.c_str());
+    if (!in) {
+        error = "cannot read " + options_.input;
+        return false;
+    }
+
+    std::set<std::string> ids;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        Json j;
+        try {
+            j = Json::parse(line);
+        } catch (const std::exception& e) {
+            error = options_.input + ":" + std::to_string(line_no) + ": " + e.what();
+            return false;
+        }
+
+        Item item;
+        if (j.is_string()) {
+            item.turns.push_back(j.get<std::string>());
+        } else if (j.is_object()) {
+            if (j.contains("id") && j["id"].is_number_integer()) {
+                item.id = std::to_string(j["id"].get<int64_t>());
+            } else {
+                item.id = json_utils::get_string(j, "id");
+            }
+            item.system = json_utils::get_string(j, "system");
+            if (j.contains("turns") && j["turns"].is_array()) {
+                for (Json::const_iterator it = j["turns"].begin(); it != j["turns"].end(); ++it) {
+                    if (it->is_string()) item.turns.push_back(it->get<std::string>());
+                }
+            } else if (j.contains("prompt") && j["prompt"].is_string()) {
+                item.turns.push_back(j["prompt"].get<std::string>());
+            }
+        }
+        if (item.turns.empty()) {
+            error = options_.input + ":" + std::to_string(line_no) + ": no \"prompt\" or \"turns\"";
+            return false;
+        }
+        if (item.id.empty()) {
+            item.id = "line-" + std::to_string(line_no);
+        }
+        if (!ids.insert(item.id).second) {
+            error = options_.input + ":" + std::to_string(line_no) + ": duplicate id " + item.id;
+            return false;
+        }
+        items_.push_back(item);
+    }
+
+    // Finished items of an earlier run; failed ones are tried again
+    std::ifstream prev(options_.output.c_str());
+    while (std::getline(prev, line)) {
+        Json j;
+        try {
+            j = Json::parse(line);
+        } catch (const std::exception&) {
+            continue;   // Torn last line of an interrupted run
+        }
+        std::string status = json_utils::get_string(j, "status");
+        if (status == "ok" || status == "paused") {
+            done_.insert(json_utils::get_string(j, "id"));
+        }
+    }
+
+    out_ = fopen(options_.output.c_str(), "a");
+    if (!out_) {
+        error = "cannot write " + options_.output;
+        return false;
+    }
+    return true;
+}
+
+int BatchRunner::run(Agent& agent, AIPlugin* ai, ThreadPool* pool, const std::string& system_prompt) {
+    size_t pending = 0;
+    for (size_t i = 0; i < items_.size(); ++i) {
+        if (!done_.count(items_[i].id)) ++pending;
+    }
+    LOG_INFO("[Batch] %zu item(s) in %s, %zu already in %s, running %zu with concurrency %d",
+             items_.size(), options_.input.c_str(), items_.size() - pending,
+             options_.output.c_str(), pending, options_.concurrency);
+
+    int64_t started = steady_ms();
+    for (size_t i = 0; i < items_.size(); ++i) {
+        const Item& item = items_[i];
+        if (done_.count(item.id)) continue;
+
+        Conversation* conv = new Conversation();
+        conv->item = &item;
+        conv->agent = &agent;
+        conv->ai = ai;
+        conv->pool = pool;
+        conv->system_prompt = item.system.empty() ? system_prompt : item.system;
+        conv->config = agent.config();
+        conv->config.session_key = "batch:" + item.id;
+        conv->config.user_key = conv->config.session_key;
+        conv->config.cancel_key = conv->config.session_key;
+        conv->config.cancel = std::make_shared<CancelToken>();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() {
+                return stopping_.load() || running_.size() < static_cast<size_t>(options_.concurrency);
+            });
+            if (stopping_.load()) {
+                delete conv;
+                break;
+            }
+            running_.insert(conv);
+        }
+        conv->started_ms = steady_ms();
+        pool->enqueue(Task([this, conv]() { next_turn(conv); }), TaskPriority::AGENT);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return running_.empty(); });
+    }
+
+    int64_t wall_ms = steady_ms() - started;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int64_t> sorted(durations_ms_);
+    std::sort(sorted.begin(), sorted.end());
+    size_t finished = ok_ + failed_;
+    size_t left = pending - finished;
+    LOG_INFO("[Batch] Done: %zu ok, %zu failed, %zu skipped, %zu not run; %.1fs wall, %.2f items/s",
+             ok_, failed_, items_.size() - pending, left, wall_ms / 1000.0,
+             wall_ms > 0 ? finished * 1000.0 / wall_ms : 0.0);
+    LOG_INFO("[Batch] Latency p50 %lld ms, p95 %lld ms, max %lld ms; tokens %lld prompt (%lld cached), %lld completion",
+             static_cast<long long>(percentile(sorted, 0.50)),
+             static_cast<long long>(percentile(sorted, 0.95)),
+             static_cast<long long>(sorted.empty() ? 0 : sorted.back()),
+             static_cast<long long>(prompt_tokens_), static_cast<long long>(cached_tokens_),
+             static_cast<long long>(completion_tokens_));
+    if (left > 0) {
+        LOG_INFO("[Batch] Stopped early; run the same command again to resume");
+    }
+    return (failed_ == 0 && left == 0) ? 0 : 1;
+}
+
+void BatchRunner::next_turn(Conversation* conv) {
+    int64_t turn_started = steady_ms();
+    conv->agent->run_async(
+        conv->ai,
+        conv->item->turns[conv->turn],
+        conv->history,
+        conv->system_prompt,
+        conv->config,
+        [this, conv, turn_started](AgentResult& result) {
+            int64_t duration = steady_ms() - turn_started;
+            conv->iterations += result.iterations;
+            conv->tool_calls += result.tool_calls_made;
+            conv->prompt_tokens += result.prompt_tokens;
+            conv->cached_tokens += result.cached_prompt_tokens;
+            conv->completion_tokens += result.completion_tokens;
+            conv->model_ms += result.model_ms;
+            conv->tool_ms += result.tool_ms;
+
+            Json turn;
+            turn["duration_ms"] = duration;
+            turn["iterations"] = result.iterations;
+            turn["tool_calls"] = result.tool_calls_made;
+            turn["model_ms"] = result.model_ms;
+            turn["tool_ms"] = result.tool_ms;
+            turn["prompt_tokens"] = result.prompt_tokens;
+            turn["cached_prompt_tokens"] = result.cached_prompt_tokens;
+            turn["completion_tokens"] = result.completion_tokens;
+            if (!result.trace_id.empty()) turn["trace_id"] = result.trace_id;
+            conv->turns.push_back(turn);
+            conv->turn++;
+
+            if (result.cancelled) {
+                conv->status = "cancelled";
+            } else if (result.paused) {
+                conv->status = "paused";
+                conv->response = result.pause_message;
+            } else if (!result.success) {
+                conv->status = "error";
+                conv->error = result.error;
+            } else {
+                conv->status = "ok";
+                conv->response = result.final_response;
+                if (conv->turn < conv->item->turns.size() && !stopping_.load()) {
+                    conv->pool->enqueue(Task([this, conv]() { next_turn(conv); }), TaskPriority::AGENT);
+                    return;
+                }
+                if (conv->turn < conv->item->turns.size()) {
+                    conv->status = "cancelled";
+                }
+            }
+            finish(conv);
+        });
+}
+
+void BatchRunner::finish(Conversation* conv) {
+    int64_t duration = steady_ms() - conv->started_ms;
+    const std::string& id = conv->item->id;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (conv->status != "cancelled") {
+        Json record;
+        record["id"] = id;
+        record["status"] = conv->status;
+        record["response"] = conv->response;
+        if (!conv->error.empty()) record["error"] = conv->error;
+        record["duration_ms"] = duration;
+        record["iterations"] = conv->iterations;
+        record["tool_calls"] = conv->tool_calls;
+        record["model_ms"] = conv->model_ms;
+        record["tool_ms"] = conv->tool_ms;
+        Json usage;
+        usage["prompt_tokens"] = conv->prompt_tokens;
+        usage["cached_prompt_tokens"] = conv->cached_tokens;
+        usage["completion_tokens"] = conv->completion_tokens;
+        record["usage"] = usage;
+        if (conv->item->turns.size() > 1) record["turns"] = conv->turns;
+
+        std::string line = record.dump(-1, ' ', false, Json::error_handler_t::replace);
+        line += '\n';
+        fwrite(line.data(), 1, line.size(), out_);
+        fflush(out_);   // The output is the checkpoint
+
+        if (conv->status == "ok") {
+            ++ok_;
+        } else {
+            ++failed_;
+        }
+        prompt_tokens_ += conv->prompt_tokens;
+        cached_tokens_ += conv->cached_tokens;
+        completion_tokens_ += conv->completion_tokens;
+        durations_ms_.push_back(duration);
+        LOG_INFO("[Batch] %s %s in %lld ms (%d iterations, %d tool calls)",
+                 id.c_str(), conv->status.c_str(), static_cast<long long>(duration),
+                 conv->iterations, conv->tool_calls);
+    } else {
+        LOG_INFO("[Batch] %s cancelled, left for the next run", id.c_str());
+    }
+
+    running_.erase(conv);
+    delete conv;
+    cv_.notify_all();
+}
+
+void BatchRunner::stop() {
+    std::vector<std::string> keys;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_.exchange(true)) return;
+        for (std::set<Conversation*>::iterator it = running_.begin(); it != running_.end(); ++it) {
+            (*it)->config.cancel->cancel();
+            keys.push_back((*it)->config.cancel_key);
+        }
+        cv_.notify_all();
+    }
+    if (keys.empty()) return;
+
+    LOG_INFO("[Batch] Stopping %zu running item(s)", keys.size());
+    AsyncHttp::instance().wake_cancelled();
+    FairShareScheduler::instance().wake_cancelled();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ProcessRunner::cancel(keys[i]);
+        ToolWorkerPool::instance().cancel(keys[i]);
+    }
+}
+
+} // namespace opencrank
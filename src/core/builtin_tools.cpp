@@ -8,24 +8,26 @@
 #include <opencrank/core/config.hpp>
 #include <opencrank/core/sandbox.hpp>
 #include <opencrank/core/message_handler.hpp>
+#include <opencrank/core/process_runner.hpp>
+#include <opencrank/core/tool_workers.hpp>
+#include <opencrank/core/file_reader.hpp>
+#include <opencrank/core/file_search.hpp>
+#include <opencrank/core/content_chunker.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/tool_select.hpp>
 
-#include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
+#include <csignal>
+#include <cerrno>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <dirent.h>
-
-#ifdef _WIN32
-#include <windows.h>
-#define popen _popen
-#define pclose _pclose
-#else
 #include <unistd.h>
-#include <sys/wait.h>
-#endif
 
 namespace opencrank {
 
@@ -74,6 +76,34 @@ bool is_within_workspace(const std::string& path, const std::string& workspace)
 }
 
 } // namespace path
+
+namespace param {
+
+// Tool arguments arrive as JSON numbers, booleans, or their string forms
+size_t get_size(const Json& params, const char* key, size_t def) {
+    if (!params.contains(key)) return def;
+    const Json& val = params[key];
+    if (val.is_number()) return static_cast<size_t>(std::max<int64_t>(0, json_utils::as_int(val)));
+    if (val.is_string()) {
+        try {
+            return static_cast<size_t>(std::max(0, std::stoi(val.get<std::string>())));
+        } catch (...) {}
+    }
+    return def;
+}
+
+bool get_flag(const Json& params, const char* key, bool def) {
+    if (!params.contains(key)) return def;
+    const Json& val = params[key];
+    if (val.is_boolean()) return val.get<bool>();
+    if (val.is_string()) {
+        std::string s = val.get<std::string>();
+        return s == "true" || s == "1" || s == "yes";
+    }
+    return def;
+}
+
+} // namespace param
 } // namespace builtin_tools
 
 // ============================================================================
@@ -83,6 +113,9 @@ bool is_within_workspace(const std::string& path, const std::string& workspace)
 BuiltinToolsProvider::BuiltinToolsProvider()
     : workspace_dir_(".")
     , shell_timeout_(20)
+    , shell_cpu_limit_(20)
+    , shell_memory_bytes_(0)
+    , shell_max_output_(1024 * 1024)
     , chunker_(nullptr) {}
 
 BuiltinToolsProvider::~BuiltinToolsProvider() {
@@ -92,9 +125,13 @@ BuiltinToolsProvider::~BuiltinToolsProvider() {
 bool BuiltinToolsProvider::init(const Config& cfg) {
     workspace_dir_ = cfg.get_string("workspace_dir", ".");
     shell_timeout_ = static_cast<int>(cfg.get_int("agent.shell_timeout", 20));
+    shell_cpu_limit_ = static_cast<int>(cfg.get_int("agent.shell_cpu_limit", shell_timeout_));
+    shell_memory_bytes_ = static_cast<size_t>(cfg.get_int("agent.shell_memory_mb", 0)) * 1024 * 1024;
+    shell_max_output_ = static_cast<size_t>(cfg.get_int("agent.shell_max_output_kb", 1024)) * 1024;
     
-    LOG_INFO("Builtin tools initialized (workspace=%s, shell_timeout=%ds)",
-             workspace_dir_.c_str(), shell_timeout_);
+    LOG_INFO("Builtin tools initialized (workspace=%s, shell_timeout=%ds, cpu=%ds, memory=%zuMB)",
+             workspace_dir_.c_str(), shell_timeout_, shell_cpu_limit_,
+             shell_memory_bytes_ / (1024 * 1024));
     
     initialized_ = true;
     return true;
@@ -110,6 +147,7 @@ std::vector<std::string> BuiltinToolsProvider::actions() const {
     acts.push_back("write");
     acts.push_back("shell");
     acts.push_back("list_dir");
+    acts.push_back("search_files");
     acts.push_back("content_chunk");
     acts.push_back("content_search");
     acts.push_back("notify_user");
@@ -127,6 +165,8 @@ ToolResult BuiltinToolsProvider::execute(const std::string& action, const Json&
         result = do_shell(params);
     } else if (action == "list_dir") {
         result = do_list_dir(params);
+    } else if (action == "search_files") {
+        result = do_search_files(params);
     } else if (action == "content_chunk") {
         result = do_content_chunk(params);
     } else if (action == "content_search") {
@@ -153,13 +193,29 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "read";
+        tool.parallel_safe = true;
+        tool.memo_store = "files";
+        tool.path_param = "path";
         tool.description = "Read the contents of a file. Use this to examine files, "
-                           "read documentation, or load skill instructions.";
+                           "read documentation, or load skill instructions. Large files "
+                           "can be read by line or byte range.";
         tool.params.push_back(ToolParamSchema(
             "path", "string", 
             "Path to the file to read (relative to workspace)", 
             true
         ));
+        tool.params.push_back(ToolParamSchema(
+            "start_line", "number", "First line to read (1-based, optional)", false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "end_line", "number", "Last line to read, inclusive (optional)", false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "offset", "number", "Byte offset to start reading at (optional)", false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "length", "number", "Number of bytes to read from offset (optional)", false
+        ));
         
         tool.execute = [self](const Json& params) -> AgentToolResult {
             return self->do_read(params);
@@ -172,6 +228,8 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "write";
+        tool.writes_store = "files";
+        tool.path_param = "path";
         tool.description = "Write content to a file. Creates the file if it doesn't exist, "
                            "overwrites if it does.";
         tool.params.push_back(ToolParamSchema(
@@ -208,6 +266,26 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
             "Working directory (optional)", 
             false
         ));
+        tool.params.push_back(ToolParamSchema(
+            "grep", "string",
+            "Return only the output lines matching this regex (optional)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "invert", "boolean",
+            "With grep, return the lines that do NOT match (optional)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "head", "number",
+            "Return only the first N output lines, after grep (optional)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "tail", "number",
+            "Return only the last N output lines, after grep; with head, both ends (optional)",
+            false
+        ));
         
         tool.execute = [self](const Json& params) -> AgentToolResult {
             return self->do_shell(params);
@@ -220,6 +298,9 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "list_dir";
+        tool.parallel_safe = true;
+        tool.memo_store = "files";
+        tool.path_param = "path";
         tool.description = "List the contents of a directory.";
         tool.params.push_back(ToolParamSchema(
             "path", "string", 
@@ -234,10 +315,65 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
         tools.push_back(tool);
     }
     
+    // search_files - Grep/find across the workspace
+    {
+        AgentTool tool;
+        tool.name = "search_files";
+        tool.parallel_safe = true;
+        tool.memo_store = "files";
+        tool.path_param = "path";
+        tool.description = "Search file contents across the workspace (like grep -rn) and/or find files by name. "
+                           "Returns matching lines as file:line with the best matching files first. "
+                           "Prefer this over running grep or find through shell, or reading files one by one. "
+                           "Hidden directories, node_modules and binary files are skipped.";
+        tool.params.push_back(ToolParamSchema(
+            "pattern", "string",
+            "Text to search for. Omit to just list files matching 'glob'.",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "path", "string",
+            "Directory or file to search (relative to workspace, default: whole workspace)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "glob", "string",
+            "Only files whose name matches, e.g. '*.cpp' (or whose path matches, if it contains '/')",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "regex", "boolean",
+            "Treat pattern as a regex (default: false)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "ignore_case", "boolean",
+            "Case-insensitive matching (default: false)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "context", "number",
+            "Lines of context around each match (default: 0, max: 5)",
+            false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "max_results", "number",
+            "Maximum matching lines to return (default: 50, max: 200)",
+            false
+        ));
+        
+        tool.execute = [self](const Json& params) -> AgentToolResult {
+            return self->do_search_files(params);
+        };
+        
+        tools.push_back(tool);
+    }
+    
     // content_chunk - Retrieve chunks of large content
     {
         AgentTool tool;
         tool.name = "content_chunk";
+        tool.writes_store = "content";
         tool.description = "This loads a part of chunk of large content that was stored in memory due to size limits. "
                            "Before using this, use 'content_search' to find which chunks contain the information you need, then load specific chunks with this tool.";
 
@@ -256,6 +392,11 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
             "Strip HTML tags except links and images (default: false)", 
             false
         ));
+        tool.params.push_back(ToolParamSchema(
+            "max_tokens", "number",
+            "Also return the following chunks while the total stays within this many tokens (default: one chunk)",
+            false
+        ));
         
         tool.execute = [self](const Json& params) -> AgentToolResult {
             return self->do_content_chunk(params);
@@ -268,6 +409,7 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "content_search";
+        tool.writes_store = "content";
         tool.description = "Search for text within large stored content. Returns chunk IDs where matches were found "
                            "along with excerpts. Use this to find which chunks contain specific information, then load those chunks. "
                            "Supports regex patterns for advanced searches. If 'id' is omitted, searches across ALL stored chunks.";
@@ -303,6 +445,7 @@ std::vector<AgentTool> BuiltinToolsProvider::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "notify_user";
+        tool.writes_store = "messages";
         tool.description = "Send a notification to the user about what you are about to do, "
                            "your current status, or important information. Use this SPARINGLY - only for "
                            "significant actions like starting a complex task, reporting critical findings, "
@@ -352,24 +495,37 @@ AgentToolResult BuiltinToolsProvider::do_read(const Json& params) const {
         return AgentToolResult::fail("Path not allowed: " + file_path);
     }
     
-    std::ifstream file(full_path.c_str());
-    if (!file.is_open()) {
-        return AgentToolResult::fail("Cannot open file: " + file_path);
-    }
-    
-    std::ostringstream content;
-    content << file.rdbuf();
-    file.close();
-    
-    auto result = content.str();
-    
-    // Truncate very large files
+    // Whole files past MAX_SIZE are handed to the chunker by reference
     constexpr size_t MAX_SIZE = 50000;
-    if (result.size() > MAX_SIZE) {
-        result = result.substr(0, MAX_SIZE) + "\n\n... [truncated, file too large] ...";
+    constexpr size_t PREVIEW_SIZE = 2000;
+    bool ranged = params.contains("start_line") || params.contains("end_line") ||
+                  params.contains("offset") || params.contains("length");
+    
+    FileSlice slice;
+    std::string error;
+    if (!read_file_slice(full_path, params, MAX_SIZE, slice, error)) {
+        return AgentToolResult::fail(error + ": " + file_path);
+    }
+    
+    if (!ranged && slice.more && chunker_) {
+        const ToolCallContext* ctx = ToolCallContext::current();
+        std::string id = chunker_->store_file(full_path, "read:" + file_path, 0,
+                                              ctx ? ctx->session_key : "");
+        FileSlice preview;
+        if (!id.empty() && read_file_slice(full_path, params, PREVIEW_SIZE, preview, error)) {
+            std::ostringstream oss;
+            oss << "[File " << file_path << " is " << preview.file_size << " bytes, showing lines 1-"
+                << preview.last_line << "]\n" << preview.text;
+            if (!preview.text.empty() && preview.text[preview.text.size() - 1] != '\n') oss << "\n";
+            oss << "\n[Registered as content id=\"" << id << "\" with "
+                << chunker_->get_total_chunks(id) << " chunks. Use content_chunk to page through it, "
+                << "content_search to find text in it, or read with start_line/end_line "
+                << "or offset/length for a specific range.]";
+            return AgentToolResult::ok(oss.str());
+        }
     }
     
-    return AgentToolResult::ok(result);
+    return AgentToolResult::ok(format_slice(slice));
 }
 
 AgentToolResult BuiltinToolsProvider::do_write(const Json& params) const {
@@ -391,13 +547,25 @@ AgentToolResult BuiltinToolsProvider::do_write(const Json& params) const {
     LOG_DEBUG("[write tool] Writing file: %s (%zu bytes)", 
               full_path.c_str(), content.size());
     
-    std::ofstream file(full_path.c_str());
-    if (!file.is_open()) {
+    // Resolved beneath the sandbox root in the same syscall that opens it
+    int fd = Sandbox::instance().open_beneath(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
         return AgentToolResult::fail("Cannot open file for writing: " + file_path);
     }
     
-    file << content;
-    file.close();
+    const char* data = content.data();
+    size_t left = content.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, data, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ::close(fd);
+            return AgentToolResult::fail("Write failed for " + file_path + ": " + strerror(errno));
+        }
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    ::close(fd);
     
     return AgentToolResult::ok(
         "Successfully wrote " + std::to_string(content.size()) + " bytes to " + file_path
@@ -416,6 +584,22 @@ AgentToolResult BuiltinToolsProvider::do_shell(const Json& params) const {
         workdir = builtin_tools::path::resolve(params["workdir"].get<std::string>(), workspace_dir_);
     }
     
+    // Output filter, checked before anything runs
+    LineFilter filter;
+    if (params.contains("grep") && params["grep"].is_string()) {
+        filter.grep = params["grep"].get<std::string>();
+    }
+    filter.invert = builtin_tools::param::get_flag(params, "invert", false);
+    filter.head = builtin_tools::param::get_size(params, "head", 0);
+    filter.tail = builtin_tools::param::get_size(params, "tail", 0);
+    if (!filter.empty()) {
+        std::string unused, error;
+        size_t matches = 0;
+        if (!filter_lines(std::string(), filter, unused, matches, error)) {
+            return AgentToolResult::fail(error);
+        }
+    }
+    
     // Auto-add timeout to curl commands
     if (command.find("curl ") != std::string::npos && 
         command.find("--connect-timeout") == std::string::npos &&
@@ -452,61 +636,92 @@ AgentToolResult BuiltinToolsProvider::do_shell(const Json& params) const {
         }
     }
     
-    // Build full command
-    std::ostringstream full_cmd;
-    full_cmd << "cd \"" << workdir << "\" && ";
-    
-#ifndef _WIN32
-    if (shell_timeout_ > 0) {
-        full_cmd << "timeout " << shell_timeout_ << " ";
+    // The runner enforces the limits itself: wall clock, then CPU time and
+    // address space on the child. Output streams in as it is produced; each
+    // block tells the run the tool is alive (at most once a second).
+    ProcessLimits limits;
+    limits.timeout_s = shell_timeout_;
+    limits.cpu_s = shell_cpu_limit_;
+    limits.memory_bytes = shell_memory_bytes_;
+    limits.max_output = shell_max_output_;
+    
+    const ToolCallContext* ctx = ToolCallContext::current();
+    limits.cancel = ctx ? ctx->cancel : NULL;
+    std::string cancel_key = ctx ? ctx->cancel_key : "";
+    ProcessRunner::OutputCallback on_output;
+    if (ctx && ctx->on_progress) {
+        std::function<void()> progress = ctx->on_progress;
+        int64_t last_progress_ms = 0;
+        on_output = [progress, last_progress_ms](const char*, size_t) mutable {
+            int64_t now = current_timestamp_ms();
+            if (now - last_progress_ms >= 1000) {
+                last_progress_ms = now;
+                progress();
+            }
+        };
     }
-#endif
-    
-    full_cmd << command << " 2>&1";
     
-    // Execute
-    FILE* pipe = popen(full_cmd.str().c_str(), "r");
-    if (!pipe) {
-        return AgentToolResult::fail("Failed to execute command");
+    // Sandboxed helper processes when available, otherwise spawned from here
+    ToolWorkerPool& workers = ToolWorkerPool::instance();
+    ProcessResult proc = workers.available()
+        ? workers.run_shell(command, workdir, limits, cancel_key, on_output)
+        : ProcessRunner::run_shell(command, workdir, limits, cancel_key, on_output);
+    if (!proc.started) {
+        return AgentToolResult::fail("Failed to execute command: " + proc.error);
     }
+    // The command may have moved directories or swapped symlinks
+    sandbox.invalidate_path_cache();
     
-    std::ostringstream output;
-    char buffer[4096];
-    size_t total_read = 0;
-    constexpr size_t MAX_OUTPUT = 100000;
-    
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr && total_read < MAX_OUTPUT) {
-        output << buffer;
-        total_read += strlen(buffer);
+    std::string result;
+    if (filter.empty()) {
+        result.swap(proc.output);
+    } else {
+        std::string error;
+        size_t matches = 0;
+        filter_lines(proc.output, filter, result, matches, error);
+        if (!filter.grep.empty()) {
+            if (!result.empty()) result += '\n';
+            result += "[" + std::to_string(matches) + " line(s) " +
+                      (filter.invert ? "not matching" : "matching") + " '" + filter.grep + "']";
+        }
     }
-    
-    int status = pclose(pipe);
-    
-    auto result = output.str();
-    if (total_read >= MAX_OUTPUT) {
+    if (proc.truncated) {
         result += "\n... [output truncated] ...";
     }
     
-#ifndef _WIN32
-    int exit_code = WEXITSTATUS(status);
-#else
-    int exit_code = status;
-#endif
+    if (proc.cancelled) {
+        std::string msg = "Command was cancelled after " +
+                          std::to_string(proc.duration_ms / 1000) + " seconds.";
+        if (!result.empty()) {
+            msg += " Partial output:\n" + result;
+        }
+        return AgentToolResult::ok(msg);
+    }
     
-    if (exit_code != 0) {
+    if (proc.timed_out || proc.term_signal == SIGXCPU) {
         std::ostringstream err;
-        if (exit_code == 124) {
-            // Timeout
+        if (proc.timed_out) {
             err << "Command timed out after " << shell_timeout_ << " seconds.";
-            if (!result.empty()) {
-                err << " Partial output:\n" << result;
-            }
-            err << "\nTry an alternative approach or different service.";
         } else {
-            err << "Command exited with code " << exit_code;
-            if (!result.empty()) {
-                err << ":\n" << result;
-            }
+            err << "Command exceeded its CPU limit of " << shell_cpu_limit_ << " seconds.";
+        }
+        if (!result.empty()) {
+            err << " Partial output:\n" << result;
+        }
+        err << "\nTry an alternative approach or different service.";
+        return AgentToolResult::ok(err.str());
+    }
+    
+    if (proc.exit_code != 0) {
+        std::ostringstream err;
+        if (proc.term_signal != 0) {
+            err << "Command killed by signal " << proc.term_signal
+                << " (" << strsignal(proc.term_signal) << ")";
+        } else {
+            err << "Command exited with code " << proc.exit_code;
+        }
+        if (!result.empty()) {
+            err << ":\n" << result;
         }
         // Return as success so AI can see output and retry
         return AgentToolResult::ok(err.str());
@@ -531,8 +746,10 @@ AgentToolResult BuiltinToolsProvider::do_list_dir(const Json& params) const {
         return AgentToolResult::fail("Path not allowed: " + dir_path);
     }
     
-    DIR* dir = opendir(full_path.c_str());
+    int dir_fd = Sandbox::instance().open_beneath(full_path, O_RDONLY | O_DIRECTORY);
+    DIR* dir = dir_fd >= 0 ? fdopendir(dir_fd) : nullptr;
     if (!dir) {
+        if (dir_fd >= 0) ::close(dir_fd);
         return AgentToolResult::fail("Cannot open directory: " + dir_path);
     }
     
@@ -561,6 +778,43 @@ AgentToolResult BuiltinToolsProvider::do_list_dir(const Json& params) const {
     return AgentToolResult::ok(result.str());
 }
 
+AgentToolResult BuiltinToolsProvider::do_search_files(const Json& params) const {
+    std::string dir_path = ".";
+    if (params.contains("path") && params["path"].is_string()) {
+        dir_path = params["path"].get<std::string>();
+    }
+    
+    auto full_path = builtin_tools::path::resolve(dir_path, workspace_dir_);
+    
+    if (!builtin_tools::path::is_within_workspace(full_path, workspace_dir_)) {
+        return AgentToolResult::fail("Path not allowed: " + dir_path);
+    }
+    
+    FileSearchOptions options;
+    if (params.contains("pattern") && params["pattern"].is_string()) {
+        options.pattern = params["pattern"].get<std::string>();
+    }
+    if (params.contains("glob") && params["glob"].is_string()) {
+        options.glob = params["glob"].get<std::string>();
+    }
+    options.regex = builtin_tools::param::get_flag(params, "regex", false);
+    options.ignore_case = builtin_tools::param::get_flag(params, "ignore_case", false);
+    options.context_lines = std::min<size_t>(builtin_tools::param::get_size(params, "context", 0), 5);
+    options.max_results = std::min<size_t>(builtin_tools::param::get_size(params, "max_results", 50), 200);
+    if (options.max_results == 0) options.max_results = 50;
+    options.timeout_ms = shell_timeout_ > 0 ? shell_timeout_ * 1000 : 0;
+    
+    LOG_DEBUG("[search_files tool] '%s' in %s (glob=%s, regex=%s)",
+              options.pattern.c_str(), full_path.c_str(), options.glob.c_str(),
+              options.regex ? "true" : "false");
+    
+    FileSearchResult result;
+    if (!search_files(full_path, options, result)) {
+        return AgentToolResult::fail(result.error);
+    }
+    return AgentToolResult::ok(format_search(result, options));
+}
+
 AgentToolResult BuiltinToolsProvider::do_content_chunk(const Json& params) const {
     if (!chunker_) {
         return AgentToolResult::fail("Content chunker not available");
@@ -595,8 +849,10 @@ AgentToolResult BuiltinToolsProvider::do_content_chunk(const Json& params) const
         }
     }
     
-    LOG_DEBUG("[content_chunk tool] Retrieving chunk %zu of '%s' (clean_html=%s)", 
-              chunk_index, id.c_str(), clean_html ? "true" : "false");
+    size_t max_tokens = builtin_tools::param::get_size(params, "max_tokens", 0);
+    
+    LOG_DEBUG("[content_chunk tool] Retrieving chunk %zu of '%s' (clean_html=%s, max_tokens=%zu)", 
+              chunk_index, id.c_str(), clean_html ? "true" : "false", max_tokens);
     
     if (!chunker_->has(id)) {
         return AgentToolResult::fail(
@@ -604,7 +860,7 @@ AgentToolResult BuiltinToolsProvider::do_content_chunk(const Json& params) const
         );
     }
     
-    auto chunk = chunker_->get_chunk(id, chunk_index, clean_html);
+    auto chunk = chunker_->get_chunk(id, chunk_index, clean_html, max_tokens);
     return AgentToolResult::ok(chunk);
 }
 
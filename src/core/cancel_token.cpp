@@ -0,0 +1,34 @@
+/*
+ * OpenCrank C++ - Cancellation Token Implementation
+ */
+#include <opencrank/core/cancel_token.hpp>
+#include <algorithm>
+
+namespace opencrank {
+
+CancelToken::CancelToken() : flag_(false) {}
+
+bool CancelToken::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (flag_.exchange(true)) return false;
+    for (std::vector<std::atomic<bool>*>::iterator it = linked_.begin(); it != linked_.end(); ++it) {
+        (*it)->store(true);
+    }
+    return true;
+}
+
+void CancelToken::link(std::atomic<bool>* other) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (flag_.load()) {
+        other->store(true);
+        return;
+    }
+    linked_.push_back(other);
+}
+
+void CancelToken::unlink(std::atomic<bool>* other) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    linked_.erase(std::remove(linked_.begin(), linked_.end(), other), linked_.end());
+}
+
+} // namespace opencrank
@@ -0,0 +1,443 @@
+/*
+ * OpenCrank C++ - Cluster Mode Implementation
+ */
+#include <opencrank/core/cluster.hpp>
+#include <opencrank/core/reactor.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <opencrank/core/message_handler.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/json.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace opencrank {
+
+namespace {
+
+const long FORWARD_TIMEOUT_MS = 5000;
+const char* SECRET_HEADER = "X-Opencrank-Cluster-Secret";
+const char* NODE_HEADER = "X-Opencrank-Cluster-Node";
+
+// FNV-1a spreads short, similar keys ("a#0", "a#1") poorly in its high
+// bits; a final mix places the points evenly around the ring
+uint64_t ring_point(const std::string& key) {
+    uint64_t h = fnv1a_64(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace
+
+Cluster& Cluster::instance() {
+    static Cluster cluster;
+    return cluster;
+}
+
+Cluster::Cluster()
+    : enabled_(false)
+    , leader_cron_(true)
+    , port_(18790)
+    , vnodes_(64)
+    , heartbeat_ms_(2000)
+    , dead_after_ms_(6000)
+    , reactor_(NULL)
+    , pool_(NULL)
+    , heartbeat_timer_(0)
+    , pinging_(false) {
+    Metrics& metrics = Metrics::instance();
+    const char* help = "Messages forwarded to the cluster node owning their session";
+    forwarded_ = &metrics.counter("opencrank_cluster_forwarded_total", help, metric_labels("result", "ok"));
+    forward_failed_ = &metrics.counter("opencrank_cluster_forwarded_total", help, metric_labels("result", "failed"));
+    received_ = &metrics.counter("opencrank_cluster_received_total", "Messages forwarded here by other cluster nodes");
+}
+
+bool Cluster::configure(const Config& cfg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = false;
+    nodes_.clear();
+    ring_.clear();
+    if (!cfg.get_bool("cluster.enabled", false)) return true;
+
+    node_id_ = cfg.get_string("cluster.node_id", "");
+    secret_ = cfg.get_string("cluster.secret", "");
+    bind_ = cfg.get_string("cluster.bind", "0.0.0.0");
+    port_ = static_cast<int>(cfg.get_int("cluster.port", 18790));
+    vnodes_ = static_cast<int>(std::max<int64_t>(1, cfg.get_int("cluster.vnodes", 64)));
+    heartbeat_ms_ = static_cast<int>(std::max<int64_t>(100, cfg.get_int("cluster.heartbeat_ms", 2000)));
+    dead_after_ms_ = std::max<int64_t>(heartbeat_ms_, cfg.get_int("cluster.dead_after_ms", 6000));
+    leader_cron_ = cfg.get_string("cluster.cron", "leader") != "local";
+
+    bool found_self = false;
+    int64_t now = current_timestamp_ms();
+    const Json& nodes = cfg.get_section("cluster.nodes");
+    if (nodes.is_array()) {
+        for (Json::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+            Node node;
+            node.id = json_utils::get_string(*it, "id");
+            node.url = json_utils::get_string(*it, "url");
+            while (!node.url.empty() && node.url[node.url.size() - 1] == '/') {
+                node.url.erase(node.url.size() - 1);
+            }
+            if (node.id.empty() || (node.url.empty() && node.id != node_id_)) {
+                LOG_ERROR("[Cluster] Every entry of cluster.nodes needs an id and a url");
+                nodes_.clear();
+                return false;
+            }
+            node.alive = true;          // Until it misses its pings
+            node.last_seen_ms = now;
+            if (node.id == node_id_) found_self = true;
+            nodes_.push_back(node);
+        }
+    }
+    if (node_id_.empty() || !found_self) {
+        LOG_ERROR("[Cluster] cluster.node_id '%s' is not one of cluster.nodes, running alone",
+                  node_id_.c_str());
+        nodes_.clear();
+        return false;
+    }
+    if (secret_.empty()) {
+        LOG_WARN("[Cluster] No cluster.secret: anyone reaching port %d can inject messages", port_);
+    }
+
+    enabled_ = true;
+    rebuild_ring_locked();
+    LOG_INFO("[Cluster] Node %s of %zu, %d ring points each, cron on %s",
+             node_id_.c_str(), nodes_.size(), vnodes_, leader_cron_ ? "the leader" : "every node");
+    return true;
+}
+
+bool Cluster::start(Reactor& reactor, ThreadPool* pool, const Deliver& deliver) {
+    std::string bind_address;
+    int port = 0;
+    int heartbeat_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_) return false;
+        pool_ = pool;
+        deliver_ = deliver;
+        bind_address = bind_;
+        port = port_;
+        heartbeat_ms = heartbeat_ms_;
+    }
+    if (!listener_.open("Cluster", "cluster", bind_address, port) ||
+        !listener_.attach(reactor, [this](const HttpRequest& request, HttpReply& reply) {
+            handle_request(request, reply);
+        })) {
+        listener_.close();
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_ = false;
+        ring_.clear();
+        LOG_ERROR("[Cluster] Internal endpoint unavailable, running alone");
+        return false;
+    }
+    reactor_ = &reactor;
+    LOG_INFO("[Cluster] Internal endpoint listening on %s:%d", bind_address.c_str(), port);
+
+    heartbeat_timer_ = reactor.add_timer(heartbeat_ms, [this]() {
+        if (pinging_.exchange(true)) return;    // Last round still waiting on a peer
+        if (pool_) {
+            pool_->enqueue(Task([this]() { heartbeat(); }), TaskPriority::BACKGROUND);
+        } else {
+            heartbeat();
+        }
+    }, true);
+    return true;
+}
+
+void Cluster::stop() {
+    listener_.close();
+    if (reactor_ && heartbeat_timer_) reactor_->cancel_timer(heartbeat_timer_);
+    heartbeat_timer_ = 0;
+    reactor_ = NULL;
+}
+
+bool Cluster::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return enabled_;
+}
+
+std::string Cluster::node_id() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return node_id_;
+}
+
+// ============================================================================
+// Ownership
+// ============================================================================
+
+void Cluster::rebuild_ring_locked() {
+    ring_.clear();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!nodes_[i].alive) continue;
+        for (int v = 0; v < vnodes_; ++v) {
+            ring_[ring_point(nodes_[i].id + "#" + std::to_string(v))] = nodes_[i].id;
+        }
+    }
+}
+
+std::string Cluster::owner_of(const std::string& session_key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_ || ring_.empty()) return node_id_;
+    std::map<uint64_t, std::string>::const_iterator it = ring_.lower_bound(ring_point(session_key));
+    if (it == ring_.end()) it = ring_.begin();
+    return it->second;
+}
+
+bool Cluster::route(const std::string& session_key, const Message& msg) {
+    std::string owner = owner_of(session_key);
+    ThreadPool* pool = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_ || owner == node_id_) return false;
+        Outbox& box = outbox_[owner];
+        Forward fwd;
+        fwd.session_key = session_key;
+        fwd.msg = msg;
+        box.queue.push_back(fwd);
+        if (box.draining) return true;      // Its worker takes this one in turn
+        box.draining = true;
+        pool = pool_;
+    }
+
+    // Off the channel's thread: a slow peer must not hold up ingress
+    if (pool) {
+        pool->enqueue(Task([this, owner]() { drain_outbox(owner); }), TaskPriority::INTERACTIVE);
+    } else {
+        drain_outbox(owner);
+    }
+    return true;
+}
+
+void Cluster::drain_outbox(const std::string& owner) {
+    while (true) {
+        Forward fwd;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Outbox& box = outbox_[owner];
+            if (box.queue.empty()) {
+                box.draining = false;
+                return;
+            }
+            fwd = box.queue.front();
+            box.queue.pop_front();
+        }
+        forward(owner, fwd);
+    }
+}
+
+void Cluster::forward(const std::string& owner, const Forward& fwd) {
+    const Message& msg = fwd.msg;
+    std::string url;
+    bool alive = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            if (nodes_[i].id == owner) {
+                url = nodes_[i].url;
+                alive = nodes_[i].alive;
+            }
+        }
+    }
+
+    std::map<std::string, std::string> headers;
+    headers[SECRET_HEADER] = secret_;
+    headers[NODE_HEADER] = node_id();
+    std::string body = message_to_json(msg).dump();
+
+    // A second try only with an id: the owner drops it if the first arrived
+    HttpResponse response;
+    for (int attempt = 0; alive && attempt < (msg.id.empty() ? 1 : 2); ++attempt) {
+        {
+            HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+            http->set_timeout(FORWARD_TIMEOUT_MS);
+            response = http->post_json(url + "/cluster/message", body, headers);
+        }
+        if (response.ok() || !response.sent || (response.status_code >= 400 && response.status_code < 500)) {
+            break;
+        }
+    }
+    if (response.ok()) {
+        forwarded_->inc();
+        LOG_DEBUG("[Cluster] Message %s for %s:%s forwarded to %s",
+                  msg.id.c_str(), msg.channel.c_str(), msg.to.c_str(), owner.c_str());
+        return;
+    }
+
+    forward_failed_->inc();
+    std::string why = !alive ? std::string("left the ring")
+                    : response.error.empty() ? "HTTP " + std::to_string(response.status_code)
+                    : response.error;
+    bool refused = response.status_code >= 400 && response.status_code < 500;   // Up, but did not take it
+    if (alive && !refused) mark(owner, false);
+
+    if (alive && response.sent && !refused) {
+        // The owner may be running it already; a copy here would answer twice
+        LOG_ERROR("[Cluster] Forward of message %s to %s unanswered (%s), not handling it here",
+                  msg.id.c_str(), owner.c_str(), why.c_str());
+        return;
+    }
+
+    // The owner never saw it: the session's next owner handles it
+    LOG_WARN("[Cluster] Forward of message %s to %s failed (%s), %s", msg.id.c_str(), owner.c_str(),
+             why.c_str(), refused ? "handling it here" : "routing it again");
+    if (!refused && route(fwd.session_key, msg)) return;
+    Deliver deliver;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        deliver = deliver_;
+    }
+    if (deliver) deliver(msg);
+}
+
+// ============================================================================
+// Membership
+// ============================================================================
+
+void Cluster::mark(const std::string& id, bool alive) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = current_timestamp_ms();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        Node& node = nodes_[i];
+        if (node.id != id || node.id == node_id_) continue;
+        if (alive) node.last_seen_ms = now;
+        if (node.alive == alive) return;
+        node.alive = alive;
+        rebuild_ring_locked();
+
+        size_t live = 0;
+        for (size_t j = 0; j < nodes_.size(); ++j) {
+            if (nodes_[j].alive) ++live;
+        }
+        if (alive) {
+            LOG_INFO("[Cluster] Node %s joined the ring (%zu/%zu live)", id.c_str(), live, nodes_.size());
+        } else {
+            LOG_WARN("[Cluster] Node %s left the ring (%zu/%zu live)", id.c_str(), live, nodes_.size());
+        }
+        return;
+    }
+}
+
+void Cluster::heartbeat() {
+    std::vector<Node> peers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            if (nodes_[i].id != node_id_) peers.push_back(nodes_[i]);
+        }
+    }
+
+    std::map<std::string, std::string> headers;
+    headers[SECRET_HEADER] = secret_;
+    headers[NODE_HEADER] = node_id();
+    long timeout_ms = std::min(1000L, static_cast<long>(heartbeat_ms_));
+
+    for (size_t i = 0; i < peers.size(); ++i) {
+        HttpResponse response;
+        {
+            HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+            http->set_timeout(timeout_ms);
+            response = http->get(peers[i].url + "/cluster/ping", headers);
+        }
+        if (response.ok() && json_utils::get_string(response.json(), "node") == peers[i].id) {
+            mark(peers[i].id, true);
+            continue;
+        }
+        LOG_DEBUG("[Cluster] Ping to %s failed: %s", peers[i].id.c_str(),
+                  response.error.empty() ? ("HTTP " + std::to_string(response.status_code)).c_str()
+                                         : response.error.c_str());
+        if (current_timestamp_ms() - peers[i].last_seen_ms >= dead_after_ms_) {
+            mark(peers[i].id, false);
+        }
+    }
+    pinging_.store(false);
+}
+
+bool Cluster::is_leader() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) return true;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_[i].alive && nodes_[i].id < node_id_) return false;
+    }
+    return true;
+}
+
+bool Cluster::runs_cron() const {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_ || !leader_cron_) return true;
+    }
+    return is_leader();
+}
+
+size_t Cluster::live_nodes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t live = 0;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_[i].alive) ++live;
+    }
+    return live;
+}
+
+// ============================================================================
+// Internal endpoint
+// ============================================================================
+
+void Cluster::handle_request(const HttpRequest& request, HttpReply& reply) {
+    reply.content_type = "application/json";
+    reply.body = "{}";
+
+    std::string expected;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expected = secret_;
+    }
+    if (!expected.empty() && request.header(to_lower(SECRET_HEADER)) != expected) {
+        LOG_WARN("[Cluster] Request to %s with bad secret rejected", request.path.c_str());
+        reply.status = 403;
+        return;
+    }
+
+    // Any request from a peer shows it is up
+    std::string from = request.header(to_lower(NODE_HEADER));
+    if (!from.empty()) mark(from, true);
+
+    if (request.method == "GET" && request.path == "/cluster/ping") {
+        Json pong = Json::object();
+        pong["node"] = node_id();
+        reply.body = pong.dump();
+        return;
+    }
+    if (request.method != "POST" || request.path != "/cluster/message") {
+        reply.status = 404;
+        return;
+    }
+
+    Json payload;
+    try {
+        payload = Json::parse(request.body, request.body + request.body_size);
+    } catch (const std::exception& e) {
+        LOG_WARN("[Cluster] Forwarded message is not JSON: %s", e.what());
+        reply.status = 400;
+        return;
+    }
+    Message msg = message_from_json(payload);
+    if (msg.channel.empty() || msg.to.empty()) {
+        reply.status = 400;
+        return;
+    }
+
+    received_->inc();
+    LOG_DEBUG("[Cluster] Message %s for %s:%s forwarded by %s", msg.id.c_str(), msg.channel.c_str(),
+              msg.to.c_str(), from.empty() ? "a peer" : from.c_str());
+    if (deliver_) deliver_(msg);
+}
+
+} // namespace opencrank
@@ -0,0 +1,223 @@
+/*
+ * OpenCrank C++ - Command Dispatch Table Implementation
+ */
+#include <opencrank/core/command_table.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <cctype>
+#include <strings.h>
+
+namespace opencrank {
+
+namespace {
+
+const char SKILL_PREFIX[] = "/skill";
+const size_t SKILL_PREFIX_LEN = sizeof(SKILL_PREFIX) - 1;
+
+bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// "/name" for a bare or slashed name
+std::string slashed(const std::string& name) {
+    std::string trimmed = trim(name);
+    if (trimmed.empty() || trimmed[0] == '/') return trimmed;
+    return "/" + trimmed;
+}
+
+} // anonymous namespace
+
+CommandTable::CommandTable() : names_(0) {
+    nodes_.push_back(Node());
+    nodes_[0].target = -1;
+}
+
+bool CommandTable::insert(const std::string& name, const Target& target) {
+    int32_t node = 0;
+    for (size_t i = 0; i < name.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(tolower(static_cast<unsigned char>(name[i])));
+        std::vector<std::pair<unsigned char, int32_t> >& edges = nodes_[node].edges;
+        std::vector<std::pair<unsigned char, int32_t> >::iterator it = std::lower_bound(
+            edges.begin(), edges.end(), std::make_pair(c, static_cast<int32_t>(-1)));
+        if (it != edges.end() && it->first == c) {
+            node = it->second;
+            continue;
+        }
+        int32_t child = static_cast<int32_t>(nodes_.size());
+        edges.insert(it, std::make_pair(c, child));
+        nodes_.push_back(Node());
+        nodes_.back().target = -1;
+        node = child;
+    }
+
+    if (nodes_[node].target >= 0) {
+        return false;
+    }
+    nodes_[node].target = static_cast<int32_t>(targets_.size());
+    targets_.push_back(target);
+    ++names_;
+    return true;
+}
+
+const CommandTable::Target* CommandTable::find(const char* name, size_t len) const {
+    int32_t node = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(tolower(static_cast<unsigned char>(name[i])));
+        const std::vector<std::pair<unsigned char, int32_t> >& edges = nodes_[node].edges;
+        std::vector<std::pair<unsigned char, int32_t> >::const_iterator it = std::lower_bound(
+            edges.begin(), edges.end(), std::make_pair(c, static_cast<int32_t>(-1)));
+        if (it == edges.end() || it->first != c) {
+            return NULL;
+        }
+        node = it->second;
+    }
+    int32_t target = nodes_[node].target;
+    return target >= 0 ? &targets_[target] : NULL;
+}
+
+std::shared_ptr<const CommandTable> CommandTable::build(
+    const std::map<std::string, CommandDef>& registry_commands,
+    const std::shared_ptr<const SkillCatalog>& catalog,
+    const std::map<std::string, std::string>& aliases) {
+
+    std::shared_ptr<CommandTable> table = std::make_shared<CommandTable>();
+    table->catalog_ = catalog;
+
+    // 1. Registry commands and built-ins
+    for (std::map<std::string, CommandDef>::const_iterator it = registry_commands.begin();
+         it != registry_commands.end(); ++it) {
+        Target target = { REGISTRY, static_cast<int32_t>(table->commands_.size()) };
+        table->commands_.push_back(&it->second);
+        if (!table->insert(it->first, target)) {
+            LOG_WARN("[Commands] %s registered twice (names are case-insensitive)", it->first.c_str());
+        }
+    }
+    Target list_skills = { LIST_SKILLS, -1 };
+    table->insert("/skills", list_skills);
+
+    // 2. Skill commands, then their original names and frontmatter aliases
+    if (catalog) {
+        std::map<std::string, const SkillEntry*> entries_by_name;
+        for (size_t i = 0; i < catalog->entries.size(); ++i) {
+            entries_by_name[to_lower(catalog->entries[i].skill.name)] = &catalog->entries[i];
+        }
+
+        const std::vector<SkillCommandSpec>& specs = catalog->commands;
+        table->skill_entries_.resize(specs.size(), NULL);
+        for (size_t i = 0; i < specs.size(); ++i) {
+            std::map<std::string, const SkillEntry*>::const_iterator e =
+                entries_by_name.find(to_lower(specs[i].skill_name));
+            if (e != entries_by_name.end()) {
+                table->skill_entries_[i] = e->second;
+            }
+            Target target = { SKILL, static_cast<int32_t>(i) };
+            if (!table->insert("/" + specs[i].name, target)) {
+                LOG_WARN("[Commands] Skill command /%s shadowed by an existing command",
+                         specs[i].name.c_str());
+            }
+        }
+
+        for (size_t i = 0; i < specs.size(); ++i) {
+            Target target = { SKILL, static_cast<int32_t>(i) };
+            table->insert("/" + specs[i].skill_name, target);
+
+            const SkillEntry* entry = table->skill_entries_[i];
+            if (!entry) continue;
+            SkillFrontmatter::const_iterator fm = entry->frontmatter.find("aliases");
+            if (fm == entry->frontmatter.end()) continue;
+            std::string list = fm->second;
+            list.erase(std::remove(list.begin(), list.end(), '['), list.end());
+            list.erase(std::remove(list.begin(), list.end(), ']'), list.end());
+            std::vector<std::string> names = split(list, ',');
+            for (size_t j = 0; j < names.size(); ++j) {
+                std::string alias = trim(names[j]);
+                if (alias.size() >= 2 && (alias[0] == '"' || alias[0] == '\'')) {
+                    alias = alias.substr(1, alias.size() - 2);
+                }
+                alias = slashed(alias);
+                if (alias.size() > 1 && !table->insert(alias, target)) {
+                    LOG_WARN("[Commands] Alias %s of skill '%s' is already taken",
+                             alias.c_str(), specs[i].skill_name.c_str());
+                }
+            }
+        }
+    }
+
+    // 3. Configured aliases point at whatever their target resolved to
+    for (std::map<std::string, std::string>::const_iterator it = aliases.begin();
+         it != aliases.end(); ++it) {
+        std::string alias = slashed(it->first);
+        std::string target_name = slashed(it->second);
+        const Target* target = table->find(target_name.data(), target_name.size());
+        if (!target) {
+            LOG_WARN("[Commands] Alias %s -> %s: unknown command", alias.c_str(), target_name.c_str());
+            continue;
+        }
+        Target copy = *target;
+        if (alias.size() > 1 && !table->insert(alias, copy)) {
+            LOG_WARN("[Commands] Alias %s is already a command", alias.c_str());
+        }
+    }
+
+    LOG_DEBUG("[Commands] Dispatch table: %zu names, %zu trie nodes",
+              table->names_, table->nodes_.size());
+    return table;
+}
+
+CommandTable::Match CommandTable::resolve(const std::string& text) const {
+    Match match;
+
+    size_t pos = 0;
+    while (pos < text.size() && is_blank(text[pos])) ++pos;
+    if (pos >= text.size() || text[pos] != '/') {
+        return match;
+    }
+
+    size_t name_end = pos;
+    while (name_end < text.size() && !is_blank(text[name_end])) ++name_end;
+    size_t args_start = name_end < text.size() ? name_end + 1 : name_end;
+
+    const Target* target = find(text.data() + pos, name_end - pos);
+
+    // "/skill name args": look name up among skill commands only
+    if (!target && name_end - pos == SKILL_PREFIX_LEN &&
+        strncasecmp(text.c_str() + pos, SKILL_PREFIX, SKILL_PREFIX_LEN) == 0) {
+        size_t start = name_end;
+        while (start < text.size() && is_blank(text[start])) ++start;
+        size_t end = start;
+        while (end < text.size() && !is_blank(text[end])) ++end;
+        if (start == end) {
+            return match;
+        }
+        std::string name = "/" + text.substr(start, end - start);
+        target = find(name.data(), name.size());
+        if (!target || target->kind != SKILL) {
+            return match;
+        }
+        args_start = end < text.size() ? end + 1 : end;
+    }
+
+    if (!target) {
+        return match;
+    }
+
+    match.kind = target->kind;
+    switch (target->kind) {
+        case REGISTRY:
+            match.command = commands_[target->index];
+            match.args = text.substr(args_start);
+            break;
+        case SKILL:
+            match.skill = &catalog_->commands[target->index];
+            match.entry = skill_entries_[target->index];
+            match.args = trim(text.substr(args_start));
+            break;
+        default:
+            match.args = text.substr(args_start);
+            break;
+    }
+    return match;
+}
+
+} // namespace opencrank
@@ -5,13 +5,36 @@
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/utils.hpp>
 #include <opencrank/core/application.hpp>
+#include <opencrank/core/memory_recall.hpp>
+#include <opencrank/core/trace.hpp>
+#include <opencrank/core/allocator.hpp>
 #include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
 
 namespace opencrank {
 
 namespace {
 static std::string core_app_name = "OpenCrank C++";
 static std::string core_app_version = "0.5.0";
+
+std::string format_kb(size_t bytes) {
+    char buf[32];
+    if (bytes >= 10 * 1024 * 1024) {
+        snprintf(buf, sizeof(buf), "%.1f MB", static_cast<double>(bytes) / (1024.0 * 1024.0));
+    } else {
+        snprintf(buf, sizeof(buf), "%.1f KB", static_cast<double>(bytes) / 1024.0);
+    }
+    return buf;
+}
+
+struct SessionTotal {
+    SessionMemory memory;
+    size_t chunker_bytes;
+    size_t total() const { return memory.history_bytes + memory.inflight_bytes + chunker_bytes; }
+    bool operator<(const SessionTotal& o) const { return total() > o.total(); }
+};
 }
 
 void register_core_commands(const Config& cfg, PluginRegistry& registry) {
@@ -33,6 +56,9 @@ void register_core_commands(const Config& cfg, PluginRegistry& registry) {
     cmds.push_back(CommandDef("/monitor", "AI monitor status", commands::cmd_monitor));
     cmds.push_back(CommandDef("/continue", "Resume paused agent task", commands::cmd_continue));
     cmds.push_back(CommandDef("/cancel", "Cancel paused agent task", commands::cmd_cancel));
+    cmds.push_back(CommandDef("/stop", "Stop the running agent task", commands::cmd_stop));
+    cmds.push_back(CommandDef("/trace", "Timing breakdown of the last agent run (/trace last [json])", commands::cmd_trace));
+    cmds.push_back(CommandDef("/stats", "Process statistics (/stats memory)", commands::cmd_stats));
 
     registry.register_commands(cmds);
     LOG_INFO("Core commands registered: %zu", cmds.size());
@@ -113,6 +139,7 @@ std::string cmd_start(const Message& /*msg*/, Session& /*session*/, const std::s
 
 std::string cmd_new(const Message& /*msg*/, Session& session, const std::string& /*args*/) {
     session.clear_history();
+    MemoryRecall::instance().forget(session.key());
     return "🔄 Conversation cleared. Let's start fresh!";
 }
 
@@ -126,6 +153,17 @@ std::string cmd_status(const Message& /*msg*/, Session& session, const std::stri
         << "Last active: " << format_timestamp(session.last_activity()) << "\n"
         << "Total sessions: " << sessions.session_count();
     
+    // Provider prefix/KV cache effectiveness for this conversation
+    if (session.has_data("prompt_tokens")) {
+        long long prompt = std::atoll(session.get_data("prompt_tokens").c_str());
+        long long cached = std::atoll(session.get_data("prompt_cached_tokens", "0").c_str());
+        if (prompt > 0) {
+            char ratio[32];
+            snprintf(ratio, sizeof(ratio), "%.1f%%", 100.0 * static_cast<double>(cached) / static_cast<double>(prompt));
+            oss << "\nPrompt cache: " << ratio << " of " << prompt << " prompt tokens reused";
+        }
+    }
+    
     // Show paused task info if applicable
     if (session.has_data("agent_paused")) {
         oss << "\n\n⏸️ **Paused Task**\n";
@@ -250,8 +288,8 @@ std::string cmd_continue(const Message& msg, Session& session, const std::string
     
     // Start AI monitoring
     std::string monitor_session_id = msg.channel + ":" + msg.to;
-    app.ai_monitor().start_session(monitor_session_id, msg.channel, msg.to);
-    app.typing().start_typing(msg.to);
+    CancelTokenPtr cancel = app.ai_monitor().start_session(monitor_session_id, msg.channel, msg.to);
+    app.typing().start_typing(msg.channel, msg.to);
     
     LOG_INFO("[continue] Resuming agent loop with %d more iterations (prev: %d iterations, %d tool calls)",
              additional_iterations, prev_iterations, prev_tool_calls);
@@ -259,6 +297,8 @@ std::string cmd_continue(const Message& msg, Session& session, const std::string
     // Configure agent with new limit (inherit other settings from app config)
     AgentConfig agent_config = app.agent().config();
     agent_config.max_iterations = additional_iterations;
+    agent_config.cancel_key = monitor_session_id;
+    agent_config.cancel = cancel;
     
     // Run agent loop with continuation message
     auto agent_result = app.agent().run(
@@ -269,11 +309,14 @@ std::string cmd_continue(const Message& msg, Session& session, const std::string
         agent_config
     );
     
-    app.typing().stop_typing(msg.to);
+    app.typing().stop_typing(msg.channel, msg.to);
     app.ai_monitor().end_session(monitor_session_id);
     
     std::string response;
-    if (agent_result.paused) {
+    if (agent_result.cancelled) {
+        response = "🛑 Stopped.";
+        LOG_INFO("[continue] Stopped after %d more iterations", agent_result.iterations);
+    } else if (agent_result.paused) {
         // Paused again - store updated state
         session.set_data("agent_paused", "true");
         session.set_data("agent_iterations", std::to_string(prev_iterations + agent_result.iterations));
@@ -310,6 +353,110 @@ std::string cmd_cancel(const Message& /*msg*/, Session& session, const std::stri
     return "🛑 Paused task cancelled. You can start a new conversation.";
 }
 
+std::string cmd_stop(const Message& msg, Session& /*session*/, const std::string& /*args*/) {
+    // A running task is stopped by on_message before it gets here; this
+    // runs when the session was idle or the run finished meanwhile
+    if (Application::instance().cancel_session(msg.channel + ":" + msg.to)) {
+        return "";
+    }
+    return "⚠️ No running task to stop.";
+}
+
+std::string cmd_trace(const Message& /*msg*/, Session& session, const std::string& args) {
+    Tracer& tracer = Tracer::instance();
+    if (!tracer.enabled()) {
+        return "Tracing is off (agent.trace_keep = 0).";
+    }
+    
+    std::vector<std::string> words = split(trim(args), ' ');
+    std::string what = words.empty() || words[0].empty() ? "last" : words[0];
+    if (what != "last") {
+        return "Usage: /trace last [json]";
+    }
+    
+    std::shared_ptr<Trace> trace = tracer.last(session.key());
+    if (!trace) {
+        return "No traced agent run in this session yet.";
+    }
+    
+    std::string out = trace->summary();
+    if (words.size() > 1 && words[1] == "json") {
+        std::string dir = tracer.export_dir();
+        if (dir.empty()) {
+            dir = Application::instance().config().get_string("workspace_dir", ".") + "/traces";
+        }
+        std::string path = Tracer::write(*trace, dir);
+        out += path.empty() ? "\nCould not write the trace file." :
+               "\nChrome trace JSON: " + path + " (open in ui.perfetto.dev or chrome://tracing)";
+    }
+    return out;
+}
+
+std::string cmd_stats(const Message& /*msg*/, Session& session, const std::string& args) {
+    if (trim(args) != "memory") {
+        return "Usage: /stats memory";
+    }
+    Application& app = Application::instance();
+    SessionManager& sessions = SessionManager::instance();
+    const ContentChunker& chunker = app.agent().chunker();
+    
+    std::vector<SessionMemory> usage = sessions.memory_usage();
+    std::map<std::string, size_t> chunked = chunker.owner_usage();
+    std::vector<SessionTotal> totals;
+    totals.reserve(usage.size());
+    size_t unloaded = 0;
+    size_t inflight = 0;
+    for (size_t i = 0; i < usage.size(); ++i) {
+        SessionTotal t;
+        t.memory = usage[i];
+        std::map<std::string, size_t>::const_iterator c = chunked.find(usage[i].key);
+        t.chunker_bytes = c != chunked.end() ? c->second : 0;
+        if (!usage[i].loaded) unloaded++;
+        inflight += usage[i].inflight_bytes;
+        totals.push_back(t);
+    }
+    std::sort(totals.begin(), totals.end());
+    
+    allocator::Stats heap = allocator::stats();
+    // The budget is enforced by unloading to the store, so only with one
+    size_t budget = app.config().get_bool("session.persist", true) ?
+        static_cast<size_t>(app.config().get_int("session.memory_budget_mb", 64)) * 1024 * 1024 : 0;
+    
+    std::ostringstream oss;
+    oss << "🧠 Memory\n\n"
+        << "Allocator: " << allocator::name();
+    if (heap.allocated > 0) oss << ", " << format_kb(heap.allocated) << " in use";
+    if (heap.resident > 0) oss << ", " << format_kb(heap.resident) << " held";
+    oss << "\n"
+        << "Sessions: " << usage.size() << " (" << unloaded << " unloaded to the store), "
+        << format_kb(sessions.memory_used());
+    if (budget > 0) oss << " of " << format_kb(budget) << " budget";
+    oss << "\n"
+        << "  tool results of running turns: " << format_kb(inflight) << "\n"
+        << "  histories unloaded over budget: " << sessions.evictions() << "\n"
+        << "Content chunker: " << format_kb(chunker.memory_used()) << " in memory, "
+        << format_kb(chunker.disk_used()) << " spilled\n";
+    
+    // Session keys name the chat and peer, so other chats are only listed
+    // when the operator allowed it
+    bool list_keys = app.config().get_bool("stats.list_sessions", false);
+    for (size_t i = 0; i < totals.size(); ++i) {
+        if (totals[i].memory.key != session.key()) continue;
+        oss << "\nThis session: " << format_kb(totals[i].total()) << " (history "
+            << format_kb(totals[i].memory.history_bytes) << ", in flight "
+            << format_kb(totals[i].memory.inflight_bytes) << ", chunker "
+            << format_kb(totals[i].chunker_bytes) << ")\n";
+    }
+    if (list_keys && !totals.empty()) {
+        oss << "\nLargest sessions:\n";
+        for (size_t i = 0; i < totals.size() && i < 10; ++i) {
+            oss << "  " << totals[i].memory.key << ": " << format_kb(totals[i].total())
+                << (totals[i].memory.loaded ? "" : " (unloaded)") << "\n";
+        }
+    }
+    return oss.str();
+}
+
 } // namespace commands
 
 } // namespace opencrank
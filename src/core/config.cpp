@@ -3,7 +3,27 @@
 
 namespace opencrank {
 
-Config::Config() {}
+namespace {
+
+// Add every node below node under its dotted path. A key that itself
+// contains a dot can collide with a nested path; the first one indexed wins.
+void index_tree(const Json& node, const std::string& prefix,
+                std::unordered_map<std::string, const Json*>& index) {
+    for (Json::const_iterator it = node.begin(); it != node.end(); ++it) {
+        std::string path = prefix.empty() ? it.key() : prefix + "." + it.key();
+        index.insert(std::make_pair(path, &it.value()));
+        if (it.value().is_object()) {
+            index_tree(it.value(), path, index);
+        }
+    }
+}
+
+} // namespace
+
+Config::Config() : current_(nullptr) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    publish(Json::object());
+}
 
 bool Config::load_file(const std::string& path) {
     std::ifstream f(path.c_str());
@@ -11,150 +31,148 @@ bool Config::load_file(const std::string& path) {
     
     std::string content((std::istreambuf_iterator<char>(f)),
                         std::istreambuf_iterator<char>());
-    try {
-        data_ = Json::parse(content);
-        return true;
-    } catch (...) {
-        return false;
-    }
+    if (!load_string(content)) return false;
+    path_ = path;
+    return true;
 }
 
 bool Config::load_string(const std::string& json_str) {
+    Json data;
     try {
-        data_ = Json::parse(json_str);
-        return true;
+        data = Json::parse(json_str);
     } catch (...) {
         return false;
     }
+    
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    overrides_.clear();
+    publish(std::move(data));
+    return true;
 }
 
-std::string Config::get_string(const std::string& key, const std::string& def) const {
-    // Support dot notation for nested keys (e.g., "gateway.bind")
-    size_t dot_pos = key.find('.');
-    if (dot_pos != std::string::npos) {
-        std::string section = key.substr(0, dot_pos);
-        std::string subkey = key.substr(dot_pos + 1);
-        
-        if (data_.contains(section)) {
-            const Json& sec = data_[section];
-            // Handle multi-level nesting (e.g., "gateway.auth.token")
-            size_t dot_pos2 = subkey.find('.');
-            if (dot_pos2 != std::string::npos) {
-                std::string subsection = subkey.substr(0, dot_pos2);
-                std::string finalkey = subkey.substr(dot_pos2 + 1);
-                if (sec.contains(subsection)) {
-                    const Json& subsec = sec[subsection];
-                    if (subsec.contains(finalkey) && subsec[finalkey].is_string()) {
-                        LOG_DEBUG("Config: found nested key '%s.%s.%s'", 
-                                  section.c_str(), subsection.c_str(), finalkey.c_str());
-                        return subsec[finalkey].get<std::string>();
-                    }
-                }
-            } else if (sec.contains(subkey) && sec[subkey].is_string()) {
-                LOG_DEBUG("Config: found key '%s.%s'", section.c_str(), subkey.c_str());
-                return sec[subkey].get<std::string>();
+bool Config::reload() {
+    if (path_.empty()) return false;
+    
+    std::ifstream f(path_.c_str());
+    if (!f.is_open()) {
+        LOG_WARN("Config: cannot open %s for reload", path_.c_str());
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(f)),
+                        std::istreambuf_iterator<char>());
+    Json data;
+    try {
+        data = Json::parse(content);
+    } catch (const std::exception& e) {
+        LOG_WARN("Config: reload of %s failed, keeping current settings - %s", path_.c_str(), e.what());
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    // Runtime overrides (sandbox paths) outlive the file contents
+    for (size_t i = 0; i < overrides_.size(); ++i) {
+        const std::string& key = overrides_[i].first;
+        size_t dot_pos = key.find('.');
+        if (dot_pos != std::string::npos) {
+            std::string section = key.substr(0, dot_pos);
+            if (!data.contains(section) || !data[section].is_object()) {
+                data[section] = Json::object();
             }
+            data[section][key.substr(dot_pos + 1)] = overrides_[i].second;
+        } else {
+            data[key] = overrides_[i].second;
         }
-
-        LOG_DEBUG("Config: key '%s' not found in section '%s'", subkey.c_str(), section.c_str());
-        return def;
     }
-    
-    // No dot notation, direct lookup
-    if (data_.contains(key) && data_[key].is_string()) {
-        LOG_DEBUG("Config: found key '%s'", key.c_str());
-        return data_[key].get<std::string>();
+    publish(std::move(data));
+    LOG_INFO("Config: reloaded %s (generation %llu)", path_.c_str(),
+             static_cast<unsigned long long>(generation()));
+    return true;
+}
+
+void Config::publish(Json data) {
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    snapshot->data = std::move(data);
+    snapshot->generation = snapshots_.size() + 1;
+    if (snapshot->data.is_object()) {
+        index_tree(snapshot->data, "", snapshot->index);
     }
+    current_.store(snapshot.get(), std::memory_order_release);
+    snapshots_.push_back(std::move(snapshot));
+}
+
+const Json* Config::find(const std::string& key) const {
+    const Snapshot* snapshot = current_.load(std::memory_order_acquire);
+    std::unordered_map<std::string, const Json*>::const_iterator it = snapshot->index.find(key);
+    return it != snapshot->index.end() ? it->second : nullptr;
+}
 
-    LOG_DEBUG("Config: key '%s' not found", key.c_str());
+std::string Config::get_string(const std::string& key, const std::string& def) const {
+    // Dot notation reaches nested keys (e.g., "gateway.auth.token")
+    const Json* value = find(key);
+    if (value && value->is_string()) {
+        return value->get<std::string>();
+    }
     return def;
 }
 
 int64_t Config::get_int(const std::string& key, int64_t def) const {
-    // Support dot notation for nested keys
-    size_t dot_pos = key.find('.');
-    if (dot_pos != std::string::npos) {
-        std::string section = key.substr(0, dot_pos);
-        std::string subkey = key.substr(dot_pos + 1);
-        
-        if (data_.contains(section)) {
-            const Json& sec = data_[section];
-            if (sec.contains(subkey) && sec[subkey].is_number()) {
-                LOG_DEBUG("Config: found key '%s.%s'", section.c_str(), subkey.c_str());
-                return sec[subkey].get<int64_t>();
-            }
-        }
-        LOG_DEBUG("Config: key '%s' not found in section '%s'", subkey.c_str(), section.c_str());
-        return def;
-    }
-    
-    // No dot notation, direct lookup
-    if (data_.contains(key) && data_[key].is_number()) {
-        LOG_DEBUG("Config: found key '%s'", key.c_str());
-        return data_[key].get<int64_t>();
+    const Json* value = find(key);
+    if (value && value->is_number()) {
+        return value->get<int64_t>();
     }
     return def;
 }
 
 bool Config::get_bool(const std::string& key, bool def) const {
-    // Support dot notation for nested keys
-    size_t dot_pos = key.find('.');
-    if (dot_pos != std::string::npos) {
-        std::string section = key.substr(0, dot_pos);
-        std::string subkey = key.substr(dot_pos + 1);
-        
-        if (data_.contains(section)) {
-            const Json& sec = data_[section];
-            if (sec.contains(subkey) && sec[subkey].is_boolean()) {
-                LOG_DEBUG("Config: found key '%s.%s'", section.c_str(), subkey.c_str());
-                return sec[subkey].get<bool>();
-            }
-        }
-        LOG_DEBUG("Config: key '%s' not found in section '%s'", subkey.c_str(), section.c_str());
-        return def;
-    }
-    
-    if (data_.contains(key) && data_[key].is_boolean()) {
-        LOG_DEBUG("Config: found key '%s'", key.c_str());
-        return data_[key].get<bool>();
+    const Json* value = find(key);
+    if (value && value->is_boolean()) {
+        return value->get<bool>();
     }
     return def;
 }
 
 const Json& Config::get_section(const std::string& key) const {
     static Json null_json;
-    if (data_.contains(key)) {
-        return data_[key];
-    }
-    return null_json;
+    const Json* value = find(key);
+    return value ? *value : null_json;
 }
 
 std::string Config::get_channel_string(const std::string& channel, 
                                         const std::string& key,
                                         const std::string& def) const {
-    if (data_.contains(channel)) {
-        const Json& ch = data_[channel];
-        if (ch.contains(key) && ch[key].is_string()) {
-            return ch[key].get<std::string>();
-        }
-    }
-    return def;
+    std::string path;
+    path.reserve(channel.size() + 1 + key.size());
+    path += channel;
+    path += '.';
+    path += key;
+    return get_string(path, def);
 }
 
-const Json& Config::data() const { return data_; }
+const Json& Config::data() const {
+    return current_.load(std::memory_order_acquire)->data;
+}
+
+uint64_t Config::generation() const {
+    return current_.load(std::memory_order_acquire)->generation;
+}
 
 void Config::set_string(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    Json data = current_.load(std::memory_order_acquire)->data;
+    
     size_t dot_pos = key.find('.');
     if (dot_pos != std::string::npos) {
         std::string section = key.substr(0, dot_pos);
         std::string subkey = key.substr(dot_pos + 1);
-        if (!data_.contains(section)) {
-            data_[section] = Json::object();
+        if (!data.contains(section)) {
+            data[section] = Json::object();
         }
-        data_[section][subkey] = value;
+        data[section][subkey] = value;
     } else {
-        data_[key] = value;
+        data[key] = value;
     }
+    overrides_.push_back(std::make_pair(key, value));
+    publish(std::move(data));
 }
 
 } // namespace opencrank
@@ -6,10 +6,18 @@
 #include <opencrank/core/content_chunker.hpp>
 #include <opencrank/core/utils.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/token_counter.hpp>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
 #include <regex>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
 
 namespace opencrank {
 
@@ -21,140 +29,836 @@ struct Match {
     size_t chunk_index;
 };
 
-// Find all matches in content, returns up to max_matches results
-static std::vector<Match> find_matches(const std::string& content, const std::string& query,
-                                       size_t chunk_size, bool use_regex, size_t max_matches = 20) {
-    std::vector<Match> matches;
+// Chunk signatures also cover trigrams starting up to this far past the
+// chunk end, so matches that straddle a boundary still pass the filter
+const size_t SIGNATURE_OVERLAP = 256;
+
+// Tag names in the block scanner, a byte at a time
+char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+uint32_t trigram_bit(const char* p, int shift) {
+    uint32_t t = static_cast<unsigned char>(p[0]) |
+                 (static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8) |
+                 (static_cast<uint32_t>(static_cast<unsigned char>(p[2])) << 16);
+    return (t * 2654435761u) >> shift;
+}
+
+// ---------------------------------------------------------------------------
+// Chunk layout
+// ---------------------------------------------------------------------------
+
+// How good a place is to end a chunk before (higher is better)
+enum CutScore {
+    CUT_NONE = -1,      // Inside a UTF-8 sequence or an HTML tag
+    CUT_CHAR = 0,
+    CUT_WORD = 1,       // After a space
+    CUT_LINE = 2,       // At a line start
+    CUT_BLOCK = 3,      // After a closing block tag, before an opening one
+    CUT_PARAGRAPH = 4,  // After a blank line
+    CUT_SECTION = 5     // Before a heading or code fence, after a fence closes
+};
+
+// Tags longer than this are taken for a stray '<' in text
+const size_t MAX_TAG = 1024;
+
+const ApproxTokenCounter& chunk_token_counter() {
+    static const ApproxTokenCounter counter;
+    return counter;
+}
+
+bool utf8_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Element name at p (just past '<' or '</'); 0 when not a block element,
+// 2 for headings, 1 for other blocks
+int block_tag(const char* p, const char* end) {
+    static const char* const BLOCKS[] = {
+        "p", "div", "pre", "table", "tr", "ul", "ol", "li", "dl", "blockquote",
+        "section", "article", "header", "footer", "nav", "main", "aside"
+    };
+    size_t n = 0;
+    while (p + n < end && n < 12 && (is_alpha(p[n]) || (n > 0 && p[n] >= '0' && p[n] <= '9'))) ++n;
+    if (n == 0 || (p + n < end && p[n] != '>' && p[n] != ' ' && p[n] != '/' &&
+                   p[n] != '\t' && p[n] != '\n' && p[n] != '\r')) {
+        return 0;
+    }
+    if (n == 2 && ascii_lower(p[0]) == 'h' && p[1] >= '1' && p[1] <= '6') return 2;
+    for (size_t i = 0; i < sizeof(BLOCKS) / sizeof(BLOCKS[0]); ++i) {
+        if (strlen(BLOCKS[i]) != n) continue;
+        size_t k = 0;
+        while (k < n && ascii_lower(p[k]) == BLOCKS[i][k]) ++k;
+        if (k == n) return 1;
+    }
+    return 0;
+}
+
+// <br> or <hr> at p (just past '<')
+bool break_tag(const char* p, const char* end) {
+    return end - p >= 2 && (ascii_lower(p[0]) == 'b' || ascii_lower(p[0]) == 'h') &&
+           ascii_lower(p[1]) == 'r' && (end - p == 2 || !is_alpha(p[2]));
+}
+
+bool fence_at(const char* p, const char* end) {
+    return end - p >= 3 && ((p[0] == '`' && p[1] == '`' && p[2] == '`') ||
+                            (p[0] == '~' && p[1] == '~' && p[2] == '~'));
+}
+
+// Pick where the chunk starting at pos ends, at most at limit and not
+// before the middle of the window. in_fence carries code-fence state from
+// one chunk to the next.
+size_t choose_cut(const char* data, size_t size, size_t pos, size_t limit, bool& in_fence) {
+    const char* end = data + size;
+    size_t floor = pos + (limit - pos) / 2;
+    int best = CUT_NONE;
+    size_t best_at = limit;
+    bool best_fence = in_fence;
+    size_t safe_at = limit;         // Latest cut outside a UTF-8 sequence
+    bool safe_fence = in_fence;
+    bool found_safe = false;
     
-    if (use_regex) {
-        try {
-            std::regex pattern(query, std::regex::icase);
-            std::sregex_iterator iter(content.begin(), content.end(), pattern);
-            std::sregex_iterator end;
+    bool fence = in_fence;
+    bool in_tag = false;
+    size_t tag_start = 0;
+    size_t block_end = 0;           // Offset just past a closing block tag
+    size_t after_fence = 0;         // Start of the line after a closing fence
+    
+    for (size_t p = pos; p <= limit; ++p) {
+        bool line_start = p == 0 || data[p - 1] == '\n';
+        if (p > floor && p < size && !utf8_continuation(data[p])) {
+            safe_at = p;
+            safe_fence = fence;
+            found_safe = true;
             
-            while (iter != end && matches.size() < max_matches) {
-                std::smatch m = *iter;
-                Match match;
-                match.position = static_cast<size_t>(m.position());
-                match.length = static_cast<size_t>(m.length());
-                match.chunk_index = match.position / chunk_size;
-                matches.push_back(match);
-                ++iter;
+            int score = CUT_CHAR;
+            if (in_tag) {
+                score = CUT_NONE;
+            } else if (line_start) {
+                score = CUT_LINE;
+                if (p == after_fence || (!fence && (data[p] == '#' || fence_at(data + p, end)))) {
+                    score = CUT_SECTION;
+                } else if (!fence && p >= 2 && (data[p - 2] == '\n' ||
+                           (data[p - 2] == '\r' && p >= 3 && data[p - 3] == '\n'))) {
+                    score = CUT_PARAGRAPH;
+                }
+            } else if (!fence && data[p] == '<' && p + 1 < size) {
+                int block = block_tag(data + p + 1, end);
+                score = block == 2 ? CUT_SECTION : block == 1 ? CUT_BLOCK : CUT_CHAR;
+            }
+            if (score < CUT_BLOCK && !fence && p == block_end) {
+                score = CUT_BLOCK;
+            } else if (score == CUT_CHAR && (data[p - 1] == ' ' || data[p - 1] == '\t')) {
+                score = CUT_WORD;
+            }
+            if (score >= best) {
+                best = score;
+                best_at = p;
+                best_fence = fence;
             }
-        } catch (const std::regex_error&) {
-            // Return empty on invalid regex; caller handles the error
         }
-    } else {
-        std::string content_lower = content;
-        std::string query_lower = query;
-        for (size_t i = 0; i < content_lower.size(); ++i)
-            content_lower[i] = tolower(content_lower[i]);
-        for (size_t i = 0; i < query_lower.size(); ++i)
-            query_lower[i] = tolower(query_lower[i]);
+        if (p == limit) break;
         
-        size_t pos = 0;
-        while ((pos = content_lower.find(query_lower, pos)) != std::string::npos && matches.size() < max_matches) {
+        // Advance past data[p]
+        char c = data[p];
+        if (line_start && fence_at(data + p, end)) {
+            fence = !fence;
+            if (!fence) {
+                const void* nl = memchr(data + p, '\n', size - p);
+                after_fence = nl ? static_cast<size_t>(static_cast<const char*>(nl) - data) + 1 : size;
+            }
+        }
+        if (fence) continue;
+        if (!in_tag && c == '<' && p + 1 < size && (is_alpha(data[p + 1]) || data[p + 1] == '/' ||
+                                                   data[p + 1] == '!')) {
+            in_tag = true;
+            tag_start = p;
+        } else if (in_tag && c == '>') {
+            in_tag = false;
+            const char* name = data + tag_start + 1;
+            if (name[0] == '/' ? block_tag(name + 1, end) != 0 : break_tag(name, end)) {
+                block_end = p + 1;      // </p>, </div>, ..., <br>, <hr>
+            }
+        } else if (in_tag && p - tag_start > MAX_TAG) {
+            in_tag = false;
+        }
+    }
+    
+    if (best == CUT_NONE) {
+        // All inside a tag: any UTF-8-safe cut; failing that (binary
+        // data), the plain byte limit
+        if (found_safe) {
+            in_fence = safe_fence;
+            return safe_at;
+        }
+        return limit;
+    }
+    in_fence = best_fence;
+    return best_at;
+}
+
+// Chunk offsets of text cut into pieces of at most chunk_size bytes
+void layout_chunks(const char* data, size_t size, size_t chunk_size, std::vector<uint32_t>& starts) {
+    starts.clear();
+    starts.push_back(0);
+    bool in_fence = false;
+    size_t pos = 0;
+    while (size - pos > chunk_size) {
+        pos = choose_cut(data, size, pos, pos + chunk_size, in_fence);
+        starts.push_back(static_cast<uint32_t>(pos));
+    }
+    if (size > 0) starts.push_back(static_cast<uint32_t>(size));
+}
+
+void count_chunk_tokens(const char* data, const std::vector<uint32_t>& starts, std::vector<uint32_t>& tokens) {
+    tokens.clear();
+    std::string piece;
+    for (size_t c = 0; c + 1 < starts.size(); ++c) {
+        piece.assign(data + starts[c], starts[c + 1] - starts[c]);
+        tokens.push_back(static_cast<uint32_t>(chunk_token_counter().count(piece)));
+    }
+}
+
+void build_layout(ChunkedContent& cc, const char* data, size_t size) {
+    layout_chunks(data, size, cc.chunk_size, cc.chunk_starts);
+    count_chunk_tokens(data, cc.chunk_starts, cc.chunk_tokens);
+    cc.total_chunks = cc.chunk_starts.size() - 1;
+    if (size == 0) cc.total_chunks = 0;
+}
+
+void build_index(ChunkedContent& cc) {
+    const std::string& text = cc.full_content;
+    cc.lower = to_lower(text);
+    
+    cc.line_starts.clear();
+    cc.line_starts.push_back(0);
+    for (const char* p = text.data(), *end = text.data() + text.size();
+         (p = static_cast<const char*>(memchr(p, '\n', end - p))) != NULL; ++p) {
+        cc.line_starts.push_back(static_cast<uint32_t>(p - text.data() + 1));
+    }
+    
+    // Roughly two bits per character keeps false positives per query
+    // trigram low while the signatures stay well under the content size
+    size_t bits = 1024;
+    int log2_bits = 10;
+    while (bits < cc.chunk_size * 2 && bits < 65536) {
+        bits <<= 1;
+        ++log2_bits;
+    }
+    cc.words_per_chunk = bits / 64;
+    cc.signature_shift = 32 - log2_bits;
+    cc.signatures.assign(cc.words_per_chunk * cc.total_chunks, 0);
+    
+    const char* lower = cc.lower.data();
+    size_t size = cc.lower.size();
+    for (size_t c = 0; c < cc.total_chunks; ++c) {
+        uint64_t* sig = &cc.signatures[c * cc.words_per_chunk];
+        size_t from = cc.chunk_begin(c);
+        size_t to = std::min(cc.chunk_begin(c + 1) + SIGNATURE_OVERLAP, size);
+        for (size_t p = from; p + 3 <= to; ++p) {
+            uint32_t bit = trigram_bit(lower + p, cc.signature_shift);
+            sig[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    }
+}
+
+// False when chunk c certainly has no match starting in it
+bool chunk_may_contain(const ChunkedContent& cc, size_t c, const std::string& query_lower) {
+    if (query_lower.size() < 3 || cc.words_per_chunk == 0) return true;
+    const uint64_t* sig = &cc.signatures[c * cc.words_per_chunk];
+    size_t last = std::min(query_lower.size(), SIGNATURE_OVERLAP + 3) - 3;
+    for (size_t i = 0; i <= last; ++i) {
+        uint32_t bit = trigram_bit(query_lower.data() + i, cc.signature_shift);
+        if (!(sig[bit >> 6] & (uint64_t(1) << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+// Non-overlapping case-insensitive matches, visiting candidate chunks only
+std::vector<Match> find_substring(const ChunkedContent& cc, const std::string& query_lower,
+                                  size_t max_matches) {
+    std::vector<Match> matches;
+    const char* lower = cc.lower.data();
+    size_t size = cc.lower.size();
+    size_t qlen = query_lower.size();
+    if (qlen == 0 || qlen > size) return matches;
+    
+    size_t next = 0;    // Matches never overlap: resume after the last one
+    for (size_t c = 0; c < cc.total_chunks && matches.size() < max_matches; ++c) {
+        size_t from = std::max(cc.chunk_begin(c), next);
+        size_t to = std::min(cc.chunk_begin(c + 1), size);      // Match start range
+        if (from >= to || !chunk_may_contain(cc, c, query_lower)) continue;
+        
+        size_t limit = std::min(to + qlen - 1, size);
+        while (from + qlen <= limit && matches.size() < max_matches) {
+            const void* hit = memmem(lower + from, limit - from, query_lower.data(), qlen);
+            if (!hit) break;
+            size_t pos = static_cast<const char*>(hit) - lower;
             Match match;
             match.position = pos;
-            match.length = query.size();
-            match.chunk_index = pos / chunk_size;
+            match.length = qlen;
+            match.chunk_index = c;
             matches.push_back(match);
-            pos += query_lower.size();
+            from = pos + qlen;
+            next = from;
         }
     }
+    return matches;
+}
+
+// Find all matches in content, returns up to max_matches results
+std::vector<Match> find_matches(const ChunkedContent& cc, const std::string& query,
+                                bool use_regex, size_t max_matches = 20) {
+    std::vector<Match> matches;
+    
+    if (!use_regex) {
+        return find_substring(cc, to_lower(query), max_matches);
+    }
+    
+    // Cheap rejection: no occurrence of the required literal, no match
+    std::string literal = to_lower(regex_required_literal(query));
+    if (!literal.empty() && find_substring(cc, literal, 1).empty()) {
+        return matches;
+    }
+    
+    try {
+        std::regex pattern(query, std::regex::icase);
+        const std::string& content = cc.full_content;
+        std::sregex_iterator iter(content.begin(), content.end(), pattern);
+        std::sregex_iterator end;
+        
+        while (iter != end && matches.size() < max_matches) {
+            const std::smatch& m = *iter;
+            Match match;
+            match.position = static_cast<size_t>(m.position());
+            match.length = static_cast<size_t>(m.length());
+            match.chunk_index = cc.chunk_of(match.position);
+            matches.push_back(match);
+            ++iter;
+        }
+    } catch (const std::regex_error&) {
+        // Return empty on invalid regex; caller handles the error
+    }
     
     return matches;
 }
+
+// 1-based line number of a byte offset
+size_t line_of(const ChunkedContent& cc, size_t position) {
+    std::vector<uint32_t>::const_iterator it =
+        std::upper_bound(cc.line_starts.begin(), cc.line_starts.end(), static_cast<uint32_t>(position));
+    return static_cast<size_t>(it - cc.line_starts.begin());
+}
+
+size_t cleaned_size(const ChunkedContent& cc) {
+    size_t bytes = cc.cleaned.capacity() * sizeof(std::string);
+    for (size_t i = 0; i < cc.cleaned.size(); ++i) bytes += cc.cleaned[i].capacity();
+    return bytes;
+}
+
+size_t resident_size(const ChunkedContent& cc) {
+    return sizeof(ChunkedContent) + cc.id.capacity() + cc.source.capacity() + cc.owner.capacity() +
+           cc.full_content.capacity() + cc.lower.capacity() +
+           (cc.line_starts.capacity() + cc.chunk_starts.capacity() + cc.chunk_tokens.capacity()) * sizeof(uint32_t) +
+           cc.signatures.capacity() * sizeof(uint64_t) + cleaned_size(cc);
+}
+
+void release_content(ChunkedContent& cc) {
+    std::string().swap(cc.full_content);
+    std::string().swap(cc.lower);
+    std::vector<uint32_t>().swap(cc.line_starts);
+    std::vector<uint64_t>().swap(cc.signatures);
+    std::vector<std::string>().swap(cc.cleaned);
+}
+
+bool write_file(const std::string& path, const std::string& data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            unlink(path.c_str());
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+    return true;
+}
+
+// Copy [offset, offset + len) of a spill file through a read-only mapping
+bool read_range(const std::string& path, size_t offset, size_t len, std::string& out) {
+    out.clear();
+    if (len == 0) return true;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    
+    long page = sysconf(_SC_PAGESIZE);
+    size_t aligned = offset - offset % static_cast<size_t>(page);
+    size_t span = len + (offset - aligned);
+    void* map = mmap(NULL, span, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    
+    out.assign(static_cast<const char*>(map) + (offset - aligned), len);
+    munmap(map, span);
+    return true;
+}
+
+bool read_spilled(const ChunkedContent& cc, ChunkedContent& into) {
+    if (!read_range(cc.spill_path, 0, cc.content_size, into.full_content)) return false;
+    into.id = cc.id;
+    into.source = cc.source;
+    into.chunk_size = cc.chunk_size;
+    into.total_chunks = cc.total_chunks;
+    into.chunk_starts = cc.chunk_starts;
+    into.content_size = cc.content_size;
+    build_index(into);
+    return true;
+}
 } // anonymous namespace
 
-ContentChunker::ContentChunker() : next_id_(1) {}
+size_t ChunkedContent::chunk_of(size_t position) const {
+    std::vector<uint32_t>::const_iterator it =
+        std::upper_bound(chunk_starts.begin(), chunk_starts.end(), static_cast<uint32_t>(position));
+    size_t c = static_cast<size_t>(it - chunk_starts.begin());
+    return c == 0 ? 0 : std::min(c - 1, total_chunks > 0 ? total_chunks - 1 : 0);
+}
+
+ContentChunker::ContentChunker()
+    : memory_used_(0), disk_used_(0), memory_budget_(0), disk_budget_(0), next_id_(1) {}
+
+ContentChunker::~ContentChunker() {
+    clear();
+}
+
+void ContentChunker::set_limits(size_t memory_budget, const std::string& spill_dir, size_t disk_budget) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_budget_ = memory_budget;
+    disk_budget_ = disk_budget;
+    spill_dir_.clear();
+    
+    if (!spill_dir.empty() && disk_budget > 0) {
+        if (mkdir(spill_dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            LOG_WARN("[ContentChunker] Cannot create spill directory %s: %s",
+                     spill_dir.c_str(), strerror(errno));
+        } else {
+            spill_dir_ = spill_dir;
+            // Ids restart at chunk_1 every run: leftovers would collide
+            DIR* dir = opendir(spill_dir.c_str());
+            if (dir) {
+                size_t removed = 0;
+                struct dirent* entry;
+                while ((entry = readdir(dir)) != NULL) {
+                    std::string name(entry->d_name);
+                    if (name.size() > 6 && name.compare(name.size() - 6, 6, ".chunk") == 0) {
+                        std::string path = spill_dir + "/" + name;
+                        bool live = false;
+                        for (std::map<std::string, ChunkedContent>::const_iterator it = storage_.begin();
+                             it != storage_.end() && !live; ++it) {
+                            live = it->second.spill_path == path;
+                        }
+                        if (!live && unlink(path.c_str()) == 0) ++removed;
+                    }
+                }
+                closedir(dir);
+                if (removed > 0) {
+                    LOG_DEBUG("[ContentChunker] Removed %zu stale spill file(s)", removed);
+                }
+            }
+        }
+    }
+    
+    LOG_INFO("[ContentChunker] Memory budget %zu MB, spill %s",
+             memory_budget_ / (1024 * 1024),
+             spill_dir_.empty() ? "disabled" : (spill_dir_ + " (" +
+                 std::to_string(disk_budget_ / (1024 * 1024)) + " MB)").c_str());
+    enforce_limits("");
+}
 
-std::string ContentChunker::store(const std::string& content, const std::string& source, size_t chunk_size) {
+std::string ContentChunker::store(const std::string& content, const std::string& source, size_t chunk_size,
+                                  const std::string& owner) {
     // Use default if 0 is passed
     if (chunk_size == 0) chunk_size = 8000;
     
-    ChunkedContent cc;
-    cc.id = "chunk_" + std::to_string(next_id_++);
+    // Boundaries and token counts need no lock
+    ChunkedContent layout;
+    layout.chunk_size = chunk_size;
+    build_layout(layout, content.data(), content.size());
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string id = "chunk_" + std::to_string(next_id_++);
+    ChunkedContent& cc = storage_[id];
+    cc.id = id;
     cc.full_content = content;
     cc.source = source;
+    cc.owner = owner;
     cc.chunk_size = chunk_size;
-    cc.total_chunks = (content.size() + chunk_size - 1) / chunk_size;
+    cc.content_size = content.size();
+    cc.total_chunks = layout.total_chunks;
+    cc.chunk_starts.swap(layout.chunk_starts);
+    cc.chunk_tokens.swap(layout.chunk_tokens);
+    build_index(cc);
+    
+    lru_.push_front(id);
+    cc.lru_pos = lru_.begin();
+    account(cc, true);
+    
+    LOG_DEBUG("[ContentChunker] Stored content '%s' from '%s': %zu bytes, %zu chunks, %zu lines",
+              cc.id.c_str(), source.c_str(), content.size(), cc.total_chunks, cc.line_starts.size());
+    
+    enforce_limits(id);
+    return id;
+}
+
+std::string ContentChunker::store_file(const std::string& path, const std::string& source, size_t chunk_size,
+                                       const std::string& owner) {
+    if (chunk_size == 0) chunk_size = 8000;
+    
+    // The file is read once through a mapping to lay out its chunks
+    struct stat st;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return "";
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        static_cast<uint64_t>(st.st_size) > UINT32_MAX) {
+        close(fd);
+        return "";
+    }
+    void* map = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return "";
+    ChunkedContent layout;
+    layout.chunk_size = chunk_size;
+    build_layout(layout, static_cast<const char*>(map), static_cast<size_t>(st.st_size));
+    munmap(map, static_cast<size_t>(st.st_size));
     
-    storage_[cc.id] = cc;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string id = "chunk_" + std::to_string(next_id_++);
+    ChunkedContent& cc = storage_[id];
+    cc.id = id;
+    cc.source = source;
+    cc.owner = owner;
+    cc.chunk_size = chunk_size;
+    cc.content_size = static_cast<size_t>(st.st_size);
+    cc.total_chunks = layout.total_chunks;
+    cc.chunk_starts.swap(layout.chunk_starts);
+    cc.chunk_tokens.swap(layout.chunk_tokens);
+    cc.spill_path = path;
+    cc.external = true;
+    cc.file_mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
     
-    LOG_DEBUG("[ContentChunker] Stored content '%s' from '%s': %zu bytes, %zu chunks",
-              cc.id.c_str(), source.c_str(), content.size(), cc.total_chunks);
+    lru_.push_front(id);
+    cc.lru_pos = lru_.begin();
     
-    return cc.id;
+    LOG_DEBUG("[ContentChunker] Registered file '%s' as '%s': %zu bytes, %zu chunks",
+              path.c_str(), id.c_str(), cc.content_size, cc.total_chunks);
+    return id;
+}
+
+// ============================================================================
+// Residency (mutex_ held)
+// ============================================================================
+
+void ContentChunker::account(ChunkedContent& cc, bool resident) {
+    if (resident) {
+        cc.resident_bytes = resident_size(cc);
+        memory_used_ += cc.resident_bytes;
+        owner_bytes_[cc.owner] += cc.resident_bytes;
+        return;
+    }
+    memory_used_ -= cc.resident_bytes;
+    std::map<std::string, size_t>::iterator ob = owner_bytes_.find(cc.owner);
+    if (ob != owner_bytes_.end()) {
+        ob->second -= cc.resident_bytes;
+        if (ob->second == 0) owner_bytes_.erase(ob);
+    }
+    cc.resident_bytes = 0;
+}
+
+void ContentChunker::touch(ChunkedContent& cc) {
+    lru_.splice(lru_.begin(), lru_, cc.lru_pos);
 }
 
-std::string ContentChunker::get_chunk(const std::string& id, size_t chunk_index, bool clean_html) const {
+bool ContentChunker::file_changed(const ChunkedContent& cc) const {
+    if (!cc.external) return false;
+    // Reading a mapping past a truncated end would fault, so check first
+    struct stat st;
+    if (stat(cc.spill_path.c_str(), &st) != 0) return true;
+    int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return static_cast<size_t>(st.st_size) != cc.content_size || mtime != cc.file_mtime_ns;
+}
+
+void ContentChunker::erase(std::map<std::string, ChunkedContent>::iterator it) {
+    ChunkedContent& cc = it->second;
+    if (cc.external) {
+        // Not ours to delete
+    } else if (cc.spilled()) {
+        unlink(cc.spill_path.c_str());
+        disk_used_ -= cc.content_size;
+    } else {
+        account(cc, false);
+    }
+    lru_.erase(cc.lru_pos);
+    storage_.erase(it);
+}
+
+bool ContentChunker::spill(ChunkedContent& cc) {
+    if (spill_dir_.empty() || cc.content_size > disk_budget_) return false;
+    
+    std::string path = spill_dir_ + "/" + cc.id + ".chunk";
+    if (!write_file(path, cc.full_content)) {
+        LOG_WARN("[ContentChunker] Failed to spill '%s' to %s: %s",
+                 cc.id.c_str(), path.c_str(), strerror(errno));
+        return false;
+    }
+    account(cc, false);
+    release_content(cc);
+    cc.spill_path = path;
+    disk_used_ += cc.content_size;
+    LOG_DEBUG("[ContentChunker] Spilled '%s' (%zu bytes) to disk", cc.id.c_str(), cc.content_size);
+    
+    // Over the disk budget, oldest spill files go first: the same owner's,
+    // then anyone's
+    for (int pass = 0; pass < 2 && disk_used_ > disk_budget_; ++pass) {
+        std::list<std::string>::iterator pos = lru_.end();
+        while (disk_used_ > disk_budget_ && pos != lru_.begin()) {
+            --pos;
+            std::map<std::string, ChunkedContent>::iterator it = storage_.find(*pos);
+            if (it == storage_.end() || !it->second.spilled() || it->second.external ||
+                it->first == cc.id) continue;
+            if (pass == 0 && it->second.owner != cc.owner) continue;
+            LOG_DEBUG("[ContentChunker] Dropping spilled '%s' (disk budget)", it->first.c_str());
+            std::list<std::string>::iterator next = pos;
+            ++next;
+            erase(it);
+            pos = next;
+        }
+    }
+    return true;
+}
+
+bool ContentChunker::load(ChunkedContent& cc) {
+    ChunkedContent loaded;
+    if (!read_spilled(cc, loaded)) {
+        LOG_WARN("[ContentChunker] Spill file for '%s' unreadable: %s", cc.id.c_str(), strerror(errno));
+        return false;
+    }
+    cc.full_content.swap(loaded.full_content);
+    cc.lower.swap(loaded.lower);
+    cc.line_starts.swap(loaded.line_starts);
+    cc.signatures.swap(loaded.signatures);
+    cc.words_per_chunk = loaded.words_per_chunk;
+    cc.signature_shift = loaded.signature_shift;
+    
+    unlink(cc.spill_path.c_str());
+    cc.spill_path.clear();
+    disk_used_ -= cc.content_size;
+    account(cc, true);
+    enforce_limits(cc.id);
+    return true;
+}
+
+void ContentChunker::enforce_limits(const std::string& keep_id) {
+    while (memory_budget_ > 0 && memory_used_ > memory_budget_) {
+        // An owner over its fair share pays for what it just added; otherwise
+        // the heaviest owner pays, with its least recently used content
+        std::string owner;
+        size_t most = 0;
+        for (std::map<std::string, size_t>::const_iterator ob = owner_bytes_.begin();
+             ob != owner_bytes_.end(); ++ob) {
+            if (ob->second > most) {
+                most = ob->second;
+                owner = ob->first;
+            }
+        }
+        std::map<std::string, ChunkedContent>::const_iterator kept = storage_.find(keep_id);
+        if (kept != storage_.end() && !kept->second.spilled()) {
+            std::map<std::string, size_t>::const_iterator ob = owner_bytes_.find(kept->second.owner);
+            if (ob != owner_bytes_.end() && ob->second >= memory_budget_ / owner_bytes_.size()) {
+                owner = ob->first;
+            }
+        }
+        
+        std::map<std::string, ChunkedContent>::iterator victim = storage_.end();
+        std::map<std::string, ChunkedContent>::iterator fallback = storage_.end();
+        for (std::list<std::string>::reverse_iterator r = lru_.rbegin(); r != lru_.rend(); ++r) {
+            std::map<std::string, ChunkedContent>::iterator it = storage_.find(*r);
+            if (it == storage_.end() || it->second.spilled() || it->second.owner != owner) continue;
+            if (it->first == keep_id) {
+                fallback = it;   // Only if the owner has nothing else resident
+                continue;
+            }
+            victim = it;
+            break;
+        }
+        if (victim == storage_.end()) victim = fallback;
+        if (victim == storage_.end()) break;
+        
+        if (!spill(victim->second)) {
+            LOG_DEBUG("[ContentChunker] Evicting '%s' (%zu bytes, memory budget)",
+                      victim->first.c_str(), victim->second.content_size);
+            erase(victim);
+        }
+    }
+}
+
+std::string ContentChunker::get_chunk(const std::string& id, size_t chunk_index, bool clean_html,
+                                      size_t max_tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = storage_.find(id);
     if (it == storage_.end()) {
         return "Error: Content ID '" + id + "' not found.";
     }
     
-    const auto& [content_id, cc] = *it;
+    auto& [content_id, cc] = *it;
     if (chunk_index >= cc.total_chunks) {
         return "Error: Chunk index " + std::to_string(chunk_index) + 
                " out of range. Total chunks: " + std::to_string(cc.total_chunks);
     }
+    if (file_changed(cc)) {
+        std::string path = cc.spill_path;
+        erase(it);
+        return "Error: " + path + " changed on disk since it was read. Read it again.";
+    }
+    touch(cc);
     
-    size_t start = chunk_index * cc.chunk_size;
-    size_t len = std::min(cc.chunk_size, cc.full_content.size() - start);
+    // Following chunks join while their (raw) token counts fit
+    size_t last = chunk_index;
+    size_t tokens = cc.chunk_tokens[chunk_index];
+    while (max_tokens > 0 && last + 1 < cc.total_chunks && tokens + cc.chunk_tokens[last + 1] <= max_tokens) {
+        tokens += cc.chunk_tokens[++last];
+    }
     
-    std::string chunk_content = cc.full_content.substr(start, len);
+    // Paging through spilled content reads just these chunks from disk
+    size_t start = cc.chunk_begin(chunk_index);
+    size_t len = cc.chunk_begin(last + 1) - start;
+    std::string chunk_content;
+    if (!cc.spilled()) {
+        if (!clean_html) chunk_content = cc.full_content.substr(start, len);
+    } else if (!read_range(cc.spill_path, start, len, chunk_content)) {
+        LOG_WARN("[ContentChunker] Spill file for '%s' unreadable: %s", content_id.c_str(), strerror(errno));
+        erase(it);
+        return "Error: Content ID '" + id + "' not found.";
+    }
     
-    // Apply HTML cleaning if requested
+    // Chunks end outside tags, so each one cleans on its own. Resident
+    // content keeps the cleaned text for the next request.
+    bool cached = false;
     if (clean_html) {
-        chunk_content = strip_html_for_ai(chunk_content);
+        std::string cleaned;
+        if (cc.cleaned.size() != cc.total_chunks && !cc.spilled()) cc.cleaned.resize(cc.total_chunks);
+        for (size_t c = chunk_index; c <= last; ++c) {
+            if (!cc.spilled()) {
+                if (cc.cleaned[c].empty()) {
+                    cc.cleaned[c] = strip_html_for_ai(cc.full_content.substr(cc.chunk_begin(c), cc.chunk_length(c)));
+                    cached = true;
+                }
+                cleaned += cc.cleaned[c];
+            } else {
+                cleaned += strip_html_for_ai(chunk_content.substr(cc.chunk_begin(c) - start, cc.chunk_length(c)));
+            }
+        }
+        chunk_content.swap(cleaned);
+        tokens = chunk_token_counter().count(chunk_content);
     }
     
     std::ostringstream oss;
-    oss << "[Chunk " << (chunk_index + 1) << "/" << cc.total_chunks 
-        << " from " << cc.source;
+    if (last == chunk_index) {
+        oss << "[Chunk " << (chunk_index + 1) << "/" << cc.total_chunks;
+    } else {
+        oss << "[Chunks " << (chunk_index + 1) << "-" << (last + 1) << "/" << cc.total_chunks;
+    }
+    oss << " from " << cc.source << ", ~" << tokens << " tokens";
     if (clean_html) {
         oss << " (HTML cleaned)";
     }
     oss << "]\n";
     oss << chunk_content;
     
-    if (chunk_index + 1 < cc.total_chunks) {
+    if (last + 1 < cc.total_chunks) {
         oss << "\n\n[Use content_chunk tool with id=\"" << id 
-            << "\" and chunk=" << (chunk_index + 1) << " for next chunk]";
+            << "\" and chunk=" << (last + 1) << " for next chunk]";
     } else {
         oss << "\n\n[End of content]";
     }
     
+    if (cached) {
+        account(cc, false);
+        account(cc, true);
+        enforce_limits(id);
+    }
     return oss.str();
 }
 
 std::string ContentChunker::get_info(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = storage_.find(id);
     if (it == storage_.end()) {
         return "Content ID '" + id + "' not found.";
     }
     
     const auto& [content_id, cc] = *it;
+    size_t total_tokens = 0;
+    size_t most_tokens = 0;
+    for (size_t c = 0; c < cc.chunk_tokens.size(); ++c) {
+        total_tokens += cc.chunk_tokens[c];
+        most_tokens = std::max(most_tokens, static_cast<size_t>(cc.chunk_tokens[c]));
+    }
+    
     std::ostringstream oss;
     oss << "Content ID: " << cc.id << "\n";
     oss << "Source: " << cc.source << "\n";
-    oss << "Total size: " << cc.full_content.size() << " characters\n";
-    oss << "Total chunks: " << cc.total_chunks << " (each ~" << cc.chunk_size << " chars)\n";
+    oss << "Total size: " << cc.content_size << " characters, ~" << total_tokens << " tokens\n";
+    oss << "Total chunks: " << cc.total_chunks << " (up to " << cc.chunk_size
+        << " chars each, largest ~" << most_tokens << " tokens)\n";
+    if (cc.total_chunks > 1 && cc.total_chunks <= 64) {
+        oss << "Tokens per chunk:";
+        for (size_t c = 0; c < cc.chunk_tokens.size(); ++c) {
+            oss << (c == 0 ? " " : ", ") << c << ":" << cc.chunk_tokens[c];
+        }
+        oss << "\n";
+    }
     
     return oss.str();
 }
 
-std::string ContentChunker::search_with_chunks(const std::string& id, const std::string& query, size_t context_chars, bool use_regex) const {
+std::string ContentChunker::search_with_chunks(const std::string& id, const std::string& query, size_t context_chars, bool use_regex) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = storage_.find(id);
     if (it == storage_.end()) {
         return "Content ID '" + id + "' not found.";
     }
     
-    const auto& [content_id, cc] = *it;
+    if (file_changed(it->second)) {
+        std::string path = it->second.spill_path;
+        erase(it);
+        return "Error: " + path + " changed on disk since it was read. Read it again.";
+    }
+    
+    // The model is working on this content: bring it back into memory.
+    // If the budget cannot hold it, search a temporary copy instead.
+    // Registered files are always searched from a temporary copy.
+    ChunkedContent scratch;
+    if (it->second.spilled()) {
+        if (!it->second.external) load(it->second);
+        if (it->second.spilled() && !read_spilled(it->second, scratch)) {
+            erase(it);
+            return "Content ID '" + id + "' not found.";
+        }
+    }
+    touch(it->second);
+    const ChunkedContent& cc = it->second.spilled() ? scratch : it->second;
     
     // Use shared search helper
-    std::vector<Match> matches = find_matches(cc.full_content, query, cc.chunk_size, use_regex);
+    std::vector<Match> matches = find_matches(cc, query, use_regex);
     
     // Handle regex error (empty matches + regex mode might be a parse error)
     if (matches.empty() && use_regex) {
@@ -209,7 +913,7 @@ std::string ContentChunker::search_with_chunks(const std::string& id, const std:
             size_t start = (match_pos > context_chars) ? (match_pos - context_chars) : 0;
             size_t end = std::min(match_pos + match_len + context_chars, cc.full_content.size());
             
-            oss << "Match preview:\n";
+            oss << "Match preview (line " << line_of(cc, match_pos) << "):\n";
             if (start > 0) oss << "...";
             oss << cc.full_content.substr(start, end - start);
             if (end < cc.full_content.size()) oss << "...";
@@ -224,7 +928,8 @@ std::string ContentChunker::search_with_chunks(const std::string& id, const std:
     return oss.str();
 }
 
-std::string ContentChunker::search_all_chunks(const std::string& query, size_t context_chars, bool use_regex) const {
+std::string ContentChunker::search_all_chunks(const std::string& query, size_t context_chars, bool use_regex) {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (storage_.empty()) {
         return "No content is currently stored. All chunks have expired or been cleared.";
     }
@@ -241,10 +946,16 @@ std::string ContentChunker::search_all_chunks(const std::string& query, size_t c
          it != storage_.end(); ++it) {
         
         const std::string& content_id = it->first;
-        const ChunkedContent& cc = it->second;
+        
+        // Spilled contents are searched from a temporary copy, without
+        // pushing anyone's working set out of memory
+        ChunkedContent scratch;
+        if (file_changed(it->second)) continue;
+        if (it->second.spilled() && !read_spilled(it->second, scratch)) continue;
+        const ChunkedContent& cc = it->second.spilled() ? scratch : it->second;
         
         // Use shared search helper
-        std::vector<Match> matches = find_matches(cc.full_content, query, cc.chunk_size, use_regex);
+        std::vector<Match> matches = find_matches(cc, query, use_regex);
         
         // If we found matches in this content, display them
         if (!matches.empty()) {
@@ -288,7 +999,7 @@ std::string ContentChunker::search_all_chunks(const std::string& query, size_t c
                     size_t start = (match_pos > context_chars) ? (match_pos - context_chars) : 0;
                     size_t end = std::min(match_pos + match_len + context_chars, cc.full_content.size());
                     
-                    oss << "  Preview: ";
+                    oss << "  Preview (line " << line_of(cc, match_pos) << "): ";
                     if (start > 0) oss << "...";
                     oss << cc.full_content.substr(start, end - start);
                     if (end < cc.full_content.size()) oss << "...";
@@ -316,19 +1027,32 @@ std::string ContentChunker::search_all_chunks(const std::string& query, size_t c
 }
 
 bool ContentChunker::has(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return storage_.find(id) != storage_.end();
 }
 
 void ContentChunker::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<std::string, ChunkedContent>::const_iterator it = storage_.begin();
+         it != storage_.end(); ++it) {
+        if (it->second.spilled() && !it->second.external) unlink(it->second.spill_path.c_str());
+    }
     storage_.clear();
+    lru_.clear();
+    owner_bytes_.clear();
+    memory_used_ = 0;
+    disk_used_ = 0;
     LOG_DEBUG("[ContentChunker] Cleared all stored content");
 }
 
 void ContentChunker::remove(const std::string& id) {
-    storage_.erase(id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, ChunkedContent>::iterator it = storage_.find(id);
+    if (it != storage_.end()) erase(it);
 }
 
 size_t ContentChunker::get_total_chunks(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = storage_.find(id);
     if (it == storage_.end()) {
         return 0;
@@ -337,4 +1061,19 @@ size_t ContentChunker::get_total_chunks(const std::string& id) const {
     return cc.total_chunks;
 }
 
+size_t ContentChunker::memory_used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_used_;
+}
+
+std::map<std::string, size_t> ContentChunker::owner_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return owner_bytes_;
+}
+
+size_t ContentChunker::disk_used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return disk_used_;
+}
+
 } // namespace opencrank
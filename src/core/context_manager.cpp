@@ -8,14 +8,23 @@
  *   2. The resume is saved to persistent memory (SQLite)
  *   3. The conversation history is wiped
  *   4. The resume is injected as context for seamless continuation
+ *
+ * With a thread pool the resume is usually ready before it is needed:
+ * prepare_summary() folds new messages into a rolling per-session
+ * summary on the background lane, and the cycle swaps that in.
  */
 #include <opencrank/core/context_manager.hpp>
+#include <opencrank/ai/models.hpp>
 #include <opencrank/core/memory_tool.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/trace.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/thread_pool.hpp>
 
 #include <sstream>
 #include <ctime>
 #include <iomanip>
+#include <algorithm>
 
 namespace opencrank {
 
@@ -23,8 +32,45 @@ namespace opencrank {
 // ContextManager Implementation
 // ============================================================================
 
+namespace {
+// Role tags and chat template tokens around each message
+const size_t MESSAGE_OVERHEAD_TOKENS = 4;
+
+// Bytes of one message quoted into a fold request (tool results can be huge)
+const size_t FOLD_MESSAGE_CHARS = 2000;
+
+// Sessions with a rolling summary kept at once
+const size_t MAX_SUMMARIES = 256;
+
+// FNV-1a over role and content of history[0, count)
+uint64_t hash_prefix(const std::vector<ConversationMessage>& history, size_t count) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < count && i < history.size(); ++i) {
+        h = (h ^ static_cast<uint64_t>(history[i].role)) * 1099511628211ULL;
+        const std::string& content = history[i].content;
+        for (size_t j = 0; j < content.size(); ++j) {
+            h = (h ^ static_cast<unsigned char>(content[j])) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+// Where a summary of history can end: the latest user message (or tool
+// result) starts the kept tail, so the resumed history still alternates
+size_t summary_cut(const std::vector<ConversationMessage>& history) {
+    for (size_t i = history.size(); i > 0; --i) {
+        if (history[i - 1].role == MessageRole::USER) return i - 1;
+    }
+    return 0;
+}
+}
+
 ContextManager::ContextManager()
     : memory_tool_(nullptr)
+    , counter_(std::make_shared<ApproxTokenCounter>())
+    , pool_(nullptr)
+    , counted_prompt_tokens_(0)
+    , counted_prompt_counter_(0)
 {}
 
 ContextManager::~ContextManager() {}
@@ -33,28 +79,69 @@ void ContextManager::set_config(const ContextManagerConfig& config) {
     config_ = config;
 }
 
-size_t ContextManager::estimate_chars(const std::vector<ConversationMessage>& messages) const {
-    size_t total = 0;
+void ContextManager::set_token_counter(std::shared_ptr<TokenCounter> counter) {
+    if (counter) counter_ = counter;
+}
+
+size_t ContextManager::count_tokens(const ConversationMessage& message) const {
+    if (message.token_counter_id != counter_->id() ||
+        message.token_count_bytes != message.content.size()) {
+        message.token_count = counter_->count(message.content) + MESSAGE_OVERHEAD_TOKENS;
+        message.token_count_bytes = message.content.size();
+        message.token_counter_id = counter_->id();
+    }
+    return message.token_count;
+}
+
+size_t ContextManager::count_system_prompt(const std::string& system_prompt) const {
+    if (system_prompt.empty()) return 0;
+    {
+        std::lock_guard<std::mutex> lock(prompt_mutex_);
+        if (counted_prompt_counter_ == counter_->id() && counted_prompt_ == system_prompt) {
+            return counted_prompt_tokens_;
+        }
+    }
+    size_t tokens = counter_->count(system_prompt) + MESSAGE_OVERHEAD_TOKENS;
+    std::lock_guard<std::mutex> lock(prompt_mutex_);
+    counted_prompt_ = system_prompt;
+    counted_prompt_tokens_ = tokens;
+    counted_prompt_counter_ = counter_->id();
+    return tokens;
+}
+
+size_t ContextManager::count_tokens(
+    const std::vector<ConversationMessage>& messages,
+    const std::string& system_prompt) const
+{
+    size_t total = count_system_prompt(system_prompt);
     for (size_t i = 0; i < messages.size(); ++i) {
-        total += messages[i].content.size();
-        total += 20; // Role tags, formatting overhead per message
+        total += count_tokens(messages[i]);
     }
     return total;
 }
 
+size_t ContextManager::budget_tokens() const {
+    return config_.max_context_tokens > config_.reserve_for_response
+        ? config_.max_context_tokens - config_.reserve_for_response
+        : 0;
+}
+
 ContextUsage ContextManager::estimate_usage(
     const std::vector<ConversationMessage>& history,
     const std::string& system_prompt) const
 {
     ContextUsage usage;
-    usage.system_prompt_chars = system_prompt.size();
-    usage.history_chars = estimate_chars(history);
-    usage.total_chars = usage.system_prompt_chars + usage.history_chars;
-    usage.budget_chars = config_.max_context_chars - config_.reserve_for_response;
-    
-    if (usage.budget_chars > 0) {
-        usage.usage_ratio = static_cast<double>(usage.total_chars) / 
-                            static_cast<double>(usage.budget_chars);
+    usage.system_prompt_tokens = count_system_prompt(system_prompt);
+    usage.history_tokens = 0;
+    for (size_t i = 0; i < history.size(); ++i) {
+        usage.history_tokens += count_tokens(history[i]);
+    }
+    usage.total_tokens = usage.system_prompt_tokens + usage.history_tokens;
+    usage.budget_tokens = budget_tokens();
+    
+    if (usage.budget_tokens > 0) {
+        usage.usage_ratio = static_cast<double>(usage.total_tokens) / 
+                            static_cast<double>(usage.budget_tokens);
     } else {
         usage.usage_ratio = 1.0;
     }
@@ -119,7 +206,7 @@ std::string ContextManager::generate_resume(
     LOG_INFO("[ContextManager] Generating conversation resume (%zu messages in history)",
              history.size());
     
-    CompletionResult result = ai->chat(resume_messages, opts);
+    CompletionResult result = PurposeModels::instance().chat(PURPOSE_RESUME, ai, resume_messages, opts);
     
     if (!result.success) {
         LOG_ERROR("[ContextManager] Failed to generate resume: %s", result.error.c_str());
@@ -140,6 +227,172 @@ std::string ContextManager::generate_resume(
     return resume;
 }
 
+std::string ContextManager::fold_summary(
+    AIPlugin* ai,
+    const std::string& previous,
+    const std::vector<ConversationMessage>& messages) const
+{
+    if (!ai || !ai->is_configured()) return "";
+    
+    // Only the new messages go out, quoted as a transcript: the request
+    // stays small however long the conversation is
+    std::ostringstream prompt;
+    prompt << "Below is the resume of a conversation so far, followed by the messages "
+           << "that came after it. Write an updated resume that covers both.\n\n"
+           << "## Resume so far\n\n" << (previous.empty() ? std::string("(none yet)") : previous)
+           << "\n\n## Messages since\n\n";
+    for (size_t i = 0; i < messages.size(); ++i) {
+        prompt << "### " << role_to_string(messages[i].role) << "\n";
+        if (messages[i].content.size() > FOLD_MESSAGE_CHARS) {
+            prompt << truncate_safe(messages[i].content, FOLD_MESSAGE_CHARS) << "\n[...]\n\n";
+        } else {
+            prompt << messages[i].content << "\n\n";
+        }
+    }
+    prompt << "## Task\n\n" << build_resume_prompt();
+    
+    std::vector<ConversationMessage> request;
+    request.push_back(ConversationMessage::user(prompt.str()));
+    
+    CompletionOptions opts;
+    opts.system_prompt = "You keep a running resume of a conversation between a user and an AI assistant.";
+    opts.max_tokens = 2048;
+    opts.temperature = 0.3;
+    opts.skip_context_management = true;
+    
+    CompletionResult result = PurposeModels::instance().chat(PURPOSE_RESUME, ai, request, opts);
+    if (!result.success) {
+        LOG_WARN("[ContextManager] Background summary failed: %s", result.error.c_str());
+        return "";
+    }
+    
+    std::string summary = result.content;
+    if (summary.size() > config_.max_resume_chars) {
+        summary = truncate_safe(summary, config_.max_resume_chars) + "\n\n[Resume truncated due to size limits]";
+    }
+    return summary;
+}
+
+void ContextManager::prepare_summary(
+    AIPlugin* ai,
+    const std::vector<ConversationMessage>& history,
+    const ContextUsage& usage,
+    const std::string& session_key)
+{
+    if (!pool_ || !ai || !config_.background_summary || usage.usage_ratio < config_.summary_start) {
+        return;
+    }
+    
+    size_t cut = summary_cut(history);
+    std::string previous;
+    size_t covered;
+    {
+        std::lock_guard<std::mutex> lock(summary_mutex_);
+        RollingSummary& state = summaries_[session_key];
+        state.last_used_ms = current_timestamp_ms();
+        if (state.pending) return;
+        
+        // A rewritten history (truncation, /reset) starts the summary over
+        if (state.covered > 0 &&
+            (state.covered > history.size() || hash_prefix(history, state.covered) != state.prefix_hash)) {
+            LOG_DEBUG("[ContextManager] History of '%s' changed, restarting its summary", session_key.c_str());
+            state = RollingSummary();
+            state.last_used_ms = current_timestamp_ms();
+        }
+        if (cut <= state.covered || cut - state.covered < std::max<size_t>(1, config_.summary_window)) {
+            return;
+        }
+        
+        state.pending = true;
+        previous = state.text;
+        covered = state.covered;
+        
+        if (summaries_.size() > MAX_SUMMARIES) {
+            std::map<std::string, RollingSummary>::iterator oldest = summaries_.end();
+            for (std::map<std::string, RollingSummary>::iterator it = summaries_.begin();
+                 it != summaries_.end(); ++it) {
+                if (!it->second.pending && (oldest == summaries_.end() ||
+                                            it->second.last_used_ms < oldest->second.last_used_ms)) {
+                    oldest = it;
+                }
+            }
+            if (oldest != summaries_.end()) summaries_.erase(oldest);
+        }
+    }
+    
+    // The history belongs to the caller and keeps growing: copy the window
+    std::vector<ConversationMessage> window(history.begin() + covered, history.begin() + cut);
+    uint64_t prefix_hash = hash_prefix(history, cut);
+    LOG_DEBUG("[ContextManager] Queueing background summary of messages %zu-%zu for '%s' (usage %.0f%%)",
+              covered, cut, session_key.c_str(), usage.usage_ratio * 100.0);
+    
+    pool_->enqueue(Task([this, ai, session_key, previous, window, covered, cut, prefix_hash]() {
+        ScopedSpan span("summary_fold", "context");
+        span.set("messages", window.size());
+        std::string text = fold_summary(ai, previous, window);
+        
+        std::lock_guard<std::mutex> lock(summary_mutex_);
+        std::map<std::string, RollingSummary>::iterator it = summaries_.find(session_key);
+        if (it == summaries_.end()) return;
+        it->second.pending = false;
+        // Dropped if the session restarted its summary meanwhile
+        if (text.empty() || it->second.covered != covered) return;
+        it->second.text = text;
+        it->second.covered = cut;
+        it->second.prefix_hash = prefix_hash;
+        LOG_INFO("[ContextManager] Background summary for '%s' now covers %zu messages (%zu chars)",
+                 session_key.c_str(), cut, text.size());
+    }), TaskPriority::BACKGROUND);
+}
+
+bool ContextManager::swap_in_summary(
+    std::vector<ConversationMessage>& history,
+    const std::string& system_prompt,
+    const std::string& session_key)
+{
+    std::string text;
+    size_t covered;
+    {
+        std::lock_guard<std::mutex> lock(summary_mutex_);
+        std::map<std::string, RollingSummary>::iterator it = summaries_.find(session_key);
+        if (it == summaries_.end() || it->second.text.empty() || it->second.covered == 0 ||
+            it->second.covered > history.size() ||
+            hash_prefix(history, it->second.covered) != it->second.prefix_hash) {
+            return false;
+        }
+        it->second.last_used_ms = current_timestamp_ms();
+        text = it->second.text;
+        covered = it->second.covered;
+    }
+    
+    std::vector<ConversationMessage> fresh = build_resumed_history(text, "", system_prompt);
+    fresh.insert(fresh.end(), history.begin() + covered, history.end());
+    
+    ContextUsage usage = estimate_usage(fresh, system_prompt);
+    if (usage.needs_resume) {
+        LOG_INFO("[ContextManager] Pre-built summary leaves %.0f%% in use, generating a new resume",
+                 usage.usage_ratio * 100.0);
+        return false;
+    }
+    
+    history.swap(fresh);
+    return true;
+}
+
+void ContextManager::store_summary(
+    const std::string& session_key,
+    const std::string& text,
+    size_t covered,
+    uint64_t prefix_hash)
+{
+    std::lock_guard<std::mutex> lock(summary_mutex_);
+    RollingSummary& state = summaries_[session_key];
+    state.text = text;
+    state.covered = covered;
+    state.prefix_hash = prefix_hash;
+    state.last_used_ms = current_timestamp_ms();
+}
+
 bool ContextManager::save_resume_to_memory(
     const std::string& resume,
     const std::string& session_key)
@@ -263,23 +516,47 @@ bool ContextManager::perform_resume_cycle(
     const std::string& system_prompt,
     const std::string& session_key)
 {
+    ScopedSpan span("resume_cycle", "context");
     LOG_INFO("[ContextManager] ═══════════════════════════════════════");
     LOG_INFO("[ContextManager] Starting context resume cycle");
     
     ContextUsage usage = estimate_usage(history, system_prompt);
-    LOG_INFO("[ContextManager] Current usage: %.1f%% (%zu/%zu chars, %zu messages)",
-             usage.usage_ratio * 100.0, usage.total_chars, usage.budget_chars,
+    span.set("tokens_before", usage.total_tokens);
+    span.set("messages_before", history.size());
+    LOG_INFO("[ContextManager] Current usage: %.1f%% (%zu/%zu tokens, %zu messages)",
+             usage.usage_ratio * 100.0, usage.total_tokens, usage.budget_tokens,
              history.size());
     
+    // Step 0: A summary built in the background makes this instant
+    size_t messages_before = history.size();
+    if (swap_in_summary(history, system_prompt, session_key)) {
+        ContextUsage new_usage = estimate_usage(history, system_prompt);
+        LOG_INFO("[ContextManager] Swapped in the pre-built summary: %zu -> %zu messages, %.1f%% usage",
+                 messages_before, history.size(), new_usage.usage_ratio * 100.0);
+        LOG_INFO("[ContextManager] ═══════════════════════════════════════");
+        span.set("prebuilt", true);
+        span.set("tokens_after", new_usage.total_tokens);
+        span.set("success", true);
+        return true;
+    }
+    span.set("prebuilt", false);
+    
     // Step 1: Generate resume
     LOG_INFO("[ContextManager] Step 1: Generating conversation resume...");
     std::string resume = generate_resume(ai, history, system_prompt);
     
     if (resume.empty()) {
         LOG_ERROR("[ContextManager] Failed to generate resume, aborting cycle");
+        span.set("success", false);
         return false;
     }
     
+    // Later requests of the session reuse it (Step 0)
+    size_t cut = summary_cut(history);
+    if (cut > 0) {
+        store_summary(session_key, resume, cut, hash_prefix(history, cut));
+    }
+    
     // Step 2: Save resume to persistent memory
     if (config_.auto_save_memory) {
         LOG_INFO("[ContextManager] Step 2: Saving resume to persistent memory...");
@@ -307,10 +584,12 @@ bool ContextManager::perform_resume_cycle(
     history = build_resumed_history(resume, last_user_message, system_prompt);
     
     ContextUsage new_usage = estimate_usage(history, system_prompt);
-    LOG_INFO("[ContextManager] Context resumed: %.1f%% usage (%zu/%zu chars, %zu messages)",
-             new_usage.usage_ratio * 100.0, new_usage.total_chars, new_usage.budget_chars,
+    LOG_INFO("[ContextManager] Context resumed: %.1f%% usage (%zu/%zu tokens, %zu messages)",
+             new_usage.usage_ratio * 100.0, new_usage.total_tokens, new_usage.budget_tokens,
              history.size());
     LOG_INFO("[ContextManager] ═══════════════════════════════════════");
+    span.set("tokens_after", new_usage.total_tokens);
+    span.set("success", true);
     
     return true;
 }
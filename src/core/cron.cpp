@@ -0,0 +1,327 @@
+/*
+ * OpenCrank C++ - CRON Schedules and Scheduler Implementation
+ */
+#include <opencrank/core/cron.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cctype>
+
+namespace opencrank {
+
+namespace {
+
+const char* const MONTH_NAMES[] = {
+    "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+};
+const char* const WEEKDAY_NAMES[] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+const int MAX_YEARS_AHEAD = 5;
+
+// Number or (for months/weekdays) three-letter name; -1 if neither
+int parse_value(const std::string& token, const char* const* names, int name_count, int name_base) {
+    if (token.empty()) return -1;
+    if (std::isdigit(static_cast<unsigned char>(token[0]))) {
+        char* end = nullptr;
+        long v = std::strtol(token.c_str(), &end, 10);
+        if (*end != '\0' || v > 1000) return -1;
+        return static_cast<int>(v);
+    }
+    std::string name = to_lower(token);
+    for (int i = 0; i < name_count; ++i) {
+        if (name == names[i]) return i + name_base;
+    }
+    return -1;
+}
+
+// One comma-separated field into a bitmask over [lo, hi]. `any` is set
+// for a bare '*'.
+bool parse_field(const std::string& field, int lo, int hi,
+                 const char* const* names, int name_count, int name_base,
+                 uint64_t& bits, bool& any, std::string& error) {
+    bits = 0;
+    any = (field == "*");
+    std::stringstream ss(field);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int step = 1;
+        size_t slash = item.find('/');
+        std::string range = item;
+        if (slash != std::string::npos) {
+            range = item.substr(0, slash);
+            step = parse_value(item.substr(slash + 1), nullptr, 0, 0);
+            if (step <= 0) {
+                error = "bad step in '" + item + "'";
+                return false;
+            }
+        }
+
+        int first;
+        int last;
+        if (range == "*") {
+            first = lo;
+            last = hi;
+        } else {
+            size_t dash = range.find('-');
+            first = parse_value(range.substr(0, dash), names, name_count, name_base);
+            last = dash == std::string::npos
+                ? (slash != std::string::npos ? hi : first)      // "5/15" means 5-max/15
+                : parse_value(range.substr(dash + 1), names, name_count, name_base);
+        }
+        if (first < lo || last > hi || first > last) {
+            error = "'" + item + "' out of range " + std::to_string(lo) + "-" + std::to_string(hi);
+            return false;
+        }
+        for (int v = first; v <= last; v += step) {
+            bits |= (1ULL << v);
+        }
+    }
+    if (bits == 0) {
+        error = "empty field";
+        return false;
+    }
+    return true;
+}
+
+std::string expand_macro(const std::string& expr) {
+    std::string e = to_lower(expr);
+    if (e == "@yearly" || e == "@annually") return "0 0 1 1 *";
+    if (e == "@monthly") return "0 0 1 * *";
+    if (e == "@weekly") return "0 0 * * 0";
+    if (e == "@daily" || e == "@midnight") return "0 0 * * *";
+    if (e == "@hourly") return "0 * * * *";
+    return expr;
+}
+
+// mktime() with DST resolved by the library
+time_t normalize(std::tm& tm) {
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+} // namespace
+
+// ============================================================================
+// CronSchedule
+// ============================================================================
+
+CronSchedule::CronSchedule()
+    : minutes(0), hours(0), days(0), months(0), weekdays(0)
+    , days_any(true), weekdays_any(true), valid(false) {}
+
+CronSchedule CronSchedule::parse(const std::string& expr) {
+    CronSchedule sched;
+    std::istringstream iss(expand_macro(expr));
+    std::string field;
+    std::vector<std::string> fields;
+    while (iss >> field) fields.push_back(field);
+    if (fields.size() != 5) {
+        sched.error = "expected 5 fields, got " + std::to_string(fields.size());
+        return sched;
+    }
+
+    uint64_t bits;
+    bool any;
+    if (!parse_field(fields[0], 0, 59, nullptr, 0, 0, bits, any, sched.error)) return sched;
+    sched.minutes = bits;
+    if (!parse_field(fields[1], 0, 23, nullptr, 0, 0, bits, any, sched.error)) return sched;
+    sched.hours = static_cast<uint32_t>(bits);
+    if (!parse_field(fields[2], 1, 31, nullptr, 0, 0, bits, any, sched.error)) return sched;
+    sched.days = static_cast<uint32_t>(bits);
+    sched.days_any = any;
+    if (!parse_field(fields[3], 1, 12, MONTH_NAMES, 12, 1, bits, any, sched.error)) return sched;
+    sched.months = static_cast<uint16_t>(bits);
+    // 7 is Sunday too
+    if (!parse_field(fields[4], 0, 7, WEEKDAY_NAMES, 7, 0, bits, any, sched.error)) return sched;
+    if (bits & (1ULL << 7)) bits |= 1;
+    sched.weekdays = static_cast<uint8_t>(bits & 0x7F);
+    sched.weekdays_any = any;
+
+    sched.valid = true;
+    return sched;
+}
+
+bool CronSchedule::day_matches(const std::tm& tm) const {
+    bool dom = (days >> tm.tm_mday) & 1;
+    bool dow = (weekdays >> tm.tm_wday) & 1;
+    if (days_any || weekdays_any) return dom && dow;
+    return dom || dow;
+}
+
+bool CronSchedule::matches(const std::tm& tm) const {
+    if (!valid) return false;
+    return ((minutes >> tm.tm_min) & 1) && ((hours >> tm.tm_hour) & 1) &&
+           ((months >> (tm.tm_mon + 1)) & 1) && day_matches(tm);
+}
+
+time_t CronSchedule::next_after(time_t t) const {
+    if (!valid) return 0;
+
+    std::tm tm;
+    time_t start = (t / 60 + 1) * 60;
+    localtime_r(&start, &tm);
+    tm.tm_sec = 0;
+    int last_year = tm.tm_year + MAX_YEARS_AHEAD;
+
+    // Advance the coarsest mismatching field, resetting the finer ones
+    while (tm.tm_year <= last_year) {
+        if (!((months >> (tm.tm_mon + 1)) & 1)) {
+            tm.tm_mon += 1;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!day_matches(tm)) {
+            tm.tm_mday += 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!((hours >> tm.tm_hour) & 1)) {
+            tm.tm_hour += 1;
+            tm.tm_min = 0;
+        } else if (!((minutes >> tm.tm_min) & 1)) {
+            tm.tm_min += 1;
+        } else {
+            time_t when = normalize(tm);
+            if (when > t) return when;
+            tm.tm_min += 1;     // DST fold mapped us back to the past
+        }
+        normalize(tm);
+    }
+    return 0;
+}
+
+// ============================================================================
+// CronScheduler
+// ============================================================================
+
+CronScheduler::CronScheduler() : stop_(false), dirty_(false) {}
+
+CronScheduler::~CronScheduler() {
+    stop();
+}
+
+void CronScheduler::start(JobSource source, FireHandler fire) {
+    if (thread_.joinable()) return;
+    source_ = source;
+    fire_ = fire;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = false;
+        dirty_ = true;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void CronScheduler::stop() {
+    if (!thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void CronScheduler::invalidate() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirty_ = true;
+    }
+    cv_.notify_all();
+}
+
+size_t CronScheduler::jobs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+time_t CronScheduler::next_fire() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    time_t next = 0;
+    for (std::map<std::string, Entry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->second.next != 0 && (next == 0 || it->second.next < next)) next = it->second.next;
+    }
+    return next;
+}
+
+void CronScheduler::reload_locked(const std::vector<Job>& jobs, time_t now) {
+    std::map<std::string, Entry> fresh;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const Job& job = jobs[i];
+        std::map<std::string, Entry>::iterator old = entries_.find(job.id);
+        if (old != entries_.end() && old->second.expr == job.expr) {
+            fresh[job.id] = old->second;        // Parsed already; keep its deadline
+            continue;
+        }
+        Entry entry;
+        entry.expr = job.expr;
+        entry.schedule = CronSchedule::parse(job.expr);
+        if (!entry.schedule.valid) {
+            LOG_WARN("[CRON] Task %s has an invalid schedule '%s': %s",
+                     job.id.c_str(), job.expr.c_str(), entry.schedule.error.c_str());
+            continue;
+        }
+        entry.next = entry.schedule.next_after(now);
+        if (entry.next == 0) {
+            LOG_WARN("[CRON] Task %s schedule '%s' never fires", job.id.c_str(), job.expr.c_str());
+            continue;
+        }
+        fresh[job.id] = entry;
+    }
+    entries_.swap(fresh);
+
+    Heap heap;
+    for (std::map<std::string, Entry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it) {
+        heap.push(Deadline(it->second.next, it->first));
+    }
+    heap_.swap(heap);
+    LOG_DEBUG("[CRON] %zu scheduled task(s)", entries_.size());
+}
+
+void CronScheduler::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (dirty_) {
+            dirty_ = false;
+            lock.unlock();
+            std::vector<Job> jobs = source_();
+            lock.lock();
+            reload_locked(jobs, time(nullptr));
+            continue;
+        }
+
+        if (heap_.empty()) {
+            cv_.wait(lock, [this] { return stop_ || dirty_; });
+            continue;
+        }
+
+        Deadline top = heap_.top();
+        std::map<std::string, Entry>::iterator it = entries_.find(top.second);
+        if (it == entries_.end() || it->second.next != top.first) {
+            heap_.pop();        // Superseded by a reload
+            continue;
+        }
+
+        time_t now = time(nullptr);
+        if (top.first > now) {
+            // Woken early by invalidate()/stop() or a clock change: re-check
+            cv_.wait_until(lock, std::chrono::system_clock::from_time_t(top.first));
+            continue;
+        }
+
+        heap_.pop();
+        // A deadline missed by more than a minute (suspend, clock jump) is
+        // fired once, not once per missed minute
+        time_t base = now - top.first > 60 ? now : top.first;
+        it->second.next = it->second.schedule.next_after(base);
+        if (it->second.next != 0) heap_.push(Deadline(it->second.next, top.second));
+
+        std::string id = top.second;
+        lock.unlock();
+        fire_(id, top.first);
+        lock.lock();
+    }
+}
+
+} // namespace opencrank
@@ -0,0 +1,246 @@
+/*
+ * OpenCrank C++ - File Reader Implementation
+ */
+#include <opencrank/core/file_reader.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace opencrank {
+
+namespace {
+
+// Files that cannot be mapped are read into memory up to this much
+const size_t MAX_UNMAPPED = 16 * 1024 * 1024;
+
+// Non-negative integer parameter; models sometimes send numbers as strings
+int64_t param_int(const Json& params, const char* key) {
+    if (!params.is_object() || !params.contains(key)) return 0;
+    const Json& val = params[key];
+    if (val.is_number()) return json_utils::as_int(val);
+    if (val.is_string()) return std::strtoll(val.get<std::string>().c_str(), NULL, 10);
+    return 0;
+}
+
+size_t count_newlines(const char* p, const char* end) {
+    size_t n = 0;
+    while (p < end && (p = static_cast<const char*>(memchr(p, '\n', end - p))) != NULL) {
+        ++n;
+        ++p;
+    }
+    return n;
+}
+
+// Offset just past the n-th newline at or after from (or size if the file ends first)
+size_t skip_lines(const char* data, size_t size, size_t from, size_t n, size_t& skipped) {
+    skipped = 0;
+    const char* p = data + from;
+    const char* end = data + size;
+    while (skipped < n && p < end) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!nl) return size;
+        p = nl + 1;
+        ++skipped;
+    }
+    return static_cast<size_t>(p - data);
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// MappedFile
+// ============================================================================
+
+MappedFile::MappedFile() : data_(NULL), size_(0), mtime_ns_(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved = errno;
+        ::close(fd);
+        errno = saved;
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ::close(fd);
+        errno = S_ISDIR(st.st_mode) ? EISDIR : ENODEV;
+        return false;
+    }
+    mtime_ns_ = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void* map = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved = errno;
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        size_ = 0;
+        errno = saved;
+        return false;
+    }
+    data_ = static_cast<char*>(map);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) {
+        munmap(data_, size_);
+        data_ = NULL;
+    }
+    size_ = 0;
+    mtime_ns_ = 0;
+}
+
+// ============================================================================
+// Slices
+// ============================================================================
+
+bool read_file_slice(const std::string& path, const Json& params, size_t max_bytes,
+                     FileSlice& out, std::string& error) {
+    out = FileSlice();
+
+    MappedFile mapped;
+    std::string buffer;
+    const char* data = NULL;
+    size_t size = 0;
+    bool opened = mapped.open(path);
+    if (opened && mapped.size() > 0) {
+        data = mapped.data();
+        size = mapped.size();
+    } else if (!opened && errno == EISDIR) {
+        error = "Is a directory (use list_dir)";
+        return false;
+    } else {
+        // Character devices, FIFOs, /proc (which reports size 0): read what there is
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::string("Cannot open file: ") + strerror(errno);
+            return false;
+        }
+        char buf[65536];
+        ssize_t n;
+        while (buffer.size() < MAX_UNMAPPED && (n = read(fd, buf, sizeof(buf))) != 0) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            buffer.append(buf, static_cast<size_t>(n));
+        }
+        ::close(fd);
+        data = buffer.data();
+        size = buffer.size();
+    }
+    out.file_size = size;
+
+    int64_t start_line = param_int(params, "start_line");
+    int64_t end_line = param_int(params, "end_line");
+    int64_t offset = param_int(params, "offset");
+    int64_t length = param_int(params, "length");
+
+    size_t begin = 0;
+    size_t end = size;
+    bool lines_known = true;
+    if (start_line > 0 || end_line > 0) {
+        out.ranged = true;
+        size_t first = start_line > 0 ? static_cast<size_t>(start_line) : 1;
+        size_t skipped = 0;
+        begin = skip_lines(data, size, 0, first - 1, skipped);
+        if (skipped < first - 1 || (begin == size && size > 0 && first > 1 && data[size - 1] == '\n')) {
+            std::ostringstream oss;
+            oss << "start_line " << first << " is past the end of the file ("
+                << count_newlines(data, data + size) + (size > 0 && data[size - 1] != '\n' ? 1 : 0)
+                << " lines)";
+            error = oss.str();
+            return false;
+        }
+        out.first_line = first;
+        if (end_line > 0) {
+            if (static_cast<size_t>(end_line) < first) {
+                error = "end_line is before start_line";
+                return false;
+            }
+            end = skip_lines(data, size, begin, static_cast<size_t>(end_line) - first + 1, skipped);
+        }
+    } else if (offset > 0 || length > 0) {
+        out.ranged = true;
+        if (static_cast<size_t>(offset) > size) {
+            std::ostringstream oss;
+            oss << "offset " << offset << " is past the end of the file (" << size << " bytes)";
+            error = oss.str();
+            return false;
+        }
+        begin = static_cast<size_t>(offset);
+        if (length > 0) {
+            end = std::min(size, begin + static_cast<size_t>(length));
+        }
+        // Numbering lines would mean reading everything before offset
+        lines_known = begin == 0;
+    }
+
+    // Too long: cut at the last line break that fits
+    if (end - begin > max_bytes) {
+        size_t cut = begin + max_bytes;
+        const void* nl = memrchr(data + begin, '\n', max_bytes);
+        if (nl) {
+            cut = static_cast<size_t>(static_cast<const char*>(nl) - data) + 1;
+        }
+        end = cut;
+    }
+
+    out.begin = begin;
+    out.end = end;
+    out.more = end < size;
+    out.text.assign(data + begin, end - begin);
+    if (lines_known) {
+        size_t newlines = count_newlines(data + begin, data + end);
+        bool partial_last = end > begin && data[end - 1] != '\n';
+        out.last_line = out.first_line + newlines - (partial_last || newlines == 0 ? 0 : 1);
+    } else {
+        out.first_line = 0;
+    }
+    return true;
+}
+
+std::string format_slice(const FileSlice& slice) {
+    if (!slice.ranged && !slice.more) {
+        return slice.text;
+    }
+
+    std::ostringstream oss;
+    oss << "[";
+    if (slice.first_line > 0 && slice.end > slice.begin) {
+        oss << "lines " << slice.first_line << "-" << slice.last_line << ", ";
+    }
+    oss << "bytes " << slice.begin << "-" << slice.end << " of " << slice.file_size << "]\n";
+    oss << slice.text;
+    if (slice.more) {
+        if (!slice.text.empty() && slice.text[slice.text.size() - 1] != '\n') oss << "\n";
+        oss << "[More follows: continue with ";
+        if (slice.first_line > 0 && slice.text.size() > 0 && slice.text[slice.text.size() - 1] == '\n') {
+            oss << "start_line=" << (slice.last_line + 1);
+        } else {
+            oss << "offset=" << slice.end;
+        }
+        oss << "]";
+    }
+    return oss.str();
+}
+
+} // namespace opencrank
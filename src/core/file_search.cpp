@@ -0,0 +1,518 @@
+/*
+ * OpenCrank C++ - File Search Implementation
+ */
+#include <opencrank/core/file_search.hpp>
+#include <opencrank/core/file_reader.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/logger.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <cctype>
+#include <cstring>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+namespace opencrank {
+
+namespace {
+
+const size_t BINARY_PROBE = 8192;       // Bytes checked for a NUL
+const size_t MAX_LINE_SHOWN = 200;      // Characters of a hit line shown
+const size_t HITS_KEPT_PER_FILE = 20;
+const size_t MAX_TOTAL_MATCHES = 5000;  // Past this the scan stops
+const size_t HITS_SHOWN_PER_FILE = 5;
+
+struct WorkItem {
+    std::string rel;            // Relative to the root
+    bool dir;
+};
+
+struct FileMatches {
+    std::string path;
+    std::vector<FileSearchHit> hits;
+    size_t count;
+    int score;
+};
+
+char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool is_word_char(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Case-insensitive memmem: memchr for both cases of the first byte, keeping
+// the next position of each so neither is scanned twice
+const char* find_ci(const char* p, const char* end, const std::string& needle_lower) {
+    size_t n = needle_lower.size();
+    if (n == 0 || static_cast<size_t>(end - p) < n) return NULL;
+    char lo = needle_lower[0];
+    char up = static_cast<char>(toupper(static_cast<unsigned char>(lo)));
+    const char* last = end - n + 1;
+    const char* next_lo = NULL;
+    const char* next_up = NULL;
+    while (p < last) {
+        if (!next_lo || next_lo < p) {
+            next_lo = static_cast<const char*>(memchr(p, lo, last - p));
+            if (!next_lo) next_lo = last;
+        }
+        if (up == lo) {
+            next_up = last;
+        } else if (!next_up || next_up < p) {
+            next_up = static_cast<const char*>(memchr(p, up, last - p));
+            if (!next_up) next_up = last;
+        }
+        const char* c = std::min(next_lo, next_up);
+        if (c >= last) return NULL;
+        if (strncasecmp(c, needle_lower.data(), n) == 0) return c;
+        p = c + 1;
+    }
+    return NULL;
+}
+
+size_t count_newlines(const char* p, const char* end) {
+    size_t n = 0;
+    while (p < end && (p = static_cast<const char*>(memchr(p, '\n', end - p))) != NULL) {
+        ++n;
+        ++p;
+    }
+    return n;
+}
+
+std::string line_text(const char* begin, const char* end) {
+    if (end > begin && end[-1] == '\r') --end;
+    return std::string(begin, end);
+}
+
+// The line, cut to MAX_LINE_SHOWN characters around the match
+std::string shown_line(const char* begin, const char* end, const char* match) {
+    if (end > begin && end[-1] == '\r') --end;
+    if (static_cast<size_t>(end - begin) <= MAX_LINE_SHOWN) return std::string(begin, end);
+    const char* from = begin;
+    if (match - begin > static_cast<ptrdiff_t>(MAX_LINE_SHOWN / 4)) {
+        from = match - MAX_LINE_SHOWN / 4;
+        while (from < match && (static_cast<unsigned char>(*from) & 0xC0) == 0x80) ++from;
+    }
+    std::string out = from > begin ? "..." : "";
+    size_t left = static_cast<size_t>(end - from);
+    out += truncate_safe(std::string(from, std::min(left, MAX_LINE_SHOWN + 8)), MAX_LINE_SHOWN);
+    if (left > MAX_LINE_SHOWN) out += "...";
+    return out;
+}
+
+const char* base_name(const std::string& rel) {
+    size_t slash = rel.rfind('/');
+    return rel.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+class Scan {
+public:
+    Scan(const std::string& root, const FileSearchOptions& options)
+        : root_(root), opt_(options), pending_(0), stop_(false), scanned_(0)
+        , matches_(0), binary_(0), large_(0), incomplete_(false)
+        , deadline_(std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeout_ms)) {}
+
+    bool prepare(std::string& error) {
+        if (opt_.regex && !opt_.pattern.empty()) {
+            try {
+                std::regex::flag_type flags = std::regex::ECMAScript | std::regex::optimize;
+                if (opt_.ignore_case) flags |= std::regex::icase;
+                re_ = std::regex(opt_.pattern, flags);
+            } catch (const std::regex_error& e) {
+                error = "Invalid regex pattern: " + opt_.pattern + " (" + e.what() + ")";
+                return false;
+            }
+            literal_ = regex_required_literal(opt_.pattern);
+        } else {
+            literal_ = opt_.pattern;
+        }
+        if (opt_.ignore_case) {
+            for (size_t i = 0; i < literal_.size(); ++i) literal_[i] = ascii_lower(literal_[i]);
+        }
+        return true;
+    }
+
+    void run(const WorkItem& first, int threads) {
+        queue_.push_back(first);
+        pending_ = 1;
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < threads; ++i) {
+            helpers.push_back(std::thread(&Scan::work, this));
+        }
+        work();
+        for (size_t i = 0; i < helpers.size(); ++i) helpers[i].join();
+    }
+
+    void collect(FileSearchResult& result) {
+        result.files_scanned = scanned_.load();
+        result.skipped_binary = binary_.load();
+        result.skipped_large = large_.load();
+        result.incomplete = incomplete_.load();
+        result.files_matched = files_.size();
+
+        // Best files first; within a file, hits stay in line order
+        std::sort(files_.begin(), files_.end(), [](const FileMatches& a, const FileMatches& b) {
+            if (a.score != b.score) return a.score > b.score;
+            return a.path < b.path;
+        });
+        size_t per_file = opt_.pattern.empty() ? 1 : HITS_SHOWN_PER_FILE;
+        for (size_t i = 0; i < files_.size(); ++i) {
+            result.total_matches += files_[i].count;
+            for (size_t h = 0; h < files_[i].hits.size() && h < per_file; ++h) {
+                if (result.hits.size() >= opt_.max_results) break;
+                result.hits.push_back(files_[i].hits[h]);
+            }
+        }
+    }
+
+private:
+    void work() {
+        for (;;) {
+            WorkItem item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return !queue_.empty() || pending_ == 0 || stop_.load(); });
+                if (queue_.empty() || stop_.load()) {
+                    cv_.notify_all();
+                    return;
+                }
+                item = queue_.front();
+                queue_.pop_front();
+            }
+
+            if (opt_.timeout_ms > 0 && std::chrono::steady_clock::now() > deadline_) {
+                halt();
+            } else if (item.dir) {
+                list_dir(item.rel);
+            } else {
+                scan_file(item.rel);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) cv_.notify_all();
+        }
+    }
+
+    void halt() {
+        incomplete_ = true;
+        stop_ = true;
+        cv_.notify_all();
+    }
+
+    std::string full_path(const std::string& rel) const {
+        return rel.empty() ? root_ : root_ + "/" + rel;
+    }
+
+    void list_dir(const std::string& rel) {
+        std::string path = full_path(rel);
+        DIR* dir = opendir(path.c_str());
+        if (!dir) return;
+
+        std::vector<WorkItem> found;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            const char* name = entry->d_name;
+            if (name[0] == '.' || strcmp(name, "node_modules") == 0) continue;
+
+            unsigned char type = entry->d_type;
+            std::string child = rel.empty() ? std::string(name) : rel + "/" + name;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (lstat(full_path(child).c_str(), &st) != 0) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+            }
+            // Symlinks are skipped: they could lead out of the root
+            if (type == DT_DIR) {
+                WorkItem w = { child, true };
+                found.push_back(w);
+            } else if (type == DT_REG && glob_matches(child)) {
+                WorkItem w = { child, false };
+                found.push_back(w);
+            }
+        }
+        closedir(dir);
+
+        if (found.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < found.size(); ++i) queue_.push_back(found[i]);
+        pending_ += found.size();
+        cv_.notify_all();
+    }
+
+    bool glob_matches(const std::string& rel) const {
+        if (opt_.glob.empty()) return true;
+        int flags = opt_.ignore_case ? FNM_CASEFOLD : 0;
+        if (opt_.glob.find('/') != std::string::npos) {
+            return fnmatch(opt_.glob.c_str(), rel.c_str(), flags) == 0;
+        }
+        return fnmatch(opt_.glob.c_str(), base_name(rel), flags) == 0;
+    }
+
+    int depth(const std::string& rel) const {
+        return static_cast<int>(std::count(rel.begin(), rel.end(), '/'));
+    }
+
+    void scan_file(const std::string& rel) {
+        if (scanned_.fetch_add(1) >= opt_.max_files) {
+            halt();
+            return;
+        }
+
+        // Find mode: the name is the match
+        if (opt_.pattern.empty()) {
+            FileMatches fm;
+            fm.path = rel;
+            fm.count = 1;
+            fm.score = -depth(rel);
+            FileSearchHit hit;
+            hit.path = rel;
+            hit.line = 0;
+            fm.hits.push_back(hit);
+            add(fm);
+            return;
+        }
+
+        MappedFile file;
+        if (!file.open(full_path(rel))) return;
+        if (file.size() == 0) return;
+        if (memchr(file.data(), 0, std::min(file.size(), BINARY_PROBE))) {
+            ++binary_;
+            return;
+        }
+        if (file.size() > opt_.max_file_size) {
+            ++large_;
+            return;
+        }
+
+        FileMatches fm;
+        fm.path = rel;
+        fm.count = 0;
+        fm.score = 0;
+        bool word_match = false;
+        scan(file.data(), file.data() + file.size(), fm, word_match);
+        if (fm.count == 0) return;
+
+        std::string base = base_name(rel);
+        if (opt_.ignore_case) base = to_lower(base);
+        fm.score = static_cast<int>(std::min<size_t>(fm.count, 10)) * 10 - depth(rel) * 2;
+        if (word_match) fm.score += 20;
+        if (!literal_.empty() && base.find(literal_) != std::string::npos) fm.score += 30;
+        add(fm);
+    }
+
+    const char* find_literal(const char* p, const char* end) const {
+        if (opt_.ignore_case) return find_ci(p, end, literal_);
+        return static_cast<const char*>(memmem(p, end - p, literal_.data(), literal_.size()));
+    }
+
+    // Collect matching lines of [data, end) into fm
+    void scan(const char* data, const char* end, FileMatches& fm, bool& word_match) {
+        const char* p = data;
+        const char* counted = data;
+        size_t line_no = 1;
+        while (p < end && !stop_.load()) {
+            const char* line_start;
+            const char* line_end;
+            const char* at;
+            if (!literal_.empty()) {
+                at = find_literal(p, end);
+                if (!at) break;
+                const void* nl = memrchr(p, '\n', at - p);
+                line_start = nl ? static_cast<const char*>(nl) + 1 : p;
+            } else {
+                at = p;
+                line_start = p;
+            }
+            line_end = static_cast<const char*>(memchr(at, '\n', end - at));
+            if (!line_end) line_end = end;
+            line_no += count_newlines(counted, line_start);
+            counted = line_start;
+
+            size_t match_len = literal_.size();
+            bool matched = true;
+            if (opt_.regex) {
+                std::cmatch m;
+                matched = std::regex_search(line_start, line_end, m, re_);
+                if (matched) {
+                    at = line_start + m.position(0);
+                    match_len = static_cast<size_t>(m.length(0));
+                }
+            }
+            if (matched) {
+                ++fm.count;
+                if ((at == line_start || !is_word_char(at[-1])) &&
+                    (at + match_len >= line_end || !is_word_char(at[match_len]))) {
+                    word_match = true;
+                }
+                if (fm.hits.size() < HITS_KEPT_PER_FILE) {
+                    fm.hits.push_back(make_hit(fm.path, data, end, line_start, line_end, at, line_no));
+                }
+                if (matches_.fetch_add(1) + 1 >= MAX_TOTAL_MATCHES) halt();
+            }
+            p = line_end + 1;
+        }
+    }
+
+    FileSearchHit make_hit(const std::string& rel, const char* data, const char* end,
+                           const char* line_start, const char* line_end, const char* at,
+                           size_t line_no) const {
+        FileSearchHit hit;
+        hit.path = rel;
+        hit.line = line_no;
+        hit.text = shown_line(line_start, line_end, at);
+
+        const char* b = line_start;
+        for (size_t i = 0; i < opt_.context_lines && b > data; ++i) {
+            const char* prev_end = b - 1;
+            const void* nl = memrchr(data, '\n', prev_end - data);
+            const char* prev = nl ? static_cast<const char*>(nl) + 1 : data;
+            hit.before.insert(hit.before.begin(), truncate_safe(line_text(prev, prev_end), MAX_LINE_SHOWN));
+            b = prev;
+        }
+        const char* a = line_end;
+        for (size_t i = 0; i < opt_.context_lines && a < end; ++i) {
+            const char* next = a + 1;
+            if (next >= end) break;
+            const char* next_end = static_cast<const char*>(memchr(next, '\n', end - next));
+            if (!next_end) next_end = end;
+            hit.after.push_back(truncate_safe(line_text(next, next_end), MAX_LINE_SHOWN));
+            a = next_end;
+        }
+        return hit;
+    }
+
+    void add(FileMatches& fm) {
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        files_.push_back(FileMatches());
+        std::swap(files_.back(), fm);
+    }
+
+    std::string root_;
+    const FileSearchOptions& opt_;
+    std::regex re_;
+    std::string literal_;       // Lowercased when ignore_case
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<WorkItem> queue_;
+    size_t pending_;            // Queued or being processed
+    std::atomic<bool> stop_;
+
+    std::mutex results_mutex_;
+    std::vector<FileMatches> files_;
+    std::atomic<size_t> scanned_;
+    std::atomic<size_t> matches_;
+    std::atomic<size_t> binary_;
+    std::atomic<size_t> large_;
+    std::atomic<bool> incomplete_;
+    std::chrono::steady_clock::time_point deadline_;
+};
+
+} // anonymous namespace
+
+bool search_files(const std::string& root, const FileSearchOptions& options, FileSearchResult& result) {
+    result = FileSearchResult();
+    if (options.pattern.empty() && options.glob.empty()) {
+        result.error = "Give a pattern to search for, a glob to list files, or both";
+        return false;
+    }
+
+    struct stat st;
+    if (stat(root.c_str(), &st) != 0) {
+        result.error = std::string("Cannot open ") + root + ": " + strerror(errno);
+        return false;
+    }
+
+    // A single file is searched from its directory
+    std::string dir = root;
+    WorkItem first = { "", true };
+    if (!S_ISDIR(st.st_mode)) {
+        size_t slash = root.rfind('/');
+        dir = slash == std::string::npos ? "." : root.substr(0, slash);
+        first.rel = slash == std::string::npos ? root : root.substr(slash + 1);
+        first.dir = false;
+    }
+
+    Scan scan(dir, options);
+    if (!scan.prepare(result.error)) return false;
+
+    int threads = options.threads;
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+        threads = std::max(1, std::min(threads, 8));
+    }
+    if (!first.dir) threads = 1;
+
+    auto started = std::chrono::steady_clock::now();
+    scan.run(first, threads);
+    scan.collect(result);
+
+    LOG_DEBUG("[FileSearch] '%s' under %s: %zu match(es) in %zu of %zu file(s), %lld ms, %d thread(s)",
+              options.pattern.c_str(), root.c_str(), result.total_matches, result.files_matched,
+              result.files_scanned,
+              static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - started).count()),
+              threads);
+    return true;
+}
+
+std::string format_search(const FileSearchResult& result, const FileSearchOptions& options) {
+    std::ostringstream oss;
+    bool find_mode = options.pattern.empty();
+
+    if (result.files_matched == 0) {
+        oss << "No " << (find_mode ? "files" : "matches") << " found";
+    } else if (find_mode) {
+        oss << "Found " << result.files_matched << " file(s)";
+    } else {
+        oss << "Found " << result.total_matches << " matching line(s) in "
+            << result.files_matched << " file(s)";
+    }
+    oss << " (scanned " << result.files_scanned << " file(s)";
+    if (result.skipped_binary > 0) oss << ", skipped " << result.skipped_binary << " binary";
+    if (result.skipped_large > 0) oss << ", skipped " << result.skipped_large << " too large";
+    oss << ")\n";
+    if (result.incomplete) {
+        oss << "[Search stopped early (file, match or time limit); results are partial]\n";
+    }
+    size_t listed = find_mode ? result.files_matched : result.total_matches;
+    if (result.hits.size() < listed) {
+        oss << "[Showing " << result.hits.size() << ", best files first; "
+            << "narrow the pattern, glob or path to see the rest]\n";
+    }
+
+    std::string current;
+    for (size_t i = 0; i < result.hits.size(); ++i) {
+        const FileSearchHit& hit = result.hits[i];
+        if (find_mode) {
+            oss << hit.path << "\n";
+            continue;
+        }
+        if (hit.path != current) {
+            oss << "\n" << hit.path << "\n";
+            current = hit.path;
+        } else if (options.context_lines > 0) {
+            oss << "  --\n";
+        }
+        for (size_t b = 0; b < hit.before.size(); ++b) {
+            oss << "  " << (hit.line - hit.before.size() + b) << "- " << hit.before[b] << "\n";
+        }
+        oss << "  " << hit.line << ": " << hit.text << "\n";
+        for (size_t a = 0; a < hit.after.size(); ++a) {
+            oss << "  " << (hit.line + 1 + a) << "- " << hit.after[a] << "\n";
+        }
+    }
+    return oss.str();
+}
+
+} // namespace opencrank
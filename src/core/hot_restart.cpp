@@ -0,0 +1,232 @@
+/*
+ * OpenCrank C++ - Hot Restart Implementation
+ */
+#include <opencrank/core/hot_restart.hpp>
+#include <opencrank/core/message_handler.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace opencrank {
+
+namespace {
+
+const char* LISTEN_FDS_ENV = "OPENCRANK_LISTEN_FDS";     // name=fd,name=fd
+const char* STATE_FILE_ENV = "OPENCRANK_RESTART_STATE";
+
+void set_cloexec(int fd, bool on) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags < 0) return;
+    fcntl(fd, F_SETFD, on ? (flags | FD_CLOEXEC) : (flags & ~FD_CLOEXEC));
+}
+
+// Nothing but the handed-over sockets may leak into the new image
+void close_on_exec_except(const std::map<std::string, int>& keep) {
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir) return;
+    int dir_fd = dirfd(dir);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+        int fd = std::atoi(entry->d_name);
+        if (fd <= 2 || fd == dir_fd) continue;
+        bool kept = false;
+        for (std::map<std::string, int>::const_iterator it = keep.begin(); it != keep.end(); ++it) {
+            if (it->second == fd) kept = true;
+        }
+        set_cloexec(fd, !kept);
+    }
+    closedir(dir);
+}
+
+} // namespace
+
+HotRestart& HotRestart::instance() {
+    static HotRestart restart;
+    return restart;
+}
+
+HotRestart::HotRestart() : resumed_(false), plugin_states_(Json::object()) {}
+
+void HotRestart::init() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The path, not the inode: a deploy replaces the file under it
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0) {
+        executable_.assign(path, static_cast<size_t>(len));
+        const std::string deleted = " (deleted)";
+        if (executable_.size() > deleted.size() &&
+            executable_.compare(executable_.size() - deleted.size(), deleted.size(), deleted) == 0) {
+            executable_.erase(executable_.size() - deleted.size());
+        }
+    }
+
+    const char* fds = getenv(LISTEN_FDS_ENV);
+    if (fds) {
+        std::vector<std::string> entries = split(fds, ',');
+        for (size_t i = 0; i < entries.size(); ++i) {
+            size_t eq = entries[i].find('=');
+            if (eq == std::string::npos) continue;
+            int fd = std::atoi(entries[i].c_str() + eq + 1);
+            if (fd <= 2 || fcntl(fd, F_GETFD) < 0) continue;
+            set_cloexec(fd, true);      // Not for tool processes
+            inherited_[entries[i].substr(0, eq)] = fd;
+        }
+        unsetenv(LISTEN_FDS_ENV);
+        resumed_ = true;
+    }
+
+    const char* state_file = getenv(STATE_FILE_ENV);
+    if (state_file) {
+        std::string file = state_file;
+        unsetenv(STATE_FILE_ENV);
+        resumed_ = true;
+
+        std::ifstream in(file.c_str());
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        Json state;
+        try {
+            state = Json::parse(buffer.str());
+        } catch (const std::exception& e) {
+            LOG_ERROR("[Restart] Cannot read handed-over state %s: %s", file.c_str(), e.what());
+        }
+        std::remove(file.c_str());
+
+        if (state.is_object()) {
+            if (state.contains("plugins") && state["plugins"].is_object()) {
+                plugin_states_ = state["plugins"];
+            }
+            if (state.contains("messages") && state["messages"].is_array()) {
+                const Json& messages = state["messages"];
+                for (Json::const_iterator it = messages.begin(); it != messages.end(); ++it) {
+                    SessionExecutor::Queued queued;
+                    queued.session_key = json_utils::get_string(*it, "session_key");
+                    queued.priority = static_cast<TaskPriority>(json_utils::get_int(*it, "priority", 1));
+                    queued.msg = message_from_json(*it);
+                    if (!queued.session_key.empty()) messages_.push_back(queued);
+                }
+            }
+        }
+    }
+
+    if (resumed_) {
+        LOG_INFO("[Restart] Resuming after hot restart: %zu socket(s), %zu message(s), %zu plugin state(s)",
+                 inherited_.size(), messages_.size(), plugin_states_.size());
+    }
+}
+
+bool HotRestart::resumed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resumed_;
+}
+
+int HotRestart::adopt_listener(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, int>::iterator it = inherited_.find(name);
+    if (it == inherited_.end()) return -1;
+    int fd = it->second;
+    inherited_.erase(it);
+    LOG_DEBUG("[Restart] Adopted listening socket %s (fd %d)", name.c_str(), fd);
+    return fd;
+}
+
+void HotRestart::offer_listener(const std::string& name, int fd) {
+    int kept = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    if (kept < 0) {
+        LOG_WARN("[Restart] Cannot keep listening socket %s: %s", name.c_str(), strerror(errno));
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, int>::iterator it = offered_.find(name);
+    if (it != offered_.end()) ::close(it->second);
+    offered_[name] = kept;
+}
+
+Json HotRestart::plugin_state(const std::string& plugin) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return plugin_states_.contains(plugin) ? plugin_states_[plugin] : Json();
+}
+
+std::vector<SessionExecutor::Queued> HotRestart::take_messages() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<SessionExecutor::Queued> taken;
+    taken.swap(messages_);
+    return taken;
+}
+
+void HotRestart::set_plugin_state(const std::string& plugin, const Json& state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    plugin_states_[plugin] = state;
+}
+
+void HotRestart::add_messages(const std::vector<SessionExecutor::Queued>& messages) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    messages_.insert(messages_.end(), messages.begin(), messages.end());
+}
+
+bool HotRestart::save(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json state = Json::object();
+    state["plugins"] = plugin_states_;
+    Json messages = Json::array();
+    for (size_t i = 0; i < messages_.size(); ++i) {
+        Json entry = message_to_json(messages_[i].msg);
+        entry["session_key"] = messages_[i].session_key;
+        entry["priority"] = static_cast<int>(messages_[i].priority);
+        messages.push_back(entry);
+    }
+    state["messages"] = messages;
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::trunc);
+        out << state.dump();
+        if (!out) {
+            LOG_ERROR("[Restart] Cannot write %s", tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("[Restart] Cannot move state file into place: %s", strerror(errno));
+        return false;
+    }
+    state_path_ = path;
+    LOG_INFO("[Restart] Handing over %zu message(s), %zu plugin state(s), %zu socket(s)",
+             messages_.size(), plugin_states_.size(), offered_.size());
+    return true;
+}
+
+bool HotRestart::exec(char* argv[]) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (executable_.empty()) {
+        fprintf(stderr, "[Restart] Executable path unknown, cannot restart\n");
+        return false;
+    }
+
+    std::string fds;
+    for (std::map<std::string, int>::const_iterator it = offered_.begin(); it != offered_.end(); ++it) {
+        if (!fds.empty()) fds += ',';
+        fds += it->first + "=" + std::to_string(it->second);
+    }
+    close_on_exec_except(offered_);
+    setenv(LISTEN_FDS_ENV, fds.c_str(), 1);
+    if (!state_path_.empty()) setenv(STATE_FILE_ENV, state_path_.c_str(), 1);
+
+    execv(executable_.c_str(), argv);
+    fprintf(stderr, "[Restart] execv %s failed: %s\n", executable_.c_str(), strerror(errno));
+    return false;
+}
+
+} // namespace opencrank
@@ -0,0 +1,555 @@
+/*
+ * OpenCrank C++ - Streaming HTML Tokenizer Implementation
+ */
+#include <opencrank/core/html_tokenizer.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace opencrank {
+
+namespace {
+const size_t MAX_TAG_BYTES = 64 * 1024;         // Longer tags keep their head only
+const size_t MAX_LINK_TEXT_BYTES = 4096;
+const size_t MAX_FIELD_VALUE_BYTES = 64 * 1024;
+const size_t MAX_ENTITY_CHARS = 10;
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+inline bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline bool is_alnum(char c) {
+    return is_alpha(c) || (c >= '0' && c <= '9');
+}
+
+inline char lower_ascii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// First '<' or '&' in [p, end), or end
+const char* find_markup(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i amp = _mm_set1_epi8('&');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)));
+        if (mask) return p + __builtin_ctz(static_cast<unsigned>(mask));
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '<' && *p != '&') ++p;
+    return p;
+}
+
+// Decoded form of the entity name (between '&' and ';'); false if unknown
+bool decode_entity(const std::string& name, std::string& out) {
+    if (name == "nbsp" || name == "#160") { out = " "; return true; }
+    if (name == "amp")  { out = "&"; return true; }
+    if (name == "lt")   { out = "<"; return true; }
+    if (name == "gt")   { out = ">"; return true; }
+    if (name == "quot") { out = "\""; return true; }
+    if (name == "apos") { out = "'"; return true; }
+
+    if (name.size() < 2 || name[0] != '#') return false;
+    bool hex = (name[1] == 'x' || name[1] == 'X');
+    const char* digits = name.c_str() + (hex ? 2 : 1);
+    if (*digits == '\0') return false;
+    char* endp = nullptr;
+    unsigned long cp = std::strtoul(digits, &endp, hex ? 16 : 10);
+    if (*endp != '\0' || cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+    out.clear();
+    HtmlTokenizer::append_utf8(out, static_cast<uint32_t>(cp));
+    return true;
+}
+
+// Drop a multi-byte UTF-8 sequence left incomplete at the end of s
+void trim_partial_utf8(std::string& s) {
+    size_t n = s.size();
+    size_t back = 0;
+    while (back < 4 && back < n && (static_cast<unsigned char>(s[n - 1 - back]) & 0xC0) == 0x80) {
+        ++back;
+    }
+    if (back == n) return;
+    unsigned char lead = static_cast<unsigned char>(s[n - 1 - back]);
+    size_t want = (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 1;
+    if (want > back + 1) s.resize(n - 1 - back);
+}
+
+const std::string* find_attr(const std::vector<std::pair<std::string, std::string> >& attrs,
+                             const char* name) {
+    for (size_t i = 0; i < attrs.size(); ++i) {
+        if (attrs[i].first == name) return &attrs[i].second;
+    }
+    return nullptr;
+}
+
+std::string attr(const std::vector<std::pair<std::string, std::string> >& attrs, const char* name) {
+    const std::string* value = find_attr(attrs, name);
+    return value ? *value : std::string();
+}
+
+HtmlFormField make_field(const std::vector<std::pair<std::string, std::string> >& attrs,
+                         const std::string& type) {
+    HtmlFormField field;
+    field.name = attr(attrs, "name");
+    field.type = type;
+    field.required = find_attr(attrs, "required") != nullptr;
+    return field;
+}
+} // namespace
+
+// ============================================================================
+// HtmlTokenizer
+// ============================================================================
+
+// Attribute values may carry the same entities as text
+std::string HtmlTokenizer::decode_entities(const std::string& s) {
+    if (s.find('&') == std::string::npos) return s;
+    std::string out;
+    out.reserve(s.size());
+    std::string decoded;
+    size_t i = 0;
+    while (i < s.size()) {
+        if (s[i] == '&') {
+            size_t semi = s.find(';', i + 1);
+            if (semi != std::string::npos && semi - i - 1 <= MAX_ENTITY_CHARS &&
+                decode_entity(s.substr(i + 1, semi - i - 1), decoded)) {
+                out += decoded;
+                i = semi + 1;
+                continue;
+            }
+        }
+        out += s[i++];
+    }
+    return out;
+}
+
+void HtmlTokenizer::append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// "name a=1 b='x' c": tag_ after the name
+void HtmlTokenizer::parse_attributes(const std::string& tag, size_t pos, Attributes& attrs) {
+    size_t n = tag.size();
+    while (pos < n) {
+        while (pos < n && (is_space(tag[pos]) || tag[pos] == '/')) ++pos;
+        if (pos >= n) break;
+
+        size_t name_start = pos;
+        while (pos < n && !is_space(tag[pos]) && tag[pos] != '=' && tag[pos] != '/') ++pos;
+        std::string name = to_lower(tag.substr(name_start, pos - name_start));
+
+        while (pos < n && is_space(tag[pos])) ++pos;
+        std::string value;
+        if (pos < n && tag[pos] == '=') {
+            ++pos;
+            while (pos < n && is_space(tag[pos])) ++pos;
+            if (pos < n && (tag[pos] == '"' || tag[pos] == '\'')) {
+                char quote = tag[pos++];
+                size_t value_end = tag.find(quote, pos);
+                if (value_end == std::string::npos) value_end = n;
+                value = tag.substr(pos, value_end - pos);
+                pos = value_end < n ? value_end + 1 : n;
+            } else {
+                size_t value_start = pos;
+                while (pos < n && !is_space(tag[pos])) ++pos;
+                value = tag.substr(value_start, pos - value_start);
+            }
+        }
+        if (!name.empty()) attrs.push_back(std::make_pair(name, decode_entities(value)));
+    }
+}
+
+HtmlTokenizer::HtmlTokenizer(int outputs, size_t text_limit)
+    : outputs_(outputs)
+    , text_limit_(text_limit)
+    , done_(false)
+    , truncated_(false)
+    , bytes_fed_(0)
+    , state_(DATA)
+    , quote_(0)
+    , comment_dashes_(0)
+    , raw_end_(nullptr)
+    , raw_matched_(0)
+    , space_pending_(false)
+    , in_link_(false)
+    , in_form_(false)
+    , in_textarea_(false)
+    , in_select_(false)
+    , select_has_selected_(false)
+    , select_has_option_(false) {}
+
+bool HtmlTokenizer::feed(const char* data, size_t len) {
+    if (done_) return false;
+    bytes_fed_ += len;
+
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end && !done_) {
+        switch (state_) {
+        case DATA: {
+            const char* q = find_markup(p, end);
+            if (q > p) emit(p, static_cast<size_t>(q - p));
+            p = q;
+            if (p == end) break;
+            if (*p == '<') {
+                state_ = TAG_OPEN;
+            } else {
+                entity_.clear();
+                state_ = ENTITY;
+            }
+            ++p;
+            break;
+        }
+
+        case TAG_OPEN: {
+            char c = *p;
+            if (is_alpha(c) || c == '/' || c == '!' || c == '?') {
+                tag_.assign(1, c);
+                quote_ = 0;
+                state_ = TAG;
+                ++p;
+            } else {
+                emit("<", 1);               // "a < b" is text
+                state_ = DATA;
+            }
+            break;
+        }
+
+        case TAG: {
+            for (; p < end; ++p) {
+                char c = *p;
+                if (quote_) {
+                    if (c == quote_) quote_ = 0;
+                } else if (c == '>') {
+                    ++p;
+                    handle_tag();
+                    break;
+                } else if (c == '"' || c == '\'') {
+                    // Quotes open a value only right after '=' (apostrophes elsewhere are text)
+                    size_t k = tag_.size();
+                    while (k > 0 && is_space(tag_[k - 1])) --k;
+                    if (k > 0 && tag_[k - 1] == '=') quote_ = c;
+                }
+                if (tag_.size() < MAX_TAG_BYTES) tag_ += c;
+                if (tag_.size() == 3 && tag_ == "!--") {
+                    comment_dashes_ = 0;
+                    state_ = COMMENT;
+                    ++p;
+                    break;
+                }
+            }
+            break;
+        }
+
+        case COMMENT: {
+            const void* hit = std::memchr(p, '>', static_cast<size_t>(end - p));
+            const char* q = hit ? static_cast<const char*>(hit) : end;
+            // Count the dashes just before q, continuing the run from the previous piece
+            int dashes = 0;
+            const char* d = q;
+            while (d > p && d[-1] == '-' && dashes < 2) {
+                --d;
+                ++dashes;
+            }
+            if (d == p) dashes += comment_dashes_;
+            if (dashes > 2) dashes = 2;
+
+            if (!hit) {
+                comment_dashes_ = dashes;
+                p = end;
+            } else if (dashes >= 2) {
+                p = q + 1;
+                emit_separator();
+                state_ = DATA;
+            } else {
+                comment_dashes_ = 0;
+                p = q + 1;
+            }
+            break;
+        }
+
+        case ENTITY: {
+            char c = *p;
+            if (c == ';') {
+                finish_entity(true);
+                ++p;
+                state_ = DATA;
+            } else if ((is_alnum(c) || c == '#') && entity_.size() < MAX_ENTITY_CHARS) {
+                entity_ += c;
+                ++p;
+            } else {
+                finish_entity(false);       // c is handled as text
+                state_ = DATA;
+            }
+            break;
+        }
+
+        case RAW: {
+            const void* hit = std::memchr(p, '<', static_cast<size_t>(end - p));
+            if (!hit) {
+                p = end;
+            } else {
+                p = static_cast<const char*>(hit) + 1;
+                raw_matched_ = 0;
+                state_ = RAW_END;
+            }
+            break;
+        }
+
+        case RAW_END: {
+            char c = *p;
+            if (raw_end_[raw_matched_] != '\0') {
+                if (lower_ascii(c) == raw_end_[raw_matched_]) {
+                    ++raw_matched_;
+                    ++p;
+                } else {
+                    state_ = RAW;           // c may itself be '<'
+                }
+            } else if (is_space(c) || c == '/' || c == '>') {
+                tag_ = raw_end_;
+                quote_ = 0;
+                state_ = TAG;
+            } else {
+                state_ = RAW;               // e.g. "</scripts"
+            }
+            break;
+        }
+        }
+    }
+    return !done_;
+}
+
+void HtmlTokenizer::finish() {
+    if (state_ == ENTITY) {
+        finish_entity(false);
+    } else if (state_ == TAG_OPEN) {
+        emit("<", 1);
+    }
+    state_ = DATA;
+    close_link();
+    close_form();
+}
+
+void HtmlTokenizer::emit(const char* s, size_t n) {
+    if (in_link_ && link_.text.size() < MAX_LINK_TEXT_BYTES) {
+        link_.text.append(s, std::min(n, MAX_LINK_TEXT_BYTES - link_.text.size()));
+    }
+    if (in_textarea_ && textarea_.value.size() < MAX_FIELD_VALUE_BYTES) {
+        textarea_.value.append(s, std::min(n, MAX_FIELD_VALUE_BYTES - textarea_.value.size()));
+    }
+    if (!(outputs_ & TEXT) || truncated_) return;
+
+    // Collapse whitespace runs to one space, dropping leading/trailing ones
+    const char* end = s + n;
+    while (s < end) {
+        if (is_space(*s)) {
+            space_pending_ = true;
+            ++s;
+            continue;
+        }
+        const char* run = s;
+        while (s < end && !is_space(*s)) ++s;
+        size_t run_len = static_cast<size_t>(s - run);
+        bool space = space_pending_ && !text_.empty();
+        space_pending_ = false;
+
+        if (text_limit_ > 0 && text_.size() + (space ? 1 : 0) + run_len > text_limit_) {
+            if (space && text_.size() < text_limit_) text_ += ' ';
+            text_.append(run, text_limit_ - text_.size());
+            trim_partial_utf8(text_);
+            truncated_ = true;
+            if (outputs_ == TEXT) done_ = true;
+            return;
+        }
+        if (space) text_ += ' ';
+        text_.append(run, run_len);
+    }
+}
+
+void HtmlTokenizer::emit_separator() {
+    // Tags separate words like whitespace does
+    space_pending_ = true;
+    if (in_link_ && link_.text.size() < MAX_LINK_TEXT_BYTES) link_.text += ' ';
+}
+
+void HtmlTokenizer::finish_entity(bool terminated) {
+    std::string decoded;
+    if (terminated && decode_entity(entity_, decoded)) {
+        emit(decoded.data(), decoded.size());
+        return;
+    }
+    std::string literal = "&" + entity_;
+    if (terminated) literal += ';';
+    emit(literal.data(), literal.size());
+}
+
+void HtmlTokenizer::handle_tag() {
+    state_ = DATA;
+    emit_separator();
+
+    if (tag_.empty() || tag_[0] == '!' || tag_[0] == '?') return;     // Doctype, CDATA, PI
+
+    bool closing = tag_[0] == '/';
+    size_t pos = closing ? 1 : 0;
+    size_t name_start = pos;
+    while (pos < tag_.size() && !is_space(tag_[pos]) && tag_[pos] != '/') ++pos;
+    std::string name = to_lower(tag_.substr(name_start, pos - name_start));
+
+    if (closing) {
+        if (name == "a") {
+            close_link();
+        } else if (name == "form") {
+            close_form();
+        } else if (name == "textarea") {
+            close_textarea();
+        } else if (name == "select") {
+            close_select();
+        }
+        return;
+    }
+
+    if (name == "script" || name == "style") {
+        raw_end_ = name == "script" ? "/script" : "/style";
+        state_ = RAW;
+        return;
+    }
+
+    if (name == "a") {
+        if (!(outputs_ & LINKS)) return;
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        open_link(attrs);
+        return;
+    }
+
+    if (!(outputs_ & FORMS)) return;
+
+    if (name == "form") {
+        close_form();
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        in_form_ = true;
+        form_ = HtmlForm();
+        form_.action = attr(attrs, "action");
+        form_.method = attr(attrs, "method");
+        if (form_.method.empty()) form_.method = "GET";
+        for (size_t i = 0; i < form_.method.size(); ++i)
+            form_.method[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(form_.method[i])));
+        form_.id = attr(attrs, "id");
+        form_.name = attr(attrs, "name");
+        return;
+    }
+
+    if (!in_form_) return;  // Fields outside a form are not submittable
+
+    if (name == "input") {
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        std::string type = to_lower(attr(attrs, "type"));
+        HtmlFormField field = make_field(attrs, type.empty() ? "text" : type);
+        field.value = attr(attrs, "value");
+        if (!field.name.empty()) form_.fields.push_back(field);
+    } else if (name == "textarea") {
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        textarea_ = make_field(attrs, "textarea");
+        in_textarea_ = true;
+    } else if (name == "select") {
+        close_select();
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        select_ = make_field(attrs, "select");
+        in_select_ = true;
+        select_has_selected_ = false;
+        select_has_option_ = false;
+    } else if (name == "option" && in_select_) {
+        // The selected option's value, or else the first option's
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        bool selected = find_attr(attrs, "selected") != nullptr;
+        if (selected && !select_has_selected_) {
+            select_.value = attr(attrs, "value");
+            select_has_selected_ = true;
+        } else if (!select_has_option_ && !select_has_selected_) {
+            select_.value = attr(attrs, "value");
+        }
+        select_has_option_ = true;
+    } else if (name == "button") {
+        Attributes attrs;
+        parse_attributes(tag_, pos, attrs);
+        std::string type = to_lower(attr(attrs, "type"));
+        HtmlFormField field = make_field(attrs, "submit");
+        field.required = false;
+        field.value = attr(attrs, "value");
+        if (!field.name.empty() && (type.empty() || type == "submit")) {
+            form_.fields.push_back(field);
+        }
+    }
+}
+
+void HtmlTokenizer::open_link(const Attributes& attrs) {
+    close_link();
+    const std::string* href = find_attr(attrs, "href");
+    if (!href) return;
+    in_link_ = true;
+    link_.href = trim(*href);
+    link_.text.clear();
+}
+
+void HtmlTokenizer::close_link() {
+    if (!in_link_) return;
+    in_link_ = false;
+    link_.text = normalize_whitespace(link_.text);
+    links_.push_back(link_);
+}
+
+void HtmlTokenizer::close_textarea() {
+    if (!in_textarea_) return;
+    in_textarea_ = false;
+    textarea_.value = trim(textarea_.value);
+    if (!textarea_.name.empty()) form_.fields.push_back(textarea_);
+}
+
+void HtmlTokenizer::close_select() {
+    if (!in_select_) return;
+    in_select_ = false;
+    if (!select_.name.empty()) form_.fields.push_back(select_);
+}
+
+void HtmlTokenizer::close_form() {
+    if (!in_form_) return;
+    close_textarea();
+    close_select();
+    in_form_ = false;
+    forms_.push_back(form_);
+    form_ = HtmlForm();
+}
+
+} // namespace opencrank
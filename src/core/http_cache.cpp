@@ -0,0 +1,425 @@
+/*
+ * OpenCrank C++ - HTTP Response Cache Implementation
+ */
+#include <opencrank/core/http_cache.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/logger.hpp>
+#include <cstdlib>
+#include <ctime>
+
+namespace opencrank {
+
+namespace {
+
+const int64_t MAX_HEURISTIC_TTL_MS = 24LL * 3600 * 1000;
+
+// Header names are case-insensitive (HTTP/2 servers send them lowercase)
+const std::string* find_header(const std::map<std::string, std::string>& headers, const std::string& name) {
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (it->first.size() == name.size() && to_lower(it->first) == name) return &it->second;
+    }
+    return nullptr;
+}
+
+std::string header_or_empty(const std::map<std::string, std::string>& headers, const std::string& name) {
+    const std::string* v = find_header(headers, name);
+    return v ? *v : std::string();
+}
+
+void erase_header(std::map<std::string, std::string>& headers, const std::string& name) {
+    for (std::map<std::string, std::string>::iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (it->first.size() == name.size() && to_lower(it->first) == name) {
+            headers.erase(it);
+            return;
+        }
+    }
+}
+
+std::vector<std::string> split_list(const std::string& value) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t comma = value.find(',', start);
+        if (comma == std::string::npos) comma = value.size();
+        std::string item = trim(value.substr(start, comma - start));
+        if (!item.empty()) items.push_back(item);
+        start = comma + 1;
+    }
+    return items;
+}
+
+// Seconds since the epoch for an HTTP date, or -1
+int64_t http_date(const std::string& value) {
+    if (value.empty()) return -1;
+    time_t t = curl_getdate(value.c_str(), NULL);
+    return t == static_cast<time_t>(-1) ? -1 : static_cast<int64_t>(t);
+}
+
+struct CacheDirectives {
+    bool no_store;
+    bool no_cache;
+    int64_t max_age;        // Seconds, -1 if absent
+
+    CacheDirectives() : no_store(false), no_cache(false), max_age(-1) {}
+};
+
+CacheDirectives parse_cache_control(const std::string& value) {
+    CacheDirectives d;
+    std::vector<std::string> items = split_list(to_lower(value));
+    for (size_t i = 0; i < items.size(); ++i) {
+        const std::string& item = items[i];
+        if (item == "no-store") {
+            d.no_store = true;
+        } else if (item == "no-cache" || starts_with(item, "no-cache=")) {
+            d.no_cache = true;
+        } else if (starts_with(item, "max-age=")) {
+            d.max_age = std::atoll(item.c_str() + 8);
+        }
+    }
+    return d;
+}
+
+// How long a response stays fresh from now, per RFC 9111 4.2
+int64_t freshness_ms(const std::map<std::string, std::string>& headers, int64_t now_ms,
+                     int64_t default_ttl_ms) {
+    CacheDirectives cc = parse_cache_control(header_or_empty(headers, "cache-control"));
+    if (cc.no_cache) return 0;
+
+    int64_t age_ms = std::atoll(header_or_empty(headers, "age").c_str()) * 1000;
+    if (cc.max_age >= 0) return cc.max_age * 1000 - age_ms;
+
+    int64_t date = http_date(header_or_empty(headers, "date"));
+    if (date < 0) date = now_ms / 1000;
+
+    const std::string* expires = find_header(headers, "expires");
+    if (expires) {
+        int64_t t = http_date(*expires);
+        return t < 0 ? 0 : (t - date) * 1000 - age_ms;   // Invalid dates mean "already expired"
+    }
+
+    int64_t modified = http_date(header_or_empty(headers, "last-modified"));
+    if (modified >= 0 && modified < date) {
+        int64_t ttl = (date - modified) * 100;   // 10% of the age, in ms
+        return ttl < MAX_HEURISTIC_TTL_MS ? ttl : MAX_HEURISTIC_TTL_MS;
+    }
+    return default_ttl_ms;
+}
+
+// Fill status/freshness/validators of an entry from its response headers
+void apply_headers(HttpCacheEntry& entry, int64_t now_ms, int64_t default_ttl_ms) {
+    entry.etag = header_or_empty(entry.headers, "etag");
+    entry.last_modified = header_or_empty(entry.headers, "last-modified");
+    entry.stored_ms = now_ms;
+    entry.expires_ms = now_ms + freshness_ms(entry.headers, now_ms, default_ttl_ms);
+}
+
+} // namespace
+
+// ============================================================================
+// HttpCacheEntry
+// ============================================================================
+
+std::string HttpCacheEntry::header(const std::string& name) const {
+    return header_or_empty(headers, to_lower(name));
+}
+
+// ============================================================================
+// HttpCache
+// ============================================================================
+
+HttpCache& HttpCache::instance() {
+    static HttpCache cache;
+    return cache;
+}
+
+HttpCache::HttpCache()
+    : bytes_(0)
+    , max_bytes_(32 * 1024 * 1024)
+    , default_ttl_ms_(60000)
+    , hits_(0)
+    , misses_(0)
+    , revalidations_(0) {}
+
+void HttpCache::configure(size_t max_bytes, int64_t default_ttl_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    default_ttl_ms_ = default_ttl_ms < 0 ? 0 : default_ttl_ms;
+    while (bytes_ > max_bytes_ && !lru_.empty()) {
+        remove_locked(--lru_.end());
+    }
+}
+
+const char* HttpCache::outcome_name(Outcome outcome) {
+    switch (outcome) {
+        case HIT: return "hit";
+        case MISS: return "miss";
+        case REVALIDATED: return "revalidated";
+        default: return "bypass";
+    }
+}
+
+size_t HttpCache::entry_bytes(const HttpCacheEntry& entry) {
+    size_t n = entry.key.size() + (entry.body ? entry.body->size() : 0);
+    for (std::map<std::string, std::string>::const_iterator it = entry.headers.begin();
+         it != entry.headers.end(); ++it) {
+        n += it->first.size() + it->second.size();
+    }
+    std::lock_guard<std::mutex> lock(entry.text_mutex);
+    if (entry.text) n += entry.text->size();
+    return n;
+}
+
+HttpCacheEntryPtr HttpCache::get(const std::string& url,
+                                 const std::map<std::string, std::string>& headers,
+                                 const std::string& proxy, long timeout_ms,
+                                 Outcome* outcome,
+                                 const HttpDataCallback* on_data,
+                                 const std::atomic<bool>* cancel,
+                                 size_t max_body) {
+    int64_t now = current_timestamp_ms();
+    std::string key = "GET " + url;
+    if (!proxy.empty()) key += " via " + proxy;
+
+    // Credentials make a response user-specific; explicit conditionals mean
+    // the caller wants to see the 304 itself
+    CacheDirectives request_cc = parse_cache_control(header_or_empty(headers, "cache-control"));
+    bool cacheable = !request_cc.no_store &&
+                     !find_header(headers, "authorization") && !find_header(headers, "cookie") &&
+                     !find_header(headers, "if-none-match") && !find_header(headers, "if-modified-since");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (max_bytes_ == 0) cacheable = false;
+    }
+
+    HttpCacheEntryPtr cached;
+    if (cacheable) {
+        cached = lookup(key, headers);
+        if (cached && !request_cc.no_cache && now < cached->expires_ms) {
+            hits_.fetch_add(1);
+            if (outcome) *outcome = HIT;
+            LOG_DEBUG("[HttpCache] Hit %s", url.c_str());
+            return cached;
+        }
+    }
+
+    std::map<std::string, std::string> request_headers = headers;
+    if (cached) {
+        if (!cached->etag.empty()) request_headers["If-None-Match"] = cached->etag;
+        if (!cached->last_modified.empty()) request_headers["If-Modified-Since"] = cached->last_modified;
+    }
+
+    HttpResponse response;
+    bool stopped = false;   // Consumer cut the body short, or the caller cancelled
+    {
+        HttpClientPool::Lease http = HttpClientPool::instance().acquire(url);
+        http->set_timeout(timeout_ms);
+        http->set_cancel(cancel);
+        http->set_max_body(max_body);
+        if (on_data) {
+            HttpDataCallback sink = [on_data, &stopped](const char* data, size_t len) {
+                if ((*on_data)(data, len)) return true;
+                stopped = true;
+                return false;
+            };
+            response = http->get_stream(url, request_headers, proxy, sink);
+        } else {
+            response = http->get(url, request_headers, proxy);
+        }
+        if (cancel && cancel->load()) stopped = true;
+        if (response.truncated) stopped = true;
+    }
+
+    int64_t ttl;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ttl = default_ttl_ms_;
+    }
+    now = current_timestamp_ms();
+
+    if (cached && response.status_code == 304) {
+        // Same body, refreshed headers and lifetime
+        std::shared_ptr<HttpCacheEntry> refreshed = std::make_shared<HttpCacheEntry>();
+        refreshed->key = cached->key;
+        refreshed->status_code = cached->status_code;
+        refreshed->headers = cached->headers;
+        for (std::map<std::string, std::string>::const_iterator it = response.headers.begin();
+             it != response.headers.end(); ++it) {
+            erase_header(refreshed->headers, to_lower(it->first));
+            refreshed->headers[it->first] = it->second;
+        }
+        refreshed->body = cached->body;
+        refreshed->vary = cached->vary;
+        {
+            std::lock_guard<std::mutex> lock(cached->text_mutex);
+            refreshed->text = cached->text;
+        }
+        apply_headers(*refreshed, now, ttl);
+        store(refreshed);
+
+        revalidations_.fetch_add(1);
+        if (outcome) *outcome = REVALIDATED;
+        LOG_DEBUG("[HttpCache] Revalidated %s", url.c_str());
+        return refreshed;
+    }
+
+    std::shared_ptr<HttpCacheEntry> entry = std::make_shared<HttpCacheEntry>();
+    entry->key = key;
+    entry->status_code = response.status_code;
+    entry->headers.swap(response.headers);
+    entry->error.swap(response.error);
+    entry->truncated = response.truncated;
+    entry->body = std::make_shared<const std::string>(std::move(response.body));
+
+    bool storable = cacheable && !stopped && (entry->status_code == 200 || entry->status_code == 203);
+    if (storable) {
+        CacheDirectives cc = parse_cache_control(entry->header("cache-control"));
+        if (cc.no_store) storable = false;
+    }
+    if (storable) {
+        std::vector<std::string> names = split_list(to_lower(entry->header("vary")));
+        for (size_t i = 0; i < names.size() && storable; ++i) {
+            if (names[i] == "*") {
+                storable = false;
+            } else {
+                entry->vary.push_back(std::make_pair(names[i], header_or_empty(headers, names[i])));
+            }
+        }
+    }
+
+    if (cacheable) misses_.fetch_add(1);
+    if (storable) {
+        apply_headers(*entry, now, ttl);
+        store(entry);
+        if (outcome) *outcome = MISS;
+    } else {
+        if (cached) invalidate(url);    // Whatever we had is no longer current
+        if (outcome) *outcome = BYPASS;
+    }
+    return entry;
+}
+
+HttpCacheEntryPtr HttpCache::lookup(const std::string& key,
+                                    const std::map<std::string, std::string>& headers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::pair<std::multimap<std::string, Lru::iterator>::iterator,
+              std::multimap<std::string, Lru::iterator>::iterator> range = index_.equal_range(key);
+    for (std::multimap<std::string, Lru::iterator>::iterator it = range.first; it != range.second; ++it) {
+        const HttpCacheEntry& entry = *it->second->entry;
+        bool match = true;
+        for (size_t i = 0; i < entry.vary.size() && match; ++i) {
+            match = header_or_empty(headers, entry.vary[i].first) == entry.vary[i].second;
+        }
+        if (match) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->entry;
+        }
+    }
+    return HttpCacheEntryPtr();
+}
+
+void HttpCache::store(const HttpCacheEntryPtr& entry) {
+    size_t size = entry_bytes(*entry);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_bytes_ == 0 || size > max_bytes_ / 8) return;   // One page must not flush the cache
+
+    // Replace the variant with the same Vary values
+    std::pair<std::multimap<std::string, Lru::iterator>::iterator,
+              std::multimap<std::string, Lru::iterator>::iterator> range = index_.equal_range(entry->key);
+    for (std::multimap<std::string, Lru::iterator>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second->entry->vary == entry->vary) {
+            remove_locked(it->second);
+            break;
+        }
+    }
+
+    Slot slot;
+    slot.entry = entry;
+    slot.bytes = size;
+    lru_.push_front(slot);
+    index_.insert(std::make_pair(entry->key, lru_.begin()));
+    bytes_ += size;
+    while (bytes_ > max_bytes_ && lru_.size() > 1) {
+        remove_locked(--lru_.end());
+    }
+}
+
+void HttpCache::remove_locked(Lru::iterator it) {
+    const HttpCacheEntryPtr& entry = it->entry;
+    std::pair<std::multimap<std::string, Lru::iterator>::iterator,
+              std::multimap<std::string, Lru::iterator>::iterator> range = index_.equal_range(entry->key);
+    for (std::multimap<std::string, Lru::iterator>::iterator i = range.first; i != range.second; ++i) {
+        if (i->second == it) {
+            index_.erase(i);
+            break;
+        }
+    }
+    bytes_ -= it->bytes;
+    lru_.erase(it);
+}
+
+void HttpCache::invalidate(const std::string& url) {
+    std::string prefix = "GET " + url;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::multimap<std::string, Lru::iterator>::iterator it = index_.lower_bound(prefix);
+    while (it != index_.end() && starts_with(it->first, prefix)) {
+        // Same URL with or without a proxy suffix, not a longer URL
+        bool same_url = it->first.size() == prefix.size() ||
+                        it->first.compare(prefix.size(), 5, " via ") == 0;
+        Lru::iterator victim = it->second;
+        ++it;
+        if (same_url) remove_locked(victim);
+    }
+}
+
+std::shared_ptr<const std::string> HttpCache::derived_text(const HttpCacheEntryPtr& entry,
+                                                           TextDeriver derive) {
+    {
+        std::lock_guard<std::mutex> lock(entry->text_mutex);
+        if (entry->text) return entry->text;
+    }
+
+    std::shared_ptr<const std::string> text =
+        std::make_shared<const std::string>(derive(entry->body ? *entry->body : std::string()));
+    {
+        std::lock_guard<std::mutex> lock(entry->text_mutex);
+        if (entry->text) return entry->text;    // Another caller won the race
+        entry->text = text;
+    }
+
+    // Account for it if the entry is cached
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::pair<std::multimap<std::string, Lru::iterator>::iterator,
+              std::multimap<std::string, Lru::iterator>::iterator> range = index_.equal_range(entry->key);
+    for (std::multimap<std::string, Lru::iterator>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second->entry == entry) {
+            it->second->bytes += text->size();
+            bytes_ += text->size();
+            while (bytes_ > max_bytes_ && lru_.size() > 1) {
+                Lru::iterator last = --lru_.end();
+                if (last == it->second) break;
+                remove_locked(last);
+            }
+            break;
+        }
+    }
+    return text;
+}
+
+void HttpCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+size_t HttpCache::entries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+size_t HttpCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+} // namespace opencrank
@@ -1,12 +1,33 @@
 #include <opencrank/core/http_client.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/trace.hpp>
 #include <cstring>
+#include <cctype>
 #include <sstream>
 
 namespace opencrank {
 
-HttpClient::HttpClient() : curl_(nullptr), timeout_ms_(60000) {
+namespace {
+// "scheme://host:port" of url, lowercased (credentials dropped)
+std::string request_host(const std::string& url) {
+    size_t scheme_end = url.find("://");
+    size_t start = scheme_end == std::string::npos ? 0 : scheme_end + 3;
+    size_t end = url.find_first_of("/?#", start);
+    if (end == std::string::npos) end = url.size();
+    size_t at = url.find('@', start);
+    size_t host_start = (at != std::string::npos && at < end) ? at + 1 : start;
+
+    std::string host = url.substr(0, start) + url.substr(host_start, end - host_start);
+    for (size_t i = 0; i < host.size(); ++i) {
+        host[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(host[i])));
+    }
+    return host;
+}
+} // namespace
+
+HttpClient::HttpClient() : curl_(nullptr), share_(nullptr), http2_(false), timeout_ms_(60000), cancel_(nullptr),
+                           max_body_(0), decompress_(true) {
     curl_ = curl_easy_init();
 }
 
@@ -35,6 +56,20 @@ HttpResponse HttpClient::get(const std::string& url,
     return perform_request("GET", url, "", headers, proxy);
 }
 
+HttpResponse HttpClient::get_stream(const std::string& url,
+                                    const std::map<std::string, std::string>& headers,
+                                    const std::string& proxy,
+                                    const HttpDataCallback& on_data) {
+    return perform_request("GET", url, "", headers, proxy, &on_data);
+}
+
+HttpResponse HttpClient::get_sink(const std::string& url,
+                                  const std::map<std::string, std::string>& headers,
+                                  const std::string& proxy,
+                                  const HttpDataCallback& sink) {
+    return perform_request("GET", url, "", headers, proxy, &sink, false);
+}
+
 HttpResponse HttpClient::post_json(const std::string& url, 
                                    const Json& body,
                                    const std::map<std::string, std::string>& extra_headers) {
@@ -51,6 +86,16 @@ HttpResponse HttpClient::post_json(const std::string& url,
     return perform_request("POST", url, body, headers, "");
 }
 
+HttpResponse HttpClient::post_json_stream(const std::string& url,
+                                          const std::string& body,
+                                          const std::map<std::string, std::string>& extra_headers,
+                                          const HttpDataCallback& on_data) {
+    std::map<std::string, std::string> headers = extra_headers;
+    headers["Content-Type"] = "application/json";
+    headers["Accept"] = "text/event-stream";
+    return perform_request("POST", url, body, headers, "", &on_data);
+}
+
 HttpResponse HttpClient::post_form(const std::string& url,
                                    const std::map<std::string, std::string>& form_data,
                                    const std::map<std::string, std::string>& extra_headers) {
@@ -76,9 +121,32 @@ HttpResponse HttpClient::request(const std::string& method,
 
 size_t HttpClient::write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
     size_t total = size * nmemb;
-    std::string* response_body = static_cast<std::string*>(userdata);
-    response_body->append(ptr, total);
-    return total;
+    WriteContext* ctx = static_cast<WriteContext*>(userdata);
+    
+    size_t keep = total;
+    if (ctx->max_body > 0 && ctx->received + total > ctx->max_body) {
+        keep = ctx->max_body - ctx->received;
+        ctx->truncated = true;
+    }
+    ctx->received += keep;
+    
+    // Error bodies are left for the caller to parse as a whole
+    long status = 0;
+    curl_easy_getinfo(ctx->curl, CURLINFO_RESPONSE_CODE, &status);
+    bool success = status >= 200 && status < 300;
+    if (ctx->collect || !success) {
+        ctx->body->append(ptr, keep);
+    }
+    if (success && keep > 0 && ctx->on_data && *ctx->on_data && !(*ctx->on_data)(ptr, keep)) {
+        ctx->aborted = true;
+        return 0;  // Makes curl stop with CURLE_WRITE_ERROR
+    }
+    return ctx->truncated ? 0 : total;
+}
+
+int HttpClient::progress_callback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    // Non-zero makes curl stop with CURLE_ABORTED_BY_CALLBACK
+    return static_cast<const std::atomic<bool>*>(userdata)->load() ? 1 : 0;
 }
 
 size_t HttpClient::header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
@@ -139,8 +207,11 @@ HttpResponse HttpClient::perform_request(const std::string& method,
                                          const std::string& url,
                                          const std::string& body,
                                          const std::map<std::string, std::string>& headers,
-                                         const std::string& proxy) {
+                                         const std::string& proxy,
+                                         const HttpDataCallback* on_data,
+                                         bool collect) {
     HttpResponse resp;
+    ScopedSpan span(method + " " + request_host(url), "http");
     
     if (!curl_) {
         resp.error = "CURL not initialized";
@@ -171,6 +242,20 @@ HttpResponse HttpClient::perform_request(const std::string& method,
     // Avoid signals which can break timeouts when used in multithreaded programs
     curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
     
+    // Connection reuse (curl_easy_reset clears these, so set them every time)
+    if (share_) {
+        curl_easy_setopt(curl_, CURLOPT_SHARE, share_);
+    }
+    if (http2_) {
+        curl_easy_setopt(curl_, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    }
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+    
+    // "" = every encoding this libcurl decodes; the body arrives decoded
+    if (decompress_) {
+        curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, "");
+    }
+    
     // Set method
     if (method == "POST") {
         curl_easy_setopt(curl_, CURLOPT_POST, 1L);
@@ -208,8 +293,23 @@ HttpResponse HttpClient::perform_request(const std::string& method,
     
     // Set response callbacks
     std::string response_body;
+    WriteContext write_ctx;
+    write_ctx.body = &response_body;
+    write_ctx.on_data = on_data;
+    write_ctx.curl = curl_;
+    write_ctx.collect = collect;
+    write_ctx.max_body = max_body_;
+    write_ctx.received = 0;
+    write_ctx.aborted = false;
+    write_ctx.truncated = false;
     curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_body);
+    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &write_ctx);
+    
+    if (cancel_) {
+        curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl_, CURLOPT_XFERINFOFUNCTION, progress_callback);
+        curl_easy_setopt(curl_, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(cancel_));
+    }
     
     std::map<std::string, std::string> response_headers;
     curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, header_callback);
@@ -231,17 +331,40 @@ HttpResponse HttpClient::perform_request(const std::string& method,
         curl_slist_free_all(header_list);
     }
     
-    if (res != CURLE_OK) {
+    if (res == CURLE_WRITE_ERROR && write_ctx.aborted) {
+        // Stream consumer stopped early on purpose; keep what we have
+        LOG_DEBUG("◀ IN  %s %s stream stopped by consumer", method.c_str(), url.c_str());
+    } else if (res == CURLE_WRITE_ERROR && write_ctx.truncated) {
+        LOG_DEBUG("◀ IN  %s %s body cut off at %zu bytes", method.c_str(), url.c_str(), max_body_);
+        resp.truncated = true;
+    } else if (res != CURLE_OK) {
+        long request_bytes = 0;
+        curl_easy_getinfo(curl_, CURLINFO_REQUEST_SIZE, &request_bytes);
+        resp.sent = request_bytes > 0;
         LOG_DEBUG("◀ IN  %s %s FAILED: %s", method.c_str(), url.c_str(), curl_easy_strerror(res));
-        resp.error = curl_easy_strerror(res);
+        resp.error = res == CURLE_ABORTED_BY_CALLBACK ? "Request cancelled" : curl_easy_strerror(res);
+        span.set("error", resp.error);
         return resp;
     }
     
     // Get status code
     curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &resp.status_code);
+    resp.sent = true;
+    
+    if (span.active()) {
+        curl_off_t first_byte_us = 0;
+        curl_easy_getinfo(curl_, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us);
+        span.set("status", resp.status_code);
+        span.set("request_bytes", body.size());
+        span.set("response_bytes", static_cast<size_t>(write_ctx.received));
+        span.set("first_byte_ms", static_cast<int64_t>(first_byte_us / 1000));
+        span.set("streamed", on_data != nullptr);
+        if (resp.truncated) span.set("truncated", true);
+    }
     
     // Sanitize response body to ensure valid UTF-8 for JSON serialization
-    resp.body = sanitize_utf8(response_body);
+    resp.body.swap(response_body);
+    sanitize_utf8_in_place(resp.body);
     resp.headers = response_headers;
     
     LOG_DEBUG("◀ IN  %s %s -> HTTP %ld (%zu bytes)", 
@@ -264,4 +387,197 @@ HttpResponse HttpClient::perform_request(const std::string& method,
     return resp;
 }
 
+// ============================================================================
+// HttpClientPool
+// ============================================================================
+
+HttpClientPool& HttpClientPool::instance() {
+    static HttpClientPool pool;
+    return pool;
+}
+
+HttpClientPool::HttpClientPool()
+    : share_(nullptr), max_idle_(8), http2_(true), decompress_(true), stopped_(false), created_(0), reused_(0),
+      in_flight_(0), waiting_(0), max_in_flight_(0), max_per_host_(0) {
+    share_ = curl_share_init();
+    if (!share_) {
+        LOG_WARN("[HttpPool] curl_share_init failed, clients will not share connections");
+        return;
+    }
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) != CURLSHE_OK) {
+        LOG_DEBUG("[HttpPool] Shared connection cache not supported by this libcurl");
+    }
+}
+
+HttpClientPool::~HttpClientPool() {
+    shutdown();
+}
+
+void HttpClientPool::share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    (void)handle;
+    (void)access;
+    HttpClientPool* pool = static_cast<HttpClientPool*>(userptr);
+    pool->share_locks_[data].lock();
+}
+
+void HttpClientPool::share_unlock(CURL* handle, curl_lock_data data, void* userptr) {
+    (void)handle;
+    HttpClientPool* pool = static_cast<HttpClientPool*>(userptr);
+    pool->share_locks_[data].unlock();
+}
+
+HttpClientPool::Lease HttpClientPool::acquire() {
+    return Lease(this, borrow());
+}
+
+HttpClientPool::Lease HttpClientPool::acquire(const std::string& url) {
+    std::string host = request_host(url);
+    {
+        std::unique_lock<std::mutex> lock(slots_mutex_);
+        bool logged = false;
+        while ((max_in_flight_ > 0 && in_flight_ >= max_in_flight_) ||
+               (max_per_host_ > 0 && host_in_flight_[host] >= max_per_host_)) {
+            if (!logged) {
+                LOG_DEBUG("[HttpPool] Waiting for a request slot (%s: %zu in flight, %zu total)",
+                          host.c_str(), host_in_flight_[host], in_flight_);
+                logged = true;
+            }
+            ++waiting_;
+            slots_cv_.wait(lock);
+            --waiting_;
+        }
+        ++host_in_flight_[host];
+        ++in_flight_;
+    }
+    return Lease(this, borrow(), host);
+}
+
+void HttpClientPool::release_slot(const std::string& host) {
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        std::map<std::string, size_t>::iterator it = host_in_flight_.find(host);
+        if (it != host_in_flight_.end() && --it->second == 0) {
+            host_in_flight_.erase(it);
+        }
+        if (in_flight_ > 0) --in_flight_;
+    }
+    // Waiters may be blocked on different hosts; let each recheck its own
+    slots_cv_.notify_all();
+}
+
+void HttpClientPool::set_request_limits(size_t max_in_flight, size_t max_per_host) {
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        max_in_flight_ = max_in_flight;
+        max_per_host_ = max_per_host;
+    }
+    slots_cv_.notify_all();
+}
+
+size_t HttpClientPool::in_flight() const {
+    std::lock_guard<std::mutex> lock(slots_mutex_);
+    return in_flight_;
+}
+
+size_t HttpClientPool::waiting() const {
+    std::lock_guard<std::mutex> lock(slots_mutex_);
+    return waiting_;
+}
+
+HttpClient* HttpClientPool::borrow() {
+    HttpClient* client = nullptr;
+    CURLSH* share = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopped_) share = share_;
+        if (!idle_.empty()) {
+            client = idle_.back();
+            idle_.pop_back();
+        }
+    }
+    
+    if (client) {
+        reused_.fetch_add(1);
+    } else {
+        client = new HttpClient();
+        created_.fetch_add(1);
+    }
+    
+    // Reset per-borrow state left by the previous user
+    client->set_timeout(60000);
+    client->clear_proxy();
+    client->set_share(share);
+    client->set_http2(http2_);
+    client->set_decompress(decompress_);
+    
+    return client;
+}
+
+void HttpClientPool::release(HttpClient* client) {
+    client->set_cancel(nullptr);
+    client->set_max_body(0);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopped_ && idle_.size() < max_idle_) {
+            idle_.push_back(client);
+            return;
+        }
+    }
+    delete client;
+}
+
+CURLSH* HttpClientPool::share() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stopped_ ? nullptr : share_;
+}
+
+void HttpClientPool::set_max_idle(size_t max_idle) {
+    std::vector<HttpClient*> excess;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_idle_ = max_idle;
+        while (idle_.size() > max_idle_) {
+            excess.push_back(idle_.back());
+            idle_.pop_back();
+        }
+    }
+    for (size_t i = 0; i < excess.size(); ++i) {
+        delete excess[i];
+    }
+}
+
+size_t HttpClientPool::idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+void HttpClientPool::shutdown() {
+    std::vector<HttpClient*> clients;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) return;
+        stopped_ = true;
+        clients.swap(idle_);
+    }
+    for (size_t i = 0; i < clients.size(); ++i) {
+        delete clients[i];
+    }
+    
+    if (share_) {
+        // Fails with CURLSHE_IN_USE if a borrowed client still holds it
+        if (curl_share_cleanup(share_) == CURLSHE_OK) {
+            share_ = nullptr;
+        } else {
+            LOG_WARN("[HttpPool] Share handle still in use at shutdown");
+        }
+    }
+    
+    LOG_DEBUG("[HttpPool] Shutdown (created=%zu, reused=%zu)", created_.load(), reused_.load());
+}
+
 } // namespace opencrank
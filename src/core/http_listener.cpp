@@ -0,0 +1,307 @@
+/*
+ * OpenCrank C++ - Minimal HTTP/1.1 Listener Implementation
+ */
+#include <opencrank/core/http_listener.hpp>
+#include <opencrank/core/reactor.hpp>
+#include <opencrank/core/hot_restart.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+namespace opencrank {
+
+namespace {
+const size_t MAX_REQUEST_BYTES = 1024 * 1024;
+const int64_t IDLE_TIMEOUT_MS = 10000;
+
+void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+void send_reply(int fd, const HttpReply& reply) {
+    const char* reason = "OK";
+    switch (reply.status) {
+        case 200: reason = "OK"; break;
+        case 400: reason = "Bad Request"; break;
+        case 401: reason = "Unauthorized"; break;
+        case 403: reason = "Forbidden"; break;
+        case 404: reason = "Not Found"; break;
+        case 413: reason = "Payload Too Large"; break;
+        default: reason = "Error"; break;
+    }
+    std::string resp = "HTTP/1.1 " + std::to_string(reply.status) + " " + reason + "\r\n";
+    if (!reply.body.empty()) resp += "Content-Type: " + reply.content_type + "\r\n";
+    resp += "Content-Length: " + std::to_string(reply.body.size()) + "\r\nConnection: close\r\n\r\n";
+    resp += reply.body;
+    ssize_t n = ::send(fd, resp.data(), resp.size(), MSG_NOSIGNAL);
+    (void)n;  // Best effort; senders retry what they did not get an answer for
+}
+} // namespace
+
+// ============================================================================
+// HttpRequest
+// ============================================================================
+
+std::string HttpRequest::header(const std::string& name) const {
+    std::map<std::string, std::string>::const_iterator it = headers.find(name);
+    return it == headers.end() ? std::string() : it->second;
+}
+
+std::string HttpRequest::query_param(const std::string& key) const {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.size();
+        size_t eq = query.find('=', pos);
+        if (eq != std::string::npos && eq < amp && query.compare(pos, eq - pos, key) == 0) {
+            std::string out;
+            for (size_t i = eq + 1; i < amp; ++i) {
+                if (query[i] == '+') {
+                    out += ' ';
+                } else if (query[i] == '%' && i + 2 < amp) {
+                    out += static_cast<char>(std::strtol(query.substr(i + 1, 2).c_str(), NULL, 16));
+                    i += 2;
+                } else {
+                    out += query[i];
+                }
+            }
+            return out;
+        }
+        pos = amp + 1;
+    }
+    return "";
+}
+
+// ============================================================================
+// HttpListener
+// ============================================================================
+
+HttpListener::HttpListener()
+    : listen_fd_(-1)
+    , reactor_(NULL)
+    , sweep_timer_(0) {}
+
+HttpListener::~HttpListener() {
+    close();
+}
+
+bool HttpListener::open(const std::string& tag, const std::string& restart_name,
+                        const std::string& bind_address, int port) {
+    close();
+    tag_ = tag;
+
+    // A hot restart hands the bound socket over; pending requests wait in it
+    int fd = restart_name.empty() ? -1 : HotRestart::instance().adopt_listener(restart_name);
+    if (fd < 0) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            LOG_ERROR("[%s] Socket failed: %s", tag_.c_str(), strerror(errno));
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1) {
+            LOG_ERROR("[%s] Invalid bind address: %s", tag_.c_str(), bind_address.c_str());
+            ::close(fd);
+            return false;
+        }
+        if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            listen(fd, 64) < 0) {
+            LOG_ERROR("[%s] Cannot listen on %s:%d: %s",
+                      tag_.c_str(), bind_address.c_str(), port, strerror(errno));
+            ::close(fd);
+            return false;
+        }
+    }
+    if (!restart_name.empty()) HotRestart::instance().offer_listener(restart_name, fd);
+    set_nonblocking(fd);
+    listen_fd_ = fd;
+    return true;
+}
+
+bool HttpListener::attach(Reactor& reactor, const Handler& handler) {
+    if (listen_fd_ < 0) return false;
+    handler_ = handler;
+    reactor_ = &reactor;
+
+    if (!reactor.add_fd(listen_fd_, EPOLLIN, [this](uint32_t) { on_accept(); })) {
+        reactor_ = NULL;
+        return false;
+    }
+    sweep_timer_ = reactor.add_timer(static_cast<int>(IDLE_TIMEOUT_MS), [this]() { sweep_idle(); }, true);
+    return true;
+}
+
+void HttpListener::close() {
+    std::vector<int> fds;
+    for (std::map<int, Connection>::iterator it = connections_.begin(); it != connections_.end(); ++it) {
+        fds.push_back(it->first);
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        close_connection(fds[i]);
+    }
+
+    if (reactor_) {
+        if (listen_fd_ >= 0) reactor_->remove_fd(listen_fd_);
+        if (sweep_timer_) reactor_->cancel_timer(sweep_timer_);
+    }
+    sweep_timer_ = 0;
+    reactor_ = NULL;
+
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+// ============================================================================
+// Connections
+// ============================================================================
+
+void HttpListener::on_accept() {
+    while (true) {
+        int fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_WARN("[%s] Accept failed: %s", tag_.c_str(), strerror(errno));
+            }
+            return;
+        }
+        Connection conn;
+        conn.last_active_ms = current_timestamp_ms();
+        connections_[fd] = conn;
+        if (!reactor_->add_fd(fd, EPOLLIN | EPOLLRDHUP, [this, fd](uint32_t) { on_readable(fd); })) {
+            connections_.erase(fd);
+            ::close(fd);
+        }
+    }
+}
+
+void HttpListener::on_readable(int fd) {
+    std::map<int, Connection>::iterator it = connections_.find(fd);
+    if (it == connections_.end()) return;
+
+    char buf[16384];
+    while (true) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            it->second.buffer.append(buf, static_cast<size_t>(n));
+            it->second.last_active_ms = current_timestamp_ms();
+            if (it->second.buffer.size() > MAX_REQUEST_BYTES) {
+                HttpReply reply;
+                reply.status = 413;
+                send_reply(fd, reply);
+                close_connection(fd);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) {
+            close_connection(fd);   // Peer closed before a full request
+            return;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            close_connection(fd);
+            return;
+        }
+        break;
+    }
+
+    HttpReply reply;
+    if (handle_request(it->second.buffer, reply)) {
+        send_reply(fd, reply);
+        close_connection(fd);
+    }
+}
+
+void HttpListener::close_connection(int fd) {
+    if (connections_.erase(fd) == 0) return;
+    if (reactor_) reactor_->remove_fd(fd);
+    ::close(fd);
+}
+
+void HttpListener::sweep_idle() {
+    int64_t cutoff = current_timestamp_ms() - IDLE_TIMEOUT_MS;
+    std::vector<int> idle;
+    for (std::map<int, Connection>::iterator it = connections_.begin(); it != connections_.end(); ++it) {
+        if (it->second.last_active_ms < cutoff) idle.push_back(it->first);
+    }
+    for (size_t i = 0; i < idle.size(); ++i) {
+        close_connection(idle[i]);
+    }
+}
+
+// ============================================================================
+// Request parsing
+// ============================================================================
+
+bool HttpListener::handle_request(const std::string& buffer, HttpReply& reply) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) return false;
+
+    // Request line: METHOD SP TARGET SP VERSION
+    size_t line_end = buffer.find("\r\n");
+    std::string request_line = buffer.substr(0, line_end);
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = sp1 == std::string::npos ? std::string::npos : request_line.find(' ', sp1 + 1);
+    if (sp2 == std::string::npos) {
+        reply.status = 400;
+        return true;
+    }
+    HttpRequest request;
+    request.method = request_line.substr(0, sp1);
+    request.path = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t question = request.path.find('?');
+    if (question != std::string::npos) {
+        request.query = request.path.substr(question + 1);
+        request.path.erase(question);
+    }
+
+    size_t pos = line_end + 2;
+    while (pos < header_end) {
+        size_t eol = buffer.find("\r\n", pos);
+        std::string line = buffer.substr(pos, eol - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            request.headers[to_lower(line.substr(0, colon))] = trim(line.substr(colon + 1));
+        }
+        pos = eol + 2;
+    }
+
+    size_t content_length = static_cast<size_t>(
+        std::strtoul(request.header("content-length").c_str(), NULL, 10));
+    if (content_length > MAX_REQUEST_BYTES) {
+        reply.status = 413;
+        return true;
+    }
+    size_t body_start = header_end + 4;
+    if (buffer.size() - body_start < content_length) return false;
+
+    request.body = buffer.data() + body_start;
+    request.body_size = content_length;
+    if (handler_) {
+        handler_(request, reply);
+    } else {
+        reply.status = 404;
+    }
+    return true;
+}
+
+} // namespace opencrank
@@ -0,0 +1,686 @@
+/*
+ * OpenCrank C++ - Streaming JSON Implementation
+ */
+#include <opencrank/core/json_stream.hpp>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace opencrank {
+
+namespace {
+const size_t MAX_RETAINED_BUFFER = 16 * 1024 * 1024;
+const char REPLACEMENT[] = "\xEF\xBF\xBD";  // U+FFFD
+
+// Length of the valid UTF-8 sequence starting at s[i], or 0 if invalid
+// (truncated, overlong, surrogate or beyond U+10FFFF)
+size_t utf8_sequence_length(const unsigned char* s, size_t i, size_t len) {
+    unsigned char c = s[i];
+    size_t n;
+    uint32_t cp;
+    if ((c & 0xE0) == 0xC0) { n = 2; cp = c & 0x1F; }
+    else if ((c & 0xF0) == 0xE0) { n = 3; cp = c & 0x0F; }
+    else if ((c & 0xF8) == 0xF0) { n = 4; cp = c & 0x07; }
+    else return 0;
+
+    if (i + n > len) return 0;
+    for (size_t j = 1; j < n; ++j) {
+        if ((s[i + j] & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (s[i + j] & 0x3F);
+    }
+    if ((n == 2 && cp < 0x80) || (n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000)) return 0;
+    if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+    return n;
+}
+} // namespace
+
+// ============================================================================
+// JsonWriter
+// ============================================================================
+
+std::string& JsonWriter::thread_buffer() {
+    static thread_local std::string buffer;
+    if (buffer.capacity() > MAX_RETAINED_BUFFER) {
+        std::string().swap(buffer);
+    }
+    buffer.clear();
+    return buffer;
+}
+
+void JsonWriter::separator() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (!first_.empty()) {
+        if (!first_.back()) out_ += ',';
+        first_.back() = false;
+    }
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    separator();
+    out_ += '{';
+    first_.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    out_ += '}';
+    first_.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    separator();
+    out_ += '[';
+    first_.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    out_ += ']';
+    first_.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name) {
+    separator();
+    write_string(name, std::strlen(name));
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string& name) {
+    separator();
+    write_string(name.data(), name.size());
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& s) {
+    separator();
+    write_string(s.data(), s.size());
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* s) {
+    separator();
+    write_string(s, std::strlen(s));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t n) {
+    separator();
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(n));
+    out_.append(buf, static_cast<size_t>(len));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double d) {
+    separator();
+    if (std::isfinite(d)) {
+        out_ += Json(d).dump();     // Shortest round-trip form
+    } else {
+        out_ += "null";
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b) {
+    separator();
+    out_ += b ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::null_value() {
+    separator();
+    out_ += "null";
+    return *this;
+}
+
+JsonWriter& JsonWriter::json(const Json& j) {
+    separator();
+    out_ += j.dump(-1, ' ', false, Json::error_handler_t::replace);
+    return *this;
+}
+
+void JsonWriter::write_string(const char* data, size_t len) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(data);
+    out_.reserve(out_.size() + len + 2);
+    out_ += '"';
+
+    size_t run = 0;     // Start of the pending run of bytes copied verbatim
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            ++i;
+            continue;
+        }
+        if (c >= 0x80) {
+            size_t n = utf8_sequence_length(s, i, len);
+            if (n > 0) {
+                i += n;
+                continue;
+            }
+        }
+
+        out_.append(data + run, i - run);
+        switch (c) {
+            case '"':  out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\n': out_ += "\\n"; break;
+            case '\t': out_ += "\\t"; break;
+            default:
+                if (c >= 0x80) {
+                    out_ += REPLACEMENT;
+                } else {
+                    out_ += ' ';    // Other control characters, as sanitize_utf8
+                }
+                break;
+        }
+        ++i;
+        run = i;
+    }
+    out_.append(data + run, len - run);
+    out_ += '"';
+}
+
+// ============================================================================
+// Field-filtering SAX reader
+// ============================================================================
+
+namespace {
+
+class FieldFilter : public nlohmann::json_sax<Json> {
+public:
+    FieldFilter(const std::vector<std::string>& keys, Json& result)
+        : keys_(keys), result_(result), depth_(0), capturing_(false) {}
+
+    bool null() override { return add(Json()); }
+    bool boolean(bool val) override { return add(Json(val)); }
+    bool number_integer(number_integer_t val) override { return add(Json(val)); }
+    bool number_unsigned(number_unsigned_t val) override { return add(Json(val)); }
+    bool number_float(number_float_t val, const string_t&) override { return add(Json(val)); }
+    bool string(string_t& val) override {
+        if (!wanted()) return depth_ > 0;
+        Json j(std::move(val));
+        return add(std::move(j));
+    }
+    bool binary(binary_t&) override { return add(Json()); }
+
+    bool start_object(std::size_t) override {
+        if (depth_ == 0) {
+            depth_ = 1;
+            return true;
+        }
+        ++depth_;
+        return open(Json::object());
+    }
+
+    bool end_object() override {
+        close();
+        --depth_;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        if (depth_ == 0) return false;  // Root must be an object
+        ++depth_;
+        return open(Json::array());
+    }
+
+    bool end_array() override {
+        close();
+        --depth_;
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        if (depth_ == 1) {
+            capturing_ = false;
+            for (size_t i = 0; i < keys_.size(); ++i) {
+                if (keys_[i] == val) {
+                    capturing_ = true;
+                    break;
+                }
+            }
+        }
+        if (capturing_) member_key_.swap(val);
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+        return false;
+    }
+
+private:
+    bool wanted() const { return depth_ >= 1 && capturing_; }
+
+    // Store a value at the current position; returns where it landed
+    Json* insert(Json&& v) {
+        if (stack_.empty()) {
+            Json& slot = result_[member_key_];
+            slot = std::move(v);
+            return &slot;
+        }
+        Json* top = stack_.back();
+        if (top->is_array()) {
+            top->push_back(std::move(v));
+            return &top->back();
+        }
+        Json& slot = (*top)[member_key_];
+        slot = std::move(v);
+        return &slot;
+    }
+
+    bool add(Json&& v) {
+        if (depth_ == 0) return false;  // Scalar root
+        if (wanted()) insert(std::move(v));
+        return true;
+    }
+
+    bool open(Json&& container) {
+        if (wanted()) stack_.push_back(insert(std::move(container)));
+        return true;
+    }
+
+    void close() {
+        if (wanted() && !stack_.empty()) stack_.pop_back();
+    }
+
+    const std::vector<std::string>& keys_;
+    Json& result_;
+    int depth_;
+    bool capturing_;
+    std::string member_key_;
+    std::vector<Json*> stack_;
+};
+
+} // namespace
+
+Json parse_json_fields(const std::string& text, const std::vector<std::string>& keys) {
+    Json result = Json::object();
+    FieldFilter filter(keys, result);
+    if (!Json::sax_parse(text, &filter)) {
+        return Json(Json::value_t::discarded);
+    }
+    return result;
+}
+
+// ============================================================================
+// JsonView
+// ============================================================================
+
+namespace {
+
+inline const char* skip_ws(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    return p;
+}
+
+// p at an opening quote; returns the closing quote, or nullptr when the
+// string is unterminated
+const char* string_close(const char* p, const char* end) {
+    ++p;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+#endif
+    for (;;) {
+#if defined(__SSE2__)
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                      _mm_cmpeq_epi8(v, backslash)));
+            if (mask) {
+                p += __builtin_ctz(static_cast<unsigned>(mask));
+                break;
+            }
+            p += 16;
+        }
+#endif
+        while (p < end && *p != '"' && *p != '\\') ++p;
+        if (p >= end) return nullptr;
+        if (*p == '"') return p;
+        p += 2;     // Escape and the character it protects
+        if (p > end) return nullptr;
+    }
+}
+
+// p at an opening quote; returns just past the closing one, or end
+inline const char* skip_string(const char* p, const char* end) {
+    const char* close = string_close(p, end);
+    return close ? close + 1 : end;
+}
+
+// First '"', '{', '}', '[' or ']' in [p, end), or end
+const char* find_structural(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i open_brace = _mm_set1_epi8('{');
+    const __m128i close_brace = _mm_set1_epi8('}');
+    const __m128i open_bracket = _mm_set1_epi8('[');
+    const __m128i close_bracket = _mm_set1_epi8(']');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, open_brace)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, close_brace),
+                                                _mm_or_si128(_mm_cmpeq_epi8(v, open_bracket),
+                                                             _mm_cmpeq_epi8(v, close_bracket))));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return p + __builtin_ctz(static_cast<unsigned>(mask));
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '{' && *p != '}' && *p != '[' && *p != ']') ++p;
+    return p;
+}
+
+// p at the first byte of a value; returns just past it, or end
+const char* skip_value(const char* p, const char* end) {
+    if (p >= end) return end;
+    if (*p == '"') return skip_string(p, end);
+    if (*p == '{' || *p == '[') {
+        size_t depth = 0;
+        while (p < end) {
+            p = find_structural(p, end);
+            if (p >= end) break;
+            char c = *p;
+            if (c == '"') {
+                p = skip_string(p, end);
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                ++depth;
+            } else if (--depth == 0) {
+                return p + 1;
+            }
+            ++p;
+        }
+        return end;
+    }
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') {
+        ++p;
+    }
+    return p;
+}
+
+// After a value at p: the next entry of the enclosing container, or nullptr
+const char* next_entry(const char* p, const char* end) {
+    p = skip_ws(skip_value(p, end), end);
+    if (p >= end || *p != ',') return nullptr;
+    return skip_ws(p + 1, end);
+}
+
+// p at a key's opening quote: its value, or nullptr when malformed
+const char* member_value(const char* p, const char* end) {
+    if (p >= end || *p != '"') return nullptr;
+    p = skip_ws(skip_string(p, end), end);
+    if (p >= end || *p != ':') return nullptr;
+    p = skip_ws(p + 1, end);
+    return p < end ? p : nullptr;
+}
+
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool read_hex4(const char* p, const char* end, uint32_t& out) {
+    if (end - p < 4) return false;
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+        int d = hex_digit(p[i]);
+        if (d < 0) return false;
+        out = (out << 4) | static_cast<uint32_t>(d);
+    }
+    return true;
+}
+
+void append_code_point(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Decode the string whose opening quote is at p into out; false if it is
+// unterminated. Bad \u escapes and lone surrogates become U+FFFD.
+bool unescape_string(const char* p, const char* end, std::string& out) {
+    const char* stop = string_close(p, end);
+    if (!stop) return false;
+    ++p;
+    out.reserve(out.size() + static_cast<size_t>(stop - p));
+    while (p < stop) {
+        const char* run = static_cast<const char*>(memchr(p, '\\', static_cast<size_t>(stop - p)));
+        if (!run) run = stop;
+        out.append(p, static_cast<size_t>(run - p));
+        p = run;
+        if (p >= stop) break;
+        if (stop - p < 2) return false;
+        char c = p[1];
+        p += 2;
+        switch (c) {
+            case '"':  out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/'; break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!read_hex4(p, stop, cp)) {
+                    out += REPLACEMENT;
+                    break;
+                }
+                p += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t low;
+                    if (stop - p >= 6 && p[0] == '\\' && p[1] == 'u' && read_hex4(p + 2, stop, low) &&
+                        low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                append_code_point(out, cp);
+                break;
+            }
+            default:
+                out += c;
+                break;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+JsonView::JsonView(const char* data, size_t len) : p_(nullptr), end_(data + len) {
+    const char* p = skip_ws(data, end_);
+    if (p < end_) p_ = p;
+}
+
+JsonView::JsonView(const std::string& text) : p_(nullptr), end_(text.data() + text.size()) {
+    const char* p = skip_ws(text.data(), end_);
+    if (p < end_) p_ = p;
+}
+
+JsonView::Type JsonView::type() const {
+    if (!p_ || p_ >= end_) return MISSING;
+    switch (*p_) {
+        case '{': return OBJECT;
+        case '[': return ARRAY;
+        case '"': return STRING;
+        case 't':
+        case 'f': return BOOLEAN;
+        case 'n': return NULL_VALUE;
+        default:
+            return (*p_ == '-' || (*p_ >= '0' && *p_ <= '9')) ? NUMBER : MISSING;
+    }
+}
+
+JsonView JsonView::operator[](const char* key) const {
+    return find(key, strlen(key));
+}
+
+JsonView JsonView::find(const char* key, size_t len) const {
+    if (type() != OBJECT) return JsonView();
+    const char* p = skip_ws(p_ + 1, end_);
+    std::string decoded;
+    while (p < end_ && *p == '"') {
+        const char* value = member_value(p, end_);
+        if (!value) break;
+        // Raw bytes match unless the key was written with escapes
+        const char* k = p + 1;
+        bool match;
+        if (static_cast<size_t>(end_ - k) > len && memcmp(k, key, len) == 0 && k[len] == '"') {
+            match = true;
+        } else if (memchr(k, '\\', static_cast<size_t>(value - k)) != nullptr) {
+            decoded.clear();
+            match = unescape_string(p, end_, decoded) && decoded.size() == len &&
+                    memcmp(decoded.data(), key, len) == 0;
+        } else {
+            match = false;
+        }
+        if (match) return JsonView(value, end_, true);
+        p = next_entry(value, end_);
+        if (!p) break;
+    }
+    return JsonView();
+}
+
+JsonView JsonView::at(size_t index) const {
+    if (type() != ARRAY) return JsonView();
+    const char* p = skip_ws(p_ + 1, end_);
+    if (p >= end_ || *p == ']') return JsonView();
+    for (size_t i = 0; i < index && p; ++i) {
+        p = next_entry(p, end_);
+    }
+    return p ? JsonView(p, end_, true) : JsonView();
+}
+
+std::string JsonView::get_string(const std::string& def) const {
+    if (type() != STRING) return def;
+    std::string out;
+    if (!unescape_string(p_, end_, out)) return def;
+    return out;
+}
+
+int64_t JsonView::get_int(int64_t def) const {
+    if (type() != NUMBER) return def;
+    const char* p = p_;
+    bool negative = *p == '-';
+    if (negative) ++p;
+    uint64_t n = 0;
+    const char* digits = p;
+    while (p < end_ && *p >= '0' && *p <= '9' && p - digits < 19) {
+        n = n * 10 + static_cast<uint64_t>(*p - '0');
+        ++p;
+    }
+    if (p == digits) return def;
+    if (p < end_ && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E')) {
+        return static_cast<int64_t>(get_double(static_cast<double>(def)));
+    }
+    return negative ? -static_cast<int64_t>(n) : static_cast<int64_t>(n);
+}
+
+double JsonView::get_double(double def) const {
+    if (type() != NUMBER) return def;
+    char buf[64];
+    size_t len = static_cast<size_t>(value_end() - p_);
+    if (len == 0 || len >= sizeof(buf)) return def;
+    memcpy(buf, p_, len);
+    buf[len] = '\0';
+    char* parsed_end = nullptr;
+    double d = strtod(buf, &parsed_end);
+    return parsed_end == buf ? def : d;
+}
+
+bool JsonView::get_bool(bool def) const {
+    if (type() != BOOLEAN) return def;
+    size_t avail = static_cast<size_t>(end_ - p_);
+    if (avail >= 4 && memcmp(p_, "true", 4) == 0) return true;
+    if (avail >= 5 && memcmp(p_, "false", 5) == 0) return false;
+    return def;
+}
+
+const char* JsonView::value_end() const {
+    return skip_value(p_, end_);
+}
+
+std::string JsonView::raw() const {
+    if (!exists()) return std::string();
+    return std::string(p_, value_end());
+}
+
+Json JsonView::parse() const {
+    if (!exists()) return Json(Json::value_t::discarded);
+    return Json::parse(p_, value_end(), nullptr, false);
+}
+
+JsonView::Iterator JsonView::begin() const {
+    Type t = type();
+    if (t != OBJECT && t != ARRAY) return Iterator();
+    return Iterator(skip_ws(p_ + 1, end_), end_, t == OBJECT);
+}
+
+JsonView::Iterator::Iterator(const char* p, const char* end, bool object)
+    : p_(nullptr), end_(end), object_(object), key_(nullptr) {
+    enter(p);
+}
+
+void JsonView::Iterator::enter(const char* p) {
+    p_ = nullptr;
+    key_ = nullptr;
+    if (!p || p >= end_ || *p == '}' || *p == ']') return;
+    if (object_) {
+        const char* value = member_value(p, end_);
+        if (!value) return;
+        key_ = p;
+        p_ = value;
+    } else {
+        p_ = p;
+    }
+}
+
+JsonView::Iterator& JsonView::Iterator::operator++() {
+    if (p_) enter(next_entry(p_, end_));
+    return *this;
+}
+
+std::string JsonView::Iterator::key() const {
+    return key_ ? JsonView(key_, end_, true).get_string() : std::string();
+}
+
+} // namespace opencrank
@@ -3,15 +3,30 @@
  */
 #include <opencrank/core/loader.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/startup_profile.hpp>
 #include <dlfcn.h>
 #include <opencrank/core/dl_utils.hpp>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <cstring>
+#include <algorithm>
 
 namespace opencrank {
 
 namespace {
+    struct StaticPlugin {
+        GetPluginInfoFunc get_info;
+        CreatePluginFunc create;
+        DestroyPluginFunc destroy;
+    };
+
+    // Function-local so registrations from any translation unit's static
+    // initializers find it constructed
+    std::vector<StaticPlugin>& static_plugins() {
+        static std::vector<StaticPlugin> table;
+        return table;
+    }
+
     void teardown_loaded_plugin(LoadedPlugin& plugin) {
         if (plugin.instance) {
             plugin.instance->shutdown();
@@ -26,9 +41,40 @@ namespace {
             plugin.handle = nullptr;
         }
     }
+
+    void file_stamp(const std::string& path, int64_t& mtime_ns, int64_t& size) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            mtime_ns = 0;
+            size = 0;
+            return;
+        }
+        mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        size = static_cast<int64_t>(st.st_size);
+    }
 }
 
-PluginLoader::PluginLoader() {
+bool register_static_plugin(GetPluginInfoFunc get_info, CreatePluginFunc create,
+                            DestroyPluginFunc destroy) {
+    StaticPlugin entry;
+    entry.get_info = get_info;
+    entry.create = create;
+    entry.destroy = destroy;
+    static_plugins().push_back(entry);
+    return true;
+}
+
+std::vector<std::string> static_plugin_names() {
+    std::vector<std::string> names;
+    const std::vector<StaticPlugin>& table = static_plugins();
+    for (std::vector<StaticPlugin>::const_iterator it = table.begin(); it != table.end(); ++it) {
+        names.push_back(it->get_info().name);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+PluginLoader::PluginLoader() : lazy_binding_(false), profile_(nullptr) {
     // Default search paths
     search_paths_.push_back("./opencrank/plugins");
     search_paths_.push_back("/usr/lib/opencrank/plugins");
@@ -40,6 +86,30 @@ PluginLoader::~PluginLoader() {
 }
 
 bool PluginLoader::load(const std::string& path) {
+    // Plugins compiled into the binary win over a .so of the same name
+    if (path.find('/') == std::string::npos) {
+        LoadedPlugin plugin;
+        if (find_static(path, plugin)) {
+            StartupProfile::Scope scope(profile_, "load", path);
+            plugin.instance = plugin.create_func();
+            if (!plugin.instance) {
+                scope.set_ok(false);
+                set_error("Failed to create plugin instance: " + path);
+                return false;
+            }
+            if (name_index_.find(plugin.info.name) != name_index_.end()) {
+                LOG_WARN("Plugin %s already loaded, skipping", plugin.info.name);
+                plugin.destroy_func(plugin.instance);
+                return true;
+            }
+            name_index_[plugin.info.name] = plugins_.size();
+            plugins_.push_back(plugin);
+            LOG_INFO("Loaded plugin: %s v%s (%s, static)",
+                     plugin.info.name, plugin.info.version, plugin.info.type);
+            return true;
+        }
+    }
+    
     // Check if it's a full path or just a name
     std::string full_path;
     struct stat st;
@@ -55,7 +125,9 @@ bool PluginLoader::load(const std::string& path) {
     }
     
     LoadedPlugin plugin;
+    StartupProfile::Scope scope(profile_, "load", path);
     if (!load_impl(full_path, plugin)) {
+        scope.set_ok(false);
         return false;
     }
     
@@ -80,7 +152,7 @@ bool PluginLoader::load(const std::string& path) {
 
 bool PluginLoader::load_impl(const std::string& path, LoadedPlugin& plugin) {
     // Open shared library
-    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+    void* handle = dlopen(path.c_str(), (lazy_binding_ ? RTLD_LAZY : RTLD_NOW) | RTLD_GLOBAL);
     if (!handle) {
         set_error(std::string("dlopen failed: ") + dlerror());
         return false;
@@ -88,6 +160,7 @@ bool PluginLoader::load_impl(const std::string& path, LoadedPlugin& plugin) {
     
     plugin.handle = handle;
     plugin.path = path;
+    file_stamp(path, plugin.file_mtime_ns, plugin.file_size);
     
     // Lookup required symbols (use templated helper to avoid repetitive casts)
     GetPluginInfoFunc get_info = get_symbol<GetPluginInfoFunc>(handle, "opencrank_get_plugin_info");
@@ -120,6 +193,20 @@ bool PluginLoader::load_impl(const std::string& path, LoadedPlugin& plugin) {
     return true;
 }
 
+bool PluginLoader::find_static(const std::string& name, LoadedPlugin& plugin) {
+    const std::vector<StaticPlugin>& table = static_plugins();
+    for (std::vector<StaticPlugin>::const_iterator it = table.begin(); it != table.end(); ++it) {
+        PluginInfo info = it->get_info();
+        if (name != info.name) continue;
+        plugin.path = "(static)";
+        plugin.info = info;
+        plugin.create_func = it->create;
+        plugin.destroy_func = it->destroy;
+        return true;
+    }
+    return false;
+}
+
 int PluginLoader::load_dir(const std::string& dir) {
     LOG_DEBUG("[Loader] Scanning plugin directory: %s", dir.c_str());
     DIR* d = opendir(dir.c_str());
@@ -148,8 +235,8 @@ int PluginLoader::load_dir(const std::string& dir) {
     return count;
 }
 
-int PluginLoader::load_from_config(const Config& config) {
-    int count = 0;
+std::vector<std::string> PluginLoader::configured(const Config& config) {
+    std::vector<std::string> names;
     
     // Get plugin list from config
     const Json& plugins_config = config.get_section("plugins");
@@ -159,8 +246,8 @@ int PluginLoader::load_from_config(const Config& config) {
         for (const auto& item : plugins_config) {
             if (item.is_string()) {
                 std::string name = item.get<std::string>();
-                if (!name.empty() && load(name)) {
-                    count++;
+                if (!name.empty()) {
+                    names.push_back(name);
                 }
             }
         }
@@ -179,10 +266,19 @@ int PluginLoader::load_from_config(const Config& config) {
                     continue;
                 }
             }
-            
-            if (load(it.key())) {
-                count++;
-            }
+            names.push_back(it.key());
+        }
+    }
+    
+    return names;
+}
+
+int PluginLoader::load_from_config(const Config& config) {
+    int count = 0;
+    std::vector<std::string> names = configured(config);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (load(names[i])) {
+            count++;
         }
     }
     
@@ -200,12 +296,26 @@ void PluginLoader::unload(const std::string& name) {
     
     size_t idx = it->second;
     LoadedPlugin& plugin = plugins_[idx];
+    bool shared = plugin.handle != nullptr;
     teardown_loaded_plugin(plugin);
     
+    // dlclose keeps a library mapped while another object still uses it or
+    // it defines GNU unique symbols; a later load would get the old code
+    void* still = shared ? dlopen(plugin.path.c_str(), RTLD_LAZY | RTLD_NOLOAD) : nullptr;
+    if (still) {
+        LOG_WARN("Plugin %s is still mapped after unload; loading it again reuses the old code",
+                 name.c_str());
+        dlclose(still);
+    }
+    
     LOG_INFO("Unloaded plugin: %s", name.c_str());
     
-    // Remove from maps (mark as unloaded but keep in vector to preserve indices)
-    name_index_.erase(it);
+    // Its info strings lived in the closed library: drop the entry
+    plugins_.erase(plugins_.begin() + static_cast<long>(idx));
+    name_index_.clear();
+    for (size_t i = 0; i < plugins_.size(); ++i) {
+        name_index_[plugins_[i].info.name] = i;
+    }
 }
 
 void PluginLoader::unload_all() {
@@ -235,6 +345,20 @@ bool PluginLoader::is_loaded(const std::string& name) const {
     return name_index_.find(name) != name_index_.end();
 }
 
+const LoadedPlugin* PluginLoader::loaded(const std::string& name) const {
+    std::map<std::string, size_t>::const_iterator it = name_index_.find(name);
+    return it != name_index_.end() ? &plugins_[it->second] : nullptr;
+}
+
+bool PluginLoader::changed_on_disk(const std::string& name) const {
+    const LoadedPlugin* plugin = loaded(name);
+    if (!plugin || !plugin->handle) return false;   // Static plugins never change
+    int64_t mtime_ns = 0;
+    int64_t size = 0;
+    file_stamp(plugin->path, mtime_ns, size);
+    return mtime_ns != 0 && (mtime_ns != plugin->file_mtime_ns || size != plugin->file_size);
+}
+
 std::string PluginLoader::last_error() const {
     return last_error_;
 }
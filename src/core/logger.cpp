@@ -1,4 +1,13 @@
 #include <opencrank/core/logger.hpp>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstring>
 
 namespace opencrank {
 
@@ -89,6 +98,139 @@ static std::pair<std::string, std::string> extract_class_and_function(const char
     return {class_name, func_name};
 }
 
+// ============================================================================
+// Async state
+// ============================================================================
+
+struct Logger::Record {
+    uint64_t seq;
+    int64_t ts_ms;
+    LogLevel level;
+    int line;
+    uint32_t thread;
+    char file[96];
+    char func[160];
+    char text[768];
+    std::string* overflow;      // Heap copy when text[] is too small (rare)
+
+    Record() : seq(0), ts_ms(0), level(LogLevel::INFO), line(0), thread(0), overflow(nullptr) {
+        file[0] = func[0] = text[0] = '\0';
+    }
+
+    const char* message() const { return overflow ? overflow->c_str() : text; }
+};
+
+// Single producer (owning thread), single consumer (writer thread)
+struct Logger::Ring {
+    explicit Ring(size_t entries) : slots(entries), head(0), tail(0) {}
+
+    std::vector<Record> slots;
+    std::atomic<size_t> head;   // Next slot to write (producer)
+    std::atomic<size_t> tail;   // Next slot to read (writer)
+};
+
+struct Logger::AsyncState {
+    // Outputs + formatting buffers (sync callers and the writer)
+    std::mutex output_mutex;
+    LoggerOptions options;
+    FILE* file;
+    time_t cached_sec;
+    char cached_ts[32];
+    std::string line;
+
+    std::atomic<bool> async;
+    std::atomic<bool> stop;
+    std::atomic<bool> writer_idle;
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> generation;   // Bumped when rings are reset
+    uint64_t reported_drops;
+    std::thread writer;
+
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+
+    AsyncState()
+        : file(nullptr), cached_sec(0), async(false), stop(false), writer_idle(false)
+        , seq(0), generation(1), reported_drops(0) {
+        cached_ts[0] = '\0';
+    }
+};
+
+namespace {
+
+thread_local std::shared_ptr<void> tls_ring;    // Holds this thread's Ring
+thread_local uint64_t tls_ring_generation = 0;
+
+uint32_t current_thread_tag() {
+    thread_local uint32_t tag = static_cast<uint32_t>(
+        std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return tag;
+}
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void copy_truncated(char* dst, size_t size, const char* src) {
+    size_t n = src ? strlen(src) : 0;
+    if (n >= size) n = size - 1;
+    if (n) memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+// Format into rec.text, spilling to the heap if it does not fit
+void format_message(char* text, size_t size, std::string*& overflow,
+                    const char* fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(text, size, fmt, args);
+    if (n >= static_cast<int>(size)) {
+        overflow = new std::string(static_cast<size_t>(n) + 1, '\0');
+        vsnprintf(&(*overflow)[0], overflow->size(), fmt, copy);
+        overflow->resize(static_cast<size_t>(n));
+    }
+    va_end(copy);
+}
+
+void append_json_string(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; ++s) {
+        unsigned char c = static_cast<unsigned char>(*s);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += '"';
+}
+
+void append_le(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Logger
+// ============================================================================
+
 // Force visibility for the singleton across shared library boundaries
 #ifdef __GNUC__
 __attribute__((visibility("default")))
@@ -98,12 +240,12 @@ Logger& Logger::instance() {
     return logger;
 }
 
-void Logger::set_level(LogLevel level) { level_ = level; }
+void Logger::set_level(LogLevel level) { level_.store(static_cast<int>(level)); }
 
-LogLevel Logger::level() const { return level_; }
+LogLevel Logger::level() const { return static_cast<LogLevel>(level_.load()); }
 
 void Logger::debug(const char* file, int line, const char* func, const char* fmt, ...) {
-    if (level_ > LogLevel::DEBUG) return;
+    if (!enabled(LogLevel::DEBUG)) return;
     va_list args;
     va_start(args, fmt);
     log_impl(LogLevel::DEBUG, file, line, func, fmt, args);
@@ -111,7 +253,7 @@ void Logger::debug(const char* file, int line, const char* func, const char* fmt
 }
 
 void Logger::info(const char* file, int line, const char* func, const char* fmt, ...) {
-    if (level_ > LogLevel::INFO) return;
+    if (!enabled(LogLevel::INFO)) return;
     va_list args;
     va_start(args, fmt);
     log_impl(LogLevel::INFO, file, line, func, fmt, args);
@@ -119,7 +261,7 @@ void Logger::info(const char* file, int line, const char* func, const char* fmt,
 }
 
 void Logger::warn(const char* file, int line, const char* func, const char* fmt, ...) {
-    if (level_ > LogLevel::WARN) return;
+    if (!enabled(LogLevel::WARN)) return;
     va_list args;
     va_start(args, fmt);
     log_impl(LogLevel::WARN, file, line, func, fmt, args);
@@ -127,43 +269,330 @@ void Logger::warn(const char* file, int line, const char* func, const char* fmt,
 }
 
 void Logger::error(const char* file, int line, const char* func, const char* fmt, ...) {
-    if (level_ > LogLevel::ERROR) return;
+    if (!enabled(LogLevel::ERROR)) return;
     va_list args;
     va_start(args, fmt);
     log_impl(LogLevel::ERROR, file, line, func, fmt, args);
     va_end(args);
 }
 
-Logger::Logger() : level_(LogLevel::INFO) {}
+Logger::Logger()
+    : level_(static_cast<int>(LogLevel::INFO))
+    , dropped_(0)
+    , state_(new AsyncState()) {}
 
-void Logger::log_impl(LogLevel level, const char* file, int line, const char* func, const char* fmt, va_list args) {
-    time_t now = time(NULL);
-    struct tm* t = localtime(&now);
-    char timestamp[32];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", t);
-    
-    const char* color = get_color_code(level);
-    const char* level_str = get_level_str(level);
-    const char* func_color = get_function_color();
-    const char* location_color = get_location_color();
-    auto [class_name, func_name] = extract_class_and_function(func);
-
-    if(level_ == LogLevel::DEBUG) {
-        if (!class_name.empty()) {
-            fprintf(stderr, "[%s] %s[%s]\033[0m %s(%s::%s)\033[0m at %s%s:%d\033[0m ", 
-                    timestamp, color, level_str, func_color, class_name.c_str(), func_name.c_str(), 
-                    location_color, file, line);
+// state_ is deliberately leaked: static destructors may still log
+Logger::~Logger() {
+    shutdown();
+}
+
+bool Logger::configure(const LoggerOptions& options) {
+    shutdown();
+
+    bool file_ok = true;
+    {
+        std::lock_guard<std::mutex> lock(state_->output_mutex);
+        if (state_->file) {
+            fclose(state_->file);
+            state_->file = nullptr;
+        }
+        state_->options = options;
+        if (state_->options.ring_entries < 16) state_->options.ring_entries = 16;
+        if (!options.file.empty()) {
+            state_->file = fopen(options.file.c_str(), options.file_format == LogFormat::BINARY ? "ab" : "a");
+            file_ok = state_->file != nullptr;
+        }
+        if (!state_->file) state_->options.to_stderr = true;  // Never go silent
+    }
+    if (!file_ok) {
+        LOG_ERROR("[Logger] Cannot open log file %s, logging to stderr only", options.file.c_str());
+    }
+
+    if (options.async) {
+        {
+            std::lock_guard<std::mutex> lock(state_->rings_mutex);
+            state_->rings.clear();
+            state_->generation.fetch_add(1);
+        }
+        state_->stop.store(false);
+        state_->writer = std::thread(&Logger::writer_loop, this);
+        state_->async.store(true, std::memory_order_release);
+    }
+    return file_ok;
+}
+
+void Logger::shutdown() {
+    if (!state_->async.exchange(false)) return;
+    state_->stop.store(true);
+    state_->wake_cv.notify_one();
+    if (state_->writer.joinable()) {
+        state_->writer.join();
+    }
+    drain_rings();  // Anything enqueued while stopping
+    flush();
+}
+
+void Logger::flush() {
+    if (state_->async.load()) {
+        // Let the writer catch up with everything queued so far
+        for (int i = 0; i < 200 && has_pending(); ++i) {
+            state_->wake_cv.notify_one();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    std::lock_guard<std::mutex> lock(state_->output_mutex);
+    if (state_->options.to_stderr) fflush(stderr);
+    if (state_->file) fflush(state_->file);
+}
+
+bool Logger::has_pending() {
+    std::lock_guard<std::mutex> lock(state_->rings_mutex);
+    for (size_t i = 0; i < state_->rings.size(); ++i) {
+        if (state_->rings[i]->head.load(std::memory_order_acquire) !=
+            state_->rings[i]->tail.load(std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Logger::enqueue(LogLevel level, const char* file, int line, const char* func,
+                     const char* fmt, va_list args) {
+    if (!state_->async.load(std::memory_order_acquire)) return false;
+
+    uint64_t generation = state_->generation.load(std::memory_order_acquire);
+    if (!tls_ring || tls_ring_generation != generation) {
+        std::shared_ptr<Ring> ring = std::make_shared<Ring>(state_->options.ring_entries);
+        {
+            std::lock_guard<std::mutex> lock(state_->rings_mutex);
+            state_->rings.push_back(ring);
+        }
+        tls_ring = ring;
+        tls_ring_generation = generation;
+    }
+    Ring* ring = static_cast<Ring*>(tls_ring.get());
+
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    while (head - ring->tail.load(std::memory_order_acquire) >= ring->slots.size()) {
+        if (!state_->options.block_when_full) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        state_->wake_cv.notify_one();
+        std::this_thread::yield();
+        if (!state_->async.load(std::memory_order_acquire)) return false;
+    }
+
+    Record& rec = ring->slots[head % ring->slots.size()];
+    rec.seq = state_->seq.fetch_add(1, std::memory_order_relaxed);
+    rec.ts_ms = now_ms();
+    rec.level = level;
+    rec.line = line;
+    rec.thread = current_thread_tag();
+    copy_truncated(rec.file, sizeof(rec.file), file);
+    copy_truncated(rec.func, sizeof(rec.func), func);
+    rec.overflow = nullptr;
+    format_message(rec.text, sizeof(rec.text), rec.overflow, fmt, args);
+
+    ring->head.store(head + 1, std::memory_order_release);
+    if (state_->writer_idle.load(std::memory_order_relaxed)) {
+        state_->wake_cv.notify_one();
+    }
+    return true;
+}
+
+void Logger::writer_loop() {
+    while (!state_->stop.load()) {
+        if (drain_rings() > 0) continue;
+
+        state_->writer_idle.store(true);
+        std::unique_lock<std::mutex> lock(state_->wake_mutex);
+        // Timed wait bounds the cost of a missed notify
+        state_->wake_cv.wait_for(lock, std::chrono::milliseconds(50));
+        state_->writer_idle.store(false);
+    }
+    drain_rings();
+}
+
+size_t Logger::drain_rings() {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(state_->rings_mutex);
+        rings = state_->rings;
+    }
+
+    // Snapshot every ring, then write in global sequence order
+    std::vector<size_t> heads(rings.size());
+    std::vector<const Record*> batch;
+    for (size_t r = 0; r < rings.size(); ++r) {
+        Ring& ring = *rings[r];
+        size_t tail = ring.tail.load(std::memory_order_relaxed);
+        heads[r] = ring.head.load(std::memory_order_acquire);
+        for (size_t i = tail; i != heads[r]; ++i) {
+            batch.push_back(&ring.slots[i % ring.slots.size()]);
+        }
+    }
+
+    if (!batch.empty()) {
+        std::sort(batch.begin(), batch.end(), [](const Record* a, const Record* b) {
+            return a->seq < b->seq;
+        });
+        std::lock_guard<std::mutex> lock(state_->output_mutex);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            write_record(*batch[i]);
+            Record& rec = const_cast<Record&>(*batch[i]);
+            delete rec.overflow;
+            rec.overflow = nullptr;
+        }
+        if (state_->options.to_stderr) fflush(stderr);
+        if (state_->file) fflush(state_->file);
+    }
+
+    for (size_t r = 0; r < rings.size(); ++r) {
+        rings[r]->tail.store(heads[r], std::memory_order_release);
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != state_->reported_drops) {
+        Record note;
+        note.seq = state_->seq.fetch_add(1);
+        note.ts_ms = now_ms();
+        note.level = LogLevel::WARN;
+        snprintf(note.text, sizeof(note.text), "[Logger] Dropped %llu log records (ring full)",
+                 static_cast<unsigned long long>(dropped - state_->reported_drops));
+        state_->reported_drops = dropped;
+        std::lock_guard<std::mutex> lock(state_->output_mutex);
+        write_record(note);
+    }
+
+    // Forget rings whose thread has exited (we hold the only reference)
+    {
+        std::lock_guard<std::mutex> lock(state_->rings_mutex);
+        std::vector<std::shared_ptr<Ring>>& all = state_->rings;
+        for (size_t i = 0; i < all.size();) {
+            bool owned_here = false;
+            for (size_t r = 0; r < rings.size(); ++r) {
+                if (rings[r] == all[i]) { owned_here = true; break; }
+            }
+            // 2 = registry + our local copy
+            if (owned_here && all[i].use_count() <= 2 &&
+                all[i]->head.load() == all[i]->tail.load()) {
+                all.erase(all.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+    return batch.size();
+}
+
+void Logger::write_record(const Record& rec) {
+    AsyncState& st = *state_;
+
+    // Timestamp text is reformatted at most once per second
+    time_t sec = static_cast<time_t>(rec.ts_ms / 1000);
+    if (sec != st.cached_sec || !st.cached_ts[0]) {
+        struct tm t;
+        localtime_r(&sec, &t);
+        strftime(st.cached_ts, sizeof(st.cached_ts), "%Y-%m-%d %H:%M:%S", &t);
+        st.cached_sec = sec;
+    }
+
+    const char* level_str = get_level_str(rec.level);
+    bool detailed = level_.load(std::memory_order_relaxed) == static_cast<int>(LogLevel::DEBUG) && rec.func[0];
+    std::string class_name, func_name;
+    if (detailed) {
+        std::pair<std::string, std::string> cf = extract_class_and_function(rec.func);
+        class_name = cf.first;
+        func_name = cf.second;
+    }
+
+    if (st.options.to_stderr) {
+        const char* color = get_color_code(rec.level);
+        if (detailed && !class_name.empty()) {
+            fprintf(stderr, "[%s] %s[%s]\033[0m %s(%s::%s)\033[0m at %s%s:%d\033[0m %s\n",
+                    st.cached_ts, color, level_str, get_function_color(), class_name.c_str(),
+                    func_name.c_str(), get_location_color(), rec.file, rec.line, rec.message());
+        } else if (detailed) {
+            fprintf(stderr, "[%s] %s[%s]\033[0m %s(%s)\033[0m at %s%s:%d\033[0m %s\n",
+                    st.cached_ts, color, level_str, get_function_color(), func_name.c_str(),
+                    get_location_color(), rec.file, rec.line, rec.message());
         } else {
-            fprintf(stderr, "[%s] %s[%s]\033[0m %s(%s)\033[0m at %s%s:%d\033[0m ", 
-                    timestamp, color, level_str, func_color, func_name.c_str(), 
-                    location_color, file, line);
+            fprintf(stderr, "[%s] %s[%s]\033[0m %s\n", st.cached_ts, color, level_str, rec.message());
         }
-    } else {
-        fprintf(stderr, "[%s] %s[%s]\033[0m ", timestamp, color, level_str);
     }
-    vfprintf(stderr, fmt, args);
-    fprintf(stderr, "\n");
-    fflush(stderr);
+
+    if (!st.file) return;
+
+    std::string& out = st.line;
+    out.clear();
+    switch (st.options.file_format) {
+        case LogFormat::JSON: {
+            char head[96];
+            snprintf(head, sizeof(head), "{\"ts\":%lld,\"time\":\"%s\",\"level\":\"%s\",\"thread\":%u,",
+                     static_cast<long long>(rec.ts_ms), st.cached_ts, level_str, rec.thread);
+            out += head;
+            out += "\"file\":";
+            append_json_string(out, rec.file);
+            out += ",\"line\":" + std::to_string(rec.line) + ",\"func\":";
+            append_json_string(out, rec.func);
+            out += ",\"msg\":";
+            append_json_string(out, rec.message());
+            out += "}\n";
+            break;
+        }
+        case LogFormat::BINARY: {
+            std::string body;
+            append_le(body, static_cast<uint64_t>(rec.ts_ms), 8);
+            append_le(body, static_cast<uint64_t>(rec.level), 1);
+            append_le(body, rec.thread, 4);
+            append_le(body, static_cast<uint32_t>(rec.line), 4);
+            body.append(rec.file, strlen(rec.file) + 1);
+            body.append(rec.func, strlen(rec.func) + 1);
+            const char* msg = rec.message();
+            body.append(msg, strlen(msg) + 1);
+            append_le(out, body.size(), 4);
+            out += body;
+            break;
+        }
+        default:
+            out += '[';
+            out += st.cached_ts;
+            out += "] [";
+            out += level_str;
+            out += "] ";
+            if (detailed) {
+                out += '(';
+                if (!class_name.empty()) out += class_name + "::";
+                out += func_name + ") at " + rec.file + ":" + std::to_string(rec.line) + " ";
+            }
+            out += rec.message();
+            out += '\n';
+            break;
+    }
+    fwrite(out.data(), 1, out.size(), st.file);
+}
+
+void Logger::log_impl(LogLevel level, const char* file, int line, const char* func, const char* fmt, va_list args) {
+    if (enqueue(level, file, line, func, fmt, args)) return;
+
+    // Synchronous path: format outside the lock, write the whole line at once
+    Record rec;
+    rec.ts_ms = now_ms();
+    rec.level = level;
+    rec.line = line;
+    rec.thread = current_thread_tag();
+    copy_truncated(rec.file, sizeof(rec.file), file);
+    copy_truncated(rec.func, sizeof(rec.func), func);
+    format_message(rec.text, sizeof(rec.text), rec.overflow, fmt, args);
+
+    {
+        std::lock_guard<std::mutex> lock(state_->output_mutex);
+        write_record(rec);
+        if (state_->options.to_stderr) fflush(stderr);
+        if (state_->file) fflush(state_->file);
+    }
+    delete rec.overflow;
 }
 
 } // namespace opencrank
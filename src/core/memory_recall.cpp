@@ -0,0 +1,234 @@
+/*
+ * OpenCrank C++ - Proactive Memory Recall Implementation
+ */
+#include <opencrank/core/memory_recall.hpp>
+#include <opencrank/core/memory_tool.hpp>
+#include <opencrank/core/registry.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <cctype>
+
+namespace opencrank {
+
+namespace {
+
+const size_t MAX_QUERY_WORDS = 12;
+const char* RECALL_HEADER =
+    "\n\n## Recalled memories\n"
+    "Saved notes that may be relevant to this conversation (memory_search finds more):\n";
+
+const char* const STOP_WORDS[] = {
+    "the", "and", "for", "are", "but", "not", "you", "your", "all", "any", "can", "had", "has",
+    "have", "her", "his", "how", "its", "our", "out", "she", "was", "were", "who", "why", "what",
+    "when", "where", "which", "will", "with", "would", "could", "should", "this", "that", "these",
+    "those", "there", "their", "them", "they", "then", "than", "from", "into", "about", "just",
+    "also", "some", "been", "being", "does", "did", "doing", "please", "thanks", "thank", "hello",
+    "hey", "okay", "yes", "let", "get", "got", "make", "want", "need", "tell", "know", "like"
+};
+
+MemoryManager* memory_manager() {
+    MemoryTool* memtool = dynamic_cast<MemoryTool*>(PluginRegistry::instance().get_tool("memory"));
+    return memtool && memtool->manager().is_initialized() ? &memtool->manager() : NULL;
+}
+
+std::string format_hits(const std::vector<MemorySearchHit>& hits, size_t max_chars) {
+    if (hits.empty()) return std::string();
+    std::string block = RECALL_HEADER;
+    size_t budget = max_chars > block.size() ? max_chars - block.size() : 0;
+    size_t used = 0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const MemoryEntry& entry = hits[i].entry;
+        std::string line = "- ";
+        if (!entry.category.empty() && entry.category != "general") {
+            line += "(" + entry.category + ") ";
+        }
+        std::string content = trim(entry.content);
+        for (size_t c = 0; c < content.size(); ++c) {
+            if (content[c] == '\n') content[c] = ' ';
+        }
+        if (used + line.size() + 24 > budget) break;
+        size_t room = budget - used - line.size() - 1;
+        line += content.size() > room ? truncate_safe(content, room - 3) + "..." : content;
+        line += "\n";
+        block += line;
+        used += line.size();
+    }
+    return block;
+}
+
+} // namespace
+
+// A lookup in flight: the run that waits for it may give up first
+struct MemoryRecall::Lookup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done;
+    std::string block;
+
+    Lookup() : done(false) {}
+};
+
+MemoryRecall& MemoryRecall::instance() {
+    static MemoryRecall recall;
+    return recall;
+}
+
+MemoryRecall::MemoryRecall()
+    : pool_(NULL)
+    , enabled_(false)
+    , max_results_(3)
+    , max_chars_(1200)
+    , wait_ms_(1500)
+    , ttl_ms_(900000) {
+    Metrics& metrics = Metrics::instance();
+    const char* help = "Proactive memory lookups for incoming messages";
+    cached_ = &metrics.counter("opencrank_memory_recall_total", help, metric_labels("result", "cached"));
+    searched_ = &metrics.counter("opencrank_memory_recall_total", help, metric_labels("result", "searched"));
+    late_ = &metrics.counter("opencrank_memory_recall_total", help, metric_labels("result", "late"));
+}
+
+void MemoryRecall::configure(const Config& cfg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = cfg.get_bool("memory.recall.enabled", true);
+    max_results_ = static_cast<int>(std::max<int64_t>(1, cfg.get_int("memory.recall.max_results", 3)));
+    max_chars_ = static_cast<size_t>(std::max<int64_t>(50, cfg.get_int("memory.recall.max_tokens", 300))) * 4;
+    wait_ms_ = static_cast<int>(std::max<int64_t>(0, cfg.get_int("memory.recall.wait_ms", 1500)));
+    ttl_ms_ = cfg.get_int("memory.recall.ttl_s", 900) * 1000;
+    sessions_.clear();
+    if (enabled_) {
+        LOG_DEBUG("[Recall] Up to %d memories (~%zu tokens) per message, waiting %d ms, reused for %llds",
+                  max_results_, max_chars_ / 4, wait_ms_, static_cast<long long>(ttl_ms_ / 1000));
+    }
+}
+
+void MemoryRecall::set_thread_pool(ThreadPool* pool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pool_ = pool;
+}
+
+bool MemoryRecall::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return enabled_;
+}
+
+MemoryRecall::Result MemoryRecall::start(const std::string& session_key, const std::string& user_key,
+                                         const std::string& text) {
+    MemoryManager* manager = enabled() ? memory_manager() : NULL;
+    if (!manager) return Result();
+    uint64_t revision = manager->revision();
+
+    ThreadPool* pool = NULL;
+    int max_results = 0;
+    size_t max_chars = 0;
+    int wait_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, Cached>::iterator it = sessions_.find(session_key);
+        if (it != sessions_.end() && it->second.revision == revision &&
+            current_timestamp_ms() - it->second.stored_ms < ttl_ms_) {
+            cached_->inc();
+            std::string block = it->second.block;
+            return [block]() { return block; };
+        }
+        pool = pool_;
+        max_results = max_results_;
+        max_chars = max_chars_;
+        wait_ms = wait_ms_;
+    }
+
+    std::string query = query_for(text);
+    if (query.empty()) return Result();
+
+    std::shared_ptr<Lookup> lookup = std::make_shared<Lookup>();
+    std::function<void()> search = [this, lookup, manager, query, session_key, user_key, revision,
+                                    max_results, max_chars]() {
+        int64_t started = current_timestamp_ms();
+        MemoryManager::ShardScope shard(user_key);
+        std::vector<MemorySearchHit> hits = manager->search(query, max_results);
+        std::string block = format_hits(hits, max_chars);
+        LOG_DEBUG("[Recall] %zu memories for '%s' in %lld ms", hits.size(), query.c_str(),
+                  static_cast<long long>(current_timestamp_ms() - started));
+        searched_->inc();
+        remember(session_key, block, revision);
+        {
+            std::lock_guard<std::mutex> lock(lookup->mutex);
+            lookup->block = block;
+            lookup->done = true;
+        }
+        lookup->cv.notify_all();
+    };
+    if (pool) {
+        pool->enqueue(Task(search), TaskPriority::INTERACTIVE);
+    } else {
+        search();
+    }
+
+    Counter* late = late_;
+    return [lookup, wait_ms, late]() -> std::string {
+        std::unique_lock<std::mutex> lock(lookup->mutex);
+        if (!lookup->cv.wait_for(lock, std::chrono::milliseconds(wait_ms), [&lookup]() { return lookup->done; })) {
+            LOG_DEBUG("[Recall] Memory lookup still running after %d ms, answering without it", wait_ms);
+            late->inc();
+            return std::string();
+        }
+        return lookup->block;
+    };
+}
+
+void MemoryRecall::forget(const std::string& session_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.erase(session_key);
+}
+
+void MemoryRecall::remember(const std::string& session_key, const std::string& block, uint64_t revision) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = current_timestamp_ms();
+    std::map<std::string, Cached>::iterator it = sessions_.begin();
+    while (it != sessions_.end()) {
+        if (now - it->second.stored_ms >= ttl_ms_) {
+            sessions_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    Cached& cached = sessions_[session_key];
+    cached.block = block;
+    cached.revision = revision;
+    cached.stored_ms = now;
+}
+
+std::string MemoryRecall::query_for(const std::string& text) {
+    static const std::set<std::string> stop_words(
+        STOP_WORDS, STOP_WORDS + sizeof(STOP_WORDS) / sizeof(STOP_WORDS[0]));
+
+    std::set<std::string> seen;
+    std::string query;
+    std::string word;
+    size_t words = 0;
+    for (size_t i = 0; i <= text.size() && words < MAX_QUERY_WORDS; ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (std::isalnum(c) || c >= 0x80) {
+            word += static_cast<char>(c);
+            continue;
+        }
+        if (word.size() >= 3) {
+            word = to_lower(word);
+            if (!stop_words.count(word) && seen.insert(word).second) {
+                if (!query.empty()) query += ' ';
+                query += word;
+                ++words;
+            }
+        }
+        word.clear();
+    }
+    return query;
+}
+
+} // namespace opencrank
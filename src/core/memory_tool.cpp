@@ -9,6 +9,8 @@
 #include <opencrank/core/config.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/sandbox.hpp>
+#include <opencrank/core/file_reader.hpp>
+#include <opencrank/core/agent.hpp>
 
 #include <fstream>
 #include <sstream>
@@ -27,6 +29,16 @@
 
 namespace opencrank {
 
+namespace {
+
+// Sender of the agent run calling the tool: picks its memory shard
+std::string caller_user_key() {
+    const ToolCallContext* ctx = ToolCallContext::current();
+    return ctx ? ctx->user_key : std::string();
+}
+
+} // namespace
+
 // ============================================================================
 // Constructor / Destructor
 // ============================================================================
@@ -117,6 +129,7 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "memory_save";
+        tool.writes_store = "memory";
         tool.description = 
             "Save important information to persistent memory database. "
             "NOTE: When instructed to write something in files like saving API keys, user preferences, or notes, you MUST use this tool to save it. "
@@ -154,6 +167,8 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "memory_search";
+        tool.parallel_safe = true;
+        tool.memo_store = "memory";
         tool.description = 
             "Search persistent memory using full-text search (BM25 ranking). "
             "NOTE: When instructed to find or read API keys, user preferences, or notes, you MUST use this tool to search it. "
@@ -186,6 +201,8 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "memory_get";
+        tool.parallel_safe = true;
+        tool.memo_store = "memory";
         tool.description = 
             "Get a specific memory by ID, or list recent memories. "
             "NOTE: When instructed to read/fetch something in files like API keys, user preferences, or notes, you MUST use this tool to fetch it. "
@@ -218,6 +235,8 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "memory_list";
+        tool.parallel_safe = true;
+        tool.memo_store = "memory";
         tool.description = 
             "List recent memories from the database. "
             "NOTE: When instructed to find files like API keys, user preferences, or notes, you MUST use this tool to find it. "
@@ -245,6 +264,8 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "file_save";
+        tool.writes_store = "files";
+        tool.path_param = "path";
         tool.description = 
             "Save content to a file in the workspace directory. "
             "Use for saving structured documents, source code, notes, or daily logs. DONT use this for saving small pieces of information like API keys or user preferences - use memory_save for that. "
@@ -282,6 +303,9 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "file_read";
+        tool.parallel_safe = true;
+        tool.memo_store = "files";
+        tool.path_param = "path";
         tool.description = 
             "Read a file from the workspace memory directory.";
             "Use for reading structured documents, source code, notes, or daily logs. DONT use this for reading small pieces of information like API keys or user preferences - use memory_get or memory_search for that. ";
@@ -290,6 +314,18 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
             "File path relative to workspace",
             true
         ));
+        tool.params.push_back(ToolParamSchema(
+            "start_line", "number", "First line to read (1-based, optional)", false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "end_line", "number", "Last line to read, inclusive (optional)", false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "offset", "number", "Byte offset to start reading at (optional)", false
+        ));
+        tool.params.push_back(ToolParamSchema(
+            "length", "number", "Number of bytes to read from offset (optional)", false
+        ));
         tool.execute = [self](const Json& params) -> AgentToolResult {
             ToolResult r = self->do_file_read(params);
             return r.success 
@@ -303,6 +339,7 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "task_create";
+        tool.writes_store = "tasks";
         tool.description = 
             "Create a new task or reminder in the database. "
             "Tasks persist across sessions and can have optional due dates or CRON schedules. "
@@ -340,6 +377,8 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "task_list";
+        tool.parallel_safe = true;
+        tool.memo_store = "tasks";
         tool.description = 
             "List tasks from the database. By default shows only active (incomplete) tasks.";
         tool.params.push_back(ToolParamSchema(
@@ -360,6 +399,7 @@ std::vector<AgentTool> MemoryTool::get_agent_tools() const {
     {
         AgentTool tool;
         tool.name = "task_complete";
+        tool.writes_store = "tasks";
         tool.description = 
             "Mark a task as completed by its ID.";
         tool.params.push_back(ToolParamSchema(
@@ -436,6 +476,7 @@ std::string MemoryTool::daily_file_path() const {
 // ============================================================================
 
 ToolResult MemoryTool::do_memory_save(const Json& params) {
+    MemoryManager::ShardScope shard(caller_user_key());
     if (!params.contains("content") || !params["content"].is_string()) {
         return ToolResult::fail("Missing required parameter: content");
     }
@@ -471,6 +512,7 @@ ToolResult MemoryTool::do_memory_save(const Json& params) {
 }
 
 ToolResult MemoryTool::do_memory_search(const Json& params) {
+    MemoryManager::ShardScope shard(caller_user_key());
     if (!params.contains("query") || !params["query"].is_string()) {
         return ToolResult::fail("Missing required parameter: query");
     }
@@ -530,6 +572,7 @@ ToolResult MemoryTool::do_memory_search(const Json& params) {
 }
 
 ToolResult MemoryTool::do_memory_get(const Json& params) {
+    MemoryManager::ShardScope shard(caller_user_key());
     // If ID is provided, get specific memory
     if (params.contains("id") && params["id"].is_string()) {
         std::string id = params["id"].get<std::string>();
@@ -722,23 +765,14 @@ ToolResult MemoryTool::do_file_read(const Json& params) {
         return ToolResult::fail("Path not allowed by sandbox: " + path);
     }
     
-    std::ifstream file(full_path.c_str());
-    if (!file.is_open()) {
-        return ToolResult::fail("Cannot open file: " + path);
-    }
-    
-    std::ostringstream content;
-    content << file.rdbuf();
-    file.close();
-    
-    std::string result = content.str();
-    
-    // Truncate very large files
+    // Truncate very large files; ranges read only what they ask for
     constexpr size_t MAX_SIZE = 50000;
-    if (result.size() > MAX_SIZE) {
-        result.resize(MAX_SIZE);
-        result += "\n\n... [truncated, file too large] ...";
+    FileSlice slice;
+    std::string error;
+    if (!read_file_slice(full_path, params, MAX_SIZE, slice, error)) {
+        return ToolResult::fail(error + ": " + path);
     }
+    std::string result = format_slice(slice);
     
     Json data;
     data["output"] = result;
@@ -7,13 +7,116 @@
 #include <opencrank/core/application.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/channel.hpp>
+#include <opencrank/core/outbound.hpp>
+#include <opencrank/core/cluster.hpp>
+#include <opencrank/core/memory_recall.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/metrics.hpp>
 #include <opencrank/ai/ai.hpp>
 
 #include <sstream>
+#include <memory>
 #include <ctime>
+#include <cstdlib>
 
 namespace opencrank {
 
+// ============================================================================
+// Helpers
+// ============================================================================
+
+namespace {
+
+// Accumulate provider prefix-cache counters on the session (shown by /status)
+void record_prompt_cache_usage(Session& session, const AgentResult& result) {
+    if (result.prompt_tokens <= 0) return;
+    
+    long long prompt = std::atoll(session.get_data("prompt_tokens", "0").c_str());
+    long long cached = std::atoll(session.get_data("prompt_cached_tokens", "0").c_str());
+    prompt += result.prompt_tokens;
+    cached += result.cached_prompt_tokens;
+    session.set_data("prompt_tokens", std::to_string(prompt));
+    session.set_data("prompt_cached_tokens", std::to_string(cached));
+    
+    LOG_DEBUG("Prompt cache for %s: %d/%d tokens reused this turn (%.1f%% session-wide)",
+              session.key().c_str(), result.cached_prompt_tokens, result.prompt_tokens,
+              prompt > 0 ? 100.0 * static_cast<double>(cached) / static_cast<double>(prompt) : 0.0);
+}
+
+// Session bookkeeping for a finished agent run; returns the reply text
+std::string finish_agent_turn(Session& session, const AgentResult& agent_result) {
+    record_prompt_cache_usage(session, agent_result);
+    
+    LOG_DEBUG("=== ◀ OUT Agent loop complete ===");
+    LOG_DEBUG("◀ OUT Success: %s, Paused: %s", 
+              agent_result.success ? "yes" : "no",
+              agent_result.paused ? "yes" : "no");
+    LOG_DEBUG("◀ OUT Iterations: %d, Tool calls: %d", 
+              agent_result.iterations, agent_result.tool_calls_made);
+    LOG_DEBUG("◀ OUT Response (%zu chars): %.200s%s", 
+              agent_result.final_response.size(),
+              agent_result.final_response.c_str(),
+              agent_result.final_response.size() > 200 ? "..." : "");
+    
+    std::string response;
+    if (agent_result.cancelled) {
+        // A stopped run is not resumable with /continue
+        session.remove_data("agent_paused");
+        session.remove_data("agent_iterations");
+        session.remove_data("agent_tool_calls");
+        
+        response = "🛑 Stopped.";
+        LOG_INFO(" Agent stopped after %d iterations (%d tool calls)",
+                 agent_result.iterations, agent_result.tool_calls_made);
+    } else if (agent_result.paused) {
+        // Store paused state in session for /continue command
+        // This handles both max_iterations and max_consecutive_errors pauses
+        session.set_data("agent_paused", "true");
+        session.set_data("agent_iterations", std::to_string(agent_result.iterations));
+        session.set_data("agent_tool_calls", std::to_string(agent_result.tool_calls_made));
+        
+        response = agent_result.pause_message;
+        LOG_INFO(" Agent paused after %d iterations (%d tool calls), awaiting /continue", 
+                 agent_result.iterations, agent_result.tool_calls_made);
+    } else if (agent_result.success) {
+        // Clear any paused state
+        session.remove_data("agent_paused");
+        session.remove_data("agent_iterations");
+        session.remove_data("agent_tool_calls");
+        
+        response = agent_result.final_response;
+        
+        // Log tools used
+        if (!agent_result.tools_used.empty()) {
+            std::ostringstream tools_str;
+            for (size_t i = 0; i < agent_result.tools_used.size(); ++i) {
+                if (i > 0) tools_str << ", ";
+                tools_str << agent_result.tools_used[i];
+            }
+            LOG_INFO(" Tools used: %s", tools_str.str().c_str());
+        }
+    } else {
+        // Clear paused state on error
+        session.remove_data("agent_paused");
+        session.remove_data("agent_iterations");
+        session.remove_data("agent_tool_calls");
+        
+        response = "❌ Agent error: " + agent_result.error;
+    }
+    return response;
+}
+
+// A chat turn waiting for the agent: the session stays pinned, the draft
+// alive and the AI provider loaded until the reply is out
+struct AiTurn {
+    PluginRegistry::Pin plugins;
+    MessagePtr msg;
+    std::unique_ptr<detail::SessionRelease> release;
+    std::unique_ptr<detail::StreamingReply> stream;
+};
+
+} // anonymous namespace
+
 // ============================================================================
 // Plugin Notification
 // ============================================================================
@@ -39,6 +142,7 @@ void notify_outgoing_message(
     out_msg.reply_to_id = reply_to;
     
     // Notify all plugins
+    PluginRegistry::Pin pin;
     for (auto* plugin : app.registry().plugins()) {
         if (plugin && plugin->is_initialized()) {
             plugin->on_incoming_message(out_msg);
@@ -104,6 +208,38 @@ void broadcast_notification(
              level.c_str(), message.c_str());
 }
 
+Json message_to_json(const Message& msg) {
+    Json j = Json::object();
+    j["id"] = msg.id;
+    j["channel"] = msg.channel;
+    j["account_id"] = msg.account_id;
+    j["from"] = msg.from;
+    j["from_name"] = msg.from_name;
+    j["to"] = msg.to;
+    j["text"] = msg.text;
+    j["chat_type"] = msg.chat_type;
+    j["timestamp"] = msg.timestamp;
+    j["reply_to_id"] = msg.reply_to_id;
+    j["media_url"] = msg.media_url;
+    return j;
+}
+
+Message message_from_json(const Json& json) {
+    Message msg;
+    msg.id = json_utils::get_string(json, "id");
+    msg.channel = json_utils::get_string(json, "channel");
+    msg.account_id = json_utils::get_string(json, "account_id");
+    msg.from = json_utils::get_string(json, "from");
+    msg.from_name = json_utils::get_string(json, "from_name");
+    msg.to = json_utils::get_string(json, "to");
+    msg.text = json_utils::get_string(json, "text");
+    msg.chat_type = json_utils::get_string(json, "chat_type");
+    msg.timestamp = json_utils::get_int(json, "timestamp", 0);
+    msg.reply_to_id = json_utils::get_string(json, "reply_to_id");
+    msg.media_url = json_utils::get_string(json, "media_url");
+    return msg;
+}
+
 // ============================================================================
 // Error Callback
 // ============================================================================
@@ -116,11 +252,15 @@ void on_error(const std::string& channel, const std::string& error) {
 // Message Callback (Entry Point)
 // ============================================================================
 
-void on_message(const Message& msg) {
+namespace {
+
+// on_owned_message() for a message whose session key is known
+void accept_message(const Message& msg, const std::string& session_key) {
     auto& app = Application::instance();
     
-    // Deduplicate
-    if (!app.debouncer().should_process(msg.id)) {
+    // Deduplicate. Ids are only unique within a chat (and per bot, for
+    // channels serving several accounts), so the chat address is part of it
+    if (!app.debouncer().should_process(msg.channel + ":" + msg.to + ":" + msg.id)) {
         LOG_DEBUG("Skipping duplicate message: %s", msg.id.c_str());
         return;
     }
@@ -130,26 +270,52 @@ void on_message(const Message& msg) {
              msg.text.size() > 200 ? "..." : "");
     
     // Notify all plugins
+    PluginRegistry::Pin pin;
     for (auto* plugin : app.registry().plugins()) {
         if (plugin && plugin->is_initialized()) {
             plugin->on_incoming_message(msg);
         }
     }
     
+    // /stop cannot queue behind the run it stops: cancel here, the run
+    // replies as it unwinds. With nothing running the command answers.
+    if (detail::is_stop_command(msg) &&
+        app.cancel_session(msg.channel + ":" + msg.to)) {
+        return;
+    }
+    
     // Rate limit check
     auto rate_result = app.user_limiter().check(msg.from);
     if (!rate_result.allowed) {
+        static Counter& denied = Metrics::instance().counter(
+            "opencrank_rate_limited_total", "Messages dropped by the per-user rate limit");
+        denied.inc();
         LOG_WARN("Rate limit exceeded for user %s, retry in %lldms", 
                  msg.from.c_str(), static_cast<long long>(rate_result.retry_after_ms));
         return;
     }
     
-    // Process in thread pool (non-blocking)
-    // Copy msg for the lambda capture
-    Message msg_copy = msg;
-    app.thread_pool()->enqueue([msg_copy]() {
-        process_message(msg_copy);
-    });
+    // Process in thread pool (non-blocking), one turn at a time per session.
+    // Quick commands get the interactive lane once their session is free.
+    // The message's one copy: queue, handler and reply share it from here
+    TaskPriority priority = detail::classify_message(msg);
+    app.session_executor().submit(session_key, std::make_shared<const Message>(msg), priority);
+}
+
+} // anonymous namespace
+
+void on_message(const Message& msg) {
+    // In a cluster, sessions owned by another node are handled there
+    auto& app = Application::instance();
+    const std::string& session_key = app.sessions().session_key_for_message(msg);
+    if (Cluster::instance().route(session_key, msg)) {
+        return;
+    }
+    accept_message(msg, session_key);
+}
+
+void on_owned_message(const Message& msg) {
+    accept_message(msg, Application::instance().sessions().session_key_for_message(msg));
 }
 
 // ============================================================================
@@ -158,6 +324,91 @@ void on_message(const Message& msg) {
 
 namespace detail {
 
+SessionRelease::~SessionRelease() {
+    Application::instance().sessions().release(session_);
+}
+
+namespace {
+
+// Command name up to first space, without @botname suffix
+std::string command_name(const Message& msg) {
+    std::string command = msg.text.substr(0, msg.text.find(' '));
+    auto at_pos = command.find('@');
+    if (at_pos != std::string::npos) {
+        command.erase(at_pos);
+    }
+    return command;
+}
+
+} // anonymous namespace
+
+bool is_stop_command(const Message& msg) {
+    if (msg.text.empty() || msg.text[0] != '/') {
+        return false;
+    }
+    CommandTable::Match match = Application::instance().command_table()->resolve(command_name(msg));
+    return match.kind == CommandTable::REGISTRY && match.command->command == "/stop";
+}
+
+TaskPriority classify_message(const Message& msg) {
+    if (msg.text.empty() || msg.text[0] != '/') {
+        return TaskPriority::AGENT;
+    }
+    
+    std::string command = command_name(msg);
+    
+    // /continue resumes the agentic loop; skill commands also run the agent
+    CommandTable::Match match = Application::instance().command_table()->resolve(command);
+    if (match.kind == CommandTable::REGISTRY && match.command->command == "/continue") {
+        return TaskPriority::AGENT;
+    }
+    if (match.kind == CommandTable::REGISTRY || match.kind == CommandTable::LIST_SKILLS) {
+        return TaskPriority::INTERACTIVE;
+    }
+    return TaskPriority::AGENT;
+}
+
+StreamingReply::StreamingReply(ChannelPlugin* channel, const Message& msg, int min_interval_ms)
+    : channel_(channel)
+    , to_(msg.to)
+    , reply_to_(msg.id)
+    , last_edit_ms_(0)
+    , min_interval_ms_(min_interval_ms)
+    , failed_(false) {}
+
+void StreamingReply::update(const std::string& text) {
+    if (!channel_ || failed_ || text.empty() || text == last_text_) {
+        return;
+    }
+    
+    int64_t now = current_timestamp_ms();
+    if (active() && now - last_edit_ms_ < min_interval_ms_) {
+        return;
+    }
+    
+    // Drafts stay within a single message; the tail arrives with the final reply
+    std::string draft = text.size() > 3500 ? text.substr(0, 3500) : text;
+    draft += " \xe2\x80\xa6";  // …
+    
+    SendResult result = active()
+        ? channel_->edit_message(to_, message_id_, draft)
+        : channel_->send_message(to_, draft, reply_to_);
+    
+    if (!result.success) {
+        // Give up on live updates for this reply; the final send still happens
+        LOG_DEBUG("[%s] Streaming update failed, disabling for this reply: %s",
+                  channel_->channel_id(), result.error.c_str());
+        failed_ = true;
+        return;
+    }
+    
+    if (!active()) {
+        message_id_ = result.message_id;
+    }
+    last_text_ = text;
+    last_edit_ms_ = now;
+}
+
 std::string handle_command(
     const Message& msg,
     Session& session,
@@ -165,56 +416,48 @@ std::string handle_command(
 {
     auto& app = Application::instance();
     
-    // Check if this is a skill command
-    std::string response;
-    if (handle_skill_command(msg, session, cmd_text, response)) {
-        return response;
-    }
-    
-    // Parse command and arguments
-    std::string command, args;
-    auto space_pos = cmd_text.find(' ');
-    if (space_pos != std::string::npos) {
-        command = cmd_text.substr(0, space_pos);
-        args = cmd_text.substr(space_pos + 1);
-    } else {
-        command = cmd_text;
-    }
+    // One lookup for registry, built-in and skill commands; the table keeps
+    // the skill catalog alive even if skills reload meanwhile
+    CommandTablePtr table = app.command_table();
+    CommandTable::Match match = table->resolve(cmd_text);
     
-    // Handle /skills command
-    if (command == "/skills") {
-        std::ostringstream oss;
-        oss << "**Available Skills:**\n\n";
-        oss << app.skills().list_skills_for_display(app.skill_entries(), true);
-        oss << "\n💡 Use `/skillname <args>` or `/skill skillname <args>` to invoke a skill";
-        return oss.str();
+    std::string response;
+    switch (match.kind) {
+        case CommandTable::SKILL:
+            handle_skill_command(msg, session, match, response);
+            return response;
+        
+        case CommandTable::LIST_SKILLS: {
+            std::ostringstream oss;
+            oss << "**Available Skills:**\n\n";
+            oss << app.skills().list_skills_for_display(app.skill_catalog()->entries, true);
+            oss << "\n💡 Use `/skillname <args>` or `/skill skillname <args>` to invoke a skill";
+            return oss.str();
+        }
+        
+        case CommandTable::REGISTRY:
+            return match.command->handler(msg, session, match.args);
+        
+        default:
+            return "";
     }
-    
-    // Route to registered command handler
-    return app.registry().execute_command(command, msg, session, args);
 }
 
 bool handle_skill_command(
     const Message& msg,
     Session& session,
-    const std::string& cmd_text,
+    const CommandTable::Match& match,
     std::string& response_out)
 {
     auto& app = Application::instance();
     
-    // Check if this is a skill command
-    auto skill_cmd = app.skills().resolve_skill_command_invocation(cmd_text, app.skill_commands());
-    
-    LOG_DEBUG("Skill command resolution result: %s", 
-              skill_cmd.first ? "MATCHED" : "NO MATCH");
-    
-    if (!skill_cmd.first) {
+    if (match.kind != CommandTable::SKILL) {
         return false;
     }
     
     // This is a skill command!
-    const auto* spec = skill_cmd.first;
-    const auto& skill_args = skill_cmd.second;
+    const auto* spec = match.skill;
+    const auto& skill_args = match.args;
     
     LOG_INFO(" ▶ IN  Skill command invoked: %s (args: %s)", spec->skill_name.c_str(), skill_args.c_str());
     
@@ -228,8 +471,8 @@ bool handle_skill_command(
     // AI-mediated dispatch via agentic loop
     LOG_DEBUG("AI-mediated skill dispatch via agentic loop: %s", spec->skill_name.c_str());
     
-    // Find the skill entry
-    const auto* entry = app.skills().find_skill_by_name(spec->skill_name, app.skill_entries());
+    // Skill entry, resolved when the table was built
+    const auto* entry = match.entry;
     LOG_DEBUG("Skill entry lookup: %s", entry ? "FOUND" : "NOT FOUND");
     
     if (!entry) {
@@ -238,11 +481,19 @@ bool handle_skill_command(
         return true;
     }
     
-    // Rewrite prompt
+    // Rewrite prompt; the body is only read now that the skill is invoked,
+    // which also saves the model a read tool round trip
+    std::string body = app.skills().load_skill_body(*entry);
     std::string rewritten = "Use the '" + spec->skill_name + "' skill. ";
-    rewritten += "First, read its instructions using the read tool: ";
-    rewritten += entry->skill.file_path + ". ";
-    rewritten += "Then follow those instructions to complete this task: ";
+    if (!body.empty()) {
+        rewritten += "Its instructions (from " + entry->skill.file_path + ") are:\n\n";
+        rewritten += body;
+        rewritten += "\n\nFollow those instructions to complete this task: ";
+    } else {
+        rewritten += "First, read its instructions using the read tool: ";
+        rewritten += entry->skill.file_path + ". ";
+        rewritten += "Then follow those instructions to complete this task: ";
+    }
     rewritten += skill_args;
     
     LOG_DEBUG("Rewritten prompt: %s", rewritten.c_str());
@@ -261,14 +512,21 @@ bool handle_skill_command(
     
     // Start AI monitoring session
     std::string monitor_session_id = msg.channel + ":" + msg.to;
-    app.ai_monitor().start_session(monitor_session_id, msg.channel, msg.to);
+    CancelTokenPtr cancel = app.ai_monitor().start_session(monitor_session_id, msg.channel, msg.to);
     
-    app.typing().start_typing(msg.to);
+    app.typing().start_typing(msg.channel, msg.to);
     
     LOG_INFO(" Starting agentic loop for skill: %s", spec->skill_name.c_str());
     
     // Use agent config from application (loaded from config file)
     AgentConfig agent_config = app.agent().config();
+    agent_config.session_key = session.key();
+    agent_config.user_key = msg.channel + ":" + msg.from;
+    agent_config.cancel_key = monitor_session_id;
+    agent_config.cancel = cancel;
+    agent_config.on_progress = [monitor_session_id]() {
+        Application::instance().ai_monitor().heartbeat(monitor_session_id);
+    };
     
     auto agent_result = app.agent().run(
         ai, 
@@ -278,12 +536,17 @@ bool handle_skill_command(
         agent_config
     );
     
+    record_prompt_cache_usage(session, agent_result);
+    
     LOG_DEBUG("Agent loop completed: success=%s, iterations=%d, tool_calls=%d",
               agent_result.success ? "yes" : "no", 
               agent_result.iterations, 
               agent_result.tool_calls_made);
     
-    if (agent_result.success) {
+    if (agent_result.cancelled) {
+        response_out = "🛑 Stopped.";
+        LOG_INFO(" ◀ OUT Skill stopped after %d tool calls", agent_result.tool_calls_made);
+    } else if (agent_result.success) {
         response_out = agent_result.final_response;
         LOG_INFO(" ◀ OUT Skill completed via %d tool calls (response: %zu chars)", 
                  agent_result.tool_calls_made, response_out.size());
@@ -292,29 +555,32 @@ bool handle_skill_command(
         LOG_ERROR(" ◀ OUT Skill execution failed: %s", agent_result.error.c_str());
     }
     
-    app.typing().stop_typing(msg.to);
+    app.typing().stop_typing(msg.channel, msg.to);
     app.ai_monitor().end_session(monitor_session_id);
     return true;
 }
 
-std::string handle_ai_message(
+void handle_ai_message(
     const Message& msg,
-    Session& session)
+    Session& session,
+    StreamingReply* stream,
+    const ReplyCallback& done)
 {
     auto& app = Application::instance();
     
     auto* ai = app.registry().get_default_ai();
     if (!ai || !ai->is_configured()) {
-        return "No AI provider configured. Set in config.json to enable AI features. "
-               "Type /help for available commands.";
+        done("No AI provider configured. Set in config.json to enable AI features. "
+             "Type /help for available commands.");
+        return;
     }
     
     // Start AI monitoring session
     std::string monitor_session_id = msg.channel + ":" + msg.to;
-    app.ai_monitor().start_session(monitor_session_id, msg.channel, msg.to);
+    CancelTokenPtr cancel = app.ai_monitor().start_session(monitor_session_id, msg.channel, msg.to);
     
     // Start typing indicator
-    app.typing().start_typing(msg.to);
+    app.typing().start_typing(msg.channel, msg.to);
     
     LOG_DEBUG("=== ▶ IN  User message entering agentic loop ===");
     LOG_DEBUG("▶ IN  User: %s", msg.from_name.c_str());
@@ -330,73 +596,48 @@ std::string handle_ai_message(
     // Run agentic loop with heartbeat callbacks
     // Use agent config from application (loaded from config file)
     AgentConfig agent_config = app.agent().config();
-    
-    auto agent_result = app.agent().run(
+    agent_config.session_key = session.key();
+    agent_config.user_key = msg.channel + ":" + msg.from;
+    agent_config.cancel_key = monitor_session_id;
+    agent_config.cancel = cancel;
+    agent_config.on_progress = [monitor_session_id]() {
+        Application::instance().ai_monitor().heartbeat(monitor_session_id);
+    };
+    if (stream) {
+        agent_config.on_partial = [stream](const std::string& text) {
+            stream->update(text);
+        };
+    }
+    // Memories about the message are looked up while the run assembles its prompt
+    agent_config.prompt_context = MemoryRecall::instance().start(session.key(), agent_config.user_key, msg.text);
+    
+    // Model calls may complete on another thread: done runs there
+    Session* turn_session = &session;
+    std::string channel_id = msg.channel;
+    std::string to = msg.to;
+    app.agent().run_async(
         ai, 
         msg.text, 
         session.history(), 
         app.system_prompt(),
-        agent_config
-    );
-    
-    LOG_DEBUG("=== ◀ OUT Agent loop complete ===");
-    LOG_DEBUG("◀ OUT Success: %s, Paused: %s", 
-              agent_result.success ? "yes" : "no",
-              agent_result.paused ? "yes" : "no");
-    LOG_DEBUG("◀ OUT Iterations: %d, Tool calls: %d", 
-              agent_result.iterations, agent_result.tool_calls_made);
-    LOG_DEBUG("◀ OUT Response (%zu chars): %.200s%s", 
-              agent_result.final_response.size(),
-              agent_result.final_response.c_str(),
-              agent_result.final_response.size() > 200 ? "..." : "");
-    
-    std::string response;
-    if (agent_result.paused) {
-        // Store paused state in session for /continue command
-        // This handles both max_iterations and max_consecutive_errors pauses
-        session.set_data("agent_paused", "true");
-        session.set_data("agent_iterations", std::to_string(agent_result.iterations));
-        session.set_data("agent_tool_calls", std::to_string(agent_result.tool_calls_made));
-        
-        response = agent_result.pause_message;
-        LOG_INFO(" Agent paused after %d iterations (%d tool calls), awaiting /continue", 
-                 agent_result.iterations, agent_result.tool_calls_made);
-    } else if (agent_result.success) {
-        // Clear any paused state
-        session.remove_data("agent_paused");
-        session.remove_data("agent_iterations");
-        session.remove_data("agent_tool_calls");
-        
-        response = agent_result.final_response;
-        
-        // Log tools used
-        if (!agent_result.tools_used.empty()) {
-            std::ostringstream tools_str;
-            for (size_t i = 0; i < agent_result.tools_used.size(); ++i) {
-                if (i > 0) tools_str << ", ";
-                tools_str << agent_result.tools_used[i];
-            }
-            LOG_INFO(" Tools used: %s", tools_str.str().c_str());
+        agent_config,
+        [turn_session, channel_id, to, monitor_session_id, done](AgentResult& agent_result) {
+            std::string response = finish_agent_turn(*turn_session, agent_result);
+            
+            // Stop typing and end monitoring session
+            Application& app = Application::instance();
+            app.typing().stop_typing(channel_id, to);
+            app.ai_monitor().end_session(monitor_session_id);
+            
+            done(response);
         }
-    } else {
-        // Clear paused state on error
-        session.remove_data("agent_paused");
-        session.remove_data("agent_iterations");
-        session.remove_data("agent_tool_calls");
-        
-        response = "❌ Agent error: " + agent_result.error;
-    }
-    
-    // Stop typing and end monitoring session
-    app.typing().stop_typing(msg.to);
-    app.ai_monitor().end_session(monitor_session_id);
-    
-    return response;
+    );
 }
 
 void send_response(
     const Message& original_msg,
-    const std::string& response)
+    const std::string& response,
+    StreamingReply* stream)
 {
     if (response.empty()) {
         return;
@@ -419,37 +660,44 @@ void send_response(
         if (!channel) continue;
         
         std::string channel_id = channel->channel_id();
+        std::string to = original_msg.to;
+        std::string reply_id = original_msg.id;
+        size_t total = chunks.size();
         
-        for (size_t i = 0; i < chunks.size(); ++i) {
-            const auto& chunk = chunks[i];
-            if (chunk.empty()) {
-                continue;
-            }
-
-            SendResult result;
-            if (i == 0) {
-                // Reply to original message on first chunk
-                result = channel->send_message(original_msg.to, chunk, original_msg.id);
-            } else {
-                result = channel->send_message(original_msg.to, chunk);
-            }
-
+        OutboundScheduler::Reply reply;
+        reply.to = to;
+        reply.chunks = chunks;
+        reply.reply_to = reply_id;
+        if (stream && stream->active() && stream->channel() == channel) {
+            // Replace the streamed draft with the final text
+            reply.edit_message_id = stream->message_id();
+        }
+        reply.on_chunk = [channel_id, to, chunks, reply_id, total](size_t i, const SendResult& result) {
             if (result.success) {
                 LOG_DEBUG("◀ OUT Sent to %s (msg_id=%s, chunk %zu/%zu)", 
-                          channel_id.c_str(), result.message_id.c_str(),
-                          i + 1, chunks.size());
-                notify_outgoing_message(channel_id, original_msg.to, chunk, original_msg.id);
+                          channel_id.c_str(), result.message_id.c_str(), i + 1, total);
+                notify_outgoing_message(channel_id, to, chunks[i], reply_id);
             } else {
                 LOG_ERROR("Failed to send response to %s: %s", channel_id.c_str(), result.error.c_str());
                 
                 // Check thread pool status
-                auto pending = app.thread_pool()->pending();
+                auto pending = Application::instance().thread_pool()->pending();
                 if (pending > 4) {
                     LOG_WARN("Thread pool has %zu pending tasks - system may be overloaded", pending);
                 }
-                break;
             }
-        }
+        };
+        reply.on_delivered = [](const OutboundScheduler::Delivery& delivery) {
+            if (delivery.delivered < delivery.chunks) {
+                LOG_WARN("[Outbound] Reply to %s:%s: %zu of %zu chunk(s) delivered (%s)",
+                         delivery.channel_id.c_str(), delivery.to.c_str(),
+                         delivery.delivered, delivery.chunks, delivery.error.c_str());
+            }
+        };
+        
+        // Queued per chat: order and rate limits are kept without holding
+        // this worker, and the draft id is copied so the stream may go away
+        OutboundScheduler::instance().send(channel, reply);
     }
 }
 
@@ -459,8 +707,10 @@ void send_response(
 // Main Message Processor
 // ============================================================================
 
-void process_message(const Message& msg) {
+void process_message(const MessagePtr& shared, const SessionExecutor::Done& done) {
     auto& app = Application::instance();
+    const Message& msg = *shared;
+    PluginRegistry::Pin pin;
     
     LOG_DEBUG("▶ IN  Processing message from %s: %.100s%s", 
               msg.from_name.c_str(), msg.text.c_str(),
@@ -468,40 +718,55 @@ void process_message(const Message& msg) {
     
     auto* channel = app.registry().get_channel(msg.channel);
     if (!channel || msg.text.empty()) {
+        done();
         return;
     }
     
-    // Get session
+    // Get session (pinned until the turn is over, then saved)
     auto& session = app.sessions().get_session_for_message(msg);
     
-    std::string response;
-    
     // Handle commands (start with /)
     if (msg.text[0] == '/') {
-        // Parse command text (handle @botname suffix)
-        std::string cmd_text = msg.text;
-        
-        auto at_pos = cmd_text.find('@');
-        if (at_pos != std::string::npos) {
-            auto space_pos = cmd_text.find(' ');
-            if (space_pos == std::string::npos || at_pos < space_pos) {
-                cmd_text.erase(at_pos, space_pos != std::string::npos ? space_pos - at_pos : std::string::npos);
+        {
+            detail::SessionRelease release_session(session);
+            
+            // Parse command text (handle @botname suffix)
+            std::string cmd_text = msg.text;
+            
+            auto at_pos = cmd_text.find('@');
+            if (at_pos != std::string::npos) {
+                auto space_pos = cmd_text.find(' ');
+                if (space_pos == std::string::npos || at_pos < space_pos) {
+                    cmd_text.erase(at_pos, space_pos != std::string::npos ? space_pos - at_pos : std::string::npos);
+                }
+            }
+            
+            std::string response = detail::handle_command(msg, session, cmd_text);
+            
+            // Unknown command - don't respond
+            if (!response.empty()) {
+                detail::send_response(msg, response);
             }
         }
-        
-        response = detail::handle_command(msg, session, cmd_text);
-        
-        // Unknown command - don't respond
-        if (response.empty()) {
-            return;
-        }
-    } else {
-        // Regular message - route to AI
-        response = detail::handle_ai_message(msg, session);
+        done();
+        return;
     }
     
-    // Send response
-    detail::send_response(msg, response);
+    // Regular message - route to AI, streaming into channels that can edit
+    std::shared_ptr<AiTurn> turn = std::make_shared<AiTurn>();
+    turn->msg = shared;
+    turn->release.reset(new detail::SessionRelease(session));
+    const AgentConfig& agent_config = app.agent().config();
+    if (agent_config.stream_replies && channel->capabilities().supports_edit) {
+        turn->stream.reset(new detail::StreamingReply(channel, msg, agent_config.stream_interval_ms));
+    }
+    
+    detail::handle_ai_message(msg, session, turn->stream.get(), [turn, done](const std::string& response) {
+        // Send response
+        detail::send_response(*turn->msg, response, turn->stream.get());
+        turn->release.reset();
+        done();
+    });
 }
 
 } // namespace opencrank
@@ -0,0 +1,263 @@
+/*
+ * OpenCrank C++ - Metrics Implementation
+ */
+#include <opencrank/core/metrics.hpp>
+#include <cmath>
+#include <cstdio>
+
+namespace opencrank {
+
+namespace {
+
+std::string escape_label_value(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        char c = value[i];
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+std::string format_value(double v) {
+    if (std::isinf(v)) return v > 0 ? "+Inf" : "-Inf";
+    if (std::isnan(v)) return "NaN";
+    char buf[32];
+    if (v == std::floor(v) && std::fabs(v) < 1e15) {
+        snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v));
+    } else {
+        snprintf(buf, sizeof(buf), "%.6g", v);
+    }
+    return buf;
+}
+
+// {a="b"} plus one more label, for histogram buckets
+std::string with_label(const std::string& labels, const std::string& key, const std::string& value) {
+    std::string extra = key + "=\"" + value + "\"";
+    if (labels.empty()) return "{" + extra + "}";
+    return labels.substr(0, labels.size() - 1) + "," + extra + "}";
+}
+
+void write_header(std::ostringstream& out, const std::string& name, const std::string& help, const char* type) {
+    out << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Series
+// ============================================================================
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds_(bounds), buckets_(new std::atomic<uint64_t>[bounds.size() + 1])
+    , count_(0), sum_micro_(0) {
+    for (size_t i = 0; i <= bounds_.size(); ++i) buckets_[i] = 0;
+}
+
+void Histogram::observe(double value) {
+    size_t i = 0;
+    while (i < bounds_.size() && value > bounds_[i]) ++i;
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_micro_.fetch_add(static_cast<int64_t>(std::llround(value * 1e6)), std::memory_order_relaxed);
+}
+
+std::string metric_labels(const std::string& k1, const std::string& v1) {
+    return "{" + k1 + "=\"" + escape_label_value(v1) + "\"}";
+}
+
+std::string metric_labels(const std::string& k1, const std::string& v1,
+                          const std::string& k2, const std::string& v2) {
+    return "{" + k1 + "=\"" + escape_label_value(v1) + "\"," +
+           k2 + "=\"" + escape_label_value(v2) + "\"}";
+}
+
+std::string metric_labels(const std::string& k1, const std::string& v1,
+                          const std::string& k2, const std::string& v2,
+                          const std::string& k3, const std::string& v3) {
+    return "{" + k1 + "=\"" + escape_label_value(v1) + "\"," +
+           k2 + "=\"" + escape_label_value(v2) + "\"," +
+           k3 + "=\"" + escape_label_value(v3) + "\"}";
+}
+
+// ============================================================================
+// MetricsWriter
+// ============================================================================
+
+void MetricsWriter::gauge(const std::string& name, const std::string& help, double value,
+                          const std::string& labels) {
+    sample(name, help, "gauge", value, labels);
+}
+
+void MetricsWriter::counter(const std::string& name, const std::string& help, double value,
+                            const std::string& labels) {
+    sample(name, help, "counter", value, labels);
+}
+
+void MetricsWriter::sample(const std::string& name, const std::string& help, const char* type,
+                           double value, const std::string& labels) {
+    if (name != last_name_) {
+        write_header(out_, name, help, type);
+        last_name_ = name;
+    }
+    out_ << name << labels << " " << format_value(value) << "\n";
+}
+
+// ============================================================================
+// Registry
+// ============================================================================
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+std::vector<double> Metrics::latency_buckets() {
+    static const double bounds[] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300 };
+    return std::vector<double>(bounds, bounds + sizeof(bounds) / sizeof(bounds[0]));
+}
+
+Metrics::Family& Metrics::family(const std::string& name, const std::string& help, Kind kind) {
+    std::map<std::string, Family>::iterator it = families_.find(name);
+    if (it == families_.end()) {
+        it = families_.insert(std::make_pair(name, Family())).first;
+        it->second.kind = kind;
+        it->second.help = help;
+    }
+    return it->second;
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<Counter>& slot = family(name, help, COUNTER).counters[labels];
+    if (!slot) slot = std::make_shared<Counter>();
+    return *slot;
+}
+
+Gauge& Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<Gauge>& slot = family(name, help, GAUGE).gauges[labels];
+    if (!slot) slot = std::make_shared<Gauge>();
+    return *slot;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help, const std::string& labels,
+                              const std::vector<double>& bounds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Family& fam = family(name, help, HISTOGRAM);
+    std::shared_ptr<Histogram>& slot = fam.histograms[labels];
+    if (!slot) {
+        // Every series of a metric shares the first registration's buckets
+        if (fam.bounds.empty()) fam.bounds = bounds;
+        slot = std::make_shared<Histogram>(fam.bounds);
+    }
+    return *slot;
+}
+
+void Metrics::add_collector(const std::string& id, const Collector& collector) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < collectors_.size(); ++i) {
+        if (collectors_[i].first == id) {
+            collectors_[i].second = collector;
+            return;
+        }
+    }
+    collectors_.push_back(std::make_pair(id, collector));
+}
+
+void Metrics::remove_collector(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < collectors_.size(); ++i) {
+        if (collectors_[i].first == id) {
+            collectors_.erase(collectors_.begin() + static_cast<long>(i));
+            return;
+        }
+    }
+}
+
+std::string Metrics::render() const {
+    std::ostringstream out;
+    std::vector<std::pair<std::string, Collector> > collectors;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::map<std::string, Family>::const_iterator f = families_.begin(); f != families_.end(); ++f) {
+            const std::string& name = f->first;
+            const Family& fam = f->second;
+            if (fam.kind == COUNTER) {
+                write_header(out, name, fam.help, "counter");
+                for (std::map<std::string, std::shared_ptr<Counter> >::const_iterator s = fam.counters.begin();
+                     s != fam.counters.end(); ++s) {
+                    out << name << s->first << " " << s->second->value() << "\n";
+                }
+            } else if (fam.kind == GAUGE) {
+                write_header(out, name, fam.help, "gauge");
+                for (std::map<std::string, std::shared_ptr<Gauge> >::const_iterator s = fam.gauges.begin();
+                     s != fam.gauges.end(); ++s) {
+                    out << name << s->first << " " << s->second->value() << "\n";
+                }
+            } else {
+                write_header(out, name, fam.help, "histogram");
+                for (std::map<std::string, std::shared_ptr<Histogram> >::const_iterator s = fam.histograms.begin();
+                     s != fam.histograms.end(); ++s) {
+                    const Histogram& h = *s->second;
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i <= h.bounds().size(); ++i) {
+                        cumulative += h.bucket(i);
+                        std::string le = i < h.bounds().size() ? format_value(h.bounds()[i]) : "+Inf";
+                        out << name << "_bucket" << with_label(s->first, "le", le) << " " << cumulative << "\n";
+                    }
+                    // _count is the +Inf bucket, so a concurrent observe cannot
+                    // make the two disagree
+                    out << name << "_sum" << s->first << " " << format_value(h.sum()) << "\n"
+                        << name << "_count" << s->first << " " << cumulative << "\n";
+                }
+            }
+        }
+        collectors = collectors_;
+    }
+
+    // Collectors read other subsystems' locks; run them outside ours
+    MetricsWriter writer(out);
+    for (size_t i = 0; i < collectors.size(); ++i) {
+        collectors[i].second(writer);
+    }
+    return out.str();
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+void record_llm_request(const std::string& provider, const std::string& purpose,
+                        double seconds, bool success,
+                        int64_t prompt_tokens, int64_t completion_tokens, int64_t cached_tokens) {
+    Metrics& m = Metrics::instance();
+    m.histogram("opencrank_llm_request_seconds", "Model request latency",
+                metric_labels("provider", provider, "purpose", purpose)).observe(seconds);
+    m.counter("opencrank_llm_requests_total", "Model requests by outcome",
+              metric_labels("provider", provider, "purpose", purpose, "outcome", success ? "ok" : "error")).inc();
+    if (!success) return;
+
+    const char* help = "Tokens processed by model requests";
+    if (prompt_tokens > 0) {
+        m.counter("opencrank_llm_tokens_total", help,
+                  metric_labels("provider", provider, "purpose", purpose, "kind", "prompt"))
+            .inc(static_cast<uint64_t>(prompt_tokens));
+    }
+    if (completion_tokens > 0) {
+        m.counter("opencrank_llm_tokens_total", help,
+                  metric_labels("provider", provider, "purpose", purpose, "kind", "completion"))
+            .inc(static_cast<uint64_t>(completion_tokens));
+    }
+    if (cached_tokens > 0) {
+        m.counter("opencrank_llm_tokens_total", help,
+                  metric_labels("provider", provider, "purpose", purpose, "kind", "cached"))
+            .inc(static_cast<uint64_t>(cached_tokens));
+    }
+}
+
+} // namespace opencrank
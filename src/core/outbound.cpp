@@ -0,0 +1,285 @@
+/*
+ * OpenCrank C++ - Outbound Reply Scheduler Implementation
+ */
+#include <opencrank/core/outbound.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <chrono>
+
+namespace opencrank {
+
+namespace {
+const int64_t IDLE_WAIT_MS = 1000;
+} // namespace
+
+// Bookkeeping shared by the chunks of one reply
+struct OutboundScheduler::ReplyState {
+    std::mutex mutex;
+    Delivery delivery;
+    size_t answered;
+    ChunkCallback on_chunk;
+    DeliveryCallback on_delivered;
+
+    ReplyState() : answered(0) {}
+};
+
+OutboundScheduler& OutboundScheduler::instance() {
+    static OutboundScheduler scheduler;
+    return scheduler;
+}
+
+OutboundScheduler::OutboundScheduler()
+    : queued_(0)
+    , running_(false)
+    , stopping_(false)
+    , delivered_(0)
+    , failed_(0) {}
+
+OutboundScheduler::~OutboundScheduler() {
+    stop(0);
+}
+
+void OutboundScheduler::start(size_t threads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return;
+    senders_.reset(new ThreadPool(threads < 1 ? 1 : threads));
+    running_ = true;
+    stopping_ = false;
+    thread_ = std::thread(&OutboundScheduler::dispatcher_loop, this);
+    LOG_DEBUG("[Outbound] Scheduler started (%zu sender thread(s))", senders_->size());
+}
+
+void OutboundScheduler::stop(int drain_ms) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_) return;
+        stopping_ = true;
+        cv_.notify_all();
+        if (drain_ms > 0 && queued_ > 0) {
+            LOG_DEBUG("[Outbound] Draining %zu queued chunk(s)", queued_);
+            cv_.wait_for(lock, std::chrono::milliseconds(drain_ms), [this]() { return queued_ == 0; });
+        }
+        running_ = false;
+        cv_.notify_all();
+    }
+    if (thread_.joinable()) thread_.join();
+    senders_->shutdown();   // Lets blocking sends already handed over finish
+
+    std::vector<Job> leftover;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::map<std::string, ChatQueue>::iterator it = chats_.begin(); it != chats_.end(); ++it) {
+            leftover.insert(leftover.end(), it->second.jobs.begin(), it->second.jobs.end());
+        }
+        chats_.clear();
+        queued_ = 0;
+    }
+    if (!leftover.empty()) {
+        LOG_WARN("[Outbound] Dropping %zu unsent chunk(s) at shutdown", leftover.size());
+    }
+    for (size_t i = 0; i < leftover.size(); ++i) {
+        report(leftover[i], SendResult::fail("outbound scheduler stopped"));
+    }
+}
+
+void OutboundScheduler::send(ChannelPlugin* channel, const Reply& reply) {
+    if (!channel) return;
+
+    std::shared_ptr<ReplyState> state = std::make_shared<ReplyState>();
+    state->delivery.channel_id = channel->channel_id();
+    state->delivery.to = reply.to;
+    state->on_chunk = reply.on_chunk;
+    state->on_delivered = reply.on_delivered;
+
+    std::vector<Job> jobs;
+    for (size_t i = 0; i < reply.chunks.size(); ++i) {
+        if (reply.chunks[i].empty()) continue;
+        Job job;
+        job.channel = channel;
+        job.chat_key = state->delivery.channel_id + "\n" + reply.to;
+        job.to = reply.to;
+        job.text = reply.chunks[i];
+        job.index = i;
+        job.reply = state;
+        job.pipelined = false;
+        job.chat_interval_ms = 0;
+        if (jobs.empty()) {
+            job.reply_to = reply.reply_to;
+            job.edit_message_id = reply.edit_message_id;
+        }
+        jobs.push_back(job);
+    }
+    state->delivery.chunks = jobs.size();
+    if (jobs.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ && !stopping_) {
+            ChatQueue& queue = chats_[jobs[0].chat_key];
+            queue.jobs.insert(queue.jobs.end(), jobs.begin(), jobs.end());
+            queued_ += jobs.size();
+            cv_.notify_all();   // stop() may be waiting on the same condition
+            return;
+        }
+    }
+
+    // No scheduler: send in order on the caller's thread
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        report(jobs[i], run_blocking(jobs[i]));
+    }
+}
+
+size_t OutboundScheduler::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+// ============================================================================
+// Dispatcher thread
+// ============================================================================
+
+OutboundScheduler::ChannelShape& OutboundScheduler::shape_for(ChannelPlugin* channel) {
+    std::string id = channel->channel_id();
+    std::map<std::string, ChannelShape>::iterator it = shapes_.find(id);
+    if (it != shapes_.end()) return it->second;
+
+    ChannelCapabilities caps = channel->capabilities();
+    ChannelShape& shape = shapes_[id];
+    shape.async_sends = caps.async_sends;
+    if (!caps.async_sends) {
+        shape.chat_interval_ms = caps.min_chat_send_interval_ms;
+        if (caps.max_sends_per_second > 0) {
+            shape.shaped = true;
+            shape.bucket.set_rate(caps.max_sends_per_second, caps.max_sends_per_second);
+            shape.bucket.reset();
+        }
+    }
+    LOG_DEBUG("[Outbound] %s: %s", id.c_str(),
+              shape.async_sends ? "channel queues its own sends" :
+              shape.shaped ? "shaped by the scheduler" : "unshaped");
+    return shape;
+}
+
+void OutboundScheduler::take_ready(int64_t now, std::vector<Job>& ready, int64_t& wait_ms) {
+    wait_ms = IDLE_WAIT_MS;
+    std::map<std::string, ChatQueue>::iterator it = chats_.begin();
+    while (it != chats_.end()) {
+        ChatQueue& queue = it->second;
+        while (!queue.jobs.empty() && !queue.busy) {
+            if (queue.next_ms > now) {
+                if (queue.next_ms - now < wait_ms) wait_ms = queue.next_ms - now;
+                break;
+            }
+            Job& job = queue.jobs.front();
+            ChannelShape& shape = shape_for(job.channel);
+            if (shape.shaped) {
+                RateLimitResult token = shape.bucket.try_acquire();
+                if (!token.allowed) {
+                    if (token.retry_after_ms + 1 < wait_ms) wait_ms = token.retry_after_ms + 1;
+                    break;
+                }
+            }
+
+            // Edits block (a failed one falls back to a send that must land
+            // first); async sends are pipelined behind each other
+            job.pipelined = shape.async_sends && job.edit_message_id.empty();
+            job.chat_interval_ms = shape.chat_interval_ms;
+            queue.busy = !job.pipelined;
+            ready.push_back(job);
+            queue.jobs.pop_front();
+            --queued_;
+        }
+        // Kept while a send runs or its gap to the next one lasts
+        if (queue.jobs.empty() && !queue.busy && queue.next_ms <= now) {
+            chats_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void OutboundScheduler::dispatcher_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        std::vector<Job> ready;
+        int64_t wait_ms = IDLE_WAIT_MS;
+        take_ready(current_timestamp_ms(), ready, wait_ms);
+        if (queued_ == 0 && stopping_) cv_.notify_all();   // Drained
+        if (ready.empty()) {
+            cv_.wait_for(lock, std::chrono::milliseconds(wait_ms < 1 ? 1 : wait_ms));
+            continue;
+        }
+
+        lock.unlock();
+        for (size_t i = 0; i < ready.size(); ++i) {
+            dispatch(ready[i]);
+        }
+        lock.lock();
+    }
+}
+
+void OutboundScheduler::dispatch(Job& job) {
+    if (job.pipelined) {
+        Job sent = job;
+        job.channel->send_message_async(job.to, job.text, job.reply_to, [this, sent](const SendResult& result) {
+            report(sent, result);
+        });
+        return;
+    }
+
+    Job blocking = job;
+    senders_->enqueue([this, blocking]() {
+        SendResult result = run_blocking(blocking);
+        chat_done(blocking.chat_key, blocking.chat_interval_ms);
+        report(blocking, result);
+    }, TaskPriority::INTERACTIVE);
+}
+
+SendResult OutboundScheduler::run_blocking(const Job& job) {
+    if (!job.edit_message_id.empty()) {
+        // Replace the streamed draft with the final text
+        SendResult result = job.channel->edit_message(job.to, job.edit_message_id, job.text);
+        if (result.success) return result;
+        LOG_DEBUG("[Outbound] Final edit failed on %s (%s), sending instead",
+                  job.channel->channel_id(), result.error.c_str());
+    }
+    return job.reply_to.empty() ? job.channel->send_message(job.to, job.text)
+                                : job.channel->send_message(job.to, job.text, job.reply_to);
+}
+
+void OutboundScheduler::chat_done(const std::string& chat_key, int chat_interval_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, ChatQueue>::iterator it = chats_.find(chat_key);
+    if (it == chats_.end()) return;
+    it->second.busy = false;
+    it->second.next_ms = current_timestamp_ms() + chat_interval_ms;
+    cv_.notify_all();
+}
+
+void OutboundScheduler::report(const Job& job, const SendResult& result) {
+    if (result.success) {
+        delivered_.fetch_add(1);
+    } else {
+        failed_.fetch_add(1);
+    }
+
+    ReplyState& state = *job.reply;
+    if (state.on_chunk) state.on_chunk(job.index, result);
+
+    bool last = false;
+    Delivery delivery;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (result.success) {
+            state.delivery.delivered++;
+        } else {
+            state.delivery.error = result.error;
+        }
+        last = ++state.answered == state.delivery.chunks;
+        if (last) delivery = state.delivery;
+    }
+    if (last && state.on_delivered) state.on_delivered(delivery);
+}
+
+} // namespace opencrank
@@ -3,6 +3,10 @@
  */
 #include <opencrank/core/registry.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/startup_profile.hpp>
+#include <set>
+#include <thread>
+#include <algorithm>
 
 namespace opencrank {
 
@@ -16,26 +20,138 @@ PluginRegistry& PluginRegistry::instance() {
     return registry;
 }
 
-void PluginRegistry::register_command(const CommandDef& cmd) {
-    if (cmd.command.empty() || !cmd.handler) {
-        LOG_WARN("Attempted to register invalid command (empty=%d, handler=%p)", 
-                 cmd.command.empty(), reinterpret_cast<void*>(cmd.handler));
-        return;
+PluginRegistry::PluginRegistry() : current_(nullptr) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    publish_locked(std::vector<Plugin*>(), std::map<std::string, CommandDef>());
+}
+
+PluginRegistry::~PluginRegistry() {
+    // Pins inside objects destroyed after this singleton (replies still on
+    // the Application's reactor at exit) release into their snapshot last
+    for (size_t i = 0; i < snapshots_.size(); ++i) {
+        snapshots_[i].release();
+    }
+}
+
+void PluginRegistry::publish_locked(const std::vector<Plugin*>& plugins,
+                                    const std::map<std::string, CommandDef>& commands) {
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    snapshot->plugins = plugins;
+    for (size_t i = 0; i < plugins.size(); ++i) {
+        Plugin* plugin = plugins[i];
+        snapshot->plugin_map[plugin->name()] = plugin;
+        
+        // Also track channel plugins separately
+        ChannelPlugin* channel = dynamic_cast<ChannelPlugin*>(plugin);
+        if (channel) {
+            snapshot->channels.push_back(channel);
+            snapshot->channel_map[channel->channel_id()] = channel;
+        }
+        
+        // Also track tools
+        ToolProvider* tool = dynamic_cast<ToolProvider*>(plugin);
+        if (tool) {
+            snapshot->tools.push_back(tool);
+            snapshot->tool_map[tool->tool_id()] = tool;
+        }
+        
+        // Also track AI plugins
+        AIPlugin* ai = dynamic_cast<AIPlugin*>(plugin);
+        if (ai) {
+            snapshot->ai_providers.push_back(ai);
+            snapshot->ai_map[ai->provider_id()] = ai;
+        }
+    }
+    snapshot->commands = commands;
+    for (std::map<std::string, CommandDef>::const_iterator it = snapshot->commands.begin();
+         it != snapshot->commands.end(); ++it) {
+        snapshot->command_index[it->first] = &it->second;
+    }
+    
+    const Snapshot* previous = current_.load(std::memory_order_relaxed);
+    snapshot->generation = previous ? previous->generation + 1 : 1;
+    current_.store(snapshot.get(), std::memory_order_seq_cst);
+    snapshots_.push_back(std::move(snapshot));
+}
+
+PluginRegistry::Pin::Pin() {
+    // Count on the current snapshot, then check it is still current: a
+    // writer that swapped it in between may already have seen the count
+    // at zero, so retry on the new one
+    const std::atomic<const Snapshot*>& current = PluginRegistry::instance().current_;
+    for (;;) {
+        const Snapshot* snapshot = current.load(std::memory_order_seq_cst);
+        snapshot->pins.fetch_add(1, std::memory_order_seq_cst);
+        if (current.load(std::memory_order_seq_cst) == snapshot) {
+            snapshot_ = snapshot;
+            return;
+        }
+        snapshot->pins.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+PluginRegistry::Pin::~Pin() {
+    snapshot_->pins.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void PluginRegistry::register_plugin(Plugin* plugin, size_t position) {
+    if (!plugin) return;
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    const Snapshot* snapshot = current();
+    std::vector<Plugin*> plugins = snapshot->plugins;
+    plugins.insert(plugins.begin() + static_cast<long>(std::min(position, plugins.size())), plugin);
+    publish_locked(plugins, snapshot->commands);
+}
+
+size_t PluginRegistry::unregister_plugin(Plugin* plugin) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    const Snapshot* snapshot = current();
+    std::vector<Plugin*> plugins = snapshot->plugins;
+    std::vector<Plugin*>::iterator it = std::find(plugins.begin(), plugins.end(), plugin);
+    if (it == plugins.end()) return static_cast<size_t>(-1);
+    size_t position = static_cast<size_t>(it - plugins.begin());
+    plugins.erase(it);
+    publish_locked(plugins, snapshot->commands);
+    return position;
+}
+
+bool PluginRegistry::quiescent(uint64_t generation) const {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    for (size_t i = 0; i < snapshots_.size(); ++i) {
+        if (snapshots_[i]->generation < generation &&
+            snapshots_[i]->pins.load(std::memory_order_seq_cst) > 0) {
+            return false;
+        }
     }
-    commands_[cmd.command] = cmd;
-    LOG_DEBUG("-> Registered: %s", cmd.command.c_str());
+    return true;
+}
+
+void PluginRegistry::register_command(const CommandDef& cmd) {
+    register_commands(std::vector<CommandDef>(1, cmd));
 }
 
 void PluginRegistry::register_commands(const std::vector<CommandDef>& cmds) {
     LOG_DEBUG("registering %zu commands", cmds.size());
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    const Snapshot* snapshot = current();
+    std::map<std::string, CommandDef> commands = snapshot->commands;
     for (size_t i = 0; i < cmds.size(); ++i) {
-        register_command(cmds[i]);
+        const CommandDef& cmd = cmds[i];
+        if (cmd.command.empty() || !cmd.handler) {
+            LOG_WARN("Attempted to register invalid command (empty=%d, handler=%p)", 
+                     cmd.command.empty(), reinterpret_cast<void*>(cmd.handler));
+            continue;
+        }
+        commands[cmd.command] = cmd;
+        LOG_DEBUG("-> Registered: %s", cmd.command.c_str());
     }
-    LOG_DEBUG("total commands now: %zu", commands_.size());
+    publish_locked(snapshot->plugins, commands);
+    LOG_DEBUG("total commands now: %zu", commands.size());
 }
 
 std::string PluginRegistry::execute_command(const std::string& command, const Message& msg, 
                                             Session& session, const std::string& args) {
+    Pin pin;
     const CommandDef* cmd = find_command(command);
     if (!cmd || !cmd->handler) {
         return "";  // Command not found
@@ -44,58 +160,164 @@ std::string PluginRegistry::execute_command(const std::string& command, const Me
 }
 
 const CommandDef* PluginRegistry::find_command(const std::string& command) const {
-    std::map<std::string, CommandDef>::const_iterator it = commands_.find(command);
-    return it != commands_.end() ? &it->second : NULL;
+    return lookup(current()->command_index, command);
 }
 
-bool PluginRegistry::init_all(const Config& cfg) {
-    bool all_ok = true;
-    for (size_t i = 0; i < plugins_.size(); ++i) {
-        if (!plugins_[i]->init(cfg)) {
-            all_ok = false;
+Plugin* PluginRegistry::find_dependency(const std::string& name) {
+    if (Plugin* plugin = get_plugin(name)) return plugin;
+    if (AIPlugin* ai = get_ai(name)) return ai;
+    if (ChannelPlugin* channel = get_channel(name)) return channel;
+    if (ToolProvider* tool = get_tool(name)) return tool;
+    return NULL;
+}
+
+bool PluginRegistry::init_all(const Config& cfg, bool parallel, StartupProfile* profile) {
+    // Dependencies as indices; unknown names were never loaded and impose nothing
+    const std::vector<Plugin*>& plugins = current()->plugins;
+    size_t count = plugins.size();
+    std::vector<std::set<size_t> > waits_on(count);
+    std::map<Plugin*, size_t> index;
+    for (size_t i = 0; i < count; ++i) {
+        index[plugins[i]] = i;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<std::string> after = plugins[i]->init_after(cfg);
+        for (size_t j = 0; j < after.size(); ++j) {
+            Plugin* dep = find_dependency(after[j]);
+            if (dep && dep != plugins[i]) {
+                waits_on[i].insert(index[dep]);
+            }
         }
     }
+    
+    std::vector<bool> done(count, false);
+    std::vector<char> ok(count, 0);   // Written by the init threads
+    size_t remaining = count;
+    while (remaining > 0) {
+        std::vector<size_t> wave;
+        for (size_t i = 0; i < count; ++i) {
+            if (done[i]) continue;
+            bool ready = true;
+            for (std::set<size_t>::const_iterator it = waits_on[i].begin(); it != waits_on[i].end(); ++it) {
+                if (!done[*it]) { ready = false; break; }
+            }
+            if (ready) wave.push_back(i);
+        }
+        if (wave.empty()) {
+            // A cycle: fall back to registration order for what is left
+            LOG_WARN("[Plugins] init_after() cycle, initializing %zu plugin(s) in order", remaining);
+            for (size_t i = 0; i < count; ++i) {
+                if (!done[i]) wave.push_back(i);
+            }
+            parallel = false;
+        }
+        
+        auto init_one = [&](size_t i) {
+            StartupProfile::Scope scope(profile, "init", plugins[i]->name());
+            ok[i] = plugins[i]->init(cfg) ? 1 : 0;
+            scope.set_ok(ok[i] != 0);
+        };
+        if (parallel && wave.size() > 1) {
+            std::vector<std::thread> threads;
+            for (size_t w = 1; w < wave.size(); ++w) {
+                threads.push_back(std::thread(init_one, wave[w]));
+            }
+            init_one(wave[0]);
+            for (size_t t = 0; t < threads.size(); ++t) {
+                threads[t].join();
+            }
+        } else {
+            for (size_t w = 0; w < wave.size(); ++w) {
+                init_one(wave[w]);
+            }
+        }
+        
+        for (size_t w = 0; w < wave.size(); ++w) {
+            done[wave[w]] = true;
+        }
+        remaining -= wave.size();
+    }
+    
+    bool all_ok = true;
+    for (size_t i = 0; i < count; ++i) {
+        if (!ok[i]) all_ok = false;
+    }
     return all_ok;
 }
 
 void PluginRegistry::shutdown_all() {
+    const std::vector<Plugin*>& plugins = current()->plugins;
     // Shutdown in reverse order
-    for (size_t i = plugins_.size(); i > 0; --i) {
-        plugins_[i - 1]->shutdown();
+    for (size_t i = plugins.size(); i > 0; --i) {
+        plugins[i - 1]->shutdown();
     }
 }
 
-bool PluginRegistry::start_all_channels() {
-    bool all_ok = true;
-    for (size_t i = 0; i < channels_.size(); ++i) {
-        if (!channels_[i]->start()) {
-            all_ok = false;
+int PluginRegistry::start_all_channels(bool parallel, StartupProfile* profile) {
+    // Starting usually means a network round trip (getMe, status checks);
+    // channels do not depend on each other, so they start concurrently
+    const std::vector<ChannelPlugin*>& channels = current()->channels;
+    std::vector<ChannelPlugin*> pending;
+    for (size_t i = 0; i < channels.size(); ++i) {
+        if (channels[i]->is_initialized()) pending.push_back(channels[i]);
+    }
+    
+    std::vector<char> started(pending.size(), 0);
+    auto start_one = [&](size_t i) {
+        StartupProfile::Scope scope(profile, "start", pending[i]->channel_id());
+        started[i] = pending[i]->start() ? 1 : 0;
+        scope.set_ok(started[i] != 0);
+    };
+    if (parallel && pending.size() > 1) {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < pending.size(); ++i) {
+            threads.push_back(std::thread(start_one, i));
+        }
+        start_one(0);
+        for (size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+    } else {
+        for (size_t i = 0; i < pending.size(); ++i) {
+            start_one(i);
         }
     }
-    return all_ok;
+    
+    int count = 0;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (started[i]) {
+            LOG_INFO("Started channel: %s", pending[i]->channel_id());
+            count++;
+        }
+    }
+    return count;
 }
 
 void PluginRegistry::stop_all_channels() {
-    for (size_t i = 0; i < channels_.size(); ++i) {
-        channels_[i]->stop();
+    const std::vector<ChannelPlugin*>& channels = current()->channels;
+    for (size_t i = 0; i < channels.size(); ++i) {
+        channels[i]->stop();
     }
 }
 
 void PluginRegistry::poll_all_channels() {
-    for (size_t i = 0; i < channels_.size(); ++i) {
-        channels_[i]->poll();
+    const std::vector<ChannelPlugin*>& channels = current()->channels;
+    for (size_t i = 0; i < channels.size(); ++i) {
+        channels[i]->poll();
     }
 }
 
 void PluginRegistry::poll_all() {
-    for (size_t i = 0; i < plugins_.size(); ++i) {
-        plugins_[i]->poll();
+    const std::vector<Plugin*>& plugins = current()->plugins;
+    for (size_t i = 0; i < plugins.size(); ++i) {
+        plugins[i]->poll();
     }
 }
 
 ToolResult PluginRegistry::execute_tool(const std::string& tool_id, 
                                         const std::string& action,
                                         const Json& params) {
+    Pin pin;
     ToolProvider* tool = get_tool(tool_id);
     if (!tool) {
         return ToolResult::fail("Tool not found: " + tool_id);
@@ -107,15 +329,16 @@ ToolResult PluginRegistry::execute_tool(const std::string& tool_id,
 }
 
 AIPlugin* PluginRegistry::get_default_ai() {
-    LOG_DEBUG("Selecting default AI provider from %zu registered providers", ai_providers_.size());
-    for (size_t i = 0; i < ai_providers_.size(); ++i) {
+    const std::vector<AIPlugin*>& ai_providers = current()->ai_providers;
+    LOG_DEBUG("Selecting default AI provider from %zu registered providers", ai_providers.size());
+    for (size_t i = 0; i < ai_providers.size(); ++i) {
         LOG_DEBUG("Checking: %s (initialized=%d, configured=%d)", 
-                  ai_providers_[i]->provider_id().c_str(),
-                  ai_providers_[i]->is_initialized(),
-                  ai_providers_[i]->is_configured());
-        if (ai_providers_[i]->is_initialized() && ai_providers_[i]->is_configured()) {
-            LOG_INFO(" Selected AI provider: %s", ai_providers_[i]->provider_id().c_str());
-            return ai_providers_[i];
+                  ai_providers[i]->provider_id().c_str(),
+                  ai_providers[i]->is_initialized(),
+                  ai_providers[i]->is_configured());
+        if (ai_providers[i]->is_initialized() && ai_providers[i]->is_configured()) {
+            LOG_INFO(" Selected AI provider: %s", ai_providers[i]->provider_id().c_str());
+            return ai_providers[i];
         }
     }
     LOG_WARN(" No configured AI provider found");
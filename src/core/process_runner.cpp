@@ -0,0 +1,399 @@
+/*
+ * OpenCrank C++ - Process Runner Implementation
+ */
+#include <opencrank/core/process_runner.hpp>
+#include <opencrank/core/logger.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace opencrank {
+
+namespace {
+
+// SIGTERM first; whatever is left of the group gets SIGKILL after this
+const int KILL_GRACE_MS = 2000;
+
+// Output still arriving from background children after the command exited
+const int DRAIN_GRACE_MS = 500;
+
+// Exit polling interval when pidfd_open is unavailable
+const int WAITPID_POLL_MS = 50;
+
+struct Running {
+    pid_t pgid;
+    std::atomic<bool> cancelled;
+
+    explicit Running(pid_t p) : pgid(p), cancelled(false) {}
+};
+
+typedef std::multimap<std::string, std::shared_ptr<Running> > RunningMap;
+
+std::mutex& running_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+RunningMap& running_map() {
+    static RunningMap map;
+    return map;
+}
+
+void unregister(RunningMap::iterator it) {
+    std::lock_guard<std::mutex> lock(running_mutex());
+    running_map().erase(it);
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Resource is glibc's __rlimit_resource in C++, int elsewhere
+template <typename Resource>
+void apply_limit(pid_t pid, Resource resource, rlim_t soft, rlim_t hard) {
+    struct rlimit rl;
+    rl.rlim_cur = soft;
+    rl.rlim_max = hard;
+    if (prlimit(pid, resource, &rl, NULL) != 0) {
+        LOG_DEBUG("[Process] prlimit(%d) failed for pid %d: %s",
+                  static_cast<int>(resource), pid, strerror(errno));
+    }
+}
+
+// Child has exited (left as a zombie so its pgid cannot be reused yet)
+bool has_exited(pid_t pid) {
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+        return errno == ECHILD;
+    }
+    return info.si_pid == pid;
+}
+
+// Words of a command line that needs no shell; empty if it does
+std::vector<std::string> simple_argv(const std::string& command) {
+    static const char PLAIN[] = "-_./=:,+@%";
+    std::vector<std::string> words;
+    std::string word;
+    for (size_t i = 0; i < command.size(); ++i) {
+        char c = command[i];
+        if (c == ' ' || c == '\t') {
+            if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+            continue;
+        }
+        if (!isalnum(static_cast<unsigned char>(c)) && !strchr(PLAIN, c)) {
+            return std::vector<std::string>();
+        }
+        word += c;
+    }
+    if (!word.empty()) {
+        words.push_back(word);
+    }
+    // "VAR=value cmd" is an assignment only a shell understands
+    if (!words.empty() && words[0].find('=') != std::string::npos) {
+        words.clear();
+    }
+    return words;
+}
+
+int64_t elapsed_ms(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - since).count();
+}
+
+} // anonymous namespace
+
+ProcessResult ProcessRunner::run_shell(const std::string& command,
+                                       const std::string& workdir,
+                                       const ProcessLimits& limits,
+                                       const std::string& cancel_key,
+                                       OutputCallback on_output) {
+    std::vector<std::string> words = simple_argv(command);
+    if (!words.empty()) {
+        ProcessResult result = run(words, workdir, limits, cancel_key, on_output);
+        if (result.started || result.error_code != ENOENT) {
+            return result;
+        }
+        // Not a program (a builtin such as cd, or a typo): let the shell
+        // run it or report it
+    }
+
+    std::vector<std::string> argv;
+    argv.push_back("/bin/sh");
+    argv.push_back("-c");
+    argv.push_back(command);
+    return run(argv, workdir, limits, cancel_key, on_output);
+}
+
+ProcessResult ProcessRunner::run(const std::vector<std::string>& argv,
+                                 const std::string& workdir,
+                                 const ProcessLimits& limits,
+                                 const std::string& cancel_key,
+                                 OutputCallback on_output) {
+    ProcessResult result;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (argv.empty()) {
+        result.error = "empty command";
+        return result;
+    }
+    if (limits.cancel && limits.cancel->load()) {
+        result.cancelled = true;
+        result.error = "cancelled";
+        return result;
+    }
+
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        result.error_code = errno;
+        result.error = std::string("pipe: ") + strerror(errno);
+        return result;
+    }
+
+    // stdin from /dev/null, stdout and stderr into the pipe. dup2 clears
+    // CLOEXEC on the targets; the originals close on exec.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], 2);
+
+    std::vector<std::string> args = argv;
+    if (!workdir.empty()) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+        posix_spawn_file_actions_addchdir_np(&actions, workdir.c_str());
+#else
+        // No spawn-time chdir: let a shell change directory first
+        std::string line = "cd \"$0\" && exec \"$@\"";
+        args.insert(args.begin(), workdir);
+        args.insert(args.begin(), line);
+        args.insert(args.begin(), "-c");
+        args.insert(args.begin(), "/bin/sh");
+#endif
+    }
+
+    // Own process group (so the whole tree can be signalled), default
+    // dispositions for signals the gateway ignores or handles, empty mask
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    sigaddset(&defaults, SIGHUP);
+    sigaddset(&defaults, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK |
+                                    POSIX_SPAWN_SETSIGDEF);
+
+    std::vector<char*> cargv;
+    for (size_t i = 0; i < args.size(); ++i) {
+        cargv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    cargv.push_back(NULL);
+
+    pid_t pid = -1;
+    int rc = posix_spawnp(&pid, cargv[0], &actions, &attr, cargv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(pipefd[1]);
+
+    if (rc != 0) {
+        close(pipefd[0]);
+        result.error_code = rc;
+        result.error = std::string("spawn ") + argv[0] +
+                       (workdir.empty() ? "" : " in " + workdir) + ": " + strerror(rc);
+        return result;
+    }
+    result.started = true;
+
+    if (limits.cpu_s > 0) {
+        // SIGXCPU at the soft limit, SIGKILL a second later
+        rlim_t cpu = static_cast<rlim_t>(limits.cpu_s);
+        apply_limit(pid, RLIMIT_CPU, cpu, cpu + 1);
+    }
+    if (limits.memory_bytes > 0) {
+        rlim_t memory = static_cast<rlim_t>(limits.memory_bytes);
+        apply_limit(pid, RLIMIT_AS, memory, memory);
+    }
+
+    std::shared_ptr<Running> running = std::make_shared<Running>(pid);
+    RunningMap::iterator reg;
+    {
+        std::lock_guard<std::mutex> lock(running_mutex());
+        reg = running_map().insert(std::make_pair(cancel_key, running));
+    }
+    // A cancel by key before the insert missed this process
+    if (limits.cancel && limits.cancel->load()) {
+        running->cancelled.store(true);
+        kill(-pid, SIGKILL);
+    }
+
+    int out_fd = pipefd[0];
+    fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) | O_NONBLOCK);
+    int pidfd = open_pidfd(pid);
+
+    int64_t deadline_ms = limits.timeout_s > 0 ? static_cast<int64_t>(limits.timeout_s) * 1000 : -1;
+    int64_t kill_at_ms = -1;        // SIGKILL escalation after a timeout
+    int64_t drain_until_ms = -1;    // Set once the process has exited
+    bool exited = false;
+    char buf[16384];
+
+    while (out_fd >= 0 || !exited) {
+        int64_t now = elapsed_ms(start);
+
+        if (!exited && deadline_ms >= 0 && now >= deadline_ms && !result.timed_out) {
+            result.timed_out = true;
+            kill(-pid, SIGTERM);
+            kill_at_ms = now + KILL_GRACE_MS;
+        }
+        if (!exited && kill_at_ms >= 0 && now >= kill_at_ms) {
+            kill(-pid, SIGKILL);
+            kill_at_ms = -1;
+        }
+        if (exited && now >= drain_until_ms) {
+            break;
+        }
+
+        // Sleep until output, exit, or the next deadline
+        int64_t wait = -1;
+        if (!exited && deadline_ms >= 0 && !result.timed_out) wait = deadline_ms - now;
+        if (kill_at_ms >= 0) wait = wait < 0 ? kill_at_ms - now : std::min(wait, kill_at_ms - now);
+        if (exited) wait = drain_until_ms - now;
+        if (!exited && pidfd < 0) wait = wait < 0 ? WAITPID_POLL_MS : std::min<int64_t>(wait, WAITPID_POLL_MS);
+
+        struct pollfd pfds[2];
+        nfds_t nfds = 0;
+        int out_idx = -1, pid_idx = -1;
+        if (out_fd >= 0) {
+            pfds[nfds].fd = out_fd;
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            out_idx = static_cast<int>(nfds++);
+        }
+        if (!exited && pidfd >= 0) {
+            pfds[nfds].fd = pidfd;
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            pid_idx = static_cast<int>(nfds++);
+        }
+        int ready = poll(pfds, nfds, static_cast<int>(wait < 0 ? -1 : std::max<int64_t>(wait, 0)));
+        if (ready < 0 && errno != EINTR) {
+            LOG_WARN("[Process] poll failed: %s", strerror(errno));
+            kill(-pid, SIGKILL);
+            break;
+        }
+
+        if (out_idx >= 0 && (pfds[out_idx].revents & (POLLIN | POLLHUP | POLLERR))) {
+            for (;;) {
+                ssize_t n = read(out_fd, buf, sizeof(buf));
+                if (n > 0) {
+                    size_t room = limits.max_output > result.output.size()
+                                      ? limits.max_output - result.output.size() : 0;
+                    if (static_cast<size_t>(n) > room) {
+                        result.truncated = true;
+                    }
+                    result.output.append(buf, std::min(static_cast<size_t>(n), room));
+                    if (on_output) {
+                        on_output(buf, static_cast<size_t>(n));
+                    }
+                    continue;
+                }
+                if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    close(out_fd);      // EOF: every writer is gone
+                    out_fd = -1;
+                }
+                break;
+            }
+        }
+
+        bool check_exit = pid_idx >= 0 ? (pfds[pid_idx].revents & POLLIN) != 0 : pidfd < 0;
+        if (!exited && check_exit && has_exited(pid)) {
+            exited = true;
+            drain_until_ms = elapsed_ms(start) + DRAIN_GRACE_MS;
+            // Stop cancel() from signalling the group once the leader is reaped
+            unregister(reg);
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+            if (WIFEXITED(status)) {
+                result.exit_code = WEXITSTATUS(status);
+            } else if (WIFSIGNALED(status)) {
+                result.term_signal = WTERMSIG(status);
+            }
+        }
+    }
+
+    if (!exited) {
+        // Left the loop on an error: make sure nothing is left behind
+        unregister(reg);
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+    }
+    if (out_fd >= 0) {
+        close(out_fd);      // Background children that kept the pipe get EPIPE
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+
+    result.cancelled = running->cancelled.load();
+    result.duration_ms = elapsed_ms(start);
+    LOG_DEBUG("[Process] %s: pid %d finished in %lldms (exit=%d signal=%d%s%s, %zu bytes)",
+              argv[0].c_str(), pid, static_cast<long long>(result.duration_ms),
+              result.exit_code, result.term_signal,
+              result.timed_out ? ", timed out" : "", result.cancelled ? ", cancelled" : "",
+              result.output.size());
+    return result;
+}
+
+size_t ProcessRunner::cancel(const std::string& cancel_key) {
+    std::lock_guard<std::mutex> lock(running_mutex());
+    std::pair<RunningMap::iterator, RunningMap::iterator> range = running_map().equal_range(cancel_key);
+    size_t killed = 0;
+    for (RunningMap::iterator it = range.first; it != range.second; ++it) {
+        it->second->cancelled.store(true);
+        if (kill(-it->second->pgid, SIGKILL) == 0) {
+            ++killed;
+        }
+    }
+    if (killed > 0) {
+        LOG_INFO("[Process] Cancelled %zu process(es) for [%s]", killed, cancel_key.c_str());
+    }
+    return killed;
+}
+
+size_t ProcessRunner::running() {
+    std::lock_guard<std::mutex> lock(running_mutex());
+    return running_map().size();
+}
+
+} // namespace opencrank
@@ -38,6 +38,29 @@ RateLimitResult TokenBucketLimiter::try_acquire() {
     return RateLimitResult::deny(wait_ms, max_tokens_);
 }
 
+RateLimitResult TokenBucketLimiter::reserve() {
+    refill();
+    tokens_ -= 1.0;
+    if (tokens_ >= 0.0) {
+        return RateLimitResult::allow(static_cast<int>(tokens_), max_tokens_);
+    }
+    // In debt: the token is ours once the bucket is back at zero
+    int64_t wait_ms = refill_rate_ > 0.0 ? static_cast<int64_t>((-tokens_ / refill_rate_) * 1000) : 0;
+    return RateLimitResult::deny(wait_ms, max_tokens_);
+}
+
+void TokenBucketLimiter::set_rate(int max_tokens, double refill_rate_per_second) {
+    refill();
+    max_tokens_ = max_tokens;
+    refill_rate_ = refill_rate_per_second;
+    tokens_ = std::min(static_cast<double>(max_tokens_), tokens_);
+}
+
+void TokenBucketLimiter::limit_to(int tokens) {
+    refill();
+    tokens_ = std::min(static_cast<double>(tokens), tokens_);
+}
+
 bool TokenBucketLimiter::would_allow() const {
     // Create a copy to check without modifying state
     TokenBucketLimiter copy = *this;
@@ -106,102 +129,302 @@ KeyedRateLimiter::KeyedRateLimiter(LimiterType type, int limit, int window_or_ra
     , limit_(limit)
     , window_or_rate_(window_or_rate) {}
 
+KeyedRateLimiter::Shard& KeyedRateLimiter::shard_for(const std::string& key) {
+    return shards_[std::hash<std::string>()(key) % SHARDS];
+}
+
 RateLimitResult KeyedRateLimiter::check(const std::string& key) {
-    last_activity_[key] = current_timestamp();
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return check_locked(shard, key, current_timestamp_ms());
+}
+
+std::vector<RateLimitResult> KeyedRateLimiter::check_many(const std::vector<std::string>& keys) {
+    std::vector<RateLimitResult> results(keys.size());
     
-    if (type_ == TOKEN_BUCKET) {
-        auto [it, inserted] = token_limiters_.try_emplace(key, limit_, window_or_rate_);
-        return it->second.try_acquire();
-    } else {
-        auto [it, inserted] = window_limiters_.try_emplace(key, limit_, window_or_rate_);
-        return it->second.try_acquire();
+    // Bucket indices by shard so each lock is taken once
+    std::vector<size_t> by_shard[SHARDS];
+    for (size_t i = 0; i < keys.size(); ++i) {
+        by_shard[std::hash<std::string>()(keys[i]) % SHARDS].push_back(i);
+    }
+    
+    int64_t now = current_timestamp_ms();
+    for (size_t s = 0; s < SHARDS; ++s) {
+        if (by_shard[s].empty()) continue;
+        Shard& shard = shards_[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (size_t k = 0; k < by_shard[s].size(); ++k) {
+            size_t i = by_shard[s][k];
+            results[i] = check_locked(shard, keys[i], now);
+        }
     }
+    return results;
 }
 
-void KeyedRateLimiter::reset(const std::string& key) {
+RateLimitResult KeyedRateLimiter::check_locked(Shard& shard, const std::string& key, int64_t now) {
+    std::unordered_map<std::string, KeyState>::iterator it = shard.keys.find(key);
+    if (it == shard.keys.end()) {
+        KeyState fresh;
+        fresh.tokens = static_cast<double>(limit_);
+        fresh.refill_ms = now;
+        fresh.window_start_ms = now;
+        fresh.prev_count = 0;
+        fresh.curr_count = 0;
+        fresh.last_active_ms = now;
+        fresh.tick = -1;
+        it = shard.keys.insert(std::make_pair(key, fresh)).first;
+    }
+    KeyState& state = it->second;
+    touch_locked(shard, it->first, state, now);
+    
     if (type_ == TOKEN_BUCKET) {
-        token_limiters_.erase(key);
+        int64_t elapsed = now - state.refill_ms;
+        if (elapsed > 0) {
+            state.tokens = std::min(static_cast<double>(limit_),
+                                    state.tokens + (elapsed / 1000.0) * window_or_rate_);
+            state.refill_ms = now;
+        }
+        if (state.tokens >= 1.0) {
+            state.tokens -= 1.0;
+            return RateLimitResult::allow(static_cast<int>(state.tokens), limit_);
+        }
+        int64_t wait_ms = static_cast<int64_t>(((1.0 - state.tokens) / window_or_rate_) * 1000);
+        return RateLimitResult::deny(std::max(wait_ms, static_cast<int64_t>(1)), limit_);
+    }
+    
+    // Sliding window: roll the fixed windows forward
+    int64_t window_ms = static_cast<int64_t>(window_or_rate_) * 1000;
+    if (window_ms <= 0) window_ms = 1000;
+    int64_t since = now - state.window_start_ms;
+    if (since >= window_ms) {
+        state.prev_count = since < 2 * window_ms ? state.curr_count : 0;
+        state.curr_count = 0;
+        state.window_start_ms += (since / window_ms) * window_ms;
+        since = now - state.window_start_ms;
+    }
+    
+    double prev_weight = static_cast<double>(window_ms - since) / window_ms;
+    double estimate = state.prev_count * prev_weight + state.curr_count;
+    if (estimate + 1.0 <= limit_) {
+        state.curr_count++;
+        return RateLimitResult::allow(static_cast<int>(limit_ - estimate - 1.0), limit_);
+    }
+    
+    // Time until the estimate drops enough to admit one more request
+    int64_t wait_ms;
+    if (state.curr_count + 1 <= limit_ && state.prev_count > 0) {
+        double needed = 1.0 - static_cast<double>(limit_ - 1 - state.curr_count) / state.prev_count;
+        wait_ms = static_cast<int64_t>(needed * window_ms) - since;
     } else {
-        window_limiters_.erase(key);
+        // Not before the next window, where this window becomes "previous"
+        double needed = state.curr_count > 0
+            ? 1.0 - static_cast<double>(limit_ - 1) / state.curr_count : 0.0;
+        wait_ms = (window_ms - since) + static_cast<int64_t>(std::max(needed, 0.0) * window_ms);
     }
-    last_activity_.erase(key);
+    return RateLimitResult::deny(std::max(wait_ms, static_cast<int64_t>(1)), limit_);
 }
 
-void KeyedRateLimiter::reset_all() {
-    token_limiters_.clear();
-    window_limiters_.clear();
-    last_activity_.clear();
+void KeyedRateLimiter::touch_locked(Shard& shard, const std::string& key, KeyState& state, int64_t now) {
+    state.last_active_ms = now;
+    int64_t tick = now / WHEEL_TICK_MS;
+    if (state.tick == tick) return;
+    
+    WheelSlot& slot = shard.wheel[tick % WHEEL_SLOTS];
+    if (slot.tick != tick) {
+        // The slot last held keys from a full revolution ago. Those still
+        // filed there outlived the wheel span; carry them into this tick.
+        std::vector<std::string> carried;
+        for (size_t i = 0; i < slot.keys.size(); ++i) {
+            std::unordered_map<std::string, KeyState>::iterator it = shard.keys.find(slot.keys[i]);
+            if (it != shard.keys.end() && it->second.tick == slot.tick) {
+                it->second.tick = tick;
+                carried.push_back(slot.keys[i]);
+            }
+        }
+        slot.keys.swap(carried);
+        slot.tick = tick;
+        if (state.tick == tick) return;   // Was carried along
+    }
+    slot.keys.push_back(key);
+    state.tick = tick;
 }
 
-size_t KeyedRateLimiter::cleanup(int64_t max_age_seconds) {
-    int64_t now = current_timestamp();
+size_t KeyedRateLimiter::expire_locked(Shard& shard, int64_t cutoff_ms) {
     size_t removed = 0;
-    
-    std::vector<std::string> to_remove;
-    for (std::map<std::string, int64_t>::iterator it = last_activity_.begin();
-         it != last_activity_.end(); ++it) {
-        if (now - it->second > max_age_seconds) {
-            to_remove.push_back(it->first);
+    for (size_t s = 0; s < WHEEL_SLOTS; ++s) {
+        WheelSlot& slot = shard.wheel[s];
+        if (slot.tick < 0 || slot.keys.empty()) continue;
+        // Only slots that ended before the cutoff hold nothing but idle keys
+        if ((slot.tick + 1) * WHEEL_TICK_MS > cutoff_ms) continue;
+        
+        for (size_t i = 0; i < slot.keys.size(); ++i) {
+            std::unordered_map<std::string, KeyState>::iterator it = shard.keys.find(slot.keys[i]);
+            // Keys touched later were re-filed under a newer tick
+            if (it != shard.keys.end() && it->second.tick == slot.tick) {
+                shard.keys.erase(it);
+                ++removed;
+            }
         }
+        slot.keys.clear();
+        slot.tick = -1;
     }
-    
-    for (size_t i = 0; i < to_remove.size(); ++i) {
-        reset(to_remove[i]);
-        ++removed;
+    return removed;
+}
+
+void KeyedRateLimiter::reset(const std::string& key) {
+    // Stale wheel entries are skipped (tick mismatch or missing key)
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.keys.erase(key);
+}
+
+void KeyedRateLimiter::reset_all() {
+    for (size_t s = 0; s < SHARDS; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        shards_[s].keys.clear();
+        for (size_t i = 0; i < WHEEL_SLOTS; ++i) {
+            shards_[s].wheel[i].keys.clear();
+            shards_[s].wheel[i].tick = -1;
+        }
+    }
+}
+
+size_t KeyedRateLimiter::cleanup(int64_t max_age_seconds) {
+    int64_t cutoff = current_timestamp_ms() - max_age_seconds * 1000;
+    size_t removed = 0;
+    for (size_t s = 0; s < SHARDS; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        removed += expire_locked(shards_[s], cutoff);
     }
-    
     return removed;
 }
 
 size_t KeyedRateLimiter::key_count() const {
-    if (type_ == TOKEN_BUCKET) {
-        return token_limiters_.size();
-    } else {
-        return window_limiters_.size();
+    size_t total = 0;
+    for (size_t s = 0; s < SHARDS; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        total += shards_[s].keys.size();
     }
+    return total;
 }
 
 // ============ TypingIndicator ============
 
 TypingIndicator::TypingIndicator()
-    : interval_ms_(5000) {}
+    : interval_ms_(5000)
+    , sent_(0)
+    , flush_scheduled_(false) {}
+
+void TypingIndicator::set_sender(const Sender& sender, const Executor& executor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sender_ = sender;
+    executor_ = executor;
+}
 
-void TypingIndicator::start_typing(const std::string& chat_id) {
-    is_typing_[chat_id] = true;
+void TypingIndicator::start_typing(const std::string& channel_id, const std::string& chat_id) {
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ChatKey key(channel_id, chat_id);
+        ChatState& state = chats_[key];
+        state.holders++;
+        
+        int64_t now = current_timestamp_ms();
+        if (state.holders == 1 || now - state.last_sent_ms >= interval_ms_) {
+            state.last_sent_ms = now;
+            schedule = queue_locked(key, true);
+        }
+    }
+    if (schedule) dispatch();
 }
 
-void TypingIndicator::stop_typing(const std::string& chat_id) {
-    is_typing_[chat_id] = false;
+void TypingIndicator::stop_typing(const std::string& channel_id, const std::string& chat_id) {
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ChatKey key(channel_id, chat_id);
+        std::map<ChatKey, ChatState>::iterator it = chats_.find(key);
+        if (it == chats_.end()) {
+            return;
+        }
+        if (--it->second.holders <= 0) {
+            chats_.erase(it);
+            schedule = queue_locked(key, false);
+        }
+    }
+    if (schedule) dispatch();
 }
 
-bool TypingIndicator::should_send_typing(const std::string& chat_id) {
-    // Check if typing is active
-    std::map<std::string, bool>::iterator typing_it = is_typing_.find(chat_id);
-    if (typing_it == is_typing_.end() || !typing_it->second) {
-        return false;
+void TypingIndicator::refresh(const std::string& channel_id, const std::string& chat_id) {
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ChatKey key(channel_id, chat_id);
+        std::map<ChatKey, ChatState>::iterator it = chats_.find(key);
+        if (it == chats_.end()) {
+            return;
+        }
+        
+        int64_t now = current_timestamp_ms();
+        if (now - it->second.last_sent_ms >= interval_ms_) {
+            it->second.last_sent_ms = now;
+            schedule = queue_locked(key, true);
+        }
     }
-    
-    // Check if enough time has passed since last send
-    int64_t now = current_timestamp_ms();
-    std::map<std::string, int64_t>::iterator last_it = last_typing_.find(chat_id);
-    
-    if (last_it == last_typing_.end() || now - last_it->second >= interval_ms_) {
-        last_typing_[chat_id] = now;
-        return true;
+    if (schedule) dispatch();
+}
+
+bool TypingIndicator::queue_locked(const ChatKey& key, bool typing) {
+    Batch& batch = pending_[key.first];
+    if (typing) {
+        batch.stop.erase(key.second);
+        batch.start.insert(key.second);
+    } else {
+        batch.start.erase(key.second);
+        batch.stop.insert(key.second);
     }
     
-    return false;
+    if (flush_scheduled_ || !sender_) {
+        return false;
+    }
+    flush_scheduled_ = true;
+    return true;
 }
 
-std::vector<std::string> TypingIndicator::active_chats() const {
-    std::vector<std::string> chats;
-    for (std::map<std::string, bool>::const_iterator it = is_typing_.begin();
-         it != is_typing_.end(); ++it) {
-        if (it->second) {
-            chats.push_back(it->first);
+void TypingIndicator::dispatch() {
+    Executor executor;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        executor = executor_;
+    }
+    if (executor) {
+        executor([this]() { flush(); });
+    } else {
+        flush();
+    }
+}
+
+void TypingIndicator::flush() {
+    std::map<std::string, Batch> batches;
+    Sender sender;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches.swap(pending_);
+        flush_scheduled_ = false;
+        sender = sender_;
+    }
+    
+    for (std::map<std::string, Batch>::iterator it = batches.begin(); it != batches.end(); ++it) {
+        if (!it->second.start.empty()) {
+            std::vector<std::string> chats(it->second.start.begin(), it->second.start.end());
+            sent_.fetch_add(chats.size());
+            sender(it->first, chats, true);
+        }
+        if (!it->second.stop.empty()) {
+            std::vector<std::string> chats(it->second.stop.begin(), it->second.stop.end());
+            sender(it->first, chats, false);
         }
     }
-    return chats;
 }
 
 // ============ HeartbeatManager ============
@@ -273,37 +496,203 @@ std::vector<std::string> HeartbeatManager::unhealthy_targets() const {
 
 // ============ MessageDebouncer ============
 
-MessageDebouncer::MessageDebouncer(int window_seconds)
-    : window_seconds_(window_seconds) {}
+namespace {
+// Spread std::hash output (identity for some inputs) over all 64 bits
+uint64_t fingerprint_of(const std::string& id) {
+    uint64_t h = static_cast<uint64_t>(std::hash<std::string>()(id));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+} // namespace
+
+const uint32_t MessageDebouncer::EMPTY;
+
+MessageDebouncer::MessageDebouncer(int window_seconds, size_t max_entries)
+    : window_ms_(static_cast<int64_t>(window_seconds) * 1000)
+    , head_(0)
+    , tail_(0)
+    , count_(0)
+    , bloom_current_(0)
+    , bloom_rotated_ms_(0)
+    , duplicates_(0)
+    , evictions_(0) {
+    set_capacity(max_entries);
+}
+
+void MessageDebouncer::set_window(int seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    window_ms_ = static_cast<int64_t>(seconds) * 1000;
+}
+
+void MessageDebouncer::set_capacity(size_t max_entries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_entries == 0) max_entries = 1;
+    
+    size_t slots = 1;
+    while (slots < max_entries * 2) slots <<= 1;   // Load factor <= 0.5
+    
+    ring_.assign(max_entries, Entry());
+    index_.assign(slots, EMPTY);
+    head_ = tail_ = count_ = 0;
+}
+
+void MessageDebouncer::set_bloom_bits(size_t bits) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t words = (bits + 63) / 64;
+    bloom_[0].assign(words, 0);
+    bloom_[1].assign(words, 0);
+    bloom_current_ = 0;
+    bloom_rotated_ms_ = current_timestamp_ms();
+}
 
 bool MessageDebouncer::should_process(const std::string& message_id) {
-    cleanup();
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = current_timestamp_ms();
+    expire_locked(now);
     
-    if (seen_messages_.find(message_id) != seen_messages_.end()) {
-        return false;  // Duplicate
+    uint64_t fp = fingerprint_of(message_id);
+    if (bloom_[0].empty() || bloom_maybe_locked(fp)) {
+        if (index_[find_slot_locked(fp)] != EMPTY) {
+            duplicates_++;
+            return false;  // Duplicate
+        }
     }
     
-    seen_messages_[message_id] = current_timestamp();
+    insert_locked(fp, now);
     return true;
 }
 
+std::vector<std::pair<uint64_t, int64_t> > MessageDebouncer::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::pair<uint64_t, int64_t> > entries;
+    entries.reserve(count_);
+    for (size_t i = 0, pos = tail_; i < count_; ++i, pos = (pos + 1) % ring_.size()) {
+        entries.push_back(std::make_pair(ring_[pos].fingerprint, ring_[pos].seen_ms));
+    }
+    return entries;
+}
+
+void MessageDebouncer::restore(const std::vector<std::pair<uint64_t, int64_t> >& entries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t cutoff = current_timestamp_ms() - window_ms_;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].second < cutoff) continue;
+        if (index_[find_slot_locked(entries[i].first)] != EMPTY) continue;
+        insert_locked(entries[i].first, entries[i].second);
+    }
+}
+
+void MessageDebouncer::insert_locked(uint64_t fingerprint, int64_t seen_ms) {
+    if (count_ == ring_.size()) {
+        pop_oldest_locked();
+        evictions_++;
+    }
+    size_t pos = head_;
+    ring_[pos].fingerprint = fingerprint;
+    ring_[pos].seen_ms = seen_ms;
+    head_ = (head_ + 1) % ring_.size();
+    count_++;
+    index_[find_slot_locked(fingerprint)] = static_cast<uint32_t>(pos);
+    
+    if (!bloom_[0].empty()) bloom_add_locked(fingerprint, seen_ms);
+}
+
 void MessageDebouncer::cleanup() {
-    int64_t now = current_timestamp();
-    int64_t cutoff = now - window_seconds_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    expire_locked(current_timestamp_ms());
+}
+
+void MessageDebouncer::expire_locked(int64_t now) {
+    int64_t cutoff = now - window_ms_;
+    while (count_ > 0 && ring_[tail_].seen_ms < cutoff) {
+        pop_oldest_locked();
+    }
+}
+
+void MessageDebouncer::pop_oldest_locked() {
+    erase_index_locked(ring_[tail_].fingerprint);
+    tail_ = (tail_ + 1) % ring_.size();
+    count_--;
+}
+
+size_t MessageDebouncer::find_slot_locked(uint64_t fingerprint) const {
+    size_t mask = index_.size() - 1;
+    size_t i = static_cast<size_t>(fingerprint) & mask;
+    while (index_[i] != EMPTY && ring_[index_[i]].fingerprint != fingerprint) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void MessageDebouncer::erase_index_locked(uint64_t fingerprint) {
+    size_t mask = index_.size() - 1;
+    size_t i = find_slot_locked(fingerprint);
+    if (index_[i] == EMPTY) return;
     
-    std::vector<std::string> to_remove;
-    for (std::map<std::string, int64_t>::iterator it = seen_messages_.begin();
-         it != seen_messages_.end(); ++it) {
-        if (it->second < cutoff) {
-            to_remove.push_back(it->first);
+    // Backward-shift deletion keeps probe chains unbroken without tombstones
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (index_[j] == EMPTY) break;
+        size_t home = static_cast<size_t>(ring_[index_[j]].fingerprint) & mask;
+        bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            index_[i] = index_[j];
+            i = j;
         }
     }
-    
-    for (size_t i = 0; i < to_remove.size(); ++i) {
-        seen_messages_.erase(to_remove[i]);
+    index_[i] = EMPTY;
+}
+
+bool MessageDebouncer::bloom_maybe_locked(uint64_t fingerprint) const {
+    size_t bits = bloom_[0].size() * 64;
+    uint64_t h2 = (fingerprint >> 32) | 1;
+    for (size_t g = 0; g < 2; ++g) {
+        bool all = true;
+        for (uint64_t k = 0; k < 3 && all; ++k) {
+            size_t bit = static_cast<size_t>((fingerprint + k * h2) % bits);
+            all = (bloom_[g][bit / 64] >> (bit % 64)) & 1;
+        }
+        if (all) return true;
+    }
+    return false;
+}
+
+void MessageDebouncer::bloom_add_locked(uint64_t fingerprint, int64_t now) {
+    // Rotate once per window: an ID stays in one of the two generations
+    // for at least a full window, so the filter never hides a duplicate
+    if (now - bloom_rotated_ms_ >= window_ms_) {
+        bloom_current_ ^= 1;
+        std::fill(bloom_[bloom_current_].begin(), bloom_[bloom_current_].end(), 0);
+        bloom_rotated_ms_ = now;
+    }
+    size_t bits = bloom_[0].size() * 64;
+    uint64_t h2 = (fingerprint >> 32) | 1;
+    for (uint64_t k = 0; k < 3; ++k) {
+        size_t bit = static_cast<size_t>((fingerprint + k * h2) % bits);
+        bloom_[bloom_current_][bit / 64] |= uint64_t(1) << (bit % 64);
     }
 }
 
+uint64_t MessageDebouncer::duplicates() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return duplicates_;
+}
+
+uint64_t MessageDebouncer::evictions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return evictions_;
+}
+
+size_t MessageDebouncer::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
 // ============ Throttler ============
 
 Throttler::Throttler(int min_interval_ms)
@@ -0,0 +1,244 @@
+/*
+ * OpenCrank C++ - Event Reactor Implementation
+ */
+#include <opencrank/core/reactor.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace opencrank {
+
+namespace {
+const int MAX_EVENTS = 64;
+}
+
+Reactor::Reactor()
+    : epoll_fd_(-1)
+    , wake_fd_(-1)
+    , stop_(false)
+    , wakeups_(0)
+    , next_timer_id_(1) {}
+
+Reactor::~Reactor() {
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+bool Reactor::init() {
+    if (epoll_fd_ >= 0) return true;
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_ERROR("[Reactor] epoll_create1 failed: %s", strerror(errno));
+        return false;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        LOG_ERROR("[Reactor] eventfd failed: %s", strerror(errno));
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0) {
+        LOG_ERROR("[Reactor] Cannot watch wake fd: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// File descriptors
+// ============================================================================
+
+bool Reactor::add_fd(int fd, uint32_t events, FdCallback callback) {
+    if (epoll_fd_ < 0 || fd < 0 || !callback) return false;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    int op = fds_.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epoll_fd_, op, fd, &ev) < 0) {
+        LOG_WARN("[Reactor] epoll_ctl(fd=%d) failed: %s", fd, strerror(errno));
+        return false;
+    }
+    fds_[fd] = std::make_shared<FdCallback>(callback);
+    return true;
+}
+
+bool Reactor::modify_fd(int fd, uint32_t events) {
+    if (!fds_.count(fd)) return false;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void Reactor::remove_fd(int fd) {
+    if (fds_.erase(fd) == 0) return;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// ============================================================================
+// Timers
+// ============================================================================
+
+Reactor::TimerId Reactor::add_timer(int delay_ms, Task callback, bool repeat) {
+    if (delay_ms < 0) delay_ms = 0;
+
+    Timer timer;
+    timer.id = next_timer_id_++;
+    timer.interval_ms = delay_ms;
+    timer.repeat = repeat && delay_ms > 0;
+    timer.callback = callback;
+
+    int64_t due = current_timestamp_ms() + delay_ms;
+    timers_.insert(std::make_pair(due, timer));
+    timer_due_[timer.id] = due;
+    return timer.id;
+}
+
+void Reactor::cancel_timer(TimerId id) {
+    std::map<TimerId, int64_t>::iterator due = timer_due_.find(id);
+    if (due == timer_due_.end()) return;
+
+    std::pair<std::multimap<int64_t, Timer>::iterator,
+              std::multimap<int64_t, Timer>::iterator> range = timers_.equal_range(due->second);
+    for (std::multimap<int64_t, Timer>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second.id == id) {
+            timers_.erase(it);
+            break;
+        }
+    }
+    timer_due_.erase(due);
+}
+
+int Reactor::next_timer_wait(int64_t now) const {
+    if (timers_.empty()) return -1;
+    int64_t wait = timers_.begin()->first - now;
+    if (wait < 0) return 0;
+    return wait > 60000 ? 60000 : static_cast<int>(wait);
+}
+
+int Reactor::run_due_timers(int64_t now) {
+    int ran = 0;
+    while (!timers_.empty() && timers_.begin()->first <= now) {
+        Timer timer = timers_.begin()->second;
+        timers_.erase(timers_.begin());
+
+        if (timer.repeat) {
+            // Reschedule first so the callback may cancel itself
+            int64_t due = now + timer.interval_ms;
+            timers_.insert(std::make_pair(due, timer));
+            timer_due_[timer.id] = due;
+        } else {
+            timer_due_.erase(timer.id);
+        }
+
+        timer.callback();
+        ran++;
+    }
+    return ran;
+}
+
+// ============================================================================
+// Cross-thread wakeups
+// ============================================================================
+
+void Reactor::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted_.push_back(task);
+    }
+    wake();
+}
+
+void Reactor::wake() {
+    if (wake_fd_ < 0) return;
+    uint64_t one = 1;
+    ssize_t n = write(wake_fd_, &one, sizeof(one));
+    (void)n;  // EAGAIN = counter saturated, already pending
+}
+
+void Reactor::drain_wake_fd() {
+    uint64_t value;
+    while (read(wake_fd_, &value, sizeof(value)) > 0) {}
+}
+
+int Reactor::run_posted() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        tasks.swap(posted_);
+    }
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        tasks[i]();
+    }
+    return static_cast<int>(tasks.size());
+}
+
+void Reactor::stop() {
+    stop_.store(true);
+    wake();
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+int Reactor::run_once(int max_wait_ms) {
+    if (epoll_fd_ < 0) return 0;
+
+    int wait = next_timer_wait(current_timestamp_ms());
+    if (max_wait_ms >= 0 && (wait < 0 || wait > max_wait_ms)) wait = max_wait_ms;
+
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, wait);
+    if (n < 0) {
+        if (errno != EINTR) {
+            LOG_WARN("[Reactor] epoll_wait failed: %s", strerror(errno));
+        }
+        n = 0;
+    }
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
+
+    int ran = 0;
+    for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == wake_fd_) {
+            drain_wake_fd();
+            continue;
+        }
+        // Copy: the callback may remove (or re-add) its own fd
+        std::map<int, std::shared_ptr<FdCallback> >::iterator it = fds_.find(fd);
+        if (it == fds_.end()) continue;
+        std::shared_ptr<FdCallback> callback = it->second;
+        (*callback)(events[i].events);
+        ran++;
+    }
+
+    ran += run_posted();
+    ran += run_due_timers(current_timestamp_ms());
+    return ran;
+}
+
+void Reactor::run() {
+    while (!stop_.load()) {
+        run_once();
+    }
+}
+
+} // namespace opencrank
@@ -0,0 +1,324 @@
+/*
+ * OpenCrank C++ - Model Response Cache Implementation
+ */
+#include <opencrank/core/response_cache.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/sqlite_stmt.hpp>
+#include <sqlite3.h>
+#include <cctype>
+
+namespace opencrank {
+
+namespace {
+
+// Whitespace runs become one space, ends trimmed. Case is kept: it
+// matters in code, identifiers and quoted text.
+std::string normalize(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    bool space = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (std::isspace(c)) {
+            space = !out.empty();
+            continue;
+        }
+        if (space) {
+            out += ' ';
+            space = false;
+        }
+        out += static_cast<char>(c);
+    }
+    return out;
+}
+
+// Length-prefixed, so no two field lists serialize alike
+void append_field(std::string& out, const std::string& field) {
+    out += std::to_string(field.size());
+    out += ':';
+    out += field;
+}
+
+} // anonymous namespace
+
+ResponseCache::ResponseCache()
+    : db_(nullptr), hits_(nullptr), semantic_hits_(nullptr), misses_(nullptr), stores_(nullptr) {}
+
+ResponseCache::~ResponseCache() {
+    close();
+}
+
+bool ResponseCache::open(const std::string& db_path, const ResponseCacheConfig& config) {
+    close();
+    config_ = config;
+    if (config_.max_entries == 0) config_.max_entries = 1;
+    if (config_.semantic) {
+        embedder_.configure(config_.embeddings);
+        if (!embedder_.enabled()) {
+            LOG_WARN("[ResponseCache] Semantic tier needs an embedding URL; exact matches only");
+            config_.semantic = false;
+        }
+    }
+
+    if (!create_parent_directory(db_path)) {
+        LOG_ERROR("[ResponseCache] Failed to create parent directory for '%s'", db_path.c_str());
+        return false;
+    }
+    sqlite3* db = nullptr;
+    if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
+        LOG_ERROR("[ResponseCache] Failed to open database '%s': %s", db_path.c_str(), sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+    char* err = nullptr;
+    if (sqlite3_exec(db,
+            "PRAGMA journal_mode=WAL;"
+            "PRAGMA synchronous=NORMAL;"
+            "PRAGMA busy_timeout=5000;"
+            "CREATE TABLE IF NOT EXISTS response_cache ("
+            "  key TEXT PRIMARY KEY,"
+            "  context TEXT NOT NULL,"
+            "  content TEXT NOT NULL,"
+            "  embedding BLOB,"
+            "  expires_ms INTEGER NOT NULL"
+            ") WITHOUT ROWID", nullptr, nullptr, &err) != SQLITE_OK) {
+        LOG_ERROR("[ResponseCache] SQL error: %s", err ? err : "unknown");
+        if (err) sqlite3_free(err);
+        sqlite3_close(db);
+        return false;
+    }
+
+    int64_t now = current_timestamp_ms();
+    {
+        SqliteStatement prune(db, "DELETE FROM response_cache WHERE expires_ms < ?");
+        if (prune.ok()) {
+            prune.bind(1, now);
+            prune.done();
+        }
+    }
+
+    // Newest last, so they end up at the front of the LRU
+    std::lock_guard<std::mutex> lock(mutex_);
+    SqliteStatement load(db, "SELECT key, context, content, embedding, expires_ms FROM "
+                             "(SELECT * FROM response_cache ORDER BY expires_ms DESC LIMIT ?) "
+                             "ORDER BY expires_ms ASC");
+    if (load.ok()) {
+        load.bind(1, static_cast<int64_t>(config_.max_entries));
+        while (load.row()) {
+            Entry entry;
+            entry.key = load.text(0);
+            entry.context = load.text(1);
+            entry.content = load.text(2);
+            if (config_.semantic) {
+                const void* blob = sqlite3_column_blob(load.get(), 3);
+                int bytes = sqlite3_column_bytes(load.get(), 3);
+                if (blob && bytes > 0) {
+                    entry.vector = decode_embedding(blob, static_cast<size_t>(bytes));
+                }
+            }
+            entry.expires_ms = load.integer(4);
+            insert_locked(entry);
+        }
+    }
+    db_ = db;
+
+    Metrics& metrics = Metrics::instance();
+    const char* help = "Response cache lookups and stores";
+    hits_ = &metrics.counter("opencrank_response_cache_total", help, metric_labels("result", "hit"));
+    semantic_hits_ = &metrics.counter("opencrank_response_cache_total", help, metric_labels("result", "semantic_hit"));
+    misses_ = &metrics.counter("opencrank_response_cache_total", help, metric_labels("result", "miss"));
+    stores_ = &metrics.counter("opencrank_response_cache_total", help, metric_labels("result", "store"));
+
+    LOG_INFO("[ResponseCache] %s: %zu entries, ttl %llds, key over %zu messages%s",
+             db_path.c_str(), lru_.size(), static_cast<long long>(config_.ttl_s),
+             config_.messages, config_.semantic ? ", semantic tier on" : "");
+    return true;
+}
+
+void ResponseCache::close() {
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (db_) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+    }
+    lru_.clear();
+    index_.clear();
+    by_context_.clear();
+}
+
+ResponseCache::Key ResponseCache::make_key(const std::string& scope, const std::string& system_prompt,
+                                           const std::vector<ConversationMessage>& history) const {
+    Key key;
+    std::string material = "v1\n";
+    append_field(material, scope);
+    append_field(material, normalize(system_prompt));
+
+    size_t n = config_.messages > 0 ? config_.messages : history.size();
+    size_t first = history.size() > n ? history.size() - n : 0;
+    size_t last = history.size();
+    // The semantic tier matches a fresh user question, not a tool result
+    if (last > first && history[last - 1].role == MessageRole::USER &&
+        history[last - 1].content.compare(0, 12, "[TOOL_RESULT") != 0) {
+        --last;
+        key.query = normalize(history[last].content);
+    }
+    for (size_t i = first; i < last; ++i) {
+        append_field(material, role_to_string(history[i].role));
+        append_field(material, normalize(history[i].content));
+    }
+    key.context = sha256_hex(material);
+    if (!key.query.empty()) {
+        append_field(material, "user");
+        append_field(material, key.query);
+    }
+    key.exact = sha256_hex(material);
+    return key;
+}
+
+bool ResponseCache::lookup(Key& key, std::string& content) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, Lru::iterator>::iterator it = index_.find(key.exact);
+        if (it != index_.end()) {
+            if (it->second->expires_ms < current_timestamp_ms()) {
+                remove_locked(it->second);
+            } else {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                content = it->second->content;
+                hits_->inc();
+                return true;
+            }
+        }
+    }
+    if (config_.semantic && !key.query.empty() && semantic_lookup(key, content)) {
+        semantic_hits_->inc();
+        return true;
+    }
+    misses_->inc();
+    return false;
+}
+
+bool ResponseCache::semantic_lookup(Key& key, std::string& content) {
+    {
+        // Nothing to compare against: skip the embedding request
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (by_context_.find(key.context) == by_context_.end()) return false;
+    }
+    std::string error;
+    if (key.vector.empty() && !embedder_.embed(key.query, key.vector, &error)) {
+        LOG_DEBUG("[ResponseCache] Embedding failed: %s", error.c_str());
+        key.vector.clear();
+        return false;
+    }
+    normalize_vector(key.vector);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = current_timestamp_ms();
+    Lru::iterator best = lru_.end();
+    float best_score = static_cast<float>(config_.similarity);
+    typedef std::multimap<std::string, Lru::iterator>::iterator ContextIter;
+    std::pair<ContextIter, ContextIter> range = by_context_.equal_range(key.context);
+    for (ContextIter c = range.first; c != range.second; ++c) {
+        const Entry& entry = *c->second;
+        if (entry.expires_ms < now || entry.vector.size() != key.vector.size()) continue;
+        float score = dot_product(entry.vector.data(), key.vector.data(), key.vector.size());
+        if (score >= best_score) {
+            best_score = score;
+            best = c->second;
+        }
+    }
+    if (best == lru_.end()) return false;
+    LOG_DEBUG("[ResponseCache] Semantic hit (similarity %.3f)", best_score);
+    lru_.splice(lru_.begin(), lru_, best);
+    content = best->content;
+    return true;
+}
+
+void ResponseCache::store(Key& key, const std::string& content) {
+    if (!enabled() || content.empty()) return;
+    if (config_.semantic && !key.query.empty() && key.vector.empty()) {
+        std::string error;
+        if (embedder_.embed(key.query, key.vector, &error)) {
+            normalize_vector(key.vector);
+        } else {
+            key.vector.clear();
+        }
+    }
+
+    Entry entry;
+    entry.key = key.exact;
+    entry.context = key.context;
+    entry.content = content;
+    entry.vector = key.vector;
+    entry.expires_ms = current_timestamp_ms() + config_.ttl_s * 1000;
+
+    std::vector<std::string> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        insert_locked(entry);
+        while (lru_.size() > config_.max_entries) {
+            evicted.push_back(lru_.back().key);
+            remove_locked(--lru_.end());
+        }
+    }
+    stores_->inc();
+
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    if (!db_) return;
+    SqliteStatement insert(db_, "INSERT OR REPLACE INTO response_cache (key, context, content, embedding, expires_ms) "
+                                "VALUES (?, ?, ?, ?, ?)");
+    if (insert.ok()) {
+        insert.bind(1, entry.key);
+        insert.bind(2, entry.context);
+        insert.bind(3, entry.content);
+        if (!entry.vector.empty()) {
+            insert.bind_blob(4, encode_embedding(entry.vector));
+        }
+        insert.bind(5, entry.expires_ms);
+        if (!insert.done()) {
+            LOG_WARN("[ResponseCache] Insert failed: %s", sqlite3_errmsg(db_));
+        }
+    }
+    for (size_t i = 0; i < evicted.size(); ++i) {
+        SqliteStatement remove(db_, "DELETE FROM response_cache WHERE key = ?");
+        if (remove.ok()) {
+            remove.bind(1, evicted[i]);
+            remove.done();
+        }
+    }
+}
+
+size_t ResponseCache::entries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+void ResponseCache::insert_locked(const Entry& entry) {
+    std::map<std::string, Lru::iterator>::iterator old = index_.find(entry.key);
+    if (old != index_.end()) {
+        remove_locked(old->second);
+    }
+    lru_.push_front(entry);
+    index_[entry.key] = lru_.begin();
+    if (!entry.vector.empty()) {
+        by_context_.insert(std::make_pair(entry.context, lru_.begin()));
+    }
+}
+
+void ResponseCache::remove_locked(Lru::iterator it) {
+    typedef std::multimap<std::string, Lru::iterator>::iterator ContextIter;
+    std::pair<ContextIter, ContextIter> range = by_context_.equal_range(it->context);
+    for (ContextIter c = range.first; c != range.second; ++c) {
+        if (c->second == it) {
+            by_context_.erase(c);
+            break;
+        }
+    }
+    index_.erase(it->key);
+    lru_.erase(it);
+}
+
+} // namespace opencrank
@@ -0,0 +1,384 @@
+/*
+ * OpenCrank C++ - Agent Run Recording Implementation
+ */
+#include <opencrank/core/run_record.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace opencrank {
+
+namespace {
+
+const int kFormatVersion = 1;
+
+// Empty strings and false flags are left out to keep files small
+void put(Json& j, const char* key, const std::string& value) {
+    if (!value.empty()) j[key] = value;
+}
+
+void put(Json& j, const char* key, bool value) {
+    if (value) j[key] = true;
+}
+
+Json config_to_json(const AgentConfig& c) {
+    Json j;
+    j["max_iterations"] = c.max_iterations;
+    j["max_consecutive_errors"] = c.max_consecutive_errors;
+    j["max_tool_result_size"] = c.max_tool_result_size;
+    j["auto_chunk_large_results"] = c.auto_chunk_large_results;
+    j["chunk_size"] = c.chunk_size;
+    j["context_size"] = c.context_size;
+    j["max_parallel_tools"] = c.max_parallel_tools;
+    j["early_tool_start"] = c.early_tool_start;
+    j["native_tools"] = c.native_tools;
+    j["compact_after"] = c.compact_after;
+    j["compact_min_chars"] = c.compact_min_chars;
+    j["temperature"] = c.temperature;
+    return j;
+}
+
+void config_from_json(const Json& j, AgentConfig& c) {
+    c.max_iterations = static_cast<int>(json_utils::get_int(j, "max_iterations", c.max_iterations));
+    c.max_consecutive_errors = static_cast<int>(
+        json_utils::get_int(j, "max_consecutive_errors", c.max_consecutive_errors));
+    c.max_tool_result_size = static_cast<size_t>(
+        json_utils::get_int(j, "max_tool_result_size", static_cast<int64_t>(c.max_tool_result_size)));
+    c.auto_chunk_large_results = json_utils::get_bool(j, "auto_chunk_large_results", c.auto_chunk_large_results);
+    c.chunk_size = static_cast<size_t>(json_utils::get_int(j, "chunk_size", static_cast<int64_t>(c.chunk_size)));
+    c.context_size = static_cast<size_t>(json_utils::get_int(j, "context_size", static_cast<int64_t>(c.context_size)));
+    c.max_parallel_tools = static_cast<int>(json_utils::get_int(j, "max_parallel_tools", c.max_parallel_tools));
+    c.early_tool_start = json_utils::get_bool(j, "early_tool_start", c.early_tool_start);
+    c.native_tools = json_utils::get_bool(j, "native_tools", c.native_tools);
+    c.compact_after = static_cast<int>(json_utils::get_int(j, "compact_after", c.compact_after));
+    c.compact_min_chars = static_cast<size_t>(
+        json_utils::get_int(j, "compact_min_chars", static_cast<int64_t>(c.compact_min_chars)));
+    c.temperature = json_utils::get_double(j, "temperature", c.temperature);
+}
+
+Json tool_to_json(const AgentTool& tool) {
+    Json j;
+    j["name"] = tool.name;
+    put(j, "description", tool.description);
+    put(j, "parallel_safe", tool.parallel_safe);
+    put(j, "memo_store", tool.memo_store);
+    put(j, "writes_store", tool.writes_store);
+    put(j, "path_param", tool.path_param);
+    Json params = Json::array();
+    for (size_t i = 0; i < tool.params.size(); ++i) {
+        const ToolParamSchema& p = tool.params[i];
+        Json pj;
+        pj["name"] = p.name;
+        pj["type"] = p.type;
+        put(pj, "description", p.description);
+        put(pj, "required", p.required);
+        put(pj, "default", p.default_value);
+        params.push_back(pj);
+    }
+    j["params"] = params;
+    return j;
+}
+
+AgentTool tool_from_json(const Json& j) {
+    AgentTool tool;
+    tool.name = json_utils::get_string(j, "name");
+    tool.description = json_utils::get_string(j, "description");
+    tool.parallel_safe = json_utils::get_bool(j, "parallel_safe");
+    tool.memo_store = json_utils::get_string(j, "memo_store");
+    tool.writes_store = json_utils::get_string(j, "writes_store");
+    tool.path_param = json_utils::get_string(j, "path_param");
+    if (j.contains("params") && j["params"].is_array()) {
+        for (const Json& pj : j["params"]) {
+            ToolParamSchema p(json_utils::get_string(pj, "name"), json_utils::get_string(pj, "type"),
+                              json_utils::get_string(pj, "description"), json_utils::get_bool(pj, "required"));
+            p.default_value = json_utils::get_string(pj, "default");
+            tool.params.push_back(p);
+        }
+    }
+    return tool;
+}
+
+Json reply_to_json(const RecordedReply& reply) {
+    const CompletionResult& r = reply.result;
+    Json j;
+    j["ms"] = reply.ms;
+    if (reply.chunks) j["chunks"] = reply.chunks;
+    put(j, "cached", reply.cached);
+    j["success"] = r.success;
+    put(j, "content", r.content);
+    put(j, "error", r.error);
+    put(j, "stop_reason", r.stop_reason);
+    put(j, "model", r.model);
+    j["usage"] = { r.usage.input_tokens, r.usage.output_tokens, r.usage.total_tokens, r.usage.cached_tokens };
+    if (!r.tool_calls.empty()) {
+        Json calls = Json::array();
+        for (size_t i = 0; i < r.tool_calls.size(); ++i) {
+            const ToolCallRequest& call = r.tool_calls[i];
+            Json cj;
+            put(cj, "id", call.id);
+            cj["name"] = call.name;
+            cj["arguments"] = call.raw_arguments.empty() && call.arguments.is_object()
+                ? call.arguments.dump() : call.raw_arguments;
+            calls.push_back(cj);
+        }
+        j["tool_calls"] = calls;
+    }
+    return j;
+}
+
+RecordedReply reply_from_json(const Json& j) {
+    RecordedReply reply;
+    reply.ms = json_utils::get_int(j, "ms");
+    reply.chunks = static_cast<size_t>(json_utils::get_int(j, "chunks"));
+    reply.cached = json_utils::get_bool(j, "cached");
+    CompletionResult& r = reply.result;
+    r.success = json_utils::get_bool(j, "success");
+    r.content = json_utils::get_string(j, "content");
+    r.error = json_utils::get_string(j, "error");
+    r.stop_reason = json_utils::get_string(j, "stop_reason");
+    r.model = json_utils::get_string(j, "model");
+    if (j.contains("usage") && j["usage"].is_array() && j["usage"].size() == 4) {
+        const Json& u = j["usage"];
+        r.usage.input_tokens = static_cast<int>(json_utils::as_int(u[0]));
+        r.usage.output_tokens = static_cast<int>(json_utils::as_int(u[1]));
+        r.usage.total_tokens = static_cast<int>(json_utils::as_int(u[2]));
+        r.usage.cached_tokens = static_cast<int>(json_utils::as_int(u[3]));
+    }
+    if (j.contains("tool_calls") && j["tool_calls"].is_array()) {
+        for (const Json& cj : j["tool_calls"]) {
+            ToolCallRequest call;
+            call.id = json_utils::get_string(cj, "id");
+            call.name = json_utils::get_string(cj, "name");
+            call.set_arguments(json_utils::get_string(cj, "arguments"));
+            r.tool_calls.push_back(call);
+        }
+    }
+    return reply;
+}
+
+Json tool_call_to_json(const RecordedToolCall& call) {
+    Json j;
+    j["tool"] = call.tool;
+    j["params"] = call.params;
+    j["ms"] = call.ms;
+    j["success"] = call.result.success;
+    put(j, "output", call.result.output);
+    put(j, "error", call.result.error);
+    put(j, "stop", !call.result.should_continue);
+    return j;
+}
+
+RecordedToolCall tool_call_from_json(const Json& j) {
+    RecordedToolCall call;
+    call.tool = json_utils::get_string(j, "tool");
+    call.params = json_utils::get_string(j, "params");
+    call.ms = json_utils::get_int(j, "ms");
+    call.result.success = json_utils::get_bool(j, "success");
+    call.result.output = json_utils::get_string(j, "output");
+    call.result.error = json_utils::get_string(j, "error");
+    call.result.should_continue = !json_utils::get_bool(j, "stop");
+    return call;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// RunRecording
+// ============================================================================
+
+RunRecording::RunRecording() : started_ms(0), native_tools(false), streamed(false) {}
+
+void RunRecording::add_tool_call(const std::string& tool, const std::string& params,
+                                 const AgentToolResult& result, int64_t ms) {
+    RecordedToolCall call;
+    call.tool = tool;
+    call.params = params;
+    call.result = result;
+    call.ms = ms;
+    std::lock_guard<std::mutex> lock(mutex_);
+    tool_calls.push_back(call);
+}
+
+Json RunRecording::to_json() const {
+    Json j;
+    j["version"] = kFormatVersion;
+    j["id"] = id;
+    j["started_ms"] = started_ms;
+    put(j, "session_key", session_key);
+    j["provider"] = provider;
+    put(j, "model", model);
+    put(j, "native_tools", native_tools);
+    put(j, "streamed", streamed);
+    j["config"] = config_to_json(config);
+    j["user_message"] = user_message;
+    put(j, "system_prompt", system_prompt);
+    put(j, "prompt_context", prompt_context);
+
+    // [role, content] pairs; roles as in the session store
+    Json h = Json::array();
+    for (size_t i = 0; i < history.size(); ++i) {
+        h.push_back({ static_cast<int>(history[i].role), history[i].content });
+    }
+    j["history"] = h;
+
+    Json t = Json::array();
+    for (size_t i = 0; i < tools.size(); ++i) t.push_back(tool_to_json(tools[i]));
+    j["tools"] = t;
+
+    Json r = Json::array();
+    for (size_t i = 0; i < replies.size(); ++i) r.push_back(reply_to_json(replies[i]));
+    j["replies"] = r;
+
+    Json c = Json::array();
+    for (size_t i = 0; i < tool_calls.size(); ++i) c.push_back(tool_call_to_json(tool_calls[i]));
+    j["tool_calls"] = c;
+
+    Json out;
+    out["success"] = result.success;
+    put(out, "paused", result.paused);
+    put(out, "cancelled", result.cancelled);
+    out["iterations"] = result.iterations;
+    out["tool_calls"] = result.tool_calls_made;
+    put(out, "final_response", result.final_response);
+    put(out, "error", result.error);
+    out["model_ms"] = result.model_ms;
+    out["tool_ms"] = result.tool_ms;
+    j["result"] = out;
+    return j;
+}
+
+bool RunRecording::from_json(const Json& j, std::string& error) {
+    if (!j.is_object()) {
+        error = "not a JSON object";
+        return false;
+    }
+    int64_t version = json_utils::get_int(j, "version");
+    if (version != kFormatVersion) {
+        error = "unsupported recording version " + std::to_string(version);
+        return false;
+    }
+    id = json_utils::get_string(j, "id");
+    started_ms = json_utils::get_int(j, "started_ms");
+    session_key = json_utils::get_string(j, "session_key");
+    provider = json_utils::get_string(j, "provider");
+    model = json_utils::get_string(j, "model");
+    native_tools = json_utils::get_bool(j, "native_tools");
+    streamed = json_utils::get_bool(j, "streamed");
+    config = AgentConfig();
+    if (j.contains("config")) config_from_json(j["config"], config);
+    user_message = json_utils::get_string(j, "user_message");
+    system_prompt = json_utils::get_string(j, "system_prompt");
+    prompt_context = json_utils::get_string(j, "prompt_context");
+
+    history.clear();
+    if (j.contains("history") && j["history"].is_array()) {
+        for (const Json& m : j["history"]) {
+            if (!m.is_array() || m.size() != 2 || !m[1].is_string()) {
+                error = "malformed history entry";
+                return false;
+            }
+            int role = static_cast<int>(json_utils::as_int(m[0]));
+            if (role < 0 || role > static_cast<int>(MessageRole::ASSISTANT)) role = 0;
+            history.push_back(ConversationMessage(static_cast<MessageRole>(role), m[1].get<std::string>()));
+        }
+    }
+
+    tools.clear();
+    if (j.contains("tools") && j["tools"].is_array()) {
+        for (const Json& t : j["tools"]) tools.push_back(tool_from_json(t));
+    }
+    replies.clear();
+    if (j.contains("replies") && j["replies"].is_array()) {
+        for (const Json& r : j["replies"]) replies.push_back(reply_from_json(r));
+    }
+    tool_calls.clear();
+    if (j.contains("tool_calls") && j["tool_calls"].is_array()) {
+        for (const Json& c : j["tool_calls"]) tool_calls.push_back(tool_call_from_json(c));
+    }
+
+    result = AgentResult();
+    if (j.contains("result")) {
+        const Json& out = j["result"];
+        result.success = json_utils::get_bool(out, "success");
+        result.paused = json_utils::get_bool(out, "paused");
+        result.cancelled = json_utils::get_bool(out, "cancelled");
+        result.iterations = static_cast<int>(json_utils::get_int(out, "iterations"));
+        result.tool_calls_made = static_cast<int>(json_utils::get_int(out, "tool_calls"));
+        result.final_response = json_utils::get_string(out, "final_response");
+        result.error = json_utils::get_string(out, "error");
+        result.model_ms = json_utils::get_int(out, "model_ms");
+        result.tool_ms = json_utils::get_int(out, "tool_ms");
+    }
+    return true;
+}
+
+bool RunRecording::load(const std::string& path, std::string& error) {
+    std::ifstream in(path.c_str());
+    if (!in.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    Json j = Json::parse(text.str(), nullptr, false);
+    if (j.is_discarded()) {
+        error = path + ": invalid JSON";
+        return false;
+    }
+    if (!from_json(j, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// RunRecorder
+// ============================================================================
+
+RunRecorder& RunRecorder::instance() {
+    static RunRecorder recorder;
+    return recorder;
+}
+
+void RunRecorder::configure(const std::string& dir) {
+    dir_ = dir;
+    if (!dir_.empty()) {
+        LOG_INFO("[Record] Recording agent runs to %s", dir_.c_str());
+    }
+}
+
+std::shared_ptr<RunRecording> RunRecorder::begin(const std::string& id) {
+    if (dir_.empty()) return std::shared_ptr<RunRecording>();
+    std::shared_ptr<RunRecording> recording = std::make_shared<RunRecording>();
+    recording->id = id;
+    if (recording->id.empty()) {
+        recording->id = generate_uuid();
+        recording->id.erase(std::remove(recording->id.begin(), recording->id.end(), '-'), recording->id.end());
+    }
+    recording->started_ms = current_timestamp_ms();
+    return recording;
+}
+
+std::string RunRecorder::finish(const std::shared_ptr<RunRecording>& recording) {
+    if (!recording || dir_.empty()) return "";
+    std::string path = dir_ + "/run-" + recording->id + ".json";
+    if (!create_parent_directory(path)) {
+        LOG_WARN("[Record] Cannot create %s", dir_.c_str());
+        return "";
+    }
+    std::ofstream out(path.c_str());
+    if (!out.is_open()) {
+        LOG_WARN("[Record] Cannot write %s", path.c_str());
+        return "";
+    }
+    // Scraped pages are not always valid UTF-8
+    out << recording->to_json().dump(-1, ' ', false, Json::error_handler_t::replace) << "\n";
+    LOG_DEBUG("[Record] Wrote %s (%zu replies, %zu tool calls)", path.c_str(),
+              recording->replies.size(), recording->tool_calls.size());
+    return path;
+}
+
+} // namespace opencrank
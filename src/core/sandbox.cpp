@@ -18,6 +18,7 @@
 #include <climits>
 #include <sys/stat.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -28,6 +29,7 @@
 #ifdef __linux__
 
 #include <linux/landlock.h>
+#include <linux/openat2.h>
 #include <sys/syscall.h>
 
 #ifndef __NR_landlock_create_ruleset
@@ -119,6 +121,7 @@ Sandbox& Sandbox::instance() {
 Sandbox::Sandbox()
     : active_(false)
     , supported_(false)
+    , cache_generation_(0)
 {
 #ifdef __linux__
     // Probe for Landlock support
@@ -219,9 +222,8 @@ bool Sandbox::is_path_in_jail(const std::string& path) const {
     if (jail_dir_.empty()) return false;
 
     // Resolve to absolute path for comparison
-    char resolved[PATH_MAX];
-    const char* rp = realpath(path.c_str(), resolved);
-    if (!rp) {
+    std::string abs_path;
+    if (!resolve_cached(path, abs_path)) {
         // File may not exist yet; do prefix check on the raw path
         if (path.size() >= jail_dir_.size() &&
             path.compare(0, jail_dir_.size(), jail_dir_) == 0) {
@@ -230,7 +232,6 @@ bool Sandbox::is_path_in_jail(const std::string& path) const {
         return false;
     }
 
-    std::string abs_path(rp);
     if (abs_path.size() >= jail_dir_.size() &&
         abs_path.compare(0, jail_dir_.size(), jail_dir_) == 0) {
         return (abs_path.size() == jail_dir_.size() || abs_path[jail_dir_.size()] == '/');
@@ -241,13 +242,9 @@ bool Sandbox::is_path_in_jail(const std::string& path) const {
 bool Sandbox::is_path_allowed(const std::string& path) const {
     if (!active_) return true;  // Sandbox not active, everything allowed
 
-    char resolved[PATH_MAX];
-    const char* rp = realpath(path.c_str(), resolved);
     std::string check_path;
 
-    if (rp) {
-        check_path = std::string(rp);
-    } else {
+    if (!resolve_cached(path, check_path)) {
         // The file may not exist yet (e.g. a new file being written).
         // Resolve the parent directory and re-attach the filename so the
         // prefix check below works correctly.
@@ -255,8 +252,8 @@ bool Sandbox::is_path_allowed(const std::string& path) const {
         if (slash != std::string::npos) {
             std::string parent   = path.substr(0, slash);
             std::string filename = path.substr(slash + 1);
-            const char* prp = realpath(parent.c_str(), resolved);
-            check_path = prp ? (std::string(prp) + "/" + filename) : path;
+            std::string real_parent;
+            check_path = resolve_cached(parent, real_parent) ? (real_parent + "/" + filename) : path;
         } else {
             // Bare filename with no directory component — resolve against cwd
             // to get an absolute path we can compare against base_dir_.
@@ -285,6 +282,101 @@ bool Sandbox::is_path_allowed(const std::string& path) const {
     return false;
 }
 
+bool Sandbox::resolve_cached(const std::string& path, std::string& resolved) const {
+    const size_t PATH_CACHE_MAX = 1024;
+
+    // One stat() proves the cached resolution still names the same object;
+    // relative paths depend on the cwd and are not cached
+    struct stat st;
+    bool exists = !path.empty() && path[0] == '/' && stat(path.c_str(), &st) == 0;
+    uint64_t generation = cache_generation_.load();
+    if (exists) {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        std::map<std::string, CachedPath>::const_iterator it = path_cache_.find(path);
+        if (it != path_cache_.end() && it->second.generation == generation &&
+            it->second.dev == st.st_dev && it->second.ino == st.st_ino) {
+            resolved = it->second.resolved;
+            return true;
+        }
+    }
+
+    char buf[PATH_MAX];
+    if (!realpath(path.c_str(), buf)) return false;
+    resolved = buf;
+    if (!exists) return true;
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (path_cache_.size() >= PATH_CACHE_MAX) path_cache_.clear();
+    CachedPath& entry = path_cache_[path];
+    entry.resolved = resolved;
+    entry.dev = st.st_dev;
+    entry.ino = st.st_ino;
+    entry.generation = generation;
+    return true;
+}
+
+void Sandbox::invalidate_path_cache() {
+    cache_generation_.fetch_add(1);
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    path_cache_.clear();
+}
+
+int Sandbox::root_fd(const std::string& root) const {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    std::map<std::string, int>::const_iterator it = root_fds_.find(root);
+    if (it != root_fds_.end()) return it->second;
+    int fd = open(root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) root_fds_[root] = fd;
+    return fd;
+}
+
+int Sandbox::open_beneath(const std::string& path, int flags, mode_t mode) const {
+    if (!active_) return open(path.c_str(), flags | O_CLOEXEC, mode);
+
+#if defined(__linux__) && defined(SYS_openat2)
+    static std::atomic<bool> no_openat2(false);
+
+    // The allowed root the path names lexically
+    std::string root;
+    if (path.compare(0, base_dir_.size(), base_dir_) == 0 &&
+        path.size() > base_dir_.size() && path[base_dir_.size()] == '/') {
+        root = base_dir_;
+    }
+    for (size_t i = 0; root.empty() && i < extra_allowed_paths_.size(); ++i) {
+        const std::string& allowed = extra_allowed_paths_[i];
+        if (path.compare(0, allowed.size(), allowed) == 0 &&
+            path.size() > allowed.size() && path[allowed.size()] == '/') {
+            root = allowed;
+        }
+    }
+
+    int dir_fd = root.empty() || no_openat2.load() ? -1 : root_fd(root);
+    if (dir_fd >= 0) {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = static_cast<uint64_t>(flags | O_CLOEXEC);
+        how.mode = (flags & (O_CREAT | O_TMPFILE)) ? mode : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        std::string relative = path.substr(root.size() + 1);
+        int fd = static_cast<int>(syscall(SYS_openat2, dir_fd, relative.c_str(), &how, sizeof(how)));
+        if (fd >= 0) return fd;
+        if (errno == ENOSYS) {
+            no_openat2 = true;
+        } else if (errno != EXDEV) {
+            return -1;
+        }
+        // EXDEV: an absolute symlink or ".." leaves the root; the checked
+        // open below decides whether its target is allowed
+    }
+#endif
+
+    if (!is_path_allowed(path)) {
+        errno = EACCES;
+        return -1;
+    }
+    return open(path.c_str(), flags | O_CLOEXEC, mode);
+}
+
 std::string Sandbox::resolve_in_jail(const std::string& relative_path) const {
     if (relative_path.empty() || relative_path == ".") {
         return jail_dir_;
@@ -1,13 +1,44 @@
 #include <opencrank/core/session.hpp>
+#include <opencrank/core/session_store.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/utils.hpp>
 #include <ctime>
 #include <sstream>
 #include <algorithm>
 #include <mutex>
+#include <tuple>
+#include <functional>
 
 namespace opencrank {
 
+namespace {
+uint64_t mix_hash(uint64_t seed, const std::string& s) {
+    uint64_t h = static_cast<uint64_t>(std::hash<std::string>()(s));
+    return seed ^ (h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+uint64_t message_fingerprint(int role, const std::string& content) {
+    return mix_hash(static_cast<uint64_t>(role) + 1, content);
+}
+
+uint64_t meta_fingerprint(const std::string& agent_id, const std::string& channel,
+                          const std::string& peer_id, const std::map<std::string, std::string>& data) {
+    uint64_t h = mix_hash(mix_hash(mix_hash(0, agent_id), channel), peer_id);
+    for (std::map<std::string, std::string>::const_iterator it = data.begin(); it != data.end(); ++it) {
+        h = mix_hash(mix_hash(h, it->first), it->second);
+    }
+    return h;
+}
+
+size_t history_bytes(const std::vector<ConversationMessage>& history) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < history.size(); ++i) {
+        bytes += sizeof(ConversationMessage) + history[i].content.capacity();
+    }
+    return bytes;
+}
+} // namespace
+
 std::string SessionKey::build(const std::string& agent_id,
                               const std::string& channel,
                               const std::string& account_id,
@@ -92,6 +123,11 @@ SessionKey::Parsed SessionKey::parse(const std::string& session_key) {
     return result;
 }
 
+std::string SessionKey::build_subagent(const std::string& agent_id, uint64_t n) {
+    std::string safe_agent = sanitize_agent_id(agent_id.empty() ? DEFAULT_AGENT_ID : agent_id);
+    return "agent:" + safe_agent + ":subagent:" + std::to_string(n);
+}
+
 bool SessionKey::is_subagent_key(const std::string& session_key) {
     std::string raw = to_lower(trim(session_key));
     if (raw.empty()) return false;
@@ -126,13 +162,31 @@ std::string SessionKey::sanitize_agent_id(const std::string& agent_id) {
 // ============ Session ============
 
 Session::Session() 
-    : last_activity_(0) {
+    : last_activity_(0)
+    , next_seq_(1)
+    , stored_meta_(0)
+    , history_loaded_(true)
+    , meta_loaded_(true)
+    , removed_(false)
+    , pins_(0)
+    , bytes_(0)
+    , inflight_bytes_(0)
+    , lru_pos_() {
     touch();
 }
 
 Session::Session(const std::string& key)
     : key_(key)
-    , last_activity_(0) {
+    , last_activity_(0)
+    , next_seq_(1)
+    , stored_meta_(0)
+    , history_loaded_(true)
+    , meta_loaded_(true)
+    , removed_(false)
+    , pins_(0)
+    , bytes_(0)
+    , inflight_bytes_(0)
+    , lru_pos_() {
     touch();
 }
 
@@ -182,33 +236,317 @@ SessionManager& SessionManager::instance() {
 }
 
 SessionManager::SessionManager() 
-    : dm_scope_(DMScope::MAIN)
-    , max_history_(20) {}
+    : count_(0)
+    , dm_scope_(DMScope::MAIN)
+    , max_history_(20)
+    , store_(nullptr)
+    , memory_budget_(0)
+    , memory_used_(0)
+    , evictions_(0) {}
+
+size_t SessionManager::shard_index(const std::string& key) {
+    return std::hash<std::string>()(key) % SHARDS;
+}
+
+void SessionManager::set_store(SessionStore* store, size_t memory_budget_bytes) {
+    store_.store(store);
+    memory_budget_.store(memory_budget_bytes);
+}
+
+size_t SessionManager::memory_used() const {
+    return memory_used_.load();
+}
+
+std::vector<SessionMemory> SessionManager::memory_usage() const {
+    std::vector<SessionMemory> usage;
+    usage.reserve(count_.load());
+    for (size_t i = 0; i < SHARDS; ++i) {
+        const Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (std::unordered_map<std::string, Session>::const_iterator it = shard.sessions.begin();
+             it != shard.sessions.end(); ++it) {
+            SessionMemory m;
+            m.key = it->first;
+            m.history_bytes = it->second.bytes_.load();
+            m.inflight_bytes = it->second.inflight_bytes_;
+            // Only flips while unpinned, under this lock and the session's
+            m.loaded = it->second.pins_ > 0 || it->second.history_loaded_;
+            usage.push_back(m);
+        }
+    }
+    return usage;
+}
+
+void SessionManager::note_inflight(const std::string& key, size_t bytes) {
+    if (bytes == 0) return;
+    size_t index = shard_index(key);
+    Shard& shard = shards_[index];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        SessionIter it = shard.sessions.find(key);
+        if (it == shard.sessions.end() || it->second.pins_ == 0) return;
+        it->second.inflight_bytes_ += bytes;
+        memory_used_ += bytes;
+    }
+    evict(index);
+}
+
+size_t SessionManager::session_count() const {
+    return count_.load();
+}
+
+Session& SessionManager::create_locked(Shard& shard, const std::string& key) {
+    Session& session = shard.sessions.emplace(std::piecewise_construct,
+                                              std::forward_as_tuple(key),
+                                              std::forward_as_tuple(key)).first->second;
+    if (store_.load()) {
+        // May be a session from before a restart or one cleaned up as idle
+        session.history_loaded_ = false;
+        session.meta_loaded_ = false;
+    }
+    shard.lru.push_front(&session);
+    session.lru_pos_ = shard.lru.begin();
+    count_++;
+    return session;
+}
+
+SessionManager::SessionIter SessionManager::erase_locked(Shard& shard, SessionIter it) {
+    shard.lru.erase(it->second.lru_pos_);
+    memory_used_ -= it->second.bytes_ + it->second.inflight_bytes_;
+    count_--;
+    return shard.sessions.erase(it);
+}
 
 Session& SessionManager::get_session(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::map<std::string, Session>::iterator it = sessions_.find(key);
-    if (it == sessions_.end()) {
-        Session new_session(key);
-        sessions_[key] = new_session;
-        LOG_DEBUG("[Session] Created new session: %s (total: %zu)", key.c_str(), sessions_.size());
-        return sessions_[key];
+    Shard& shard = shards_[shard_index(key)];
+    Session* session;
+    bool created = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        SessionIter it = shard.sessions.find(key);
+        if (it == shard.sessions.end()) {
+            session = &create_locked(shard, key);
+            created = true;
+        } else {
+            session = &it->second;
+            shard.lru.splice(shard.lru.begin(), shard.lru, session->lru_pos_);
+        }
+        session->pins_++;
+        session->touch();
+    }
+    
+    // Pinned now, so eviction and cleanup leave it alone while the store is read
+    SessionStore* store = store_.load();
+    if (store) {
+        std::lock_guard<std::mutex> lock(session->store_mutex_);
+        if (!session->history_loaded_) {
+            load_history(*session, store);
+        }
+    }
+    if (created) {
+        LOG_DEBUG("[Session] Created new session: %s (total: %zu, history: %zu)",
+                  key.c_str(), count_.load(), session->history_.size());
+    }
+    return *session;
+}
+
+void SessionManager::release(Session& session) {
+    SessionStore* store = store_.load();
+    {
+        std::lock_guard<std::mutex> lock(session.store_mutex_);
+        if (session.history_loaded_) {
+            size_t bytes = history_bytes(session.history_);
+            memory_used_ += bytes;
+            memory_used_ -= session.bytes_;
+            session.bytes_ = bytes;
+        }
+        if (store && !session.removed_) {
+            save(session, store);
+        }
+    }
+    
+    size_t index = shard_index(session.key_);
+    Shard& shard = shards_[index];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (session.pins_ > 0) session.pins_--;
+        // bytes_ was measured above with the turn's messages in it
+        memory_used_ -= session.inflight_bytes_;
+        session.inflight_bytes_ = 0;
+        if (session.removed_ && session.pins_ == 0) {
+            erase_locked(shard, shard.sessions.find(session.key_));
+            return;
+        }
+        // Activity and LRU position move together, which keeps each LRU
+        // list ordered by last_activity for cleanup_inactive
+        session.touch();
+        shard.lru.splice(shard.lru.begin(), shard.lru, session.lru_pos_);
+    }
+    evict(index);
+}
+
+void SessionManager::load_history(Session& session, SessionStore* store) {
+    SessionRecord record;
+    bool found = store->load(session.key_, record);
+    
+    session.history_.clear();
+    session.stored_.clear();
+    if (found) {
+        if (!session.meta_loaded_) {
+            session.agent_id_ = record.agent_id;
+            session.channel_ = record.channel;
+            session.peer_id_ = record.peer_id;
+            session.data_ = record.data;
+            session.stored_meta_ = meta_fingerprint(record.agent_id, record.channel,
+                                                    record.peer_id, record.data);
+        }
+        session.history_.reserve(record.messages.size());
+        session.stored_.reserve(record.messages.size());
+        for (size_t i = 0; i < record.messages.size(); ++i) {
+            const StoredMessage& m = record.messages[i];
+            session.history_.push_back(ConversationMessage(static_cast<MessageRole>(m.role), m.content));
+            session.stored_.push_back(std::make_pair(m.seq, message_fingerprint(m.role, m.content)));
+            session.next_seq_ = std::max(session.next_seq_, m.seq + 1);
+        }
+        LOG_DEBUG("[Session] Loaded %zu messages for %s from store",
+                  session.history_.size(), session.key_.c_str());
+    }
+    session.meta_loaded_ = true;
+    session.history_loaded_ = true;
+    session.bytes_ = history_bytes(session.history_);
+    memory_used_ += session.bytes_;
+}
+
+void SessionManager::save(Session& session, SessionStore* store) {
+    SessionDelta delta;
+    delta.key = session.key_;
+    
+    uint64_t meta = meta_fingerprint(session.agent_id_, session.channel_,
+                                     session.peer_id_, session.data_);
+    bool meta_changed = meta != session.stored_meta_;
+    bool history_changed = false;
+    
+    if (session.history_loaded_) {
+        const std::vector<ConversationMessage>& history = session.history_;
+        std::vector<std::pair<int64_t, uint64_t> >& stored = session.stored_;
+        std::vector<uint64_t> prints(history.size());
+        for (size_t i = 0; i < history.size(); ++i) {
+            prints[i] = message_fingerprint(static_cast<int>(history[i].role), history[i].content);
+        }
+        
+        // Messages dropped from the front (limit_history, /new) come first...
+        size_t front = stored.size();
+        if (!prints.empty()) {
+            for (size_t k = 0; k < stored.size(); ++k) {
+                if (stored[k].second == prints[0]) { front = k; break; }
+            }
+        }
+        // ...then the run that still matches, then whatever was appended or rewritten
+        size_t same = 0;
+        while (front + same < stored.size() && same < prints.size() &&
+               stored[front + same].second == prints[same]) {
+            same++;
+        }
+        
+        if (front > 0) {
+            delta.keep_from_seq = front < stored.size() ? stored[front].first : session.next_seq_;
+            history_changed = true;
+        }
+        if (front + same < stored.size()) {
+            delta.replace_from_seq = stored[front + same].first;
+            history_changed = true;
+        }
+        
+        std::vector<std::pair<int64_t, uint64_t> > kept(stored.begin() + static_cast<long>(front),
+                                                        stored.begin() + static_cast<long>(front + same));
+        for (size_t i = same; i < history.size(); ++i) {
+            StoredMessage m;
+            m.seq = session.next_seq_++;
+            m.role = static_cast<int>(history[i].role);
+            m.content = history[i].content;
+            delta.inserts.push_back(m);
+            kept.push_back(std::make_pair(m.seq, prints[i]));
+            history_changed = true;
+        }
+        stored.swap(kept);
+    }
+    
+    if (!meta_changed && !history_changed) return;
+    
+    delta.has_meta = true;
+    delta.meta.agent_id = session.agent_id_;
+    delta.meta.channel = session.channel_;
+    delta.meta.peer_id = session.peer_id_;
+    delta.meta.data = session.data_;
+    delta.meta.last_activity = session.last_activity_;
+    session.stored_meta_ = meta;
+    store->enqueue(delta);
+}
+
+void SessionManager::evict(size_t first_shard) {
+    SessionStore* store = store_.load();
+    size_t budget = memory_budget_.load();
+    if (!store || budget == 0 || memory_used_.load() <= budget) return;
+    
+    size_t evicted = 0;
+    for (size_t n = 0; n < SHARDS && memory_used_.load() > budget; ++n) {
+        Shard& shard = shards_[(first_shard + n) % SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::list<Session*>::iterator it = shard.lru.end();
+        while (it != shard.lru.begin() && memory_used_.load() > budget) {
+            --it;
+            Session& session = **it;
+            if (session.pins_ > 0) continue;
+            
+            std::lock_guard<std::mutex> session_lock(session.store_mutex_);
+            if (!session.history_loaded_) continue;
+            save(session, store);
+            std::vector<ConversationMessage>().swap(session.history_);
+            std::vector<std::pair<int64_t, uint64_t> >().swap(session.stored_);
+            session.history_loaded_ = false;
+            memory_used_ -= session.bytes_;
+            session.bytes_ = 0;
+            evicted++;
+        }
+    }
+    if (evicted > 0) {
+        evictions_ += evicted;
+        LOG_DEBUG("[Session] Unloaded %zu cold session histories (in memory: %zu KB)",
+                  evicted, memory_used_.load() / 1024);
     }
-    it->second.touch();
-    return it->second;
 }
 
 bool SessionManager::has_session(const std::string& key) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return sessions_.find(key) != sessions_.end();
+    const Shard& shard = shards_[shard_index(key)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.sessions.find(key) != shard.sessions.end();
 }
 
 void SessionManager::remove_session(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    sessions_.erase(key);
+    Shard& shard = shards_[shard_index(key)];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        SessionIter it = shard.sessions.find(key);
+        if (it != shard.sessions.end()) {
+            if (it->second.pins_ > 0) {
+                // Still in use: the last release erases it
+                std::lock_guard<std::mutex> session_lock(it->second.store_mutex_);
+                it->second.removed_ = true;
+            } else {
+                erase_locked(shard, it);
+            }
+        }
+    }
+    SessionStore* store = store_.load();
+    if (store) {
+        SessionDelta delta;
+        delta.key = key;
+        delta.remove = true;
+        store->enqueue(delta);
+    }
 }
 
-Session& SessionManager::get_session_for_message(const Message& msg, const std::string& agent_id) {
+const std::string& SessionManager::session_key_for_message(const Message& msg, const std::string& agent_id) const {
     // Determine peer kind from message
     PeerKind kind = PeerKind::DM;
     if (msg.chat_type == "group") {
@@ -217,15 +555,32 @@ Session& SessionManager::get_session_for_message(const Message& msg, const std::
         kind = PeerKind::CHANNEL;
     }
     
-    RoutePeer peer(kind, msg.to);
+    const std::string& agent = agent_id.empty() ? SessionKey::DEFAULT_AGENT_ID : agent_id;
+    SymbolTable& symbols = SymbolTable::instance();
+    RouteId route;
+    route.agent = symbols.intern(agent);
+    route.channel = symbols.intern(msg.channel);
+    route.account = symbols.intern(msg.account_id);
+    route.peer = symbols.intern(msg.to);
+    route.kind = static_cast<int>(kind);
+    route.scope = static_cast<int>(dm_scope_);
+    {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        std::unordered_map<RouteId, Symbol, RouteIdHash>::const_iterator it = routes_.find(route);
+        if (it != routes_.end()) return symbols.name(it->second);
+    }
     
-    std::string session_key = SessionKey::build(
-        agent_id.empty() ? SessionKey::DEFAULT_AGENT_ID : agent_id,
-        msg.channel,
-        SessionKey::DEFAULT_ACCOUNT_ID,
-        &peer,
-        dm_scope_
-    );
+    RoutePeer peer(kind, msg.to);
+    Symbol key = symbols.intern(SessionKey::build(agent, msg.channel, msg.account_id, &peer, dm_scope_));
+    {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        routes_[route] = key;
+    }
+    return symbols.name(key);
+}
+
+Session& SessionManager::get_session_for_message(const Message& msg, const std::string& agent_id) {
+    const std::string& session_key = session_key_for_message(msg, agent_id);
     
     Session& session = get_session(session_key);
     session.set_channel(msg.channel);
@@ -243,39 +598,76 @@ Session& SessionManager::get_session_for_message(const Message& msg, const std::
 }
 
 void SessionManager::clear_all() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    sessions_.clear();
+    SessionStore* store = store_.load();
+    for (size_t i = 0; i < SHARDS; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        SessionIter it = shard.sessions.begin();
+        while (it != shard.sessions.end()) {
+            if (store) {
+                SessionDelta delta;
+                delta.key = it->first;
+                delta.remove = true;
+                store->enqueue(delta);
+            }
+            if (it->second.pins_ > 0) {
+                std::lock_guard<std::mutex> session_lock(it->second.store_mutex_);
+                it->second.removed_ = true;
+                ++it;
+            } else {
+                it = erase_locked(shard, it);
+            }
+        }
+    }
 }
 
 size_t SessionManager::cleanup_inactive(int64_t max_age_seconds) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    SessionStore* store = store_.load();
     int64_t now = current_timestamp();
     size_t removed = 0;
     
-    std::map<std::string, Session>::iterator it = sessions_.begin();
-    while (it != sessions_.end()) {
-        if (now - it->second.last_activity() > max_age_seconds) {
-            it = sessions_.erase(it);
+    // With a store the session stays on disk and is restored on its next message
+    for (size_t i = 0; i < SHARDS; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::list<Session*>::iterator it = shard.lru.end();
+        while (it != shard.lru.begin()) {
+            --it;
+            Session& session = **it;
+            if (session.pins_ > 0) continue;
+            // Unpinned sessions sit in last_activity order: the rest are newer
+            if (now - session.last_activity() <= max_age_seconds) break;
+            
+            if (store) {
+                std::lock_guard<std::mutex> session_lock(session.store_mutex_);
+                save(session, store);
+            }
+            std::list<Session*>::iterator next = it;
+            ++next;
+            erase_locked(shard, shard.sessions.find(session.key_));
+            it = next;
             ++removed;
-        } else {
-            ++it;
         }
     }
     
     if (removed > 0) {
         LOG_DEBUG("[Session] Cleaned up %zu inactive sessions (remaining: %zu)", 
-                  removed, sessions_.size());
+                  removed, count_.load());
     }
     
     return removed;
 }
 
 std::vector<std::string> SessionManager::session_keys() const {
-    std::lock_guard<std::mutex> lock(mutex_);
     std::vector<std::string> keys;
-    for (std::map<std::string, Session>::const_iterator it = sessions_.begin();
-         it != sessions_.end(); ++it) {
-        keys.push_back(it->first);
+    keys.reserve(count_.load());
+    for (size_t i = 0; i < SHARDS; ++i) {
+        const Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (std::unordered_map<std::string, Session>::const_iterator it = shard.sessions.begin();
+             it != shard.sessions.end(); ++it) {
+            keys.push_back(it->first);
+        }
     }
     return keys;
 }
@@ -0,0 +1,175 @@
+/*
+ * OpenCrank C++ - Per-Session Serialized Executor Implementation
+ */
+#include <opencrank/core/session_executor.hpp>
+#include <opencrank/core/logger.hpp>
+#include <memory>
+
+namespace opencrank {
+
+SessionExecutor::SessionExecutor()
+    : pool_(nullptr), coalesce_(true), handing_off_(false), coalesced_(0) {}
+
+void SessionExecutor::init(ThreadPool* pool, Handler handler) {
+    init(pool, AsyncHandler([handler](const MessagePtr& msg, const Done& done) {
+        handler(msg);
+        done();
+    }));
+}
+
+void SessionExecutor::init(ThreadPool* pool, AsyncHandler handler) {
+    pool_ = pool;
+    handler_ = handler;
+}
+
+bool SessionExecutor::can_coalesce(const Message& queued, const Message& incoming) {
+    // Only plain chat: commands must keep their own turn
+    if (queued.text.empty() || incoming.text.empty()) return false;
+    if (queued.text[0] == '/' || incoming.text[0] == '/') return false;
+    return queued.from == incoming.from && queued.channel == incoming.channel;
+}
+
+void SessionExecutor::submit(const std::string& session_key, const MessagePtr& msg, TaskPriority priority) {
+    if (!pool_ || !handler_) {
+        LOG_ERROR("[SessionExecutor] submit() called before init()");
+        return;
+    }
+
+    Symbol key = intern(session_key);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (handing_off_) {
+            // The next process runs it
+            Queued queued;
+            queued.session_key = session_key;
+            queued.msg = *msg;
+            queued.priority = priority;
+            held_.push_back(std::move(queued));
+            return;
+        }
+        auto it = strands_.find(key);
+        if (it != strands_.end()) {
+            // Session busy: wait in its queue (never a second pool task)
+            std::deque<PendingMessage>& queue = it->second.queue;
+            if (coalesce_ && !queue.empty() && can_coalesce(*queue.back().msg, *msg)) {
+                // Queued messages are shared and immutable: merge into a copy
+                std::shared_ptr<Message> merged = std::make_shared<Message>(*queue.back().msg);
+                merged->text += "\n\n" + msg->text;
+                merged->id = msg->id;  // Reply to the newest message
+                merged->timestamp = msg->timestamp;
+                queue.back().msg = merged;
+                coalesced_.fetch_add(1);
+                LOG_DEBUG("[SessionExecutor] Coalesced message %s into pending turn for %s",
+                          msg->id.c_str(), session_key.c_str());
+            } else {
+                PendingMessage pending;
+                pending.msg = msg;
+                pending.priority = priority;
+                queue.push_back(std::move(pending));
+                LOG_DEBUG("[SessionExecutor] Session %s busy, queued message %s (%zu waiting)",
+                          session_key.c_str(), msg->id.c_str(), queue.size());
+            }
+            return;
+        }
+
+        PendingMessage pending;
+        pending.msg = msg;
+        pending.priority = priority;
+        strands_[key].queue.push_back(std::move(pending));
+    }
+
+    schedule(key, priority);
+}
+
+void SessionExecutor::schedule(Symbol session_key, TaskPriority priority) {
+    pool_->enqueue([this, session_key]() {
+        drain(session_key);
+    }, priority);
+}
+
+void SessionExecutor::drain(Symbol session_key) {
+    PendingMessage current;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = strands_.find(session_key);
+        if (it == strands_.end() || it->second.queue.empty()) {
+            strands_.erase(session_key);
+            return;
+        }
+        current = std::move(it->second.queue.front());
+        it->second.queue.pop_front();
+    }
+
+    // A handler that throws may or may not have called done already
+    std::shared_ptr<std::atomic<bool> > finished = std::make_shared<std::atomic<bool> >(false);
+    Done done = [this, session_key, finished]() {
+        if (!finished->exchange(true)) {
+            finish(session_key);
+        }
+    };
+    try {
+        handler_(current.msg, done);
+    } catch (const std::exception& e) {
+        LOG_ERROR("[SessionExecutor] Handler threw for session %s: %s",
+                  symbol_name(session_key).c_str(), e.what());
+        done();
+    } catch (...) {
+        LOG_ERROR("[SessionExecutor] Handler threw unknown exception for session %s",
+                  symbol_name(session_key).c_str());
+        done();
+    }
+}
+
+void SessionExecutor::finish(Symbol session_key) {
+    // Hand the session back to the pool rather than looping here, so one
+    // chatty session can't monopolise this worker.
+    TaskPriority next_priority;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = strands_.find(session_key);
+        if (it == strands_.end()) return;
+        if (it->second.queue.empty()) {
+            strands_.erase(it);
+            return;
+        }
+        next_priority = it->second.queue.front().priority;
+    }
+
+    schedule(session_key, next_priority);
+}
+
+std::vector<SessionExecutor::Queued> SessionExecutor::hand_off() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handing_off_ = true;
+    std::vector<Queued> taken;
+    taken.swap(held_);
+    // Queues keep their order; a drain already scheduled finds its queue
+    // empty and releases the session
+    for (auto it = strands_.begin(); it != strands_.end(); ++it) {
+        std::deque<PendingMessage>& queue = it->second.queue;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            Queued queued;
+            queued.session_key = symbol_name(it->first);
+            queued.msg = *queue[i].msg;
+            queued.priority = queue[i].priority;
+            taken.push_back(std::move(queued));
+        }
+        queue.clear();
+    }
+    return taken;
+}
+
+size_t SessionExecutor::active_sessions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return strands_.size();
+}
+
+size_t SessionExecutor::queued(const std::string& session_key) const {
+    Symbol key = SymbolTable::instance().find(session_key);
+    if (key == 0) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = strands_.find(key);
+    return it == strands_.end() ? 0 : it->second.queue.size();
+}
+
+} // namespace opencrank
@@ -0,0 +1,337 @@
+/*
+ * OpenCrank C++ - Session Store Implementation
+ */
+#include <opencrank/core/session_store.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/json.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/sqlite_stmt.hpp>
+#include <sqlite3.h>
+#include <chrono>
+
+namespace opencrank {
+
+namespace {
+Histogram& query_seconds(const char* op) {
+    return Metrics::instance().histogram("opencrank_sqlite_seconds", "SQLite time per operation",
+                                         metric_labels("db", "sessions", "op", op));
+}
+} // namespace
+
+SessionStore::SessionStore()
+    : db_(nullptr)
+    , flush_interval_ms_(200)
+    , flush_requested_(false)
+    , stop_(false)
+    , enqueued_(0)
+    , committed_(0)
+    , batches_(0) {}
+
+SessionStore::~SessionStore() {
+    close();
+}
+
+bool SessionStore::open(const std::string& db_path, int flush_interval_ms) {
+    close();
+
+    if (!create_parent_directory(db_path)) {
+        LOG_ERROR("[SessionStore] Failed to create parent directory for '%s'", db_path.c_str());
+        return false;
+    }
+    if (sqlite3_open(db_path.c_str(), &db_) != SQLITE_OK) {
+        LOG_ERROR("[SessionStore] Failed to open database '%s': %s",
+                  db_path.c_str(), sqlite3_errmsg(db_));
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+
+    exec("PRAGMA journal_mode=WAL");
+    exec("PRAGMA synchronous=NORMAL");
+    exec("PRAGMA busy_timeout=5000");
+
+    bool ok = exec(
+        "CREATE TABLE IF NOT EXISTS sessions ("
+        "  key TEXT PRIMARY KEY,"
+        "  agent_id TEXT DEFAULT '',"
+        "  channel TEXT DEFAULT '',"
+        "  peer_id TEXT DEFAULT '',"
+        "  data TEXT DEFAULT '{}',"
+        "  last_activity INTEGER NOT NULL"
+        ")") &&
+        exec(
+        "CREATE TABLE IF NOT EXISTS session_messages ("
+        "  session_key TEXT NOT NULL,"
+        "  seq INTEGER NOT NULL,"
+        "  role INTEGER NOT NULL,"
+        "  content TEXT NOT NULL,"
+        "  PRIMARY KEY (session_key, seq)"
+        ") WITHOUT ROWID");
+    if (!ok) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+
+    flush_interval_ms_ = flush_interval_ms > 0 ? flush_interval_ms : 1;
+    stop_ = false;
+    writer_ = std::thread(&SessionStore::writer_loop, this);
+
+    LOG_INFO("[SessionStore] Database opened: %s (flush every %dms)",
+             db_path.c_str(), flush_interval_ms_);
+    return true;
+}
+
+void SessionStore::close() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            stop_ = true;
+        }
+        queue_cv_.notify_all();
+        writer_.join();
+        LOG_DEBUG("[SessionStore] Closed after %llu deltas in %llu batches",
+                  (unsigned long long)committed_, (unsigned long long)batches_);
+    }
+    if (db_) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+    }
+}
+
+bool SessionStore::exec(const char* sql) {
+    char* err = nullptr;
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+        LOG_ERROR("[SessionStore] SQL error: %s\n  Query: %s", err ? err : "unknown", sql);
+        if (err) sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Write-behind queue
+// ============================================================================
+
+void SessionStore::enqueue(const SessionDelta& delta) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!db_ || stop_) return;
+        queue_.push_back(delta);
+        pending_[delta.key]++;
+        enqueued_++;
+    }
+    // The writer sleeps out the flush interval; no need to wake it per delta
+}
+
+void SessionStore::flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) return;
+    uint64_t target = enqueued_;
+    flush_requested_ = true;
+    queue_cv_.notify_one();
+    done_cv_.wait(lock, [this, target] { return committed_ >= target || stop_; });
+}
+
+void SessionStore::writer_loop() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+        // Let deltas accumulate so one transaction covers many turns
+        queue_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_),
+                           [this] { return stop_ || flush_requested_; });
+        flush_requested_ = false;
+
+        if (queue_.empty()) {
+            if (stop_) return;
+            continue;
+        }
+
+        std::deque<SessionDelta> batch;
+        batch.swap(queue_);
+        lock.unlock();
+
+        size_t applied = 0;
+        {
+            static Histogram& commit_seconds = query_seconds("commit");
+            std::lock_guard<std::mutex> db_lock(db_mutex_);
+            HistogramTimer timer(commit_seconds);
+            bool in_txn = exec("BEGIN IMMEDIATE");
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (apply(batch[i])) applied++;
+            }
+            if (in_txn && !exec("COMMIT")) {
+                exec("ROLLBACK");
+                applied = 0;
+            }
+        }
+        if (applied < batch.size()) {
+            LOG_WARN("[SessionStore] %zu of %zu session writes failed",
+                     batch.size() - applied, batch.size());
+        }
+        LOG_DEBUG("[SessionStore] Committed %zu session deltas", batch.size());
+
+        lock.lock();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            std::map<std::string, int>::iterator it = pending_.find(batch[i].key);
+            if (it != pending_.end() && --it->second <= 0) pending_.erase(it);
+        }
+        committed_ += batch.size();
+        batches_++;
+        done_cv_.notify_all();
+    }
+}
+
+bool SessionStore::apply(const SessionDelta& delta) {
+    if (delta.remove) {
+        SqliteStatement del_msgs(db_, "DELETE FROM session_messages WHERE session_key = ?");
+        SqliteStatement del_session(db_, "DELETE FROM sessions WHERE key = ?");
+        if (!del_msgs.ok() || !del_session.ok()) return false;
+        del_msgs.bind(1, delta.key);
+        del_session.bind(1, delta.key);
+        return del_msgs.done() && del_session.done();
+    }
+
+    if (delta.has_meta) {
+        Json data = Json::object();
+        for (std::map<std::string, std::string>::const_iterator it = delta.meta.data.begin();
+             it != delta.meta.data.end(); ++it) {
+            data[it->first] = it->second;
+        }
+        SqliteStatement upsert(db_,
+            "INSERT INTO sessions (key, agent_id, channel, peer_id, data, last_activity) "
+            "VALUES (?, ?, ?, ?, ?, ?) "
+            "ON CONFLICT(key) DO UPDATE SET agent_id = excluded.agent_id, "
+            "channel = excluded.channel, peer_id = excluded.peer_id, "
+            "data = excluded.data, last_activity = excluded.last_activity");
+        if (!upsert.ok()) return false;
+        upsert.bind(1, delta.key);
+        upsert.bind(2, delta.meta.agent_id);
+        upsert.bind(3, delta.meta.channel);
+        upsert.bind(4, delta.meta.peer_id);
+        upsert.bind(5, data.dump());
+        upsert.bind(6, delta.meta.last_activity);
+        if (!upsert.done()) return false;
+    }
+
+    if (delta.keep_from_seq > 0) {
+        SqliteStatement trim(db_, "DELETE FROM session_messages WHERE session_key = ? AND seq < ?");
+        if (!trim.ok()) return false;
+        trim.bind(1, delta.key);
+        trim.bind(2, delta.keep_from_seq);
+        if (!trim.done()) return false;
+    }
+    if (delta.replace_from_seq != INT64_MAX) {
+        SqliteStatement cut(db_, "DELETE FROM session_messages WHERE session_key = ? AND seq >= ?");
+        if (!cut.ok()) return false;
+        cut.bind(1, delta.key);
+        cut.bind(2, delta.replace_from_seq);
+        if (!cut.done()) return false;
+    }
+    if (!delta.inserts.empty()) {
+        SqliteStatement insert(db_,
+            "INSERT OR REPLACE INTO session_messages (session_key, seq, role, content) "
+            "VALUES (?, ?, ?, ?)");
+        if (!insert.ok()) return false;
+        for (size_t i = 0; i < delta.inserts.size(); ++i) {
+            const StoredMessage& m = delta.inserts[i];
+            sqlite3_reset(insert.get());
+            insert.bind(1, delta.key);
+            insert.bind(2, m.seq);
+            insert.bind(3, static_cast<int64_t>(m.role));
+            insert.bind(4, m.content);
+            if (!insert.done()) return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Reads
+// ============================================================================
+
+bool SessionStore::load(const std::string& key, SessionRecord& out) {
+    if (!db_) return false;
+
+    // Rows for this key may still be sitting in the queue
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (pending_.count(key)) {
+            flush_requested_ = true;
+            queue_cv_.notify_one();
+            done_cv_.wait(lock, [this, &key] { return !pending_.count(key) || stop_; });
+        }
+    }
+
+    static Histogram& load_seconds = query_seconds("load");
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    HistogramTimer timer(load_seconds);
+    SqliteStatement meta(db_,
+        "SELECT agent_id, channel, peer_id, data, last_activity FROM sessions WHERE key = ?");
+    if (!meta.ok()) return false;
+    meta.bind(1, key);
+    if (!meta.row()) return false;
+
+    out.key = key;
+    out.agent_id = meta.text(0);
+    out.channel = meta.text(1);
+    out.peer_id = meta.text(2);
+    out.last_activity = meta.integer(4);
+    out.data.clear();
+    try {
+        Json data = Json::parse(meta.text(3));
+        for (Json::const_iterator it = data.begin(); it != data.end(); ++it) {
+            if (it.value().is_string()) out.data[it.key()] = it.value().get<std::string>();
+        }
+    } catch (...) {
+        LOG_WARN("[SessionStore] Ignoring corrupt data for session %s", key.c_str());
+    }
+
+    SqliteStatement rows(db_,
+        "SELECT seq, role, content FROM session_messages WHERE session_key = ? ORDER BY seq");
+    if (!rows.ok()) return false;
+    rows.bind(1, key);
+    out.messages.clear();
+    while (rows.row()) {
+        StoredMessage m;
+        m.seq = rows.integer(0);
+        m.role = static_cast<int>(rows.integer(1));
+        m.content = rows.text(2);
+        out.messages.push_back(m);
+    }
+    return true;
+}
+
+size_t SessionStore::prune(int64_t max_age_seconds) {
+    if (!db_ || max_age_seconds <= 0) return 0;
+    int64_t cutoff = current_timestamp() - max_age_seconds;
+
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    SqliteStatement msgs(db_,
+        "DELETE FROM session_messages WHERE session_key IN "
+        "(SELECT key FROM sessions WHERE last_activity < ?)");
+    SqliteStatement sessions(db_, "DELETE FROM sessions WHERE last_activity < ?");
+    if (!msgs.ok() || !sessions.ok()) return 0;
+    msgs.bind(1, cutoff);
+    sessions.bind(1, cutoff);
+    if (!msgs.done() || !sessions.done()) return 0;
+
+    size_t removed = static_cast<size_t>(sqlite3_changes(db_));
+    if (removed > 0) {
+        LOG_INFO("[SessionStore] Pruned %zu sessions idle for more than %lld days",
+                 removed, (long long)(max_age_seconds / 86400));
+    }
+    return removed;
+}
+
+uint64_t SessionStore::batches_committed() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return batches_;
+}
+
+uint64_t SessionStore::deltas_committed() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return committed_;
+}
+
+} // namespace opencrank
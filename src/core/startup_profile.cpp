@@ -0,0 +1,70 @@
+/*
+ * OpenCrank C++ - Startup Profile Implementation
+ */
+#include <opencrank/core/startup_profile.hpp>
+#include <algorithm>
+#include <cstdio>
+
+namespace opencrank {
+
+StartupProfile::StartupProfile() : origin_(std::chrono::steady_clock::now()) {}
+
+double StartupProfile::elapsed_ms() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin_).count();
+}
+
+void StartupProfile::record(const std::string& phase, const std::string& item,
+                            double start_ms, double duration_ms, bool ok) {
+    Step step;
+    step.phase = phase;
+    step.item = item;
+    step.start_ms = start_ms;
+    step.duration_ms = duration_ms;
+    step.ok = ok;
+    std::lock_guard<std::mutex> lock(mutex_);
+    steps_.push_back(step);
+}
+
+StartupProfile::Scope::Scope(StartupProfile* profile, const std::string& phase, const std::string& item)
+    : profile_(profile)
+    , phase_(phase)
+    , item_(item)
+    , start_ms_(profile ? profile->elapsed_ms() : 0)
+    , ok_(true) {}
+
+StartupProfile::Scope::~Scope() {
+    if (profile_) {
+        profile_->record(phase_, item_, start_ms_, profile_->elapsed_ms() - start_ms_, ok_);
+    }
+}
+
+std::string StartupProfile::report() const {
+    std::vector<Step> steps;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        steps = steps_;
+    }
+    // Phases are recorded when they end; list them by when they began, a
+    // phase ahead of the items inside it
+    std::stable_sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) {
+        if (a.start_ms != b.start_ms) return a.start_ms < b.start_ms;
+        return a.item.empty() && !b.item.empty();
+    });
+
+    std::string out = "Startup profile (ms):\n";
+    char line[256];
+    std::snprintf(line, sizeof(line), "  %10s %-28s %10s\n", "start", "step", "duration");
+    out += line;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        const Step& s = steps[i];
+        std::string name = s.item.empty() ? s.phase : "  " + s.phase + "/" + s.item;
+        std::snprintf(line, sizeof(line), "  %10.1f %-28s %10.1f %s\n",
+                      s.start_ms, name.c_str(), s.duration_ms, s.ok ? "" : "failed");
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "  total %.1f ms\n", elapsed_ms());
+    out += line;
+    return out;
+}
+
+} // namespace opencrank
@@ -0,0 +1,358 @@
+/*
+ * OpenCrank C++ - Sub-agent Fan-out Tool Implementation
+ */
+#include <opencrank/core/subagent_tool.hpp>
+#include <opencrank/core/application.hpp>
+#include <opencrank/core/session.hpp>
+#include <opencrank/core/thread_pool.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/ai/ai.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <cstdio>
+
+namespace opencrank {
+
+namespace {
+
+const int64_t WAIT_SLICE_MS = 100;          // Cancellation checks while waiting
+const int64_t STOP_GRACE_MS = 5000;         // For stopped sub-agents to wind down
+
+const char* SUBAGENT_PROMPT =
+    "\n\n## Sub-agent\n"
+    "You are a sub-agent working on one part of a larger task. Do only that part, "
+    "using tools as needed. Your reply goes back to the agent that started you, not "
+    "to the user: state your findings completely and concisely, with sources.";
+
+// One spawn_subagents call. The sub-agents' callbacks hold it too, so a call
+// that stops waiting for stragglers leaves them something to write to.
+struct FanOut {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::string> prompts;
+    std::vector<std::string> session_keys;
+    std::vector<std::vector<ConversationMessage> > histories;   // Never resized: runs hold references
+    std::vector<AgentResult> results;
+    std::vector<bool> finished;
+    size_t next;
+    size_t running;
+    size_t queued;              // Pool tasks not yet started
+    size_t done;
+    size_t max_running;
+    AIPlugin* ai;
+    std::string system_prompt;
+    AgentConfig config;
+
+    // Stopping: checked by the waiting call and, while it runs a sub-agent
+    // itself, by a reactor tick
+    const std::atomic<bool>* caller_cancel;    // Valid while watching
+    bool watching;
+    int64_t deadline;
+    int64_t give_up;            // Stragglers are left behind after this (0 = not stopping)
+    bool cancelled;
+    bool timed_out;
+
+    FanOut()
+        : next(0), running(0), queued(0), done(0), max_running(1), ai(NULL)
+        , caller_cancel(NULL), watching(false), deadline(0), give_up(0)
+        , cancelled(false), timed_out(false) {}
+};
+
+void launch(const std::shared_ptr<FanOut>& fan);
+
+// Take the next unstarted sub-agent, within the concurrency cap (mutex held)
+bool claim(FanOut& fan, size_t& i) {
+    if (fan.next >= fan.prompts.size() || fan.running >= fan.max_running ||
+        fan.config.cancel->cancelled()) {
+        return false;
+    }
+    i = fan.next++;
+    fan.running++;
+    return true;
+}
+
+// Past the deadline or the caller was stopped: true once, when the
+// sub-agents should be cancelled (mutex held)
+bool should_stop(FanOut& fan) {
+    if (!fan.watching || fan.give_up > 0) return false;
+    int64_t now = current_timestamp_ms();
+    fan.cancelled = fan.caller_cancel && fan.caller_cancel->load();
+    if (!fan.cancelled && now < fan.deadline) return false;
+    fan.timed_out = !fan.cancelled;
+    fan.give_up = now + STOP_GRACE_MS;
+    return true;
+}
+
+// Runs on the reactor until the call stops watching
+void watch(const std::shared_ptr<FanOut>& fan) {
+    Application::instance().reactor().add_timer(static_cast<int>(WAIT_SLICE_MS), [fan]() {
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(fan->mutex);
+            if (!fan->watching) return;
+            stop = should_stop(*fan);
+        }
+        if (stop) fan->config.cancel->cancel();
+        watch(fan);
+    });
+}
+
+// Run sub-agent i on this thread. Model calls block it too: a run that
+// handed its worker back would need a free AGENT slot to resume, and the
+// slots may all be held by waiting callers.
+void run_one(const std::shared_ptr<FanOut>& fan, size_t i) {
+    AgentConfig config = fan->config;
+    config.session_key = fan->session_keys[i];
+    AgentResult result = Application::instance().agent().run(
+        fan->ai, fan->prompts[i], fan->histories[i], fan->system_prompt, config);
+    {
+        std::lock_guard<std::mutex> lock(fan->mutex);
+        fan->results[i] = result;
+        fan->finished[i] = true;
+        fan->running--;
+        fan->done++;
+    }
+    fan->cv.notify_all();
+    launch(fan);
+}
+
+// Queue pool tasks for the free slots. Each claims a sub-agent when it
+// starts; by then the waiting call may have taken it.
+void launch(const std::shared_ptr<FanOut>& fan) {
+    ThreadPool* pool = Application::instance().thread_pool();
+    if (!pool) return;          // The waiting call runs them all
+    size_t add = 0;
+    {
+        std::lock_guard<std::mutex> lock(fan->mutex);
+        if (fan->config.cancel->cancelled()) return;
+        size_t want = std::min(fan->max_running - fan->running, fan->prompts.size() - fan->next);
+        if (want > fan->queued) add = want - fan->queued;
+        fan->queued += add;
+    }
+    for (size_t n = 0; n < add; ++n) {
+        pool->enqueue(Task([fan]() {
+            size_t i = 0;
+            bool claimed;
+            {
+                std::lock_guard<std::mutex> lock(fan->mutex);
+                fan->queued--;
+                claimed = claim(*fan, i);
+            }
+            if (claimed) run_one(fan, i);
+        }), TaskPriority::AGENT);
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// Plugin Interface
+// ============================================================================
+
+SubagentTool::SubagentTool()
+    : max_tasks_(8)
+    , max_concurrent_(4)
+    , max_iterations_(8)
+    , timeout_secs_(300)
+    , next_id_(1) {}
+
+bool SubagentTool::init(const Config& cfg) {
+    max_tasks_ = static_cast<size_t>(std::max<int64_t>(1, cfg.get_int("subagents.max_tasks", 8)));
+    max_concurrent_ = static_cast<size_t>(std::max<int64_t>(1, cfg.get_int("subagents.max_concurrent", 4)));
+    max_iterations_ = static_cast<int>(std::max<int64_t>(1, cfg.get_int("subagents.max_iterations", 8)));
+    timeout_secs_ = static_cast<int>(std::max<int64_t>(1, cfg.get_int("subagents.timeout", 300)));
+    LOG_DEBUG("[Subagents] Up to %zu task(s) per call, %zu at once, %d iteration(s) each",
+              max_tasks_, max_concurrent_, max_iterations_);
+    initialized_ = true;
+    return true;
+}
+
+void SubagentTool::shutdown() {
+    initialized_ = false;
+}
+
+std::vector<std::string> SubagentTool::actions() const {
+    std::vector<std::string> acts;
+    acts.push_back("spawn");
+    return acts;
+}
+
+ToolResult SubagentTool::execute(const std::string& action, const Json& params) {
+    if (action != "spawn") {
+        return ToolResult::fail("Unknown action: " + action);
+    }
+    AgentToolResult result = do_spawn(params);
+    if (!result.success) {
+        return ToolResult::fail(result.error);
+    }
+    Json data;
+    data["output"] = result.output;
+    return ToolResult::ok(data);
+}
+
+std::vector<AgentTool> SubagentTool::get_agent_tools() const {
+    std::vector<AgentTool> tools;
+    SubagentTool* self = const_cast<SubagentTool*>(this);
+
+    AgentTool tool;
+    tool.name = "spawn_subagents";
+    tool.description =
+        "Split work into independent tasks and run each one as a separate sub-agent, all at the "
+        "same time. Each sub-agent has the same tools but starts with an empty conversation, so "
+        "every task must be self-contained. Returns every sub-agent's answer, numbered in task "
+        "order. Use this for research over several sources or items that do not depend on each "
+        "other (e.g. 'look up X on site A', 'look up X on site B'), instead of doing them one "
+        "after another. Up to " + std::to_string(max_tasks_) + " tasks per call.";
+    tool.params.push_back(ToolParamSchema(
+        "tasks", "array", "The task for each sub-agent: complete, self-contained instructions", true));
+    tool.params.push_back(ToolParamSchema(
+        "context", "string", "Background every sub-agent needs, prepended to each task (optional)", false));
+    tool.execute = [self](const Json& params) -> AgentToolResult {
+        return self->do_spawn(params);
+    };
+    tools.push_back(tool);
+    return tools;
+}
+
+// ============================================================================
+// spawn_subagents
+// ============================================================================
+
+AgentToolResult SubagentTool::do_spawn(const Json& params) {
+    const ToolCallContext* ctx = ToolCallContext::current();
+    if (ctx && SessionKey::is_subagent_key(ctx->session_key)) {
+        return AgentToolResult::fail("Sub-agents cannot spawn sub-agents: do this task yourself");
+    }
+
+    std::vector<std::string> tasks;
+    if (params.contains("tasks") && params["tasks"].is_array()) {
+        const Json& list = params["tasks"];
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (list[i].is_string() && !trim(list[i].get<std::string>()).empty()) {
+                tasks.push_back(list[i].get<std::string>());
+            }
+        }
+    }
+    if (tasks.empty()) {
+        return AgentToolResult::fail("Missing required parameter: tasks (non-empty array of task descriptions)");
+    }
+    if (tasks.size() > max_tasks_) {
+        return AgentToolResult::fail("Too many tasks: " + std::to_string(tasks.size()) +
+                                     " (at most " + std::to_string(max_tasks_) + " per call)");
+    }
+
+    Application& app = Application::instance();
+    AIPlugin* ai = app.registry().get_default_ai();
+    if (!ai || !ai->is_configured()) {
+        return AgentToolResult::fail("No AI provider configured");
+    }
+
+    std::string context = params.contains("context") && params["context"].is_string()
+        ? trim(params["context"].get<std::string>()) : std::string();
+    SessionKey::Parsed parent = SessionKey::parse(ctx ? ctx->session_key : std::string());
+    std::string agent_id = parent.valid ? parent.agent_id : SessionKey::DEFAULT_AGENT_ID;
+
+    std::shared_ptr<FanOut> fan = std::make_shared<FanOut>();
+    fan->ai = ai;
+    fan->system_prompt = app.system_prompt() + SUBAGENT_PROMPT;
+    fan->max_running = max_concurrent_;
+    fan->histories.resize(tasks.size());
+    fan->results.resize(tasks.size());
+    fan->finished.assign(tasks.size(), false);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        fan->prompts.push_back(context.empty() ? tasks[i] : context + "\n\nYour task: " + tasks[i]);
+        fan->session_keys.push_back(SessionKey::build_subagent(agent_id, next_id_.fetch_add(1)));
+    }
+
+    // The caller's tools and limits; its /stop, process group and account
+    fan->config = app.agent().config();
+    fan->config.max_iterations = max_iterations_;
+    fan->config.stream_replies = false;
+    fan->config.on_partial = nullptr;
+    fan->config.async_model_calls = false;
+    fan->config.cancel = std::make_shared<CancelToken>();
+    if (ctx) {
+        fan->config.user_key = ctx->user_key;
+        fan->config.cancel_key = ctx->cancel_key;
+        fan->config.on_progress = ctx->on_progress;
+        fan->caller_cancel = ctx->cancel;
+    }
+
+    LOG_INFO("[Subagents] %zu task(s), %zu at once", tasks.size(), std::min(max_concurrent_, tasks.size()));
+    int64_t started = current_timestamp_ms();
+    fan->deadline = started + static_cast<int64_t>(timeout_secs_) * 1000;
+    fan->watching = true;
+    app.reactor().post([fan]() { watch(fan); });
+    launch(fan);
+
+    // This call holds an AGENT worker while it waits, so it runs unstarted
+    // sub-agents itself: with every slot taken by waiting callers, their
+    // queued sub-agents would otherwise never start
+    std::vector<AgentResult> results;
+    std::vector<bool> finished;
+    bool cancelled;
+    bool timed_out;
+    {
+        std::unique_lock<std::mutex> lock(fan->mutex);
+        while (fan->done < tasks.size() && !(fan->give_up > 0 && fan->running == 0)) {
+            if (should_stop(*fan)) {
+                lock.unlock();
+                fan->config.cancel->cancel();
+                lock.lock();
+            } else if (fan->give_up > 0 && current_timestamp_ms() >= fan->give_up) {
+                break;      // Stragglers finish into fan on their own
+            }
+            size_t i = 0;
+            if (claim(*fan, i)) {
+                lock.unlock();
+                run_one(fan, i);
+                lock.lock();
+                continue;
+            }
+            fan->cv.wait_for(lock, std::chrono::milliseconds(WAIT_SLICE_MS));
+        }
+        fan->watching = false;
+        results = fan->results;
+        finished = fan->finished;
+        cancelled = fan->cancelled;
+        timed_out = fan->timed_out;
+    }
+    int64_t elapsed_ms = current_timestamp_ms() - started;
+
+    if (cancelled) {
+        return AgentToolResult::fail("Cancelled: the run was stopped");
+    }
+
+    size_t answered = 0;
+    std::ostringstream body;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        const AgentResult& r = results[i];
+        body << "### " << (i + 1) << ". " << truncate_safe(tasks[i], 160) << "\n";
+        if (!finished[i]) {
+            body << "(not finished within " << timeout_secs_ << "s)\n\n";
+        } else if (r.success) {
+            ++answered;
+            body << r.final_response << "\n\n";
+        } else if (r.paused) {
+            body << "(no final answer within " << max_iterations_ << " iterations)\n\n";
+        } else if (r.cancelled) {
+            body << "(stopped)\n\n";
+        } else {
+            body << "(failed: " << r.error << ")\n\n";
+        }
+    }
+    LOG_INFO("[Subagents] %zu/%zu answered in %lld ms%s", answered, tasks.size(),
+             static_cast<long long>(elapsed_ms), timed_out ? " (timed out)" : "");
+
+    char header[128];
+    snprintf(header, sizeof(header), "Sub-agent results: %zu of %zu answered in %.1fs\n\n",
+             answered, tasks.size(), static_cast<double>(elapsed_ms) / 1000.0);
+    return AgentToolResult::ok(header + body.str());
+}
+
+} // namespace opencrank
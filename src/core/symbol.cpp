@@ -0,0 +1,45 @@
+/*
+ * OpenCrank C++ - Interned Identifiers Implementation
+ */
+#include <opencrank/core/symbol.hpp>
+
+namespace opencrank {
+
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable::SymbolTable() {
+    names_.push_back(std::string());
+}
+
+Symbol SymbolTable::intern(const std::string& s) {
+    if (s.empty()) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, Symbol>::const_iterator it = ids_.find(s);
+    if (it != ids_.end()) return it->second;
+    Symbol symbol = static_cast<Symbol>(names_.size());
+    names_.push_back(s);
+    ids_.emplace(s, symbol);
+    return symbol;
+}
+
+Symbol SymbolTable::find(const std::string& s) const {
+    if (s.empty()) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, Symbol>::const_iterator it = ids_.find(s);
+    return it != ids_.end() ? it->second : 0;
+}
+
+const std::string& SymbolTable::name(Symbol symbol) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return symbol < names_.size() ? names_[symbol] : names_[0];
+}
+
+size_t SymbolTable::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_.size() - 1;
+}
+
+} // namespace opencrank
@@ -3,87 +3,248 @@
  */
 #include <opencrank/core/thread_pool.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/allocator.hpp>
+#include <opencrank/core/utils.hpp>
 
 namespace opencrank {
 
-ThreadPool::ThreadPool(size_t num_threads) : stop_(false) {
-    for (size_t i = 0; i < num_threads; ++i) {
-        threads_.emplace_back([this] { worker(); });
+namespace {
+    // Index of the pool worker running on this thread (-1 = not a worker)
+    thread_local long tls_worker_index = -1;
+    thread_local const ThreadPool* tls_worker_pool = nullptr;
+}
+
+const char* task_priority_name(TaskPriority priority) {
+    switch (priority) {
+        case TaskPriority::INTERACTIVE: return "interactive";
+        case TaskPriority::AGENT: return "agent";
+        case TaskPriority::BACKGROUND: return "background";
+        default: return "unknown";
     }
-    LOG_INFO("Thread pool started with %zu workers", num_threads);
+}
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : active_(0), active_agent_(0), next_queue_(0), max_agent_workers_(0), stop_(false) {
+    start(num_threads);
+}
+
+ThreadPool::ThreadPool(const ThreadPoolConfig& config)
+    : active_(0), active_agent_(0), next_queue_(0), max_agent_workers_(config.max_agent_workers), stop_(false) {
+    size_t num_threads = config.num_threads;
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    start(num_threads);
 }
 
 ThreadPool::~ThreadPool() {
     shutdown();
 }
 
-void ThreadPool::enqueue(std::function<void()> task) {
+void ThreadPool::start(size_t num_threads) {
+    if (num_threads == 0) num_threads = 1;
+
+    // Most tasks are picked up within a millisecond; the tail is what matters
+    static const double wait_bounds[] = { 0.0005, 0.001, 0.005, 0.025, 0.1, 0.5, 1, 5, 30, 120 };
+    std::vector<double> bounds(wait_bounds, wait_bounds + sizeof(wait_bounds) / sizeof(wait_bounds[0]));
+    for (size_t lane = 0; lane < NUM_LANES; ++lane) {
+        lane_pending_[lane] = 0;
+        wait_seconds_[lane] = &Metrics::instance().histogram(
+            "opencrank_pool_wait_seconds", "Time tasks spent queued before a worker took them",
+            metric_labels("lane", task_priority_name(static_cast<TaskPriority>(lane))), bounds);
+    }
+
+    // Keep one worker free for interactive/background work unless configured otherwise
+    if (max_agent_workers_ == 0 || max_agent_workers_ > num_threads) {
+        max_agent_workers_ = num_threads > 1 ? num_threads - 1 : 1;
+    }
+
+    for (size_t i = 0; i < num_threads; ++i) {
+        queues_.emplace_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads_.emplace_back([this, i] { worker(i); });
+    }
+    LOG_INFO("Thread pool started with %zu workers (max %zu concurrent agent runs)",
+             num_threads, max_agent_workers_);
+}
+
+void ThreadPool::enqueue(Task task, TaskPriority priority) {
+    if (!task) return;
+    if (stop_) {
+        LOG_WARN("Cannot enqueue task - thread pool is stopped");
+        return;
+    }
+
+    // Prefer the calling worker's own deque (keeps follow-up work local);
+    // otherwise spread round-robin so producers don't contend on one lock.
+    size_t index;
+    if (tls_worker_pool == this && tls_worker_index >= 0) {
+        index = static_cast<size_t>(tls_worker_index);
+    } else {
+        index = next_queue_.fetch_add(1) % queues_.size();
+    }
+
+    size_t lane = static_cast<size_t>(priority);
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (stop_) {
-            LOG_WARN("Cannot enqueue task - thread pool is stopped");
-            return;
-        }
-        tasks_.push(task);
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        QueuedTask queued;
+        queued.task = std::move(task);
+        queued.enqueued_us = steady_us();
+        queues_[index]->lanes[lane].push_back(std::move(queued));
     }
-    condition_.notify_one();
+    lane_pending_[lane].fetch_add(1);
+    wake_one();
 }
 
 size_t ThreadPool::pending() const {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return tasks_.size();
+    size_t total = 0;
+    for (size_t lane = 0; lane < NUM_LANES; ++lane) {
+        total += lane_pending_[lane].load();
+    }
+    return total;
+}
+
+size_t ThreadPool::pending(TaskPriority priority) const {
+    return lane_pending_[static_cast<size_t>(priority)].load();
 }
 
 void ThreadPool::shutdown() {
     {
-        std::unique_lock<std::mutex> lock(mutex_);
+        std::lock_guard<std::mutex> lock(idle_mutex_);
         if (stop_) return;  // Already stopped
         stop_ = true;
     }
-    
+
     condition_.notify_all();
-    
+
     for (std::thread& thread : threads_) {
         if (thread.joinable()) {
             thread.join();
         }
     }
-    
+
     LOG_INFO("Thread pool shutdown complete");
 }
 
-void ThreadPool::worker() {
+void ThreadPool::wake_one() {
+    // Taking the idle lock orders this wakeup after a sleeper's predicate check
+    { std::lock_guard<std::mutex> lock(idle_mutex_); }
+    condition_.notify_one();
+}
+
+void ThreadPool::wake_all() {
+    { std::lock_guard<std::mutex> lock(idle_mutex_); }
+    condition_.notify_all();
+}
+
+bool ThreadPool::has_runnable() const {
+    if (lane_pending_[static_cast<size_t>(TaskPriority::INTERACTIVE)].load() > 0) return true;
+    if (lane_pending_[static_cast<size_t>(TaskPriority::BACKGROUND)].load() > 0) return true;
+    return lane_pending_[static_cast<size_t>(TaskPriority::AGENT)].load() > 0 &&
+           active_agent_.load() < max_agent_workers_;
+}
+
+bool ThreadPool::take_from(WorkerQueue& queue, size_t lane, bool steal, Task& out, int64_t& enqueued_us) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    std::deque<QueuedTask>& dq = queue.lanes[lane];
+    if (dq.empty()) return false;
+
+    // Owner takes the oldest task (FIFO per worker); thieves take from the back
+    QueuedTask& queued = steal ? dq.back() : dq.front();
+    out = std::move(queued.task);
+    enqueued_us = queued.enqueued_us;
+    if (steal) {
+        dq.pop_back();
+    } else {
+        dq.pop_front();
+    }
+    return true;
+}
+
+bool ThreadPool::try_take(size_t index, Task& out, size_t& lane_out) {
+    const size_t n = queues_.size();
+
+    for (size_t lane = 0; lane < NUM_LANES; ++lane) {
+        if (lane_pending_[lane].load() == 0) continue;
+
+        // Reserve an agent slot before taking an AGENT task
+        bool agent_lane = (lane == static_cast<size_t>(TaskPriority::AGENT));
+        if (agent_lane) {
+            size_t running = active_agent_.load();
+            do {
+                if (running >= max_agent_workers_) break;
+            } while (!active_agent_.compare_exchange_weak(running, running + 1));
+            if (running >= max_agent_workers_) continue;
+        }
+
+        int64_t enqueued_us = 0;
+        bool found = take_from(*queues_[index], lane, false, out, enqueued_us);
+        for (size_t k = 1; !found && k < n; ++k) {
+            found = take_from(*queues_[(index + k) % n], lane, true, out, enqueued_us);
+        }
+
+        if (found) {
+            lane_pending_[lane].fetch_sub(1);
+            wait_seconds_[lane]->observe(static_cast<double>(steady_us() - enqueued_us) / 1e6);
+            lane_out = lane;
+            return true;
+        }
+
+        if (agent_lane) {
+            active_agent_.fetch_sub(1);
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker(size_t index) {
+    tls_worker_index = static_cast<long>(index);
+    tls_worker_pool = this;
+    allocator::init_thread();
+
     while (true) {
-        std::function<void()> task;
-        
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            
-            // Wait for a task or stop signal
-            condition_.wait(lock, [this] { 
-                return stop_ || !tasks_.empty(); 
+        Task task;
+        size_t lane = 0;
+
+        if (!try_take(index, task, lane)) {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+
+            // Wait for a runnable task, or for the queues to drain on shutdown
+            condition_.wait(lock, [this] {
+                return has_runnable() || (stop_ && pending() == 0);
             });
-            
-            if (stop_ && tasks_.empty()) {
+
+            if (stop_ && pending() == 0) {
                 return;  // Exit thread
             }
-            
-            if (!tasks_.empty()) {
-                task = tasks_.front();
-                tasks_.pop();
-            }
+            continue;
+        }
+
+        // Execute task outside any lock
+        active_.fetch_add(1);
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Thread pool task threw exception: %s", e.what());
+        } catch (...) {
+            LOG_ERROR("Thread pool task threw unknown exception");
         }
-        
-        // Execute task outside the lock
-        if (task) {
-            try {
-                task();
-            } catch (const std::exception& e) {
-                LOG_ERROR("Thread pool task threw exception: %s", e.what());
-            } catch (...) {
-                LOG_ERROR("Thread pool task threw unknown exception");
+        active_.fetch_sub(1);
+
+        if (lane == static_cast<size_t>(TaskPriority::AGENT)) {
+            active_agent_.fetch_sub(1);
+            // A freed agent slot may unblock a waiting AGENT task
+            if (lane_pending_[lane].load() > 0) {
+                wake_one();
             }
         }
+
+        // Let idle workers re-check the exit condition while draining
+        if (stop_) {
+            wake_all();
+        }
     }
 }
 
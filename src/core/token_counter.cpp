@@ -0,0 +1,356 @@
+/*
+ * OpenCrank C++ - Token Counters Implementation
+ */
+#include <opencrank/core/token_counter.hpp>
+#include <opencrank/core/config.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <atomic>
+#include <fstream>
+#include <cstdlib>
+
+namespace opencrank {
+
+namespace {
+
+std::atomic<int> next_counter_id(1);
+
+const size_t MAX_PIECE_CACHE = 100000;
+const long long SERVER_RETRY_MS = 30000;
+
+inline bool is_alpha(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline bool is_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+inline bool is_newline(unsigned char c) {
+    return c == '\n' || c == '\r';
+}
+
+// Multi-byte UTF-8 is treated as letters, like \p{L} in the tiktoken pattern
+inline bool is_letter(unsigned char c) {
+    return is_alpha(c) || c >= 0x80;
+}
+
+inline bool is_punct(unsigned char c) {
+    return !is_space(c) && !is_letter(c) && !is_digit(c);
+}
+
+// Length of an English contraction ('s 't 'm 'd 're 've 'll) at pos, or 0
+size_t contraction_len(const std::string& text, size_t pos) {
+    if (pos + 1 >= text.size() || text[pos] != '\'') return 0;
+    char a = static_cast<char>(text[pos + 1] | 0x20);
+    if (a == 's' || a == 't' || a == 'm' || a == 'd') return 2;
+    if (pos + 2 >= text.size()) return 0;
+    char b = static_cast<char>(text[pos + 2] | 0x20);
+    if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')) return 3;
+    return 0;
+}
+
+// Split text the way cl100k's pre-tokenizer regex does (ASCII approximation)
+void pre_tokenize(const std::string& text, std::vector<std::string>& pieces) {
+    size_t n = text.size();
+    size_t i = 0;
+    while (i < n) {
+        size_t start = i;
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        size_t clen = contraction_len(text, i);
+
+        if (clen > 0) {
+            i += clen;
+        } else if (is_letter(c) ||
+                   (!is_digit(c) && !is_newline(c) && i + 1 < n &&
+                    is_letter(static_cast<unsigned char>(text[i + 1])))) {
+            // Optional one-char prefix (usually a space) + letters
+            if (!is_letter(c)) i++;
+            while (i < n && is_letter(static_cast<unsigned char>(text[i]))) i++;
+        } else if (is_digit(c)) {
+            size_t run = 0;
+            while (i < n && run < 3 && is_digit(static_cast<unsigned char>(text[i]))) {
+                i++;
+                run++;
+            }
+        } else if (is_space(c)) {
+            size_t end = i;
+            size_t last_newline = std::string::npos;
+            while (end < n && is_space(static_cast<unsigned char>(text[end]))) {
+                if (is_newline(static_cast<unsigned char>(text[end]))) last_newline = end;
+                end++;
+            }
+            if (last_newline != std::string::npos) {
+                i = last_newline + 1;
+            } else if (end < n && end - i > 1) {
+                i = end - 1;  // Last space joins the following piece
+            } else if (end < n && c == ' ' && is_punct(static_cast<unsigned char>(text[end]))) {
+                i = end;
+                while (i < n && is_punct(static_cast<unsigned char>(text[i]))) i++;
+                while (i < n && is_newline(static_cast<unsigned char>(text[i]))) i++;
+            } else {
+                i = end;
+            }
+        } else {
+            while (i < n && is_punct(static_cast<unsigned char>(text[i]))) i++;
+            while (i < n && is_newline(static_cast<unsigned char>(text[i]))) i++;
+        }
+
+        if (i == start) i++;  // Defensive: always make progress
+        pieces.push_back(text.substr(start, i - start));
+    }
+}
+
+int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+std::string base64_decode(const std::string& in) {
+    std::string out;
+    out.reserve(in.size() * 3 / 4);
+    unsigned int buffer = 0;
+    int bits = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        int v = base64_value(in[i]);
+        if (v < 0) continue;  // Padding / whitespace
+        buffer = (buffer << 6) | static_cast<unsigned int>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((buffer >> bits) & 0xFF);
+        }
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// TokenCounter
+// ============================================================================
+
+TokenCounter::TokenCounter() : id_(next_counter_id.fetch_add(1)) {}
+
+// ============================================================================
+// ApproxTokenCounter
+// ============================================================================
+
+size_t ApproxTokenCounter::count(const std::string& text) const {
+    size_t tokens = 0;
+    size_t half_tokens = 0;  // Two-byte UTF-8 chars (Cyrillic, Greek, accents)
+    size_t n = text.size();
+    size_t i = 0;
+
+    while (i < n) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (is_alpha(c)) {
+            size_t len = 0;
+            while (i < n && is_alpha(static_cast<unsigned char>(text[i]))) { i++; len++; }
+            tokens += (len + 5) / 6;        // Common words are one token
+        } else if (is_digit(c)) {
+            size_t len = 0;
+            while (i < n && is_digit(static_cast<unsigned char>(text[i]))) { i++; len++; }
+            tokens += (len + 2) / 3;        // Digits group in threes
+        } else if (c == ' ' && i + 1 < n &&
+                   !is_space(static_cast<unsigned char>(text[i + 1]))) {
+            i++;                            // Leading space merges into the next token
+        } else if (is_space(c)) {
+            while (i < n && is_space(static_cast<unsigned char>(text[i]))) i++;
+            tokens += 1;                    // Indentation / blank lines
+        } else if (c < 0x80) {
+            size_t len = 0;
+            while (i < n && static_cast<unsigned char>(text[i]) == c) { i++; len++; }
+            tokens += (len + 3) / 4;        // "====" style runs merge
+        } else {
+            size_t seq = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+            if (seq == 4) tokens += 2;      // Emoji and rare symbols
+            else if (seq == 3) tokens += 1; // CJK: roughly one token per character
+            else half_tokens += 1;
+            i += seq;
+        }
+    }
+    return tokens + (half_tokens + 1) / 2;
+}
+
+// ============================================================================
+// BpeTokenCounter
+// ============================================================================
+
+bool BpeTokenCounter::load(const std::string& path) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        LOG_WARN("[Tokenizer] Cannot open BPE vocabulary: %s", path.c_str());
+        return false;
+    }
+
+    std::unordered_map<std::string, int> ranks;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos || space == 0) continue;
+        std::string token = base64_decode(line.substr(0, space));
+        if (token.empty()) continue;
+        ranks[token] = std::atoi(line.c_str() + space + 1);
+    }
+    if (ranks.empty()) {
+        LOG_WARN("[Tokenizer] BPE vocabulary is empty: %s", path.c_str());
+        return false;
+    }
+
+    ranks_.swap(ranks);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        piece_cache_.clear();
+    }
+    loaded_ = true;
+    LOG_INFO("[Tokenizer] Loaded BPE vocabulary: %zu tokens from %s", ranks_.size(), path.c_str());
+    return true;
+}
+
+size_t BpeTokenCounter::count_piece(const std::string& piece) const {
+    if (ranks_.count(piece)) return 1;
+
+    // Byte-level merge: repeatedly join the adjacent pair with the lowest rank
+    std::vector<std::string> parts;
+    parts.reserve(piece.size());
+    for (size_t i = 0; i < piece.size(); ++i) {
+        parts.push_back(std::string(1, piece[i]));
+    }
+
+    while (parts.size() > 1) {
+        int best_rank = -1;
+        size_t best = 0;
+        for (size_t i = 0; i + 1 < parts.size(); ++i) {
+            std::unordered_map<std::string, int>::const_iterator it = ranks_.find(parts[i] + parts[i + 1]);
+            if (it != ranks_.end() && (best_rank < 0 || it->second < best_rank)) {
+                best_rank = it->second;
+                best = i;
+            }
+        }
+        if (best_rank < 0) break;
+        parts[best] += parts[best + 1];
+        parts.erase(parts.begin() + best + 1);
+    }
+    return parts.size();
+}
+
+size_t BpeTokenCounter::count(const std::string& text) const {
+    if (!loaded_) return fallback_.count(text);
+
+    std::vector<std::string> pieces;
+    pre_tokenize(text, pieces);
+
+    size_t total = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex_);
+            std::unordered_map<std::string, size_t>::const_iterator it = piece_cache_.find(pieces[i]);
+            if (it != piece_cache_.end()) {
+                total += it->second;
+                continue;
+            }
+        }
+
+        size_t n = count_piece(pieces[i]);
+        total += n;
+
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        if (piece_cache_.size() >= MAX_PIECE_CACHE) piece_cache_.clear();
+        piece_cache_[pieces[i]] = n;
+    }
+    return total;
+}
+
+// ============================================================================
+// LlamaTokenCounter
+// ============================================================================
+
+LlamaTokenCounter::LlamaTokenCounter(const std::string& server_url, const std::string& api_key)
+    : url_(server_url)
+    , api_key_(api_key)
+    , retry_after_ms_(0)
+{
+    while (!url_.empty() && url_[url_.size() - 1] == '/') url_.erase(url_.size() - 1);
+}
+
+size_t LlamaTokenCounter::count(const std::string& text) const {
+    if (text.empty()) return 0;
+
+    long long now = static_cast<long long>(current_timestamp_ms());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (now < retry_after_ms_) return fallback_.count(text);
+    }
+
+    Json body = Json::object();
+    body["content"] = text;
+    body["add_special"] = false;
+
+    std::map<std::string, std::string> headers;
+    if (!api_key_.empty()) {
+        headers["Authorization"] = "Bearer " + api_key_;
+    }
+
+    HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+    http->set_timeout(5000);
+    HttpResponse resp = http->post_json(url_ + "/tokenize", body, headers);
+
+    if (resp.ok()) {
+        Json j = resp.json();
+        if (j.is_object() && j.contains("tokens") && j["tokens"].is_array()) {
+            return j["tokens"].size();
+        }
+    }
+
+    LOG_WARN("[Tokenizer] %s/tokenize failed (HTTP %d), using approximate counts for %llds",
+             url_.c_str(), resp.status_code, SERVER_RETRY_MS / 1000);
+    std::lock_guard<std::mutex> lock(mutex_);
+    retry_after_ms_ = now + SERVER_RETRY_MS;
+    return fallback_.count(text);
+}
+
+// ============================================================================
+// Factory
+// ============================================================================
+
+std::shared_ptr<TokenCounter> create_token_counter(
+    const Config& cfg,
+    const std::string& section,
+    const std::string& default_kind,
+    const std::string& server_url,
+    const std::string& api_key)
+{
+    std::string kind = to_lower(cfg.get_string(section + ".tokenizer", default_kind));
+
+    if (kind == "server" && !server_url.empty()) {
+        LOG_INFO("[Tokenizer] %s: counting tokens with %s/tokenize", section.c_str(), server_url.c_str());
+        return std::make_shared<LlamaTokenCounter>(server_url, api_key);
+    }
+
+    if (kind == "bpe") {
+        std::string vocab = cfg.get_string(section + ".tokenizer_vocab", "");
+        std::shared_ptr<BpeTokenCounter> bpe = std::make_shared<BpeTokenCounter>();
+        if (!vocab.empty() && bpe->load(vocab)) {
+            return bpe;
+        }
+        LOG_WARN("[Tokenizer] %s: BPE tokenizer needs %s.tokenizer_vocab, using approximation",
+                 section.c_str(), section.c_str());
+    } else if (kind != "approx") {
+        LOG_WARN("[Tokenizer] %s: unknown tokenizer '%s', using approximation",
+                 section.c_str(), kind.c_str());
+    }
+
+    return std::make_shared<ApproxTokenCounter>();
+}
+
+} // namespace opencrank
@@ -0,0 +1,503 @@
+/*
+ * opencrank C++ - Tool Call Scanner Implementation
+ */
+#include <opencrank/core/tool_call_scanner.hpp>
+#include <opencrank/core/logger.hpp>
+#include <cstdio>
+#include <utility>
+
+namespace opencrank {
+
+namespace {
+
+// A top-level "tool" key further than this from its '{' is not a tool call
+const size_t kToolKeyWindow = 200;
+
+const size_t kMaxKeyCapture = 32;
+const size_t kMaxToolNameCapture = 128;
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Parse repaired text, keeping the parser's message for failures only
+bool parse_repaired(const char* begin, const char* end, Json& out, std::string& error) {
+    out = Json::parse(begin, end, nullptr, false);
+    if (!out.is_discarded()) {
+        return true;
+    }
+    try {
+        Json reparsed = Json::parse(begin, end);
+        (void)reparsed;
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    if (error.empty()) error = "invalid JSON";
+    return false;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// JsonRepairer
+// ============================================================================
+
+JsonRepairer::JsonRepairer()
+    : src_(NULL)
+    , start_(0)
+    , end_(0)
+    , comma_at_(0)
+    , clean_(true)
+    , in_string_(false)
+    , escape_(false)
+    , string_is_key_(false)
+    , expect_key_(false)
+    , pending_comma_(false)
+    , seen_token_(false)
+    , has_tool_(false)
+    , tool_value_next_(false)
+    , capture_(0) {}
+
+void JsonRepairer::begin(const std::string& text, size_t at) {
+    src_ = &text;
+    start_ = at;
+    end_ = at + 1;
+    comma_at_ = 0;
+    clean_ = true;
+    out_.clear();
+    stack_.clear();
+    in_string_ = false;
+    escape_ = false;
+    string_is_key_ = false;
+    pending_comma_ = false;
+    has_tool_ = false;
+    tool_value_next_ = false;
+    capture_ = 0;
+    key_.clear();
+    tool_name_.clear();
+
+    bool object = text[at] == '{';
+    stack_.push_back(object ? OBJECT : ARRAY);
+    expect_key_ = object;
+    seen_token_ = !object;
+}
+
+void JsonRepairer::dirty(size_t at) {
+    if (clean_) {
+        out_.assign(*src_, start_, at - start_);
+        clean_ = false;
+    }
+}
+
+int JsonRepairer::closes_string(const std::string& text, size_t i, bool at_end) const {
+    // The quote ends the string if what follows is structure: a comma
+    // before the next key or element, or closers that end the containers
+    // actually open ({"cmd": "echo '{"a": "b"}' x"} stays one string)
+    size_t depth = stack_.size();
+    size_t j = i + 1;
+    while (true) {
+        while (j < text.size() && is_space(text[j])) ++j;
+        if (j >= text.size()) {
+            return at_end ? 1 : -1;
+        }
+        char next = text[j];
+        if (next == '}' || next == ']') {
+            if (--depth == 0) {
+                return 1;   // Closes the call; prose may follow
+            }
+            ++j;
+            continue;
+        }
+        if (next != ',') {
+            return 0;
+        }
+        ++j;
+        while (j < text.size() && is_space(text[j])) ++j;
+        if (j >= text.size()) {
+            return at_end ? 1 : -1;
+        }
+        next = text[j];
+        if (stack_[depth - 1] == OBJECT) {
+            return (next == '"' || next == '}') ? 1 : 0;
+        }
+        return (next == '"' || next == '{' || next == '[' || next == ']' || next == '-' ||
+                (next >= '0' && next <= '9') || next == 't' || next == 'f' || next == 'n') ? 1 : 0;
+    }
+}
+
+JsonRepairer::Status JsonRepairer::run(const std::string& text, size_t& pos, bool at_end, size_t tool_within) {
+    src_ = &text;
+    Status status = scan(text, pos, at_end, tool_within);
+    end_ = pos;
+    return status;
+}
+
+JsonRepairer::Status JsonRepairer::scan(const std::string& text, size_t& pos, bool at_end, size_t tool_within) {
+    while (pos < text.size()) {
+        if (tool_within && !has_tool_ && pos - start_ >= tool_within) {
+            return NO_TOOL;
+        }
+        char c = text[pos];
+
+        if (in_string_) {
+            if (escape_) {
+                escape_ = false;
+                switch (c) {
+                    case '"': case '\\': case '/': case 'b': case 'f':
+                    case 'n': case 'r': case 't': case 'u':
+                        put('\\');
+                        put(c);
+                        ++pos;
+                        continue;
+                    default:
+                        // Lone backslash ("C:\path"): keep it as a character
+                        dirty(pos - 1);
+                        out_ += "\\\\";
+                        continue;   // c itself is handled as ordinary text
+                }
+            }
+            if (c == '\\') {
+                escape_ = true;
+                ++pos;
+                continue;
+            }
+            if (c == '"') {
+                int closes = string_is_key_ ? 1 : closes_string(text, pos, at_end);
+                if (closes < 0) {
+                    return NEED_MORE;   // Resume at this quote
+                }
+                if (closes == 0) {
+                    // Unescaped quote inside a value
+                    dirty(pos);
+                    out_ += "\\\"";
+                    if (capture_ == 2 && tool_name_.size() < kMaxToolNameCapture) tool_name_ += c;
+                    ++pos;
+                    continue;
+                }
+                put('"');
+                ++pos;
+                in_string_ = false;
+                if (capture_ == 1 && key_ == "tool") {
+                    has_tool_ = true;
+                    tool_value_next_ = true;
+                }
+                capture_ = 0;
+                continue;
+            }
+
+            unsigned char uc = static_cast<unsigned char>(c);
+            if (uc < 0x20) {
+                // Raw control characters are not allowed inside JSON strings
+                dirty(pos);
+                switch (c) {
+                    case '\n': out_ += "\\n"; break;
+                    case '\r': out_ += "\\r"; break;
+                    case '\t': out_ += "\\t"; break;
+                    default: {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", uc);
+                        out_ += buf;
+                    }
+                }
+            } else if (capture_ == 0) {
+                // Copy the run of plain characters up to the next one of interest
+                size_t end = pos + 1;
+                while (end < text.size()) {
+                    char d = text[end];
+                    if (d == '"' || d == '\\' || static_cast<unsigned char>(d) < 0x20) break;
+                    ++end;
+                }
+                if (!clean_) out_.append(text, pos, end - pos);
+                pos = end;
+                continue;
+            } else {
+                put(c);
+                if (capture_ == 1 && key_.size() < kMaxKeyCapture) key_ += c;
+                else if (capture_ == 2 && tool_name_.size() < kMaxToolNameCapture) tool_name_ += c;
+            }
+            ++pos;
+            continue;
+        }
+
+        if (is_space(c)) {
+            ++pos;
+            continue;
+        }
+
+        bool top_level = stack_.size() == 1;
+        if (!seen_token_) {
+            // Prose in braces ("{like this}") is not an object
+            if (c != '"' && c != '}') {
+                return NOT_JSON;
+            }
+            seen_token_ = true;
+        }
+
+        if (pending_comma_) {
+            pending_comma_ = false;
+            if (c == '}' || c == ']') {
+                dirty(comma_at_);   // Trailing comma
+            } else {
+                put(',');
+            }
+        }
+
+        switch (c) {
+            case '"':
+                in_string_ = true;
+                string_is_key_ = stack_.back() == OBJECT && expect_key_;
+                capture_ = 0;
+                if (top_level && string_is_key_) {
+                    capture_ = 1;
+                    key_.clear();
+                } else if (top_level && tool_value_next_) {
+                    capture_ = 2;
+                    tool_name_.clear();
+                    tool_value_next_ = false;
+                }
+                put('"');
+                break;
+            case '{':
+                stack_.push_back(OBJECT);
+                expect_key_ = true;
+                put(c);
+                break;
+            case '[':
+                stack_.push_back(ARRAY);
+                expect_key_ = false;
+                put(c);
+                break;
+            case '}':
+            case ']': {
+                // A mismatched closer closes whatever is open
+                char closer = stack_.back() == OBJECT ? '}' : ']';
+                if (c != closer) dirty(pos);
+                put(closer);
+                stack_.pop_back();
+                expect_key_ = false;
+                if (stack_.empty()) {
+                    ++pos;
+                    return DONE;
+                }
+                break;
+            }
+            case ':':
+                expect_key_ = false;
+                put(c);
+                break;
+            case ',':
+                pending_comma_ = true;   // Dropped if a closer follows
+                comma_at_ = pos;
+                expect_key_ = stack_.back() == OBJECT;
+                if (top_level) tool_value_next_ = false;
+                break;
+            default:
+                put(c);   // Numbers and literals
+                break;
+        }
+        ++pos;
+    }
+    return NEED_MORE;
+}
+
+void JsonRepairer::close_open() {
+    // Cut a pending comma or a lone trailing backslash
+    dirty(pending_comma_ ? comma_at_ : (escape_ ? end_ - 1 : end_));
+    pending_comma_ = false;
+    if (in_string_) {
+        out_ += '"';
+        in_string_ = false;
+        escape_ = false;
+    } else {
+        while (!out_.empty() && is_space(out_[out_.size() - 1])) {
+            out_.erase(out_.size() - 1);
+        }
+    }
+    while (!stack_.empty()) {
+        if (!out_.empty() && out_[out_.size() - 1] == ':') {
+            out_ += "null";
+        }
+        out_ += stack_.back() == OBJECT ? '}' : ']';
+        stack_.pop_back();
+    }
+}
+
+void JsonRepairer::output(std::string& out) const {
+    if (clean_) {
+        out.assign(*src_, start_, end_ - start_);
+    } else {
+        out = out_;
+    }
+}
+
+bool JsonRepairer::parse(Json& out, std::string& error) const {
+    if (!clean_) {
+        return parse_repaired(out_.data(), out_.data() + out_.size(), out, error);
+    }
+    // Nothing needed repair: parse straight from the source text
+    const char* begin = src_->data() + start_;
+    return parse_repaired(begin, begin + (end_ - start_), out, error);
+}
+
+bool repair_json(const std::string& text, std::string& out) {
+    size_t at = text.find_first_of("{[");
+    if (at == std::string::npos) {
+        return false;
+    }
+
+    JsonRepairer repairer;
+    repairer.begin(text, at);
+    size_t pos = at + 1;
+    JsonRepairer::Status status = repairer.run(text, pos, true);
+    if (status == JsonRepairer::NOT_JSON) {
+        // Leave it to the parser to explain
+        out.assign(text, at, std::string::npos);
+        return true;
+    }
+    if (status != JsonRepairer::DONE) {
+        repairer.close_open();
+    }
+    repairer.output(out);
+    return true;
+}
+
+bool parse_json_tolerant(const std::string& text, Json& out, std::string& error) {
+    std::string repaired;
+    if (!repair_json(text, repaired)) {
+        error = "no JSON object found";
+        return false;
+    }
+    return parse_repaired(repaired.data(), repaired.data() + repaired.size(), out, error);
+}
+
+// ============================================================================
+// ToolCallScanner
+// ============================================================================
+
+ToolCallScanner::ToolCallScanner() : pos_(0), in_candidate_(false) {}
+
+size_t ToolCallScanner::feed(const char* data, size_t len) {
+    text_.append(data, len);
+    return scan(false);
+}
+
+size_t ToolCallScanner::finish() {
+    return scan(true);
+}
+
+size_t ToolCallScanner::scan(bool at_end) {
+    size_t added = 0;
+    while (true) {
+        if (!in_candidate_) {
+            size_t brace = text_.find('{', pos_);
+            if (brace == std::string::npos) {
+                pos_ = text_.size();
+                break;
+            }
+            candidate_.begin(text_, brace);
+            pos_ = brace + 1;
+            in_candidate_ = true;
+        }
+
+        size_t pos = pos_;
+        JsonRepairer::Status status = candidate_.run(text_, pos, at_end, kToolKeyWindow);
+        if (status == JsonRepairer::DONE) {
+            // A complete object without a tool key holds no calls either
+            in_candidate_ = false;
+            pos_ = pos;
+            if (candidate_.has_tool() && add_call(pos)) {
+                ++added;
+            }
+            continue;
+        }
+        if (status == JsonRepairer::NEED_MORE && !at_end) {
+            pos_ = pos;
+            break;
+        }
+        if (status == JsonRepairer::NEED_MORE && candidate_.has_tool()) {
+            // Output ended inside a call (max_tokens): close it and try
+            candidate_.close_open();
+            Json probe;
+            std::string error;
+            if (candidate_.parse(probe, error)) {
+                in_candidate_ = false;
+                pos_ = text_.size();
+                if (add_call(text_.size())) ++added;
+                continue;
+            }
+        }
+
+        // Not a call after all: try the next '{' after this one
+        in_candidate_ = false;
+        pos_ = candidate_.start() + 1;
+    }
+    return added;
+}
+
+bool ToolCallScanner::add_call(size_t end) {
+    ParsedToolCall call;
+    call.start_pos = candidate_.start();
+    call.end_pos = end;
+    call.raw_content = text_.substr(call.start_pos, end - call.start_pos);
+
+    Json parsed;
+    std::string error;
+    if (!candidate_.parse(parsed, error) || !parsed.is_object()) {
+        // Keep the call so the model hears what went wrong with it
+        call.tool_name = candidate_.tool_name();
+        call.valid = false;
+        call.parse_error = error.empty() ? "tool call is not a JSON object" : error;
+        LOG_DEBUG("Tool call '%s' at %zu did not parse: %s",
+                  call.tool_name.c_str(), call.start_pos, call.parse_error.c_str());
+        if (call.tool_name.empty()) {
+            return false;
+        }
+        calls_.push_back(std::move(call));
+        return true;
+    }
+
+    Json::const_iterator tool = parsed.find("tool");
+    if (tool != parsed.end() && tool->is_string()) {
+        call.tool_name = tool->get<std::string>();
+    }
+    if (call.tool_name.empty()) {
+        LOG_DEBUG("JSON has 'tool' key but no name, skipping");
+        return false;
+    }
+
+    Json::iterator args = parsed.find("arguments");
+    if (args != parsed.end() && args->is_object()) {
+        call.params.swap(*args);
+        call.valid = true;
+    } else if (args != parsed.end() && args->is_string()) {
+        // Some models send the arguments as a JSON string
+        const std::string& args_str = args->get_ref<const std::string&>();
+        Json args_parsed;
+        std::string args_error;
+        if (parse_json_tolerant(args_str, args_parsed, args_error) && args_parsed.is_object()) {
+            call.params = args_parsed;
+            call.valid = true;
+            LOG_DEBUG("Parsed stringified arguments for '%s'", call.tool_name.c_str());
+        } else {
+            call.valid = false;
+            call.parse_error = "Arguments field is a string but not valid JSON: " + args_str;
+            LOG_WARN(" Failed to parse stringified arguments for '%s'", call.tool_name.c_str());
+        }
+    } else {
+        // Parameters at the top level, next to "tool"
+        call.params = Json::object();
+        for (Json::const_iterator it = parsed.begin(); it != parsed.end(); ++it) {
+            if (it.key() != "tool") {
+                call.params[it.key()] = it.value();
+            }
+        }
+        call.valid = true;
+    }
+
+    LOG_DEBUG("Parsed tool call: %s at %zu-%zu (valid=%s)",
+              call.tool_name.c_str(), call.start_pos, call.end_pos, call.valid ? "yes" : "no");
+    calls_.push_back(std::move(call));
+    return true;
+}
+
+} // namespace opencrank
@@ -0,0 +1,165 @@
+/*
+ * OpenCrank C++ - Tool Result Memo Implementation
+ */
+#include <opencrank/core/tool_memo.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/metrics.hpp>
+
+namespace opencrank {
+
+namespace {
+
+// Workspace root ("", ".", "./") -> ""
+std::string memo_path(const std::string& path) {
+    std::string normalized = normalize_path(path);
+    return normalized == "." ? std::string() : normalized;
+}
+
+} // namespace
+
+const char* const ToolMemo::ANY_STORE = "*";
+
+ToolMemo::ToolMemo() : bytes_(0) {
+    Metrics& metrics = Metrics::instance();
+    const char* help = "Memoized tool result lookups and invalidations";
+    hits_ = &metrics.counter("opencrank_tool_memo_total", help, metric_labels("result", "hit"));
+    misses_ = &metrics.counter("opencrank_tool_memo_total", help, metric_labels("result", "miss"));
+    invalidated_ = &metrics.counter("opencrank_tool_memo_total", help, metric_labels("result", "invalidated"));
+}
+
+void ToolMemo::configure(const ToolMemoConfig& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    if (config_.scope == ToolMemoConfig::OFF) {
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+        return;
+    }
+    LOG_DEBUG("[ToolMemo] Per %s, ttl %llds, %zu MB",
+              config_.scope == ToolMemoConfig::SESSION ? "session" : "run",
+              static_cast<long long>(config_.ttl_s), config_.max_bytes / (1024 * 1024));
+}
+
+bool ToolMemo::enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_.scope != ToolMemoConfig::OFF && config_.max_bytes > 0;
+}
+
+bool ToolMemo::per_session() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_.scope == ToolMemoConfig::SESSION;
+}
+
+bool ToolMemo::lookup(const std::string& scope, const std::string& key,
+                      std::string& output, int64_t& age_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Lru::iterator>::iterator it = index_.find(scope + '\n' + key);
+    if (it == index_.end()) {
+        misses_->inc();
+        return false;
+    }
+    Lru::iterator entry = it->second;
+    age_ms = current_timestamp_ms() - entry->stored_ms;
+    if (config_.ttl_s > 0 && age_ms >= config_.ttl_s * 1000) {
+        remove_locked(entry);
+        misses_->inc();
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, entry);
+    output = entry->output;
+    hits_->inc();
+    return true;
+}
+
+bool ToolMemo::contains(const std::string& scope, const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Lru::iterator>::const_iterator it = index_.find(scope + '\n' + key);
+    return it != index_.end() &&
+           (config_.ttl_s <= 0 || current_timestamp_ms() - it->second->stored_ms < config_.ttl_s * 1000);
+}
+
+void ToolMemo::store(const std::string& scope, const std::string& key, const std::string& store,
+                     const std::string& path, const std::string& output) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (config_.scope == ToolMemoConfig::OFF || output.size() > config_.max_bytes / 4) {
+        return;     // One result may not push out everything else
+    }
+
+    std::string id = scope + '\n' + key;
+    std::map<std::string, Lru::iterator>::iterator it = index_.find(id);
+    if (it != index_.end()) {
+        remove_locked(it->second);
+    }
+
+    Entry entry;
+    entry.id = id;
+    entry.scope = scope;
+    entry.store = store;
+    entry.path = memo_path(path);
+    entry.output = output;
+    entry.stored_ms = current_timestamp_ms();
+    lru_.push_front(entry);
+    index_[id] = lru_.begin();
+    bytes_ += output.size();
+
+    while (bytes_ > config_.max_bytes && !lru_.empty()) {
+        remove_locked(--lru_.end());
+    }
+}
+
+void ToolMemo::invalidate(const std::string& store, const std::string& path) {
+    std::string written = memo_path(path);
+    size_t dropped = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Lru::iterator it = lru_.begin();
+    while (it != lru_.end()) {
+        if (store == ANY_STORE || (it->store == store && paths_overlap(it->path, written))) {
+            remove_locked(it++);
+            ++dropped;
+        } else {
+            ++it;
+        }
+    }
+    if (dropped > 0) {
+        invalidated_->inc(dropped);
+        LOG_DEBUG("[ToolMemo] Write to %s%s%s dropped %zu memoized result(s)", store.c_str(),
+                  written.empty() ? "" : ":", written.c_str(), dropped);
+    }
+}
+
+void ToolMemo::drop(const std::string& scope) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Lru::iterator it = lru_.begin();
+    while (it != lru_.end()) {
+        if (it->scope == scope) {
+            remove_locked(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ToolMemo::entries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+bool ToolMemo::paths_overlap(const std::string& a, const std::string& b) {
+    std::string x = memo_path(a);
+    std::string y = memo_path(b);
+    if (x.empty() || y.empty()) return true;                // The whole store
+    if ((x[0] == '/') != (y[0] == '/')) return true;        // Can't tell: assume so
+    if (x.size() > y.size()) x.swap(y);
+    return y.compare(0, x.size(), x) == 0 &&
+           (y.size() == x.size() || y[x.size()] == '/' || x == "/");
+}
+
+void ToolMemo::remove_locked(Lru::iterator it) {
+    bytes_ -= it->output.size();
+    index_.erase(it->id);
+    lru_.erase(it);
+}
+
+} // namespace opencrank
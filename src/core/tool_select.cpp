@@ -0,0 +1,816 @@
+/*
+ * OpenCrank C++ - Tool Output Selectors Implementation
+ */
+#include <opencrank/core/tool_select.hpp>
+#include <opencrank/core/html_tokenizer.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/core/json.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <regex>
+#include <utility>
+#include <vector>
+
+namespace opencrank {
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+std::string trim_spaces(const std::string& s) {
+    size_t b = 0, e = s.size();
+    while (b < e && is_space(s[b])) ++b;
+    while (e > b && is_space(s[e - 1])) --e;
+    return s.substr(b, e - b);
+}
+
+// Split at top-level commas: not inside quotes, [], {} or ()
+std::vector<std::string> split_top_level(const std::string& expr) {
+    std::vector<std::string> parts;
+    std::string current;
+    int depth = 0;
+    char quote = 0;
+    for (size_t i = 0; i < expr.size(); ++i) {
+        char c = expr[i];
+        if (quote) {
+            if (c == '\\' && i + 1 < expr.size()) {
+                current += c;
+                c = expr[++i];
+            } else if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '[' || c == '{' || c == '(') {
+            ++depth;
+        } else if ((c == ']' || c == '}' || c == ')') && depth > 0) {
+            --depth;
+        } else if (c == ',' && depth == 0) {
+            parts.push_back(trim_spaces(current));
+            current.clear();
+            continue;
+        }
+        current += c;
+    }
+    parts.push_back(trim_spaces(current));
+    return parts;
+}
+
+// Quoted string at s[pos] ('"' or '\''); pos ends past the closing quote
+bool parse_quoted(const std::string& s, size_t& pos, std::string& out) {
+    char quote = s[pos++];
+    out.clear();
+    while (pos < s.size() && s[pos] != quote) {
+        if (s[pos] == '\\' && pos + 1 < s.size()) ++pos;
+        out += s[pos++];
+    }
+    if (pos >= s.size()) return false;
+    ++pos;
+    return true;
+}
+
+// ============================================================================
+// JSON paths
+// ============================================================================
+
+struct PathStep {
+    enum Kind { KEY, INDEX, ALL, SLICE, DESCEND, PROJECT } kind;
+    std::string key;
+    long index;
+    long from, to;
+    bool has_from, has_to;
+    std::vector<std::string> keys;
+
+    PathStep() : kind(KEY), index(0), from(0), to(0), has_from(false), has_to(false) {}
+};
+
+bool json_name_char(char c) {
+    return !is_space(c) && c != '.' && c != '[' && c != ']' && c != '{' && c != '}' && c != ',' && c != '"' &&
+           c != '\'';
+}
+
+bool parse_name(const std::string& s, size_t& pos, std::string& out) {
+    if (pos < s.size() && (s[pos] == '"' || s[pos] == '\'')) return parse_quoted(s, pos, out);
+    size_t start = pos;
+    while (pos < s.size() && json_name_char(s[pos])) ++pos;
+    out = s.substr(start, pos - start);
+    return !out.empty();
+}
+
+bool parse_long(const std::string& s, size_t& pos, long& out) {
+    const char* begin = s.c_str() + pos;
+    char* end = NULL;
+    out = std::strtol(begin, &end, 10);
+    if (end == begin) return false;
+    pos += static_cast<size_t>(end - begin);
+    return true;
+}
+
+bool parse_path(const std::string& expr, std::vector<PathStep>& steps, std::string& error) {
+    size_t pos = 0;
+    size_t n = expr.size();
+    if (pos < n && expr[pos] == '$') ++pos;
+    while (pos < n) {
+        char c = expr[pos];
+        PathStep step;
+        if (is_space(c)) {
+            ++pos;
+            continue;
+        }
+        if (c == '.') {
+            ++pos;
+            if (pos < n && expr[pos] == '.') {
+                ++pos;
+                step.kind = PathStep::DESCEND;
+                if (!parse_name(expr, pos, step.key)) {
+                    error = "expected a key after '..'";
+                    return false;
+                }
+            } else if (pos >= n || expr[pos] == '[' || expr[pos] == '{') {
+                continue;   // ".[0]", ".{a}" and "." itself
+            } else if (expr[pos] == '*') {
+                ++pos;
+                step.kind = PathStep::ALL;
+            } else if (!parse_name(expr, pos, step.key)) {
+                error = "expected a key at offset " + std::to_string(pos);
+                return false;
+            }
+        } else if (c == '[') {
+            ++pos;
+            while (pos < n && is_space(expr[pos])) ++pos;
+            if (pos < n && (expr[pos] == ']' || expr[pos] == '*')) {
+                if (expr[pos] == '*') ++pos;
+                step.kind = PathStep::ALL;
+            } else if (pos < n && (expr[pos] == '"' || expr[pos] == '\'')) {
+                if (!parse_quoted(expr, pos, step.key)) {
+                    error = "unterminated quote";
+                    return false;
+                }
+            } else {
+                step.kind = PathStep::INDEX;
+                step.has_from = parse_long(expr, pos, step.from);
+                while (pos < n && is_space(expr[pos])) ++pos;
+                if (pos < n && expr[pos] == ':') {
+                    ++pos;
+                    step.kind = PathStep::SLICE;
+                    while (pos < n && is_space(expr[pos])) ++pos;
+                    step.has_to = parse_long(expr, pos, step.to);
+                } else if (!step.has_from) {
+                    error = "expected an index, slice, quoted key or * at offset " + std::to_string(pos);
+                    return false;
+                }
+                step.index = step.from;
+            }
+            while (pos < n && is_space(expr[pos])) ++pos;
+            if (pos >= n || expr[pos] != ']') {
+                error = "expected ']' at offset " + std::to_string(pos);
+                return false;
+            }
+            ++pos;
+        } else if (c == '{') {
+            ++pos;
+            step.kind = PathStep::PROJECT;
+            while (true) {
+                while (pos < n && (is_space(expr[pos]) || expr[pos] == ',')) ++pos;
+                if (pos < n && expr[pos] == '}') break;
+                std::string key;
+                if (!parse_name(expr, pos, key)) {
+                    error = "expected a key or '}' at offset " + std::to_string(pos);
+                    return false;
+                }
+                step.keys.push_back(key);
+            }
+            ++pos;
+        } else {
+            error = std::string("unexpected '") + c + "' at offset " + std::to_string(pos);
+            return false;
+        }
+        steps.push_back(step);
+    }
+    return true;
+}
+
+void descend(const Json& node, const std::string& key, std::vector<const Json*>& out) {
+    if (node.is_object()) {
+        Json::const_iterator it = node.find(key);
+        if (it != node.end()) out.push_back(&*it);
+        for (Json::const_iterator child = node.begin(); child != node.end(); ++child) {
+            descend(*child, key, out);
+        }
+    } else if (node.is_array()) {
+        for (size_t i = 0; i < node.size(); ++i) descend(node[i], key, out);
+    }
+}
+
+// Python-style slice bounds
+void slice_bounds(const PathStep& step, long size, long& from, long& to) {
+    from = step.has_from ? step.from : 0;
+    to = step.has_to ? step.to : size;
+    if (from < 0) from += size;
+    if (to < 0) to += size;
+    from = std::max(0L, std::min(from, size));
+    to = std::max(from, std::min(to, size));
+}
+
+void evaluate(const Json& root, const std::vector<PathStep>& steps, std::deque<Json>& made,
+              std::vector<const Json*>& out) {
+    std::vector<const Json*> current(1, &root);
+    std::vector<const Json*> next;
+    for (size_t s = 0; s < steps.size(); ++s) {
+        const PathStep& step = steps[s];
+        next.clear();
+        for (size_t i = 0; i < current.size(); ++i) {
+            const Json& node = *current[i];
+            switch (step.kind) {
+            case PathStep::KEY:
+                if (node.is_object()) {
+                    Json::const_iterator it = node.find(step.key);
+                    if (it != node.end()) next.push_back(&*it);
+                }
+                break;
+            case PathStep::INDEX:
+                if (node.is_array()) {
+                    long size = static_cast<long>(node.size());
+                    long at = step.index < 0 ? step.index + size : step.index;
+                    if (at >= 0 && at < size) next.push_back(&node[static_cast<size_t>(at)]);
+                }
+                break;
+            case PathStep::ALL:
+                if (node.is_array() || node.is_object()) {
+                    for (Json::const_iterator it = node.begin(); it != node.end(); ++it) next.push_back(&*it);
+                }
+                break;
+            case PathStep::SLICE:
+                if (node.is_array()) {
+                    long from, to;
+                    slice_bounds(step, static_cast<long>(node.size()), from, to);
+                    for (long at = from; at < to; ++at) next.push_back(&node[static_cast<size_t>(at)]);
+                }
+                break;
+            case PathStep::DESCEND:
+                descend(node, step.key, next);
+                break;
+            case PathStep::PROJECT:
+                if (node.is_object()) {
+                    Json picked = Json::object();
+                    for (size_t k = 0; k < step.keys.size(); ++k) {
+                        Json::const_iterator it = node.find(step.keys[k]);
+                        if (it != node.end()) picked[step.keys[k]] = *it;
+                    }
+                    made.push_back(picked);
+                    next.push_back(&made.back());
+                }
+                break;
+            }
+        }
+        current.swap(next);
+    }
+    out.insert(out.end(), current.begin(), current.end());
+}
+
+// ============================================================================
+// CSS selectors
+// ============================================================================
+
+struct AttrTest {
+    std::string name;
+    char op;                // 0 (present), '=', '^', '$', '*'
+    std::string value;
+};
+
+struct Compound {
+    std::string tag;        // "" or "*" = any
+    std::string id;
+    std::vector<std::string> classes;
+    std::vector<AttrTest> attrs;
+    bool child;             // Combinator to the previous compound is '>'
+    Compound() : child(false) {}
+};
+
+struct CssSelector {
+    std::vector<Compound> parts;
+    std::string attr_out;   // @attr: output this attribute instead of text
+};
+
+bool css_name_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ||
+           (static_cast<unsigned char>(c) & 0x80);
+}
+
+std::string css_name(const std::string& s, size_t& pos) {
+    size_t start = pos;
+    while (pos < s.size() && css_name_char(s[pos])) ++pos;
+    return s.substr(start, pos - start);
+}
+
+bool parse_css(const std::string& group, CssSelector& sel, std::string& error) {
+    std::string expr = group;
+
+    // A trailing @attr, outside brackets and quotes
+    int depth = 0;
+    char quote = 0;
+    size_t at = std::string::npos;
+    for (size_t i = 0; i < expr.size(); ++i) {
+        char c = expr[i];
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '[') {
+            ++depth;
+        } else if (c == ']') {
+            --depth;
+        } else if (c == '@' && depth == 0) {
+            at = i;
+        }
+    }
+    if (at != std::string::npos) {
+        sel.attr_out = to_lower(trim_spaces(expr.substr(at + 1)));
+        expr = trim_spaces(expr.substr(0, at));
+        if (sel.attr_out.empty()) {
+            error = "empty attribute name after '@'";
+            return false;
+        }
+    }
+
+    size_t pos = 0;
+    bool child = false;
+    while (pos < expr.size()) {
+        if (is_space(expr[pos])) {
+            ++pos;
+            continue;
+        }
+        if (expr[pos] == '>') {
+            if (sel.parts.empty() || child) {
+                error = "misplaced '>'";
+                return false;
+            }
+            child = true;
+            ++pos;
+            continue;
+        }
+
+        Compound part;
+        part.child = child;
+        child = false;
+        if (expr[pos] == '*') {
+            part.tag = "*";
+            ++pos;
+        } else {
+            part.tag = to_lower(css_name(expr, pos));
+        }
+        while (pos < expr.size() && !is_space(expr[pos]) && expr[pos] != '>') {
+            char c = expr[pos++];
+            if (c == '#' || c == '.') {
+                std::string name = css_name(expr, pos);
+                if (name.empty()) {
+                    error = std::string("expected a name after '") + c + "'";
+                    return false;
+                }
+                if (c == '#') part.id = name;
+                else part.classes.push_back(name);
+            } else if (c == '[') {
+                AttrTest test;
+                test.op = 0;
+                while (pos < expr.size() && is_space(expr[pos])) ++pos;
+                test.name = to_lower(css_name(expr, pos));
+                while (pos < expr.size() && is_space(expr[pos])) ++pos;
+                if (pos < expr.size() && expr[pos] != ']') {
+                    if (expr[pos] == '=') {
+                        test.op = '=';
+                        ++pos;
+                    } else if (pos + 1 < expr.size() && expr[pos + 1] == '=' &&
+                               (expr[pos] == '^' || expr[pos] == '$' || expr[pos] == '*')) {
+                        test.op = expr[pos];
+                        pos += 2;
+                    } else {
+                        error = "unsupported attribute operator in '" + group + "'";
+                        return false;
+                    }
+                    while (pos < expr.size() && is_space(expr[pos])) ++pos;
+                    if (pos < expr.size() && (expr[pos] == '"' || expr[pos] == '\'')) {
+                        if (!parse_quoted(expr, pos, test.value)) {
+                            error = "unterminated quote";
+                            return false;
+                        }
+                    } else {
+                        size_t start = pos;
+                        while (pos < expr.size() && expr[pos] != ']' && !is_space(expr[pos])) ++pos;
+                        test.value = expr.substr(start, pos - start);
+                    }
+                    while (pos < expr.size() && is_space(expr[pos])) ++pos;
+                }
+                if (test.name.empty() || pos >= expr.size() || expr[pos] != ']') {
+                    error = "malformed attribute test in '" + group + "'";
+                    return false;
+                }
+                ++pos;
+                part.attrs.push_back(test);
+            } else {
+                error = std::string("unsupported '") + c + "' in selector '" + group + "'";
+                return false;
+            }
+        }
+        if (part.tag.empty() && part.id.empty() && part.classes.empty() && part.attrs.empty()) {
+            error = "empty selector";
+            return false;
+        }
+        sel.parts.push_back(part);
+    }
+    if (sel.parts.empty() || child) {
+        error = sel.parts.empty() ? "empty selector" : "selector ends with '>'";
+        return false;
+    }
+    return true;
+}
+
+struct Element {
+    std::string tag;
+    std::vector<std::pair<std::string, std::string> > attrs;
+    int capture;            // Index into the captures opened by this element, or -1
+
+    const std::string* attr(const std::string& name) const {
+        for (size_t i = 0; i < attrs.size(); ++i) {
+            if (attrs[i].first == name) return &attrs[i].second;
+        }
+        return NULL;
+    }
+};
+
+bool has_class(const std::string& list, const std::string& cls) {
+    size_t pos = 0;
+    while (pos < list.size()) {
+        while (pos < list.size() && is_space(list[pos])) ++pos;
+        size_t start = pos;
+        while (pos < list.size() && !is_space(list[pos])) ++pos;
+        if (pos - start == cls.size() && list.compare(start, cls.size(), cls) == 0) return true;
+    }
+    return false;
+}
+
+bool ends_with_str(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool matches_compound(const Compound& part, const Element& el) {
+    if (!part.tag.empty() && part.tag != "*" && part.tag != el.tag) return false;
+    if (!part.id.empty()) {
+        const std::string* id = el.attr("id");
+        if (!id || *id != part.id) return false;
+    }
+    if (!part.classes.empty()) {
+        const std::string* cls = el.attr("class");
+        if (!cls) return false;
+        for (size_t i = 0; i < part.classes.size(); ++i) {
+            if (!has_class(*cls, part.classes[i])) return false;
+        }
+    }
+    for (size_t i = 0; i < part.attrs.size(); ++i) {
+        const AttrTest& test = part.attrs[i];
+        const std::string* value = el.attr(test.name);
+        if (!value) return false;
+        switch (test.op) {
+        case '=': if (*value != test.value) return false; break;
+        case '^': if (value->compare(0, test.value.size(), test.value) != 0) return false; break;
+        case '$': if (!ends_with_str(*value, test.value)) return false; break;
+        case '*': if (value->find(test.value) == std::string::npos) return false; break;
+        default: break;
+        }
+    }
+    return true;
+}
+
+// parts[0..p] against stack[0..e], parts[p] matching stack[e]
+bool matches_at(const CssSelector& sel, size_t p, const std::vector<Element>& stack, size_t e) {
+    if (!matches_compound(sel.parts[p], stack[e])) return false;
+    if (p == 0) return true;
+    if (sel.parts[p].child) {
+        return e > 0 && matches_at(sel, p - 1, stack, e - 1);
+    }
+    for (size_t a = e; a-- > 0;) {
+        if (matches_at(sel, p - 1, stack, a)) return true;
+    }
+    return false;
+}
+
+bool is_void_element(const std::string& tag) {
+    static const char* const VOID[] = {
+        "area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta",
+        "param", "source", "track", "wbr"
+    };
+    for (size_t i = 0; i < sizeof(VOID) / sizeof(VOID[0]); ++i) {
+        if (tag == VOID[i]) return true;
+    }
+    return false;
+}
+
+bool closes_paragraph(const std::string& tag) {
+    static const char* const BLOCKS[] = {
+        "p", "div", "ul", "ol", "dl", "table", "pre", "blockquote", "section", "article",
+        "header", "footer", "nav", "aside", "form", "h1", "h2", "h3", "h4", "h5", "h6", "hr"
+    };
+    for (size_t i = 0; i < sizeof(BLOCKS) / sizeof(BLOCKS[0]); ++i) {
+        if (tag == BLOCKS[i]) return true;
+    }
+    return false;
+}
+
+// Parse the tag at doc[pos] == '<'. Sets end past '>'. Returns false for
+// things that are not element tags (text '<', comments, doctypes), with
+// end set to where scanning resumes.
+bool parse_tag(const std::string& doc, size_t pos, size_t& end, bool& closing, bool& self_closing,
+               Element& el) {
+    size_t n = doc.size();
+    if (doc.compare(pos, 4, "<!--") == 0) {
+        size_t close = doc.find("-->", pos + 4);
+        end = close == std::string::npos ? n : close + 3;
+        return false;
+    }
+    if (pos + 1 < n && (doc[pos + 1] == '!' || doc[pos + 1] == '?')) {
+        size_t close = doc.find('>', pos);
+        end = close == std::string::npos ? n : close + 1;
+        return false;
+    }
+    size_t p = pos + 1;
+    closing = p < n && doc[p] == '/';
+    if (closing) ++p;
+    if (p >= n || !std::isalpha(static_cast<unsigned char>(doc[p]))) {
+        end = pos + 1;
+        return false;
+    }
+    size_t name_start = p;
+    while (p < n && !is_space(doc[p]) && doc[p] != '>' && doc[p] != '/') ++p;
+    el.tag = to_lower(doc.substr(name_start, p - name_start));
+    el.attrs.clear();
+    el.capture = -1;
+
+    // The '>' outside quoted values, the tokenizer's way: a quote opens a
+    // value only right after '='
+    size_t attrs_start = p;
+    char quote = 0;
+    for (; p < n; ++p) {
+        char c = doc[p];
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '>') {
+            break;
+        } else if (c == '"' || c == '\'') {
+            size_t k = p;
+            while (k > attrs_start && is_space(doc[k - 1])) --k;
+            if (k > attrs_start && doc[k - 1] == '=') quote = c;
+        }
+    }
+    self_closing = p < n && p > attrs_start && doc[p - 1] == '/';
+    if (!closing) {
+        HtmlTokenizer::parse_attributes(doc.substr(attrs_start, p - attrs_start), 0, el.attrs);
+    }
+    end = p < n ? p + 1 : n;
+    return true;
+}
+
+struct Capture {
+    size_t start;           // Offset of the element's '<'
+    size_t content;         // Offset past its start tag
+    size_t end;             // Offset past its end tag
+    bool raw;               // script/style: keep the content as is
+};
+
+} // anonymous namespace
+
+bool select_json(const std::string& document, const std::string& expr,
+                 std::string& out, size_t& matches, std::string& error) {
+    out.clear();
+    matches = 0;
+    Json root = Json::parse(document, nullptr, false);
+    if (root.is_discarded()) {
+        error = "content is not valid JSON";
+        return false;
+    }
+
+    std::vector<std::string> paths = split_top_level(expr);
+    std::deque<Json> made;
+    std::vector<const Json*> results;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::vector<PathStep> steps;
+        if (!parse_path(paths[i], steps, error)) {
+            error = "invalid path '" + paths[i] + "': " + error;
+            return false;
+        }
+        evaluate(root, steps, made, results);
+    }
+
+    // One value as is (a string unquoted); several one per line, jq style
+    matches = results.size();
+    if (results.size() == 1 && results[0]->is_string()) {
+        out = results[0]->get<std::string>();
+        return true;
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (i > 0) out += '\n';
+        out += results[i]->dump();
+    }
+    return true;
+}
+
+bool select_html(const std::string& document, const std::string& expr,
+                 std::string& out, size_t& matches, std::string& error) {
+    out.clear();
+    matches = 0;
+    std::vector<std::string> groups = split_top_level(expr);
+    std::vector<CssSelector> selectors(groups.size());
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (!parse_css(groups[i], selectors[i], error)) {
+            error = "invalid selector '" + groups[i] + "': " + error;
+            return false;
+        }
+    }
+
+    std::vector<Element> stack;
+    std::vector<Capture> captures;
+    std::vector<std::string> outputs;       // Per capture, filled in document order
+    std::vector<size_t> output_of;          // capture -> index in outputs
+    int open_capture = -1;                  // Text capture holding the matches inside it
+    size_t n = document.size();
+    size_t pos = 0;
+
+    // Pops the top element, ending its capture at offset at
+    auto pop = [&](size_t at) {
+        Element& top = stack.back();
+        if (top.capture >= 0) {
+            captures[top.capture].end = at;
+            if (open_capture == top.capture) open_capture = -1;
+        }
+        stack.pop_back();
+    };
+
+    while (pos < n) {
+        const void* lt = memchr(document.data() + pos, '<', n - pos);
+        if (!lt) break;
+        size_t tag_start = static_cast<const char*>(lt) - document.data();
+        size_t tag_end;
+        bool closing = false, self_closing = false;
+        Element el;
+        if (!parse_tag(document, tag_start, tag_end, closing, self_closing, el)) {
+            pos = tag_end;
+            continue;
+        }
+        pos = tag_end;
+
+        if (closing) {
+            for (size_t i = stack.size(); i-- > 0;) {
+                if (stack[i].tag != el.tag) continue;
+                while (stack.size() > i + 1) pop(tag_start);
+                pop(tag_end);
+                break;
+            }
+            continue;
+        }
+
+        // Implicitly closed elements
+        if (!stack.empty()) {
+            const std::string& top = stack.back().tag;
+            if ((top == "p" && closes_paragraph(el.tag)) ||
+                (top == el.tag && (el.tag == "li" || el.tag == "option" || el.tag == "tr" ||
+                                   el.tag == "dt" || el.tag == "dd")) ||
+                ((top == "td" || top == "th") && (el.tag == "td" || el.tag == "th" || el.tag == "tr"))) {
+                pop(tag_start);
+            }
+        }
+
+        stack.push_back(el);
+        for (size_t s = 0; s < selectors.size(); ++s) {
+            const CssSelector& sel = selectors[s];
+            if (!matches_at(sel, sel.parts.size() - 1, stack, stack.size() - 1)) continue;
+            if (!sel.attr_out.empty()) {
+                const std::string* value = stack.back().attr(sel.attr_out);
+                if (value && !value->empty()) {
+                    outputs.push_back(*value);
+                    ++matches;
+                }
+                continue;
+            }
+            if (open_capture >= 0 || stack.back().capture >= 0) continue;
+            Capture capture;
+            capture.start = tag_start;
+            capture.content = tag_end;
+            capture.end = n;
+            capture.raw = el.tag == "script" || el.tag == "style";
+            stack.back().capture = static_cast<int>(captures.size());
+            open_capture = stack.back().capture;
+            captures.push_back(capture);
+            output_of.push_back(outputs.size());
+            outputs.push_back(std::string());
+        }
+
+        bool raw = el.tag == "script" || el.tag == "style";
+        if (self_closing || is_void_element(el.tag)) {
+            pop(tag_end);
+        } else if (raw) {
+            // Content up to the end tag is not markup
+            std::string end_tag = "</" + el.tag;
+            size_t close = pos;
+            while (close < n) {
+                close = document.find("</", close);
+                if (close == std::string::npos) {
+                    close = n;
+                    break;
+                }
+                if (to_lower(document.substr(close, end_tag.size())) == end_tag) break;
+                close += 2;
+            }
+            pos = close;
+        }
+    }
+    while (!stack.empty()) pop(n);
+
+    for (size_t c = 0; c < captures.size(); ++c) {
+        const Capture& capture = captures[c];
+        std::string text;
+        if (capture.raw) {
+            size_t close = capture.end > capture.content ? document.rfind("</", capture.end - 1) : std::string::npos;
+            if (close == std::string::npos || close < capture.content) close = capture.end;
+            text = trim_spaces(document.substr(capture.content, close - capture.content));
+        } else {
+            HtmlTokenizer tokenizer(HtmlTokenizer::TEXT);
+            tokenizer.feed(document.data() + capture.start, capture.end - capture.start);
+            tokenizer.finish();
+            text = trim_spaces(tokenizer.text());
+        }
+        if (!text.empty()) ++matches;
+        outputs[output_of[c]].swap(text);
+    }
+
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        if (outputs[i].empty()) continue;
+        if (!out.empty()) out += '\n';
+        out += outputs[i];
+    }
+    return true;
+}
+
+bool filter_lines(const std::string& text, const LineFilter& filter,
+                  std::string& out, size_t& matches, std::string& error) {
+    out.clear();
+    matches = 0;
+
+    // Plain words are searched as substrings, anything else as a regex
+    bool literal = filter.grep.find_first_of("\\^$.|?*+()[]{}") == std::string::npos;
+    std::regex pattern;
+    if (!filter.grep.empty() && !literal) {
+        try {
+            pattern = std::regex(filter.grep, std::regex::ECMAScript);
+        } catch (const std::regex_error& e) {
+            error = "invalid grep pattern '" + filter.grep + "': " + e.what();
+            return false;
+        }
+    }
+
+    std::vector<std::pair<size_t, size_t> > kept;   // (offset, length)
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        size_t len = (nl == std::string::npos ? text.size() : nl) - pos;
+        bool hit = true;
+        if (!filter.grep.empty()) {
+            if (literal) {
+                hit = std::search(text.begin() + pos, text.begin() + pos + len,
+                                  filter.grep.begin(), filter.grep.end()) != text.begin() + pos + len;
+            } else {
+                hit = std::regex_search(text.begin() + pos, text.begin() + pos + len, pattern);
+            }
+            if (filter.invert) hit = !hit;
+        }
+        if (hit) kept.push_back(std::make_pair(pos, len));
+        if (nl == std::string::npos) break;
+        pos = nl + 1;
+    }
+    matches = kept.size();
+
+    size_t head = filter.head;
+    size_t tail = filter.tail;
+    if ((head == 0 && tail == 0) || head + tail >= kept.size()) {
+        head = kept.size();
+        tail = 0;
+    }
+    for (size_t i = 0; i < head && i < kept.size(); ++i) {
+        out.append(text, kept[i].first, kept[i].second);
+        out += '\n';
+    }
+    if (head < kept.size()) {
+        size_t skipped = kept.size() - head - tail;
+        out += "... [" + std::to_string(skipped) + " line(s) omitted] ...\n";
+        for (size_t i = kept.size() - tail; i < kept.size(); ++i) {
+            out.append(text, kept[i].first, kept[i].second);
+            out += '\n';
+        }
+    }
+    if (!out.empty()) out.resize(out.size() - 1);
+    return true;
+}
+
+} // namespace opencrank
@@ -0,0 +1,571 @@
+/*
+ * OpenCrank C++ - Tool Worker Pool Implementation
+ */
+#include <opencrank/core/tool_workers.hpp>
+#include <opencrank/core/json.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/sandbox.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace opencrank {
+
+namespace {
+
+// Largest control message (the command line travels inline)
+const size_t MAX_MESSAGE = 256 * 1024;
+
+// Minimum delay between progress ticks from a worker
+const int64_t PROGRESS_INTERVAL_MS = 250;
+
+// A worker that has not answered this long after the command's own
+// timeout is considered wedged and killed
+const int64_t WORKER_GRACE_MS = 10000;
+
+bool send_message(int sock, const Json& msg) {
+    std::string data = msg.dump();
+    ssize_t n;
+    do {
+        n = send(sock, data.data(), data.size(), MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(data.size());
+}
+
+// One packet; false on EOF or error
+bool recv_message(int sock, Json& msg) {
+    thread_local std::vector<char> buf(MAX_MESSAGE);
+    ssize_t n;
+    do {
+        n = recv(sock, buf.data(), buf.size(), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    msg = Json::parse(buf.data(), buf.data() + n, nullptr, false);
+    return !msg.is_discarded();
+}
+
+// Zygote -> gateway: worker pid with its socket and shared memory fds
+bool send_worker(int sock, pid_t pid, int worker_sock, int memfd) {
+    int32_t payload = static_cast<int32_t>(pid);
+    struct iovec iov;
+    iov.iov_base = &payload;
+    iov.iov_len = sizeof(payload);
+
+    union {
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (pid > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        int fds[2] = { worker_sock, memfd };
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(payload));
+}
+
+bool recv_worker(int sock, pid_t& pid, int& worker_sock, int& memfd) {
+    int32_t payload = -1;
+    struct iovec iov;
+    iov.iov_base = &payload;
+    iov.iov_len = sizeof(payload);
+
+    union {
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(payload)) || payload <= 0) {
+        return false;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        return false;
+    }
+    int fds[2];
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    pid = static_cast<pid_t>(payload);
+    worker_sock = fds[0];
+    memfd = fds[1];
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Worker process
+// ----------------------------------------------------------------------------
+
+// Reads requests and cancels from the gateway while the main thread runs
+// commands. Cancels are handled on arrival; packets are ordered, so a
+// cancel that arrives after its command finished is a no-op.
+struct WorkerInbox {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Json> requests;
+    bool closed;
+
+    WorkerInbox() : closed(false) {}
+};
+
+void worker_reader(int sock, WorkerInbox* inbox) {
+    Json msg;
+    while (recv_message(sock, msg)) {
+        std::string type = json_utils::get_string(msg, "type");
+        if (type == "cancel") {
+            ProcessRunner::cancel("");
+        } else if (type == "run") {
+            std::lock_guard<std::mutex> lock(inbox->mutex);
+            inbox->requests.push_back(msg);
+            inbox->cv.notify_one();
+        }
+    }
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    inbox->closed = true;
+    inbox->cv.notify_one();
+}
+
+void worker_main(int sock, int memfd, size_t shm_size) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    signal(SIGCHLD, SIG_DFL);     // ProcessRunner reaps its own children
+
+    char* shm = static_cast<char*>(mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0));
+    close(memfd);
+    if (shm == MAP_FAILED) {
+        _exit(1);
+    }
+
+    WorkerInbox inbox;
+    std::thread reader(worker_reader, sock, &inbox);
+    reader.detach();
+
+    for (;;) {
+        Json request;
+        {
+            std::unique_lock<std::mutex> lock(inbox.mutex);
+            inbox.cv.wait(lock, [&inbox] { return inbox.closed || !inbox.requests.empty(); });
+            if (inbox.requests.empty()) {
+                _exit(0);       // Gateway gone
+            }
+            request = inbox.requests.front();
+            inbox.requests.pop_front();
+        }
+
+        ProcessLimits limits;
+        limits.timeout_s = static_cast<int>(json_utils::get_int(request, "timeout_s", 0));
+        limits.cpu_s = static_cast<int>(json_utils::get_int(request, "cpu_s", 0));
+        limits.memory_bytes = static_cast<size_t>(json_utils::get_int(request, "memory_bytes", 0));
+        limits.max_output = 0;  // Output goes straight into shared memory
+        size_t cap = std::min(shm_size, static_cast<size_t>(
+            json_utils::get_int(request, "max_output", static_cast<int64_t>(shm_size))));
+
+        size_t written = 0;
+        bool truncated = false;
+        int64_t last_tick = 0;
+        ProcessResult result = ProcessRunner::run_shell(
+            json_utils::get_string(request, "command"),
+            json_utils::get_string(request, "workdir"),
+            limits, "",
+            [&](const char* data, size_t len) {
+                size_t n = std::min(len, cap - written);
+                memcpy(shm + written, data, n);
+                written += n;
+                if (n < len) truncated = true;
+                int64_t now = current_timestamp_ms();
+                if (n > 0 && now - last_tick >= PROGRESS_INTERVAL_MS) {
+                    last_tick = now;
+                    Json tick;
+                    tick["type"] = "progress";
+                    tick["len"] = written;
+                    send_message(sock, tick);
+                }
+            });
+
+        Json done;
+        done["type"] = "done";
+        done["started"] = result.started;
+        done["exit_code"] = result.exit_code;
+        done["term_signal"] = result.term_signal;
+        done["timed_out"] = result.timed_out;
+        done["cancelled"] = result.cancelled;
+        done["truncated"] = truncated;
+        done["duration_ms"] = result.duration_ms;
+        done["error"] = result.error;
+        done["len"] = written;
+        if (!send_message(sock, done)) {
+            _exit(0);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Zygote process
+// ----------------------------------------------------------------------------
+
+void zygote_main(int ctl, pid_t gateway, size_t shm_size, bool sandbox) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != gateway) {
+        _exit(0);
+    }
+    signal(SIGINT, SIG_IGN);      // Ctrl-C is for the gateway; we exit on EOF
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_IGN);     // Workers are reaped automatically
+
+    // Landlock is inherited by every worker forked from here on
+    Logger::instance().set_level(LogLevel::WARN);
+    if (sandbox) {
+        Sandbox& sb = Sandbox::instance();
+        if (!sb.init() || !sb.activate()) {
+            LOG_WARN("[ToolWorkers] Workers run without the Landlock sandbox");
+        }
+    }
+
+    for (;;) {
+        char op;
+        ssize_t n = recv(ctl, &op, 1, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            _exit(0);
+        }
+
+        int pair[2];
+        int memfd = memfd_create("opencrank-tool-worker", MFD_CLOEXEC);
+        if (memfd < 0 || ftruncate(memfd, static_cast<off_t>(shm_size)) != 0 ||
+            socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0) {
+            if (memfd >= 0) close(memfd);
+            send_worker(ctl, -1, -1, -1);
+            continue;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(ctl);
+            close(pair[0]);
+            worker_main(pair[1], memfd, shm_size);
+            _exit(0);
+        }
+        close(pair[1]);
+        send_worker(ctl, pid, pair[0], memfd);
+        close(pair[0]);
+        close(memfd);
+    }
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// ToolWorkerPool
+// ============================================================================
+
+ToolWorkerPool& ToolWorkerPool::instance() {
+    static ToolWorkerPool pool;
+    return pool;
+}
+
+ToolWorkerPool::ToolWorkerPool()
+    : zygote_sock_(-1)
+    , output_bytes_(0)
+    , target_(0)
+    , live_(0)
+    , commands_(0)
+    , crashes_(0) {}
+
+ToolWorkerPool::~ToolWorkerPool() {
+    stop();
+}
+
+bool ToolWorkerPool::start(int workers, size_t output_bytes, bool sandbox) {
+    if (workers <= 0 || zygote_sock_ >= 0) {
+        return false;
+    }
+
+    int ctl[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ctl) != 0) {
+        LOG_WARN("[ToolWorkers] socketpair failed: %s", strerror(errno));
+        return false;
+    }
+
+    pid_t gateway = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG_WARN("[ToolWorkers] fork failed: %s, commands run in-process", strerror(errno));
+        close(ctl[0]);
+        close(ctl[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(ctl[0]);
+        zygote_main(ctl[1], gateway, output_bytes, sandbox);
+        _exit(0);
+    }
+    close(ctl[1]);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    zygote_sock_ = ctl[0];
+    output_bytes_ = output_bytes;
+    target_ = static_cast<size_t>(workers);
+    for (size_t i = 0; i < target_; ++i) {
+        Worker* w = spawn_locked();
+        if (!w) {
+            break;
+        }
+        idle_.push_back(w);
+        ++live_;
+    }
+    LOG_INFO("[ToolWorkers] Zygote %d ready, %zu worker(s) pre-forked (%zuKB output each)",
+             pid, live_, output_bytes / 1024);
+    return true;
+}
+
+void ToolWorkerPool::stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < idle_.size(); ++i) {
+        destroy(idle_[i]);
+    }
+    live_ -= idle_.size();
+    idle_.clear();
+    if (zygote_sock_ >= 0) {
+        close(zygote_sock_);
+        zygote_sock_ = -1;
+    }
+    cv_.notify_all();
+}
+
+ToolWorkerPool::Worker* ToolWorkerPool::spawn_locked() {
+    if (zygote_sock_ < 0) {
+        return NULL;
+    }
+    char op = 'S';
+    pid_t pid = -1;
+    int sock = -1, memfd = -1;
+    if (send(zygote_sock_, &op, 1, MSG_NOSIGNAL) != 1 || !recv_worker(zygote_sock_, pid, sock, memfd)) {
+        LOG_WARN("[ToolWorkers] Zygote not answering, commands run in-process");
+        close(zygote_sock_);
+        zygote_sock_ = -1;
+        return NULL;
+    }
+
+    char* shm = static_cast<char*>(mmap(NULL, output_bytes_, PROT_READ, MAP_SHARED, memfd, 0));
+    close(memfd);
+    if (shm == MAP_FAILED) {
+        LOG_WARN("[ToolWorkers] mmap failed: %s", strerror(errno));
+        kill(pid, SIGKILL);
+        close(sock);
+        return NULL;
+    }
+
+    Worker* w = new Worker();
+    w->pid = pid;
+    w->sock = sock;
+    w->shm = shm;
+    LOG_DEBUG("[ToolWorkers] Worker %d started", pid);
+    return w;
+}
+
+void ToolWorkerPool::destroy(Worker* w) {
+    kill(w->pid, SIGKILL);
+    close(w->sock);
+    munmap(w->shm, output_bytes_);
+    delete w;
+}
+
+ToolWorkerPool::Worker* ToolWorkerPool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (!idle_.empty()) {
+            Worker* w = idle_.back();
+            idle_.pop_back();
+            return w;
+        }
+        if (live_ < target_) {
+            Worker* w = spawn_locked();
+            if (w) {
+                ++live_;
+                return w;
+            }
+        }
+        if (live_ == 0) {
+            return NULL;    // No zygote left to replace workers
+        }
+        cv_.wait(lock);
+    }
+}
+
+void ToolWorkerPool::release(Worker* w, bool healthy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::pair<std::multimap<std::string, Worker*>::iterator,
+              std::multimap<std::string, Worker*>::iterator> range = busy_.equal_range(w->cancel_key);
+    for (std::multimap<std::string, Worker*>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == w) {
+            busy_.erase(it);
+            break;
+        }
+    }
+    if (healthy && zygote_sock_ >= 0) {
+        idle_.push_back(w);
+    } else {
+        destroy(w);
+        --live_;
+    }
+    cv_.notify_one();
+}
+
+ProcessResult ToolWorkerPool::run_shell(const std::string& command,
+                                        const std::string& workdir,
+                                        const ProcessLimits& limits,
+                                        const std::string& cancel_key,
+                                        ProcessRunner::OutputCallback on_output) {
+    Json request;
+    request["type"] = "run";
+    request["command"] = command;
+    request["workdir"] = workdir;
+    request["timeout_s"] = limits.timeout_s;
+    request["cpu_s"] = limits.cpu_s;
+    request["memory_bytes"] = limits.memory_bytes;
+    request["max_output"] = std::min(limits.max_output, output_bytes_);
+
+    // An idle worker may have died since its last command: try another
+    Worker* w = NULL;
+    if (request.dump().size() < MAX_MESSAGE) {
+        for (int attempt = 0; attempt < 2 && !w; ++attempt) {
+            w = acquire();
+            if (w && !send_message(w->sock, request)) {
+                crashes_.fetch_add(1);
+                release(w, false);
+                w = NULL;
+            }
+        }
+    }
+    if (!w) {
+        return ProcessRunner::run_shell(command, workdir, limits, cancel_key, on_output);
+    }
+    commands_.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        w->cancel_key = cancel_key;
+        busy_.insert(std::make_pair(cancel_key, w));
+    }
+    if (limits.cancel && limits.cancel->load()) {
+        Json cancel;
+        cancel["type"] = "cancel";
+        send_message(w->sock, cancel);
+    }
+
+    ProcessResult result;
+    int64_t start = current_timestamp_ms();
+    int64_t deadline = limits.timeout_s > 0
+        ? start + static_cast<int64_t>(limits.timeout_s) * 1000 + WORKER_GRACE_MS : -1;
+    size_t seen = 0;
+    bool healthy = true;
+
+    while (healthy) {
+        int wait = -1;
+        if (deadline >= 0) {
+            wait = static_cast<int>(std::max<int64_t>(deadline - current_timestamp_ms(), 0));
+        }
+        struct pollfd pfd;
+        pfd.fd = w->sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, wait);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            // The worker enforces the timeout itself; silence past it means
+            // the worker is stuck. Its command (own process group) has had
+            // SIGTERM/SIGKILL from the worker's runner unless that is what hung.
+            LOG_WARN("[ToolWorkers] Worker %d wedged, killing it", w->pid);
+            result.started = true;
+            result.timed_out = true;
+            healthy = false;
+            break;
+        }
+
+        Json msg;
+        if (ready < 0 || !recv_message(w->sock, msg)) {
+            healthy = false;
+            break;
+        }
+        size_t len = std::min(static_cast<size_t>(json_utils::get_int(msg, "len", 0)), output_bytes_);
+        if (len > seen && on_output) {
+            on_output(w->shm + seen, len - seen);
+        }
+        seen = std::max(seen, len);
+
+        if (json_utils::get_string(msg, "type") == "done") {
+            result.started = json_utils::get_bool(msg, "started");
+            result.exit_code = static_cast<int>(json_utils::get_int(msg, "exit_code", -1));
+            result.term_signal = static_cast<int>(json_utils::get_int(msg, "term_signal", 0));
+            result.timed_out = json_utils::get_bool(msg, "timed_out");
+            result.cancelled = json_utils::get_bool(msg, "cancelled");
+            result.truncated = json_utils::get_bool(msg, "truncated");
+            result.duration_ms = json_utils::get_int(msg, "duration_ms", 0);
+            result.error = json_utils::get_string(msg, "error");
+            result.output.assign(w->shm, seen);
+            break;
+        }
+    }
+
+    if (!healthy) {
+        crashes_.fetch_add(1);
+        result.output.assign(w->shm, seen);
+        result.duration_ms = current_timestamp_ms() - start;
+        if (!result.timed_out) {
+            LOG_WARN("[ToolWorkers] Worker %d died while running a command", w->pid);
+            result.error = "tool worker exited unexpectedly";
+        }
+    }
+    release(w, healthy);
+    return result;
+}
+
+size_t ToolWorkerPool::cancel(const std::string& cancel_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::pair<std::multimap<std::string, Worker*>::iterator,
+              std::multimap<std::string, Worker*>::iterator> range = busy_.equal_range(cancel_key);
+    size_t sent = 0;
+    Json msg;
+    msg["type"] = "cancel";
+    for (std::multimap<std::string, Worker*>::iterator it = range.first; it != range.second; ++it) {
+        if (send_message(it->second->sock, msg)) {
+            ++sent;
+        }
+    }
+    if (sent > 0) {
+        LOG_INFO("[ToolWorkers] Cancelled %zu command(s) for [%s]", sent, cancel_key.c_str());
+    }
+    return sent;
+}
+
+} // namespace opencrank
@@ -0,0 +1,354 @@
+/*
+ * OpenCrank C++ - Tracing Implementation
+ */
+#include <opencrank/core/trace.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <time.h>
+
+namespace opencrank {
+
+namespace {
+
+thread_local TraceContext t_trace;
+std::atomic<bool> g_cpu_clock(false);
+
+int64_t thread_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+std::string hex_span_id(uint32_t id) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016x", id);
+    return buf;
+}
+
+std::string format_duration(int64_t us) {
+    char buf[32];
+    if (us >= 1000000) {
+        snprintf(buf, sizeof(buf), "%.1f s", static_cast<double>(us) / 1e6);
+    } else if (us >= 1000) {
+        snprintf(buf, sizeof(buf), "%lld ms", static_cast<long long>(us / 1000));
+    } else {
+        snprintf(buf, sizeof(buf), "%lld us", static_cast<long long>(us));
+    }
+    return buf;
+}
+
+std::string percent(int64_t part, int64_t whole) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%.0f%%", whole > 0 ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0);
+    return buf;
+}
+
+int64_t attr_int(const TraceSpan& span, const char* key) {
+    return json_utils::get_int(span.attrs, key, 0);
+}
+
+struct Tally {
+    size_t count;
+    int64_t us;
+    Tally() : count(0), us(0) {}
+    void add(int64_t d) { ++count; us += d; }
+};
+
+} // anonymous namespace
+
+// ============================================================================
+// Trace
+// ============================================================================
+
+Trace::Trace(const std::string& name, const std::string& session_key)
+    : name_(name), session_key_(session_key)
+    , started_ms_(current_timestamp_ms()), start_steady_us_(0)
+    , finished_us_(-1), cpu_clock_(g_cpu_clock.load()), next_span_(1) {
+    start_steady_us_ = cpu_clock_ ? thread_cpu_us() : steady_us();
+    id_ = generate_uuid();
+    id_.erase(std::remove(id_.begin(), id_.end(), '-'), id_.end());
+}
+
+int64_t Trace::now_us() const {
+    return (cpu_clock_ ? thread_cpu_us() : steady_us()) - start_steady_us_;
+}
+
+int64_t Trace::duration_us() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_us_ >= 0 ? finished_us_ : now_us();
+}
+
+uint32_t Trace::thread_number() {
+    uint64_t self = static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        if (threads_[i].first == self) return threads_[i].second;
+    }
+    uint32_t n = static_cast<uint32_t>(threads_.size() + 1);
+    threads_.push_back(std::make_pair(self, n));
+    return n;
+}
+
+void Trace::add(const TraceSpan& span) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_.push_back(span);
+}
+
+void Trace::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_us_ < 0) finished_us_ = now_us();
+}
+
+std::vector<TraceSpan> Trace::spans() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return spans_;
+}
+
+Json Trace::to_chrome_json() const {
+    std::vector<TraceSpan> spans = this->spans();
+
+    Json events = Json::array();
+    Json meta;
+    meta["name"] = "process_name";
+    meta["ph"] = "M";
+    meta["pid"] = 1;
+    meta["args"]["name"] = name_ + " " + session_key_;
+    events.push_back(meta);
+
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const TraceSpan& s = spans[i];
+        Json ev;
+        ev["name"] = s.name;
+        ev["cat"] = s.category;
+        ev["ph"] = "X";
+        ev["ts"] = s.start_us;
+        ev["dur"] = s.duration_us;
+        ev["pid"] = 1;
+        ev["tid"] = s.thread;
+        Json args = s.attrs.is_object() ? s.attrs : Json::object();
+        args["trace_id"] = id_;
+        args["span_id"] = hex_span_id(s.id);
+        if (s.parent) args["parent_span_id"] = hex_span_id(s.parent);
+        ev["args"] = args;
+        events.push_back(ev);
+    }
+
+    Json out;
+    out["traceEvents"] = events;
+    out["displayTimeUnit"] = "ms";
+    out["otherData"]["trace_id"] = id_;
+    out["otherData"]["session"] = session_key_;
+    out["otherData"]["started"] = format_timestamp(started_ms_ / 1000);
+    return out;
+}
+
+std::string Trace::summary() const {
+    std::vector<TraceSpan> spans = this->spans();
+    int64_t total = duration_us();
+
+    std::map<std::string, Tally> by_category;
+    std::map<std::string, Tally> by_tool;
+    int64_t input_tokens = 0, output_tokens = 0, cached_tokens = 0;
+    size_t iterations = 0;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const TraceSpan& s = spans[i];
+        if (s.category == "agent") {
+            if (s.name == "iteration") ++iterations;
+            continue;
+        }
+        by_category[s.category].add(s.duration_us);
+        if (s.category == "tool") by_tool[s.name].add(s.duration_us);
+        if (s.category == "llm") {
+            input_tokens += attr_int(s, "input_tokens");
+            output_tokens += attr_int(s, "output_tokens");
+            cached_tokens += attr_int(s, "cached_tokens");
+        }
+    }
+
+    std::ostringstream oss;
+    oss << "🔎 Trace " << id_.substr(0, 8) << " (" << name_ << ", " << format_duration(total)
+        << ", " << iterations << " iteration(s), " << spans.size() << " spans)\n"
+        << "Started: " << format_timestamp(started_ms_ / 1000) << "\n\n";
+
+    const Tally& llm = by_category["llm"];
+    oss << "Model: " << format_duration(llm.us) << " in " << llm.count << " call(s) ("
+        << percent(llm.us, total) << ")";
+    if (input_tokens || output_tokens) {
+        oss << ", " << input_tokens << " prompt";
+        if (cached_tokens) oss << " (" << cached_tokens << " cached)";
+        oss << " / " << output_tokens << " completion tokens";
+    }
+    oss << "\n";
+
+    const Tally& tools = by_category["tool"];
+    oss << "Tools: " << format_duration(tools.us) << " in " << tools.count << " call(s) ("
+        << percent(tools.us, total) << ")\n";
+    for (std::map<std::string, Tally>::const_iterator it = by_tool.begin(); it != by_tool.end(); ++it) {
+        oss << "  " << it->first << ": " << format_duration(it->second.us) << " x" << it->second.count << "\n";
+    }
+
+    const char* extra[] = { "context", "parse", "format", "http", NULL };
+    const char* labels[] = { "Context resume", "Tool-call parsing", "Tool-result formatting",
+                             "HTTP (within the above)", NULL };
+    for (int i = 0; extra[i]; ++i) {
+        std::map<std::string, Tally>::const_iterator it = by_category.find(extra[i]);
+        if (it == by_category.end() || it->second.count == 0) continue;
+        oss << labels[i] << ": " << format_duration(it->second.us) << " in " << it->second.count << "\n";
+    }
+
+    // Resume cycles run inside chat() and HTTP inside both, so only the
+    // agent's own work is subtracted
+    int64_t other = total - llm.us - tools.us - by_category["parse"].us - by_category["format"].us;
+    if (other > 0) oss << "Other: " << format_duration(other) << " (" << percent(other, total) << ")\n";
+
+    std::vector<const TraceSpan*> slowest;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        if (spans[i].category != "agent") slowest.push_back(&spans[i]);
+    }
+    std::sort(slowest.begin(), slowest.end(), [](const TraceSpan* a, const TraceSpan* b) {
+        return a->duration_us > b->duration_us;
+    });
+    if (!slowest.empty()) {
+        oss << "\nSlowest:\n";
+        for (size_t i = 0; i < slowest.size() && i < 5; ++i) {
+            oss << "  " << (i + 1) << ". " << slowest[i]->category << " " << slowest[i]->name
+                << " " << format_duration(slowest[i]->duration_us)
+                << " at +" << format_duration(slowest[i]->start_us) << "\n";
+        }
+    }
+    return oss.str();
+}
+
+// ============================================================================
+// Context and spans
+// ============================================================================
+
+TraceContext TraceContext::current() {
+    return t_trace;
+}
+
+TraceContextScope::TraceContextScope(const TraceContext& ctx) : saved_(t_trace) {
+    t_trace = ctx;
+}
+
+TraceContextScope::~TraceContextScope() {
+    t_trace = saved_;
+}
+
+ScopedSpan::ScopedSpan(const std::string& name, const char* category)
+    : trace_(t_trace.trace.get()), saved_parent_(0) {
+    if (!trace_) return;
+    span_.name = name;
+    span_.category = category;
+    span_.id = trace_->next_span_id();
+    span_.parent = t_trace.parent;
+    span_.thread = trace_->thread_number();
+    span_.start_us = trace_->now_us();
+    saved_parent_ = t_trace.parent;
+    t_trace.parent = span_.id;
+}
+
+ScopedSpan::~ScopedSpan() {
+    if (!trace_) return;
+    span_.duration_us = trace_->now_us() - span_.start_us;
+    span_.attrs.swap(attrs_);
+    trace_->add(span_);
+    t_trace.parent = saved_parent_;
+}
+
+// ============================================================================
+// Tracer
+// ============================================================================
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : keep_(8) {}
+
+void Tracer::configure(size_t keep, const std::string& export_dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    keep_ = keep;
+    export_dir_ = export_dir;
+    if (keep_ == 0) finished_.clear();
+    LOG_INFO("[Trace] %s", keep_ == 0 ? "Disabled" :
+             ("Keeping " + std::to_string(keep_) + " trace(s) per session" +
+              (export_dir_.empty() ? "" : ", exporting to " + export_dir_)).c_str());
+}
+
+void Tracer::set_cpu_clock(bool on) {
+    g_cpu_clock.store(on);
+}
+
+std::shared_ptr<Trace> Tracer::begin(const std::string& name, const std::string& session_key) {
+    if (keep_ == 0) return std::shared_ptr<Trace>();
+    return std::make_shared<Trace>(name, session_key);
+}
+
+void Tracer::finish(const std::shared_ptr<Trace>& trace) {
+    if (!trace) return;
+    trace->finish();
+
+    std::string dir;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (keep_ == 0) return;
+        finished_.push_back(trace);
+
+        // Drop the session's oldest beyond keep_, and anything beyond a
+        // global cap so idle sessions do not pin memory
+        size_t same = 0;
+        for (size_t i = 0; i < finished_.size(); ++i) {
+            if (finished_[i]->session_key() == trace->session_key()) ++same;
+        }
+        for (std::deque<std::shared_ptr<Trace> >::iterator it = finished_.begin();
+             it != finished_.end() && same > keep_; ) {
+            if ((*it)->session_key() == trace->session_key()) {
+                it = finished_.erase(it);
+                --same;
+            } else {
+                ++it;
+            }
+        }
+        while (finished_.size() > keep_ * 16) finished_.pop_front();
+        dir = export_dir_;
+    }
+
+    if (!dir.empty()) write(*trace, dir);
+}
+
+std::shared_ptr<Trace> Tracer::last(const std::string& session_key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::deque<std::shared_ptr<Trace> >::const_reverse_iterator it = finished_.rbegin();
+         it != finished_.rend(); ++it) {
+        if (session_key.empty() || (*it)->session_key() == session_key) return *it;
+    }
+    return std::shared_ptr<Trace>();
+}
+
+std::string Tracer::write(const Trace& trace, const std::string& dir) {
+    std::string path = dir + "/trace-" + trace.id() + ".json";
+    if (!create_parent_directory(path)) {
+        LOG_WARN("[Trace] Cannot create %s", dir.c_str());
+        return "";
+    }
+    std::ofstream out(path.c_str());
+    if (!out.is_open()) {
+        LOG_WARN("[Trace] Cannot write %s", path.c_str());
+        return "";
+    }
+    out << trace.to_chrome_json().dump();
+    LOG_DEBUG("[Trace] Wrote %s", path.c_str());
+    return path;
+}
+
+} // namespace opencrank
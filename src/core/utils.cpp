@@ -1,5 +1,6 @@
 #include <opencrank/core/utils.hpp>
 #include <algorithm>
+#include <atomic>
 #include <numeric>
 #include <cctype>
 #include <cstdlib>
@@ -17,6 +18,12 @@
 #include <openssl/rand.h>
 #include <string_view>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace opencrank {
 
 // ============ Math utilities ============
@@ -32,12 +39,43 @@ int64_t current_timestamp() {
     return static_cast<int64_t>(std::time(NULL));
 }
 
+namespace {
+std::atomic<bool> g_manual_clock(false);
+std::atomic<int64_t> g_manual_ms(0);
+}
+
 int64_t current_timestamp_ms() {
+    if (g_manual_clock.load(std::memory_order_relaxed)) {
+        return g_manual_ms.load(std::memory_order_relaxed);
+    }
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
     return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
 }
 
+int64_t steady_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t steady_ms() {
+    return steady_us() / 1000;
+}
+
+void set_manual_clock(int64_t start_ms) {
+    g_manual_ms.store(start_ms);
+    g_manual_clock.store(true);
+}
+
+void advance_manual_clock(int64_t ms) {
+    if (ms > 0) g_manual_ms.fetch_add(ms);
+}
+
+void clear_manual_clock() {
+    g_manual_clock.store(false);
+}
+
 std::string format_timestamp(int64_t timestamp) {
     time_t t = static_cast<time_t>(timestamp);
     struct tm tm_buf;
@@ -112,78 +150,148 @@ std::string join(const std::vector<std::string>& parts, const std::string& delim
         });
 }
 
+size_t utf8_safe_cut(const char* s, size_t len, size_t max_len) {
+    if (len <= max_len) return len;
+    
+    // Back up if in the middle of a multi-byte sequence
+    size_t cut = max_len;
+    while (cut > 0 && (static_cast<unsigned char>(s[cut]) & 0xC0) == 0x80) {
+        --cut;
+    }
+    return cut;
+}
+
 std::string truncate_safe(const std::string& s, size_t max_len) {
     if (s.size() <= max_len) return s;
-    
-    // Find a safe truncation point (don't break UTF-8 multi-byte sequences)
-    size_t len = max_len;
-    while (len > 0 && (static_cast<unsigned char>(s[len]) & 0xC0) == 0x80) {
-        --len;  // Back up if in the middle of a multi-byte sequence
+    return s.substr(0, utf8_safe_cut(s.data(), s.size(), max_len));
+}
+
+namespace {
+
+// Byte count of the UTF-8 sequence at p that sanitize_utf8 keeps as is,
+// or 0 when it must be rewritten (control char, bad lead or continuation)
+inline size_t clean_sequence(const unsigned char* p, size_t left) {
+    unsigned char c = p[0];
+    if (c < 0x80) {
+        return (c == 0x09 || c == 0x0A || c >= 0x20) ? 1 : 0;
+    }
+    size_t expected;
+    if ((c & 0xE0) == 0xC0) expected = 2;
+    else if ((c & 0xF0) == 0xE0) expected = 3;
+    else if ((c & 0xF8) == 0xF0) expected = 4;
+    else return 0;
+    if (expected > left) return 0;
+    for (size_t j = 1; j < expected; ++j) {
+        if ((p[j] & 0xC0) != 0x80) return 0;
     }
-    return s.substr(0, len);
+    return expected;
 }
 
-std::string sanitize_utf8(const std::string& s) {
-    std::string out;
-    out.reserve(s.size());
-    
-    for (size_t i = 0; i < s.size(); ) {
-        unsigned char c = static_cast<unsigned char>(s[i]);
-        
-        // Determine expected byte count from leading byte
-        int expected = 0;
-        if (c < 0x80) {
-            // ASCII range: allow tab (0x09), newline (0x0A), and printable chars
-            // Strip carriage return (0x0D) and other control chars
-            if (c == 0x09 || c == 0x0A || c >= 0x20) {
-                out.push_back(static_cast<char>(c));
-            } else {
-                // Replace control character with space or skip
-                out.push_back(' ');
+// Length of the prefix of [s, s + n) that sanitize_utf8 leaves unchanged.
+// Blocks of printable ASCII, tab and newline are skipped 16 bytes at a
+// time; anything else goes through clean_sequence().
+size_t clean_prefix(const char* s, size_t n) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+    size_t i = 0;
+    while (i < n) {
+#if defined(__SSE2__)
+        const __m128i floor = _mm_set1_epi8(0x1F);
+        const __m128i tab = _mm_set1_epi8(0x09);
+        const __m128i lf = _mm_set1_epi8(0x0A);
+        while (n - i >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            // Signed compare: 0x20-0x7F pass, bytes >= 0x80 are negative
+            __m128i ok = _mm_or_si128(_mm_cmpgt_epi8(v, floor),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, lf)));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ok));
+            if (mask != 0xFFFF) {
+                i += static_cast<size_t>(__builtin_ctz(~mask));
+                break;
             }
-            ++i;
-            continue;
-        } else if ((c & 0xE0) == 0xC0) {
-            expected = 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            expected = 3;
-        } else if ((c & 0xF8) == 0xF0) {
-            expected = 4;
-        } else {
-            // Invalid leading byte, replace with replacement char
-            out += "\xEF\xBF\xBD"; // �
-            ++i;
-            continue;
+            i += 16;
         }
-        
-        // Validate continuation bytes
-        bool valid = true;
-        if (i + expected > s.size()) {
-            valid = false;
-        } else {
-            for (int j = 1; j < expected; ++j) {
-                if ((static_cast<unsigned char>(s[i + j]) & 0xC0) != 0x80) {
-                    valid = false;
-                    break;
-                }
-            }
+#elif defined(__ARM_NEON)
+        const uint8x16_t floor = vdupq_n_u8(0x20);
+        const uint8x16_t ceiling = vdupq_n_u8(0x80);
+        const uint8x16_t tab = vdupq_n_u8(0x09);
+        const uint8x16_t lf = vdupq_n_u8(0x0A);
+        while (n - i >= 16) {
+            uint8x16_t v = vld1q_u8(p + i);
+            uint8x16_t ok = vandq_u8(vcgeq_u8(v, floor), vcltq_u8(v, ceiling));
+            ok = vorrq_u8(ok, vorrq_u8(vceqq_u8(v, tab), vceqq_u8(v, lf)));
+            if (vminvq_u8(ok) != 0xFF) break;   // Scalar finds the byte
+            i += 16;
         }
-        
-        if (valid) {
-            for (int j = 0; j < expected; ++j) {
-                out.push_back(s[i + j]);
-            }
-            i += expected;
+#endif
+        if (i >= n) break;
+        size_t len = clean_sequence(p + i, n - i);
+        if (len == 0) return i;
+        i += len;
+    }
+    return n;
+}
+
+} // namespace
+
+bool utf8_is_clean(const char* s, size_t n) {
+    return clean_prefix(s, n) == n;
+}
+
+void sanitize_utf8_into(const char* s, size_t n, std::string& out) {
+    size_t clean = clean_prefix(s, n);
+    if (clean == n) {
+        out.assign(s, n);
+        return;
+    }
+    
+    // Worst case every remaining byte becomes U+FFFD (3 bytes)
+    out.resize(clean + (n - clean) * 3);
+    char* dst = &out[0];
+    std::memcpy(dst, s, clean);
+    char* w = dst + clean;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+    
+    size_t i = clean;
+    while (i < n) {
+        unsigned char c = p[i];
+        size_t len = clean_sequence(p + i, n - i);
+        if (len > 0) {
+            std::memcpy(w, s + i, len);
+            w += len;
+            i += len;
+        } else if (c < 0x80) {
+            // Control character (CR included) becomes a space
+            *w++ = ' ';
+            ++i;
         } else {
-            // Replace invalid sequence with replacement char
-            out += "\xEF\xBF\xBD"; // �
+            // Invalid lead or truncated sequence: one replacement per byte
+            std::memcpy(w, "\xEF\xBF\xBD", 3);  // U+FFFD
+            w += 3;
             ++i;
         }
+        
+        // Copy the next clean run in one go
+        size_t run = clean_prefix(s + i, n - i);
+        std::memcpy(w, s + i, run);
+        w += run;
+        i += run;
     }
-    
+    out.resize(static_cast<size_t>(w - dst));
+}
+
+std::string sanitize_utf8(const std::string& s) {
+    std::string out;
+    sanitize_utf8_into(s.data(), s.size(), out);
     return out;
 }
 
+void sanitize_utf8_in_place(std::string& s) {
+    if (utf8_is_clean(s.data(), s.size())) return;
+    std::string out;
+    sanitize_utf8_into(s.data(), s.size(), out);
+    s.swap(out);
+}
+
 // ============ Phone number utilities ============
 
 // ============ Path utilities ============
@@ -283,6 +391,86 @@ std::string generate_uuid() {
 
 // ============ Hashing utilities ============
 
+uint64_t fnv1a_64(const std::string& data) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string sha256_hex(const std::string& data) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), digest);
+    static const char hex[] = "0123456789abcdef";
+    std::string out(SHA256_DIGEST_LENGTH * 2, '0');
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+        out[i * 2] = hex[digest[i] >> 4];
+        out[i * 2 + 1] = hex[digest[i] & 0x0F];
+    }
+    return out;
+}
+
+// ============ Regex utilities ============
+
+std::string regex_required_literal(const std::string& pattern) {
+    if (pattern.find('|') != std::string::npos) return "";
+    
+    std::string best, run;
+    int depth = 0;      // Group contents may be optional or repeated: skipped
+    for (size_t i = 0; i < pattern.size(); ) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char n = pattern[i + 1];
+            i += 2;
+            if (isalnum(static_cast<unsigned char>(n))) {
+                // \d, \w, \b, back-references, \n ...: not a plain literal
+                if (run.size() > best.size()) best = run;
+                run.clear();
+            } else if (depth == 0) {
+                run += n;
+            }
+            continue;
+        }
+        if (c == '*' || c == '?' || c == '{') {
+            if (!run.empty()) run.erase(run.size() - 1);   // Previous atom optional
+            if (run.size() > best.size()) best = run;
+            run.clear();
+            if (c == '{') {
+                size_t close = pattern.find('}', i);
+                i = close == std::string::npos ? pattern.size() : close + 1;
+            } else {
+                ++i;
+            }
+            continue;
+        }
+        if (c == '+' || c == '^' || c == '$' || c == '.' || c == '(' || c == ')' || c == '[') {
+            if (run.size() > best.size()) best = run;
+            run.clear();
+            if (c == '(') ++depth;
+            if (c == ')' && depth > 0) --depth;
+            if (c == '[') {
+                // Skip the class, honouring escapes and a leading ']'
+                size_t j = i + 1;
+                if (j < pattern.size() && pattern[j] == '^') ++j;
+                if (j < pattern.size() && pattern[j] == ']') ++j;
+                while (j < pattern.size() && pattern[j] != ']') {
+                    j += (pattern[j] == '\\') ? 2 : 1;
+                }
+                i = j + 1;
+                continue;
+            }
+            ++i;
+            continue;
+        }
+        if (depth == 0) run += c;
+        ++i;
+    }
+    if (run.size() > best.size()) best = run;
+    return best.size() >= 3 ? best : std::string();
+}
+
 // ============ HTML utilities ============
 
 std::string strip_html_for_ai(const std::string& html) {
@@ -21,5 +21,11 @@ int main(int argc, char* argv[]) {
     int result = app.run();
     app.shutdown();
     
+    // SIGUSR2: continue as the binary now at this path
+    if (app.restarting()) {
+        app.exec_restart(argv);
+        return 1;   // Only reached when the new image could not start
+    }
+    
     return result;
 }
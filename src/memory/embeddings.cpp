@@ -0,0 +1,319 @@
+/*
+ * OpenCrank C++ - Memory Embeddings Implementation
+ */
+#include <opencrank/memory/embeddings.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <opencrank/core/logger.hpp>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define OPENCRANK_HAVE_SSE 1
+#endif
+
+namespace opencrank {
+
+// ============================================================================
+// Vector helpers
+// ============================================================================
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        // Inf / NaN
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    }
+    if (exponent >= 0x1F) {
+        return static_cast<uint16_t>(sign | 0x7C00);  // Overflow -> inf
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) return static_cast<uint16_t>(sign);  // Underflow -> 0
+        // Subnormal
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;  // Round half up
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;  // Round to nearest (carry may bump exponent)
+    return static_cast<uint16_t>(half);
+}
+
+float half_to_float(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Normalize subnormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            mantissa &= 0x3FF;
+            bits = sign | (exponent << 23) | (mantissa << 13);
+        }
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float out;
+    std::memcpy(&out, &bits, sizeof(out));
+    return out;
+}
+
+std::string encode_embedding(const std::vector<float>& vec) {
+    std::string blob(vec.size() * 2, '\0');
+    for (size_t i = 0; i < vec.size(); ++i) {
+        uint16_t h = float_to_half(vec[i]);
+        blob[2 * i] = static_cast<char>(h & 0xFF);
+        blob[2 * i + 1] = static_cast<char>(h >> 8);
+    }
+    return blob;
+}
+
+std::vector<float> decode_embedding(const void* data, size_t bytes) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::vector<float> vec(bytes / 2);
+    for (size_t i = 0; i < vec.size(); ++i) {
+        uint16_t h = static_cast<uint16_t>(p[2 * i] | (p[2 * i + 1] << 8));
+        vec[i] = half_to_float(h);
+    }
+    return vec;
+}
+
+float dot_product(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#ifdef OPENCRANK_HAVE_SSE
+    // Two accumulators hide the add latency
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void normalize_vector(std::vector<float>& vec) {
+    float norm = std::sqrt(dot_product(vec.data(), vec.data(), vec.size()));
+    if (norm <= 0.0f) return;
+    float inv = 1.0f / norm;
+    for (size_t i = 0; i < vec.size(); ++i) {
+        vec[i] *= inv;
+    }
+}
+
+// ============================================================================
+// EmbeddingClient
+// ============================================================================
+
+std::string EmbeddingClient::model_tag() const {
+    return config_.model.empty() ? config_.api + ":" + config_.url : config_.model;
+}
+
+bool EmbeddingClient::embed(const std::string& text, std::vector<float>& out, std::string* error) const {
+    out.clear();
+    if (!enabled()) {
+        if (error) *error = "embeddings not configured";
+        return false;
+    }
+
+    std::string base = config_.url;
+    while (!base.empty() && base[base.size() - 1] == '/') base.erase(base.size() - 1);
+
+    bool llama = config_.api == "llamacpp";
+    std::string url;
+    Json body = Json::object();
+    if (llama) {
+        url = base + "/embedding";
+        body["content"] = text;
+    } else {
+        bool has_v1 = base.size() >= 3 && base.compare(base.size() - 3, 3, "/v1") == 0;
+        url = base + (has_v1 ? "/embeddings" : "/v1/embeddings");
+        body["input"] = text;
+        if (!config_.model.empty()) body["model"] = config_.model;
+    }
+
+    std::map<std::string, std::string> headers;
+    if (!config_.api_key.empty()) {
+        headers["Authorization"] = "Bearer " + config_.api_key;
+    }
+
+    HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+    http->set_timeout(config_.timeout_ms);
+    HttpResponse resp = http->post_json(url, body, headers);
+
+    if (!resp.ok()) {
+        if (error) {
+            *error = resp.error.empty()
+                ? "HTTP " + std::to_string(resp.status_code) + ": " + resp.body.substr(0, 200)
+                : resp.error;
+        }
+        return false;
+    }
+
+    Json j = resp.json();
+    const Json* vec = nullptr;
+    if (llama) {
+        // Old servers: {"embedding": [...]}
+        // New servers: [{"index": 0, "embedding": [[...]]}]
+        if (j.is_array() && !j.empty() && j[0].is_object()) {
+            j = j[0];
+        }
+        if (j.is_object() && j.contains("embedding") && j["embedding"].is_array()) {
+            vec = &j["embedding"];
+            if (!vec->empty() && (*vec)[0].is_array()) {
+                vec = &(*vec)[0];
+            }
+        }
+    } else if (j.is_object() && j.contains("data") && j["data"].is_array() && !j["data"].empty()) {
+        const Json& first = j["data"][0];
+        if (first.contains("embedding") && first["embedding"].is_array()) {
+            vec = &first["embedding"];
+        }
+    }
+
+    if (!vec || vec->empty()) {
+        if (error) *error = "unexpected embedding response";
+        return false;
+    }
+
+    out.reserve(vec->size());
+    for (size_t i = 0; i < vec->size(); ++i) {
+        out.push_back((*vec)[i].is_number() ? (*vec)[i].get<float>() : 0.0f);
+    }
+    return true;
+}
+
+// ============================================================================
+// VectorIndex
+// ============================================================================
+
+void VectorIndex::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dim_ = 0;
+    data_.clear();
+    ids_.clear();
+    slots_.clear();
+}
+
+bool VectorIndex::upsert(const std::string& id, std::vector<float> vec) {
+    if (vec.empty()) return false;
+    normalize_vector(vec);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dim_ == 0) {
+        dim_ = vec.size();
+    } else if (vec.size() != dim_) {
+        LOG_WARN("[MemoryIndex] Dimension mismatch for %s (%zu != %zu)",
+                 id.c_str(), vec.size(), dim_);
+        return false;
+    }
+
+    auto it = slots_.find(id);
+    if (it != slots_.end()) {
+        std::copy(vec.begin(), vec.end(), data_.begin() + it->second * dim_);
+        return true;
+    }
+
+    slots_[id] = ids_.size();
+    ids_.push_back(id);
+    data_.insert(data_.end(), vec.begin(), vec.end());
+    return true;
+}
+
+void VectorIndex::remove(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = slots_.find(id);
+    if (it == slots_.end()) return;
+
+    // Move the last row into the hole
+    size_t slot = it->second;
+    size_t last = ids_.size() - 1;
+    if (slot != last) {
+        std::copy(data_.begin() + last * dim_, data_.begin() + (last + 1) * dim_,
+                  data_.begin() + slot * dim_);
+        ids_[slot] = ids_[last];
+        slots_[ids_[slot]] = slot;
+    }
+    ids_.pop_back();
+    data_.resize(ids_.size() * dim_);
+    slots_.erase(it);
+}
+
+size_t VectorIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ids_.size();
+}
+
+size_t VectorIndex::dim() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dim_;
+}
+
+std::vector<std::pair<std::string, float>> VectorIndex::search(
+    std::vector<float> query, size_t k, float min_similarity) const
+{
+    std::vector<std::pair<std::string, float>> hits;
+    if (query.empty() || k == 0) return hits;
+    normalize_vector(query);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (query.size() != dim_) return hits;
+
+    // Bounded min-heap of the best k rows
+    typedef std::pair<float, size_t> Scored;
+    std::vector<Scored> heap;
+    heap.reserve(k + 1);
+    std::greater<Scored> cmp;
+
+    const float* row = data_.data();
+    for (size_t r = 0; r < ids_.size(); ++r, row += dim_) {
+        float sim = dot_product(query.data(), row, dim_);
+        if (sim < min_similarity) continue;
+        if (heap.size() < k) {
+            heap.push_back(Scored(sim, r));
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        } else if (sim > heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            heap.back() = Scored(sim, r);
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        }
+    }
+
+    std::sort(heap.begin(), heap.end(), cmp);
+    hits.reserve(heap.size());
+    for (size_t i = 0; i < heap.size(); ++i) {
+        hits.push_back(std::make_pair(ids_[heap[i].second], heap[i].first));
+    }
+    return hits;
+}
+
+} // namespace opencrank
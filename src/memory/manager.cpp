@@ -7,8 +7,14 @@
 #include <opencrank/memory/manager.hpp>
 #include <opencrank/core/config.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
 
+#include <dirent.h>
+#include <cctype>
+#include <cstdio>
 #include <cstdlib>
+#include <map>
+#include <algorithm>
 
 namespace opencrank {
 
@@ -16,7 +22,29 @@ namespace opencrank {
 // MemoryManager Implementation
 // ============================================================================
 
-MemoryManager::MemoryManager() : initialized_(false) {}
+namespace {
+    // Reciprocal rank fusion constant (standard value from the RRF paper)
+    const double RRF_K = 60.0;
+    
+    // Memories embedded per backfill round
+    const int BACKFILL_BATCH = 32;
+    
+    // Owner of the memory calls on this thread (ShardScope)
+    thread_local std::string t_shard_user;
+    
+    // Readable part of a shard file name
+    const size_t SHARD_NAME_CHARS = 48;
+}
+
+MemoryManager::ShardScope::ShardScope(const std::string& user_key) : saved_(t_shard_user) {
+    t_shard_user = user_key;
+}
+
+MemoryManager::ShardScope::~ShardScope() {
+    t_shard_user = saved_;
+}
+
+MemoryManager::MemoryManager() : initialized_(false), revision_(0), stop_backfill_(false) {}
 
 MemoryManager::~MemoryManager() {
     shutdown();
@@ -37,12 +65,40 @@ bool MemoryManager::init(const MemoryConfig& config) {
     
     LOG_INFO(" Initializing with db_path=%s", db_path.c_str());
     
+    store_.set_write_linger(config_.write_linger_ms);
     if (!store_.open(db_path)) {
         LOG_ERROR(" Failed to open database: %s", db_path.c_str());
         return false;
     }
     
+    shard_dir_.clear();
+    if (sharded()) {
+        shard_dir_ = config_.shard_dir;
+        if (shard_dir_.empty()) {
+            size_t slash = db_path.find_last_of('/');
+            shard_dir_ = (slash == std::string::npos ? std::string(".") : db_path.substr(0, slash)) + "/memory";
+        }
+        LOG_INFO(" Memories sharded by %s under %s (up to %d open)",
+                 config_.shard_by.c_str(), shard_dir_.c_str(), config_.shard_cache);
+        if (config_.embeddings.enabled) {
+            LOG_WARN(" Embeddings are not used with sharded memory; search is BM25 per shard");
+        }
+    }
+    
     initialized_ = true;
+    
+    if (!sharded() && config_.search.hybrid_enabled && config_.embeddings.enabled) {
+        embedder_.configure(config_.embeddings);
+        if (embedder_.enabled()) {
+            embed_model_ = embedder_.model_tag();
+            load_vectors();
+            stop_backfill_ = false;
+            backfill_thread_ = std::thread(&MemoryManager::backfill_vectors, this);
+        } else {
+            LOG_WARN(" Embeddings enabled but no embedding URL configured; using BM25 only");
+        }
+    }
+    
     LOG_INFO(" Initialized successfully");
     return true;
 }
@@ -64,10 +120,58 @@ bool MemoryManager::init(const Config& config) {
     mcfg.search.max_results = static_cast<int>(
         config.get_int("memory.max_results", 10));
     
+    // Semantic search (falls back to the llama.cpp server URL)
+    mcfg.embeddings.enabled = config.get_bool("memory.embeddings", false);
+    mcfg.embeddings.url = config.get_string("memory.embedding_url",
+                                            config.get_string("llamacpp.url", ""));
+    mcfg.embeddings.api = config.get_string("memory.embedding_api", "openai");
+    mcfg.embeddings.model = config.get_string("memory.embedding_model", "");
+    mcfg.embeddings.api_key = config.get_string("memory.embedding_api_key", "");
+    mcfg.embeddings.timeout_ms = static_cast<int>(
+        config.get_int("memory.embedding_timeout_ms", 15000));
+    mcfg.search.hybrid_enabled = mcfg.embeddings.enabled;
+    mcfg.maintenance.enabled = config.get_bool("memory.maintenance.enabled", mcfg.maintenance.enabled);
+    mcfg.maintenance.cron = config.get_string("memory.maintenance.cron", mcfg.maintenance.cron);
+    mcfg.maintenance.checkpoint_wal_bytes = config.get_int("memory.maintenance.checkpoint_wal_bytes",
+                                                           mcfg.maintenance.checkpoint_wal_bytes);
+    mcfg.maintenance.vacuum_pages = static_cast<int>(
+        config.get_int("memory.maintenance.vacuum_pages", mcfg.maintenance.vacuum_pages));
+    mcfg.maintenance.probe_query = config.get_string("memory.maintenance.probe_query", "");
+    mcfg.shard_by = config.get_string("memory.shard_by", "");
+    if (mcfg.shard_by == "none") mcfg.shard_by.clear();
+    if (!mcfg.shard_by.empty() && mcfg.shard_by != "user" && mcfg.shard_by != "channel") {
+        LOG_WARN(" Unknown memory.shard_by '%s', using one database", mcfg.shard_by.c_str());
+        mcfg.shard_by.clear();
+    }
+    mcfg.shard_dir = config.get_string("memory.shard_dir", "");
+    mcfg.shard_cache = static_cast<int>(config.get_int("memory.shard_cache", mcfg.shard_cache));
+    mcfg.write_linger_ms = static_cast<int>(
+        config.get_int("memory.write_linger_ms", mcfg.write_linger_ms));
+    
+    const Json& mem = config.get_section("memory");
+    if (mem.is_object()) {
+        mcfg.search.bm25_weight = mem.value("bm25_weight", mcfg.search.bm25_weight);
+        mcfg.search.vector_weight = mem.value("vector_weight", mcfg.search.vector_weight);
+        mcfg.embeddings.min_similarity = mem.value("embedding_min_similarity",
+                                                   mcfg.embeddings.min_similarity);
+    }
+    
     return init(mcfg);
 }
 
 void MemoryManager::shutdown() {
+    stop_backfill_ = true;
+    if (backfill_thread_.joinable()) {
+        backfill_thread_.join();
+    }
+    vectors_.clear();
+    
+    {
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        shards_.clear();
+        shard_lru_.clear();
+    }
+    
     if (initialized_) {
         store_.close();
         initialized_ = false;
@@ -101,16 +205,41 @@ std::string MemoryManager::save_memory(
     entry.channel = channel;
     entry.user_id = user_id;
     
-    if (store_.save_memory(entry)) {
+    std::string id;
+    if (memories()->save_memory(entry, &id)) {
+        revision_.fetch_add(1);
         // Return a confirmation - the store generates the ID internally
         LOG_DEBUG("Memory saved (category=%s, importance=%d)",
                   category.c_str(), importance);
+        if (embedder_.enabled()) {
+            index_memory(id, content);
+        }
         return "saved";
     }
     
     return "";
 }
 
+size_t MemoryManager::save_memories(const std::vector<MemoryEntry>& entries) {
+    if (!initialized_) {
+        LOG_ERROR(" Not initialized, cannot save memories");
+        return 0;
+    }
+    
+    std::vector<std::string> ids;
+    if (!memories()->save_memories(entries, &ids)) {
+        return 0;
+    }
+    
+    revision_.fetch_add(1);
+    if (embedder_.enabled()) {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            index_memory(ids[i], entries[i].content);
+        }
+    }
+    return ids.size();
+}
+
 std::vector<MemorySearchHit> MemoryManager::search(
     const std::string& query, int max_results, const std::string& category)
 {
@@ -120,22 +249,216 @@ std::vector<MemorySearchHit> MemoryManager::search(
     }
     
     int limit = max_results > 0 ? max_results : config_.search.max_results;
-    return store_.search_memories(query, limit, category);
+    if (embedder_.enabled() && vectors_.size() > 0) {
+        return hybrid_search(query, limit, category);
+    }
+    return memories()->search_memories(query, limit, category);
 }
 
 MemoryEntry MemoryManager::get_memory(const std::string& id) {
     if (!initialized_) return MemoryEntry();
-    return store_.get_memory(id);
+    return memories()->get_memory(id);
 }
 
 std::vector<MemoryEntry> MemoryManager::get_recent(int limit, const std::string& category) {
     if (!initialized_) return std::vector<MemoryEntry>();
-    return store_.get_recent_memories(limit, category);
+    return memories()->get_recent_memories(limit, category);
 }
 
 bool MemoryManager::delete_memory(const std::string& id) {
     if (!initialized_) return false;
-    return store_.delete_memory(id);
+    vectors_.remove(id);
+    revision_.fetch_add(1);
+    return memories()->delete_memory(id);
+}
+
+// ============================================================================
+// Shards
+// ============================================================================
+
+std::string MemoryManager::shard_stem(const std::string& user_key) const {
+    if (!sharded() || user_key.empty()) return "";
+    std::string owner = user_key;
+    if (config_.shard_by == "channel") {
+        owner = user_key.substr(0, user_key.find(':'));
+    }
+    
+    // Readable prefix plus a hash, so distinct owners never share a file
+    std::string stem;
+    for (size_t i = 0; i < owner.size() && stem.size() < SHARD_NAME_CHARS; ++i) {
+        char c = owner[i];
+        stem += (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_') ? c : '_';
+    }
+    char hash[20];
+    snprintf(hash, sizeof(hash), "-%08llx",
+             static_cast<unsigned long long>(fnv1a_64(owner) & 0xffffffffULL));
+    return stem + hash;
+}
+
+std::shared_ptr<MemoryStore> MemoryManager::memories() {
+    std::string stem = shard_stem(t_shard_user);
+    if (stem.empty()) {
+        // Aliases the member: nothing to free
+        return std::shared_ptr<MemoryStore>(std::shared_ptr<MemoryStore>(), &store_);
+    }
+    std::shared_ptr<MemoryStore> store = shard(stem);
+    return store ? store : std::shared_ptr<MemoryStore>(std::shared_ptr<MemoryStore>(), &store_);
+}
+
+std::shared_ptr<MemoryStore> MemoryManager::shard(const std::string& stem) {
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    std::map<std::string, Shard>::iterator it = shards_.find(stem);
+    if (it != shards_.end()) {
+        shard_lru_.splice(shard_lru_.begin(), shard_lru_, it->second.lru);
+        return it->second.store;
+    }
+    
+    std::shared_ptr<MemoryStore> store = std::make_shared<MemoryStore>();
+    store->set_write_linger(config_.write_linger_ms);
+    std::string path = shard_dir_ + "/" + stem + ".db";
+    if (!store->open(path)) {
+        LOG_ERROR(" Failed to open memory shard %s, using the main database", path.c_str());
+        return std::shared_ptr<MemoryStore>();
+    }
+    
+    // Calls still holding an evicted store finish before it closes
+    while (!shard_lru_.empty() && shards_.size() >= static_cast<size_t>(std::max(1, config_.shard_cache))) {
+        shards_.erase(shard_lru_.back());
+        shard_lru_.pop_back();
+    }
+    shard_lru_.push_front(stem);
+    Shard& entry = shards_[stem];
+    entry.store = store;
+    entry.lru = shard_lru_.begin();
+    return store;
+}
+
+size_t MemoryManager::open_shards() const {
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    return shards_.size();
+}
+
+// ============================================================================
+// Semantic Index
+// ============================================================================
+
+bool MemoryManager::index_memory(const std::string& id, const std::string& content) {
+    std::vector<float> vec;
+    std::string error;
+    if (!embedder_.embed(content, vec, &error)) {
+        LOG_WARN(" Embedding failed for memory %s: %s", id.c_str(), error.c_str());
+        return false;
+    }
+    
+    store_.save_embedding(id, embed_model_, encode_embedding(vec), static_cast<int>(vec.size()));
+    return vectors_.upsert(id, vec);
+}
+
+void MemoryManager::load_vectors() {
+    vectors_.clear();
+    store_.for_each_embedding(embed_model_,
+        [this](const std::string& id, const void* blob, size_t bytes) {
+            vectors_.upsert(id, decode_embedding(blob, bytes));
+        });
+    LOG_INFO(" Loaded %zu memory embeddings (dim=%zu, model=%s)",
+             vectors_.size(), vectors_.dim(), embed_model_.c_str());
+}
+
+void MemoryManager::backfill_vectors() {
+    size_t done = 0;
+    while (!stop_backfill_) {
+        std::vector<MemoryEntry> pending =
+            store_.get_memories_without_embedding(embed_model_, BACKFILL_BATCH);
+        if (pending.empty()) break;
+        
+        for (size_t i = 0; i < pending.size() && !stop_backfill_; ++i) {
+            if (!index_memory(pending[i].id, pending[i].content)) {
+                // Endpoint unavailable; retry on next start rather than spinning
+                LOG_WARN(" Embedding backfill stopped after %zu memories", done);
+                return;
+            }
+            done++;
+        }
+    }
+    if (done > 0) {
+        LOG_INFO(" Embedded %zu existing memories", done);
+    }
+}
+
+std::vector<MemorySearchHit> MemoryManager::hybrid_search(
+    const std::string& query, int limit, const std::string& category)
+{
+    // Over-fetch from both rankers so fusion has something to reorder
+    int candidates = limit * 3;
+    std::vector<MemorySearchHit> keyword = store_.search_memories(query, candidates, category);
+    
+    std::vector<float> qvec;
+    std::string error;
+    if (!embedder_.embed(query, qvec, &error)) {
+        LOG_WARN(" Query embedding failed (%s), using BM25 only", error.c_str());
+        if (static_cast<int>(keyword.size()) > limit) keyword.resize(limit);
+        return keyword;
+    }
+    
+    // Category filtering happens after the scan, so widen the vector pool
+    size_t vector_pool = static_cast<size_t>(category.empty() ? candidates : candidates * 4);
+    std::vector<std::pair<std::string, float>> semantic = vectors_.search(
+        qvec, vector_pool, static_cast<float>(config_.embeddings.min_similarity));
+    
+    std::map<std::string, size_t> index;  // id -> position in fused
+    std::vector<MemorySearchHit> fused;
+    std::vector<double> scores;
+    
+    for (size_t i = 0; i < keyword.size(); ++i) {
+        index[keyword[i].entry.id] = fused.size();
+        fused.push_back(keyword[i]);
+        scores.push_back(config_.search.bm25_weight / (RRF_K + i + 1));
+    }
+    
+    size_t rank = 0;
+    for (size_t i = 0; i < semantic.size(); ++i) {
+        const std::string& id = semantic[i].first;
+        double contribution = config_.search.vector_weight / (RRF_K + rank + 1);
+        
+        auto it = index.find(id);
+        if (it != index.end()) {
+            scores[it->second] += contribution;
+            rank++;
+            continue;
+        }
+        
+        MemoryEntry entry = store_.get_memory(id);
+        if (entry.id.empty()) {
+            vectors_.remove(id);  // Deleted behind our back
+            continue;
+        }
+        if (!category.empty() && entry.category != category) continue;
+        
+        MemorySearchHit hit;
+        hit.entry = entry;
+        hit.snippet = entry.content.substr(0, 200);
+        index[id] = fused.size();
+        fused.push_back(hit);
+        scores.push_back(contribution);
+        rank++;
+    }
+    
+    std::vector<size_t> order(fused.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&scores](size_t a, size_t b) {
+        return scores[a] > scores[b];
+    });
+    
+    std::vector<MemorySearchHit> results;
+    for (size_t i = 0; i < order.size() && static_cast<int>(results.size()) < limit; ++i) {
+        MemorySearchHit hit = fused[order[i]];
+        hit.score = scores[order[i]];
+        results.push_back(hit);
+    }
+    
+    LOG_DEBUG(" Hybrid search '%s': %zu keyword + %zu vector -> %zu results",
+              query.c_str(), keyword.size(), semantic.size(), results.size());
+    return results;
 }
 
 // ============================================================================
@@ -166,12 +489,89 @@ std::string MemoryManager::create_task(
 
     if (store_.create_task(task)) {
         LOG_DEBUG("Task created: '%.50s'", content.c_str());
+        notify_tasks_changed();
         return "created";
     }
 
     return "";
 }
 
+bool MemoryManager::run_maintenance(MaintenanceReport& report) {
+    if (!initialized_) return false;
+    
+    bool ok = store_.run_maintenance(config_.maintenance, report);
+    
+    // Every shard file, not only the open ones
+    size_t shards = 0;
+    DIR* dir = sharded() ? opendir(shard_dir_.c_str()) : NULL;
+    if (dir) {
+        std::vector<std::string> stems;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = entry->d_name;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".db") == 0) {
+                stems.push_back(name.substr(0, name.size() - 3));
+            }
+        }
+        closedir(dir);
+        
+        double probe_total = report.probe_ms_before >= 0 ? report.probe_ms_after : 0;
+        double probe_before_total = report.probe_ms_before >= 0 ? report.probe_ms_before : 0;
+        size_t probed = report.probe_ms_before >= 0 ? 1 : 0;
+        for (size_t i = 0; i < stems.size(); ++i) {
+            std::shared_ptr<MemoryStore> store = shard(stems[i]);
+            if (!store) continue;
+            MaintenanceReport part;
+            ok = store->run_maintenance(config_.maintenance, part) && ok;
+            report.db_bytes_before += part.db_bytes_before;
+            report.db_bytes_after += part.db_bytes_after;
+            report.wal_bytes_before += part.wal_bytes_before;
+            report.wal_bytes_after += part.wal_bytes_after;
+            report.pages_vacuumed += part.pages_vacuumed;
+            report.elapsed_ms += part.elapsed_ms;
+            report.fts_optimized = report.fts_optimized && part.fts_optimized;
+            report.analyzed = report.analyzed && part.analyzed;
+            if (part.probe_ms_before >= 0) {
+                probe_before_total += part.probe_ms_before;
+                probe_total += part.probe_ms_after;
+                probed++;
+            }
+            shards++;
+        }
+        if (probed > 0) {
+            report.probe_ms_before = probe_before_total / probed;
+            report.probe_ms_after = probe_total / probed;
+        }
+    }
+    
+    std::string scope = shards > 0 ? " over " + std::to_string(shards + 1) + " databases" : "";
+    LOG_INFO(" Maintenance %s in %.0f ms%s: db %lld -> %lld bytes, wal %lld -> %lld bytes, "
+             "search %.2f -> %.2f ms (fts optimize=%s analyze=%s checkpoint=%s vacuumed=%lld pages)",
+             ok ? "done" : "partly failed", report.elapsed_ms,
+             scope.c_str(),
+             static_cast<long long>(report.db_bytes_before), static_cast<long long>(report.db_bytes_after),
+             static_cast<long long>(report.wal_bytes_before), static_cast<long long>(report.wal_bytes_after),
+             report.probe_ms_before, report.probe_ms_after,
+             report.fts_optimized ? "yes" : "no", report.analyzed ? "yes" : "no",
+             report.checkpointed ? "yes" : "no", static_cast<long long>(report.pages_vacuumed));
+    return ok;
+}
+
+size_t MemoryManager::create_tasks(const std::vector<MemoryTask>& tasks) {
+    if (!initialized_) {
+        LOG_ERROR(" Not initialized, cannot create tasks");
+        return 0;
+    }
+
+    std::vector<std::string> ids;
+    if (!store_.create_tasks(tasks, &ids)) {
+        return 0;
+    }
+
+    notify_tasks_changed();
+    return ids.size();
+}
+
 std::vector<MemoryTask> MemoryManager::list_tasks(
     bool include_completed, const std::string& channel)
 {
@@ -186,12 +586,16 @@ MemoryTask MemoryManager::get_task(const std::string& id) {
 
 bool MemoryManager::complete_task(const std::string& id) {
     if (!initialized_) return false;
-    return store_.complete_task(id);
+    bool ok = store_.complete_task(id);
+    if (ok) notify_tasks_changed();
+    return ok;
 }
 
 bool MemoryManager::delete_task(const std::string& id) {
     if (!initialized_) return false;
-    return store_.delete_task(id);
+    bool ok = store_.delete_task(id);
+    if (ok) notify_tasks_changed();
+    return ok;
 }
 
 std::vector<MemoryTask> MemoryManager::get_due_tasks() {
@@ -3,16 +3,24 @@
  * 
  * SQLite storage backend for memories and tasks.
  * Uses FTS5 for BM25 full-text search.
+ *
+ * Reads run on per-thread WAL connections; writes are funnelled through
+ * a single writer thread that group-commits whatever is queued.
  */
 #include <opencrank/memory/store.hpp>
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/metrics.hpp>
 #include <sqlite3.h>
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
 #include <ctime>
 #include <cstdio>
+#include <future>
+#include <chrono>
+#include <cctype>
+#include <sys/stat.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -70,18 +78,142 @@ std::string MemoryStore::generate_uuid() {
     return std::string(buf);
 }
 
+// ============================================================================
+// Connection / statement cache
+// ============================================================================
+
+struct MemoryStore::Connection {
+    sqlite3* db;
+    std::map<std::string, sqlite3_stmt*> statements;
+
+    Connection() : db(nullptr) {}
+
+    ~Connection() {
+        for (auto& kv : statements) {
+            sqlite3_finalize(kv.second);
+        }
+        statements.clear();
+        if (db) sqlite3_close(db);
+    }
+
+    // Cached prepared statement for sql (nullptr on error)
+    sqlite3_stmt* prepare(const std::string& sql) {
+        auto it = statements.find(sql);
+        if (it != statements.end()) return it->second;
+
+        sqlite3_stmt* stmt = nullptr;
+        int rc = sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            LOG_ERROR("[MemoryStore] prepare failed: %s\n  Query: %s",
+                      sqlite3_errmsg(db), sql.c_str());
+            return nullptr;
+        }
+        statements[sql] = stmt;
+        return stmt;
+    }
+
+private:
+    Connection(const Connection&);
+    Connection& operator=(const Connection&);
+};
+
+struct MemoryStore::WriteJob {
+    DbFn fn;
+    bool exclusive;
+    std::promise<bool> result;
+    
+    WriteJob() : exclusive(false) {}
+};
+
+namespace {
+
+// Resets a cached statement on scope exit so it can be reused and so
+// readers don't pin an old WAL snapshot.
+class StatementScope {
+public:
+    explicit StatementScope(sqlite3_stmt* stmt) : stmt_(stmt) {}
+    ~StatementScope() {
+        if (stmt_) {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);
+        }
+    }
+private:
+    sqlite3_stmt* stmt_;
+};
+
+// First column of the first row of a PRAGMA (-1 on error)
+int64_t pragma_int(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    int64_t value = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+std::string column_string(sqlite3_stmt* stmt, int col) {
+    const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+    return text ? std::string(text) : std::string();
+}
+
+Histogram& query_seconds(const char* op) {
+    return Metrics::instance().histogram("opencrank_sqlite_seconds", "SQLite time per operation",
+                                         metric_labels("db", "memory", "op", op));
+}
+
+// Columns: id, content, category, tags, channel, user_id, importance, created_at, updated_at
+void read_memory_row(sqlite3_stmt* stmt, MemoryEntry& entry) {
+    entry.id = column_string(stmt, 0);
+    entry.content = column_string(stmt, 1);
+    entry.category = column_string(stmt, 2);
+    entry.tags = column_string(stmt, 3);
+    entry.channel = column_string(stmt, 4);
+    entry.user_id = column_string(stmt, 5);
+    entry.importance = sqlite3_column_int(stmt, 6);
+    entry.created_at = sqlite3_column_int64(stmt, 7);
+    entry.updated_at = sqlite3_column_int64(stmt, 8);
+}
+
+// Columns: id, content, context, channel, user_id, created_at, due_at,
+//          cron_expr, completed, completed_at
+void read_task_row(sqlite3_stmt* stmt, MemoryTask& task) {
+    task.id = column_string(stmt, 0);
+    task.content = column_string(stmt, 1);
+    task.context = column_string(stmt, 2);
+    task.channel = column_string(stmt, 3);
+    task.user_id = column_string(stmt, 4);
+    task.created_at = sqlite3_column_int64(stmt, 5);
+    task.due_at = sqlite3_column_int64(stmt, 6);
+    task.cron_expr = column_string(stmt, 7);
+    task.completed = sqlite3_column_int(stmt, 8) != 0;
+    task.completed_at = sqlite3_column_int64(stmt, 9);
+}
+
+const char* MEMORY_COLUMNS =
+    "id, content, category, tags, channel, user_id, "
+    "importance, created_at, updated_at ";
+
+const char* TASK_COLUMNS =
+    "id, content, context, channel, user_id, "
+    "created_at, due_at, cron_expr, completed, completed_at ";
+
+// Upper bound on writes folded into one transaction
+const size_t MAX_WRITE_BATCH = 64;
+
+} // anonymous namespace
+
 // ============================================================================
 // MemoryStore Implementation
 // ============================================================================
 
-MemoryStore::MemoryStore() : db_(nullptr) {}
+MemoryStore::MemoryStore() : readers_enabled_(false), writer_stop_(false), write_linger_ms_(2) {}
 
 MemoryStore::~MemoryStore() {
     close();
 }
 
 bool MemoryStore::open(const std::string& db_path) {
-    if (db_) {
+    if (writer_) {
         close();
     }
     
@@ -91,18 +223,24 @@ bool MemoryStore::open(const std::string& db_path) {
         return false;
     }
     
-    int rc = sqlite3_open(db_path.c_str(), &db_);
+    std::unique_ptr<Connection> conn(new Connection());
+    int rc = sqlite3_open(db_path.c_str(), &conn->db);
     if (rc != SQLITE_OK) {
         LOG_ERROR("[MemoryStore] Failed to open database '%s': %s",
-                  db_path.c_str(), sqlite3_errmsg(db_));
-        db_ = nullptr;
+                  db_path.c_str(), sqlite3_errmsg(conn->db));
         return false;
     }
     
+    // Only takes effect on a new database; lets maintenance return free pages
+    exec_sql(conn->db, "PRAGMA auto_vacuum=INCREMENTAL");
+    
     // Enable WAL mode for better concurrent access
-    exec_sql("PRAGMA journal_mode=WAL");
-    exec_sql("PRAGMA synchronous=NORMAL");
-    exec_sql("PRAGMA busy_timeout=5000");
+    exec_sql(conn->db, "PRAGMA journal_mode=WAL");
+    exec_sql(conn->db, "PRAGMA synchronous=NORMAL");
+    exec_sql(conn->db, "PRAGMA busy_timeout=5000");
+    
+    writer_ = std::move(conn);
+    db_path_ = db_path;
     
     if (!init_tables()) {
         LOG_ERROR("[MemoryStore] Failed to initialize tables");
@@ -110,22 +248,40 @@ bool MemoryStore::open(const std::string& db_path) {
         return false;
     }
     
+    // Separate read connections only see the same data for on-disk databases
+    readers_enabled_ = db_path != ":memory:" && db_path.compare(0, 5, "file:") != 0;
+    
+    writer_stop_ = false;
+    writer_thread_ = std::thread(&MemoryStore::writer_loop, this);
+    
     LOG_INFO("[MemoryStore] Database opened: %s", db_path.c_str());
     return true;
 }
 
 void MemoryStore::close() {
-    if (db_) {
-        sqlite3_close(db_);
-        db_ = nullptr;
+    if (writer_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            writer_stop_ = true;
+        }
+        write_cv_.notify_all();
+        writer_thread_.join();
     }
+    
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        readers_.clear();
+    }
+    
+    writer_.reset();
+    db_path_.clear();
 }
 
-bool MemoryStore::exec_sql(const std::string& sql) {
-    if (!db_) return false;
+bool MemoryStore::exec_sql(sqlite3* db, const std::string& sql) {
+    if (!db) return false;
     
     char* err_msg = nullptr;
-    int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err_msg);
+    int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err_msg);
     
     if (rc != SQLITE_OK) {
         LOG_ERROR("[MemoryStore] SQL error: %s\n  Query: %s",
@@ -137,9 +293,164 @@ bool MemoryStore::exec_sql(const std::string& sql) {
     return true;
 }
 
+bool MemoryStore::step_done(sqlite3_stmt* stmt) {
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// ============================================================================
+// Connection routing
+// ============================================================================
+
+bool MemoryStore::with_reader(const DbFn& fn) {
+    if (!writer_) return false;
+    
+    Connection* reader = nullptr;
+    if (readers_enabled_) {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        std::unique_ptr<Connection>& slot = readers_[std::this_thread::get_id()];
+        if (!slot) {
+            std::unique_ptr<Connection> conn(new Connection());
+            // NOMUTEX: a reader is only ever used by the thread that owns it
+            int rc = sqlite3_open_v2(db_path_.c_str(), &conn->db,
+                                     SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+            if (rc == SQLITE_OK) {
+                sqlite3_busy_timeout(conn->db, 5000);
+                slot = std::move(conn);
+                LOG_DEBUG("[MemoryStore] Opened read connection #%zu", readers_.size());
+            } else {
+                LOG_WARN("[MemoryStore] Read connection failed (%s), reading via writer",
+                         sqlite3_errmsg(conn->db));
+                readers_.erase(std::this_thread::get_id());
+            }
+        }
+        auto it = readers_.find(std::this_thread::get_id());
+        if (it != readers_.end()) reader = it->second.get();
+    }
+    
+    if (reader) {
+        static Histogram& read_seconds = query_seconds("read");
+        HistogramTimer timer(read_seconds);
+        return fn(*reader);
+    }
+    return submit_write(fn);
+}
+
+bool MemoryStore::submit_write(const DbFn& fn, bool exclusive) {
+    if (!writer_) return false;
+    
+    // Before the writer thread exists (init) or from the writer itself
+    if (!writer_thread_.joinable() || std::this_thread::get_id() == writer_thread_.get_id()) {
+        return fn(*writer_);
+    }
+    
+    std::shared_ptr<WriteJob> job = std::make_shared<WriteJob>();
+    job->fn = fn;
+    job->exclusive = exclusive;
+    std::future<bool> result = job->result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        if (writer_stop_) return false;
+        write_queue_.push_back(job);
+    }
+    write_cv_.notify_one();
+    return result.get();
+}
+
+void MemoryStore::writer_loop() {
+    while (true) {
+        std::vector<std::shared_ptr<WriteJob>> batch;
+        {
+            std::unique_lock<std::mutex> lock(write_mutex_);
+            write_cv_.wait(lock, [this] { return writer_stop_ || !write_queue_.empty(); });
+            if (write_queue_.empty()) {
+                return;  // Stopping and fully drained
+            }
+            // Group commit window: writes from other workers join this batch
+            if (write_linger_ms_ > 0 && !writer_stop_ && write_queue_.size() < MAX_WRITE_BATCH) {
+                write_cv_.wait_for(lock, std::chrono::milliseconds(write_linger_ms_), [this] {
+                    return writer_stop_ || write_queue_.size() >= MAX_WRITE_BATCH;
+                });
+            }
+            while (!write_queue_.empty() && batch.size() < MAX_WRITE_BATCH) {
+                // An exclusive job goes alone: it ends the batch or is one
+                bool exclusive = write_queue_.front()->exclusive;
+                if (exclusive && !batch.empty()) break;
+                batch.push_back(write_queue_.front());
+                write_queue_.pop_front();
+                if (exclusive) break;
+            }
+        }
+        run_write_batch(batch);
+    }
+}
+
+void MemoryStore::run_write_batch(std::vector<std::shared_ptr<WriteJob>>& batch) {
+    sqlite3* db = writer_->db;
+    static Histogram& write_seconds = query_seconds("write");
+    HistogramTimer timer(write_seconds);
+    
+    if (batch.size() == 1) {
+        bool ok = false;
+        try {
+            ok = batch[0]->fn(*writer_);
+        } catch (...) {
+            LOG_ERROR("[MemoryStore] Write job threw an exception");
+        }
+        batch[0]->result.set_value(ok);
+        return;
+    }
+    
+    // Group commit: one fsync for the whole batch, savepoint per job
+    std::vector<bool> results(batch.size(), false);
+    bool in_txn = exec_sql(db, "BEGIN IMMEDIATE");
+    
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (in_txn) exec_sql(db, "SAVEPOINT job");
+        bool ok = false;
+        try {
+            ok = batch[i]->fn(*writer_);
+        } catch (...) {
+            LOG_ERROR("[MemoryStore] Write job threw an exception");
+        }
+        if (in_txn) {
+            if (!ok) exec_sql(db, "ROLLBACK TO job");
+            exec_sql(db, "RELEASE job");
+        }
+        results[i] = ok;
+    }
+    
+    if (in_txn && !exec_sql(db, "COMMIT")) {
+        exec_sql(db, "ROLLBACK");
+        for (size_t i = 0; i < results.size(); ++i) results[i] = false;
+    }
+    
+    LOG_DEBUG("[MemoryStore] Group-committed %zu writes", batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->result.set_value(results[i]);
+    }
+}
+
+bool MemoryStore::atomically(Connection& conn, const std::function<bool()>& fn) {
+    // A savepoint opens a transaction of its own when the job runs alone
+    // and nests inside a group commit
+    if (!exec_sql(conn.db, "SAVEPOINT bulk")) return false;
+    bool ok = false;
+    try {
+        ok = fn();
+    } catch (...) {
+        exec_sql(conn.db, "ROLLBACK TO bulk");
+        exec_sql(conn.db, "RELEASE bulk");
+        throw;
+    }
+    if (!ok) exec_sql(conn.db, "ROLLBACK TO bulk");
+    return exec_sql(conn.db, "RELEASE bulk") && ok;
+}
+
 bool MemoryStore::init_tables() {
+    sqlite3* db = writer_->db;
+    
     // Main memories table
-    bool ok = exec_sql(
+    bool ok = exec_sql(db,
         "CREATE TABLE IF NOT EXISTS memories ("
         "  id TEXT PRIMARY KEY,"
         "  content TEXT NOT NULL,"
@@ -155,7 +466,7 @@ bool MemoryStore::init_tables() {
     if (!ok) return false;
     
     // FTS5 virtual table for full-text search on memories
-    ok = exec_sql(
+    ok = exec_sql(db,
         "CREATE VIRTUAL TABLE IF NOT EXISTS memories_fts USING fts5("
         "  content, category, tags,"
         "  content_rowid='rowid',"
@@ -170,7 +481,7 @@ bool MemoryStore::init_tables() {
     // requires an integer rowid, so we use the implicit rowid.
     
     // Insert trigger
-    exec_sql(
+    exec_sql(db,
         "CREATE TRIGGER IF NOT EXISTS memories_ai AFTER INSERT ON memories BEGIN "
         "  INSERT INTO memories_fts(rowid, content, category, tags) "
         "    VALUES (NEW.rowid, NEW.content, NEW.category, NEW.tags);"
@@ -178,7 +489,7 @@ bool MemoryStore::init_tables() {
     );
     
     // Update trigger
-    exec_sql(
+    exec_sql(db,
         "CREATE TRIGGER IF NOT EXISTS memories_au AFTER UPDATE ON memories BEGIN "
         "  DELETE FROM memories_fts WHERE rowid = OLD.rowid;"
         "  INSERT INTO memories_fts(rowid, content, category, tags) "
@@ -187,14 +498,14 @@ bool MemoryStore::init_tables() {
     );
     
     // Delete trigger
-    exec_sql(
+    exec_sql(db,
         "CREATE TRIGGER IF NOT EXISTS memories_ad AFTER DELETE ON memories BEGIN "
         "  DELETE FROM memories_fts WHERE rowid = OLD.rowid;"
         "END"
     );
     
     // Tasks table
-    ok = exec_sql(
+    ok = exec_sql(db,
         "CREATE TABLE IF NOT EXISTS tasks ("
         "  id TEXT PRIMARY KEY,"
         "  content TEXT NOT NULL,"
@@ -211,13 +522,31 @@ bool MemoryStore::init_tables() {
     if (!ok) return false;
     
     // Index for task queries
-    exec_sql("CREATE INDEX IF NOT EXISTS idx_tasks_completed ON tasks(completed)");
-    exec_sql("CREATE INDEX IF NOT EXISTS idx_tasks_due ON tasks(due_at)");
-    exec_sql("CREATE INDEX IF NOT EXISTS idx_tasks_channel ON tasks(channel)");
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS idx_tasks_completed ON tasks(completed)");
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS idx_tasks_due ON tasks(due_at)");
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS idx_tasks_channel ON tasks(channel)");
     
     // Index for memory queries
-    exec_sql("CREATE INDEX IF NOT EXISTS idx_memories_category ON memories(category)");
-    exec_sql("CREATE INDEX IF NOT EXISTS idx_memories_updated ON memories(updated_at)");
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS idx_memories_category ON memories(category)");
+    exec_sql(db, "CREATE INDEX IF NOT EXISTS idx_memories_updated ON memories(updated_at)");
+    
+    // Embeddings (float16 blobs), one row per memory
+    ok = exec_sql(db,
+        "CREATE TABLE IF NOT EXISTS memory_embeddings ("
+        "  memory_id TEXT PRIMARY KEY,"
+        "  model TEXT NOT NULL,"
+        "  dim INTEGER NOT NULL,"
+        "  vec BLOB NOT NULL,"
+        "  updated_at INTEGER NOT NULL"
+        ")"
+    );
+    if (!ok) return false;
+    
+    exec_sql(db,
+        "CREATE TRIGGER IF NOT EXISTS memories_embed_ad AFTER DELETE ON memories BEGIN "
+        "  DELETE FROM memory_embeddings WHERE memory_id = OLD.id;"
+        "END"
+    );
     
     LOG_DEBUG("[MemoryStore] Tables initialized");
     return true;
@@ -227,88 +556,71 @@ bool MemoryStore::init_tables() {
 // Memory Operations
 // ============================================================================
 
-bool MemoryStore::save_memory(const MemoryEntry& entry) {
-    if (!db_) return false;
-    
-    std::string id = entry.id.empty() ? generate_uuid() : entry.id;
-    int64_t now = now_ms();
-    int64_t created = entry.created_at > 0 ? entry.created_at : now;
+bool MemoryStore::save_memory(const MemoryEntry& entry, std::string* id_out) {
+    std::vector<std::string> ids;
+    if (!save_memories(std::vector<MemoryEntry>(1, entry), &ids)) return false;
     
-    // Use INSERT OR REPLACE to handle both insert and update
-    const char* sql = 
-        "INSERT OR REPLACE INTO memories "
-        "(id, content, category, tags, channel, user_id, importance, created_at, updated_at) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    LOG_DEBUG("[MemoryStore] Saved memory id=%s category=%s importance=%d",
+              ids[0].c_str(), entry.category.c_str(), entry.importance);
+    if (id_out) *id_out = ids[0];
+    return true;
+}
+
+bool MemoryStore::save_memories(const std::vector<MemoryEntry>& entries, std::vector<std::string>* ids_out) {
+    if (!writer_) return false;
+    if (entries.empty()) return true;
     
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("[MemoryStore] save_memory prepare failed: %s", sqlite3_errmsg(db_));
-        return false;
+    std::vector<std::string> ids(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ids[i] = entries[i].id.empty() ? generate_uuid() : entries[i].id;
     }
+    int64_t now = now_ms();
     
-    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, entry.content.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, entry.category.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, entry.tags.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 5, entry.channel.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 6, entry.user_id.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 7, entry.importance);
-    sqlite3_bind_int64(stmt, 8, created);
-    sqlite3_bind_int64(stmt, 9, now);
-    
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    bool ok = submit_write([&](Connection& conn) {
+        return atomically(conn, [&]() {
+            // Use INSERT OR REPLACE to handle both insert and update
+            sqlite3_stmt* stmt = conn.prepare(
+                "INSERT OR REPLACE INTO memories "
+                "(id, content, category, tags, channel, user_id, importance, created_at, updated_at) "
+                "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
+            if (!stmt) return false;
+            
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const MemoryEntry& entry = entries[i];
+                StatementScope scope(stmt);
+                sqlite3_bind_text(stmt, 1, ids[i].c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 2, entry.content.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 3, entry.category.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 4, entry.tags.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 5, entry.channel.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 6, entry.user_id.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int(stmt, 7, entry.importance);
+                sqlite3_bind_int64(stmt, 8, entry.created_at > 0 ? entry.created_at : now);
+                sqlite3_bind_int64(stmt, 9, now);
+                
+                if (!step_done(stmt)) {
+                    LOG_ERROR("[MemoryStore] save_memory step failed: %s", sqlite3_errmsg(conn.db));
+                    return false;
+                }
+            }
+            return true;
+        });
+    });
     
-    if (rc != SQLITE_DONE) {
-        LOG_ERROR("[MemoryStore] save_memory step failed: %s", sqlite3_errmsg(db_));
-        return false;
+    if (ok) {
+        if (entries.size() > 1) {
+            LOG_DEBUG("[MemoryStore] Saved %zu memories in one transaction", entries.size());
+        }
+        if (ids_out) ids_out->swap(ids);
     }
-    
-    LOG_DEBUG("[MemoryStore] Saved memory id=%s category=%s importance=%d",
-              id.c_str(), entry.category.c_str(), entry.importance);
-    return true;
+    return ok;
 }
 
 std::vector<MemorySearchHit> MemoryStore::search_memories(
     const std::string& query, int max_results, const std::string& category_filter)
 {
     std::vector<MemorySearchHit> results;
-    if (!db_ || query.empty()) return results;
-    
-    // Build FTS5 query with BM25 ranking
-    // Join memories_fts with memories to get full row data
-    std::string sql;
-    if (category_filter.empty()) {
-        sql = 
-            "SELECT m.id, m.content, m.category, m.tags, m.channel, m.user_id, "
-            "       m.importance, m.created_at, m.updated_at, "
-            "       bm25(memories_fts, 1.0, 0.5, 0.3) AS score, "
-            "       snippet(memories_fts, 0, '<b>', '</b>', '...', 64) AS snip "
-            "FROM memories_fts f "
-            "JOIN memories m ON m.rowid = f.rowid "
-            "WHERE memories_fts MATCH ? "
-            "ORDER BY score "
-            "LIMIT ?";
-    } else {
-        sql = 
-            "SELECT m.id, m.content, m.category, m.tags, m.channel, m.user_id, "
-            "       m.importance, m.created_at, m.updated_at, "
-            "       bm25(memories_fts, 1.0, 0.5, 0.3) AS score, "
-            "       snippet(memories_fts, 0, '<b>', '</b>', '...', 64) AS snip "
-            "FROM memories_fts f "
-            "JOIN memories m ON m.rowid = f.rowid "
-            "WHERE memories_fts MATCH ? AND m.category = ? "
-            "ORDER BY score "
-            "LIMIT ?";
-    }
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("[MemoryStore] search_memories prepare failed: %s", sqlite3_errmsg(db_));
-        return results;
-    }
+    if (!writer_ || query.empty()) return results;
     
     // Sanitize the query for FTS5: wrap each word in quotes to avoid syntax errors
     std::string safe_query;
@@ -334,55 +646,45 @@ std::vector<MemorySearchHit> MemoryStore::search_memories(
     }
     
     if (safe_query.empty()) {
-        sqlite3_finalize(stmt);
         return results;
     }
     
-    sqlite3_bind_text(stmt, 1, safe_query.c_str(), -1, SQLITE_TRANSIENT);
-    
-    if (category_filter.empty()) {
-        sqlite3_bind_int(stmt, 2, max_results);
-    } else {
-        sqlite3_bind_text(stmt, 2, category_filter.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 3, max_results);
-    }
-    
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        MemorySearchHit hit;
-        
-        const char* col_text;
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        hit.entry.id = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        hit.entry.content = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        hit.entry.category = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        hit.entry.tags = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        hit.entry.channel = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
-        hit.entry.user_id = col_text ? col_text : "";
-        
-        hit.entry.importance = sqlite3_column_int(stmt, 6);
-        hit.entry.created_at = sqlite3_column_int64(stmt, 7);
-        hit.entry.updated_at = sqlite3_column_int64(stmt, 8);
-        
-        hit.score = sqlite3_column_double(stmt, 9);
+    // Build FTS5 query with BM25 ranking
+    // Join memories_fts with memories to get full row data
+    std::string sql =
+        "SELECT m.id, m.content, m.category, m.tags, m.channel, m.user_id, "
+        "       m.importance, m.created_at, m.updated_at, "
+        "       bm25(memories_fts, 1.0, 0.5, 0.3) AS score, "
+        "       snippet(memories_fts, 0, '<b>', '</b>', '...', 64) AS snip "
+        "FROM memories_fts f "
+        "JOIN memories m ON m.rowid = f.rowid ";
+    sql += category_filter.empty()
+        ? "WHERE memories_fts MATCH ? "
+        : "WHERE memories_fts MATCH ? AND m.category = ? ";
+    sql += "ORDER BY score LIMIT ?";
+    
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(sql);
+        if (!stmt) return false;
+        StatementScope scope(stmt);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 10));
-        hit.snippet = col_text ? col_text : "";
+        sqlite3_bind_text(stmt, 1, safe_query.c_str(), -1, SQLITE_TRANSIENT);
+        if (category_filter.empty()) {
+            sqlite3_bind_int(stmt, 2, max_results);
+        } else {
+            sqlite3_bind_text(stmt, 2, category_filter.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 3, max_results);
+        }
         
-        results.push_back(hit);
-    }
-    
-    sqlite3_finalize(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            MemorySearchHit hit;
+            read_memory_row(stmt, hit.entry);
+            hit.score = sqlite3_column_double(stmt, 9);
+            hit.snippet = column_string(stmt, 10);
+            results.push_back(hit);
+        }
+        return true;
+    });
     
     LOG_DEBUG("[MemoryStore] Search '%s' returned %zu results", 
               query.c_str(), results.size());
@@ -391,46 +693,20 @@ std::vector<MemorySearchHit> MemoryStore::search_memories(
 
 MemoryEntry MemoryStore::get_memory(const std::string& id) {
     MemoryEntry entry;
-    if (!db_ || id.empty()) return entry;
+    if (!writer_ || id.empty()) return entry;
     
-    const char* sql = 
-        "SELECT id, content, category, tags, channel, user_id, "
-        "       importance, created_at, updated_at "
-        "FROM memories WHERE id = ?";
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return entry;
-    
-    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-    
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* col_text;
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        entry.id = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        entry.content = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        entry.category = col_text ? col_text : "";
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            std::string("SELECT ") + MEMORY_COLUMNS + "FROM memories WHERE id = ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        entry.tags = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        entry.channel = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
-        entry.user_id = col_text ? col_text : "";
-        
-        entry.importance = sqlite3_column_int(stmt, 6);
-        entry.created_at = sqlite3_column_int64(stmt, 7);
-        entry.updated_at = sqlite3_column_int64(stmt, 8);
-    }
-    
-    sqlite3_finalize(stmt);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            read_memory_row(stmt, entry);
+        }
+        return true;
+    });
     return entry;
 }
 
@@ -438,136 +714,195 @@ std::vector<MemoryEntry> MemoryStore::get_recent_memories(
     int limit, const std::string& category_filter)
 {
     std::vector<MemoryEntry> results;
-    if (!db_) return results;
-    
-    std::string sql;
-    if (category_filter.empty()) {
-        sql = "SELECT id, content, category, tags, channel, user_id, "
-              "       importance, created_at, updated_at "
-              "FROM memories ORDER BY updated_at DESC LIMIT ?";
-    } else {
-        sql = "SELECT id, content, category, tags, channel, user_id, "
-              "       importance, created_at, updated_at "
-              "FROM memories WHERE category = ? ORDER BY updated_at DESC LIMIT ?";
-    }
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return results;
+    if (!writer_) return results;
     
-    if (category_filter.empty()) {
-        sqlite3_bind_int(stmt, 1, limit);
-    } else {
-        sqlite3_bind_text(stmt, 1, category_filter.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 2, limit);
+    std::string sql = std::string("SELECT ") + MEMORY_COLUMNS + "FROM memories ";
+    if (!category_filter.empty()) {
+        sql += "WHERE category = ? ";
     }
+    sql += "ORDER BY updated_at DESC LIMIT ?";
     
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        MemoryEntry entry;
-        const char* col_text;
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        entry.id = col_text ? col_text : "";
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(sql);
+        if (!stmt) return false;
+        StatementScope scope(stmt);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        entry.content = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        entry.category = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        entry.tags = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        entry.channel = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
-        entry.user_id = col_text ? col_text : "";
-        
-        entry.importance = sqlite3_column_int(stmt, 6);
-        entry.created_at = sqlite3_column_int64(stmt, 7);
-        entry.updated_at = sqlite3_column_int64(stmt, 8);
+        if (category_filter.empty()) {
+            sqlite3_bind_int(stmt, 1, limit);
+        } else {
+            sqlite3_bind_text(stmt, 1, category_filter.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 2, limit);
+        }
         
-        results.push_back(entry);
-    }
-    
-    sqlite3_finalize(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            MemoryEntry entry;
+            read_memory_row(stmt, entry);
+            results.push_back(entry);
+        }
+        return true;
+    });
     return results;
 }
 
 bool MemoryStore::delete_memory(const std::string& id) {
-    if (!db_ || id.empty()) return false;
-    
-    const char* sql = "DELETE FROM memories WHERE id = ?";
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return false;
-    
-    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+    if (!writer_ || id.empty()) return false;
     
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    return rc == SQLITE_DONE;
+    return submit_write([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare("DELETE FROM memories WHERE id = ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
+        
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        return step_done(stmt);
+    });
 }
 
 // ============================================================================
-// Task Operations
+// Embedding Operations
 // ============================================================================
 
-bool MemoryStore::create_task(const MemoryTask& task) {
-    if (!db_) return false;
+bool MemoryStore::save_embedding(const std::string& memory_id, const std::string& model,
+                                 const std::string& blob, int dim)
+{
+    if (!writer_ || memory_id.empty() || blob.empty()) return false;
     
-    std::string id = task.id.empty() ? generate_uuid() : task.id;
     int64_t now = now_ms();
-    int64_t created = task.created_at > 0 ? task.created_at : now;
     
-    const char* sql = 
-        "INSERT INTO tasks "
-        "(id, content, context, channel, user_id, created_at, due_at, cron_expr, completed, completed_at) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, 0, 0)";
-
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("[MemoryStore] create_task prepare failed: %s", sqlite3_errmsg(db_));
-        return false;
-    }
+    return submit_write([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            "INSERT OR REPLACE INTO memory_embeddings "
+            "(memory_id, model, dim, vec, updated_at) VALUES (?, ?, ?, ?, ?)");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
+        
+        sqlite3_bind_text(stmt, 1, memory_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, model.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, dim);
+        sqlite3_bind_blob(stmt, 4, blob.data(), static_cast<int>(blob.size()), SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 5, now);
+        return step_done(stmt);
+    });
+}
 
-    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, task.content.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, task.context.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, task.channel.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 5, task.user_id.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(stmt, 6, created);
-    sqlite3_bind_int64(stmt, 7, task.due_at);
-    sqlite3_bind_text(stmt, 8, task.cron_expr.c_str(), -1, SQLITE_TRANSIENT);
+void MemoryStore::for_each_embedding(const std::string& model,
+    const std::function<void(const std::string& id, const void* blob, size_t bytes)>& fn)
+{
+    if (!writer_) return;
+    
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            "SELECT e.memory_id, e.vec FROM memory_embeddings e "
+            "JOIN memories m ON m.id = e.memory_id WHERE e.model = ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
+        
+        sqlite3_bind_text(stmt, 1, model.c_str(), -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const void* blob = sqlite3_column_blob(stmt, 1);
+            size_t bytes = static_cast<size_t>(sqlite3_column_bytes(stmt, 1));
+            if (blob && bytes > 0) {
+                fn(column_string(stmt, 0), blob, bytes);
+            }
+        }
+        return true;
+    });
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+std::vector<MemoryEntry> MemoryStore::get_memories_without_embedding(const std::string& model, int limit) {
+    std::vector<MemoryEntry> results;
+    if (!writer_) return results;
+    
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            std::string("SELECT ") + MEMORY_COLUMNS + "FROM memories m "
+            "WHERE NOT EXISTS (SELECT 1 FROM memory_embeddings e "
+            "                  WHERE e.memory_id = m.id AND e.model = ?) "
+            "ORDER BY updated_at DESC LIMIT ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
+        
+        sqlite3_bind_text(stmt, 1, model.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, limit);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            MemoryEntry entry;
+            read_memory_row(stmt, entry);
+            results.push_back(entry);
+        }
+        return true;
+    });
+    return results;
+}
 
-    if (rc != SQLITE_DONE) {
-        LOG_ERROR("[MemoryStore] create_task step failed: %s", sqlite3_errmsg(db_));
-        return false;
-    }
+// ============================================================================
+// Task Operations
+// ============================================================================
 
+bool MemoryStore::create_task(const MemoryTask& task) {
+    std::vector<std::string> ids;
+    if (!create_tasks(std::vector<MemoryTask>(1, task), &ids)) return false;
+    
     LOG_DEBUG("[MemoryStore] Created task id=%s content='%.50s'",
-              id.c_str(), task.content.c_str());
+              ids[0].c_str(), task.content.c_str());
     return true;
 }
 
+bool MemoryStore::create_tasks(const std::vector<MemoryTask>& tasks, std::vector<std::string>* ids_out) {
+    if (!writer_) return false;
+    if (tasks.empty()) return true;
+    
+    std::vector<std::string> ids(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        ids[i] = tasks[i].id.empty() ? generate_uuid() : tasks[i].id;
+    }
+    int64_t now = now_ms();
+    
+    bool ok = submit_write([&](Connection& conn) {
+        return atomically(conn, [&]() {
+            sqlite3_stmt* stmt = conn.prepare(
+                "INSERT INTO tasks "
+                "(id, content, context, channel, user_id, created_at, due_at, cron_expr, completed, completed_at) "
+                "VALUES (?, ?, ?, ?, ?, ?, ?, ?, 0, 0)");
+            if (!stmt) return false;
+            
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                const MemoryTask& task = tasks[i];
+                StatementScope scope(stmt);
+                sqlite3_bind_text(stmt, 1, ids[i].c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 2, task.content.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 3, task.context.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 4, task.channel.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 5, task.user_id.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(stmt, 6, task.created_at > 0 ? task.created_at : now);
+                sqlite3_bind_int64(stmt, 7, task.due_at);
+                sqlite3_bind_text(stmt, 8, task.cron_expr.c_str(), -1, SQLITE_TRANSIENT);
+                
+                if (!step_done(stmt)) {
+                    LOG_ERROR("[MemoryStore] create_task step failed: %s", sqlite3_errmsg(conn.db));
+                    return false;
+                }
+            }
+            return true;
+        });
+    });
+    
+    if (ok) {
+        if (tasks.size() > 1) {
+            LOG_DEBUG("[MemoryStore] Created %zu tasks in one transaction", tasks.size());
+        }
+        if (ids_out) ids_out->swap(ids);
+    }
+    return ok;
+}
+
 std::vector<MemoryTask> MemoryStore::list_tasks(
     bool include_completed, const std::string& channel_filter)
 {
     std::vector<MemoryTask> results;
-    if (!db_) return results;
+    if (!writer_) return results;
     
     // Build query based on filters
     std::ostringstream sql;
-    sql << "SELECT id, content, context, channel, user_id, "
-        << "       created_at, due_at, cron_expr, completed, completed_at "
-        << "FROM tasks";
+    sql << "SELECT " << TASK_COLUMNS << "FROM tasks";
     
     std::vector<std::string> conditions;
     if (!include_completed) {
@@ -587,193 +922,195 @@ std::vector<MemoryTask> MemoryStore::list_tasks(
     sql << " ORDER BY CASE WHEN due_at > 0 THEN due_at ELSE 9999999999999 END ASC, "
         << "created_at DESC";
     
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql.str().c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        LOG_ERROR("[MemoryStore] list_tasks prepare failed: %s", sqlite3_errmsg(db_));
-        return results;
-    }
-    
-    // Bind channel filter if present
-    // "completed = 0" is a literal condition with no bind parameter,
-    // so channel filter is always bind index 1
-    if (!channel_filter.empty()) {
-        sqlite3_bind_text(stmt, 1, channel_filter.c_str(), -1, SQLITE_TRANSIENT);
-    }
-    
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        MemoryTask task;
-        const char* col_text;
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        task.id = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        task.content = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        task.context = col_text ? col_text : "";
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(sql.str());
+        if (!stmt) return false;
+        StatementScope scope(stmt);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        task.channel = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        task.user_id = col_text ? col_text : "";
-
-        task.created_at = sqlite3_column_int64(stmt, 5);
-        task.due_at = sqlite3_column_int64(stmt, 6);
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-        task.cron_expr = col_text ? col_text : "";
-        task.completed = sqlite3_column_int(stmt, 8) != 0;
-        task.completed_at = sqlite3_column_int64(stmt, 9);
+        // Bind channel filter if present
+        // "completed = 0" is a literal condition with no bind parameter,
+        // so channel filter is always bind index 1
+        if (!channel_filter.empty()) {
+            sqlite3_bind_text(stmt, 1, channel_filter.c_str(), -1, SQLITE_TRANSIENT);
+        }
         
-        results.push_back(task);
-    }
-    
-    sqlite3_finalize(stmt);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            MemoryTask task;
+            read_task_row(stmt, task);
+            results.push_back(task);
+        }
+        return true;
+    });
     return results;
 }
 
 MemoryTask MemoryStore::get_task(const std::string& id) {
     MemoryTask task;
-    if (!db_ || id.empty()) return task;
-    
-    const char* sql = 
-        "SELECT id, content, context, channel, user_id, "
-        "       created_at, due_at, cron_expr, completed, completed_at "
-        "FROM tasks WHERE id = ?";
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return task;
+    if (!writer_ || id.empty()) return task;
     
-    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-    
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* col_text;
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        task.id = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        task.content = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        task.context = col_text ? col_text : "";
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            std::string("SELECT ") + TASK_COLUMNS + "FROM tasks WHERE id = ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        task.channel = col_text ? col_text : "";
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        task.user_id = col_text ? col_text : "";
-
-        task.created_at = sqlite3_column_int64(stmt, 5);
-        task.due_at = sqlite3_column_int64(stmt, 6);
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-        task.cron_expr = col_text ? col_text : "";
-        task.completed = sqlite3_column_int(stmt, 8) != 0;
-        task.completed_at = sqlite3_column_int64(stmt, 9);
-    }
-    
-    sqlite3_finalize(stmt);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            read_task_row(stmt, task);
+        }
+        return true;
+    });
     return task;
 }
 
 bool MemoryStore::complete_task(const std::string& id) {
-    if (!db_ || id.empty()) return false;
+    if (!writer_ || id.empty()) return false;
     
     int64_t now = now_ms();
     
-    const char* sql = 
-        "UPDATE tasks SET completed = 1, completed_at = ? WHERE id = ?";
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return false;
-    
-    sqlite3_bind_int64(stmt, 1, now);
-    sqlite3_bind_text(stmt, 2, id.c_str(), -1, SQLITE_TRANSIENT);
-    
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    bool ok = submit_write([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            "UPDATE tasks SET completed = 1, completed_at = ? WHERE id = ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
+        
+        sqlite3_bind_int64(stmt, 1, now);
+        sqlite3_bind_text(stmt, 2, id.c_str(), -1, SQLITE_TRANSIENT);
+        return step_done(stmt);
+    });
     
-    if (rc == SQLITE_DONE) {
+    if (ok) {
         LOG_DEBUG("[MemoryStore] Completed task id=%s", id.c_str());
-        return true;
     }
-    return false;
+    return ok;
 }
 
 bool MemoryStore::delete_task(const std::string& id) {
-    if (!db_ || id.empty()) return false;
-    
-    const char* sql = "DELETE FROM tasks WHERE id = ?";
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return false;
-    
-    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-    
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    if (!writer_ || id.empty()) return false;
     
-    return rc == SQLITE_DONE;
+    return submit_write([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare("DELETE FROM tasks WHERE id = ?");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
+        
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
+        return step_done(stmt);
+    });
 }
 
 std::vector<MemoryTask> MemoryStore::get_due_tasks() {
     std::vector<MemoryTask> results;
-    if (!db_) return results;
+    if (!writer_) return results;
     
     int64_t now = now_ms();
     
-    const char* sql = 
-        "SELECT id, content, context, channel, user_id, "
-        "       created_at, due_at, completed, completed_at "
-        "FROM tasks WHERE completed = 0 AND due_at > 0 AND due_at <= ? "
-        "ORDER BY due_at ASC";
-    
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) return results;
-    
-    sqlite3_bind_int64(stmt, 1, now);
-    
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        MemoryTask task;
-        const char* col_text;
-        
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        task.id = col_text ? col_text : "";
+    with_reader([&](Connection& conn) {
+        sqlite3_stmt* stmt = conn.prepare(
+            std::string("SELECT ") + TASK_COLUMNS +
+            "FROM tasks WHERE completed = 0 AND due_at > 0 AND due_at <= ? "
+            "ORDER BY due_at ASC");
+        if (!stmt) return false;
+        StatementScope scope(stmt);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        task.content = col_text ? col_text : "";
+        sqlite3_bind_int64(stmt, 1, now);
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        task.context = col_text ? col_text : "";
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            MemoryTask task;
+            read_task_row(stmt, task);
+            results.push_back(task);
+        }
+        return true;
+    });
+    return results;
+}
+
+// ============================================================================
+// Maintenance
+// ============================================================================
+
+void MemoryStore::file_sizes(int64_t& db_bytes, int64_t& wal_bytes) const {
+    struct stat st;
+    db_bytes = stat(db_path_.c_str(), &st) == 0 ? static_cast<int64_t>(st.st_size) : 0;
+    wal_bytes = stat((db_path_ + "-wal").c_str(), &st) == 0 ? static_cast<int64_t>(st.st_size) : 0;
+}
+
+double MemoryStore::probe_search_ms(const std::string& query) {
+    if (query.empty()) return -1;
+    const int runs = 5;
+    int64_t start = now_ms();
+    for (int i = 0; i < runs; ++i) {
+        search_memories(query, 10);
+    }
+    return static_cast<double>(now_ms() - start) / runs;
+}
+
+bool MemoryStore::run_maintenance(const MaintenanceConfig& options, MaintenanceReport& report) {
+    if (!writer_) return false;
+    int64_t start = now_ms();
+    
+    // Time a search users would run: a word of the newest memory
+    std::string probe = options.probe_query;
+    if (probe.empty()) {
+        std::vector<MemoryEntry> recent = get_recent_memories(1);
+        const std::string text = recent.empty() ? std::string() : recent[0].content;
+        std::string word;
+        for (size_t i = 0; i <= text.size() && probe.empty(); ++i) {
+            if (i < text.size() && std::isalnum(static_cast<unsigned char>(text[i]))) {
+                word += text[i];
+            } else {
+                if (word.size() >= 3) probe = word;
+                word.clear();
+            }
+        }
+    }
+    
+    file_sizes(report.db_bytes_before, report.wal_bytes_before);
+    report.probe_ms_before = probe_search_ms(probe);
+    
+    bool ok = submit_write([&](Connection& conn) {
+        bool all = true;
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        task.channel = col_text ? col_text : "";
+        // Merge the FTS5 b-tree segments into one
+        report.fts_optimized = exec_sql(conn.db,
+            "INSERT INTO memories_fts(memories_fts) VALUES('optimize')");
+        all = all && report.fts_optimized;
         
-        col_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-        task.user_id = col_text ? col_text : "";
+        report.analyzed = exec_sql(conn.db, "ANALYZE");
+        all = all && report.analyzed;
         
-        task.created_at = sqlite3_column_int64(stmt, 5);
-        task.due_at = sqlite3_column_int64(stmt, 6);
-        task.completed = sqlite3_column_int(stmt, 7) != 0;
-        task.completed_at = sqlite3_column_int64(stmt, 8);
+        if (options.vacuum_pages > 0 && pragma_int(conn.db, "PRAGMA auto_vacuum") == 2) {
+            int64_t free_before = pragma_int(conn.db, "PRAGMA freelist_count");
+            if (free_before > 0) {
+                exec_sql(conn.db, "PRAGMA incremental_vacuum(" +
+                         std::to_string(options.vacuum_pages) + ")");
+                int64_t free_after = pragma_int(conn.db, "PRAGMA freelist_count");
+                if (free_after >= 0) report.pages_vacuumed = free_before - free_after;
+            }
+        }
         
-        results.push_back(task);
-    }
+        // The optimize above rewrote the index into the WAL, so measure now
+        int64_t db_bytes = 0, wal_bytes = 0;
+        file_sizes(db_bytes, wal_bytes);
+        if (wal_bytes > options.checkpoint_wal_bytes || options.checkpoint_wal_bytes == 0) {
+            // Result row: busy, log frames, checkpointed frames
+            sqlite3_stmt* stmt = nullptr;
+            if (sqlite3_prepare_v2(conn.db, "PRAGMA wal_checkpoint(TRUNCATE)", -1, &stmt, nullptr) == SQLITE_OK) {
+                if (sqlite3_step(stmt) == SQLITE_ROW) {
+                    report.checkpointed = sqlite3_column_int(stmt, 0) == 0;
+                }
+                sqlite3_finalize(stmt);
+            }
+            if (!report.checkpointed) {
+                LOG_WARN("[MemoryStore] WAL checkpoint incomplete (readers busy), retrying next run");
+            }
+        }
+        return all;
+    }, true);
     
-    sqlite3_finalize(stmt);
-    return results;
-}
-
-bool MemoryStore::bind_and_step(sqlite3_stmt* stmt) {
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE;
+    file_sizes(report.db_bytes_after, report.wal_bytes_after);
+    report.probe_ms_after = probe_search_ms(probe);
+    report.elapsed_ms = static_cast<double>(now_ms() - start);
+    return ok;
 }
 
 } // namespace opencrank
@@ -1,16 +1,154 @@
 #include <opencrank/plugins/claude/claude.hpp>
 #include <opencrank/core/loader.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/json_stream.hpp>
+#include <opencrank/ai/rate_pacer.hpp>
+#include <opencrank/ai/sse.hpp>
 #include <sstream>
 
 namespace opencrank {
 
+namespace {
+
+// Collects Messages API stream events into the non-streaming response shape
+class ClaudeStreamAccumulator {
+public:
+    explicit ClaudeStreamAccumulator(const StreamCallback& on_chunk)
+        : on_chunk_(on_chunk)
+        , parser_([this](const std::string& event, const std::string& data) {
+              return on_event(event, data);
+          })
+        , input_tokens_(0)
+        , output_tokens_(0)
+        , cache_read_tokens_(0)
+        , cache_write_tokens_(0) {}
+    
+    bool feed(const char* data, size_t len) { return parser_.feed(data, len); }
+    
+    Json to_response() const {
+        Json resp = Json::object();
+        if (!error_.is_null()) {
+            resp["error"] = error_;
+            return resp;
+        }
+        Json block = Json::object();
+        block["type"] = "text";
+        block["text"] = text_;
+        resp["model"] = model_;
+        resp["stop_reason"] = stop_reason_;
+        resp["content"] = Json::array();
+        resp["content"].push_back(block);
+        for (size_t i = 0; i < tools_.size(); ++i) {
+            Json tool = Json::object();
+            tool["type"] = "tool_use";
+            tool["id"] = tools_[i].id;
+            tool["name"] = tools_[i].name;
+            // Input arrives as JSON text in pieces; a part that does not
+            // parse is handed on raw
+            Json input = Json::parse(tools_[i].input.empty() ? std::string("{}") : tools_[i].input,
+                                     nullptr, false);
+            if (input.is_discarded()) {
+                tool["input_json"] = tools_[i].input;
+            } else {
+                tool["input"] = input;
+            }
+            resp["content"].push_back(tool);
+        }
+        resp["usage"]["input_tokens"] = input_tokens_;
+        resp["usage"]["output_tokens"] = output_tokens_;
+        resp["usage"]["cache_read_input_tokens"] = cache_read_tokens_;
+        resp["usage"]["cache_creation_input_tokens"] = cache_write_tokens_;
+        return resp;
+    }
+    
+private:
+    struct ToolUse {
+        int index;
+        std::string id;
+        std::string name;
+        std::string input;
+    };
+    
+    bool on_event(const std::string& event, const std::string& data) {
+        // Read per-token events in place rather than parsing each into a DOM
+        JsonView ev(data);
+        if (!ev.is_object()) return true;
+        
+        if (event == "error" || ev["type"].get_string() == "error") {
+            JsonView error = ev["error"];
+            error_ = error.exists() ? error.parse() : ev.parse();
+            return false;
+        }
+        
+        if (event == "message_start") {
+            JsonView message = ev["message"];
+            if (!message.is_object()) return true;
+            model_ = message["model"].get_string();
+            JsonView usage = message["usage"];
+            if (usage.is_object()) {
+                input_tokens_ = static_cast<int>(usage["input_tokens"].get_int());
+                cache_read_tokens_ = static_cast<int>(usage["cache_read_input_tokens"].get_int());
+                cache_write_tokens_ = static_cast<int>(usage["cache_creation_input_tokens"].get_int());
+            }
+        } else if (event == "content_block_start") {
+            JsonView block = ev["content_block"];
+            if (block.is_object() && block["type"].get_string() == "tool_use") {
+                ToolUse tool;
+                tool.index = static_cast<int>(ev["index"].get_int(-1));
+                tool.id = block["id"].get_string();
+                tool.name = block["name"].get_string();
+                tools_.push_back(tool);
+            }
+        } else if (event == "content_block_delta") {
+            JsonView delta = ev["delta"];
+            if (!delta.is_object()) return true;
+            std::string type = delta["type"].get_string();
+            if (type == "text_delta") {
+                std::string text = delta["text"].get_string();
+                if (!text.empty()) {
+                    text_ += text;
+                    if (on_chunk_) on_chunk_(text);
+                }
+            } else if (type == "input_json_delta" && !tools_.empty() &&
+                       tools_.back().index == static_cast<int>(ev["index"].get_int(-1))) {
+                tools_.back().input += delta["partial_json"].get_string();
+            }
+        } else if (event == "message_delta") {
+            JsonView stop_reason = ev["delta"]["stop_reason"];
+            if (stop_reason.is_string()) {
+                stop_reason_ = stop_reason.get_string();
+            }
+            JsonView usage = ev["usage"];
+            if (usage.is_object()) {
+                output_tokens_ = static_cast<int>(usage["output_tokens"].get_int(output_tokens_));
+            }
+        }
+        return true;
+    }
+    
+    StreamCallback on_chunk_;
+    SseParser parser_;
+    std::string model_;
+    std::string text_;
+    std::string stop_reason_;
+    int input_tokens_;
+    int output_tokens_;
+    int cache_read_tokens_;
+    int cache_write_tokens_;
+    std::vector<ToolUse> tools_;
+    Json error_;
+};
+
+} // anonymous namespace
+
 ClaudeAI::ClaudeAI()
     : api_key_()
     , default_model_("claude-sonnet-4-20250514")
     , api_url_("https://api.anthropic.com/v1/messages")
     , api_version_("2023-06-01")
+    , native_tools_(true)
     , initialized_(false)
+    , pacer_(NULL)
 {}
 
 const char* ClaudeAI::name() const { return "Claude AI"; }
@@ -32,12 +170,16 @@ bool ClaudeAI::init(const Config& cfg) {
         api_url_ = url;
     }
     
+    native_tools_ = cfg.get_bool("claude.native_tools", true);
+    
     if (api_key_.empty()) {
         LOG_WARN("Claude AI: No API key configured (set claude.api_key in config.json)");
         initialized_ = false;
         return false;
     }
     
+    pacer_ = &RatePacer::get("claude", api_key_, RetryPolicy::from_config(cfg, "claude"));
+    
     LOG_INFO("Claude AI initialized with model: %s", default_model_.c_str());
     initialized_ = true;
     return true;
@@ -66,6 +208,8 @@ std::string ClaudeAI::default_model() const { return default_model_; }
 
 bool ClaudeAI::is_configured() const { return !api_key_.empty(); }
 
+bool ClaudeAI::supports_native_tools() const { return native_tools_; }
+
 CompletionResult ClaudeAI::complete(
     const std::string& prompt,
     const CompletionOptions& opts
@@ -89,62 +233,114 @@ CompletionResult ClaudeAI::chat(
     
     LOG_DEBUG("[Claude] Starting chat request with %zu messages", messages.size());
     
-    Json request = Json::object();
+    // The body is written straight from the history into a reused buffer;
+    // no DOM of the conversation is ever built.
+    std::string& request_body = JsonWriter::thread_buffer();
+    JsonWriter request(request_body);
+    request.begin_object();
     
     std::string model = opts.model.empty() ? default_model_ : opts.model;
-    request["model"] = model;
+    request.field("model", model);
     LOG_DEBUG("[Claude] Using model: %s", model.c_str());
     
     int max_tokens = opts.max_tokens > 0 ? opts.max_tokens : 4096;
-    request["max_tokens"] = static_cast<int64_t>(max_tokens);
+    request.field("max_tokens", max_tokens);
     
     if (opts.temperature >= 0.0 && opts.temperature <= 1.0) {
-        request["temperature"] = opts.temperature;
+        request.field("temperature", opts.temperature);
+    }
+    
+    // Tools precede the system prompt in the cached prefix, so the
+    // breakpoint below covers them too
+    if (native_tools_ && !opts.tools.empty()) {
+        request.key("tools").begin_array();
+        for (size_t i = 0; i < opts.tools.size(); ++i) {
+            request.begin_object();
+            request.field("name", opts.tools[i].name);
+            request.field("description", opts.tools[i].description);
+            request.key("input_schema").json(opts.tools[i].parameters);
+            request.end_object();
+        }
+        request.end_array();
+    }
+    
+    // Caller-supplied system prompt. When it is a stable prefix, mark it
+    // with cache_control so Anthropic reuses the cached prefix across the
+    // iterations of an agent run instead of re-processing it each time.
+    if (!opts.system_prompt.empty()) {
+        request.key("system").begin_array().begin_object();
+        request.field("type", "text");
+        request.field("text", opts.system_prompt);
+        if (opts.stable_system_prompt) {
+            request.key("cache_control").begin_object().field("type", "ephemeral").end_object();
+        }
+        request.end_object().end_array();
+    } else if (messages[0].role == MessageRole::SYSTEM) {
+        request.field("system", messages[0].content);
+        LOG_DEBUG("[Claude]   [0] SYSTEM (%zu chars): %.200s%s", 
+                  messages[0].content.size(), messages[0].content.c_str(),
+                  messages[0].content.size() > 200 ? "..." : "");
     }
     
-    Json msgs = Json::array();
+    size_t sent = 0;
+    request.key("messages").begin_array();
     LOG_DEBUG("[Claude] === ▶ IN  Messages being sent to AI ===");
     LOG_DEBUG("[Claude] ▶ IN  Model: %s, Max tokens: %d", model.c_str(), max_tokens);
     for (size_t i = 0; i < messages.size(); ++i) {
         const ConversationMessage& msg = messages[i];
         
         if (msg.role == MessageRole::SYSTEM) {
-            if (opts.system_prompt.empty() && i == 0) {
-                request["system"] = msg.content;
-                LOG_DEBUG("[Claude]   [%zu] SYSTEM (%zu chars): %.200s%s", 
-                          i, msg.content.size(), msg.content.c_str(),
-                          msg.content.size() > 200 ? "..." : "");
-            }
             continue;
         }
         
-        Json m = Json::object();
-        m["role"] = role_to_string(msg.role);
-        m["content"] = sanitize_utf8(msg.content);
-        msgs.push_back(m);
+        request.begin_object();
+        request.field("role", role_to_string(msg.role));
+        request.field("content", msg.content);
+        request.end_object();
+        ++sent;
         
         LOG_DEBUG("[Claude]   ▶ [%zu] %s (%zu chars): %.300s%s", 
                   i, role_to_string(msg.role).c_str(), 
                   msg.content.size(), msg.content.c_str(),
                   msg.content.size() > 300 ? "..." : "");
     }
-    request["messages"] = msgs;
-    LOG_DEBUG("[Claude] === ▶ IN  End of messages (%zu total) ===", msgs.size());
+    request.end_array();
+    LOG_DEBUG("[Claude] === ▶ IN  End of messages (%zu total) ===", sent);
     
-    if (opts.stream && opts.on_chunk) {
-        request["stream"] = true;
+    bool streaming = opts.stream && opts.on_chunk;
+    if (streaming) {
+        request.field("stream", true);
     }
+    request.end_object();
     
-    std::string request_body = request.dump(-1, ' ', false, Json::error_handler_t::replace);
     LOG_DEBUG("[Claude] ▶ IN  Sending request to API (%zu bytes)", request_body.size());
     
-    HttpClient http;
+    HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+    http->set_cancel(opts.cancel);
     std::map<std::string, std::string> headers;
     headers["x-api-key"] = api_key_;
     headers["anthropic-version"] = api_version_;
     headers["Content-Type"] = "application/json";
     
-    HttpResponse response = http.post_json(api_url_, request_body, headers);
+    ClaudeStreamAccumulator stream(opts.on_chunk);
+    HttpResponse response;
+    // 429/529 are retried here after a backoff; error bodies never reach
+    // the stream, so nothing has been shown to the caller yet
+    int64_t backoff_ms = 0;
+    for (int attempt = 0; ; ++attempt) {
+        std::string wait_error;
+        if (!pacer_->pace(opts.cancel, backoff_ms, wait_error)) {
+            LOG_WARN("[Claude] %s", wait_error.c_str());
+            return CompletionResult::fail(wait_error);
+        }
+        if (streaming) {
+            response = http->post_json_stream(api_url_, request_body, headers,
+                [&stream](const char* data, size_t len) { return stream.feed(data, len); });
+        } else {
+            response = http->post_json(api_url_, request_body, headers);
+        }
+        if (!pacer_->should_retry(response, attempt, backoff_ms)) break;
+    }
     
     if (response.status_code == 0) {
         LOG_ERROR("[Claude] HTTP request failed: %s", response.body.c_str());
@@ -154,9 +350,19 @@ CompletionResult ClaudeAI::chat(
     LOG_DEBUG("[Claude] ◀ OUT Received response [HTTP %d] (%zu bytes)", 
               response.status_code, response.body.size());
     
-    Json resp = response.json();
+    // Only the members read below are materialised from the body
+    static const std::vector<std::string> response_fields = {
+        "content", "error", "model", "stop_reason", "usage"
+    };
+    Json resp;
+    if (streaming && response.status_code == 200) {
+        resp = stream.to_response();
+    } else {
+        resp = parse_json_fields(response.body, response_fields);
+        if (resp.is_discarded()) resp = Json();
+    }
     
-    if (response.status_code != 200) {
+    if (response.status_code != 200 || resp.contains("error")) {
         std::string error_msg = "API error";
         if (resp.is_object()) {
             if (resp.contains("error") && resp["error"].is_object()) {
@@ -190,21 +396,51 @@ CompletionResult ClaudeAI::chat(
     Json content = resp["content"];
     if (content.is_array()) {
         std::ostringstream text;
+        std::vector<ToolCallRequest> calls;
         for (auto it = content.begin(); it != content.end(); ++it) {
             const Json& block = *it;
             std::string block_type = block.value("type", std::string(""));
             if (block_type == "text") {
                 text << block.value("text", std::string(""));
+            } else if (block_type == "tool_use") {
+                ToolCallRequest call;
+                call.id = block.value("id", std::string(""));
+                call.name = block.value("name", std::string(""));
+                if (call.name.empty()) continue;
+                if (block.contains("input") && block["input"].is_object()) {
+                    call.arguments = block["input"];
+                    call.raw_arguments = call.arguments.dump();
+                } else {
+                    call.set_arguments(block.value("input_json", std::string("")));
+                }
+                calls.push_back(call);
             }
         }
         result.content = text.str();
+        
+        // The text protocol's form of each call follows the text
+        for (size_t i = 0; i < calls.size(); ++i) {
+            if (!result.content.empty()) result.content += "\n\n";
+            result.content += calls[i].to_text();
+        }
+        if (!calls.empty()) {
+            LOG_INFO("[Claude] %zu native tool call(s) in response", calls.size());
+        }
+        result.tool_calls.swap(calls);
     }
     
     Json usage = resp["usage"];
     if (usage.is_object()) {
-        result.usage.input_tokens = usage.value("input_tokens", 0);
+        // input_tokens excludes cache reads/writes; count the whole prompt
+        int cached = usage.value("cache_read_input_tokens", 0);
+        int cache_written = usage.value("cache_creation_input_tokens", 0);
+        result.usage.input_tokens = usage.value("input_tokens", 0) + cached + cache_written;
         result.usage.output_tokens = usage.value("output_tokens", 0);
         result.usage.total_tokens = result.usage.input_tokens + result.usage.output_tokens;
+        result.usage.cached_tokens = cached;
+        if (cached > 0) {
+            LOG_DEBUG("[Claude] ◀ OUT Prompt cache hit: %d input tokens read from cache", cached);
+        }
     }
     
     LOG_DEBUG("[Claude] === ◀ OUT AI Response ===");
@@ -12,21 +12,34 @@
 #include <opencrank/core/logger.hpp>
 #include <opencrank/core/utils.hpp>
 #include <opencrank/core/registry.hpp>
+#include <opencrank/core/reactor.hpp>
+#include <opencrank/core/metrics.hpp>
 
 // Crow header-only library (C++17 required)
 #include "deps/crow_all.h"
 
 #include <cstring>
+#include <cstdlib>
 #include <ctime>
+#include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <deque>
+#include <memory>
 #include <unordered_map>
+#include <sys/stat.h>
+#include <zlib.h>
 
 namespace opencrank {
 
+namespace {
+// GET / and /index.html (defined with the other HTTP helpers below)
+crow::response serve_control_ui(GatewayPlugin* plugin, const crow::request& req);
+}
+
 // ============================================================================
 // WebSocket Server Implementation (using Crow)
 // ============================================================================
@@ -95,33 +108,34 @@ public:
     
 private:
     void setup_routes() {
-        // Serve static HTML control UI
+        // Serve static HTML control UI (from memory, no redirect round trip)
         CROW_ROUTE(app_, "/")
-        ([this]() {
-            crow::response res;
-            res.redirect("/index.html");
-            return res;
+        ([this](const crow::request& req) {
+            return serve_control_ui(plugin_, req);
         });
         
         CROW_ROUTE(app_, "/index.html")
-        ([this]() {
+        ([this](const crow::request& req) {
+            return serve_control_ui(plugin_, req);
+        });
+        
+        // Prometheus scrape endpoint
+        CROW_ROUTE(app_, "/metrics")
+        ([this](const crow::request& req) {
             crow::response res;
-            std::ifstream html_file(plugin_->index_filename());
-            if (html_file.is_open()) {
-                std::stringstream buffer;
-                buffer << html_file.rdbuf();
-                res.set_header("Content-Type", "text/html; charset=utf-8");
-                res.body = buffer.str();
-                html_file.close();
-
-                LOG_DEBUG("Served control UI to HTTP client");
-            }
-            else {
+            if (!plugin_->metrics_enabled()) {
                 res.code = 404;
                 res.body = "404 Not Found";
-                LOG_WARN(" Control UI HTML file not found");
+                return res;
             }
-
+            if (!plugin_->metrics_authorized(req.get_header_value("Authorization"))) {
+                res.code = 401;
+                res.set_header("WWW-Authenticate", "Bearer");
+                res.body = "401 Unauthorized";
+                return res;
+            }
+            res.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+            res.body = Metrics::instance().render();
             return res;
         });
         
@@ -176,7 +190,7 @@ private:
         }
     }
     
-    void on_ws_message(crow::websocket::connection& conn, const std::string& data, bool /* is_binary */) {
+    void on_ws_message(crow::websocket::connection& conn, const std::string& data, bool is_binary) {
         GatewayClient* client = nullptr;
         
         {
@@ -188,7 +202,7 @@ private:
         }
         
         if (client) {
-            plugin_->handle_client_message(client, data);
+            plugin_->handle_client_message(client, data, is_binary);
         }
     }
     
@@ -208,31 +222,502 @@ private:
 // GatewayClient Implementation
 // ============================================================================
 
+// Outbound queue of one client. Events wait here until the connection's own
+// io thread drains them into Crow, so publishers never touch the socket and
+// a client that falls behind only costs its bounded queue.
+struct GatewayOutbox {
+    struct Item {
+        std::shared_ptr<const std::string> data;
+        std::string coalesce_key;
+        bool binary;
+        bool droppable;
+    };
+    
+    std::mutex mutex;
+    std::deque<Item> items;
+    size_t bytes = 0;
+    size_t max_messages = 256;
+    size_t max_bytes = 4 * 1024 * 1024;
+    bool drain_scheduled = false;
+    bool overflowing = false;       // Logged once per backlog episode
+    uint64_t dropped = 0;
+    crow::websocket::connection* conn = nullptr;   // Cleared when the client goes
+    
+    // Hand everything queued to Crow (on the connection's io thread)
+    void drain() {
+        std::deque<Item> batch;
+        crow::websocket::connection* target;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            drain_scheduled = false;
+            overflowing = false;
+            batch.swap(items);
+            bytes = 0;
+            target = conn;
+        }
+        if (!target) return;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            try {
+                if (batch[i].binary) {
+                    target->send_binary(*batch[i].data);
+                } else {
+                    target->send_text(*batch[i].data);
+                }
+            } catch (const std::exception& e) {
+                LOG_ERROR("Failed to send WebSocket message: %s", e.what());
+            }
+        }
+    }
+};
+
+// The Control UI page, read and gzipped once and served from memory until
+// the file changes
+struct GatewayUiAsset {
+    std::string body;
+    std::string gzip;           // "" when compressing did not make it smaller
+    std::string etag;           // Strong validator of body (quoted)
+    std::string gzip_etag;      // ...and of the gzip representation
+    time_t mtime = 0;
+    off_t size = 0;
+};
+
+namespace {
+typedef crow::websocket::Connection<crow::SocketAdaptor, crow::SimpleApp> PlainConnection;
+
+// Run outbox->drain() on the connection's io thread; a pending drain picks
+// up anything queued after it was scheduled
+void schedule_drain(const std::shared_ptr<GatewayOutbox>& outbox,
+                    crow::websocket::connection* conn) {
+    PlainConnection* plain = dynamic_cast<PlainConnection*>(conn);
+    if (plain) {
+        plain->post([outbox]() { outbox->drain(); });
+    } else {
+        outbox->drain();
+    }
+}
+
+bool topic_matches(const std::string& pattern, const std::string& topic) {
+    if (pattern == "*" || pattern == topic) return true;
+    size_t n = pattern.size();
+    return n >= 2 && pattern.compare(n - 2, 2, ":*") == 0 &&
+           topic.compare(0, n - 1, pattern, 0, n - 1) == 0;
+}
+
+std::string make_topic(const std::string& channel, const std::string& chat_id) {
+    return channel + ":" + chat_id;
+}
+
+// ============================================================================
+// Wire formats
+// ============================================================================
+
+const size_t MAX_INFLATED_BYTES = 4 * 1024 * 1024;
+
+// Raw deflate (no zlib header), as DecompressionStream("deflate-raw") expects.
+// The stream is kept per thread and reset between messages.
+bool deflate_raw(const std::string& in, std::string& out) {
+    struct Deflater {
+        z_stream zs;
+        bool ok;
+        Deflater() {
+            memset(&zs, 0, sizeof(zs));
+            ok = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+        ~Deflater() { if (ok) deflateEnd(&zs); }
+    };
+    static thread_local Deflater d;
+    if (!d.ok || deflateReset(&d.zs) != Z_OK) return false;
+    
+    size_t start = out.size();
+    out.resize(start + deflateBound(&d.zs, static_cast<uLong>(in.size())));
+    d.zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    d.zs.avail_in = static_cast<uInt>(in.size());
+    d.zs.next_out = reinterpret_cast<Bytef*>(&out[start]);
+    d.zs.avail_out = static_cast<uInt>(out.size() - start);
+    if (deflate(&d.zs, Z_FINISH) != Z_STREAM_END) {
+        out.resize(start);
+        return false;
+    }
+    out.resize(start + d.zs.total_out);
+    return true;
+}
+
+bool inflate_raw(const char* data, size_t len, std::string& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) return false;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(len);
+    
+    char buf[16384];
+    int rc = Z_OK;
+    while (rc == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) break;
+        out.append(buf, sizeof(buf) - zs.avail_out);
+        if (out.size() > MAX_INFLATED_BYTES) {
+            rc = Z_MEM_ERROR;   // Refuse decompression bombs
+            break;
+        }
+        if (rc == Z_OK && zs.avail_in == 0 && zs.avail_out != 0) break;  // Truncated
+    }
+    inflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+// Encode a protocol message for a wire format; binary is set when the result
+// must go out as a binary frame. JSON stays a text frame unless it is
+// compressed.
+std::string encode_message(const Json& message, GatewayEncoding encoding, bool compression,
+                           size_t compress_min_bytes, bool& binary) {
+    std::string body;
+    switch (encoding) {
+        case GatewayEncoding::MSGPACK: {
+            std::vector<uint8_t> bytes = Json::to_msgpack(message);
+            body.assign(bytes.begin(), bytes.end());
+            break;
+        }
+        case GatewayEncoding::CBOR: {
+            std::vector<uint8_t> bytes = Json::to_cbor(message);
+            body.assign(bytes.begin(), bytes.end());
+            break;
+        }
+        default:
+            body = message.dump(-1, ' ', false, Json::error_handler_t::replace);
+            break;
+    }
+    
+    bool deflate = compression && body.size() >= compress_min_bytes;
+    if (encoding == GatewayEncoding::JSON && !deflate) {
+        binary = false;
+        return body;
+    }
+    
+    binary = true;
+    std::string frame;
+    frame.reserve(body.size() / 2 + 16);
+    frame += static_cast<char>(GatewayClient::FRAME_DEFLATE);
+    if (deflate && deflate_raw(body, frame) && frame.size() < body.size() + 1) {
+        return frame;
+    }
+    frame.assign(1, static_cast<char>(GatewayClient::FRAME_PLAIN));
+    frame += body;
+    return frame;
+}
+
+// Decode a client frame. Text frames are JSON; binary frames carry the
+// flag byte and the client's encoding.
+bool decode_message(const std::string& frame, bool binary, GatewayEncoding encoding, Json& out) {
+    try {
+        if (!binary) {
+            out = Json::parse(frame);
+            return true;
+        }
+        if (frame.empty()) return false;
+        
+        std::string inflated;
+        const char* body = frame.data() + 1;
+        size_t len = frame.size() - 1;
+        unsigned char flag = static_cast<unsigned char>(frame[0]);
+        if (flag == GatewayClient::FRAME_DEFLATE) {
+            if (!inflate_raw(body, len, inflated)) return false;
+            body = inflated.data();
+            len = inflated.size();
+        } else if (flag != GatewayClient::FRAME_PLAIN) {
+            return false;
+        }
+        
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(body);
+        switch (encoding) {
+            case GatewayEncoding::MSGPACK: out = Json::from_msgpack(bytes, bytes + len); break;
+            case GatewayEncoding::CBOR:    out = Json::from_cbor(bytes, bytes + len); break;
+            default:                       out = Json::parse(body, body + len); break;
+        }
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// ============================================================================
+// Static HTTP content
+// ============================================================================
+
+const int64_t UI_RECHECK_MS = 1000;
+
+// gzip (zlib header replaced by the gzip one), at the best ratio: done once
+// per file version
+bool gzip_compress(const std::string& in, std::string& out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, static_cast<uLong>(in.size())) + 32);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    bool ok = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+    out.resize(ok ? zs.total_out : 0);
+    deflateEnd(&zs);
+    return ok;
+}
+
+std::shared_ptr<GatewayUiAsset> load_ui_asset(const std::string& path, const struct stat& st) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) return nullptr;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    
+    std::shared_ptr<GatewayUiAsset> asset = std::make_shared<GatewayUiAsset>();
+    asset->body = buffer.str();
+    asset->mtime = st.st_mtime;
+    asset->size = st.st_size;
+    std::string hash = sha256_hex(asset->body).substr(0, 32);
+    asset->etag = "\"" + hash + "\"";
+    asset->gzip_etag = "\"" + hash + "-gz\"";
+    if (!gzip_compress(asset->body, asset->gzip) || asset->gzip.size() >= asset->body.size()) {
+        asset->gzip.clear();
+    }
+    return asset;
+}
+
+std::string trim_ows(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+// If-None-Match against our tag (weak comparison, as RFC 9110 asks for it)
+bool etag_matches(const std::string& if_none_match, const std::string& etag) {
+    std::stringstream list(if_none_match);
+    std::string tag;
+    while (std::getline(list, tag, ',')) {
+        tag = trim_ows(tag);
+        if (tag.compare(0, 2, "W/") == 0) tag = tag.substr(2);
+        if (tag == "*" || tag == etag) return true;
+    }
+    return false;
+}
+
+// Accept-Encoding lists gzip (or *) without q=0
+bool accepts_gzip(const std::string& accept_encoding) {
+    std::stringstream list(accept_encoding);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t semi = item.find(';');
+        std::string coding = trim_ows(item.substr(0, semi));
+        std::transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+        if (coding != "gzip" && coding != "*") continue;
+        if (semi == std::string::npos) return true;
+        size_t q = item.find("q=", semi);
+        return q == std::string::npos || atof(item.c_str() + q + 2) > 0.0;
+    }
+    return false;
+}
+
+crow::response serve_control_ui(GatewayPlugin* plugin, const crow::request& req) {
+    crow::response res;
+    std::shared_ptr<const GatewayUiAsset> ui = plugin->ui_asset();
+    if (!ui) {
+        res.code = 404;
+        res.body = "404 Not Found";
+        LOG_WARN(" Control UI HTML file not found");
+        return res;
+    }
+    
+    bool gzip = !ui->gzip.empty() && accepts_gzip(req.get_header_value("Accept-Encoding"));
+    const std::string& etag = gzip ? ui->gzip_etag : ui->etag;
+    
+    // The page keeps its URL, so browsers revalidate it on every load; an
+    // unchanged page costs one round trip and no body
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("Vary", "Accept-Encoding");
+    if (etag_matches(req.get_header_value("If-None-Match"), etag)) {
+        res.code = 304;
+        return res;
+    }
+    
+    res.set_header("Content-Type", "text/html; charset=utf-8");
+    if (gzip) {
+        res.set_header("Content-Encoding", "gzip");
+        res.body = ui->gzip;
+    } else {
+        res.body = ui->body;
+    }
+    LOG_DEBUG("Served control UI to HTTP client (%zu bytes%s)", res.body.size(), gzip ? ", gzip" : "");
+    return res;
+}
+
+bool parse_encoding(const std::string& name, GatewayEncoding& out) {
+    if (name == "json") { out = GatewayEncoding::JSON; return true; }
+    if (name == "msgpack") { out = GatewayEncoding::MSGPACK; return true; }
+    if (name == "cbor") { out = GatewayEncoding::CBOR; return true; }
+    return false;
+}
+
+const char* encoding_name(GatewayEncoding encoding) {
+    switch (encoding) {
+        case GatewayEncoding::MSGPACK: return "msgpack";
+        case GatewayEncoding::CBOR: return "cbor";
+        default: return "json";
+    }
+}
+
+// A hello field that is either one name or a list in preference order
+std::vector<std::string> name_list(const Json& params, const char* key) {
+    std::vector<std::string> names;
+    if (!params.contains(key)) return names;
+    const Json& v = params[key];
+    if (v.is_string()) {
+        names.push_back(v.get<std::string>());
+    } else if (v.is_array()) {
+        for (const auto& n : v) {
+            if (n.is_string()) names.push_back(n.get<std::string>());
+        }
+    }
+    return names;
+}
+} // namespace
+
 GatewayClient::GatewayClient(void* ws_connection, const std::string& conn_id)
     : ws_connection_(ws_connection)
+    , outbox_(std::make_shared<GatewayOutbox>())
     , conn_id_(conn_id)
     , authenticated_(false)
-    , protocol_version_(1) {
+    , protocol_version_(1)
+    , encoding_(static_cast<int>(GatewayEncoding::JSON))
+    , compression_(false)
+    , compress_min_bytes_(512) {
+    outbox_->conn = static_cast<crow::websocket::connection*>(ws_connection);
 }
 
 GatewayClient::~GatewayClient() {
+    // Drains still queued on the io thread hold the outbox; they see no
+    // connection and do nothing
+    std::lock_guard<std::mutex> lock(outbox_->mutex);
+    outbox_->conn = nullptr;
+    outbox_->items.clear();
+    outbox_->bytes = 0;
 }
 
 bool GatewayClient::send(const std::string& message) {
     if (!ws_connection_) return false;
+    push(std::make_shared<const std::string>(message), false, std::string(), false);
+    return true;
+}
+
+bool GatewayClient::send_json(const Json& data) {
+    if (!ws_connection_) return false;
+    bool binary = false;
+    std::string frame = encode_message(data, encoding(), compression(),
+                                       compress_min_bytes_.load(), binary);
+    push(std::make_shared<const std::string>(std::move(frame)), binary, std::string(), false);
+    return true;
+}
+
+void GatewayClient::set_wire_format(GatewayEncoding encoding, bool compression,
+                                    size_t compress_min_bytes) {
+    encoding_ = static_cast<int>(encoding);
+    compression_ = compression;
+    compress_min_bytes_ = compress_min_bytes;
+}
+
+void GatewayClient::enqueue(const std::shared_ptr<const std::string>& data, bool binary,
+                            const std::string& coalesce_key) {
+    push(data, binary, coalesce_key, true);
+}
+
+void GatewayClient::push(const std::shared_ptr<const std::string>& data, bool binary,
+                         const std::string& coalesce_key, bool droppable) {
+    GatewayOutbox& box = *outbox_;
+    std::unique_lock<std::mutex> lock(box.mutex);
+    if (!box.conn) return;
+    
+    // Newer state replaces a queued event with the same key (typing toggles,
+    // successive edits of one streamed reply)
+    if (!coalesce_key.empty()) {
+        for (auto it = box.items.begin(); it != box.items.end(); ++it) {
+            if (it->coalesce_key == coalesce_key) {
+                box.bytes = box.bytes - it->data->size() + data->size();
+                it->data = data;
+                it->binary = binary;
+                return;
+            }
+        }
+    }
     
-    try {
-        auto* conn = static_cast<crow::websocket::connection*>(ws_connection_);
-        conn->send_text(message);
-        return true;
-    } catch (const std::exception& e) {
-        LOG_ERROR("Failed to send WebSocket message: %s", e.what());
-        return false;
+    GatewayOutbox::Item item;
+    item.data = data;
+    item.coalesce_key = coalesce_key;
+    item.binary = binary;
+    item.droppable = droppable;
+    box.items.push_back(item);
+    box.bytes += data->size();
+    
+    // Slow consumer: shed the oldest events, keep replies
+    auto it = box.items.begin();
+    while ((box.items.size() > box.max_messages || box.bytes > box.max_bytes) &&
+           it != box.items.end()) {
+        if (!it->droppable || &*it == &box.items.back()) {
+            ++it;
+            continue;
+        }
+        box.bytes -= it->data->size();
+        it = box.items.erase(it);
+        ++box.dropped;
+        if (!box.overflowing) {
+            box.overflowing = true;
+            LOG_WARN("Gateway client %s is not keeping up, dropping queued events (%llu dropped so far)",
+                     conn_id_.c_str(), static_cast<unsigned long long>(box.dropped));
+        }
+    }
+    
+    if (!box.drain_scheduled) {
+        box.drain_scheduled = true;
+        crow::websocket::connection* conn = box.conn;
+        lock.unlock();
+        schedule_drain(outbox_, conn);
     }
 }
 
-bool GatewayClient::send_json(const Json& data) {
-    return send(data.dump());
+void GatewayClient::set_queue_limits(size_t max_messages, size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(outbox_->mutex);
+    outbox_->max_messages = max_messages;
+    outbox_->max_bytes = max_bytes;
+}
+
+uint64_t GatewayClient::dropped() const {
+    std::lock_guard<std::mutex> lock(outbox_->mutex);
+    return outbox_->dropped;
+}
+
+void GatewayClient::subscribe(const std::string& topic) {
+    std::lock_guard<std::mutex> lock(topics_mutex_);
+    topics_.insert(topic);
+}
+
+void GatewayClient::unsubscribe(const std::string& topic) {
+    std::lock_guard<std::mutex> lock(topics_mutex_);
+    topics_.erase(topic);
+}
+
+bool GatewayClient::wants(const std::string& topic) const {
+    std::lock_guard<std::mutex> lock(topics_mutex_);
+    for (auto it = topics_.begin(); it != topics_.end(); ++it) {
+        if (topic_matches(*it, topic)) return true;
+    }
+    return false;
+}
+
+std::vector<std::string> GatewayClient::subscriptions() const {
+    std::lock_guard<std::mutex> lock(topics_mutex_);
+    return std::vector<std::string>(topics_.begin(), topics_.end());
 }
 
 // ============================================================================
@@ -244,7 +729,15 @@ GatewayPlugin::GatewayPlugin()
     , port_(18789)
     , bind_host_("127.0.0.1")
     , index_filename_("ui/control_ui.html")
-    , ws_server_(nullptr) {
+    , ui_checked_ms_(0)
+    , metrics_enabled_(true)
+    , ws_server_(nullptr)
+    , queue_max_messages_(256)
+    , queue_max_bytes_(4 * 1024 * 1024)
+    , allow_binary_(true)
+    , allow_compression_(true)
+    , compress_min_bytes_(512)
+    , next_message_id_(0) {
     initialized_ = false;
 }
 
@@ -262,14 +755,33 @@ bool GatewayPlugin::init(const Config& cfg) {
     bind_host_ = cfg.get_string("gateway.bind", "127.0.0.1");
     auth_token_ = cfg.get_string("gateway.auth.token", "");
     index_filename_ = cfg.get_string("gateway.index_file", "ui/control_ui.html");
-    
-    
-    LOG_INFO("Gateway config: port=%d, bind=%s, auth=%s", 
-             port_, bind_host_.c_str(), auth_token_.empty() ? "disabled" : "enabled");
+    int64_t queue_max = cfg.get_int("gateway.client_queue_max", 256);
+    int64_t queue_kb = cfg.get_int("gateway.client_queue_kb", 4096);
+    queue_max_messages_ = static_cast<size_t>(queue_max < 1 ? 1 : queue_max);
+    queue_max_bytes_ = static_cast<size_t>(queue_kb < 1 ? 1 : queue_kb) * 1024;
+    allow_binary_ = cfg.get_bool("gateway.binary_frames", true);
+    allow_compression_ = cfg.get_bool("gateway.compression", true);
+    int64_t compress_min = cfg.get_int("gateway.compress_min_bytes", 512);
+    compress_min_bytes_ = static_cast<size_t>(compress_min < 0 ? 0 : compress_min);
+    metrics_enabled_ = cfg.get_bool("gateway.metrics", true);
+    
+    LOG_INFO("Gateway config: port=%d, bind=%s, auth=%s, client queue=%zu events/%zu KB", 
+             port_, bind_host_.c_str(), auth_token_.empty() ? "disabled" : "enabled",
+             queue_max_messages_, queue_max_bytes_ / 1024);
+    
+    // Read the UI now, before the sandbox closes its directory
+    ui_asset();
     
     // Create WebSocket server (but don't start yet)
     ws_server_ = new WebSocketServer(this);
     
+    if (metrics_enabled_) {
+        Metrics::instance().add_collector("gateway", [this](MetricsWriter& w) {
+            w.gauge("opencrank_gateway_clients", "Connected gateway clients",
+                    static_cast<double>(client_count()));
+        });
+    }
+    
     initialized_ = true;
     LOG_INFO("Gateway plugin initialized (will start on first poll)");
     return true;
@@ -280,7 +792,7 @@ ChannelCapabilities GatewayPlugin::capabilities() const {
     caps.supports_groups = false;
     caps.supports_reactions = false;
     caps.supports_media = false;
-    caps.supports_edit = false;
+    caps.supports_edit = true;
     caps.supports_delete = false;
     caps.supports_typing = true;
     return caps;
@@ -292,23 +804,43 @@ SendResult GatewayPlugin::send_typing_action(const std::string& to) {
     return SendResult::ok("");
 }
 
+std::string GatewayPlugin::make_message_id() {
+    return "gw_" + std::to_string(std::time(nullptr)) + "_" + std::to_string(++next_message_id_);
+}
+
 SendResult GatewayPlugin::send_message(const std::string& to, const std::string& text) {
-    // Broadcast to all gateway clients
+    // Deliver to the clients following this chat
+    std::string message_id = make_message_id();
     Json payload = Json::object();
     payload["to"] = to;
     payload["text"] = sanitize_utf8(text);
-    broadcast("chat.outgoing", payload);
-    return SendResult::ok("gw_" + std::to_string(std::time(nullptr)));
+    payload["message_id"] = message_id;
+    publish(make_topic("gateway", to), "chat.outgoing", payload);
+    return SendResult::ok(message_id);
 }
 
 SendResult GatewayPlugin::send_message(const std::string& to, const std::string& text, const std::string& reply_to) {
-    // Broadcast to all gateway clients
+    // Deliver to the clients following this chat
+    std::string message_id = make_message_id();
     Json payload = Json::object();
     payload["to"] = to;
     payload["text"] = sanitize_utf8(text);
     payload["reply_to"] = reply_to;
-    broadcast("chat.outgoing", payload);
-    return SendResult::ok("gw_" + std::to_string(std::time(nullptr)));
+    payload["message_id"] = message_id;
+    publish(make_topic("gateway", to), "chat.outgoing", payload);
+    return SendResult::ok(message_id);
+}
+
+SendResult GatewayPlugin::edit_message(const std::string& to, const std::string& message_id,
+                                       const std::string& text) {
+    // Same event as a new message; clients replace the one with this id
+    Json payload = Json::object();
+    payload["to"] = to;
+    payload["text"] = sanitize_utf8(text);
+    payload["message_id"] = message_id;
+    payload["edit"] = true;
+    publish(make_topic("gateway", to), "chat.outgoing", payload, "edit:" + message_id);
+    return SendResult::ok(message_id);
 }
 
 void GatewayPlugin::shutdown() {
@@ -316,6 +848,7 @@ void GatewayPlugin::shutdown() {
     
     LOG_INFO("Shutting down gateway plugin...");
     
+    Metrics::instance().remove_collector("gateway");
     stop();
     
     if (ws_server_) {
@@ -324,6 +857,7 @@ void GatewayPlugin::shutdown() {
     }
     
     // Clean up clients
+    std::lock_guard<std::mutex> lock(clients_mutex_);
     for (auto it = clients_.begin(); it != clients_.end(); ++it) {
         delete *it;
     }
@@ -332,6 +866,33 @@ void GatewayPlugin::shutdown() {
     initialized_ = false;
 }
 
+std::shared_ptr<const GatewayUiAsset> GatewayPlugin::ui_asset() {
+    int64_t now = current_timestamp_ms();
+    std::lock_guard<std::mutex> lock(ui_mutex_);
+    if (ui_asset_ && now - ui_checked_ms_ < UI_RECHECK_MS) return ui_asset_;
+    ui_checked_ms_ = now;
+    
+    // A file that is gone or locked away by the sandbox keeps its last copy
+    struct stat st;
+    if (stat(index_filename_.c_str(), &st) != 0) return ui_asset_;
+    if (ui_asset_ && ui_asset_->mtime == st.st_mtime && ui_asset_->size == st.st_size) return ui_asset_;
+    
+    std::shared_ptr<GatewayUiAsset> loaded = load_ui_asset(index_filename_, st);
+    if (loaded) {
+        LOG_INFO("[Gateway] Control UI %s loaded (%zu bytes, %zu gzipped)", index_filename_.c_str(),
+                 loaded->body.size(), loaded->gzip.size());
+        ui_asset_ = loaded;
+    }
+    return ui_asset_;
+}
+
+bool GatewayPlugin::metrics_authorized(const std::string& authorization) const {
+    if (auth_token_.empty()) return true;
+    const std::string prefix = "Bearer ";
+    return authorization.compare(0, prefix.size(), prefix) == 0 &&
+           authorization.substr(prefix.size()) == auth_token_;
+}
+
 bool GatewayPlugin::start() {
     if (running_) {
         LOG_WARN("Gateway already running");
@@ -379,24 +940,64 @@ void GatewayPlugin::poll() {
     }
 }
 
+bool GatewayPlugin::attach_reactor(Reactor& reactor) {
+    // Crow runs its own io_context thread; just start it once the loop is up
+    reactor.post([this]() {
+        if (!running_ && initialized_ && ws_server_) {
+            start();
+        }
+    });
+    return true;
+}
+
 size_t GatewayPlugin::client_count() const {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
     return clients_.size();
 }
 
 void GatewayPlugin::broadcast(const std::string& event, const Json& payload) {
-    Json message = Json::object();
-    message["type"] = "event";
-    message["event"] = event;
-    message["payload"] = payload;
-    
-    std::string data = message.dump();
-    
-    LOG_DEBUG("◀ OUT Broadcasting event '%s' to %zu clients (%zu bytes)", 
-              event.c_str(), clients_.size(), data.size());
-    
+    deliver(nullptr, event, payload, std::string());
+}
+
+void GatewayPlugin::publish(const std::string& topic, const std::string& event,
+                            const Json& payload, const std::string& coalesce_key) {
+    deliver(&topic, event, payload, coalesce_key);
+}
+
+void GatewayPlugin::deliver(const std::string* topic, const std::string& event,
+                            const Json& payload, const std::string& coalesce_key) {
+    // Serialized once per wire format; recipients sharing a format queue
+    // the same immutable buffer
+    std::shared_ptr<const std::string> frames[6];
+    bool binary[6] = {false, false, false, false, false, false};
+    Json message;
+    size_t recipients = 0;
+    
+    std::lock_guard<std::mutex> lock(clients_mutex_);
     for (auto it = clients_.begin(); it != clients_.end(); ++it) {
-        (*it)->send(data);
+        GatewayClient* client = *it;
+        if (!auth_token_.empty() && !client->is_authenticated()) continue;
+        if (topic && !client->wants(*topic)) continue;
+        
+        if (message.is_null()) {
+            message = Json::object();
+            message["type"] = "event";
+            message["event"] = event;
+            if (topic) message["topic"] = *topic;
+            message["payload"] = payload;
+        }
+        int wire = client->wire_format_index();
+        if (!frames[wire]) {
+            frames[wire] = std::make_shared<const std::string>(
+                encode_message(message, client->encoding(), client->compression(),
+                               compress_min_bytes_, binary[wire]));
+        }
+        client->enqueue(frames[wire], binary[wire], coalesce_key);
+        ++recipients;
     }
+    
+    LOG_DEBUG("◀ OUT Event '%s' (%s) to %zu of %zu clients", 
+              event.c_str(), topic ? topic->c_str() : "all", recipients, clients_.size());
 }
 
 void GatewayPlugin::send_typing_event(const std::string& channel_id, 
@@ -407,10 +1008,12 @@ void GatewayPlugin::send_typing_event(const std::string& channel_id,
     payload["chat_id"] = chat_id;
     payload["typing"] = typing;
     
-    broadcast("chat.typing", payload);
+    // Only the latest typing state of a chat is worth delivering
+    std::string topic = make_topic(channel_id, chat_id);
+    publish(topic, "chat.typing", payload, "typing:" + topic);
     
-    LOG_DEBUG("Sent typing=%s event for %s:%s to %zu clients", 
-              typing ? "true" : "false", channel_id.c_str(), chat_id.c_str(), clients_.size());
+    LOG_DEBUG("Sent typing=%s event for %s:%s", 
+              typing ? "true" : "false", channel_id.c_str(), chat_id.c_str());
 }
 
 // ============================================================================
@@ -418,26 +1021,34 @@ void GatewayPlugin::send_typing_event(const std::string& channel_id,
 // ============================================================================
 
 void GatewayPlugin::handle_client_connect(GatewayClient* client) {
+    client->set_queue_limits(queue_max_messages_, queue_max_bytes_);
+    client->subscribe(make_topic("gateway", client->conn_id()));
+    
+    std::lock_guard<std::mutex> lock(clients_mutex_);
     clients_.insert(client);
     
     LOG_INFO("Gateway client connected (total: %zu)", clients_.size());
 }
 
 void GatewayPlugin::handle_client_disconnect(GatewayClient* client) {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
     clients_.erase(client);
     
+    if (client->dropped() > 0) {
+        LOG_INFO("Gateway client %s dropped %llu events while behind",
+                 client->conn_id().c_str(), static_cast<unsigned long long>(client->dropped()));
+    }
     LOG_INFO("Gateway client disconnected (remaining: %zu)", clients_.size());
 }
 
 void GatewayPlugin::handle_client_message(GatewayClient* client, 
-                                          const std::string& msg) {
-    // Parse JSON message
+                                          const std::string& msg, bool binary) {
+    // Parse the frame (JSON text, or binary in the negotiated encoding)
     Json request;
-    try {
-        request = Json::parse(msg);
-    } catch (const std::exception& e) {
-        LOG_ERROR("Invalid JSON from client %s: %s", 
-                 client->conn_id().c_str(), e.what());
+    if (!decode_message(msg, binary, client->encoding(), request)) {
+        LOG_ERROR("Invalid %s frame from client %s", 
+                 binary ? encoding_name(client->encoding()) : "JSON",
+                 client->conn_id().c_str());
         return;
     }
     
@@ -460,6 +1071,17 @@ void GatewayPlugin::handle_client_message(GatewayClient* client,
         // Initial handshake
         Json params = request.contains("params") ? request["params"] : Json::object();
         response = handle_hello(client, params);
+        
+        // hello-ok itself is always JSON text; the negotiated format applies
+        // from the next frame on
+        client->send(response.dump(-1, ' ', false, Json::error_handler_t::replace));
+        if (response.value("type", std::string()) == "hello-ok") {
+            GatewayEncoding encoding = GatewayEncoding::JSON;
+            parse_encoding(response.value("encoding", std::string("json")), encoding);
+            client->set_wire_format(encoding, response.value("compression", std::string()) == "deflate",
+                                    compress_min_bytes_);
+        }
+        return;
     }
     else if (type == "call") {
         // RPC method call
@@ -489,6 +1111,8 @@ void GatewayPlugin::handle_client_message(GatewayClient* client,
                 result = handle_health_get(client, params);
             } else if (method == "models.list") {
                 result = handle_models_list(client, params);
+            } else if (method == "subscribe" || method == "unsubscribe") {
+                result = handle_subscribe(client, params, method == "subscribe");
             } else {
                 result = Json::object();
                 result["error"] = "Method not found: " + method;
@@ -539,6 +1163,9 @@ Json GatewayPlugin::handle_hello(GatewayClient* client, const Json& params) {
             client->set_client_id(client_info.value("id", std::string("")));
         }
     }
+    if (!client->client_id().empty()) {
+        client->subscribe(make_topic("gateway", client->client_id()));
+    }
     
     // Check authentication
     bool auth_ok = true;
@@ -554,10 +1181,27 @@ Json GatewayPlugin::handle_hello(GatewayClient* client, const Json& params) {
     
     client->set_authenticated(auth_ok);
     
+    // Wire format: first encoding we support from the client's preference
+    // list; clients that ask for nothing keep JSON text frames
+    GatewayEncoding encoding = GatewayEncoding::JSON;
+    if (allow_binary_) {
+        std::vector<std::string> encodings = name_list(params, "encoding");
+        for (size_t i = 0; i < encodings.size(); ++i) {
+            if (parse_encoding(encodings[i], encoding)) break;
+        }
+    }
+    bool compression = false;
+    if (allow_compression_) {
+        std::vector<std::string> methods = name_list(params, "compression");
+        compression = std::find(methods.begin(), methods.end(), "deflate") != methods.end();
+    }
+    
     // Build hello-ok response
     Json response = Json::object();
     response["type"] = "hello-ok";
     response["protocol"] = protocol;
+    response["encoding"] = encoding_name(encoding);
+    response["compression"] = compression ? "deflate" : "none";
     
     Json server_info = Json::object();
     server_info["version"] = "opencrank-cpp-1.0.0";
@@ -571,9 +1215,15 @@ Json GatewayPlugin::handle_hello(GatewayClient* client, const Json& params) {
     methods.push_back("config.get");
     methods.push_back("health.get");
     methods.push_back("models.list");
+    methods.push_back("subscribe");
+    methods.push_back("unsubscribe");
     features["methods"] = methods;
     
     Json events = Json::array();
+    events.push_back("chat.message");
+    events.push_back("chat.outgoing");
+    events.push_back("chat.typing");
+    events.push_back("chat.notification");
     events.push_back("chat.delta");
     events.push_back("chat.done");
     events.push_back("heartbeat");
@@ -606,6 +1256,7 @@ Json GatewayPlugin::handle_chat_send(GatewayClient* client, const Json& params)
     
     std::string text = params.value("text", std::string(""));
     std::string reply_to = params.value("reply_to", std::string(""));
+    std::string chat_id = params.value("chat_id", std::string(""));
 
     LOG_INFO(" ▶ IN  chat.send from %s: text=%.100s%s", 
              client->conn_id().c_str(), text.c_str(),
@@ -617,7 +1268,7 @@ Json GatewayPlugin::handle_chat_send(GatewayClient* client, const Json& params)
     msg.channel = "gateway";
     msg.from = client->client_id().empty() ? client->conn_id() : client->client_id();
     msg.from_name = "Gateway User";
-    msg.to = recent_chat_id_.empty() ? msg.from : recent_chat_id_;
+    msg.to = chat_id.empty() ? msg.from : chat_id;
     msg.text = text;
     msg.chat_type = "direct";
     msg.timestamp = std::time(nullptr);
@@ -628,6 +1279,9 @@ Json GatewayPlugin::handle_chat_send(GatewayClient* client, const Json& params)
     LOG_DEBUG("▶ IN  Creating message for AI processing: from=%s to=%s, text_len=%zu", 
               msg.from.c_str(), msg.to.c_str(), msg.text.size());
 
+    // The reply, typing and echo events for this chat go to its subscribers
+    client->subscribe(make_topic("gateway", msg.to));
+
     // Fire the message through the channel callback (inherited from ChannelPlugin)
     // This will route it through the message handler for AI processing
     emit_message(msg);
@@ -653,6 +1307,36 @@ Json GatewayPlugin::handle_health_get(GatewayClient* /* client */, const Json& /
     return result;
 }
 
+Json GatewayPlugin::handle_subscribe(GatewayClient* client, const Json& params, bool subscribe) {
+    Json result = Json::object();
+    std::vector<std::string> topics;
+    if (params.contains("topics") && params["topics"].is_array()) {
+        for (const auto& t : params["topics"]) {
+            if (t.is_string()) topics.push_back(t.get<std::string>());
+        }
+    } else if (params.contains("topic") && params["topic"].is_string()) {
+        topics.push_back(params["topic"].get<std::string>());
+    }
+    if (topics.empty()) {
+        result["error"] = "Missing required parameter: topics";
+        return result;
+    }
+    
+    for (size_t i = 0; i < topics.size(); ++i) {
+        if (subscribe) {
+            client->subscribe(topics[i]);
+        } else {
+            client->unsubscribe(topics[i]);
+        }
+    }
+    LOG_DEBUG("Client %s %s %zu topic(s)", client->conn_id().c_str(),
+              subscribe ? "subscribed to" : "unsubscribed from", topics.size());
+    
+    result["success"] = true;
+    result["subscriptions"] = client->subscriptions();
+    return result;
+}
+
 Json GatewayPlugin::handle_models_list(GatewayClient* /* client */, const Json& /* params */) {
     Json result = Json::object();
     result["models"] = Json::array();
@@ -660,7 +1344,7 @@ Json GatewayPlugin::handle_models_list(GatewayClient* /* client */, const Json&
 }
 
 void GatewayPlugin::route_incoming_message(const Message& msg) {
-    // Broadcast incoming message to all connected gateway clients
+    // Deliver incoming message to the clients following its chat
     Json event_payload = Json::object();
     event_payload["id"] = msg.id;
     event_payload["channel"] = msg.channel;
@@ -678,18 +1362,15 @@ void GatewayPlugin::route_incoming_message(const Message& msg) {
         event_payload["media_url"] = msg.media_url;
     }
     
-    LOG_DEBUG("◀ OUT Routing incoming message to %zu WS clients: from=%s, text=%.100s%s", 
-              clients_.size(), msg.from_name.c_str(), msg.text.c_str(),
+    LOG_DEBUG("◀ OUT Routing incoming message to WS clients: from=%s, text=%.100s%s", 
+              msg.from_name.c_str(), msg.text.c_str(),
               msg.text.size() > 100 ? "..." : "");
     
-    broadcast("chat.message", event_payload);
+    publish(make_topic(msg.channel, msg.to), "chat.message", event_payload);
 }
 
 void GatewayPlugin::on_incoming_message(const Message& msg) {
     // This is called by the main application for all incoming messages
-    // Track most recent chat for routing outgoing messages
-    recent_chat_id_ = msg.to;
-    
     // Check if this is a notification message (from notify_user tool)
     if (msg.chat_type == "notification" && 
         msg.reply_to_id.find("notification:") == 0) {
@@ -0,0 +1,418 @@
+/*
+ * OpenCrank C++ - Llama.cpp Slot Dispatcher Implementation
+ */
+#include <opencrank/plugins/llamacpp/dispatcher.hpp>
+#include <opencrank/core/http_client.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <chrono>
+
+namespace opencrank {
+
+namespace {
+
+const int64_t DISCOVER_RETRY_MS = 30000;
+const int64_t WAIT_SLICE_MS = 100;      // Cancel flags and other clients' slots are not signalled
+const long POLL_TIMEOUT_MS = 2000;
+
+} // anonymous namespace
+
+LlamaSlotDispatcher::LlamaSlotDispatcher()
+    : poll_ms_(1000)
+    , queue_timeout_ms_(120000)
+    , clock_(0)
+    , in_flight_(0)
+    , next_ticket_(0)
+    , queued_(0)
+    , stopping_(false)
+    , polling_(false)
+    , last_poll_ms_(0)
+    , discover_after_ms_(0)
+    , discovering_(false)
+    , slots_endpoint_(true)
+    , wait_seconds_(NULL) {}
+
+LlamaSlotDispatcher::~LlamaSlotDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        cv_.notify_all();
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void LlamaSlotDispatcher::configure(const std::string& server_url, const std::string& api_key,
+                                    int slots, int64_t poll_ms, int64_t queue_timeout_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    server_url_ = server_url;
+    api_key_ = api_key;
+    poll_ms_ = poll_ms;
+    queue_timeout_ms_ = queue_timeout_ms;
+    slots_.assign(slots > 0 ? static_cast<size_t>(slots) : 0, Slot());
+    session_slots_.clear();
+    discover_after_ms_ = 0;
+    slots_endpoint_ = true;
+    wait_seconds_ = &Metrics::instance().histogram(
+        "opencrank_llamacpp_queue_seconds", "Time llama.cpp requests waited for a free server slot");
+}
+
+bool LlamaSlotDispatcher::managed() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Requests arriving while another one asks the server wait for it
+        while (discovering_) {
+            cv_.wait(lock);
+        }
+        if (!slots_.empty()) return true;
+        int64_t now = current_timestamp_ms();
+        if (now < discover_after_ms_) return false;
+        discover_after_ms_ = now + DISCOVER_RETRY_MS;
+        discovering_ = true;
+    }
+    discover();
+    std::lock_guard<std::mutex> lock(mutex_);
+    discovering_ = false;
+    cv_.notify_all();
+    return !slots_.empty();
+}
+
+int LlamaSlotDispatcher::acquire(const std::string& session_key, const std::atomic<bool>* cancel,
+                                 std::string& error) {
+    if (!managed()) return -1;
+    maybe_poll();
+
+    int64_t start = current_timestamp_ms();
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t ticket = enqueue_locked(session_key);
+
+    int slot = -1;
+    for (;;) {
+        // Only the oldest request of the session whose turn it is may go
+        if (turn_.front() == session_key && waiting_[session_key].front() == ticket) {
+            slot = pick_slot_locked(session_key);
+            if (slot >= 0) break;
+        }
+        if (cancel && cancel->load()) {
+            error = "Request cancelled";
+            break;
+        }
+        int64_t waited = current_timestamp_ms() - start;
+        if (queue_timeout_ms_ > 0 && waited >= queue_timeout_ms_) {
+            error = "No free llama.cpp slot after " + std::to_string(waited) + "ms (" +
+                    std::to_string(in_flight_) + " in flight, " + std::to_string(queued_) + " queued)";
+            break;
+        }
+        cv_.wait_for(lock, std::chrono::milliseconds(WAIT_SLICE_MS));
+        if (poll_ms_ > 0 && !polling_) {
+            lock.unlock();
+            maybe_poll();
+            lock.lock();
+        }
+    }
+
+    leave_locked(session_key, ticket, slot >= 0);
+    if (slot < 0) {
+        cv_.notify_all();   // The turn may have passed to someone else
+        return -2;
+    }
+    take_locked(session_key, slot, start);
+    cv_.notify_all();   // The next session in turn may find another free slot
+    return slot;
+}
+
+void LlamaSlotDispatcher::acquire_async(const std::string& session_key, const std::atomic<bool>* cancel,
+                                        const SlotCallback& granted) {
+    if (!managed()) {
+        granted(-1, std::string());
+        return;
+    }
+    maybe_poll();
+
+    int64_t start = current_timestamp_ms();
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t ticket = enqueue_locked(session_key);
+    if (turn_.front() == session_key && waiting_[session_key].front() == ticket) {
+        int slot = pick_slot_locked(session_key);
+        if (slot >= 0) {
+            leave_locked(session_key, ticket, true);
+            take_locked(session_key, slot, start);
+            cv_.notify_all();
+            lock.unlock();
+            granted(slot, std::string());
+            return;
+        }
+    }
+
+    AsyncWaiter& waiter = async_waiters_[ticket];
+    waiter.session_key = session_key;
+    waiter.cancel = cancel;
+    waiter.start_ms = start;
+    waiter.granted = granted;
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&LlamaSlotDispatcher::serve_async, this);
+    }
+    cv_.notify_all();
+}
+
+void LlamaSlotDispatcher::serve_async() {
+    struct Grant {
+        SlotCallback granted;
+        int slot;
+        std::string error;
+    };
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (async_waiters_.empty()) {
+            cv_.wait(lock);
+            continue;
+        }
+        std::vector<Grant> grants;
+        int64_t now = current_timestamp_ms();
+        std::map<uint64_t, AsyncWaiter>::iterator it = async_waiters_.begin();
+        while (it != async_waiters_.end()) {
+            const AsyncWaiter& waiter = it->second;
+            Grant grant = { waiter.granted, -2, std::string() };
+            int64_t waited = now - waiter.start_ms;
+            if (waiter.cancel && waiter.cancel->load()) {
+                grant.error = "Request cancelled";
+            } else if (queue_timeout_ms_ > 0 && waited >= queue_timeout_ms_) {
+                grant.error = "No free llama.cpp slot after " + std::to_string(waited) + "ms (" +
+                              std::to_string(in_flight_) + " in flight, " + std::to_string(queued_) + " queued)";
+            } else {
+                ++it;
+                continue;
+            }
+            leave_locked(waiter.session_key, it->first, false);
+            grants.push_back(grant);
+            async_waiters_.erase(it++);
+        }
+        // Admit in turn order until a slot is missing or a blocked
+        // acquire() is next (it admits itself)
+        while (!turn_.empty()) {
+            std::string session_key = turn_.front();
+            uint64_t ticket = waiting_[session_key].front();
+            it = async_waiters_.find(ticket);
+            if (it == async_waiters_.end()) break;
+            int slot = pick_slot_locked(session_key);
+            if (slot < 0) break;
+            leave_locked(session_key, ticket, true);
+            take_locked(session_key, slot, it->second.start_ms);
+            Grant grant = { it->second.granted, slot, std::string() };
+            grants.push_back(grant);
+            async_waiters_.erase(it);
+        }
+        if (grants.empty()) {
+            cv_.wait_for(lock, std::chrono::milliseconds(WAIT_SLICE_MS));
+        } else {
+            cv_.notify_all();   // The turn moved on
+        }
+        lock.unlock();
+        for (size_t i = 0; i < grants.size(); ++i) {
+            grants[i].granted(grants[i].slot, grants[i].error);
+        }
+        maybe_poll();
+        lock.lock();
+    }
+
+    // Shutting down: nobody will free a slot for the rest
+    std::map<uint64_t, AsyncWaiter> left;
+    left.swap(async_waiters_);
+    for (std::map<uint64_t, AsyncWaiter>::iterator it = left.begin(); it != left.end(); ++it) {
+        leave_locked(it->second.session_key, it->first, false);
+    }
+    lock.unlock();
+    for (std::map<uint64_t, AsyncWaiter>::iterator it = left.begin(); it != left.end(); ++it) {
+        it->second.granted(-2, "Request cancelled");
+    }
+}
+
+uint64_t LlamaSlotDispatcher::enqueue_locked(const std::string& session_key) {
+    uint64_t ticket = next_ticket_++;
+    std::deque<uint64_t>& mine = waiting_[session_key];
+    if (mine.empty()) {
+        turn_.push_back(session_key);
+    }
+    mine.push_back(ticket);
+    ++queued_;
+    return ticket;
+}
+
+void LlamaSlotDispatcher::leave_locked(const std::string& session_key, uint64_t ticket, bool served) {
+    std::deque<uint64_t>& queue = waiting_[session_key];
+    queue.erase(std::find(queue.begin(), queue.end(), ticket));
+    --queued_;
+    std::deque<std::string>::iterator turn = std::find(turn_.begin(), turn_.end(), session_key);
+    if (queue.empty()) {
+        waiting_.erase(session_key);
+        turn_.erase(turn);
+    } else if (served) {
+        turn_.erase(turn);
+        turn_.push_back(session_key);
+    }
+}
+
+void LlamaSlotDispatcher::take_locked(const std::string& session_key, int slot, int64_t start_ms) {
+    Slot& s = slots_[slot];
+    s.busy = true;
+    s.last_used = ++clock_;
+    if (s.owner != session_key) {
+        // The new prompt overwrites the slot's cache
+        std::map<std::string, int>::iterator prev = session_slots_.find(s.owner);
+        if (prev != session_slots_.end() && prev->second == slot) {
+            session_slots_.erase(prev);
+        }
+        s.owner = session_key;
+        if (!session_key.empty()) {
+            session_slots_[session_key] = slot;
+        }
+    }
+    ++in_flight_;
+    int64_t waited = current_timestamp_ms() - start_ms;
+    if (waited > 0) {
+        LOG_DEBUG("[LlamaCpp] Session '%s' waited %lldms for slot %d", session_key.c_str(),
+                  static_cast<long long>(waited), slot);
+    }
+    wait_seconds_->observe(static_cast<double>(waited) / 1000.0);
+}
+
+void LlamaSlotDispatcher::release(int slot) {
+    if (slot < 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (static_cast<size_t>(slot) >= slots_.size() || !slots_[slot].busy) return;
+    slots_[slot].busy = false;
+    slots_[slot].released_ms = current_timestamp_ms();
+    --in_flight_;
+    cv_.notify_all();
+}
+
+int LlamaSlotDispatcher::pick_slot_locked(const std::string& session_key) const {
+    if (!session_key.empty()) {
+        std::map<std::string, int>::const_iterator own = session_slots_.find(session_key);
+        if (own != session_slots_.end() && !slots_[own->second].busy && !slots_[own->second].external) {
+            return own->second;
+        }
+    }
+    int best = -1;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (slots_[i].busy || slots_[i].external) continue;
+        if (best < 0 || slots_[i].last_used < slots_[best].last_used) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+void LlamaSlotDispatcher::discover() {
+    std::map<std::string, std::string> headers;
+    if (!api_key_.empty()) {
+        headers["Authorization"] = "Bearer " + api_key_;
+    }
+    HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+    http->set_timeout(POLL_TIMEOUT_MS);
+
+    size_t count = 0;
+    HttpResponse resp = http->get(server_url_ + "/slots", headers);
+    Json body = resp.ok() ? resp.json() : Json();
+    if (body.is_array()) {
+        count = body.size();
+    } else {
+        resp = http->get(server_url_ + "/props", headers);
+        body = resp.ok() ? resp.json() : Json();
+        if (body.is_object() && body.contains("total_slots") && body["total_slots"].is_number_integer()) {
+            count = body["total_slots"].get<size_t>();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count == 0) {
+        LOG_WARN("[LlamaCpp] Could not read the server's slot count (HTTP %d); requests are not queued, "
+                 "retrying in %llds", resp.status_code, static_cast<long long>(DISCOVER_RETRY_MS / 1000));
+        return;
+    }
+    if (slots_.empty()) {
+        slots_.assign(count, Slot());
+        LOG_INFO("[LlamaCpp] Server has %zu slots: at most %zu requests in flight, the rest queue per session",
+                 count, count);
+    }
+}
+
+void LlamaSlotDispatcher::maybe_poll() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t now = current_timestamp_ms();
+        if (poll_ms_ <= 0 || !slots_endpoint_ || slots_.empty() || polling_ ||
+            now - last_poll_ms_ < poll_ms_) {
+            return;
+        }
+        polling_ = true;
+        last_poll_ms_ = now;
+    }
+    poll();
+    std::lock_guard<std::mutex> lock(mutex_);
+    polling_ = false;
+}
+
+void LlamaSlotDispatcher::poll() {
+    int64_t started = current_timestamp_ms();
+    std::map<std::string, std::string> headers;
+    if (!api_key_.empty()) {
+        headers["Authorization"] = "Bearer " + api_key_;
+    }
+    HttpResponse resp;
+    {
+        HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+        http->set_timeout(POLL_TIMEOUT_MS);
+        resp = http->get(server_url_ + "/slots", headers);
+    }
+    Json body = resp.ok() ? resp.json() : Json();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!body.is_array()) {
+        if (resp.status_code != 0) {
+            // Started with --no-slots: nothing to learn from polling
+            LOG_INFO("[LlamaCpp] GET /slots answered HTTP %d, not polling slot state", resp.status_code);
+            slots_endpoint_ = false;
+        }
+        return;
+    }
+    bool freed = false;
+    for (size_t i = 0; i < body.size(); ++i) {
+        const Json& entry = body[i];
+        if (!entry.is_object() || !entry.contains("id") || !entry["id"].is_number_integer()) continue;
+        int id = entry["id"].get<int>();
+        if (id < 0 || static_cast<size_t>(id) >= slots_.size()) continue;
+        // Newer servers report is_processing, older ones state (0 = idle)
+        bool processing = entry.contains("is_processing") ? entry["is_processing"].is_boolean() &&
+                                                            entry["is_processing"].get<bool>()
+                                                          : entry.value("state", 0) != 0;
+        Slot& slot = slots_[id];
+        // Ours, or freed by us after the poll started: the answer is stale
+        if (slot.busy || slot.released_ms >= started) continue;
+        if (slot.external && !processing) freed = true;
+        slot.external = processing;
+    }
+    if (freed) {
+        cv_.notify_all();
+    }
+}
+
+int LlamaSlotDispatcher::slots() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(slots_.size());
+}
+
+size_t LlamaSlotDispatcher::in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+size_t LlamaSlotDispatcher::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+} // namespace opencrank
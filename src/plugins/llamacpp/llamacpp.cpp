@@ -1,15 +1,40 @@
 #include <opencrank/plugins/llamacpp/llamacpp.hpp>
 #include <opencrank/core/loader.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/json_stream.hpp>
+#include <opencrank/core/async_http.hpp>
+#include <opencrank/core/metrics.hpp>
+#include <opencrank/ai/sse.hpp>
 #include <sstream>
+#include <algorithm>
+#include <memory>
 
 namespace opencrank {
 
+namespace {
+
+// Hands the dispatcher's slot back however chat() returns
+class SlotGuard {
+public:
+    SlotGuard(LlamaSlotDispatcher& dispatcher, int slot) : dispatcher_(dispatcher), slot_(slot) {}
+    ~SlotGuard() { dispatcher_.release(slot_); }
+
+private:
+    SlotGuard(const SlotGuard&);
+    SlotGuard& operator=(const SlotGuard&);
+
+    LlamaSlotDispatcher& dispatcher_;
+    int slot_;
+};
+
+} // anonymous namespace
+
 LlamaCppAI::LlamaCppAI()
     : server_url_("http://localhost:8080")
     , api_key_()
     , default_model_("local-model")
-    , max_context_chars_(16000)  // Conservative default: ~4K tokens * 4 chars/token
+    , max_context_tokens_(4096)
+    , native_tools_(false)
     , initialized_(false)
 {}
 
@@ -28,36 +53,59 @@ bool LlamaCppAI::init(const Config& cfg) {
         default_model_ = model;
     }
     
-    // Context size configuration (in tokens — we multiply by 4 for char estimate)
+    native_tools_ = cfg.get_bool("llamacpp.native_tools", false);
+    
+    // Context size configuration (in tokens)
     int context_tokens = static_cast<int>(cfg.get_int("llamacpp.context_size", 4096));
-    max_context_chars_ = static_cast<size_t>(context_tokens) * 4;
+    max_context_tokens_ = static_cast<size_t>(context_tokens);
     
     // Remove trailing slash from URL
     while (!server_url_.empty() && server_url_[server_url_.length() - 1] == '/') {
         server_url_ = server_url_.substr(0, server_url_.length() - 1);
     }
     
-    LOG_INFO("Llama.cpp AI initialized with server: %s, model: %s, context: %d tokens (~%zu chars)", 
-             server_url_.c_str(), default_model_.c_str(), context_tokens, max_context_chars_);
+    LOG_INFO("Llama.cpp AI initialized with server: %s, model: %s, context: %d tokens", 
+             server_url_.c_str(), default_model_.c_str(), context_tokens);
     
     // Configure the context manager for intelligent context window management
     ContextManagerConfig ctx_config;
-    ctx_config.max_context_chars = max_context_chars_;
-    ctx_config.reserve_for_response = max_context_chars_ / 4;  // Reserve 25% for response
+    ctx_config.max_context_tokens = max_context_tokens_;
+    ctx_config.reserve_for_response = max_context_tokens_ / 4;  // Reserve 25% for response
     ctx_config.usage_threshold = 0.75;  // Trigger resume at 75%
     ctx_config.max_resume_chars = 3000;
     ctx_config.auto_save_memory = true;
+    ctx_config.background_summary = cfg.get_bool("llamacpp.background_summary", true);
+    ctx_config.summary_window = static_cast<size_t>(std::max<int64_t>(1, cfg.get_int("llamacpp.summary_window", 8)));
     context_manager_.set_config(ctx_config);
-    
-    LOG_INFO("Context manager configured: max %zu chars, reserve %zu chars, threshold %.0f%%, auto-save %s",
-             ctx_config.max_context_chars, ctx_config.reserve_for_response, 
-             ctx_config.usage_threshold * 100.0, ctx_config.auto_save_memory ? "enabled" : "disabled");
+    context_manager_.set_token_counter(
+        create_token_counter(cfg, "llamacpp", "server", server_url_, api_key_));
+    
+    LOG_INFO("Context manager configured: max %zu tokens, reserve %zu tokens, threshold %.0f%%, tokenizer %s, auto-save %s",
+             ctx_config.max_context_tokens, ctx_config.reserve_for_response, 
+             ctx_config.usage_threshold * 100.0, context_manager_.token_counter().name(),
+             ctx_config.auto_save_memory ? "enabled" : "disabled");
+    
+    int slots = static_cast<int>(cfg.get_int("llamacpp.slots", 0));
+    dispatcher_.configure(server_url_, api_key_, slots,
+                          cfg.get_int("llamacpp.slots_poll_ms", 1000),
+                          cfg.get_int("llamacpp.queue_timeout_ms", 120000));
+    if (slots > 0) {
+        LOG_INFO("[LlamaCpp] %d server slots: one request per slot in flight, sessions keep their slot", slots);
+    }
+    Metrics::instance().add_collector("llamacpp", [this](MetricsWriter& w) {
+        w.gauge("opencrank_llamacpp_slots", "llama.cpp server slots", dispatcher_.slots());
+        w.gauge("opencrank_llamacpp_in_flight", "llama.cpp requests on a server slot",
+                static_cast<double>(dispatcher_.in_flight()));
+        w.gauge("opencrank_llamacpp_queued", "llama.cpp requests waiting for a slot",
+                static_cast<double>(dispatcher_.queued()));
+    });
     
     initialized_ = true;
     return true;
 }
 
 void LlamaCppAI::shutdown() {
+    Metrics::instance().remove_collector("llamacpp");
     initialized_ = false;
 }
 
@@ -75,6 +123,10 @@ std::string LlamaCppAI::default_model() const { return default_model_; }
 
 bool LlamaCppAI::is_configured() const { return initialized_; }
 
+bool LlamaCppAI::supports_native_tools() const { return native_tools_; }
+
+void LlamaCppAI::set_thread_pool(ThreadPool* pool) { context_manager_.set_thread_pool(pool); }
+
 CompletionResult LlamaCppAI::complete(
     const std::string& prompt,
     const CompletionOptions& opts
@@ -87,51 +139,61 @@ CompletionResult LlamaCppAI::complete(
     return chat(messages, opts);
 }
 
-CompletionResult LlamaCppAI::chat(
+bool LlamaCppAI::build_chat_request(
     const std::vector<ConversationMessage>& messages,
-    const CompletionOptions& opts
+    const CompletionOptions& opts,
+    std::string& request_body,
+    std::string& error
 ) {
     if (!initialized_) {
-        return CompletionResult::fail("Llama.cpp AI not initialized");
+        error = "Llama.cpp AI not initialized";
+        return false;
     }
     
     if (messages.empty()) {
-        return CompletionResult::fail("No messages provided");
+        error = "No messages provided";
+        return false;
     }
     
     LOG_DEBUG("[LlamaCpp] Starting chat request with %zu messages", messages.size());
     
     // Manage context window intelligently (resume-based strategy)
     // Skip if disabled for internal operations like resume generation
-    std::vector<ConversationMessage> trimmed_messages;
+    // Points at the caller's history unless context management rewrote it
+    std::vector<ConversationMessage> managed_storage;
+    const std::vector<ConversationMessage>* managed = &messages;
     if (!opts.skip_context_management) {
         LOG_DEBUG("[LlamaCpp] Checking context management for %zu messages", messages.size());
-        trimmed_messages = manage_context(messages, opts.system_prompt);
-        if (trimmed_messages.size() != messages.size()) {
+        managed = &manage_context(messages, opts.system_prompt, opts.session_key, managed_storage);
+        if (managed->size() != messages.size()) {
             LOG_INFO("[LlamaCpp] Context managed: %zu -> %zu messages",
-                     messages.size(), trimmed_messages.size());
+                     messages.size(), managed->size());
         }
     } else {
         LOG_DEBUG("[LlamaCpp] Skipping context management (skip_context_management=true)");
-        trimmed_messages = messages;
     }
+    const std::vector<ConversationMessage>& trimmed_messages = *managed;
     
-    // Build OpenAI-compatible request
-    Json request = Json::object();
+    // Build OpenAI-compatible request, written straight from the history
+    // (no DOM of the conversation)
+    JsonWriter request(request_body);
+    request.begin_object();
     
     std::string model = opts.model.empty() ? default_model_ : opts.model;
-    request["model"] = model;
+    request.field("model", model);
     LOG_DEBUG("[LlamaCpp] Using model: %s", model.c_str());
     
     // Convert messages to OpenAI format
-    Json msgs = Json::array();
+    size_t sent = 0;
+    request.key("messages").begin_array();
     
     // Prepend system message if system prompt is provided
     if (!opts.system_prompt.empty()) {
-        Json sys_msg = Json::object();
-        sys_msg["role"] = "system";
-        sys_msg["content"] = sanitize_utf8(opts.system_prompt);
-        msgs.push_back(sys_msg);
+        request.begin_object();
+        request.field("role", "system");
+        request.field("content", opts.system_prompt);
+        request.end_object();
+        ++sent;
     }
     
     LOG_DEBUG("[LlamaCpp] === ▶ IN  Messages being sent to AI ===");
@@ -140,12 +202,13 @@ CompletionResult LlamaCppAI::chat(
     for (size_t i = 0; i < trimmed_messages.size(); ++i) {
         const ConversationMessage& msg = trimmed_messages[i];
         
-        Json m = Json::object();
-        m["role"] = role_to_string(msg.role);
-        m["content"] = sanitize_utf8(msg.content);
-        msgs.push_back(m);
-        
+        request.begin_object();
+        request.field("role", role_to_string(msg.role));
+        request.field("content", msg.content);
+        request.end_object();
+        ++sent;
     }
+    request.end_array();
 
     const ConversationMessage& last_msg = trimmed_messages.back();
 
@@ -154,38 +217,156 @@ CompletionResult LlamaCppAI::chat(
                 last_msg.content.size(), last_msg.content.c_str(),
                 last_msg.content.size() > 300 ? "..." : "");
 
-    request["messages"] = msgs;
-    LOG_DEBUG("[LlamaCpp] === ▶ IN  End of messages (%zu total) ===", msgs.size());
+    LOG_DEBUG("[LlamaCpp] === ▶ IN  End of messages (%zu total) ===", sent);
     
     // Set parameters
     if (opts.temperature >= 0.0) {
-        request["temperature"] = opts.temperature;
+        request.field("temperature", opts.temperature);
     }
     
     if (opts.max_tokens > 0) {
-        request["max_tokens"] = static_cast<int64_t>(opts.max_tokens);
+        request.field("max_tokens", opts.max_tokens);
     }
     
-    if (opts.stream) {
-        request["stream"] = false;  // For now, disable streaming
+    // Honoured by llama-server started with --jinja
+    if (native_tools_) {
+        write_openai_tools(request, opts.tools);
     }
     
-    std::string endpoint = server_url_ + "/v1/chat/completions";
-    std::string request_body = request.dump(-1, ' ', false, Json::error_handler_t::replace);
-    LOG_DEBUG("[LlamaCpp] ▶ IN  Sending request to %s (%zu bytes)", endpoint.c_str(), request_body.size());
+    // Only the suffix past the longest cached prefix gets evaluated. History
+    // is append-only between iterations, so that prefix is usually everything
+    // except the newest messages - as long as the session stays on its slot.
+    request.field("cache_prompt", true);
     
-    // Prepare HTTP client
-    HttpClient http;
+    // Stream only when someone consumes the chunks
+    bool streaming = opts.stream && opts.on_chunk;
+    if (streaming) {
+        request.field("stream", true);
+        request.key("stream_options").begin_object().field("include_usage", true).end_object();
+    }
+    request.end_object();
+    return true;
+}
+
+void LlamaCppAI::add_slot(std::string& request_body, int slot) {
+    // The slot is only known once the request leaves the queue, after the
+    // body was written: add the member before its closing brace
+    if (slot >= 0 && !request_body.empty() && request_body[request_body.size() - 1] == '}') {
+        request_body.insert(request_body.size() - 1, ",\"id_slot\":" + std::to_string(slot));
+    }
+}
+
+std::map<std::string, std::string> LlamaCppAI::request_headers() const {
     std::map<std::string, std::string> headers;
     headers["Content-Type"] = "application/json";
     
     if (!api_key_.empty()) {
         headers["Authorization"] = "Bearer " + api_key_;
     }
+    return headers;
+}
+
+CompletionResult LlamaCppAI::chat(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts
+) {
+    // Written into a reused buffer
+    std::string& request_body = JsonWriter::thread_buffer();
+    std::string error;
+    if (!build_chat_request(messages, opts, request_body, error)) {
+        return CompletionResult::fail(error);
+    }
+    
+    std::string queue_error;
+    int slot = dispatcher_.acquire(opts.session_key, opts.cancel, queue_error);
+    if (slot == -2) {
+        LOG_WARN("[LlamaCpp] %s", queue_error.c_str());
+        return CompletionResult::fail(queue_error);
+    }
+    SlotGuard slot_guard(dispatcher_, slot);
+    add_slot(request_body, slot);
+    
+    std::string endpoint = server_url_ + "/v1/chat/completions";
+    LOG_DEBUG("[LlamaCpp] ▶ IN  Sending request to %s (%zu bytes)", endpoint.c_str(), request_body.size());
+    
+    // Borrow a pooled HTTP client (keeps the connection warm)
+    HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+    http->set_cancel(opts.cancel);
     
     // Make request to llama.cpp server
-    HttpResponse response = http.post_json(endpoint, request_body, headers);
+    bool streaming = opts.stream && opts.on_chunk;
+    OpenAIStreamAccumulator stream(opts.on_chunk);
+    HttpResponse response;
+    if (streaming) {
+        response = http->post_json_stream(endpoint, request_body, request_headers(),
+            [&stream](const char* data, size_t len) { return stream.feed(data, len); });
+    } else {
+        response = http->post_json(endpoint, request_body, request_headers());
+    }
+    return parse_chat_response(response, streaming, stream, slot);
+}
+
+void LlamaCppAI::chat_async(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts,
+    const CompletionCallback& done
+) {
+    if (!AsyncHttp::instance().running()) {
+        AIPlugin::chat_async(messages, opts, done);
+        return;
+    }
+    
+    std::shared_ptr<AsyncHttpRequest> request = std::make_shared<AsyncHttpRequest>();
+    std::string error;
+    if (!build_chat_request(messages, opts, request->body, error)) {
+        CompletionResult result = CompletionResult::fail(error);
+        done(result);
+        return;
+    }
+    request->url = server_url_ + "/v1/chat/completions";
+    request->headers = request_headers();
+    request->cancel = opts.cancel;
+    
+    bool streaming = opts.stream && opts.on_chunk;
+    std::shared_ptr<OpenAIStreamAccumulator> stream = std::make_shared<OpenAIStreamAccumulator>(opts.on_chunk);
+    if (streaming) {
+        request->on_data = [stream](const char* data, size_t len) { return stream->feed(data, len); };
+    }
     
+    // Queued requests wait in the dispatcher, not on a thread of their own
+    dispatcher_.acquire_async(opts.session_key, opts.cancel,
+        [this, request, streaming, stream, done](int slot, const std::string& queue_error) {
+            if (slot == -2) {
+                LOG_WARN("[LlamaCpp] %s", queue_error.c_str());
+                CompletionResult result = CompletionResult::fail(queue_error);
+                done(result);
+                return;
+            }
+            add_slot(request->body, slot);
+            LOG_DEBUG("[LlamaCpp] ▶ IN  Sending request to %s (%zu bytes, async)", request->url.c_str(),
+                      request->body.size());
+            bool submitted = AsyncHttp::instance().submit(std::move(*request),
+                [this, slot, streaming, stream, done](HttpResponse& response) {
+                    dispatcher_.release(slot);
+                    CompletionResult result = parse_chat_response(response, streaming, *stream, slot);
+                    done(result);
+                });
+            if (!submitted) {
+                dispatcher_.release(slot);
+                CompletionResult result = CompletionResult::fail("HTTP request failed: shutting down");
+                done(result);
+            }
+        });
+}
+
+bool LlamaCppAI::supports_async() const { return AsyncHttp::instance().running(); }
+
+CompletionResult LlamaCppAI::parse_chat_response(
+    const HttpResponse& response,
+    bool streaming,
+    const OpenAIStreamAccumulator& stream,
+    int slot
+) {
     if (response.status_code == 0) {
         LOG_ERROR("[LlamaCpp] HTTP request failed: %s", response.error.c_str());
         return CompletionResult::fail("HTTP request failed: " + response.error);
@@ -194,16 +375,25 @@ CompletionResult LlamaCppAI::chat(
     LOG_DEBUG("[LlamaCpp] ◀ OUT Received response [HTTP %d] (%zu bytes)", 
               response.status_code, response.body.size());
     
-    std::string sanitized_body = sanitize_utf8(response.body);
     Json resp;
-    try {
-        resp = Json::parse(sanitized_body);
-    } catch (const std::exception& e) {
-        LOG_ERROR("[LlamaCpp] Failed to parse JSON response: %s", e.what());
-        return CompletionResult::fail("Invalid JSON response: " + std::string(e.what()));
+    if (streaming && response.status_code == 200) {
+        // Rebuild a regular completion from the streamed deltas
+        resp = stream.to_response();
+    } else {
+        // The body is already UTF-8 clean (HttpClient sanitizes it). Only the
+        // members read below are materialised; echoed prompts and
+        // generation settings are skipped by the SAX pass.
+        static const std::vector<std::string> response_fields = {
+            "choices", "error", "model", "timings", "usage"
+        };
+        resp = parse_json_fields(response.body, response_fields);
+        if (resp.is_discarded()) {
+            LOG_ERROR("[LlamaCpp] Failed to parse JSON response (%zu bytes)", response.body.size());
+            return CompletionResult::fail("Invalid JSON response");
+        }
     }
     
-    if (response.status_code != 200) {
+    if (response.status_code != 200 || resp.contains("error")) {
         std::string error_msg = "API error";
         if (resp.is_object()) {
             if (resp.contains("error") && resp["error"].is_object()) {
@@ -238,7 +428,10 @@ CompletionResult LlamaCppAI::chat(
         
         if (first_choice.contains("message") && first_choice["message"].is_object()) {
             const Json& message = first_choice["message"];
-            result.content = message.value("content", std::string(""));
+            // content is null when the reply is only tool calls
+            if (message.contains("content") && message["content"].is_string()) {
+                result.content = message["content"].get<std::string>();
+            }
             
             // Check for reasoning_content (some models put thinking here)
             std::string reasoning;
@@ -247,55 +440,12 @@ CompletionResult LlamaCppAI::chat(
                 LOG_DEBUG("[LlamaCpp] Found reasoning_content (%zu chars)", reasoning.size());
             }
             
-            // Check for native OpenAI-style tool_calls in the response
-            // This is the standard format: message.tool_calls = [{id, type, function: {name, arguments}}]
-            if (message.contains("tool_calls") && message["tool_calls"].is_array() && 
-                !message["tool_calls"].empty()) {
-                
-                const Json& tool_calls = message["tool_calls"];
-                LOG_INFO("[LlamaCpp] Found %zu native tool_call(s) in response", tool_calls.size());
-                
-                std::ostringstream reconstructed;
-                
-                // Include any text content or reasoning as preamble
-                if (!result.content.empty()) {
-                    reconstructed << result.content << "\n\n";
-                } else if (!reasoning.empty()) {
-                    // Don't include raw reasoning as it confuses the agent
-                    LOG_DEBUG("[LlamaCpp] Skipping reasoning_content preamble for native tool calls");
-                }
-                
-                for (size_t tc = 0; tc < tool_calls.size(); ++tc) {
-                    const Json& tc_obj = tool_calls[tc];
-                    
-                    if (!tc_obj.contains("function") || !tc_obj["function"].is_object()) {
-                        LOG_WARN("[LlamaCpp] tool_call[%zu] missing 'function' object, skipping", tc);
-                        continue;
-                    }
-                    
-                    const Json& func = tc_obj["function"];
-                    std::string tool_name = func.value("name", std::string(""));
-                    std::string arguments = func.value("arguments", std::string("{}"));
-                    
-                    if (tool_name.empty()) {
-                        LOG_WARN("[LlamaCpp] tool_call[%zu] has empty function name, skipping", tc);
-                        continue;
-                    }
-                    
-                    LOG_INFO("[LlamaCpp] Native tool_call[%zu]: %s", tc, tool_name.c_str());
-                    LOG_DEBUG("[LlamaCpp] Native tool_call[%zu] arguments: %s", tc, arguments.c_str());
-                    
-                    // Reconstruct as JSON tool call format for the agent to parse
-                    if (tc > 0) {
-                        reconstructed << "\n\n";
-                    }
-                    reconstructed << "{\"tool\": \"" << tool_name << "\", ";
-                    reconstructed << "\"arguments\": " << arguments << "}";
-                }
-                
-                result.content = reconstructed.str();
-                LOG_INFO("[LlamaCpp] Reconstructed %zu native tool call(s) into JSON format",
-                         tool_calls.size());
+            // Native OpenAI-style tool_calls (message.tool_calls = [{id, type,
+            // function: {name, arguments}}]); the text protocol's form goes into
+            // content. Reasoning is never used as preamble, it confuses the agent.
+            size_t native_calls = read_openai_tool_calls(message, result);
+            if (native_calls > 0) {
+                LOG_INFO("[LlamaCpp] %zu native tool call(s) in response", native_calls);
                 LOG_DEBUG("[LlamaCpp] Reconstructed content: %.500s%s", result.content.c_str(),
                           result.content.size() > 500 ? "..." : "");
             }
@@ -377,6 +527,26 @@ CompletionResult LlamaCppAI::chat(
         result.usage.input_tokens = usage.value("prompt_tokens", 0);
         result.usage.output_tokens = usage.value("completion_tokens", 0);
         result.usage.total_tokens = usage.value("total_tokens", 0);
+        if (usage.contains("prompt_tokens_details") && usage["prompt_tokens_details"].is_object()) {
+            result.usage.cached_tokens = usage["prompt_tokens_details"].value("cached_tokens", 0);
+        }
+    }
+    
+    // llama.cpp timings: cache_n tokens reused, prompt_n tokens evaluated
+    if (resp.contains("timings") && resp["timings"].is_object()) {
+        const Json& timings = resp["timings"];
+        int cache_n = timings.value("cache_n", -1);
+        int prompt_n = timings.value("prompt_n", -1);
+        if (cache_n >= 0) {
+            result.usage.cached_tokens = cache_n;
+            if (prompt_n >= 0 && result.usage.input_tokens < cache_n + prompt_n) {
+                result.usage.input_tokens = cache_n + prompt_n;
+            }
+        }
+    }
+    if (result.usage.input_tokens > 0) {
+        LOG_DEBUG("[LlamaCpp] ◀ OUT Prompt cache: %d/%d tokens reused (slot %d)",
+                  result.usage.cached_tokens, result.usage.input_tokens, slot);
     }
     
     LOG_DEBUG("[LlamaCpp] === ◀ OUT AI Response ===");
@@ -391,21 +561,11 @@ CompletionResult LlamaCppAI::chat(
     return result;
 }
 
-size_t LlamaCppAI::estimate_request_chars(
-    const std::vector<ConversationMessage>& messages,
-    const std::string& system_prompt) const
-{
-    size_t total = system_prompt.size();
-    for (size_t i = 0; i < messages.size(); ++i) {
-        total += messages[i].content.size();
-        total += 20; // Role tags, formatting overhead per message
-    }
-    return total;
-}
-
-std::vector<ConversationMessage> LlamaCppAI::manage_context(
+const std::vector<ConversationMessage>& LlamaCppAI::manage_context(
     const std::vector<ConversationMessage>& messages,
-    const std::string& system_prompt)
+    const std::string& system_prompt,
+    const std::string& session_key,
+    std::vector<ConversationMessage>& storage)
 {
     if (messages.empty()) {
         return messages;
@@ -413,78 +573,86 @@ std::vector<ConversationMessage> LlamaCppAI::manage_context(
     
     // Debug: Log current context usage
     ContextUsage usage = context_manager_.estimate_usage(messages, system_prompt);
-    LOG_INFO("[LlamaCpp] Context usage: %.1f%% (%zu/%zu chars, %zu messages)",
-             usage.usage_ratio * 100.0, usage.total_chars, usage.budget_chars, messages.size());
+    LOG_INFO("[LlamaCpp] Context usage: %.1f%% (%zu/%zu tokens, %zu messages)",
+             usage.usage_ratio * 100.0, usage.total_tokens, usage.budget_tokens, messages.size());
+    
+    // Keep the session's resume current in the background
+    context_manager_.prepare_summary(this, messages, usage, session_key);
     
     // Check if we need a resume cycle
-    if (context_manager_.needs_resume(messages, system_prompt)) {
-        ContextUsage resume_usage = context_manager_.estimate_usage(messages, system_prompt);
-        LOG_WARN("[LlamaCpp] Context at %.0f%% capacity (%zu/%zu chars), initiating resume cycle",
-                 resume_usage.usage_ratio * 100.0, resume_usage.total_chars, resume_usage.budget_chars);
+    if (usage.needs_resume) {
+        LOG_WARN("[LlamaCpp] Context at %.0f%% capacity (%zu/%zu tokens), initiating resume cycle",
+                 usage.usage_ratio * 100.0, usage.total_tokens, usage.budget_tokens);
         
-        // Perform the resume cycle: generate summary, save memory, wipe, reload
-        std::vector<ConversationMessage> history_copy = messages;
+        // Perform the resume cycle: pre-built or fresh summary, save memory, wipe, reload
+        storage = messages;
         bool ok = context_manager_.perform_resume_cycle(
-            this, history_copy, system_prompt);
+            this, storage, system_prompt, session_key);
         
         if (ok) {
             LOG_INFO("[LlamaCpp] Resume cycle complete: %zu -> %zu messages",
-                     messages.size(), history_copy.size());
-            return history_copy;
+                     messages.size(), storage.size());
+            return storage;
         }
         
         LOG_WARN("[LlamaCpp] Resume cycle failed, falling back to simple truncation");
     }
     
     // If context fits or resume failed, check if simple truncation is needed
-    size_t total_chars = estimate_request_chars(messages, system_prompt);
-    size_t budget = max_context_chars_ * 3 / 4;
+    size_t total_tokens = context_manager_.count_tokens(messages, system_prompt);
+    size_t budget = max_context_tokens_ * 3 / 4;
     
-    if (total_chars <= budget) {
+    if (total_tokens <= budget) {
         return messages; // Fits fine
     }
     
     // Fallback: truncate large individual messages
-    LOG_WARN("[LlamaCpp] Fallback truncation: %zu chars > %zu budget", total_chars, budget);
+    LOG_WARN("[LlamaCpp] Fallback truncation: %zu tokens > %zu budget", total_tokens, budget);
     
-    std::vector<ConversationMessage> trimmed = messages;
+    storage = messages;
+    std::vector<ConversationMessage>& trimmed = storage;
     const size_t max_single_msg = budget / 4;
     
     for (size_t i = 0; i < trimmed.size(); ++i) {
-        if (trimmed[i].content.size() > max_single_msg) {
+        size_t msg_tokens = context_manager_.count_tokens(trimmed[i]);
+        if (msg_tokens > max_single_msg) {
+            // Keep the same share of bytes as of tokens
+            size_t keep = trimmed[i].content.size() * max_single_msg / msg_tokens;
             if (trimmed[i].content.find("[TOOL_RESULT") != std::string::npos) {
-                trimmed[i].content = trimmed[i].content.substr(0, max_single_msg)
+                trimmed[i].content = truncate_safe(trimmed[i].content, keep)
                     + "\n... [content truncated to fit context window] ...";
             } else {
-                trimmed[i].content = trimmed[i].content.substr(0, max_single_msg)
+                trimmed[i].content = truncate_safe(trimmed[i].content, keep)
                     + "\n... [truncated] ...";
             }
         }
     }
     
-    total_chars = estimate_request_chars(trimmed, system_prompt);
-    if (total_chars <= budget) {
+    total_tokens = context_manager_.count_tokens(trimmed, system_prompt);
+    if (total_tokens <= budget) {
         return trimmed;
     }
     
     // Last resort: drop middle messages
+    // (kept messages are moved out of trimmed, not copied)
     std::vector<ConversationMessage> result;
-    result.push_back(trimmed[0]);
+    bool bridge = trimmed[0].role == MessageRole::USER;
+    result.push_back(std::move(trimmed[0]));
     
-    if (trimmed[0].role == MessageRole::USER) {
+    if (bridge) {
         result.push_back(ConversationMessage::assistant(
             "[Earlier conversation truncated to fit context window.]"
         ));
     }
     
-    std::vector<ConversationMessage> tail;
-    size_t used = estimate_request_chars(result, system_prompt);
+    std::vector<size_t> tail;
+    size_t used = context_manager_.count_tokens(result, system_prompt);
     
     for (size_t i = trimmed.size(); i > 1; --i) {
         size_t idx = i - 1;
-        size_t msg_cost = trimmed[idx].content.size() + 20;
+        size_t msg_cost = context_manager_.count_tokens(trimmed[idx]);
         if (used + msg_cost <= budget) {
-            tail.push_back(trimmed[idx]);
+            tail.push_back(idx);
             used += msg_cost;
         } else {
             break;
@@ -492,16 +660,18 @@ std::vector<ConversationMessage> LlamaCppAI::manage_context(
     }
     
     for (size_t i = tail.size(); i > 0; --i) {
-        if (!result.empty() && result.back().role == tail[i - 1].role) {
+        ConversationMessage& msg = trimmed[tail[i - 1]];
+        if (!result.empty() && result.back().role == msg.role) {
             continue;
         }
-        result.push_back(tail[i - 1]);
+        result.push_back(std::move(msg));
     }
     
     LOG_INFO("[LlamaCpp] Fallback trimmed from %zu to %zu messages",
              messages.size(), result.size());
     
-    return result;
+    storage.swap(result);
+    return storage;
 }
 
 std::string LlamaCppAI::ask(const std::string& question, const std::string& system) {
@@ -0,0 +1,295 @@
+#include <opencrank/plugins/loadgen/loadgen.hpp>
+#include <opencrank/core/loader.hpp>
+#include <opencrank/core/json.hpp>
+#include <opencrank/core/utils.hpp>
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <sys/resource.h>
+
+namespace opencrank {
+
+namespace {
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size()) + 0.5);
+    if (rank > 0) --rank;
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+const char* const kPrompts[] = {
+    "What did we decide about the release schedule?",
+    "Can you check my notes for anything about the database migration?",
+    "Please save a note that the load test ran today.",
+    "Give me a longer explanation of how the caching works.",
+    "Summarize the open tasks for this week.",
+    NULL
+};
+
+} // anonymous namespace
+
+LoadGenChannel::LoadGenChannel()
+    : conversations_(100)
+    , turns_(5)
+    , think_ms_(1000)
+    , ramp_ms_(5000)
+    , timeout_ms_(120000)
+    , chat_type_("group")
+    , report_path_("loadgen_report.json")
+    , exit_when_done_(true)
+    , status_(ChannelStatus::STOPPED)
+    , reactor_(NULL)
+    , tick_timer_(0)
+    , sent_(0)
+    , errors_(0)
+    , timeouts_(0)
+    , finished_(0)
+    , started_us_(0)
+    , last_check_ms_(0)
+    , reported_(false) {}
+
+const char* LoadGenChannel::name() const { return "loadgen"; }
+const char* LoadGenChannel::version() const { return "1.0.0"; }
+const char* LoadGenChannel::description() const { return "Synthetic conversations for load testing"; }
+const char* LoadGenChannel::channel_id() const { return "loadgen"; }
+
+ChannelCapabilities LoadGenChannel::capabilities() const {
+    // No edits: replies arrive whole, so one send_message ends a turn
+    return ChannelCapabilities();
+}
+
+bool LoadGenChannel::init(const Config& cfg) {
+    conversations_ = std::max(1, static_cast<int>(cfg.get_int("loadgen.conversations", 100)));
+    turns_ = std::max(1, static_cast<int>(cfg.get_int("loadgen.turns", 5)));
+    think_ms_ = std::max(0, static_cast<int>(cfg.get_int("loadgen.think_ms", 1000)));
+    ramp_ms_ = std::max(0, static_cast<int>(cfg.get_int("loadgen.ramp_ms", 5000)));
+    timeout_ms_ = std::max(1000, static_cast<int>(cfg.get_int("loadgen.timeout_ms", 120000)));
+    chat_type_ = cfg.get_string("loadgen.chat_type", "group");
+    report_path_ = cfg.get_string("loadgen.report", "loadgen_report.json");
+    exit_when_done_ = cfg.get_bool("loadgen.exit_when_done", true);
+
+    LOG_INFO("[LoadGen] %d conversation(s) x %d turn(s), think %dms, ramp %dms",
+             conversations_, turns_, think_ms_, ramp_ms_);
+    initialized_ = true;
+    return true;
+}
+
+void LoadGenChannel::shutdown() {
+    // Interrupted runs still leave a (partial) report behind
+    report(true);
+    stop();
+    initialized_ = false;
+}
+
+bool LoadGenChannel::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_ = ChannelStatus::RUNNING;
+
+    // Distinct ids per run, so the deduplicator never sees a repeat
+    run_id_ = "lg" + std::to_string(current_timestamp_ms());
+    started_us_ = steady_us();
+    int64_t now_ms = started_us_ / 1000;
+
+    convs_.clear();
+    by_chat_.clear();
+    latencies_ms_.clear();
+    latencies_ms_.reserve(static_cast<size_t>(conversations_) * static_cast<size_t>(turns_));
+    due_ = DueQueue();
+    for (int i = 0; i < conversations_; ++i) {
+        Conversation conv;
+        conv.chat_id = run_id_ + "-user" + std::to_string(i);
+        conv.turn = 0;
+        conv.waiting = false;
+        conv.sent_us = 0;
+        by_chat_[conv.chat_id] = convs_.size();
+        convs_.push_back(conv);
+        due_.push(Due(now_ms + static_cast<int64_t>(ramp_ms_) * i / conversations_, static_cast<size_t>(i)));
+    }
+    sent_ = errors_ = timeouts_ = 0;
+    finished_ = 0;
+    reported_ = false;
+
+    LOG_INFO("[LoadGen] Started run %s", run_id_.c_str());
+    return true;
+}
+
+bool LoadGenChannel::stop() {
+    if (reactor_ && tick_timer_) {
+        reactor_->cancel_timer(tick_timer_);
+        tick_timer_ = 0;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_ = ChannelStatus::STOPPED;
+    return true;
+}
+
+ChannelStatus LoadGenChannel::status() const {
+    return status_;
+}
+
+bool LoadGenChannel::attach_reactor(Reactor& reactor) {
+    reactor_ = &reactor;
+    tick_timer_ = reactor.add_timer(10, [this]() { tick(); }, true);
+    return true;
+}
+
+void LoadGenChannel::poll() {
+    // Only reached without a reactor
+    tick();
+}
+
+void LoadGenChannel::tick() {
+    std::vector<size_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (status_ != ChannelStatus::RUNNING) return;
+
+        int64_t now_ms = steady_us() / 1000;
+        while (!due_.empty() && due_.top().first <= now_ms) {
+            ready.push_back(due_.top().second);
+            due_.pop();
+        }
+
+        // Expire turns the pipeline lost (rate limited, dropped, hung)
+        if (now_ms - last_check_ms_ >= 500) {
+            last_check_ms_ = now_ms;
+            int64_t cutoff_us = steady_us() - static_cast<int64_t>(timeout_ms_) * 1000;
+            for (size_t i = 0; i < convs_.size(); ++i) {
+                if (convs_[i].waiting && convs_[i].sent_us < cutoff_us) {
+                    ++timeouts_;
+                    end_turn_locked(convs_[i], i, now_ms);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < ready.size(); ++i) {
+        send_turn(ready[i]);
+    }
+    report(false);
+}
+
+void LoadGenChannel::send_turn(size_t index) {
+    Message msg;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Conversation& conv = convs_[index];
+        msg.id = conv.chat_id + "-" + std::to_string(conv.turn);
+        msg.from = conv.chat_id;
+        msg.to = conv.chat_id;
+        msg.from_name = "Load user " + std::to_string(index);
+
+        size_t prompt_count = sizeof(kPrompts) / sizeof(kPrompts[0]) - 1;
+        msg.text = kPrompts[(index + static_cast<size_t>(conv.turn)) % prompt_count];
+
+        conv.turn++;
+        conv.waiting = true;
+        conv.sent_us = steady_us();
+        ++sent_;
+    }
+    msg.channel = channel_id();
+    msg.chat_type = chat_type_;
+    msg.timestamp = current_timestamp();
+    emit_message(msg);
+}
+
+SendResult LoadGenChannel::send_message(const std::string& to, const std::string& text) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, size_t>::iterator it = by_chat_.find(to);
+        if (it == by_chat_.end()) {
+            // Another channel's traffic (replies go to every channel)
+            return SendResult::ok("");
+        }
+
+        Conversation& conv = convs_[it->second];
+        if (conv.waiting) {
+            latencies_ms_.push_back(static_cast<double>(steady_us() - conv.sent_us) / 1000.0);
+            if (text.compare(0, 3, "\xe2\x9d\x8c") == 0) {   // ❌ error replies
+                ++errors_;
+            }
+            end_turn_locked(conv, it->second, steady_us() / 1000);
+        }
+    }
+    report(false);
+    return SendResult::ok(to + "-" + std::to_string(current_timestamp_ms()));
+}
+
+void LoadGenChannel::end_turn_locked(Conversation& conv, size_t index, int64_t now_ms) {
+    conv.waiting = false;
+    if (conv.turn >= turns_) {
+        ++finished_;
+    } else {
+        due_.push(Due(now_ms + think_ms_, index));
+    }
+}
+
+void LoadGenChannel::report(bool partial) {
+    Json out;
+    bool done = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done = finished_ >= convs_.size();
+        if (reported_ || convs_.empty() || (!done && !partial)) return;
+        reported_ = true;
+
+        double seconds = static_cast<double>(steady_us() - started_us_) / 1e6;
+        std::vector<double> sorted(latencies_ms_);
+        std::sort(sorted.begin(), sorted.end());
+
+        struct rusage usage;
+        long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+        out["run"] = run_id_;
+        out["complete"] = done;
+        out["conversations"] = conversations_;
+        out["turns_per_conversation"] = turns_;
+        out["think_ms"] = think_ms_;
+        out["messages_sent"] = sent_;
+        out["replies"] = sorted.size();
+        out["errors"] = errors_;
+        out["timeouts"] = timeouts_;
+        out["duration_s"] = seconds;
+        out["throughput_per_s"] = seconds > 0 ? static_cast<double>(sorted.size()) / seconds : 0.0;
+        out["latency_ms"]["p50"] = percentile(sorted, 50);
+        out["latency_ms"]["p90"] = percentile(sorted, 90);
+        out["latency_ms"]["p99"] = percentile(sorted, 99);
+        out["latency_ms"]["max"] = sorted.empty() ? 0.0 : sorted.back();
+        out["peak_rss_kb"] = static_cast<int64_t>(peak_rss_kb);
+        status_ = ChannelStatus::STOPPED;
+    }
+
+    LOG_INFO("[LoadGen] %s: %llu replies in %.1fs (%.1f/s), %llu errors, %llu timeouts",
+             done ? "Done" : "Interrupted",
+             static_cast<unsigned long long>(out["replies"].get<uint64_t>()),
+             out["duration_s"].get<double>(), out["throughput_per_s"].get<double>(),
+             static_cast<unsigned long long>(out["errors"].get<uint64_t>()),
+             static_cast<unsigned long long>(out["timeouts"].get<uint64_t>()));
+    LOG_INFO("[LoadGen] Latency p50 %.0fms, p90 %.0fms, p99 %.0fms, max %.0fms; peak RSS %lld KB",
+             out["latency_ms"]["p50"].get<double>(), out["latency_ms"]["p90"].get<double>(),
+             out["latency_ms"]["p99"].get<double>(), out["latency_ms"]["max"].get<double>(),
+             static_cast<long long>(out["peak_rss_kb"].get<int64_t>()));
+
+    if (!report_path_.empty()) {
+        std::ofstream file(report_path_.c_str());
+        if (file.is_open()) {
+            file << out.dump(2) << "\n";
+            LOG_INFO("[LoadGen] Report written to %s", report_path_.c_str());
+        } else {
+            LOG_WARN("[LoadGen] Cannot write report to %s", report_path_.c_str());
+        }
+    }
+
+    if (done && exit_when_done_) {
+        // Same path as Ctrl+C: the main loop exits and shuts down cleanly
+        raise(SIGTERM);
+    }
+}
+
+} // namespace opencrank
+
+// Export plugin for dynamic loading
+OPENCRANK_DECLARE_PLUGIN(opencrank::LoadGenChannel, "loadgen", "1.0.0",
+                        "Synthetic conversations for load testing", "channel")
@@ -0,0 +1,414 @@
+#include <opencrank/plugins/mock/mock.hpp>
+#include <opencrank/core/loader.hpp>
+#include <opencrank/core/json.hpp>
+#include <opencrank/core/reactor.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace opencrank {
+
+namespace {
+
+// Per-thread generator: agent workers draw latencies without a shared lock
+uint64_t thread_seed() {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) ^ std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+
+std::mt19937_64& thread_rng() {
+    static thread_local std::mt19937_64 rng(thread_seed());
+    return rng;
+}
+
+// Slice of a wait between cancel checks
+const int CANCEL_POLL_MS = 20;
+
+// Sleep in short slices so a cancelled request returns promptly; false
+// if it was cancelled
+bool sleep_ms(double ms, const std::atomic<bool>* cancel = NULL) {
+    std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() +
+        std::chrono::microseconds(static_cast<int64_t>(std::max(0.0, ms) * 1000.0));
+    while (true) {
+        if (cancel && cancel->load()) return false;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= until) return true;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            until - now, std::chrono::milliseconds(CANCEL_POLL_MS)));
+    }
+}
+
+bool is_tool_result(const ConversationMessage& msg) {
+    return msg.role == MessageRole::USER && msg.content.find("[TOOL_RESULT") != std::string::npos;
+}
+
+// Rough token estimate, enough for usage accounting and metrics
+int estimate_tokens(size_t chars) {
+    return static_cast<int>((chars + 3) / 4);
+}
+
+} // anonymous namespace
+
+MockAI::MockAI()
+    : model_("mock-1")
+    , distribution_(LATENCY_LOGNORMAL)
+    , latency_ms_(800.0)
+    , latency_stddev_ms_(300.0)
+    , stream_chunks_(8)
+    , error_rate_(0.0)
+    , native_tools_(false)
+    , reactor_(NULL)
+{}
+
+const char* MockAI::name() const { return "Mock AI"; }
+const char* MockAI::version() const { return "1.0.0"; }
+const char* MockAI::description() const {
+    return "Scripted AI provider with simulated latency, for load tests";
+}
+
+bool MockAI::init(const Config& cfg) {
+    const Json& section = cfg.get_section("mock");
+    if (section.is_object()) {
+        model_ = section.value("model", model_);
+        latency_ms_ = std::max(0.0, section.value("latency_ms", latency_ms_));
+        latency_stddev_ms_ = std::max(0.0, section.value("latency_stddev_ms", latency_stddev_ms_));
+        stream_chunks_ = std::max(1, section.value("stream_chunks", stream_chunks_));
+        error_rate_ = std::min(1.0, std::max(0.0, section.value("error_rate", error_rate_)));
+        native_tools_ = section.value("native_tools", native_tools_);
+    }
+
+    std::string distribution = cfg.get_string("mock.latency", "lognormal");
+    if (distribution == "fixed") {
+        distribution_ = LATENCY_FIXED;
+    } else if (distribution == "uniform") {
+        distribution_ = LATENCY_UNIFORM;
+    } else {
+        if (distribution != "lognormal") {
+            LOG_WARN("[Mock] Unknown latency distribution '%s', using lognormal", distribution.c_str());
+        }
+        distribution_ = LATENCY_LOGNORMAL;
+    }
+
+    std::string script = cfg.get_string("mock.script", "");
+    if (script.empty() || !load_script(script)) {
+        load_builtin_script();
+    }
+
+    LOG_INFO("[Mock] Mock AI ready: %zu scripted turn(s), %s latency %.0fms (spread %.0fms), error rate %.1f%%",
+             turns_.size(), distribution.c_str(), latency_ms_, latency_stddev_ms_, error_rate_ * 100.0);
+
+    initialized_ = true;
+    return true;
+}
+
+bool MockAI::load_script(const std::string& path) {
+    std::ifstream in(path.c_str());
+    if (!in.is_open()) {
+        LOG_WARN("[Mock] Cannot open script %s, using the built-in script", path.c_str());
+        return false;
+    }
+
+    Json doc = Json::parse(in, nullptr, false);
+    if (doc.is_discarded() || !doc.contains("turns") || !doc["turns"].is_array()) {
+        LOG_WARN("[Mock] Script %s has no \"turns\" array, using the built-in script", path.c_str());
+        return false;
+    }
+
+    std::vector<Turn> turns;
+    const Json& list = doc["turns"];
+    for (size_t t = 0; t < list.size(); ++t) {
+        if (!list[t].is_array()) continue;
+
+        Turn turn;
+        for (size_t s = 0; s < list[t].size(); ++s) {
+            const Json& step = list[t][s];
+            if (step.contains("tool") && step["tool"].is_string()) {
+                // Same shape the agent parses out of model output
+                Json call;
+                call["tool"] = step["tool"];
+                call["arguments"] = step.contains("arguments") ? step["arguments"] : Json::object();
+                turn.push_back(call.dump());
+            } else if (step.contains("text") && step["text"].is_string()) {
+                turn.push_back(step["text"].get<std::string>());
+            }
+        }
+        if (turn.empty()) continue;
+
+        // A turn has to end, or the agent loops until max_iterations
+        if (turn.back().compare(0, 8, "{\"tool\":") == 0) {
+            turn.push_back("Done.");
+        }
+        turns.push_back(turn);
+    }
+
+    if (turns.empty()) {
+        LOG_WARN("[Mock] Script %s has no usable turns, using the built-in script", path.c_str());
+        return false;
+    }
+    turns_.swap(turns);
+    LOG_INFO("[Mock] Loaded %zu turn(s) from %s", turns_.size(), path.c_str());
+    return true;
+}
+
+void MockAI::load_builtin_script() {
+    turns_.clear();
+
+    Turn plain;
+    plain.push_back("Here is a short answer. The quick summary: caching the prefix keeps "
+                    "repeated requests cheap, and batching writes keeps the database quiet.");
+    turns_.push_back(plain);
+
+    Turn one_tool;
+    one_tool.push_back("{\"tool\": \"memory_search\", \"arguments\": {\"query\": \"project notes\"}}");
+    one_tool.push_back("I looked through your saved notes. Nothing there contradicts the plan, "
+                       "so the earlier decision still stands.");
+    turns_.push_back(one_tool);
+
+    Turn two_tools;
+    two_tools.push_back("{\"tool\": \"memory_save\", \"arguments\": {\"content\": \"Load test note\", "
+                        "\"category\": \"note\"}}");
+    two_tools.push_back("{\"tool\": \"memory_list\", \"arguments\": {}}");
+    two_tools.push_back("Saved. Your notes now include the load test entry alongside the older ones.");
+    turns_.push_back(two_tools);
+
+    std::string long_answer;
+    for (int i = 0; i < 24; ++i) {
+        long_answer += "Paragraph " + std::to_string(i + 1) + ": a longer reply exercises "
+                       "message splitting, history growth and context accounting.\n\n";
+    }
+    Turn long_turn;
+    long_turn.push_back(long_answer);
+    turns_.push_back(long_turn);
+}
+
+bool MockAI::is_initialized() const { return initialized_; }
+void MockAI::shutdown() { initialized_ = false; }
+
+std::string MockAI::provider_id() const { return "mock"; }
+
+std::vector<std::string> MockAI::available_models() const {
+    return std::vector<std::string>(1, model_);
+}
+
+std::string MockAI::default_model() const { return model_; }
+bool MockAI::is_configured() const { return initialized_ && !turns_.empty(); }
+bool MockAI::supports_native_tools() const { return native_tools_; }
+
+double MockAI::draw_latency_ms() const {
+    std::mt19937_64& rng = thread_rng();
+    switch (distribution_) {
+        case LATENCY_FIXED:
+            return latency_ms_;
+        case LATENCY_UNIFORM: {
+            std::uniform_real_distribution<double> dist(
+                std::max(0.0, latency_ms_ - latency_stddev_ms_), latency_ms_ + latency_stddev_ms_);
+            return dist(rng);
+        }
+        case LATENCY_LOGNORMAL:
+        default: {
+            if (latency_ms_ <= 0) return 0;
+            // Parameters of the underlying normal for the requested mean and stddev
+            double ratio = latency_stddev_ms_ / latency_ms_;
+            double sigma2 = std::log(1.0 + ratio * ratio);
+            std::lognormal_distribution<double> dist(std::log(latency_ms_) - sigma2 / 2.0, std::sqrt(sigma2));
+            return dist(rng);
+        }
+    }
+}
+
+CompletionResult MockAI::complete(const std::string& prompt, const CompletionOptions& opts) {
+    std::vector<ConversationMessage> messages;
+    messages.push_back(ConversationMessage::user(prompt));
+    return chat(messages, opts);
+}
+
+CompletionResult MockAI::chat(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts
+) {
+    double latency = 0;
+    std::vector<std::string> chunks;
+    CompletionResult result = script_reply(messages, opts, latency, chunks);
+    if (!result.success) {
+        sleep_ms(latency);
+        return result;
+    }
+
+    if (!chunks.empty()) {
+        // Spread the latency over the chunks
+        double per_chunk = latency / static_cast<double>(chunks.size());
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if (!sleep_ms(per_chunk, opts.cancel)) {
+                return CompletionResult::fail("Request cancelled");
+            }
+            opts.on_chunk(chunks[i]);
+        }
+    } else if (!sleep_ms(latency, opts.cancel)) {
+        return CompletionResult::fail("Request cancelled");
+    }
+    return result;
+}
+
+void MockAI::chat_async(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts,
+    const CompletionCallback& done
+) {
+    if (!reactor_) {
+        AIPlugin::chat_async(messages, opts, done);
+        return;
+    }
+
+    // The latency passes on reactor timers instead of a sleeping thread
+    std::shared_ptr<AsyncReply> reply = std::make_shared<AsyncReply>();
+    double latency = 0;
+    reply->result = script_reply(messages, opts, latency, reply->chunks);
+    reply->next = 0;
+    reply->waited_ms = 0;
+    reply->delay_ms = static_cast<int>(latency / static_cast<double>(std::max<size_t>(1, reply->chunks.size())));
+    reply->on_chunk = opts.on_chunk;
+    reply->cancel = reply->result.success ? opts.cancel : NULL;
+    reply->done = done;
+    Reactor* reactor = reactor_;
+    reactor->post([reactor, reply]() { deliver(*reactor, reply); });
+}
+
+bool MockAI::supports_async() const { return reactor_ != NULL; }
+
+bool MockAI::attach_reactor(Reactor& reactor) {
+    reactor_ = &reactor;
+    return true;
+}
+
+bool MockAI::detach_reactor(Reactor& /* reactor */) {
+    // Timers already armed belong to replies still in flight, which the
+    // registry drains before the plugin is unloaded
+    reactor_ = NULL;
+    return true;
+}
+
+void MockAI::deliver(Reactor& reactor, const std::shared_ptr<AsyncReply>& reply) {
+    // A cancellable wait runs in slices, like sleep_ms
+    Reactor* loop = &reactor;
+    int step = reply->delay_ms - reply->waited_ms;
+    if (reply->cancel && step > CANCEL_POLL_MS) step = CANCEL_POLL_MS;
+    reactor.add_timer(step, [loop, reply, step]() {
+        if (reply->cancel && reply->cancel->load()) {
+            CompletionResult cancelled = CompletionResult::fail("Request cancelled");
+            reply->done(cancelled);
+            return;
+        }
+        reply->waited_ms += step;
+        if (reply->waited_ms < reply->delay_ms) {
+            deliver(*loop, reply);
+            return;
+        }
+        reply->waited_ms = 0;
+        if (reply->next < reply->chunks.size()) {
+            reply->on_chunk(reply->chunks[reply->next++]);
+        }
+        if (reply->next < reply->chunks.size()) {
+            deliver(*loop, reply);
+        } else {
+            reply->done(reply->result);
+        }
+    });
+}
+
+CompletionResult MockAI::script_reply(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts,
+    double& latency,
+    std::vector<std::string>& chunks
+) {
+    latency = 0;
+    if (!initialized_) {
+        return CompletionResult::fail("Mock AI not initialized");
+    }
+    if (messages.empty()) {
+        return CompletionResult::fail("No messages provided");
+    }
+
+    // Turn = user messages so far, step = replies since the latest one
+    size_t user_turns = 0;
+    size_t step = 0;
+    bool in_turn = true;
+    size_t prompt_chars = opts.system_prompt.size();
+    for (size_t i = messages.size(); i-- > 0;) {
+        const ConversationMessage& msg = messages[i];
+        prompt_chars += msg.content.size();
+        if (msg.role == MessageRole::USER && !is_tool_result(msg)) {
+            ++user_turns;
+            in_turn = false;
+        } else if (in_turn && msg.role == MessageRole::ASSISTANT) {
+            ++step;
+        }
+    }
+
+    std::string key = opts.session_key.empty() ? messages.front().content : opts.session_key;
+    size_t turn_index = (std::hash<std::string>()(key) + (user_turns ? user_turns - 1 : 0)) % turns_.size();
+    const Turn& turn = turns_[turn_index];
+    const std::string& content = turn[std::min(step, turn.size() - 1)];
+
+    latency = draw_latency_ms();
+    if (error_rate_ > 0) {
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        if (coin(thread_rng()) < error_rate_) {
+            LOG_DEBUG("[Mock] Injected failure after %.0fms", latency);
+            return CompletionResult::fail("Mock error (injected)");
+        }
+    }
+
+    LOG_DEBUG("[Mock] Turn %zu step %zu, %.0fms, %zu chars", turn_index, step, latency, content.size());
+
+    // A tool-call step comes back structured, like a function-calling API
+    // (nothing of it streams)
+    ToolCallRequest native_call;
+    if (native_tools_ && !opts.tools.empty() && content.compare(0, 8, "{\"tool\":") == 0) {
+        Json call = Json::parse(content, nullptr, false);
+        if (call.is_object() && call.contains("tool") && call["tool"].is_string()) {
+            native_call.id = "mock-" + std::to_string(step);
+            native_call.name = call["tool"].get<std::string>();
+            native_call.set_arguments(call.contains("arguments") ? call["arguments"].dump() : std::string());
+        }
+    }
+
+    if (opts.stream && opts.on_chunk && native_call.name.empty()) {
+        // Cut on UTF-8 boundaries
+        size_t chunk_size = std::max<size_t>(1, content.size() / static_cast<size_t>(stream_chunks_));
+        size_t pos = 0;
+        while (pos < content.size()) {
+            size_t end = std::min(content.size(), pos + chunk_size);
+            while (end < content.size() && (static_cast<unsigned char>(content[end]) & 0xC0) == 0x80) {
+                ++end;
+            }
+            chunks.push_back(content.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+
+    CompletionResult result = CompletionResult::ok(content);
+    if (!native_call.name.empty()) {
+        result.content = native_call.to_text();
+        result.tool_calls.push_back(native_call);
+        result.stop_reason = "tool_use";
+    }
+    result.model = opts.model.empty() ? model_ : opts.model;
+    if (result.stop_reason.empty()) result.stop_reason = "end_turn";
+    result.usage.input_tokens = estimate_tokens(prompt_chars);
+    result.usage.output_tokens = estimate_tokens(content.size());
+    result.usage.total_tokens = result.usage.input_tokens + result.usage.output_tokens;
+    return result;
+}
+
+} // namespace opencrank
+
+// Export plugin for dynamic loading
+OPENCRANK_DECLARE_PLUGIN(opencrank::MockAI, "mock", "1.0.0",
+                        "Scripted AI provider with simulated latency, for load tests", "ai")
@@ -1,7 +1,13 @@
 #include <opencrank/plugins/openrouter/openrouter.hpp>
 #include <opencrank/core/loader.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/json_stream.hpp>
+#include <opencrank/core/async_http.hpp>
+#include <opencrank/ai/rate_pacer.hpp>
+#include <opencrank/ai/sse.hpp>
 #include <sstream>
+#include <algorithm>
+#include <memory>
 
 namespace opencrank {
 
@@ -9,7 +15,10 @@ OpenRouterAI::OpenRouterAI()
     : api_key_()
     , default_model_("openai/gpt-4o")
     , api_url_("https://openrouter.ai/api/v1")
+    , max_context_tokens_(16384)
+    , native_tools_(true)
     , initialized_(false)
+    , pacer_(NULL)
 {}
 
 const char* OpenRouterAI::name() const { return "OpenRouter AI"; }
@@ -42,22 +51,30 @@ bool OpenRouterAI::init(const Config& cfg) {
         return false;
     }
 
-    // Context size configuration (in tokens — we multiply by 4 for char estimate)
+    native_tools_ = cfg.get_bool("openrouter.native_tools", true);
+    
+    // Context size configuration (in tokens)
     int context_tokens = static_cast<int>(cfg.get_int("openrouter.context_size", 16384));
-    max_context_chars_ = static_cast<size_t>(context_tokens) * 4;
+    max_context_tokens_ = static_cast<size_t>(context_tokens);
    
     // Configure the context manager for intelligent context window management
     ContextManagerConfig ctx_config;
-    ctx_config.max_context_chars = max_context_chars_;
-    ctx_config.reserve_for_response = max_context_chars_ / 4;  // Reserve 25% for response
+    ctx_config.max_context_tokens = max_context_tokens_;
+    ctx_config.reserve_for_response = max_context_tokens_ / 4;  // Reserve 25% for response
     ctx_config.usage_threshold = 0.75;  // Trigger resume at 75%
     ctx_config.max_resume_chars = 3000;
     ctx_config.auto_save_memory = true;
+    ctx_config.background_summary = cfg.get_bool("openrouter.background_summary", true);
+    ctx_config.summary_window = static_cast<size_t>(std::max<int64_t>(1, cfg.get_int("openrouter.summary_window", 8)));
     context_manager_.set_config(ctx_config);
+    context_manager_.set_token_counter(create_token_counter(cfg, "openrouter", "approx"));
+    
+    LOG_INFO("Context manager configured: max %zu tokens, reserve %zu tokens, threshold %.0f%%, tokenizer %s, auto-save %s",
+             ctx_config.max_context_tokens, ctx_config.reserve_for_response, 
+             ctx_config.usage_threshold * 100.0, context_manager_.token_counter().name(),
+             ctx_config.auto_save_memory ? "enabled" : "disabled");
     
-    LOG_INFO("Context manager configured: max %zu chars, reserve %zu chars, threshold %.0f%%, auto-save %s",
-             ctx_config.max_context_chars, ctx_config.reserve_for_response, 
-             ctx_config.usage_threshold * 100.0, ctx_config.auto_save_memory ? "enabled" : "disabled");
+    pacer_ = &RatePacer::get("openrouter", api_key_, RetryPolicy::from_config(cfg, "openrouter"));
     
     LOG_INFO("OpenRouter AI initialized with model: %s", default_model_.c_str());
     initialized_ = true;
@@ -90,6 +107,10 @@ std::string OpenRouterAI::default_model() const { return default_model_; }
 
 bool OpenRouterAI::is_configured() const { return !api_key_.empty(); }
 
+bool OpenRouterAI::supports_native_tools() const { return native_tools_; }
+
+void OpenRouterAI::set_thread_pool(ThreadPool* pool) { context_manager_.set_thread_pool(pool); }
+
 CompletionResult OpenRouterAI::complete(
     const std::string& prompt,
     const CompletionOptions& opts
@@ -102,51 +123,71 @@ CompletionResult OpenRouterAI::complete(
     return chat(messages, opts);
 }
 
-CompletionResult OpenRouterAI::chat(
+bool OpenRouterAI::build_chat_request(
     const std::vector<ConversationMessage>& messages,
-    const CompletionOptions& opts
+    const CompletionOptions& opts,
+    std::string& request_body,
+    std::string& error
 ) {
     if (!initialized_) {
-        return CompletionResult::fail("OpenRouter AI not initialized");
+        error = "OpenRouter AI not initialized";
+        return false;
     }
     
     if (messages.empty()) {
-        return CompletionResult::fail("No messages provided");
+        error = "No messages provided";
+        return false;
     }
     
     LOG_DEBUG("Starting chat request with %zu messages", messages.size());
     
     // Manage context window intelligently (resume-based strategy)
     // Skip if disabled for internal operations like resume generation
-    std::vector<ConversationMessage> trimmed_messages;
+    // Points at the caller's history unless context management rewrote it
+    std::vector<ConversationMessage> managed_storage;
+    const std::vector<ConversationMessage>* managed = &messages;
     if (!opts.skip_context_management) {
         LOG_DEBUG("Checking context management for %zu messages", messages.size());
-        trimmed_messages = manage_context(messages, opts.system_prompt);
-        if (trimmed_messages.size() != messages.size()) {
+        managed = &manage_context(messages, opts.system_prompt, opts.session_key, managed_storage);
+        if (managed->size() != messages.size()) {
             LOG_INFO(" Context managed: %zu -> %zu messages",
-                     messages.size(), trimmed_messages.size());
+                     messages.size(), managed->size());
         }
     } else {
         LOG_DEBUG("Skipping context management (skip_context_management=true)");
-        trimmed_messages = messages;
     }
+    const std::vector<ConversationMessage>& trimmed_messages = *managed;
     
-    // Build OpenAI-compatible request
-    Json request = Json::object();
+    // Build OpenAI-compatible request, written straight from the history
+    // (no DOM of the conversation)
+    JsonWriter request(request_body);
+    request.begin_object();
     
     std::string model = opts.model.empty() ? default_model_ : opts.model;
-    request["model"] = model;
+    request.field("model", model);
     LOG_DEBUG("Using model: %s", model.c_str());
        
     // Convert messages to OpenAI format
-    Json msgs = Json::array();
+    size_t sent = 0;
+    request.key("messages").begin_array();
     
     // Prepend system message if system prompt is provided
     if (!opts.system_prompt.empty()) {
-        Json sys_msg = Json::object();
-        sys_msg["role"] = "system";
-        sys_msg["content"] = sanitize_utf8(opts.system_prompt);
-        msgs.push_back(sys_msg);
+        request.begin_object();
+        request.field("role", "system");
+        if (opts.stable_system_prompt && model.compare(0, 10, "anthropic/") == 0) {
+            // Anthropic models need an explicit breakpoint for prompt caching
+            // (other providers behind OpenRouter cache prefixes automatically)
+            request.key("content").begin_array().begin_object();
+            request.field("type", "text");
+            request.field("text", opts.system_prompt);
+            request.key("cache_control").begin_object().field("type", "ephemeral").end_object();
+            request.end_object().end_array();
+        } else {
+            request.field("content", opts.system_prompt);
+        }
+        request.end_object();
+        ++sent;
     }
     
     LOG_DEBUG("=== ▶ IN  Messages being sent to AI ===");
@@ -162,41 +203,167 @@ CompletionResult OpenRouterAI::chat(
             }
         }
         
-        Json m = Json::object();
-        m["role"] = role_to_string(msg.role);
-        m["content"] = sanitize_utf8(msg.content);
-        msgs.push_back(m);
+        request.begin_object();
+        request.field("role", role_to_string(msg.role));
+        request.field("content", msg.content);
+        request.end_object();
+        ++sent;
         
         LOG_DEBUG("▶ [%zu] %s (%zu chars): %.300s%s", 
                   i, role_to_string(msg.role).c_str(), 
                   msg.content.size(), msg.content.c_str(),
                   msg.content.size() > 300 ? "..." : "");
     }
-    request["messages"] = msgs;
-    LOG_DEBUG("=== ▶ IN  End of messages (%zu total) ===", msgs.size());
+    request.end_array();
+    LOG_DEBUG("=== ▶ IN  End of messages (%zu total) ===", sent);
     
     // Set parameters
     if (opts.temperature >= 0.0) {
-        request["temperature"] = opts.temperature;
+        request.field("temperature", opts.temperature);
     }
     
     if (opts.max_tokens > 0) {
-        request["max_tokens"] = static_cast<int64_t>(opts.max_tokens);
+        request.field("max_tokens", opts.max_tokens);
+    }
+    
+    if (native_tools_) {
+        write_openai_tools(request, opts.tools);
+    }
+    
+    // Stream only when someone consumes the chunks
+    bool streaming = opts.stream && opts.on_chunk;
+    if (streaming) {
+        request.field("stream", true);
+        request.key("stream_options").begin_object().field("include_usage", true).end_object();
+    }
+    request.end_object();
+    return true;
+}
+
+CompletionResult OpenRouterAI::chat(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts
+) {
+    // Written into a reused buffer
+    std::string& request_body = JsonWriter::thread_buffer();
+    std::string error;
+    if (!build_chat_request(messages, opts, request_body, error)) {
+        return CompletionResult::fail(error);
     }
     
     std::string endpoint = api_url_ + "/chat/completions";
-    std::string request_body = request.dump(-1, ' ', false, Json::error_handler_t::replace);
     LOG_DEBUG("▶ IN  Sending request to %s (%zu bytes)", endpoint.c_str(), request_body.size());
     
-    // Prepare HTTP client
-    HttpClient http;
-    std::map<std::string, std::string> headers;
-    headers["Content-Type"] = "application/json";
-    headers["Authorization"] = "Bearer " + api_key_;
+    // Borrow a pooled HTTP client (keeps the TLS connection warm)
+    HttpClientPool::Lease http = HttpClientPool::instance().acquire();
+    http->set_cancel(opts.cancel);
     
     // Make request to OpenRouter API
-    HttpResponse response = http.post_json(endpoint, request_body, headers);
+    bool streaming = opts.stream && opts.on_chunk;
+    OpenAIStreamAccumulator stream(opts.on_chunk);
+    HttpResponse response;
+    // 429s are retried here after a backoff; error bodies never reach the
+    // stream, so nothing has been shown to the caller yet
+    int64_t backoff_ms = 0;
+    for (int attempt = 0; ; ++attempt) {
+        std::string wait_error;
+        if (!pacer_->pace(opts.cancel, backoff_ms, wait_error)) {
+            LOG_WARN(" %s", wait_error.c_str());
+            return CompletionResult::fail(wait_error);
+        }
+        if (streaming) {
+            response = http->post_json_stream(endpoint, request_body, request_headers(),
+                [&stream](const char* data, size_t len) { return stream.feed(data, len); });
+        } else {
+            response = http->post_json(endpoint, request_body, request_headers());
+        }
+        if (!pacer_->should_retry(response, attempt, backoff_ms)) break;
+    }
+    return parse_chat_response(response, streaming, stream);
+}
+
+struct OpenRouterAI::AsyncChat {
+    AsyncHttpRequest request;   // Each attempt sends a copy
+    bool streaming;
+    std::shared_ptr<OpenAIStreamAccumulator> stream;
+    CompletionCallback done;
+    int attempt;
+};
+
+void OpenRouterAI::chat_async(
+    const std::vector<ConversationMessage>& messages,
+    const CompletionOptions& opts,
+    const CompletionCallback& done
+) {
+    if (!AsyncHttp::instance().running()) {
+        AIPlugin::chat_async(messages, opts, done);
+        return;
+    }
     
+    AsyncHttpRequest request;
+    std::string error;
+    if (!build_chat_request(messages, opts, request.body, error)) {
+        CompletionResult result = CompletionResult::fail(error);
+        done(result);
+        return;
+    }
+    request.url = api_url_ + "/chat/completions";
+    request.headers = request_headers();
+    request.cancel = opts.cancel;
+    LOG_DEBUG("▶ IN  Sending request to %s (%zu bytes, async)", request.url.c_str(), request.body.size());
+    
+    std::shared_ptr<AsyncChat> chat = std::make_shared<AsyncChat>();
+    chat->streaming = opts.stream && opts.on_chunk;
+    chat->stream = std::make_shared<OpenAIStreamAccumulator>(opts.on_chunk);
+    chat->done = done;
+    chat->attempt = 0;
+    if (chat->streaming) {
+        std::shared_ptr<OpenAIStreamAccumulator> stream = chat->stream;
+        request.on_data = [stream](const char* data, size_t len) { return stream->feed(data, len); };
+    }
+    chat->request = std::move(request);
+    if (!send_async(chat, 0)) {
+        // The loop stopped in the meantime
+        AIPlugin::chat_async(messages, opts, done);
+    }
+}
+
+bool OpenRouterAI::send_async(const std::shared_ptr<AsyncChat>& chat, int64_t backoff_ms) {
+    AsyncHttpRequest request = chat->request;
+    request.delay_ms = pacer_->reserve(backoff_ms);
+    if (request.delay_ms > pacer_->max_delay_ms()) {
+        std::string error = pacer_->too_long(request.delay_ms);
+        LOG_WARN(" %s", error.c_str());
+        CompletionResult result = CompletionResult::fail(error);
+        chat->done(result);
+        return true;
+    }
+    return AsyncHttp::instance().submit(std::move(request), [this, chat](HttpResponse& response) {
+        int64_t backoff_ms = 0;
+        if (pacer_->should_retry(response, chat->attempt++, backoff_ms)) {
+            if (send_async(chat, backoff_ms)) return;
+            response.status_code = 0;
+            response.error = "shutting down";
+        }
+        CompletionResult result = parse_chat_response(response, chat->streaming, *chat->stream);
+        chat->done(result);
+    });
+}
+
+bool OpenRouterAI::supports_async() const { return AsyncHttp::instance().running(); }
+
+std::map<std::string, std::string> OpenRouterAI::request_headers() const {
+    std::map<std::string, std::string> headers;
+    headers["Content-Type"] = "application/json";
+    headers["Authorization"] = "Bearer " + api_key_;
+    return headers;
+}
+
+CompletionResult OpenRouterAI::parse_chat_response(
+    const HttpResponse& response,
+    bool streaming,
+    const OpenAIStreamAccumulator& stream
+) {
     if (response.status_code == 0) {
         LOG_ERROR(" HTTP request failed: %s", response.error.c_str());
         return CompletionResult::fail("HTTP request failed: " + response.error);
@@ -205,16 +372,25 @@ CompletionResult OpenRouterAI::chat(
     LOG_DEBUG("◀ OUT Received response [HTTP %d] (%zu bytes)", 
               response.status_code, response.body.size());
     
-    std::string sanitized_body = sanitize_utf8(response.body);
     Json resp;
-    try {
-        resp = Json::parse(sanitized_body);
-    } catch (const std::exception& e) {
-        LOG_ERROR(" Failed to parse JSON response: %s", e.what());
-        return CompletionResult::fail("Invalid JSON response: " + std::string(e.what()));
+    if (streaming && response.status_code == 200) {
+        // Rebuild a regular completion from the streamed deltas
+        resp = stream.to_response();
+    } else {
+        // The body is already UTF-8 clean (HttpClient sanitizes it). Only the
+        // members read below are materialised; echoed prompts and timings
+        // are skipped by the SAX pass.
+        static const std::vector<std::string> response_fields = {
+            "choices", "error", "model", "usage"
+        };
+        resp = parse_json_fields(response.body, response_fields);
+        if (resp.is_discarded()) {
+            LOG_ERROR(" Failed to parse JSON response (%zu bytes)", response.body.size());
+            return CompletionResult::fail("Invalid JSON response");
+        }
     }
     
-    if (response.status_code != 200) {
+    if (response.status_code != 200 || resp.contains("error")) {
         std::string error_msg = "API error";
         if (resp.is_object()) {
             if (resp.contains("error") && resp["error"].is_object()) {
@@ -249,51 +425,15 @@ CompletionResult OpenRouterAI::chat(
         
         if (first_choice.contains("message") && first_choice["message"].is_object()) {
             const Json& message = first_choice["message"];
-            result.content = message.value("content", std::string(""));
+            // content is null when the reply is only tool calls
+            if (message.contains("content") && message["content"].is_string()) {
+                result.content = message["content"].get<std::string>();
+            }
             
-            // Check for native OpenAI-style tool_calls in the response
-            if (message.contains("tool_calls") && message["tool_calls"].is_array() && 
-                !message["tool_calls"].empty()) {
-                
-                const Json& tool_calls = message["tool_calls"];
-                LOG_INFO(" Found %zu native tool_call(s) in response", tool_calls.size());
-                
-                std::ostringstream reconstructed;
-                
-                if (!result.content.empty()) {
-                    reconstructed << result.content << "\n\n";
-                }
-                
-                for (size_t tc = 0; tc < tool_calls.size(); ++tc) {
-                    const Json& tc_obj = tool_calls[tc];
-                    
-                    if (!tc_obj.contains("function") || !tc_obj["function"].is_object()) {
-                        LOG_WARN(" tool_call[%zu] missing 'function' object, skipping", tc);
-                        continue;
-                    }
-                    
-                    const Json& func = tc_obj["function"];
-                    std::string tool_name = func.value("name", std::string(""));
-                    std::string arguments = func.value("arguments", std::string("{}"));
-                    
-                    if (tool_name.empty()) {
-                        LOG_WARN(" tool_call[%zu] has empty function name, skipping", tc);
-                        continue;
-                    }
-                    
-                    LOG_INFO(" Native tool_call[%zu]: %s", tc, tool_name.c_str());
-                    LOG_DEBUG("Native tool_call[%zu] arguments: %s", tc, arguments.c_str());
-                    
-                    if (tc > 0) {
-                        reconstructed << "\n\n";
-                    }
-                    reconstructed << "{\"tool\": \"" << tool_name << "\", ";
-                    reconstructed << "\"arguments\": " << arguments << "}";
-                }
-                
-                result.content = reconstructed.str();
-                LOG_INFO(" Reconstructed %zu native tool call(s) into JSON format",
-                         tool_calls.size());
+            // Native tool calls; the text protocol's form goes into content
+            size_t native_calls = read_openai_tool_calls(message, result);
+            if (native_calls > 0) {
+                LOG_INFO(" %zu native tool call(s) in response", native_calls);
             }
         }
         
@@ -305,6 +445,9 @@ CompletionResult OpenRouterAI::chat(
         result.usage.input_tokens = usage.value("prompt_tokens", 0);
         result.usage.output_tokens = usage.value("completion_tokens", 0);
         result.usage.total_tokens = usage.value("total_tokens", 0);
+        if (usage.contains("prompt_tokens_details") && usage["prompt_tokens_details"].is_object()) {
+            result.usage.cached_tokens = usage["prompt_tokens_details"].value("cached_tokens", 0);
+        }
     }
     
     LOG_DEBUG("=== ◀ OUT AI Response ===");
@@ -354,21 +497,11 @@ std::string OpenRouterAI::reply(
     return "Error: " + result.error;
 }
 
-size_t OpenRouterAI::estimate_request_chars(
-    const std::vector<ConversationMessage>& messages,
-    const std::string& system_prompt) const
-{
-    size_t total = system_prompt.size();
-    for (size_t i = 0; i < messages.size(); ++i) {
-        total += messages[i].content.size();
-        total += 20; // Role tags, formatting overhead per message
-    }
-    return total;
-}
-
-std::vector<ConversationMessage> OpenRouterAI::manage_context(
+const std::vector<ConversationMessage>& OpenRouterAI::manage_context(
     const std::vector<ConversationMessage>& messages,
-    const std::string& system_prompt)
+    const std::string& system_prompt,
+    const std::string& session_key,
+    std::vector<ConversationMessage>& storage)
 {
     if (messages.empty()) {
         return messages;
@@ -376,78 +509,86 @@ std::vector<ConversationMessage> OpenRouterAI::manage_context(
     
     // Debug: Log current context usage
     ContextUsage usage = context_manager_.estimate_usage(messages, system_prompt);
-    LOG_INFO(" Context usage: %.1f%% (%zu/%zu chars, %zu messages)",
-             usage.usage_ratio * 100.0, usage.total_chars, usage.budget_chars, messages.size());
+    LOG_INFO(" Context usage: %.1f%% (%zu/%zu tokens, %zu messages)",
+             usage.usage_ratio * 100.0, usage.total_tokens, usage.budget_tokens, messages.size());
+    
+    // Keep the session's resume current in the background
+    context_manager_.prepare_summary(this, messages, usage, session_key);
     
     // Check if we need a resume cycle
-    if (context_manager_.needs_resume(messages, system_prompt)) {
-        ContextUsage resume_usage = context_manager_.estimate_usage(messages, system_prompt);
-        LOG_WARN(" Context at %.0f%% capacity (%zu/%zu chars), initiating resume cycle",
-                 resume_usage.usage_ratio * 100.0, resume_usage.total_chars, resume_usage.budget_chars);
+    if (usage.needs_resume) {
+        LOG_WARN(" Context at %.0f%% capacity (%zu/%zu tokens), initiating resume cycle",
+                 usage.usage_ratio * 100.0, usage.total_tokens, usage.budget_tokens);
         
-        // Perform the resume cycle: generate summary, save memory, wipe, reload
-        std::vector<ConversationMessage> history_copy = messages;
+        // Perform the resume cycle: pre-built or fresh summary, save memory, wipe, reload
+        storage = messages;
         bool ok = context_manager_.perform_resume_cycle(
-            this, history_copy, system_prompt);
+            this, storage, system_prompt, session_key);
         
         if (ok) {
             LOG_INFO(" Resume cycle complete: %zu -> %zu messages",
-                     messages.size(), history_copy.size());
-            return history_copy;
+                     messages.size(), storage.size());
+            return storage;
         }
         
         LOG_WARN(" Resume cycle failed, falling back to simple truncation");
     }
     
     // If context fits or resume failed, check if simple truncation is needed
-    size_t total_chars = estimate_request_chars(messages, system_prompt);
-    size_t budget = max_context_chars_ * 3 / 4;
+    size_t total_tokens = context_manager_.count_tokens(messages, system_prompt);
+    size_t budget = max_context_tokens_ * 3 / 4;
     
-    if (total_chars <= budget) {
+    if (total_tokens <= budget) {
         return messages; // Fits fine
     }
     
     // Fallback: truncate large individual messages
-    LOG_WARN(" Fallback truncation: %zu chars > %zu budget", total_chars, budget);
+    LOG_WARN(" Fallback truncation: %zu tokens > %zu budget", total_tokens, budget);
     
-    std::vector<ConversationMessage> trimmed = messages;
+    storage = messages;
+    std::vector<ConversationMessage>& trimmed = storage;
     const size_t max_single_msg = budget / 4;
     
     for (size_t i = 0; i < trimmed.size(); ++i) {
-        if (trimmed[i].content.size() > max_single_msg) {
+        size_t msg_tokens = context_manager_.count_tokens(trimmed[i]);
+        if (msg_tokens > max_single_msg) {
+            // Keep the same share of bytes as of tokens
+            size_t keep = trimmed[i].content.size() * max_single_msg / msg_tokens;
             if (trimmed[i].content.find("[TOOL_RESULT") != std::string::npos) {
-                trimmed[i].content = trimmed[i].content.substr(0, max_single_msg)
+                trimmed[i].content = truncate_safe(trimmed[i].content, keep)
                     + "\n... [content truncated to fit context window] ...";
             } else {
-                trimmed[i].content = trimmed[i].content.substr(0, max_single_msg)
+                trimmed[i].content = truncate_safe(trimmed[i].content, keep)
                     + "\n... [truncated] ...";
             }
         }
     }
     
-    total_chars = estimate_request_chars(trimmed, system_prompt);
-    if (total_chars <= budget) {
+    total_tokens = context_manager_.count_tokens(trimmed, system_prompt);
+    if (total_tokens <= budget) {
         return trimmed;
     }
     
     // Last resort: drop middle messages
+    // (kept messages are moved out of trimmed, not copied)
     std::vector<ConversationMessage> result;
-    result.push_back(trimmed[0]);
+    bool bridge = trimmed[0].role == MessageRole::USER;
+    result.push_back(std::move(trimmed[0]));
     
-    if (trimmed[0].role == MessageRole::USER) {
+    if (bridge) {
         result.push_back(ConversationMessage::assistant(
             "[Earlier conversation truncated to fit context window.]"
         ));
     }
     
-    std::vector<ConversationMessage> tail;
-    size_t used = estimate_request_chars(result, system_prompt);
+    std::vector<size_t> tail;
+    size_t used = context_manager_.count_tokens(result, system_prompt);
     
     for (size_t i = trimmed.size(); i > 1; --i) {
         size_t idx = i - 1;
-        size_t msg_cost = trimmed[idx].content.size() + 20;
+        size_t msg_cost = context_manager_.count_tokens(trimmed[idx]);
         if (used + msg_cost <= budget) {
-            tail.push_back(trimmed[idx]);
+            tail.push_back(idx);
             used += msg_cost;
         } else {
             break;
@@ -455,16 +596,18 @@ std::vector<ConversationMessage> OpenRouterAI::manage_context(
     }
     
     for (size_t i = tail.size(); i > 0; --i) {
-        if (!result.empty() && result.back().role == tail[i - 1].role) {
+        ConversationMessage& msg = trimmed[tail[i - 1]];
+        if (!result.empty() && result.back().role == msg.role) {
             continue;
         }
-        result.push_back(tail[i - 1]);
+        result.push_back(std::move(msg));
     }
     
     LOG_INFO(" Fallback trimmed from %zu to %zu messages",
              messages.size(), result.size());
     
-    return result;
+    storage.swap(result);
+    return storage;
 }
 
 } // namespace opencrank
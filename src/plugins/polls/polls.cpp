@@ -1,10 +1,18 @@
 #include <opencrank/plugins/polls/polls.hpp>
 #include <opencrank/core/loader.hpp>
+#include <opencrank/core/config.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/json.hpp>
 #include <opencrank/core/utils.hpp>
+#include <opencrank/core/sqlite_stmt.hpp>
+#include <sqlite3.h>
 #include <algorithm>
+#include <chrono>
+#include <set>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <cstdlib>
 
 namespace opencrank {
 
@@ -148,6 +156,315 @@ std::string validate_vote(const Poll& poll, const std::vector<int>& selected_opt
     return "";  // Valid
 }
 
+// ============ PollStore ============
+
+namespace {
+// Selections are stored as "0,2"; "" marks a retraction in the vote log
+std::string encode_selection(const std::vector<int>& options) {
+    std::string out;
+    for (size_t i = 0; i < options.size(); ++i) {
+        if (i) out += ',';
+        out += std::to_string(options[i]);
+    }
+    return out;
+}
+
+std::vector<int> decode_selection(const std::string& text) {
+    std::vector<int> options;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) options.push_back(atoi(item.c_str()));
+    }
+    return options;
+}
+
+// The vote log is rewritten as the live votes once it holds this many times
+// their number (and at least COMPACT_MIN_ROWS rows)
+const size_t COMPACT_RATIO = 2;
+const size_t COMPACT_MIN_ROWS = 256;
+} // namespace
+
+PollStore::PollStore()
+    : db_(nullptr)
+    , flush_interval_ms_(200)
+    , flush_requested_(false)
+    , stop_(false)
+    , enqueued_(0)
+    , committed_(0) {}
+
+PollStore::~PollStore() {
+    close();
+}
+
+bool PollStore::open(const std::string& db_path, int flush_interval_ms) {
+    close();
+
+    if (!create_parent_directory(db_path)) {
+        LOG_ERROR("[Polls] Failed to create parent directory for '%s'", db_path.c_str());
+        return false;
+    }
+    if (sqlite3_open(db_path.c_str(), &db_) != SQLITE_OK) {
+        LOG_ERROR("[Polls] Failed to open database '%s': %s", db_path.c_str(), sqlite3_errmsg(db_));
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+
+    exec("PRAGMA journal_mode=WAL");
+    exec("PRAGMA synchronous=NORMAL");
+    exec("PRAGMA busy_timeout=5000");
+
+    bool ok = exec(
+        "CREATE TABLE IF NOT EXISTS polls ("
+        "  id TEXT PRIMARY KEY,"
+        "  question TEXT NOT NULL,"
+        "  options TEXT NOT NULL,"
+        "  max_selections INTEGER NOT NULL,"
+        "  duration_hours INTEGER NOT NULL,"
+        "  created_at INTEGER NOT NULL,"
+        "  expires_at INTEGER NOT NULL,"
+        "  is_closed INTEGER NOT NULL DEFAULT 0"
+        ")") &&
+        exec(
+        "CREATE TABLE IF NOT EXISTS poll_votes ("
+        "  seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  poll_id TEXT NOT NULL,"
+        "  voter_id TEXT NOT NULL,"
+        "  options TEXT NOT NULL,"
+        "  voted_at INTEGER NOT NULL"
+        ")") &&
+        exec("CREATE INDEX IF NOT EXISTS poll_votes_poll ON poll_votes(poll_id)");
+    if (!ok) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+
+    flush_interval_ms_ = flush_interval_ms > 0 ? flush_interval_ms : 1;
+    stop_ = false;
+    writer_ = std::thread(&PollStore::writer_loop, this);
+
+    LOG_INFO("[Polls] Database opened: %s (flush every %dms)", db_path.c_str(), flush_interval_ms_);
+    return true;
+}
+
+void PollStore::close() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            stop_ = true;
+        }
+        queue_cv_.notify_all();
+        writer_.join();
+    }
+    if (db_) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+    }
+}
+
+bool PollStore::exec(const char* sql) {
+    char* err = nullptr;
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+        LOG_ERROR("[Polls] SQL error: %s\n  Query: %s", err ? err : "unknown", sql);
+        if (err) sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+void PollStore::enqueue(const Change& change) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!db_ || stop_) return;
+    queue_.push_back(change);
+    enqueued_++;
+    // The writer sleeps out the flush interval; no need to wake it per vote
+}
+
+void PollStore::flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    if (!writer_.joinable()) return;
+    uint64_t target = enqueued_;
+    flush_requested_ = true;
+    queue_cv_.notify_one();
+    done_cv_.wait(lock, [this, target] { return committed_ >= target || stop_; });
+}
+
+void PollStore::writer_loop() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+        // Let changes accumulate so one transaction covers many votes
+        queue_cv_.wait_for(lock, std::chrono::milliseconds(flush_interval_ms_),
+                           [this] { return stop_ || flush_requested_; });
+        flush_requested_ = false;
+
+        if (queue_.empty()) {
+            if (stop_) return;
+            continue;
+        }
+
+        std::deque<Change> batch;
+        batch.swap(queue_);
+        lock.unlock();
+
+        size_t applied = 0;
+        {
+            std::lock_guard<std::mutex> db_lock(db_mutex_);
+            bool in_txn = exec("BEGIN IMMEDIATE");
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (apply(batch[i])) applied++;
+            }
+            if (in_txn && !exec("COMMIT")) {
+                exec("ROLLBACK");
+                applied = 0;
+            }
+        }
+        if (applied < batch.size()) {
+            LOG_WARN("[Polls] %zu of %zu poll writes failed", batch.size() - applied, batch.size());
+        }
+
+        lock.lock();
+        committed_ += batch.size();
+        done_cv_.notify_all();
+    }
+}
+
+bool PollStore::apply(const Change& change) {
+    switch (change.kind) {
+        case Change::SAVE_POLL: {
+            const Poll& p = change.poll;
+            Json options = Json::array();
+            for (size_t i = 0; i < p.options.size(); ++i) options.push_back(p.options[i]);
+            SqliteStatement upsert(db_,
+                "INSERT OR REPLACE INTO polls (id, question, options, max_selections, "
+                "duration_hours, created_at, expires_at, is_closed) VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+            if (!upsert.ok()) return false;
+            upsert.bind(1, p.id);
+            upsert.bind(2, p.question);
+            upsert.bind(3, options.dump());
+            upsert.bind(4, static_cast<int64_t>(p.max_selections));
+            upsert.bind(5, static_cast<int64_t>(p.duration_hours));
+            upsert.bind(6, p.created_at);
+            upsert.bind(7, p.expires_at);
+            upsert.bind(8, static_cast<int64_t>(p.is_closed ? 1 : 0));
+            return upsert.done();
+        }
+        case Change::DELETE_POLL: {
+            SqliteStatement del_votes(db_, "DELETE FROM poll_votes WHERE poll_id = ?");
+            SqliteStatement del_poll(db_, "DELETE FROM polls WHERE id = ?");
+            if (!del_votes.ok() || !del_poll.ok()) return false;
+            del_votes.bind(1, change.vote.poll_id);
+            del_poll.bind(1, change.vote.poll_id);
+            return del_votes.done() && del_poll.done();
+        }
+        case Change::VOTE:
+        case Change::RETRACT: {
+            SqliteStatement insert(db_,
+                "INSERT INTO poll_votes (poll_id, voter_id, options, voted_at) VALUES (?, ?, ?, ?)");
+            if (!insert.ok()) return false;
+            insert.bind(1, change.vote.poll_id);
+            insert.bind(2, change.vote.voter_id);
+            insert.bind(3, change.kind == Change::VOTE ? encode_selection(change.vote.selected_options)
+                                                       : std::string());
+            insert.bind(4, change.vote.voted_at);
+            return insert.done();
+        }
+    }
+    return false;
+}
+
+bool PollStore::load(std::vector<Poll>& polls, std::vector<PollVote>& votes) {
+    if (!db_) return false;
+    flush();
+
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    std::set<std::string> ids;
+    {
+        SqliteStatement select(db_,
+            "SELECT id, question, options, max_selections, duration_hours, created_at, "
+            "expires_at, is_closed FROM polls");
+        if (!select.ok()) return false;
+        while (select.row()) {
+            Poll p;
+            p.id = select.text(0);
+            p.question = select.text(1);
+            try {
+                Json options = Json::parse(select.text(2));
+                for (size_t i = 0; i < options.size(); ++i) {
+                    if (options[i].is_string()) p.options.push_back(options[i].get<std::string>());
+                }
+            } catch (const std::exception&) {
+                continue;
+            }
+            p.max_selections = static_cast<int>(select.integer(3));
+            p.duration_hours = static_cast<int>(select.integer(4));
+            p.created_at = select.integer(5);
+            p.expires_at = select.integer(6);
+            p.is_closed = select.integer(7) != 0;
+            ids.insert(p.id);
+            polls.push_back(p);
+        }
+    }
+
+    // Replay the log: a later row for the same voter replaces the earlier one
+    size_t rows = 0;
+    std::map<std::pair<std::string, std::string>, PollVote> live;
+    {
+        SqliteStatement select(db_, "SELECT poll_id, voter_id, options, voted_at FROM poll_votes ORDER BY seq");
+        if (!select.ok()) return false;
+        while (select.row()) {
+            ++rows;
+            PollVote v;
+            v.poll_id = select.text(0);
+            v.voter_id = select.text(1);
+            std::string options = select.text(2);
+            std::pair<std::string, std::string> key(v.poll_id, v.voter_id);
+            if (options.empty() || !ids.count(v.poll_id)) {
+                live.erase(key);
+                continue;
+            }
+            v.selected_options = decode_selection(options);
+            v.voted_at = select.integer(3);
+            live[key] = v;
+        }
+    }
+    votes.reserve(live.size());
+    for (std::map<std::pair<std::string, std::string>, PollVote>::const_iterator it = live.begin();
+         it != live.end(); ++it) {
+        votes.push_back(it->second);
+    }
+
+    // Retractions and changed votes leave dead rows behind: write the
+    // snapshot back once they dominate
+    if (rows >= COMPACT_MIN_ROWS && rows > COMPACT_RATIO * live.size()) {
+        std::vector<PollVote> ordered(votes);
+        std::sort(ordered.begin(), ordered.end(), [](const PollVote& a, const PollVote& b) {
+            return a.voted_at < b.voted_at;
+        });
+        bool ok = exec("BEGIN IMMEDIATE") && exec("DELETE FROM poll_votes");
+        if (ok) {
+            SqliteStatement insert(db_,
+                "INSERT INTO poll_votes (poll_id, voter_id, options, voted_at) VALUES (?, ?, ?, ?)");
+            ok = insert.ok();
+            for (size_t i = 0; ok && i < ordered.size(); ++i) {
+                sqlite3_reset(insert.get());
+                insert.bind(1, ordered[i].poll_id);
+                insert.bind(2, ordered[i].voter_id);
+                insert.bind(3, encode_selection(ordered[i].selected_options));
+                insert.bind(4, ordered[i].voted_at);
+                ok = insert.done();
+            }
+        }
+        if (ok && exec("COMMIT")) {
+            LOG_INFO("[Polls] Vote log compacted from %zu to %zu rows", rows, ordered.size());
+        } else {
+            exec("ROLLBACK");
+        }
+    }
+    return true;
+}
+
 // ============ PollManager ============
 
 PollManager& PollManager::instance() {
@@ -155,57 +472,95 @@ PollManager& PollManager::instance() {
     return manager;
 }
 
+PollManager::PollState* PollManager::find(const std::string& poll_id) {
+    std::map<std::string, PollState>::iterator it = polls_.find(poll_id);
+    return it != polls_.end() ? &it->second : NULL;
+}
+
+const PollManager::PollState* PollManager::find(const std::string& poll_id) const {
+    std::map<std::string, PollState>::const_iterator it = polls_.find(poll_id);
+    return it != polls_.end() ? &it->second : NULL;
+}
+
+void PollManager::add_vote(PollState& state, const PollVote& vote) {
+    for (size_t i = 0; i < vote.selected_options.size(); ++i) {
+        int opt = vote.selected_options[i];
+        if (opt >= 0 && opt < static_cast<int>(state.counts.size())) state.counts[opt]++;
+    }
+    state.votes[vote.voter_id] = vote;
+}
+
+void PollManager::persist(PollStore::Change::Kind kind, const Poll* poll, const PollVote* vote) {
+    if (!store_.is_open()) return;
+    PollStore::Change change;
+    change.kind = kind;
+    if (poll) change.poll = *poll;
+    if (vote) change.vote = *vote;
+    store_.enqueue(change);
+}
+
 Poll& PollManager::create_poll(const PollInput& input, const PollNormalizeOptions& options) {
     Poll poll = normalize_poll(input, options);
-    polls_[poll.id] = poll;
-    votes_[poll.id] = std::vector<PollVote>();
-    return polls_[poll.id];
+    std::lock_guard<std::mutex> lock(mutex_);
+    PollState& state = polls_[poll.id];
+    state.poll = poll;
+    state.counts.assign(poll.options.size(), 0);
+    persist(PollStore::Change::SAVE_POLL, &poll, NULL);
+    return state.poll;
 }
 
 Poll* PollManager::get_poll(const std::string& poll_id) {
-    std::map<std::string, Poll>::iterator it = polls_.find(poll_id);
-    return it != polls_.end() ? &it->second : NULL;
+    std::lock_guard<std::mutex> lock(mutex_);
+    PollState* state = find(poll_id);
+    return state ? &state->poll : NULL;
 }
 
 const Poll* PollManager::get_poll(const std::string& poll_id) const {
-    std::map<std::string, Poll>::const_iterator it = polls_.find(poll_id);
-    return it != polls_.end() ? &it->second : NULL;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const PollState* state = find(poll_id);
+    return state ? &state->poll : NULL;
 }
 
 bool PollManager::has_poll(const std::string& poll_id) const {
-    return polls_.find(poll_id) != polls_.end();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return find(poll_id) != NULL;
 }
 
 bool PollManager::close_poll(const std::string& poll_id) {
-    Poll* poll = get_poll(poll_id);
-    if (!poll) return false;
-    poll->is_closed = true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    PollState* state = find(poll_id);
+    if (!state) return false;
+    state->poll.is_closed = true;
+    persist(PollStore::Change::SAVE_POLL, &state->poll, NULL);
     return true;
 }
 
 bool PollManager::delete_poll(const std::string& poll_id) {
-    if (!has_poll(poll_id)) return false;
-    polls_.erase(poll_id);
-    votes_.erase(poll_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!polls_.erase(poll_id)) return false;
+    PollVote key;
+    key.poll_id = poll_id;
+    persist(PollStore::Change::DELETE_POLL, NULL, &key);
     return true;
 }
 
 std::string PollManager::vote(const std::string& poll_id,
                               const std::string& voter_id,
                               const std::vector<int>& selected_options) {
-    Poll* poll = get_poll(poll_id);
-    if (!poll) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PollState* state = find(poll_id);
+    if (!state) {
         return "Poll not found";
     }
     
     // Validate the vote
-    std::string error = validate_vote(*poll, selected_options);
+    std::string error = validate_vote(state->poll, selected_options);
     if (!error.empty()) {
         return error;
     }
     
     // Check if already voted
-    if (has_voted(poll_id, voter_id)) {
+    if (state->votes.count(voter_id)) {
         return "You have already voted in this poll";
     }
     
@@ -216,97 +571,149 @@ std::string PollManager::vote(const std::string& poll_id,
     vote_record.selected_options = selected_options;
     vote_record.voted_at = current_timestamp();
     
-    votes_[poll_id].push_back(vote_record);
+    add_vote(*state, vote_record);
+    persist(PollStore::Change::VOTE, NULL, &vote_record);
     
     return "";  // Success
 }
 
-PollResults PollManager::get_results(const std::string& poll_id) const {
-    PollResults results;
-    results.poll_id = poll_id;
+std::string PollManager::retract_vote(const std::string& poll_id, const std::string& voter_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PollState* state = find(poll_id);
+    if (!state) {
+        return "Poll not found";
+    }
+    if (!state->poll.is_active()) {
+        return "Poll is no longer active";
+    }
     
-    const Poll* poll = get_poll(poll_id);
-    if (!poll) {
-        return results;
+    std::unordered_map<std::string, PollVote>::iterator it = state->votes.find(voter_id);
+    if (it == state->votes.end()) {
+        return "You have not voted in this poll";
+    }
+    const std::vector<int>& selected = it->second.selected_options;
+    for (size_t i = 0; i < selected.size(); ++i) {
+        int opt = selected[i];
+        if (opt >= 0 && opt < static_cast<int>(state->counts.size())) state->counts[opt]--;
     }
     
-    // Initialize vote counts
-    results.vote_counts.resize(poll->options.size(), 0);
-    results.total_votes = 0;
+    PollVote retraction;
+    retraction.poll_id = poll_id;
+    retraction.voter_id = voter_id;
+    retraction.voted_at = current_timestamp();
+    state->votes.erase(it);
+    persist(PollStore::Change::RETRACT, NULL, &retraction);
     
-    // Count votes
-    std::map<std::string, std::vector<PollVote> >::const_iterator votes_it = votes_.find(poll_id);
-    if (votes_it == votes_.end()) {
+    return "";  // Success
+}
+
+PollResults PollManager::get_results(const std::string& poll_id, bool with_voters) const {
+    PollResults results;
+    results.poll_id = poll_id;
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    const PollState* state = find(poll_id);
+    if (!state) {
         return results;
     }
     
-    const std::vector<PollVote>& poll_votes = votes_it->second;
-    for (size_t i = 0; i < poll_votes.size(); ++i) {
-        const PollVote& v = poll_votes[i];
-        results.votes_by_voter[v.voter_id] = v.selected_options;
-        results.total_votes++;
-        
-        for (size_t j = 0; j < v.selected_options.size(); ++j) {
-            int opt = v.selected_options[j];
-            if (opt >= 0 && opt < static_cast<int>(results.vote_counts.size())) {
-                results.vote_counts[opt]++;
-            }
+    results.vote_counts = state->counts;
+    results.total_votes = static_cast<int>(state->votes.size());
+    if (with_voters) {
+        for (std::unordered_map<std::string, PollVote>::const_iterator it = state->votes.begin();
+             it != state->votes.end(); ++it) {
+            results.votes_by_voter[it->first] = it->second.selected_options;
         }
     }
     
     return results;
 }
 
+size_t PollManager::voter_count(const std::string& poll_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const PollState* state = find(poll_id);
+    return state ? state->votes.size() : 0;
+}
+
 bool PollManager::has_voted(const std::string& poll_id, const std::string& voter_id) const {
-    std::map<std::string, std::vector<PollVote> >::const_iterator it = votes_.find(poll_id);
-    if (it == votes_.end()) return false;
-    
-    const std::vector<PollVote>& poll_votes = it->second;
-    return std::any_of(poll_votes.begin(), poll_votes.end(),
-        [&voter_id](const PollVote& vote) { return vote.voter_id == voter_id; });
+    std::lock_guard<std::mutex> lock(mutex_);
+    const PollState* state = find(poll_id);
+    return state && state->votes.count(voter_id) > 0;
 }
 
 std::vector<int> PollManager::get_voter_selection(const std::string& poll_id, const std::string& voter_id) const {
-    std::map<std::string, std::vector<PollVote> >::const_iterator it = votes_.find(poll_id);
-    if (it == votes_.end()) return std::vector<int>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    const PollState* state = find(poll_id);
+    if (!state) return std::vector<int>();
     
-    const std::vector<PollVote>& poll_votes = it->second;
-    auto it_vote = std::find_if(poll_votes.begin(), poll_votes.end(),
-        [&voter_id](const PollVote& vote) { return vote.voter_id == voter_id; });
-    if (it_vote != poll_votes.end()) {
-        return it_vote->selected_options;
-    }
-    return std::vector<int>();
+    std::unordered_map<std::string, PollVote>::const_iterator it = state->votes.find(voter_id);
+    return it != state->votes.end() ? it->second.selected_options : std::vector<int>();
 }
 
 size_t PollManager::cleanup_expired() {
-    size_t removed = 0;
     std::vector<std::string> to_remove;
-    
-    for (std::map<std::string, Poll>::iterator it = polls_.begin(); it != polls_.end(); ++it) {
-        if (it->second.is_expired()) {
-            to_remove.push_back(it->first);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::map<std::string, PollState>::iterator it = polls_.begin(); it != polls_.end(); ++it) {
+            if (it->second.poll.is_expired()) {
+                to_remove.push_back(it->first);
+            }
         }
     }
     
+    size_t removed = 0;
     for (size_t i = 0; i < to_remove.size(); ++i) {
-        delete_poll(to_remove[i]);
-        ++removed;
+        if (delete_poll(to_remove[i])) ++removed;
     }
     
     return removed;
 }
 
 std::vector<std::string> PollManager::active_poll_ids() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::vector<std::string> ids;
-    for (std::map<std::string, Poll>::const_iterator it = polls_.begin(); it != polls_.end(); ++it) {
-        if (it->second.is_active()) {
+    for (std::map<std::string, PollState>::const_iterator it = polls_.begin(); it != polls_.end(); ++it) {
+        if (it->second.poll.is_active()) {
             ids.push_back(it->first);
         }
     }
     return ids;
 }
 
+size_t PollManager::poll_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return polls_.size();
+}
+
+bool PollManager::open_store(const std::string& db_path, int flush_interval_ms) {
+    if (!store_.open(db_path, flush_interval_ms)) return false;
+    
+    std::vector<Poll> polls;
+    std::vector<PollVote> votes;
+    if (!store_.load(polls, votes)) {
+        LOG_WARN("[Polls] Could not read stored polls from %s", db_path.c_str());
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < polls.size(); ++i) {
+        PollState& state = polls_[polls[i].id];
+        state = PollState();
+        state.poll = polls[i];
+        state.counts.assign(polls[i].options.size(), 0);
+    }
+    for (size_t i = 0; i < votes.size(); ++i) {
+        PollState* state = find(votes[i].poll_id);
+        if (state) add_vote(*state, votes[i]);
+    }
+    LOG_INFO("[Polls] Loaded %zu poll(s) with %zu vote(s)", polls.size(), votes.size());
+    return true;
+}
+
+void PollManager::close_store() {
+    store_.close();
+}
+
 // ============ PollsPlugin ============
 
 PollsPlugin::PollsPlugin() {}
@@ -315,12 +722,18 @@ const char* PollsPlugin::name() const { return "polls"; }
 const char* PollsPlugin::version() const { return "1.0.0"; }
 const char* PollsPlugin::description() const { return "Poll management service"; }
 
-bool PollsPlugin::init(const Config& /*cfg*/) {
+bool PollsPlugin::init(const Config& cfg) {
+    std::string db_path = cfg.get_string("polls.db_path", "db/polls.db");
+    int flush_ms = static_cast<int>(cfg.get_int("polls.flush_ms", 200));
+    if (!db_path.empty() && !PollManager::instance().open_store(db_path, flush_ms)) {
+        LOG_WARN("[Polls] Polls are kept in memory only");
+    }
     initialized_ = true;
     return true;
 }
 
 void PollsPlugin::shutdown() {
+    PollManager::instance().close_store();
     initialized_ = false;
 }
 
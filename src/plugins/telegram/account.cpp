@@ -0,0 +1,368 @@
+/*
+ * OpenCrank C++ - Telegram Bot Account Implementation
+ */
+#include <opencrank/plugins/telegram/account.hpp>
+#include <opencrank/core/async_http.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <sstream>
+#include <chrono>
+
+namespace opencrank {
+
+namespace {
+
+// Account setting, else the channel-wide one
+std::string setting(const Config& cfg, const std::string& section, const std::string& key,
+                    const std::string& def) {
+    return cfg.get_string(section + "." + key, cfg.get_string("telegram." + key, def));
+}
+
+int64_t setting_int(const Config& cfg, const std::string& section, const std::string& key, int64_t def) {
+    return cfg.get_int(section + "." + key, cfg.get_int("telegram." + key, def));
+}
+
+} // namespace
+
+TelegramAccount::TelegramAccount(const std::string& id)
+    : id_(id)
+    , log_name_(id.empty() ? "Telegram" : "Telegram " + id)
+    , bot_id_(0)
+    , last_update_id_(0)
+    , poll_timeout_(30)
+    , poll_backoff_(30)
+    , stopping_(false)
+    , poll_pending_(false)
+    , webhook_mode_(false)
+    , listener_(NULL)
+    , update_dedup_(600, 16384) {}
+
+TelegramAccount::~TelegramAccount() {
+    stop();
+}
+
+bool TelegramAccount::configure(const Config& cfg, const std::string& section) {
+    bot_token_ = cfg.get_string(section + ".bot_token", "");
+    if (bot_token_.empty()) {
+        return false;
+    }
+    api_base_ = "https://api.telegram.org/bot" + bot_token_;
+
+    poll_timeout_ = static_cast<int>(setting_int(cfg, section, "poll_timeout", 30));
+    if (poll_timeout_ <= 0 || poll_timeout_ > 60) poll_timeout_ = 30;
+    poll_backoff_ = static_cast<int>(setting_int(cfg, section, "poll_backoff", 30));
+    if (poll_backoff_ <= 0 || poll_backoff_ > 60) poll_backoff_ = 30;
+
+    // Webhook mode (needs a public HTTPS URL proxied to the channel's listener)
+    webhook_mode_ = setting(cfg, section, "mode", "polling") == "webhook";
+    webhook_url_ = cfg.get_string(section + ".webhook_url", "");
+    webhook_secret_ = cfg.get_string(section + ".webhook_secret", "");
+    if (webhook_mode_ && webhook_url_.empty()) {
+        LOG_WARN("%s: mode=webhook needs webhook_url, using polling", log_name_.c_str());
+        webhook_mode_ = false;
+    }
+    if (webhook_mode_ && webhook_secret_.empty()) {
+        // Secret tokens allow [A-Za-z0-9_-]; a UUID fits
+        webhook_secret_ = generate_uuid();
+    }
+
+    // Serve the path of the public URL; the proxy forwards it unchanged
+    webhook_path_ = "/";
+    size_t scheme = webhook_url_.find("://");
+    size_t slash = webhook_url_.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    if (slash != std::string::npos) webhook_path_ = webhook_url_.substr(slash);
+    size_t query = webhook_path_.find('?');
+    if (query != std::string::npos) webhook_path_ = webhook_path_.substr(0, query);
+    return true;
+}
+
+std::string TelegramAccount::address(const std::string& chat_id) const {
+    return id_.empty() ? chat_id : id_ + ":" + chat_id;
+}
+
+void TelegramAccount::resume_after(int64_t update_id) {
+    if (update_id > last_update_id_.load()) {
+        last_update_id_ = update_id;
+        LOG_INFO("%s: resuming after update %lld", log_name_.c_str(), (long long)update_id);
+    }
+}
+
+bool TelegramAccount::start(TelegramWebhookServer* listener, MessageHandler on_message) {
+    on_message_ = on_message;
+    stopping_ = false;
+
+    HttpResponse resp = http_.get(api_base_ + "/getMe");
+    if (!resp.ok()) {
+        LOG_ERROR("%s: failed to connect - %s", log_name_.c_str(), resp.error.c_str());
+        return false;
+    }
+
+    Json result = resp.json();
+    if (!result.value("ok", false)) {
+        LOG_ERROR("%s: API error - %s", log_name_.c_str(),
+                  result.value("description", std::string("unknown")).c_str());
+        return false;
+    }
+
+    const Json& bot_info = result["result"];
+    bot_id_ = bot_info.value("id", int64_t(0));
+    bot_username_ = bot_info.value("username", std::string(""));
+
+    LOG_INFO("%s: connected as @%s (id=%lld)", log_name_.c_str(),
+             bot_username_.c_str(), (long long)bot_id_);
+
+    send_queue_.start(api_base_);
+
+    if (webhook_mode_ && !start_webhook(listener)) {
+        LOG_WARN("%s: webhook setup failed, falling back to polling", log_name_.c_str());
+        webhook_mode_ = false;
+    }
+    if (!webhook_mode_) {
+        start_polling();
+    }
+    return true;
+}
+
+void TelegramAccount::start_polling() {
+    // getUpdates is refused while a webhook is registered
+    HttpResponse resp = http_.get(api_base_ + "/deleteWebhook");
+    if (!resp.ok()) {
+        LOG_WARN("%s: deleteWebhook failed - %s", log_name_.c_str(), resp.error.c_str());
+    }
+
+    if (AsyncHttp::instance().running()) {
+        {
+            std::lock_guard<std::mutex> lock(poll_mutex_);
+            poll_pending_ = true;
+        }
+        poll_async(0);
+        LOG_INFO("%s: long polling on the async HTTP loop", log_name_.c_str());
+    } else {
+        poll_thread_ = std::thread(&TelegramAccount::polling_loop, this);
+        LOG_INFO("%s: polling thread started", log_name_.c_str());
+    }
+}
+
+bool TelegramAccount::start_webhook(TelegramWebhookServer* listener) {
+    if (!listener || !listener->is_open()) {
+        return false;
+    }
+    if (!listener->add_route(webhook_path_, webhook_secret_,
+                             [this](const JsonView& update) { process_update(update); })) {
+        LOG_ERROR("%s: webhook path %s is already served for another account",
+                  log_name_.c_str(), webhook_path_.c_str());
+        return false;
+    }
+
+    Json params = Json::object();
+    params["url"] = webhook_url_;
+    params["secret_token"] = webhook_secret_;
+    params["max_connections"] = 40;
+    params["allowed_updates"] = Json::array({"message", "edited_message"});
+
+    http_.set_timeout(10000);
+    HttpResponse resp = http_.post_json(api_base_ + "/setWebhook", params);
+    Json result = resp.json();
+    if (!result.is_object() || !result.value("ok", false)) {
+        std::string desc = result.is_object() ? result.value("description", resp.error) : resp.error;
+        LOG_ERROR("%s: setWebhook failed - %s", log_name_.c_str(), desc.c_str());
+        listener->remove_route(webhook_path_);
+        return false;
+    }
+
+    listener_ = listener;
+    LOG_INFO("%s: webhook registered at %s", log_name_.c_str(),
+             webhook_url_.c_str());
+    return true;
+}
+
+void TelegramAccount::fall_back_to_polling() {
+    if (!webhook_mode_) return;
+    if (listener_) {
+        listener_->remove_route(webhook_path_);
+        listener_ = NULL;
+    }
+    webhook_mode_ = false;
+    start_polling();
+}
+
+void TelegramAccount::stop() {
+    stopping_ = true;
+
+    // The poll in flight fails at once instead of at the end of its timeout
+    AsyncHttp::instance().wake_cancelled();
+    {
+        std::unique_lock<std::mutex> lock(poll_mutex_);
+        poll_done_.wait(lock, [this]() { return !poll_pending_; });
+    }
+    if (poll_thread_.joinable()) {
+        poll_thread_.join();
+        LOG_INFO("%s: polling thread stopped", log_name_.c_str());
+    }
+
+    // Telegram keeps undelivered updates while the webhook endpoint is down
+    if (listener_) {
+        listener_->remove_route(webhook_path_);
+        listener_ = NULL;
+    }
+    send_queue_.stop();
+}
+
+// ============================================================================
+// Long polling
+// ============================================================================
+
+std::string TelegramAccount::updates_url() const {
+    std::ostringstream url;
+    url << api_base_ << "/getUpdates?timeout=" << poll_timeout_;
+    int64_t last = last_update_id_.load();
+    if (last > 0) {
+        url << "&offset=" << (last + 1);
+    }
+    url << "&limit=100";
+    url << "&allowed_updates=" << "[\"message\",\"edited_message\"]";
+    return url.str();
+}
+
+void TelegramAccount::poll_async(int64_t delay_ms) {
+    AsyncHttpRequest request;
+    request.method = "GET";
+    request.url = updates_url();
+    request.timeout_ms = (poll_timeout_ + 5) * 1000L;
+    request.delay_ms = delay_ms;
+    request.cancel = &stopping_;
+    if (!AsyncHttp::instance().submit(request, [this](HttpResponse& response) { on_updates(response); })) {
+        // The loop has shut down; nothing more will arrive
+        std::lock_guard<std::mutex> lock(poll_mutex_);
+        poll_pending_ = false;
+        poll_done_.notify_all();
+    }
+}
+
+void TelegramAccount::on_updates(HttpResponse& response) {
+    // Runs on the AsyncHttp loop: updates are read in place and only emitted
+    int backoff = stopping_ ? 0 : handle_updates(response);
+    if (stopping_) {
+        std::lock_guard<std::mutex> lock(poll_mutex_);
+        poll_pending_ = false;
+        poll_done_.notify_all();
+        return;
+    }
+    poll_async(backoff * 1000L);
+}
+
+void TelegramAccount::polling_loop() {
+    LOG_INFO("%s: polling loop started", log_name_.c_str());
+
+    http_.set_timeout((poll_timeout_ + 5) * 1000);
+    while (!stopping_) {
+        HttpResponse resp = http_.get(updates_url());
+        int backoff = stopping_ ? 0 : handle_updates(resp);
+        for (int i = 0; i < backoff * 10 && !stopping_; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    LOG_INFO("%s: polling loop exited", log_name_.c_str());
+}
+
+int TelegramAccount::handle_updates(const HttpResponse& response) {
+    if (!response.ok()) {
+        LOG_WARN("%s: poll failed - %s (retrying in %ds)", log_name_.c_str(),
+                 response.error.c_str(), poll_backoff_);
+        return poll_backoff_;
+    }
+
+    // Up to 100 updates per batch; each is read in place, never as a DOM
+    JsonView result(response.body);
+    if (!result["ok"].get_bool()) {
+        LOG_WARN("%s: poll API error - %s (retrying in %ds)", log_name_.c_str(),
+                 result["description"].get_string("unknown").c_str(), poll_backoff_);
+        return poll_backoff_;
+    }
+
+    JsonView updates = result["result"];
+    for (JsonView::Iterator it = updates.begin(); it != updates.end(); ++it) {
+        process_update(*it);
+    }
+    return 0;
+}
+
+// ============================================================================
+// Updates
+// ============================================================================
+
+void TelegramAccount::process_update(const JsonView& update) {
+    int64_t update_id = update["update_id"].get_int();
+    if (update_id > last_update_id_.load()) {
+        last_update_id_ = update_id;
+    }
+    if (webhook_mode_) {
+        // Webhooks may redeliver (slow answer) and, with several connections,
+        // arrive out of order - dedupe by id rather than by high-water mark
+        if (!update_dedup_.should_process(std::to_string(update_id))) {
+            LOG_DEBUG("[Telegram] Skipping duplicate update %lld", (long long)update_id);
+            return;
+        }
+    }
+
+    JsonView msg = update["message"];
+    if (!msg.exists()) {
+        msg = update["edited_message"];
+    }
+    if (!msg.is_object()) return;
+
+    Message m;
+    m.channel = "telegram";
+    m.account_id = id_;
+    m.id = std::to_string(msg["message_id"].get_int());
+
+    JsonView chat = msg["chat"];
+    m.to = address(std::to_string(chat["id"].get_int()));
+
+    std::string chat_type = chat["type"].get_string();
+    if (chat_type == "private") {
+        m.chat_type = "direct";
+    } else if (chat_type == "group" || chat_type == "supergroup") {
+        m.chat_type = "group";
+    } else if (chat_type == "channel") {
+        m.chat_type = "channel";
+    }
+
+    JsonView from = msg["from"];
+    if (from.is_object()) {
+        m.from = std::to_string(from["id"].get_int());
+
+        std::string first = from["first_name"].get_string();
+        std::string last = from["last_name"].get_string();
+        m.from_name = first;
+        if (!last.empty()) {
+            m.from_name += " " + last;
+        }
+        std::string username = from["username"].get_string();
+        if (!username.empty()) {
+            m.from_name += " (@" + username + ")";
+        }
+    }
+
+    m.text = msg["text"].get_string();
+    if (m.text.empty()) {
+        m.text = msg["caption"].get_string();
+    }
+
+    JsonView reply = msg["reply_to_message"];
+    if (reply.is_object()) {
+        m.reply_to_id = std::to_string(reply["message_id"].get_int());
+    }
+
+    m.timestamp = msg["date"].get_int();
+
+    if (!m.text.empty()) {
+        LOG_DEBUG("[Telegram] ▶ IN  Message from %s (%s) to %s: %.200s%s",
+                  m.from_name.c_str(), m.from.c_str(), bot_username_.c_str(), m.text.c_str(),
+                  m.text.size() > 200 ? "..." : "");
+        if (on_message_) on_message_(m);
+    }
+}
+
+} // namespace opencrank
@@ -0,0 +1,265 @@
+/*
+ * OpenCrank C++ - Telegram Outbound Send Queue Implementation
+ */
+#include <opencrank/plugins/telegram/send_queue.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <future>
+#include <sstream>
+#include <chrono>
+
+namespace opencrank {
+
+namespace {
+const int MAX_ATTEMPTS = 3;
+const int CALL_TIMEOUT_SECONDS = 60;
+const int64_t IDLE_WAIT_MS = 1000;
+
+bool is_group_chat(const std::string& chat_id) {
+    return !chat_id.empty() && chat_id[0] == '-';
+}
+
+// Id of the sent message; edits report the id they targeted
+std::string message_id_of(const Json& params, const Json& result) {
+    int64_t id = params.value("message_id", int64_t(0));
+    if (result.is_object() && result.contains("result") && result["result"].is_object()) {
+        id = result["result"].value("message_id", id);
+    }
+    if (id == 0) return "";
+    std::ostringstream ss;
+    ss << id;
+    return ss.str();
+}
+} // namespace
+
+TelegramSendQueue::TelegramSendQueue()
+    : global_(30, 30)
+    , private_chats_(KeyedRateLimiter::TOKEN_BUCKET, 1, 1)
+    , group_chats_(KeyedRateLimiter::SLIDING_WINDOW, 20, 60)
+    , last_cleanup_ms_(0)
+    , stop_(true) {}
+
+TelegramSendQueue::~TelegramSendQueue() {
+    stop();
+}
+
+void TelegramSendQueue::start(const std::string& api_base) {
+    if (thread_.joinable()) return;
+    api_base_ = api_base;
+    http_.set_timeout(10000);
+    stop_ = false;
+    thread_ = std::thread(&TelegramSendQueue::sender_loop, this);
+}
+
+void TelegramSendQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+
+    std::deque<Job> leftover;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        leftover.swap(jobs_);
+        typing_pending_.clear();
+        blocked_until_.clear();
+    }
+    for (size_t i = 0; i < leftover.size(); ++i) {
+        if (leftover[i].done) leftover[i].done(SendResult::fail("channel stopped"));
+    }
+}
+
+void TelegramSendQueue::submit(const std::string& method, const std::string& chat_id,
+                               const Json& params, const std::string& plain_text, Callback done) {
+    Job job;
+    job.method = method;
+    job.chat_id = chat_id;
+    job.params = params;
+    job.plain_text = plain_text;
+    job.done = done;
+    job.counts = (method == "sendMessage");
+    job.attempts = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stop_) {
+            jobs_.push_back(job);
+            cv_.notify_one();
+            return;
+        }
+    }
+    if (done) done(SendResult::fail("channel stopped"));
+}
+
+SendResult TelegramSendQueue::call(const std::string& method, const std::string& chat_id,
+                                   const Json& params, const std::string& plain_text) {
+    std::shared_ptr<std::promise<SendResult> > promise = std::make_shared<std::promise<SendResult> >();
+    std::future<SendResult> future = promise->get_future();
+    submit(method, chat_id, params, plain_text, [promise](const SendResult& result) {
+        promise->set_value(result);
+    });
+    if (future.wait_for(std::chrono::seconds(CALL_TIMEOUT_SECONDS)) != std::future_status::ready) {
+        return SendResult::fail("send queue timeout");
+    }
+    return future.get();
+}
+
+void TelegramSendQueue::typing(const std::string& chat_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_ || typing_pending_.count(chat_id)) return;
+        typing_pending_.insert(chat_id);
+    }
+    Json params = Json::object();
+    params["chat_id"] = chat_id;
+    params["action"] = "typing";
+    submit("sendChatAction", chat_id, params, "", Callback());
+}
+
+size_t TelegramSendQueue::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.size();
+}
+
+// ============================================================================
+// Sender thread
+// ============================================================================
+
+int TelegramSendQueue::next_ready(int64_t now, int64_t& wait_ms) {
+    wait_ms = IDLE_WAIT_MS;
+
+    if (!jobs_.empty() && !global_.would_allow()) {
+        wait_ms = 1000 / 30 + 1;
+        return -1;
+    }
+
+    // A chat that cannot send yet also holds back its later jobs
+    std::set<std::string> held;
+    for (size_t i = 0; i < jobs_.size(); ++i) {
+        const Job& job = jobs_[i];
+        if (held.count(job.chat_id)) continue;
+
+        std::map<std::string, int64_t>::iterator blocked = blocked_until_.find(job.chat_id);
+        if (blocked != blocked_until_.end()) {
+            if (blocked->second > now) {
+                held.insert(job.chat_id);
+                if (blocked->second - now < wait_ms) wait_ms = blocked->second - now;
+                continue;
+            }
+            blocked_until_.erase(blocked);
+        }
+
+        if (job.counts) {
+            KeyedRateLimiter& limiter = is_group_chat(job.chat_id) ? group_chats_ : private_chats_;
+            RateLimitResult r = limiter.check(job.chat_id);
+            if (!r.allowed) {
+                blocked_until_[job.chat_id] = now + r.retry_after_ms;
+                held.insert(job.chat_id);
+                if (r.retry_after_ms < wait_ms) wait_ms = r.retry_after_ms;
+                continue;
+            }
+        }
+
+        global_.try_acquire();
+        return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void TelegramSendQueue::sender_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        int64_t now = current_timestamp_ms();
+        if (now - last_cleanup_ms_ > 60000) {
+            private_chats_.cleanup(120);
+            group_chats_.cleanup(120);
+            last_cleanup_ms_ = now;
+        }
+
+        int64_t wait_ms = IDLE_WAIT_MS;
+        int index = next_ready(now, wait_ms);
+        if (index < 0) {
+            cv_.wait_for(lock, std::chrono::milliseconds(wait_ms < 1 ? 1 : wait_ms));
+            continue;
+        }
+
+        Job job = jobs_[index];
+        jobs_.erase(jobs_.begin() + index);
+        if (job.method == "sendChatAction") typing_pending_.erase(job.chat_id);
+
+        lock.unlock();
+        bool finished = execute(job);
+        lock.lock();
+
+        if (!finished) {
+            if (stop_) {
+                lock.unlock();
+                if (job.done) job.done(SendResult::fail("channel stopped"));
+                lock.lock();
+            } else {
+                jobs_.push_front(job);
+            }
+        }
+    }
+}
+
+bool TelegramSendQueue::execute(Job& job) {
+    job.attempts++;
+    HttpResponse resp = http_.post_json(api_base_ + "/" + job.method, job.params);
+    Json result = resp.json();
+
+    if (result.is_object() && result.value("ok", false)) {
+        if (job.done) {
+            job.done(SendResult::ok(message_id_of(job.params, result)));
+        }
+        return true;
+    }
+
+    std::string desc;
+    if (result.is_object()) {
+        desc = result.value("description", std::string(""));
+    }
+    if (desc.empty()) {
+        desc = resp.error.empty() ? "HTTP " + std::to_string(resp.status_code) : resp.error;
+    }
+
+    // Flood control: park the chat and retry later
+    if (resp.status_code == 429 && job.attempts < MAX_ATTEMPTS) {
+        int64_t retry_after = 1;
+        if (result.is_object() && result.contains("parameters") && result["parameters"].is_object()) {
+            retry_after = result["parameters"].value("retry_after", int64_t(1));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            blocked_until_[job.chat_id] = current_timestamp_ms() + retry_after * 1000;
+        }
+        LOG_WARN("[Telegram] Rate limited on %s for chat %s, retrying in %llds",
+                 job.method.c_str(), job.chat_id.c_str(), (long long)retry_after);
+        return false;
+    }
+
+    if (job.method == "editMessageText" && desc.find("message is not modified") != std::string::npos) {
+        if (job.done) job.done(SendResult::ok(message_id_of(job.params, Json())));
+        return true;
+    }
+
+    // Partial markdown can produce unbalanced HTML; fall back to plain text
+    if (desc.find("can't parse entities") != std::string::npos && job.params.contains("parse_mode")) {
+        job.params["text"] = job.plain_text;
+        job.params.erase("parse_mode");
+        job.attempts--;
+        return execute(job);
+    }
+
+    if (job.method == "sendChatAction") {
+        LOG_DEBUG("[Telegram] Typing action failed for %s: %s", job.chat_id.c_str(), desc.c_str());
+    }
+    if (job.done) {
+        job.done(SendResult::fail((resp.status_code == 0 ? "HTTP error: " : "API error: ") + desc));
+    }
+    return true;
+}
+
+} // namespace opencrank
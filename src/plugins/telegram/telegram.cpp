@@ -1,7 +1,7 @@
 #include <opencrank/plugins/telegram/telegram.hpp>
 #include <opencrank/core/loader.hpp>
-#include <sstream>
-#include <chrono>
+#include <opencrank/core/utils.hpp>
+#include <thread>
 
 namespace opencrank {
 
@@ -156,10 +156,7 @@ std::string markdown_to_html(const std::string& text) {
 
 TelegramChannel::TelegramChannel() 
     : status_(ChannelStatus::STOPPED)
-    , last_update_id_(0)
-    , poll_timeout_(30)
-    , poll_backoff_(30)
-    , should_stop_polling_(false) {}
+    , webhook_port_(8443) {}
 
 const char* TelegramChannel::name() const { return "telegram"; }
 const char* TelegramChannel::version() const { return "1.0.0"; }
@@ -174,28 +171,48 @@ ChannelCapabilities TelegramChannel::capabilities() const {
     caps.supports_edit = true;
     caps.supports_delete = true;
     caps.supports_typing = true;
+    caps.async_sends = true;      // Send queue shapes to the API limits
     return caps;
 }
 
 bool TelegramChannel::init(const Config& cfg) {
-    bot_token_ = cfg.get_channel_string("telegram", "bot_token");
+    accounts_.clear();
     
-    if (bot_token_.empty()) {
+    // The top-level bot_token is the default account, chats addressed by bare id
+    std::unique_ptr<TelegramAccount> main_account(new TelegramAccount(""));
+    if (main_account->configure(cfg, "telegram")) {
+        accounts_.push_back(std::move(main_account));
+    }
+    
+    // Named accounts; their ids prefix chat addresses and session keys
+    const Json& named = cfg.get_section("telegram.accounts");
+    if (named.is_object()) {
+        for (Json::const_iterator it = named.begin(); it != named.end(); ++it) {
+            const std::string& id = it.key();
+            bool valid = !id.empty() && id.find_first_not_of(
+                "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") == std::string::npos;
+            if (!valid) {
+                LOG_WARN("Telegram: account id '%s' skipped (use letters, digits, '_' and '-')", id.c_str());
+                continue;
+            }
+            std::unique_ptr<TelegramAccount> account(new TelegramAccount(id));
+            if (!account->configure(cfg, "telegram.accounts." + id)) {
+                LOG_WARN("Telegram: account '%s' has no bot_token, skipped", id.c_str());
+                continue;
+            }
+            accounts_.push_back(std::move(account));
+        }
+    }
+    
+    if (accounts_.empty()) {
         LOG_WARN("Telegram: bot_token not configured in config.json");
         return false;
     }
     
-    api_base_ = "https://api.telegram.org/bot" + bot_token_;
-    // poll_timeout_ logic unchanged
-    poll_timeout_ = static_cast<int>(cfg.get_channel_string("telegram", "poll_timeout", "30")[0] - '0') * 10;
-    if (poll_timeout_ <= 0 || poll_timeout_ > 60) poll_timeout_ = 30;
-
-    // Read poll_backoff from config, default 30
-    std::string backoff_str = cfg.get_channel_string("telegram", "poll_backoff", "30");
-    poll_backoff_ = std::stoi(backoff_str);
-    if (poll_backoff_ <= 0 || poll_backoff_ > 60) poll_backoff_ = 30;
-
-    LOG_INFO("Telegram: initialized with poll_timeout=%d, poll_backoff=%d", poll_timeout_, poll_backoff_);
+    webhook_bind_ = cfg.get_channel_string("telegram", "webhook_bind", "127.0.0.1");
+    webhook_port_ = static_cast<int>(cfg.get_int("telegram.webhook_port", 8443));
+    
+    LOG_INFO("Telegram: initialized with %zu bot account(s)", accounts_.size());
     initialized_ = true;
     return true;
 }
@@ -214,33 +231,45 @@ bool TelegramChannel::start() {
     
     status_ = ChannelStatus::STARTING;
     
-    HttpResponse resp = http_.get(api_base_ + "/getMe");
-    if (!resp.ok()) {
-        LOG_ERROR("Telegram: failed to connect - %s", resp.error.c_str());
-        status_ = ChannelStatus::ERROR;
-        return false;
+    bool any_webhook = false;
+    for (size_t i = 0; i < accounts_.size(); ++i) {
+        any_webhook = any_webhook || accounts_[i]->wants_webhook();
+    }
+    if (any_webhook && !webhook_.open(webhook_bind_, webhook_port_)) {
+        LOG_WARN("Telegram: webhook listener unavailable, webhook accounts will poll");
     }
     
-    Json result = resp.json();
-    if (!result.value("ok", false)) {
-        LOG_ERROR("Telegram: API error - %s", result.value("description", std::string("unknown")).c_str());
+    // Each account checks in with its own bot; N bots start side by side
+    TelegramAccount::MessageHandler on_message = [this](const Message& msg) { emit_message(msg); };
+    std::vector<char> started(accounts_.size(), 0);
+    std::vector<std::thread> starters;
+    for (size_t i = 1; i < accounts_.size(); ++i) {
+        starters.push_back(std::thread([this, i, &started, &on_message]() {
+            started[i] = accounts_[i]->start(&webhook_, on_message) ? 1 : 0;
+        }));
+    }
+    started[0] = accounts_[0]->start(&webhook_, on_message) ? 1 : 0;
+    for (size_t i = 0; i < starters.size(); ++i) {
+        starters[i].join();
+    }
+    
+    // Bots that could not check in are dropped; sends to them fail at once
+    std::vector<std::unique_ptr<TelegramAccount> > running;
+    for (size_t i = 0; i < accounts_.size(); ++i) {
+        if (started[i]) {
+            running.push_back(std::move(accounts_[i]));
+        } else if (!accounts_[i]->id().empty()) {
+            LOG_WARN("Telegram: account '%s' failed to start, skipped", accounts_[i]->id().c_str());
+        }
+    }
+    accounts_.swap(running);
+    if (accounts_.empty()) {
+        webhook_.close();
         status_ = ChannelStatus::ERROR;
         return false;
     }
     
-    const Json& bot_info = result["result"];
-    bot_id_ = bot_info.value("id", int64_t(0));
-    bot_username_ = bot_info.value("username", std::string(""));
-    
-    LOG_INFO("Telegram: connected as @%s (id=%lld)", 
-             bot_username_.c_str(), (long long)bot_id_);
-    
-    // Start polling thread
-    should_stop_polling_ = false;
-    poll_thread_ = std::thread(&TelegramChannel::polling_loop, this);
-    
     status_ = ChannelStatus::RUNNING;
-    LOG_INFO("Telegram: polling thread started");
     return true;
 }
 
@@ -249,223 +278,167 @@ bool TelegramChannel::stop() {
     
     status_ = ChannelStatus::STOPPING;
     
-    // Stop polling thread
-    should_stop_polling_ = true;
-    if (poll_thread_.joinable()) {
-        poll_thread_.join();
-        LOG_INFO("Telegram: polling thread stopped");
+    for (size_t i = 0; i < accounts_.size(); ++i) {
+        accounts_[i]->stop();
     }
+    webhook_.close();
     
     status_ = ChannelStatus::STOPPED;
     LOG_INFO("Telegram: stopped");
     return true;
 }
 
+Json TelegramChannel::save_state() const {
+    Json state = Json::object();
+    Json named = Json::object();
+    for (size_t i = 0; i < accounts_.size(); ++i) {
+        if (accounts_[i]->id().empty()) {
+            state["last_update_id"] = accounts_[i]->last_update_id();
+        } else {
+            named[accounts_[i]->id()] = accounts_[i]->last_update_id();
+        }
+    }
+    if (!named.empty()) state["accounts"] = named;
+    return state;
+}
+
+void TelegramChannel::restore_state(const Json& state) {
+    TelegramAccount* main_account = find_account("");
+    if (main_account) {
+        main_account->resume_after(json_utils::get_int(state, "last_update_id", 0));
+    }
+    if (state.contains("accounts") && state["accounts"].is_object()) {
+        const Json& named = state["accounts"];
+        for (Json::const_iterator it = named.begin(); it != named.end(); ++it) {
+            TelegramAccount* account = find_account(it.key());
+            if (account && it.value().is_number_integer()) {
+                account->resume_after(it.value().get<int64_t>());
+            }
+        }
+    }
+}
+
 ChannelStatus TelegramChannel::status() const { return status_; }
 
+TelegramAccount* TelegramChannel::find_account(const std::string& id) const {
+    for (size_t i = 0; i < accounts_.size(); ++i) {
+        if (accounts_[i]->id() == id) return accounts_[i].get();
+    }
+    return NULL;
+}
+
+TelegramAccount* TelegramChannel::account_for(const std::string& to, std::string& chat_id) const {
+    // Chat ids are numbers or @usernames, so a ':' marks an account prefix
+    size_t colon = to.find(':');
+    if (colon == std::string::npos) {
+        chat_id = to;
+        return find_account("");
+    }
+    chat_id = to.substr(colon + 1);
+    return find_account(to.substr(0, colon));
+}
+
 SendResult TelegramChannel::send_message(const std::string& to, const std::string& text) {
-    return send_message_impl(to, text, 0);
+    return send_message(to, text, "");
 }
 
 SendResult TelegramChannel::send_message(const std::string& to, const std::string& text,
                                          const std::string& reply_to) {
+    std::string chat_id;
+    TelegramAccount* account = account_for(to, chat_id);
+    if (!account) {
+        return SendResult::fail("Telegram: no bot account for " + to);
+    }
     int64_t reply_id = 0;
     if (!reply_to.empty()) {
         reply_id = std::strtoll(reply_to.c_str(), NULL, 10);
     }
-    return send_message_impl(to, text, reply_id);
-}
-
-SendResult TelegramChannel::send_typing_action(const std::string& to) {
-    Json params = Json::object();
-    params["chat_id"] = to;
-    params["action"] = "typing";
-    
-    LOG_DEBUG("[Telegram] ◀ OUT Sending typing action to chat_id=%s", to.c_str());
-    
-    // Use a quick timeout for typing actions (they're fire-and-forget)
-    http_send_.set_timeout(3000);
-    HttpResponse resp = http_send_.post_json(api_base_ + "/sendChatAction", params);
-    
-    if (!resp.ok()) {
-        LOG_WARN("Telegram: typing action HTTP failed - %s", resp.error.c_str());
-        return SendResult::fail("HTTP error: " + resp.error);
-    }
-    
-    Json result = resp.json();
-    bool api_ok = result.value("ok", false);
-    
-    if (!api_ok) {
-        std::string desc = result.value("description", std::string("unknown"));
-        LOG_WARN("Telegram: typing action API error - %s (chat_id=%s)", desc.c_str(), to.c_str());
-        return SendResult::fail("API error: " + desc);
+    SendResult result = account->send_queue().call("sendMessage", chat_id,
+                                                   send_params(chat_id, text, reply_id), text);
+    if (result.success) {
+        LOG_DEBUG("[Telegram] ◀ OUT Sent message to %s (id=%s, %zu chars)",
+                  to.c_str(), result.message_id.c_str(), text.size());
     }
-    
-    LOG_DEBUG("[Telegram] ◀ OUT Typing action sent to %s", to.c_str());
-    return SendResult::ok("");
+    return result;
 }
 
-void TelegramChannel::poll() {
-    // If the polling thread is running, skip - it handles polling already.
-    // This prevents the main event loop from calling poll() concurrently,
-    // which would cause curl handle conflicts on the shared http_ instance.
-    if (poll_thread_.joinable() && !should_stop_polling_) {
+void TelegramChannel::send_message_async(const std::string& to, const std::string& text,
+                                         const std::string& reply_to, SendCallback done) {
+    std::string chat_id;
+    TelegramAccount* account = account_for(to, chat_id);
+    if (!account) {
+        if (done) done(SendResult::fail("Telegram: no bot account for " + to));
         return;
     }
-
-    poll_tick();
+    int64_t reply_id = 0;
+    if (!reply_to.empty()) {
+        reply_id = std::strtoll(reply_to.c_str(), NULL, 10);
+    }
+    account->send_queue().submit("sendMessage", chat_id, send_params(chat_id, text, reply_id), text, done);
 }
 
-void TelegramChannel::poll_tick() {
-    std::ostringstream url;
-    url << api_base_ << "/getUpdates?timeout=" << poll_timeout_;
-    if (last_update_id_ > 0) {
-        url << "&offset=" << (last_update_id_ + 1);
+SendResult TelegramChannel::edit_message(const std::string& to, const std::string& message_id,
+                                         const std::string& text) {
+    std::string chat_id;
+    TelegramAccount* account = account_for(to, chat_id);
+    if (!account) {
+        return SendResult::fail("Telegram: no bot account for " + to);
     }
-    url << "&allowed_updates=" << "[\"message\",\"edited_message\"]";
-
-    http_.set_timeout((poll_timeout_ + 5) * 1000);
-
-    HttpResponse resp = http_.get(url.str());
+    Json params = Json::object();
+    params["chat_id"] = chat_id;
+    params["message_id"] = std::strtoll(message_id.c_str(), NULL, 10);
+    params["text"] = markdown_to_html(text);
+    params["parse_mode"] = "HTML";
     
-    if (!resp.ok()) {
-        if (!should_stop_polling_) {
-            LOG_WARN("Telegram: poll failed - %s (retrying in %ds)", resp.error.c_str(), poll_backoff_);
-            std::this_thread::sleep_for(std::chrono::seconds(poll_backoff_));
-        }
-        return;
+    // Edits come from worker threads while streaming; the queue serializes
+    // them with sends and keeps them in order per chat
+    SendResult result = account->send_queue().call("editMessageText", chat_id, params, text);
+    if (result.success) {
+        LOG_DEBUG("[Telegram] ◀ OUT Edited message %s in %s (%zu chars)",
+                  message_id.c_str(), to.c_str(), text.size());
     }
+    return result;
+}
 
-    Json result = resp.json();
-    if (!result.value("ok", false)) {
-        LOG_WARN("Telegram: poll API error - %s (retrying in %ds)", result.value("description", std::string("unknown")).c_str(), poll_backoff_);
-        std::this_thread::sleep_for(std::chrono::seconds(poll_backoff_));
-        return;
-    }
+SendResult TelegramChannel::send_typing_action(const std::string& to) {
+    LOG_DEBUG("[Telegram] ◀ OUT Queueing typing action for chat_id=%s", to.c_str());
     
-    if (result.contains("result") && result["result"].is_array()) {
-        for (const auto& update : result["result"]) {
-            process_update(update);
-        }
+    std::string chat_id;
+    TelegramAccount* account = account_for(to, chat_id);
+    if (!account) {
+        return SendResult::fail("Telegram: no bot account for " + to);
     }
+    // Fire-and-forget: a late or dropped indicator is harmless
+    account->send_queue().typing(chat_id);
+    return SendResult::ok("");
 }
 
-void TelegramChannel::polling_loop() {
-    LOG_INFO("Telegram: polling loop started");
-    
-    while (!should_stop_polling_ && status_ == ChannelStatus::RUNNING) {
-        poll_tick();
+bool TelegramChannel::attach_reactor(Reactor& reactor) {
+    if (!webhook_.is_open()) {
+        return true;   // Accounts long poll by themselves (or channel not started)
     }
     
-    LOG_INFO("Telegram: polling loop exited");
+    // Updates are handled on the reactor; accounts only emit them
+    if (!webhook_.attach(reactor)) {
+        LOG_WARN("Telegram: cannot watch webhook socket, falling back to polling");
+        webhook_.close();
+        for (size_t i = 0; i < accounts_.size(); ++i) {
+            accounts_[i]->fall_back_to_polling();
+        }
+    }
+    return true;
 }
 
-SendResult TelegramChannel::send_message_impl(const std::string& to, const std::string& text, int64_t reply_to) {
+Json TelegramChannel::send_params(const std::string& chat_id, const std::string& text, int64_t reply_to) {
     Json params = Json::object();
-    params["chat_id"] = to;
+    params["chat_id"] = chat_id;
     params["text"] = markdown_to_html(text);
     params["parse_mode"] = "HTML";
     
     if (reply_to > 0) {
         params["reply_to_message_id"] = reply_to;
     }
-    
-    // Use separate http_send_ instance with 10s timeout
-    http_send_.set_timeout(10000);
-    HttpResponse resp = http_send_.post_json(api_base_ + "/sendMessage", params);
-    
-    if (!resp.ok()) {
-        return SendResult::fail("HTTP error: " + resp.error);
-    }
-    
-    Json result = resp.json();
-    if (!result.value("ok", false)) {
-        return SendResult::fail("API error: " + result.value("description", std::string("unknown")));
-    }
-    
-    std::ostringstream msg_id;
-    msg_id << result["result"].value("message_id", int64_t(0));
-    
-    LOG_DEBUG("[Telegram] ◀ OUT Sent message to %s (id=%s, %zu chars)", 
-              to.c_str(), msg_id.str().c_str(), text.size());
-    return SendResult::ok(msg_id.str());
-}
-
-void TelegramChannel::process_update(const Json& update) {
-    int64_t update_id = update.value("update_id", int64_t(0));
-    if (update_id > last_update_id_) {
-        last_update_id_ = update_id;
-    }
-    
-    const Json* msg_ptr = nullptr;
-    if (update.contains("message")) {
-        msg_ptr = &update["message"];
-    } else if (update.contains("edited_message")) {
-        msg_ptr = &update["edited_message"];
-    }
-    
-    if (!msg_ptr || msg_ptr->is_null()) return;
-    const Json& msg = *msg_ptr;
-    
-    Message m;
-    m.channel = "telegram";
-    
-    std::ostringstream id_ss;
-    id_ss << msg.value("message_id", int64_t(0));
-    m.id = id_ss.str();
-    
-    const Json& chat = msg["chat"];
-    std::ostringstream chat_id;
-    chat_id << chat.value("id", int64_t(0));
-    m.to = chat_id.str();
-    
-    std::string chat_type = chat.value("type", std::string(""));
-    if (chat_type == "private") {
-        m.chat_type = "direct";
-    } else if (chat_type == "group" || chat_type == "supergroup") {
-        m.chat_type = "group";
-    } else if (chat_type == "channel") {
-        m.chat_type = "channel";
-    }
-    
-    if (msg.contains("from") && !msg["from"].is_null()) {
-        const Json& from = msg["from"];
-        std::ostringstream from_id;
-        from_id << from.value("id", int64_t(0));
-        m.from = from_id.str();
-        
-        std::string first = from.value("first_name", std::string(""));
-        std::string last = from.value("last_name", std::string(""));
-        m.from_name = first;
-        if (!last.empty()) {
-            m.from_name += " " + last;
-        }
-        std::string username = from.value("username", std::string(""));
-        if (!username.empty()) {
-            m.from_name += " (@" + username + ")";
-        }
-    }
-    
-    m.text = msg.value("text", std::string(""));
-    if (m.text.empty()) {
-        m.text = msg.value("caption", std::string(""));
-    }
-    
-    if (msg.contains("reply_to_message") && !msg["reply_to_message"].is_null()) {
-        const Json& reply = msg["reply_to_message"];
-        std::ostringstream reply_id;
-        reply_id << reply.value("message_id", int64_t(0));
-        m.reply_to_id = reply_id.str();
-    }
-    
-    m.timestamp = msg.value("date", int64_t(0));
-    
-    if (!m.text.empty()) {
-        LOG_DEBUG("[Telegram] ▶ IN  Message from %s (%s): %.200s%s", 
-                  m.from_name.c_str(), m.from.c_str(), m.text.c_str(),
-                  m.text.size() > 200 ? "..." : "");
-        emit_message(m);
-    }
+    return params;
 }
 
 } // namespace opencrank
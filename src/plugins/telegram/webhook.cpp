@@ -0,0 +1,73 @@
+/*
+ * OpenCrank C++ - Telegram Webhook Listener Implementation
+ */
+#include <opencrank/plugins/telegram/webhook.hpp>
+#include <opencrank/core/logger.hpp>
+
+namespace opencrank {
+
+TelegramWebhookServer::TelegramWebhookServer() {}
+
+TelegramWebhookServer::~TelegramWebhookServer() {
+    close();
+}
+
+bool TelegramWebhookServer::open(const std::string& bind_address, int port) {
+    if (!listener_.open("Telegram", "telegram.webhook", bind_address, port)) return false;
+    LOG_INFO("[Telegram] Webhook listening on %s:%d", bind_address.c_str(), port);
+    return true;
+}
+
+bool TelegramWebhookServer::add_route(const std::string& path, const std::string& secret,
+                                      UpdateHandler handler) {
+    Route route;
+    route.secret = secret;
+    route.handler = handler;
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    return routes_.insert(std::make_pair(path.empty() ? std::string("/") : path, route)).second;
+}
+
+void TelegramWebhookServer::remove_route(const std::string& path) {
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    routes_.erase(path.empty() ? std::string("/") : path);
+}
+
+bool TelegramWebhookServer::attach(Reactor& reactor) {
+    return listener_.attach(reactor, [this](const HttpRequest& request, HttpReply& reply) {
+        handle_request(request, reply);
+    });
+}
+
+void TelegramWebhookServer::close() {
+    listener_.close();
+}
+
+void TelegramWebhookServer::handle_request(const HttpRequest& request, HttpReply& reply) {
+    Route route;
+    {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        std::map<std::string, Route>::const_iterator it = routes_.find(request.path);
+        if (it != routes_.end()) route = it->second;
+    }
+    if (request.method != "POST" || !route.handler) {
+        reply.status = 404;
+        return;
+    }
+    if (!route.secret.empty() && request.header("x-telegram-bot-api-secret-token") != route.secret) {
+        LOG_WARN("[Telegram] Webhook request with bad secret token rejected");
+        reply.status = 403;
+        return;
+    }
+
+    // Read in place from the request buffer
+    JsonView update(request.body, request.body_size);
+    if (!update.is_object()) {
+        LOG_WARN("[Telegram] Webhook body is not a JSON object");
+        reply.status = 400;
+        return;
+    }
+
+    route.handler(update);
+}
+
+} // namespace opencrank
@@ -0,0 +1,215 @@
+/*
+ * OpenCrank C++ - WhatsApp Outbound Send Queue Implementation
+ */
+#include <opencrank/plugins/whatsapp/send_queue.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+namespace opencrank {
+
+namespace {
+const int MAX_ATTEMPTS = 3;
+const int CALL_TIMEOUT_SECONDS = 60;
+const int64_t IDLE_WAIT_MS = 1000;
+} // namespace
+
+WhatsAppSendQueue::WhatsAppSendQueue()
+    : all_blocked_until_ms_(0)
+    , bucket_(20, 20)
+    , stop_(true) {}
+
+WhatsAppSendQueue::~WhatsAppSendQueue() {
+    stop();
+}
+
+void WhatsAppSendQueue::start(const Sender& sender, int per_second) {
+    if (thread_.joinable()) return;
+    sender_ = sender;
+    if (per_second < 1) per_second = 1;
+    bucket_.set_rate(per_second, per_second);
+    bucket_.reset();
+    stop_ = false;
+    thread_ = std::thread(&WhatsAppSendQueue::sender_loop, this);
+}
+
+void WhatsAppSendQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+
+    std::deque<Job> leftover;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        leftover.swap(jobs_);
+        typing_pending_.clear();
+        blocked_until_.clear();
+        all_blocked_until_ms_ = 0;
+    }
+    for (size_t i = 0; i < leftover.size(); ++i) {
+        if (leftover[i].done) leftover[i].done(SendResult::fail("channel stopped"));
+    }
+}
+
+void WhatsAppSendQueue::enqueue(const Job& job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stop_) {
+            jobs_.push_back(job);
+            cv_.notify_one();
+            return;
+        }
+    }
+    if (job.done) job.done(SendResult::fail("channel stopped"));
+}
+
+void WhatsAppSendQueue::submit(const std::string& to, const std::string& text,
+                               const std::string& reply_to, Callback done) {
+    Job job;
+    job.to = to;
+    job.text = text;
+    job.reply_to = reply_to;
+    job.typing = false;
+    job.done = done;
+    job.attempts = 0;
+    enqueue(job);
+}
+
+SendResult WhatsAppSendQueue::call(const std::string& to, const std::string& text,
+                                   const std::string& reply_to) {
+    std::shared_ptr<std::promise<SendResult> > promise = std::make_shared<std::promise<SendResult> >();
+    std::future<SendResult> future = promise->get_future();
+    submit(to, text, reply_to, [promise](const SendResult& result) {
+        promise->set_value(result);
+    });
+    if (future.wait_for(std::chrono::seconds(CALL_TIMEOUT_SECONDS)) != std::future_status::ready) {
+        return SendResult::fail("send queue timeout");
+    }
+    return future.get();
+}
+
+void WhatsAppSendQueue::typing(const std::string& to) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_ || typing_pending_.count(to)) return;
+        typing_pending_.insert(to);
+    }
+    Job job;
+    job.to = to;
+    job.typing = true;
+    job.attempts = 0;
+    enqueue(job);
+}
+
+size_t WhatsAppSendQueue::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.size();
+}
+
+// ============================================================================
+// Sender thread
+// ============================================================================
+
+void WhatsAppSendQueue::take_ready(int64_t now, std::deque<Job>& ready, int64_t& wait_ms) {
+    wait_ms = IDLE_WAIT_MS;
+    if (all_blocked_until_ms_ > now) {
+        wait_ms = all_blocked_until_ms_ - now;
+        return;
+    }
+
+    // A recipient that cannot send yet also holds back its later jobs
+    std::set<std::string> held;
+    std::deque<Job>::iterator it = jobs_.begin();
+    while (it != jobs_.end()) {
+        if (held.count(it->to)) {
+            ++it;
+            continue;
+        }
+        std::map<std::string, int64_t>::iterator blocked = blocked_until_.find(it->to);
+        if (blocked != blocked_until_.end()) {
+            if (blocked->second > now) {
+                held.insert(it->to);
+                if (blocked->second - now < wait_ms) wait_ms = blocked->second - now;
+                ++it;
+                continue;
+            }
+            blocked_until_.erase(blocked);
+        }
+        RateLimitResult token = bucket_.try_acquire();
+        if (!token.allowed) {
+            if (token.retry_after_ms + 1 < wait_ms) wait_ms = token.retry_after_ms + 1;
+            return;
+        }
+        if (it->typing) typing_pending_.erase(it->to);
+        ready.push_back(*it);
+        it = jobs_.erase(it);
+    }
+}
+
+void WhatsAppSendQueue::sender_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        std::deque<Job> ready;
+        int64_t wait_ms = IDLE_WAIT_MS;
+        take_ready(current_timestamp_ms(), ready, wait_ms);
+        if (ready.empty()) {
+            cv_.wait_for(lock, std::chrono::milliseconds(wait_ms < 1 ? 1 : wait_ms));
+            continue;
+        }
+
+        lock.unlock();
+        std::deque<Job> retry;          // Back to the front, in order
+        std::set<std::string> parked;   // Recipients parked during this batch
+        bool all_parked = false;
+        for (size_t i = 0; i < ready.size(); ++i) {
+            Job& job = ready[i];
+            if (all_parked || parked.count(job.to)) {
+                retry.push_back(job);
+                continue;
+            }
+            job.attempts++;
+            Outcome outcome = sender_(job);
+            if (outcome.retry_after_ms > 0 && job.attempts < MAX_ATTEMPTS && !stop_) {
+                LOG_WARN("[WhatsApp] Rate limited sending to %s, retrying in %lld ms",
+                         outcome.throttle_all ? "all recipients" : job.to.c_str(),
+                         (long long)outcome.retry_after_ms);
+                {
+                    std::lock_guard<std::mutex> guard(mutex_);
+                    int64_t until = current_timestamp_ms() + outcome.retry_after_ms;
+                    if (outcome.throttle_all) {
+                        all_blocked_until_ms_ = std::max(all_blocked_until_ms_, until);
+                    } else {
+                        blocked_until_[job.to] = until;
+                    }
+                }
+                if (outcome.throttle_all) all_parked = true;
+                parked.insert(job.to);
+                retry.push_back(job);
+                continue;
+            }
+            if (job.done) job.done(outcome.result);
+        }
+        lock.lock();
+
+        for (std::deque<Job>::reverse_iterator it = retry.rbegin(); it != retry.rend(); ++it) {
+            if (stop_) {
+                if (it->done) {
+                    Callback done = it->done;
+                    lock.unlock();
+                    done(SendResult::fail("channel stopped"));
+                    lock.lock();
+                }
+                continue;
+            }
+            jobs_.push_front(*it);
+        }
+    }
+}
+
+} // namespace opencrank
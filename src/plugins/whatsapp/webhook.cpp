@@ -0,0 +1,108 @@
+/*
+ * OpenCrank C++ - WhatsApp Webhook Listener Implementation
+ */
+#include <opencrank/plugins/whatsapp/webhook.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include <cstdio>
+
+namespace opencrank {
+
+WhatsAppWebhookServer::WhatsAppWebhookServer() {}
+
+WhatsAppWebhookServer::~WhatsAppWebhookServer() {
+    close();
+}
+
+bool WhatsAppWebhookServer::open(const std::string& bind_address, int port, const std::string& path,
+                                 const std::string& verify_token, const std::string& app_secret) {
+    path_ = path.empty() ? "/" : path;
+    verify_token_ = verify_token;
+    app_secret_ = app_secret;
+
+    // A hot restart hands the bound socket over; deliveries wait in it
+    if (!listener_.open("WhatsApp", "whatsapp.webhook", bind_address, port)) return false;
+    LOG_INFO("[WhatsApp] Webhook listening on %s:%d%s", bind_address.c_str(), port, path_.c_str());
+    return true;
+}
+
+bool WhatsAppWebhookServer::attach(Reactor& reactor, PayloadHandler handler) {
+    handler_ = handler;
+    return listener_.attach(reactor, [this](const HttpRequest& request, HttpReply& reply) {
+        handle_request(request, reply);
+    });
+}
+
+void WhatsAppWebhookServer::close() {
+    listener_.close();
+}
+
+// ============================================================================
+// Request handling
+// ============================================================================
+
+bool WhatsAppWebhookServer::signature_valid(const std::string& header, const std::string& payload) const {
+    if (header.compare(0, 7, "sha256=") != 0) return false;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (!HMAC(EVP_sha256(), app_secret_.data(), static_cast<int>(app_secret_.size()),
+              reinterpret_cast<const unsigned char*>(payload.data()), payload.size(),
+              digest, &digest_len)) {
+        return false;
+    }
+    std::string expected;
+    char hex[3];
+    for (unsigned int i = 0; i < digest_len; ++i) {
+        std::snprintf(hex, sizeof(hex), "%02x", digest[i]);
+        expected += hex;
+    }
+    std::string given = to_lower(header.substr(7));
+    return given.size() == expected.size() &&
+           CRYPTO_memcmp(given.data(), expected.data(), expected.size()) == 0;
+}
+
+void WhatsAppWebhookServer::handle_request(const HttpRequest& request, HttpReply& reply) {
+    if (request.path != path_) {
+        reply.status = 404;
+        return;
+    }
+
+    // Cloud API subscription handshake
+    if (request.method == "GET") {
+        if (request.query_param("hub.mode") == "subscribe" && !verify_token_.empty() &&
+            request.query_param("hub.verify_token") == verify_token_) {
+            LOG_INFO("[WhatsApp] Webhook subscription verified");
+            reply.body = request.query_param("hub.challenge");
+        } else {
+            LOG_WARN("[WhatsApp] Webhook verification with bad token rejected");
+            reply.status = 403;
+        }
+        return;
+    }
+    if (request.method != "POST") {
+        reply.status = 404;
+        return;
+    }
+
+    std::string payload(request.body, request.body_size);
+    if (!app_secret_.empty() && !signature_valid(request.header("x-hub-signature-256"), payload)) {
+        LOG_WARN("[WhatsApp] Webhook request with bad signature rejected");
+        reply.status = 401;
+        return;
+    }
+
+    JsonView json(payload);
+    if (!json.is_object()) {
+        LOG_WARN("[WhatsApp] Webhook body is not a JSON object");
+        reply.status = 400;
+        return;
+    }
+
+    if (handler_) handler_(json);
+}
+
+} // namespace opencrank
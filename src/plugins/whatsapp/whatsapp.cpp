@@ -1,15 +1,50 @@
 #include <opencrank/plugins/whatsapp/whatsapp.hpp>
 #include <opencrank/core/loader.hpp>
+#include <opencrank/core/reactor.hpp>
+#include <opencrank/core/utils.hpp>
+#include <opencrank/ai/sse.hpp>
 #include <sstream>
 #include <ctime>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
 
 namespace opencrank {
 
+namespace {
+
+// Cloud API error codes that mean "slow down" rather than "failed"
+const int CLOUD_THROUGHPUT_LIMIT = 130429;   // Account-wide messages per second
+const int CLOUD_PAIR_RATE_LIMIT = 131056;    // Too many messages to one recipient
+const int64_t THROUGHPUT_BACKOFF_MS = 1000;
+const int64_t PAIR_BACKOFF_MS = 6000;
+const int STREAM_BACKOFF_MAX_S = 30;
+
+int64_t retry_after_ms(const HttpResponse& resp, int64_t fallback) {
+    for (std::map<std::string, std::string>::const_iterator it = resp.headers.begin();
+         it != resp.headers.end(); ++it) {
+        std::string key = it->first;
+        for (size_t i = 0; i < key.size(); ++i) key[i] = static_cast<char>(std::tolower(key[i]));
+        if (key == "retry-after") {
+            long seconds = std::strtol(it->second.c_str(), NULL, 10);
+            if (seconds > 0) return static_cast<int64_t>(seconds) * 1000;
+        }
+    }
+    return fallback;
+}
+
+} // namespace
+
 WhatsAppChannel::WhatsAppChannel() 
-    : status_(ChannelStatus::STOPPED)
+    : send_rate_(20)
+    , status_(ChannelStatus::STOPPED)
     , mode_(MODE_NONE)
+    , delivery_(DELIVERY_POLL)
     , poll_interval_(5)
-    , last_poll_time_(0) {}
+    , last_poll_time_(0)
+    , should_stop_stream_(false)
+    , webhook_port_(8444)
+    , message_dedup_(600, 16384) {}
 
 const char* WhatsAppChannel::name() const { return "whatsapp"; }
 const char* WhatsAppChannel::version() const { return "1.0.0"; }
@@ -24,6 +59,7 @@ ChannelCapabilities WhatsAppChannel::capabilities() const {
     caps.supports_edit = false;
     caps.supports_delete = true;
     caps.supports_typing = true;
+    caps.async_sends = true;      // Send queue shapes to the API limits
     return caps;
 }
 
@@ -48,6 +84,37 @@ bool WhatsAppChannel::init(const Config& cfg) {
     }
     
     poll_interval_ = static_cast<int>(cfg.get_int("whatsapp.poll_interval", 5));
+    send_rate_ = static_cast<int>(cfg.get_int("whatsapp.send_rate", 20));
+    if (send_rate_ < 1) send_rate_ = 1;
+    
+    // Inbound delivery: poll (bridge default), stream (bridge SSE) or webhook
+    std::string delivery = cfg.get_channel_string("whatsapp", "mode", "poll");
+    bridge_events_ = cfg.get_channel_string("whatsapp", "bridge_events", "/events");
+    webhook_bind_ = cfg.get_channel_string("whatsapp", "webhook_bind", "127.0.0.1");
+    webhook_port_ = static_cast<int>(cfg.get_int("whatsapp.webhook_port", 8444));
+    webhook_path_ = cfg.get_channel_string("whatsapp", "webhook_path", "/whatsapp");
+    verify_token_ = cfg.get_channel_string("whatsapp", "verify_token", "");
+    app_secret_ = cfg.get_channel_string("whatsapp", "app_secret", "");
+    
+    if (delivery == "webhook") {
+        delivery_ = DELIVERY_WEBHOOK;
+        if (mode_ == MODE_CLOUD_API && verify_token_.empty()) {
+            LOG_WARN("WhatsApp: mode=webhook without verify_token, Meta cannot verify the subscription");
+        }
+        if (app_secret_.empty()) {
+            LOG_WARN("WhatsApp: webhook without app_secret accepts unsigned notifications");
+        }
+    } else if (delivery == "stream" && mode_ == MODE_BRIDGE) {
+        delivery_ = DELIVERY_STREAM;
+    } else {
+        if (delivery != "poll") {
+            LOG_WARN("WhatsApp: mode=%s not available here, using poll", delivery.c_str());
+        }
+        delivery_ = DELIVERY_POLL;
+        if (mode_ == MODE_CLOUD_API) {
+            LOG_WARN("WhatsApp: Cloud API only delivers inbound messages by webhook (set whatsapp.mode)");
+        }
+    }
     
     initialized_ = true;
     return true;
@@ -79,9 +146,26 @@ bool WhatsAppChannel::start() {
         }
     }
     
+    if (delivery_ == DELIVERY_WEBHOOK &&
+        !webhook_.open(webhook_bind_, webhook_port_, webhook_path_, verify_token_, app_secret_)) {
+        status_ = ChannelStatus::ERROR;
+        return false;
+    }
+    
+    send_queue_.start([this](const WhatsAppSendQueue::Job& job) {
+        return deliver(job);
+    }, send_rate_);
     status_ = ChannelStatus::RUNNING;
-    LOG_INFO("WhatsApp: started in %s mode", 
-             mode_ == MODE_CLOUD_API ? "Cloud API" : "Bridge");
+    
+    if (delivery_ == DELIVERY_STREAM) {
+        should_stop_stream_ = false;
+        stream_thread_ = std::thread(&WhatsAppChannel::stream_loop, this);
+    }
+    
+    LOG_INFO("WhatsApp: started in %s mode (%s delivery)", 
+             mode_ == MODE_CLOUD_API ? "Cloud API" : "Bridge",
+             delivery_ == DELIVERY_WEBHOOK ? "webhook" :
+             delivery_ == DELIVERY_STREAM ? "stream" : "poll");
     return true;
 }
 
@@ -89,6 +173,15 @@ bool WhatsAppChannel::stop() {
     if (status_ == ChannelStatus::STOPPED) return true;
     
     status_ = ChannelStatus::STOPPING;
+    
+    should_stop_stream_ = true;
+    if (stream_thread_.joinable()) {
+        stream_thread_.join();
+        LOG_INFO("WhatsApp: stream thread stopped");
+    }
+    webhook_.close();
+    send_queue_.stop();
+    
     status_ = ChannelStatus::STOPPED;
     
     LOG_INFO("WhatsApp: stopped");
@@ -97,23 +190,51 @@ bool WhatsAppChannel::stop() {
 
 ChannelStatus WhatsAppChannel::status() const { return status_; }
 
-SendResult WhatsAppChannel::send_message(const std::string& to, const std::string& text) {
-    if (mode_ == MODE_CLOUD_API) {
-        return send_cloud_api(to, text);
-    } else if (mode_ == MODE_BRIDGE) {
-        return send_bridge(to, text);
+Json WhatsAppChannel::save_state() const {
+    Json seen = Json::array();
+    std::vector<std::pair<uint64_t, int64_t> > entries = message_dedup_.snapshot();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        seen.push_back(Json::array({entries[i].first, entries[i].second}));
     }
-    return SendResult::fail("WhatsApp not configured");
+    Json state = Json::object();
+    state["seen"] = seen;
+    return state;
+}
+
+void WhatsAppChannel::restore_state(const Json& state) {
+    if (!state.contains("seen") || !state["seen"].is_array()) return;
+    std::vector<std::pair<uint64_t, int64_t> > entries;
+    const Json& seen = state["seen"];
+    for (Json::const_iterator it = seen.begin(); it != seen.end(); ++it) {
+        if (!it->is_array() || it->size() != 2 || !(*it)[0].is_number_unsigned() ||
+            !(*it)[1].is_number_integer()) {
+            continue;
+        }
+        entries.push_back(std::make_pair((*it)[0].get<uint64_t>(), (*it)[1].get<int64_t>()));
+    }
+    message_dedup_.restore(entries);
+    LOG_DEBUG("WhatsApp: %zu recent message id(s) carried over", entries.size());
+}
+
+SendResult WhatsAppChannel::send_message(const std::string& to, const std::string& text) {
+    return send_message(to, text, "");
 }
 
 SendResult WhatsAppChannel::send_message(const std::string& to, const std::string& text,
                                          const std::string& reply_to) {
-    if (mode_ == MODE_CLOUD_API) {
-        return send_cloud_api(to, text, reply_to);
-    } else if (mode_ == MODE_BRIDGE) {
-        return send_bridge(to, text, reply_to);
+    if (mode_ == MODE_NONE) {
+        return SendResult::fail("WhatsApp not configured");
     }
-    return SendResult::fail("WhatsApp not configured");
+    return send_queue_.call(to, text, reply_to);
+}
+
+void WhatsAppChannel::send_message_async(const std::string& to, const std::string& text,
+                                         const std::string& reply_to, SendCallback done) {
+    if (mode_ == MODE_NONE) {
+        if (done) done(SendResult::fail("WhatsApp not configured"));
+        return;
+    }
+    send_queue_.submit(to, text, reply_to, done);
 }
 
 SendResult WhatsAppChannel::send_typing_action(const std::string& to) {
@@ -123,33 +244,62 @@ SendResult WhatsAppChannel::send_typing_action(const std::string& to) {
         LOG_DEBUG("[WhatsApp] ◀ OUT Cloud API: typing indicator not supported");
         return SendResult::fail("Typing action not supported in Cloud API mode");
     } else if (mode_ == MODE_BRIDGE) {
-        // Bridge mode might support typing via custom endpoint
-        std::string phone = normalize_phone(to);
-        
-        Json params = Json::object();
-        params["phone"] = phone;
-        params["action"] = "typing";
-        
-        HttpResponse resp = http_.post_json(api_base_ + "/typing", params);
-        if (!resp.ok()) {
-            LOG_DEBUG("WhatsApp Bridge: typing action failed - %s", resp.error.c_str());
-            return SendResult::fail("HTTP error: " + resp.error);
-        }
-        
-        LOG_DEBUG("[WhatsApp] ◀ OUT Sent typing action to %s", to.c_str());
+        // Fire-and-forget: a late or dropped indicator is harmless
+        send_queue_.typing(to);
         return SendResult::ok("");
     }
     return SendResult::fail("WhatsApp not configured");
 }
 
+WhatsAppSendQueue::Outcome WhatsAppChannel::deliver(const WhatsAppSendQueue::Job& job) {
+    if (mode_ == MODE_CLOUD_API) {
+        return send_cloud_api(job.to, job.text, job.reply_to);
+    }
+    if (job.typing) {
+        return send_bridge_typing(job.to);
+    }
+    return send_bridge(job.to, job.text, job.reply_to);
+}
+
 void WhatsAppChannel::poll() {
     if (status_ != ChannelStatus::RUNNING) return;
     
-    if (mode_ == MODE_BRIDGE) {
+    if (mode_ == MODE_BRIDGE && delivery_ == DELIVERY_POLL) {
+        time_t now = time(NULL);
+        if (now - last_poll_time_ < poll_interval_) return;
+        last_poll_time_ = now;
         poll_bridge();
     }
 }
 
+bool WhatsAppChannel::attach_reactor(Reactor& reactor) {
+    if (delivery_ == DELIVERY_WEBHOOK) {
+        if (!webhook_.is_open()) return true;   // Channel not started
+        // Notifications are handled on the reactor; processing only emits
+        bool attached = webhook_.attach(reactor, [this](const JsonView& payload) {
+            if (status_ != ChannelStatus::RUNNING) return;
+            if (payload["object"].get_string() == "whatsapp_business_account") {
+                process_cloud_payload(payload);
+            } else {
+                process_bridge_payload(payload);
+            }
+        });
+        if (!attached) {
+            LOG_ERROR("WhatsApp: cannot watch webhook socket");
+            webhook_.close();
+        }
+        return attached;
+    }
+    
+    // Cloud API only delivers via webhook; the bridge stream has its own thread
+    if (mode_ == MODE_BRIDGE && delivery_ == DELIVERY_POLL) {
+        reactor.add_timer(poll_interval_ * 1000, [this]() {
+            if (status_ == ChannelStatus::RUNNING) poll_bridge();
+        }, true);
+    }
+    return true;
+}
+
 WhatsAppChannel::Mode WhatsAppChannel::mode() const { return mode_; }
 
 std::string WhatsAppChannel::normalize_phone(const std::string& phone) {
@@ -187,8 +337,8 @@ bool WhatsAppChannel::verify_cloud_api() {
     return true;
 }
 
-SendResult WhatsAppChannel::send_cloud_api(const std::string& to, const std::string& text,
-                                           const std::string& reply_to) {
+WhatsAppSendQueue::Outcome WhatsAppChannel::send_cloud_api(const std::string& to, const std::string& text,
+                                                           const std::string& reply_to) {
     std::string phone = normalize_phone(to);
     
     Json message = Json::object();
@@ -211,15 +361,30 @@ SendResult WhatsAppChannel::send_cloud_api(const std::string& to, const std::str
     std::map<std::string, std::string> headers;
     headers["Authorization"] = "Bearer " + access_token_;
     
-    HttpResponse resp = http_.post_json(api_base_ + "/messages", message, headers);
+    WhatsAppSendQueue::Outcome outcome;
+    HttpResponse resp = send_http_.post_json(api_base_ + "/messages", message, headers);
+    Json result = resp.json();
     
-    if (!resp.ok()) {
-        return SendResult::fail("HTTP error: " + resp.error);
+    if (result.is_object() && result.contains("error")) {
+        const Json& error = result["error"];
+        int code = error.value("code", 0);
+        if (code == CLOUD_THROUGHPUT_LIMIT) {
+            outcome.retry_after_ms = retry_after_ms(resp, THROUGHPUT_BACKOFF_MS);
+            outcome.throttle_all = true;
+        } else if (code == CLOUD_PAIR_RATE_LIMIT) {
+            outcome.retry_after_ms = retry_after_ms(resp, PAIR_BACKOFF_MS);
+        } else if (resp.status_code == 429) {
+            outcome.retry_after_ms = retry_after_ms(resp, THROUGHPUT_BACKOFF_MS);
+        }
+        outcome.result = SendResult::fail("API error: " + error.value("message", std::string("unknown error")));
+        return outcome;
     }
-    
-    Json result = resp.json();
-    if (result.contains("error")) {
-        return SendResult::fail("API error: " + result["error"].value("message", std::string("unknown error")));
+    if (!resp.ok()) {
+        if (resp.status_code == 429) {
+            outcome.retry_after_ms = retry_after_ms(resp, THROUGHPUT_BACKOFF_MS);
+        }
+        outcome.result = SendResult::fail("HTTP error: " + resp.error);
+        return outcome;
     }
     
     std::string msg_id;
@@ -228,7 +393,8 @@ SendResult WhatsAppChannel::send_cloud_api(const std::string& to, const std::str
     }
     LOG_DEBUG("[WhatsApp] ◀ OUT Sent message to %s via Cloud API (id=%s, %zu chars)", 
               phone.c_str(), msg_id.c_str(), text.size());
-    return SendResult::ok(msg_id);
+    outcome.result = SendResult::ok(msg_id);
+    return outcome;
 }
 
 bool WhatsAppChannel::verify_bridge() {
@@ -249,8 +415,8 @@ bool WhatsAppChannel::verify_bridge() {
     return true;
 }
 
-SendResult WhatsAppChannel::send_bridge(const std::string& to, const std::string& text,
-                                        const std::string& reply_to) {
+WhatsAppSendQueue::Outcome WhatsAppChannel::send_bridge(const std::string& to, const std::string& text,
+                                                        const std::string& reply_to) {
     Json message = Json::object();
     message["to"] = to;
     message["text"] = text;
@@ -258,61 +424,202 @@ SendResult WhatsAppChannel::send_bridge(const std::string& to, const std::string
         message["reply_to"] = reply_to;
     }
     
-    HttpResponse resp = http_.post_json(api_base_ + "/send", message);
+    WhatsAppSendQueue::Outcome outcome;
+    HttpResponse resp = send_http_.post_json(api_base_ + "/send", message);
     
     if (!resp.ok()) {
-        return SendResult::fail("HTTP error: " + resp.error);
+        if (resp.status_code == 429) {
+            outcome.retry_after_ms = retry_after_ms(resp, THROUGHPUT_BACKOFF_MS);
+        }
+        outcome.result = SendResult::fail("HTTP error: " + resp.error);
+        return outcome;
     }
     
     Json result = resp.json();
     if (!result.value("success", false)) {
-        return SendResult::fail("Bridge error: " + result.value("error", std::string("unknown error")));
+        outcome.result = SendResult::fail("Bridge error: " + result.value("error", std::string("unknown error")));
+        return outcome;
     }
     
     std::string msg_id = result.value("message_id", std::string(""));
     LOG_DEBUG("[WhatsApp] ◀ OUT Sent message to %s via Bridge (id=%s, %zu chars)", 
               to.c_str(), msg_id.c_str(), text.size());
-    return SendResult::ok(msg_id);
+    outcome.result = SendResult::ok(msg_id);
+    return outcome;
 }
 
-void WhatsAppChannel::poll_bridge() {
-    time_t now = time(NULL);
-    if (now - last_poll_time_ < poll_interval_) return;
-    last_poll_time_ = now;
+WhatsAppSendQueue::Outcome WhatsAppChannel::send_bridge_typing(const std::string& to) {
+    // Bridge mode might support typing via custom endpoint
+    Json params = Json::object();
+    params["phone"] = normalize_phone(to);
+    params["action"] = "typing";
+    
+    WhatsAppSendQueue::Outcome outcome;
+    HttpResponse resp = send_http_.post_json(api_base_ + "/typing", params);
+    if (!resp.ok()) {
+        LOG_DEBUG("WhatsApp Bridge: typing action failed - %s", resp.error.c_str());
+        outcome.result = SendResult::fail("HTTP error: " + resp.error);
+        return outcome;
+    }
     
+    LOG_DEBUG("[WhatsApp] ◀ OUT Sent typing action to %s", to.c_str());
+    outcome.result = SendResult::ok("");
+    return outcome;
+}
+
+void WhatsAppChannel::poll_bridge() {
     HttpResponse resp = http_.get(api_base_ + "/messages");
     if (!resp.ok()) {
         LOG_WARN("WhatsApp: poll failed - %s", resp.error.c_str());
         return;
     }
     
-    Json result = resp.json();
-    if (result.contains("messages") && result["messages"].is_array()) {
-        for (const auto& msg : result["messages"]) {
-            process_bridge_message(msg);
+    process_bridge_payload(JsonView(resp.body));
+}
+
+void WhatsAppChannel::stream_loop() {
+    LOG_INFO("WhatsApp: stream thread started (%s%s)", api_base_.c_str(), bridge_events_.c_str());
+    
+    int backoff = 1;
+    while (!should_stop_stream_ && status_ == ChannelStatus::RUNNING) {
+        // Fetch what arrived while disconnected, then follow the stream
+        poll_bridge();
+        if (stream_bridge()) backoff = 1;
+        if (should_stop_stream_) break;
+        
+        LOG_WARN("WhatsApp: event stream closed, reconnecting in %ds", backoff);
+        for (int i = 0; i < backoff * 10 && !should_stop_stream_; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
+        backoff = std::min(backoff * 2, STREAM_BACKOFF_MAX_S);
+    }
+    
+    LOG_INFO("WhatsApp: stream thread exited");
+}
+
+bool WhatsAppChannel::stream_bridge() {
+    bool received = false;
+    SseParser parser([this, &received](const std::string& event, const std::string& data) {
+        received = true;
+        if (event == "ping" || data.empty()) return true;
+        JsonView payload(data);
+        if (payload.is_object()) {
+            process_bridge_payload(payload);
+        } else {
+            LOG_WARN("WhatsApp: bad stream event (%zu bytes)", data.size());
+        }
+        return !should_stop_stream_;
+    });
+    
+    std::map<std::string, std::string> headers;
+    headers["Accept"] = "text/event-stream";
+    
+    // No overall deadline: the subscription stays open until the bridge or
+    // stop() ends it
+    http_.set_timeout(0);
+    http_.set_cancel(&should_stop_stream_);
+    HttpResponse resp = http_.get_sink(api_base_ + bridge_events_, headers, "",
+                                       [&parser](const char* data, size_t len) {
+        return parser.feed(data, len);
+    });
+    http_.set_cancel(NULL);
+    http_.set_timeout(60000);
+    
+    if (!resp.ok() && !should_stop_stream_) {
+        LOG_WARN("WhatsApp: event stream failed - %s", resp.error.c_str());
     }
+    return received;
 }
 
-void WhatsAppChannel::process_bridge_message(const Json& msg) {
+void WhatsAppChannel::process_bridge_payload(const JsonView& payload) {
+    if (!payload.is_object()) return;
+    JsonView messages = payload["messages"];
+    if (messages.is_array()) {
+        for (JsonView::Iterator it = messages.begin(); it != messages.end(); ++it) {
+            process_bridge_message(*it);
+        }
+    } else if (payload["id"].exists()) {
+        process_bridge_message(payload);
+    }
+}
+
+void WhatsAppChannel::process_cloud_payload(const JsonView& payload) {
+    JsonView entries = payload["entry"];
+    for (JsonView::Iterator entry = entries.begin(); entry != entries.end(); ++entry) {
+        JsonView changes = (*entry)["changes"];
+        for (JsonView::Iterator change = changes.begin(); change != changes.end(); ++change) {
+            JsonView value = (*change)["value"];
+            JsonView messages = value["messages"];
+            if (!messages.is_array()) continue;
+            
+            std::map<std::string, std::string> names;
+            JsonView contacts = value["contacts"];
+            for (JsonView::Iterator contact = contacts.begin(); contact != contacts.end(); ++contact) {
+                JsonView profile = (*contact)["profile"];
+                if (profile.exists()) {
+                    names[(*contact)["wa_id"].get_string()] = profile["name"].get_string();
+                }
+            }
+            for (JsonView::Iterator it = messages.begin(); it != messages.end(); ++it) {
+                JsonView msg = *it;
+                Message m;
+                m.channel = "whatsapp";
+                m.id = msg["id"].get_string();
+                if (!m.id.empty() && !message_dedup_.should_process(m.id)) {
+                    LOG_DEBUG("[WhatsApp] Skipping duplicate message %s", m.id.c_str());
+                    continue;
+                }
+                m.from = msg["from"].get_string();
+                std::map<std::string, std::string>::const_iterator name = names.find(m.from);
+                m.from_name = (name != names.end() && !name->second.empty()) ? name->second : m.from;
+                m.to = m.from;   // Cloud API chats are one-to-one; replies go to the sender
+                m.chat_type = "direct";
+                // Cloud API timestamps are decimal strings
+                m.timestamp = std::strtoll(msg["timestamp"].get_string("0").c_str(), NULL, 10);
+                
+                std::string type = msg["type"].get_string();
+                if (type == "text") {
+                    m.text = msg["text"]["body"].get_string();
+                } else if (!type.empty()) {
+                    m.text = msg[type]["caption"].get_string();
+                }
+                JsonView context = msg["context"];
+                if (context.exists()) {
+                    m.reply_to_id = context["id"].get_string();
+                }
+                if (m.text.empty()) continue;
+                
+                LOG_DEBUG("[WhatsApp] ▶ IN  Message from %s (%s): %.200s%s", 
+                          m.from_name.c_str(), m.from.c_str(), m.text.c_str(),
+                          m.text.size() > 200 ? "..." : "");
+                emit_message(m);
+            }
+        }
+    }
+}
+
+void WhatsAppChannel::process_bridge_message(const JsonView& msg) {
     Message m;
     m.channel = "whatsapp";
-    m.id = msg.value("id", std::string(""));
-    m.from = msg.value("from", std::string(""));
-    m.from_name = msg.value("from_name", m.from);
-    m.to = msg.value("to", std::string(""));
-    m.text = msg.value("text", std::string(""));
-    m.timestamp = msg.value("timestamp", int64_t(0));
-    
-    if (msg.value("is_group", false)) {
+    m.id = msg["id"].get_string();
+    // A stream reconnect re-reads /messages and a push may be redelivered
+    if (!m.id.empty() && !message_dedup_.should_process(m.id)) {
+        LOG_DEBUG("[WhatsApp] Skipping duplicate message %s", m.id.c_str());
+        return;
+    }
+    m.from = msg["from"].get_string();
+    m.from_name = msg["from_name"].get_string(m.from);
+    m.to = msg["to"].get_string();
+    m.text = msg["text"].get_string();
+    m.timestamp = msg["timestamp"].get_int();
+    
+    if (msg["is_group"].get_bool()) {
         m.chat_type = "group";
     } else {
         m.chat_type = "direct";
     }
     
-    if (msg.contains("reply_to")) {
-        m.reply_to_id = msg.value("reply_to", std::string(""));
-    }
+    m.reply_to_id = msg["reply_to"].get_string();
     
     LOG_DEBUG("[WhatsApp] ▶ IN  Message from %s (%s): %.200s%s", 
               m.from_name.c_str(), m.from.c_str(), m.text.c_str(),
@@ -0,0 +1,231 @@
+/*
+ * OpenCrank C++ - Skill Index Implementation
+ *
+ * Incremental SKILL.md parsing backed by a JSON index file.
+ */
+#include <opencrank/skills/index.hpp>
+#include <opencrank/core/json.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace opencrank {
+
+static const int SKILL_INDEX_VERSION = 1;
+
+SkillIndex::SkillIndex()
+    : generation_(0)
+    , dirty_(false)
+    , parsed_(0)
+    , reused_(0) {}
+
+bool SkillIndex::load(SkillLoader& loader) {
+    if (path_.empty()) {
+        return false;
+    }
+
+    std::ifstream file(path_.c_str());
+    if (!file.is_open()) {
+        LOG_DEBUG("[Skills] No index at %s, starting fresh", path_.c_str());
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    Json root = Json::parse(buffer.str(), nullptr, false);
+    if (root.is_discarded() || !root.is_object() ||
+        json_utils::get_int(root, "version", 0) != SKILL_INDEX_VERSION ||
+        !root.contains("skills") || !root["skills"].is_array()) {
+        LOG_WARN("[Skills] Ignoring unreadable index %s", path_.c_str());
+        return false;
+    }
+
+    records_.clear();
+    const Json& skills = root["skills"];
+    for (size_t i = 0; i < skills.size(); ++i) {
+        const Json& s = skills[i];
+        Record rec;
+        Skill& skill = rec.entry.skill;
+        skill.file_path = json_utils::get_string(s, "path");
+        skill.base_dir = json_utils::get_string(s, "dir");
+        skill.source = json_utils::get_string(s, "source");
+        skill.name = json_utils::get_string(s, "name");
+        skill.description = json_utils::get_string(s, "description");
+        skill.mtime_ns = json_utils::get_int(s, "mtime_ns", 0);
+        skill.size = s.value("size", static_cast<uint64_t>(0));
+        skill.content_hash = s.value("hash", static_cast<uint64_t>(0));
+        if (skill.file_path.empty() || skill.name.empty()) {
+            continue;
+        }
+
+        if (s.contains("frontmatter") && s["frontmatter"].is_object()) {
+            for (auto it = s["frontmatter"].begin(); it != s["frontmatter"].end(); ++it) {
+                if (it.value().is_string()) {
+                    rec.entry.frontmatter[it.key()] = it.value().get<std::string>();
+                }
+            }
+        }
+        rec.entry.metadata = loader.resolve_metadata(rec.entry.frontmatter);
+        rec.entry.invocation = loader.resolve_invocation_policy(rec.entry.frontmatter);
+        records_[skill.file_path] = rec;
+    }
+
+    dirty_ = false;
+    LOG_INFO("[Skills] Loaded index with %zu skills from %s", records_.size(), path_.c_str());
+    return true;
+}
+
+bool SkillIndex::save() {
+    if (path_.empty() || !dirty_) {
+        return true;
+    }
+
+    Json skills = json_utils::array();
+    for (std::map<std::string, Record>::const_iterator it = records_.begin();
+         it != records_.end(); ++it) {
+        const Skill& skill = it->second.entry.skill;
+        Json s = json_utils::object();
+        s["path"] = skill.file_path;
+        s["dir"] = skill.base_dir;
+        s["source"] = skill.source;
+        s["name"] = skill.name;
+        s["description"] = skill.description;
+        s["mtime_ns"] = skill.mtime_ns;
+        s["size"] = skill.size;
+        s["hash"] = skill.content_hash;
+        Json fm = json_utils::object();
+        for (SkillFrontmatter::const_iterator f = it->second.entry.frontmatter.begin();
+             f != it->second.entry.frontmatter.end(); ++f) {
+            fm[f->first] = sanitize_utf8(f->second);
+        }
+        s["frontmatter"] = fm;
+        skills.push_back(s);
+    }
+
+    Json root = json_utils::object();
+    root["version"] = SKILL_INDEX_VERSION;
+    root["skills"] = skills;
+
+    // Write a sibling file and rename so a crash never leaves half an index
+    create_parent_directory(path_);
+    std::string tmp = path_ + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_WARN("[Skills] Cannot write index %s", tmp.c_str());
+            return false;
+        }
+        out << root.dump();
+        if (!out.good()) {
+            LOG_WARN("[Skills] Failed writing index %s", tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+        LOG_WARN("[Skills] Cannot replace index %s", path_.c_str());
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    dirty_ = false;
+    LOG_DEBUG("[Skills] Saved index with %zu skills to %s", records_.size(), path_.c_str());
+    return true;
+}
+
+void SkillIndex::begin_scan() {
+    ++generation_;
+    parsed_ = 0;
+    reused_ = 0;
+}
+
+void SkillIndex::end_scan() {
+    std::map<std::string, Record>::iterator it = records_.begin();
+    while (it != records_.end()) {
+        if (it->second.seen != generation_) {
+            LOG_DEBUG("[Skills] Dropping removed skill: %s", it->first.c_str());
+            records_.erase(it++);
+            dirty_ = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<SkillEntry> SkillIndex::scan_dir(
+    SkillLoader& loader,
+    const std::string& dir,
+    const std::string& source) {
+
+    std::vector<SkillEntry> entries;
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        LOG_DEBUG("[Skills] Directory does not exist: %s", dir.c_str());
+        return entries;
+    }
+
+    std::vector<std::string> subdirs;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] != '.') {
+            subdirs.push_back(de->d_name);
+        }
+    }
+    closedir(d);
+
+    for (size_t i = 0; i < subdirs.size(); ++i) {
+        std::string skill_dir = dir + "/" + subdirs[i];
+        std::string skill_file = skill_dir + "/SKILL.md";
+
+        struct stat st;
+        if (stat(skill_file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        uint64_t size = static_cast<uint64_t>(st.st_size);
+
+        std::map<std::string, Record>::iterator it = records_.find(skill_file);
+        if (it != records_.end() &&
+            it->second.entry.skill.mtime_ns == mtime_ns &&
+            it->second.entry.skill.size == size &&
+            it->second.entry.skill.source == source) {
+            it->second.seen = generation_;
+            entries.push_back(it->second.entry);
+            ++reused_;
+            continue;
+        }
+
+        Skill skill = loader.load_skill(skill_dir, source);
+        if (skill.empty()) {
+            continue;
+        }
+
+        Record& rec = records_[skill_file];
+        if (rec.entry.skill.content_hash == skill.content_hash &&
+            rec.entry.skill.source == source && !rec.entry.empty()) {
+            // Touched but identical: keep the parsed entry
+            rec.entry.skill.mtime_ns = skill.mtime_ns;
+            rec.entry.skill.size = skill.size;
+            ++reused_;
+        } else {
+            rec.entry = loader.build_entry(skill);
+            rec.entry.skill.content.clear();
+            ++parsed_;
+            LOG_DEBUG("[Skills] Parsed %s", skill_file.c_str());
+        }
+        rec.seen = generation_;
+        dirty_ = true;
+
+        if (!rec.entry.empty()) {
+            entries.push_back(rec.entry);
+        }
+    }
+
+    return entries;
+}
+
+} // namespace opencrank
@@ -5,6 +5,7 @@
  */
 #include <opencrank/skills/loader.hpp>
 #include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
@@ -59,7 +60,8 @@ Skill SkillLoader::load_skill(const std::string& skill_dir, const std::string& s
     std::string skill_file = skill_dir + "/SKILL.md";
     LOG_DEBUG("Looking for skill file: %s", skill_file.c_str());
     
-    if (!file_exists(skill_file)) {
+    struct stat st;
+    if (stat(skill_file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
         LOG_DEBUG("SKILL.md not found in: %s", skill_dir.c_str());
         return skill;
     }
@@ -91,6 +93,9 @@ Skill SkillLoader::load_skill(const std::string& skill_dir, const std::string& s
     skill.base_dir = skill_dir;
     skill.source = source;
     skill.content = content;
+    skill.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    skill.size = static_cast<uint64_t>(st.st_size);
+    skill.content_hash = fnv1a_64(content);
     
     LOG_DEBUG("Loaded skill: name='%s', description='%s', path='%s'",
               skill.name.c_str(), skill.description.c_str(), skill.file_path.c_str());
@@ -238,6 +243,14 @@ SkillEntry SkillLoader::build_entry(const Skill& skill) {
     return entry;
 }
 
+std::string SkillLoader::read_body(const Skill& skill) {
+    if (!skill.content.empty()) {
+        return get_content_body(skill.content);
+    }
+    std::string content = read_file(skill.file_path);
+    return content.empty() ? "" : get_content_body(content);
+}
+
 std::string SkillLoader::get_content_body(const std::string& content) {
     // Skip frontmatter
     if (content.size() < 3 || content.substr(0, 3) != "---") {
@@ -4,19 +4,12 @@
  * Manages skills loading, filtering, and prompt generation.
  */
 #include <opencrank/skills/manager.hpp>
+#include <opencrank/skills/requirements.hpp>
 #include <opencrank/core/logger.hpp>
 #include <sstream>
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
-#include <sys/stat.h>
-
-#ifdef _WIN32
-#include <direct.h>
-#define PATH_SEP '\\'
-#else
-#include <unistd.h>
-#define PATH_SEP '/'
-#endif
 
 namespace opencrank {
 
@@ -30,15 +23,36 @@ SkillManager::SkillManager(const SkillsConfig& config) : config_(config) {}
 SkillManager::~SkillManager() {}
 
 void SkillManager::set_config(const SkillsConfig& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
     config_ = config;
+    if (config_.index_path != index_.path()) {
+        index_ = SkillIndex();
+        index_.set_path(config_.index_path);
+        index_.load(loader_);
+    }
+}
+
+std::vector<std::string> SkillManager::skill_dirs() const {
+    std::vector<std::string> dirs(config_.extra_dirs.begin(), config_.extra_dirs.end());
+    if (!config_.bundled_skills_dir.empty()) {
+        dirs.push_back(config_.bundled_skills_dir);
+    }
+    if (!config_.managed_skills_dir.empty()) {
+        dirs.push_back(config_.managed_skills_dir);
+    }
+    if (!config_.workspace_dir.empty()) {
+        dirs.push_back(config_.workspace_dir + "/skills");
+    }
+    return dirs;
 }
 
 std::vector<SkillEntry> SkillManager::load_workspace_skill_entries() {
-    LOG_INFO(" Loading workspace skill entries...");
     LOG_DEBUG("Loading workspace skill entries");
+    std::lock_guard<std::mutex> lock(mutex_);
     std::map<std::string, SkillEntry> merged;
     
     // Precedence: extra < bundled < managed < workspace
+    index_.begin_scan();
     
     // 1. Load from extra directories
     LOG_DEBUG("Loading from %zu extra directories", config_.extra_dirs.size());
@@ -84,14 +98,21 @@ std::vector<SkillEntry> SkillManager::load_workspace_skill_entries() {
         }
     }
     
+    index_.end_scan();
+    if (index_.dirty()) {
+        index_.save();
+    }
+    
     // Convert map to vector
     std::vector<SkillEntry> result;
+    result.reserve(merged.size());
     for (std::map<std::string, SkillEntry>::iterator it = merged.begin();
          it != merged.end(); ++it) {
-        result.push_back(it->second);
+        result.push_back(std::move(it->second));
     }
     
-    LOG_DEBUG("Total skills after merge: %zu", result.size());
+    LOG_INFO("[Skills] Scanned %zu skills (%zu parsed, %zu unchanged)",
+             result.size(), index_.parsed(), index_.reused());
     return result;
 }
 
@@ -99,19 +120,13 @@ std::vector<SkillEntry> SkillManager::load_entries_from_dir(
     const std::string& dir,
     const std::string& source) {
     
-    LOG_INFO(" load_entries_from_dir called: dir='%s', source='%s'", dir.c_str(), source.c_str());
-    std::vector<SkillEntry> entries;
-    std::vector<Skill> skills = loader_.load_from_dir(dir, source);
-    LOG_INFO(" load_from_dir returned %zu skills", skills.size());
-    
-    for (size_t i = 0; i < skills.size(); ++i) {
-        SkillEntry entry = loader_.build_entry(skills[i]);
-        if (!entry.empty()) {
-            entries.push_back(entry);
-        }
-    }
-    
-    return entries;
+    LOG_DEBUG("load_entries_from_dir: dir='%s', source='%s'", dir.c_str(), source.c_str());
+    return index_.scan_dir(loader_, dir, source);
+}
+
+std::string SkillManager::load_skill_body(const SkillEntry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loader_.read_body(entry.skill);
 }
 
 std::vector<SkillEntry> SkillManager::filter_skill_entries(
@@ -119,6 +134,7 @@ std::vector<SkillEntry> SkillManager::filter_skill_entries(
     const SkillEligibilityContext* eligibility) {
     
     LOG_DEBUG("Filtering %zu skill entries", entries.size());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     std::vector<SkillEntry> filtered;
     
     for (size_t i = 0; i < entries.size(); ++i) {
@@ -143,11 +159,13 @@ std::vector<SkillEntry> SkillManager::filter_skill_entries(
                 final_filtered.push_back(filtered[i]);
             }
         }
-        LOG_DEBUG("After filter: %zu skills", final_filtered.size());
-        return final_filtered;
+        filtered.swap(final_filtered);
+        LOG_DEBUG("After filter: %zu skills", filtered.size());
     }
     
-    LOG_DEBUG("Filter complete: %zu eligible skills", filtered.size());
+    LOG_DEBUG("Filter complete: %zu eligible skills in %lldus", filtered.size(),
+              static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start).count()));
     return filtered;
 }
 
@@ -606,38 +624,11 @@ std::string SkillManager::resolve_unique_skill_command_name(
 }
 
 bool SkillManager::has_binary(const std::string& bin) {
-    // Check if binary exists in PATH
-    const char* path_env = getenv("PATH");
-    if (!path_env) {
-        return false;
-    }
-    
-    std::string path_str = path_env;
-    
-#ifdef _WIN32
-    char delim = ';';
-    std::string exe_suffix = ".exe";
-#else
-    char delim = ':';
-    std::string exe_suffix = "";
-#endif
-    
-    std::istringstream iss(path_str);
-    std::string dir;
-    while (std::getline(iss, dir, delim)) {
-        std::string full_path = dir + PATH_SEP + bin + exe_suffix;
-        struct stat st;
-        if (stat(full_path.c_str(), &st) == 0 && (st.st_mode & S_IXUSR)) {
-            return true;
-        }
-    }
-    
-    return false;
+    return SkillRequirementResolver::instance().has_binary(bin);
 }
 
 bool SkillManager::has_env(const std::string& var) {
-    const char* val = getenv(var.c_str());
-    return val != NULL && val[0] != '\0';
+    return SkillRequirementResolver::instance().has_env(var);
 }
 
 std::string SkillManager::get_platform() {
@@ -0,0 +1,150 @@
+/*
+ * OpenCrank C++ - Skill Requirement Resolver Implementation
+ */
+#include <opencrank/skills/requirements.hpp>
+#include <opencrank/core/logger.hpp>
+#include <opencrank/core/utils.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace opencrank {
+
+// Anything that can add, remove or re-permission a binary
+static const uint32_t PATH_DIR_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                      IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+SkillRequirementResolver& SkillRequirementResolver::instance() {
+    static SkillRequirementResolver resolver;
+    return resolver;
+}
+
+SkillRequirementResolver::SkillRequirementResolver()
+    : path_synced_(false)
+    , ttl_ms_(300000)
+    , watch_fd_(-1)
+    , lookups_(0)
+    , probes_(0)
+    , invalidations_(0)
+    , probe_us_(0) {}
+
+SkillRequirementResolver::~SkillRequirementResolver() {
+    if (watch_fd_ >= 0) {
+        close(watch_fd_);
+    }
+}
+
+void SkillRequirementResolver::set_ttl_ms(int64_t ttl_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ttl_ms_ = ttl_ms < 0 ? 0 : ttl_ms;
+}
+
+bool SkillRequirementResolver::has_binary(const std::string& bin) {
+    lookups_.fetch_add(1);
+    std::lock_guard<std::mutex> lock(mutex_);
+    sync_path_locked();
+    drain_watch_locked();
+
+    int64_t now = current_timestamp_ms();
+    std::map<std::string, Answer>::iterator it = binaries_.find(bin);
+    if (it != binaries_.end() && (ttl_ms_ == 0 || now - it->second.checked_ms < ttl_ms_)) {
+        return it->second.found;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool found = probe_locked(bin);
+    int64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    probes_.fetch_add(1);
+    probe_us_.fetch_add(static_cast<uint64_t>(elapsed_us));
+
+    Answer& answer = binaries_[bin];
+    answer.found = found;
+    answer.checked_ms = now;
+    return found;
+}
+
+bool SkillRequirementResolver::has_env(const std::string& var) {
+    const char* val = getenv(var.c_str());
+    return val != NULL && val[0] != '\0';
+}
+
+void SkillRequirementResolver::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    binaries_.clear();
+    invalidations_.fetch_add(1);
+}
+
+void SkillRequirementResolver::sync_path_locked() {
+    const char* env = getenv("PATH");
+    std::string path = env ? env : "";
+    if (path_synced_ && path == path_env_) {
+        return;
+    }
+    path_synced_ = true;
+
+    if (!binaries_.empty()) {
+        binaries_.clear();
+        invalidations_.fetch_add(1);
+    }
+    path_env_ = path;
+    path_dirs_.clear();
+    std::istringstream iss(path);
+    std::string dir;
+    while (std::getline(iss, dir, ':')) {
+        if (!dir.empty()) {
+            path_dirs_.push_back(dir);
+        }
+    }
+
+    // Fresh inotify instance: dropping the old fd drops its watches
+    if (watch_fd_ >= 0) {
+        close(watch_fd_);
+    }
+    watch_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd_ < 0) {
+        LOG_DEBUG("[Skills] inotify unavailable, binary checks expire by TTL only");
+        return;
+    }
+    size_t watched = 0;
+    for (size_t i = 0; i < path_dirs_.size(); ++i) {
+        if (inotify_add_watch(watch_fd_, path_dirs_[i].c_str(), PATH_DIR_MASK) >= 0) {
+            ++watched;
+        }
+    }
+    LOG_DEBUG("[Skills] Watching %zu/%zu PATH directories for binary changes",
+              watched, path_dirs_.size());
+}
+
+void SkillRequirementResolver::drain_watch_locked() {
+    if (watch_fd_ < 0) {
+        return;
+    }
+
+    // Contents do not matter: any event means a binary may have appeared or gone
+    bool changed = false;
+    char buf[4096];
+    while (read(watch_fd_, buf, sizeof(buf)) > 0) {
+        changed = true;
+    }
+    if (changed && !binaries_.empty()) {
+        binaries_.clear();
+        invalidations_.fetch_add(1);
+    }
+}
+
+bool SkillRequirementResolver::probe_locked(const std::string& bin) const {
+    for (size_t i = 0; i < path_dirs_.size(); ++i) {
+        std::string full_path = path_dirs_[i] + "/" + bin;
+        struct stat st;
+        if (stat(full_path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace opencrank
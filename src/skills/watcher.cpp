@@ -0,0 +1,111 @@
+/*
+ * OpenCrank C++ - Skill Directory Watcher Implementation
+ */
+#include <opencrank/skills/watcher.hpp>
+#include <opencrank/core/logger.hpp>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace opencrank {
+
+static const uint32_t ROOT_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+static const uint32_t SKILL_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+SkillWatcher::SkillWatcher() : fd_(-1) {}
+
+SkillWatcher::~SkillWatcher() {
+    stop();
+}
+
+bool SkillWatcher::watch(const std::vector<std::string>& roots) {
+    if (fd_ < 0) {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) {
+            LOG_WARN("[Skills] inotify unavailable (%s), skills reload on restart only", strerror(errno));
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < roots.size(); ++i) {
+        DIR* d = opendir(roots[i].c_str());
+        if (!d) {
+            continue;
+        }
+        add(roots[i], true);
+        struct dirent* de;
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.') continue;
+            std::string sub = roots[i] + "/" + de->d_name;
+            struct stat st;
+            if (stat(sub.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+                add(sub, false);
+            }
+        }
+        closedir(d);
+    }
+
+    LOG_DEBUG("[Skills] Watching %zu directories", watches_.size());
+    return true;
+}
+
+void SkillWatcher::add(const std::string& path, bool root) {
+    // Re-adding a watched path returns the same descriptor
+    int wd = inotify_add_watch(fd_, path.c_str(), root ? ROOT_MASK : SKILL_MASK);
+    if (wd < 0) {
+        LOG_DEBUG("[Skills] Cannot watch %s: %s", path.c_str(), strerror(errno));
+        return;
+    }
+    watches_[wd] = root;
+}
+
+void SkillWatcher::stop() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    watches_.clear();
+}
+
+bool SkillWatcher::drain() {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    bool changed = false;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(fd_, buf, sizeof(buf));
+        if (n <= 0) {
+            break;  // EAGAIN: drained
+        }
+        for (char* p = buf; p < buf + n; ) {
+            const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_IGNORED) {
+                watches_.erase(ev->wd);
+                continue;
+            }
+            std::map<int, bool>::const_iterator it = watches_.find(ev->wd);
+            if (it == watches_.end()) {
+                continue;
+            }
+            if (it->second) {
+                // Root: only skill directories coming and going matter
+                if (ev->mask & IN_ISDIR) changed = true;
+            } else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                changed = true;
+            } else if (ev->len > 0 && strcmp(ev->name, "SKILL.md") == 0) {
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+} // namespace opencrank